@@ -117,6 +117,7 @@ class Display:
 
     _layer_rotate_buffer = None
     _layer_disp_buffers = [None for i in range(0, K_VO_MAX_CHN_NUMS)]
+    _layer_src_images = [None for i in range(0, K_VO_MAX_CHN_NUMS)]
     _layer_configured = [False for i in range(0, K_VO_MAX_CHN_NUMS)]
 
     # src (mod, dev, layer)
@@ -386,6 +387,7 @@ class Display:
             if isinstance(cls._layer_disp_buffers[i], MediaManager.Buffer):
                 cls._layer_disp_buffers[i].__del__()
                 cls._layer_disp_buffers[i] = None
+            cls._layer_src_images[i] = None
 
         cls._osd_layer_num = 1
         cls._write_back_to_ide = False
@@ -661,6 +663,7 @@ class Display:
                 cls._layer_disp_buffers[layer] = MediaManager.Buffer.get(4 * cls._width * cls._height)
             except Exception as e:
                 raise RuntimeError(f"get display buffer failed")
+            cls._layer_src_images[layer] = None
             # finally:
             #     print(f"get disp buffer {cls._layer_disp_buffers[layer]}")
 
@@ -715,11 +718,16 @@ class Display:
 
             machine.mem_copy(cls._layer_rotate_buffer.virt_addr, img.virtaddr(), img.size())
             kd_mpi_vo_osd_rotation(flag, input_frame, output_frame)
+            cls._layer_src_images[layer] = None
 
             # cls._layer_rotate_buffer.__del__()
             # cls._layer_rotate_buffer = None
         else:
-            machine.mem_copy(cls._layer_disp_buffers[layer].virt_addr, img.virtaddr(), img.size())
+            # only the regions changed since the last show are copied when the same image
+            # is shown again with img.track_dirty() enabled, otherwise the whole image.
+            full = cls._layer_src_images[layer] is not img
+            cls._layer_src_images[layer] = img
+            img.flush_dirty(cls._layer_disp_buffers[layer].virt_addr, full)
 
         cls._config_layer(layer, (x, y, width, height), pixelformat, flag, alpha)
 
@@ -862,6 +862,9 @@ main_thread_exit:
     extern void freetype_deinit(void);
     freetype_deinit();
 
+    extern void imlib_deinit_all(void);
+    imlib_deinit_all();
+
     // release all block
     vb_mgmt_deinit();
 
@@ -32,9 +32,20 @@
 // Enable ISP ops
 #define IMLIB_ENABLE_ISP_OPS
 
+// Enable image.ColorCorrection (single pass awb/ccm/saturation/gamma)
+#if defined(IMLIB_ENABLE_ISP_OPS)
+#define IMLIB_ENABLE_COLOR_CORR
+#endif
+
 // Enable binary ops
 #define IMLIB_ENABLE_BINARY_OPS
 
+// Enable adaptive_threshold()
+#define IMLIB_ENABLE_ADAPTIVE_THRESHOLD
+
+// Enable image.CLAHE (temporal histeq(adaptive=True) state)
+#define IMLIB_ENABLE_CLAHE
+
 // Enable math ops
 #define IMLIB_ENABLE_MATH_OPS
 
@@ -56,6 +67,11 @@
 // Enable morph()
 #define IMLIB_ENABLE_MORPH
 
+// Enable image.Pipeline (fused binary/math ops, erode/dilate and morph)
+#if defined(IMLIB_ENABLE_BINARY_OPS) && defined(IMLIB_ENABLE_MATH_OPS)
+#define IMLIB_ENABLE_PIPELINE
+#endif
+
 // Enable Gaussian
 #define IMLIB_ENABLE_GAUSSIAN
 
@@ -80,6 +96,11 @@
 // Enable rotation_corr()
 #define IMLIB_ENABLE_ROTATION_CORR
 
+// Enable image.Remap (used by lens_corr() and rotation_corr())
+#if defined(IMLIB_ENABLE_LENS_CORR) || defined(IMLIB_ENABLE_ROTATION_CORR)
+#define IMLIB_ENABLE_REMAP
+#endif
+
 // Enable phasecorrelate()
 #if defined(IMLIB_ENABLE_ROTATION_CORR)
 #define IMLIB_ENABLE_FIND_DISPLACEMENT
@@ -128,6 +149,9 @@
 // #define IMLIB_ENABLE_TF
 // #endif
 
+// Enable image.Pyramid
+#define IMLIB_ENABLE_PYRAMID
+
 // Enable FAST (20+ KBs).
 #define IMLIB_ENABLE_FAST
 
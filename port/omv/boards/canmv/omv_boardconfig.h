@@ -30,4 +30,9 @@
 
 #define OMV_JPEG_BUF_SIZE                     (1024 * 1024) // IDE JPEG buffer (header + data).
 
+// Hardware encoder channel for the IDE frame buffer. By default it shares the channel image.compress()
+// reserves (the last one). Any other channel is taken from scripts (media VENC_CHN_ID_x) while the IDE
+// is connected, but spares the shared channel from rebuilds when both encode at different sizes.
+#define OMV_IDE_JPEG_VENC_CHN                 (VENC_MAX_CHN_NUMS - 1)
+
 #endif //__OMV_BOARDCONFIG_H__
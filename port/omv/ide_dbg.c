@@ -183,6 +183,7 @@ volatile bool repl_script_running = false;
 
 void mpy_start_script(char* filepath);
 void mpy_stop_script();
+static void ide_fb_reset(bool release);
 static char *script_string = NULL;
 static sem_t script_sem;
 static bool ide_attached = false;
@@ -224,6 +225,7 @@ void ide_dbg_on_script_end(void) {
         ide_attached = false;
     }
     fb_from = FB_FROM_NONE;
+    ide_fb_reset(true);
 
     repl_script_running = false;
 }
@@ -244,23 +246,96 @@ void interrupt_ide(void) {
 }
 
 static bool enable_pic = true;
-static void* fb_data = NULL;
-static uint32_t fb_size = 0, fb_width = 0, fb_height = 0;
-static pthread_mutex_t fb_mutex;
-// FIXME: reuse buf
+static pthread_mutex_t fb_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// User set frames go through a triple buffer. The script fills whichever slot is neither
+// pending nor being sent and publishes it, the IDE thread takes the latest published slot
+// and sends it without holding fb_mutex, so neither side waits for the other and a frame
+// the IDE did not fetch in time is replaced by a newer one instead of blocking it.
+#define FB_RING_SLOTS 3
+
+typedef struct {
+    void* data;
+    uint32_t capacity;
+    uint32_t size, width, height;
+} ide_fb_slot_t;
+
+static ide_fb_slot_t fb_ring[FB_RING_SLOTS];
+static int fb_ring_pending = -1; // latest published slot
+static int fb_ring_sending = -1; // slot owned by the IDE thread
+
+// Frames whose hash matches the last one handed to the IDE are not sent again.
+#define FB_HASH_INIT 2166136261U
+static uint32_t fb_hash_last = 0;
+static bool fb_hash_valid = false;
+
+// FNV-1a over 32-bit words, enough to tell whether a frame changed since the last one.
+static uint32_t ide_fb_hash(uint32_t hash, const void* data, size_t size) {
+    const uint32_t* words = data;
+    size_t n = ((uintptr_t)data & 3) ? 0 : (size / 4);
+    for (size_t i = 0; i < n; i++) {
+        hash = (hash ^ words[i]) * 16777619U;
+    }
+    const uint8_t* bytes = data;
+    for (size_t i = n * 4; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 16777619U;
+    }
+    return hash;
+}
+
+// Drops the queued frame and the unchanged-frame hash, e.g. when the IDE (re)connects or
+// the frame source changes. With release set the script must not be producing anymore,
+// buffers of the idle slots are then freed.
+static void ide_fb_reset(bool release) {
+    pthread_mutex_lock(&fb_mutex);
+    fb_ring_pending = -1;
+    fb_hash_valid = false;
+    for (int i = 0; release && (i < FB_RING_SLOTS); i++) {
+        if (i != fb_ring_sending) {
+            free(fb_ring[i].data);
+            memset(&fb_ring[i], 0, sizeof(fb_ring[i]));
+        }
+    }
+    pthread_mutex_unlock(&fb_mutex);
+}
+
 void ide_set_fb(const void* data, uint32_t size, uint32_t width, uint32_t height) {
+    if (!ide_attached || !enable_pic) {
+        return;
+    }
+    uint32_t hash = ide_fb_hash(FB_HASH_INIT, data, size);
+
     pthread_mutex_lock(&fb_mutex);
     fb_from = FB_FROM_USER_SET;
-    if (fb_data) {
-        // not sended
+    if (fb_hash_valid && (hash == fb_hash_last)) {
         pthread_mutex_unlock(&fb_mutex);
         return;
     }
-    fb_data = malloc(size);
-    memcpy((void*)fb_data, data, size);
-    fb_size = size;
-    fb_width = width;
-    fb_height = height;
+    int slot = 0;
+    while ((slot == fb_ring_pending) || (slot == fb_ring_sending)) {
+        slot++;
+    }
+    pthread_mutex_unlock(&fb_mutex);
+
+    // Only this thread writes to a slot that is neither pending nor sending.
+    ide_fb_slot_t* s = &fb_ring[slot];
+    if (s->capacity < size) {
+        void* buffer = realloc(s->data, size);
+        if (buffer == NULL) {
+            return;
+        }
+        s->data = buffer;
+        s->capacity = size;
+    }
+    memcpy(s->data, data, size);
+    s->size = size;
+    s->width = width;
+    s->height = height;
+
+    pthread_mutex_lock(&fb_mutex);
+    fb_ring_pending = slot;
+    fb_hash_last = hash;
+    fb_hash_valid = true;
     pthread_mutex_unlock(&fb_mutex);
 }
 
@@ -280,6 +355,9 @@ static void* wbc_jpeg_buffer = NULL;
 static size_t wbc_jpeg_buffer_size = 0;
 static uint32_t wbc_jpeg_size = 0;
 static int wbc_jpeg_quality = 90;
+static int wbc_jpeg_quality_max = 90;
+static uint32_t wbc_usb_rate = 0; // bytes per ms
+static int wbc_quality_trend = 0; // >0: frames over budget in a row, <0: frames under half of it
 static uint16_t wbc_width, wbc_height;
 static k_video_frame_info frame_info;
 #if ENABLE_BUFFER_ROTATION
@@ -399,8 +477,13 @@ int ide_dbg_set_vo_wbc(int quality, int width, int height)
     wbc_width = width;
     wbc_height = height;
     wbc_jpeg_quality = (0x00 != quality) ? quality : 10;
+    wbc_jpeg_quality_max = wbc_jpeg_quality;
+    wbc_usb_rate = 0;
+    wbc_quality_trend = 0;
 #endif // ENABLE_VO_WRITEBACK
 
+    ide_fb_reset(false);
+
 #if ENABLE_BUFFER_ROTATION
     if(flag) {
         if (0x00 == vo_wbc_flag) {
@@ -564,7 +647,73 @@ static void rotation270_u16(uint16_t* __restrict dst, uint16_t* __restrict src,
 }
 #endif
 
-extern int hd_jpeg_encode(k_video_frame_info* frame, void** buffer, size_t size, int timeout, int quality, void*(*realloc)(void*, unsigned long));
+extern int hd_jpeg_encode_ide(k_video_frame_info* frame, void** buffer, size_t size, int timeout, int quality, void*(*realloc)(void*, unsigned long));
+
+#if ENABLE_VO_WRITEBACK
+// The writeback JPEG quality follows the measured USB throughput: it drops once frames
+// keep exceeding the per-frame budget and climbs back to the requested quality once they
+// keep taking less than half of it. Each step needs a run of consecutive frames on the
+// same side (shorter going down than up) so the quality does not oscillate.
+#define WBC_JPEG_QUALITY_MIN 30
+#define WBC_FRAME_BUDGET_MS 40
+#define WBC_QUALITY_DOWN_FRAMES 3
+#define WBC_QUALITY_UP_FRAMES 15
+
+static uint64_t ide_dbg_time_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
+}
+
+static void ide_dbg_wbc_adapt_quality(uint32_t size, uint64_t us) {
+    uint32_t rate = (size * 1000ULL) / (us ? us : 1);
+    wbc_usb_rate = wbc_usb_rate ? (((wbc_usb_rate * 3) + rate) / 4) : rate;
+
+    uint32_t budget = wbc_usb_rate * WBC_FRAME_BUDGET_MS;
+    if (size > budget) {
+        wbc_quality_trend = (wbc_quality_trend > 0) ? (wbc_quality_trend + 1) : 1;
+    } else if ((size * 2) < budget) {
+        wbc_quality_trend = (wbc_quality_trend < 0) ? (wbc_quality_trend - 1) : -1;
+    } else {
+        wbc_quality_trend = 0;
+    }
+
+    if ((wbc_quality_trend >= WBC_QUALITY_DOWN_FRAMES) && (wbc_jpeg_quality > WBC_JPEG_QUALITY_MIN)) {
+        wbc_jpeg_quality = (wbc_jpeg_quality - 10 < WBC_JPEG_QUALITY_MIN) ? WBC_JPEG_QUALITY_MIN : (wbc_jpeg_quality - 10);
+        wbc_quality_trend = 0;
+    } else if ((wbc_quality_trend <= -WBC_QUALITY_UP_FRAMES) && (wbc_jpeg_quality < wbc_jpeg_quality_max)) {
+        wbc_jpeg_quality = (wbc_jpeg_quality + 5 > wbc_jpeg_quality_max) ? wbc_jpeg_quality_max : (wbc_jpeg_quality + 5);
+        wbc_quality_trend = 0;
+    }
+}
+
+// Hashes the writeback frame so an idle screen is neither encoded nor sent again.
+static bool ide_dbg_wbc_unchanged(k_video_frame_info* frame, unsigned ysize, unsigned uvsize) {
+    if ((frame->v_frame.pixel_format != PIXEL_FORMAT_YUV_SEMIPLANAR_420) &&
+        (frame->v_frame.pixel_format != PIXEL_FORMAT_YVU_SEMIPLANAR_420)) {
+        return false;
+    }
+
+    uint32_t hash = FB_HASH_INIT;
+    unsigned sizes[2] = {ysize, uvsize};
+    for (int i = 0; i < 2; i++) {
+        void* plane = kd_mpi_sys_mmap_cached(frame->v_frame.phys_addr[i], sizes[i]);
+        if (plane == NULL) {
+            return false;
+        }
+        kd_mpi_sys_mmz_flush_cache(frame->v_frame.phys_addr[i], plane, sizes[i]);
+        hash = ide_fb_hash(hash, plane, sizes[i]);
+        kd_mpi_sys_munmap(plane, sizes[i]);
+    }
+
+    pthread_mutex_lock(&fb_mutex);
+    bool unchanged = fb_hash_valid && (hash == fb_hash_last);
+    fb_hash_last = hash;
+    fb_hash_valid = true;
+    pthread_mutex_unlock(&fb_mutex);
+    return unchanged;
+}
+#endif
 
 static ide_dbg_status_t ide_dbg_update(ide_dbg_state_t* state, const uint8_t* data, size_t length) {
     for (size_t i = 0; i < length;) {
@@ -833,11 +982,15 @@ static ide_dbg_status_t ide_dbg_update(ide_dbg_state_t* state, const uint8_t* da
                         fb_from_current = fb_from;
                         if (fb_from_current == FB_FROM_USER_SET) {
                             pthread_mutex_lock(&fb_mutex);
-                            if (fb_data) {
+                            if ((fb_ring_sending < 0) && (fb_ring_pending >= 0)) {
+                                fb_ring_sending = fb_ring_pending;
+                                fb_ring_pending = -1;
+                            }
+                            if (fb_ring_sending >= 0) {
                                 pr_verb("[omv] use user set fb");
-                                resp[0] = fb_width;
-                                resp[1] = fb_height;
-                                resp[2] = fb_size;
+                                resp[0] = fb_ring[fb_ring_sending].width;
+                                resp[1] = fb_ring[fb_ring_sending].height;
+                                resp[2] = fb_ring[fb_ring_sending].size;
                             }
                             pthread_mutex_unlock(&fb_mutex);
                         #if ENABLE_VO_WRITEBACK
@@ -851,6 +1004,10 @@ static ide_dbg_status_t ide_dbg_update(ide_dbg_state_t* state, const uint8_t* da
                                 int ssize = 0;
                                 unsigned ysize = frame_info.v_frame.width * frame_info.v_frame.height;
                                 unsigned uvsize = ysize / 2;
+                                if (ide_dbg_wbc_unchanged(&frame_info, ysize, uvsize)) {
+                                    kd_mpi_wbc_dump_release(&frame_info);
+                                    goto skip;
+                                }
                                 #define FIX_UV_OFFSET 0
                                 #if FIX_UV_OFFSET
                                 {
@@ -894,7 +1051,7 @@ static ide_dbg_status_t ide_dbg_update(ide_dbg_state_t* state, const uint8_t* da
                                     kd_mpi_sys_mmz_flush_cache(frame_info.v_frame.phys_addr[1], uv, uvsize);
                                     kd_mpi_sys_munmap(uv, uvsize);
 
-                                    ssize = hd_jpeg_encode(&rotation_buffer, &wbc_jpeg_buffer, wbc_jpeg_buffer_size, 1000, wbc_jpeg_quality, realloc);
+                                    ssize = hd_jpeg_encode_ide(&rotation_buffer, &wbc_jpeg_buffer, wbc_jpeg_buffer_size, 1000, wbc_jpeg_quality, realloc);
                                 } else if (K_ROTATION_270 == (vo_wbc_flag & K_ROTATION_270)) {
                                     // y
                                     uint8_t* y = kd_mpi_sys_mmap_cached(frame_info.v_frame.phys_addr[0], ysize);
@@ -910,12 +1067,12 @@ static ide_dbg_status_t ide_dbg_update(ide_dbg_state_t* state, const uint8_t* da
                                     kd_mpi_sys_mmz_flush_cache(frame_info.v_frame.phys_addr[1], uv, uvsize);
                                     kd_mpi_sys_munmap(uv, uvsize);
 
-                                    ssize = hd_jpeg_encode(&rotation_buffer, &wbc_jpeg_buffer, wbc_jpeg_buffer_size, 1000, wbc_jpeg_quality, realloc);
+                                    ssize = hd_jpeg_encode_ide(&rotation_buffer, &wbc_jpeg_buffer, wbc_jpeg_buffer_size, 1000, wbc_jpeg_quality, realloc);
                                 } else {
-                                    ssize = hd_jpeg_encode(&frame_info, &wbc_jpeg_buffer, wbc_jpeg_buffer_size, 1000, wbc_jpeg_quality, realloc);
+                                    ssize = hd_jpeg_encode_ide(&frame_info, &wbc_jpeg_buffer, wbc_jpeg_buffer_size, 1000, wbc_jpeg_quality, realloc);
                                 }
                                 #else
-                                ssize = hd_jpeg_encode(&frame_info, &wbc_jpeg_buffer, wbc_jpeg_buffer_size, 1000, wbc_jpeg_quality, realloc);
+                                ssize = hd_jpeg_encode_ide(&frame_info, &wbc_jpeg_buffer, wbc_jpeg_buffer_size, 1000, wbc_jpeg_quality, realloc);
                                 #endif
                                 if (0) {
                                     // dump raw file
@@ -968,15 +1125,19 @@ static ide_dbg_status_t ide_dbg_update(ide_dbg_state_t* state, const uint8_t* da
                     }
                     case USBDBG_FRAME_DUMP: {
                         if (fb_from_current == FB_FROM_USER_SET) {
-                            pthread_mutex_lock(&fb_mutex);
-                            usb_tx((void*)fb_data, fb_size);
-                            free((void*)fb_data);
-                            fb_data = NULL;
-                            pthread_mutex_unlock(&fb_mutex);
+                            // the sending slot is ours until released, send it unlocked
+                            if (fb_ring_sending >= 0) {
+                                usb_tx(fb_ring[fb_ring_sending].data, fb_ring[fb_ring_sending].size);
+                                pthread_mutex_lock(&fb_mutex);
+                                fb_ring_sending = -1;
+                                pthread_mutex_unlock(&fb_mutex);
+                            }
                         }
                         #if ENABLE_VO_WRITEBACK
                         else if (fb_from_current == FB_FROM_VO_WRITEBACK) {
+                            uint64_t start = ide_dbg_time_us();
                             usb_tx(wbc_jpeg_buffer, wbc_jpeg_size);
+                            ide_dbg_wbc_adapt_quality(wbc_jpeg_size, ide_dbg_time_us() - start);
                             wbc_jpeg_size = 0;
                         }
                         #endif
@@ -1125,6 +1286,7 @@ static void* ide_dbg_task(void* args) {
                     interrupt_repl();
                 }
                 ide_attached = true;
+                ide_fb_reset(false);
                 if (ide_script_running)
                     mp_thread_set_exception_main(MP_OBJ_FROM_PTR(&ide_exception));
                 ide_dbg_update(&state, usb_cdc_read_buf, size);
@@ -1211,7 +1373,6 @@ void ide_dbg_init(void) {
     while (0 < read(usb_cdc_fd, usb_cdc_read_buf, sizeof(usb_cdc_read_buf)));
     sem_init(&script_sem, 0, 0);
     sem_init(&stdin_sem, 0, 0);
-    pthread_mutex_init(&fb_mutex, NULL);
     ide_exception_str.data = (const byte*)"IDE interrupt";
     ide_exception_str.len  = 13;
     ide_exception_str.base.type = &mp_type_str;
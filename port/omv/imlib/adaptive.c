@@ -0,0 +1,324 @@
+/*
+ * This file is part of the OpenMV project.
+ *
+ * Copyright (c) 2013-2023 Ibrahim Abdelkader <iabdalkader@openmv.io>
+ * Copyright (c) 2013-2023 Kwabena W. Agyeman <kwagyeman@openmv.io>
+ *
+ * This work is licensed under the MIT license, see the file LICENSE for details.
+ *
+ * Adaptive thresholding.
+ *
+ * The luma of the source is copied out first, so the bitmap can be written over the source. Mean
+ * and Sauvola windows are clipped at the borders and read from running column sums (and sums of
+ * squares), their cost does not depend on the window size. Gaussian uses the blur engine on the
+ * luma copy. Otsu thresholds tiles of (2 * ksize + 1)^2 pixels and interpolates the thresholds
+ * bilinearly between tile centers like CLAHE, low contrast tiles take the global threshold.
+ */
+#include "imlib.h"
+#include "simd.h"
+#include "fmath.h"
+
+#ifdef IMLIB_ENABLE_ADAPTIVE_THRESHOLD
+
+#define ADAPTIVE_SAUVOLA_R              (128.0f)    // Dynamic range of the standard deviation.
+#define ADAPTIVE_OTSU_MIN_CONTRAST      (32)        // Tiles with a smaller range use the global threshold.
+#define ADAPTIVE_PITCH(w)               ((((w) + VEC_LANES - 1) / VEC_LANES) * VEC_LANES)
+
+static void adaptive_luma(uint8_t *dst, image_t *img, int pitch) {
+    for (int y = 0, yy = img->h; y < yy; y++, dst += pitch) {
+        switch (img->pixfmt) {
+            case PIXFORMAT_BINARY: {
+                uint32_t *row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, y);
+                for (int x = 0, xx = img->w; x < xx; x++) {
+                    dst[x] = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x));
+                }
+                break;
+            }
+            case PIXFORMAT_GRAYSCALE: {
+                memcpy(dst, IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y), img->w);
+                break;
+            }
+            case PIXFORMAT_RGB565: {
+                uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y);
+                for (int x = 0, xx = img->w; x < xx; x++) {
+                    dst[x] = COLOR_RGB565_TO_Y(row_ptr[x]);
+                }
+                break;
+            }
+            case PIXFORMAT_RGB888: {
+                uint8_t *row_ptr = ((uint8_t *) img->data) + (img->w * y * 3);
+                for (int x = 0, xx = img->w; x < xx; x++, row_ptr += 3) {
+                    dst[x] = COLOR_RGB888_TO_Y(row_ptr[0], row_ptr[1], row_ptr[2]);
+                }
+                break;
+            }
+            default: {
+                break;
+            }
+        }
+    }
+}
+
+static inline void adaptive_put(uint32_t *row_ptr, image_t *mask, int x, int y,
+                                int pixel, bool set, bool invert) {
+    if (mask && (!image_get_mask_pixel(mask, x, y))) {
+        set = COLOR_GRAYSCALE_TO_BINARY(pixel);
+    } else {
+        set ^= invert;
+    }
+
+    IMAGE_PUT_BINARY_PIXEL_FAST(row_ptr, x, set);
+}
+
+// Adds or subtracts a row to/from the column sums and sums of squares.
+static void adaptive_col_update(uint32_t *sum, uint32_t *ssq, const uint8_t *row, int pitch, bool add) {
+    for (int x = 0; x < pitch; x += VEC_LANES) {
+        vec_u32_t v = VEC_U16_TO_U32(VEC_U8_TO_U16(VEC_LOAD(vec_u8_t, row + x)));
+        vec_u32_t s = VEC_LOAD(vec_u32_t, sum + x);
+        VEC_STORE(sum + x, add ? (s + v) : (s - v));
+
+        if (ssq) {
+            vec_u32_t q = VEC_LOAD(vec_u32_t, ssq + x);
+            VEC_STORE(ssq + x, add ? (q + (v * v)) : (q - (v * v)));
+        }
+    }
+}
+
+static void adaptive_windowed(image_t *out, uint8_t *luma, int pitch, adaptive_threshold_method_t method,
+                              int ksize, int offset, float k, bool invert, image_t *mask) {
+    int w = out->w, h = out->h;
+    bool sauvola = method == ADAPTIVE_THRESHOLD_SAUVOLA;
+    uint32_t *sum = fb_alloc0(pitch * sizeof(uint32_t), FB_ALLOC_NO_HINT);
+    uint32_t *ssq = sauvola ? fb_alloc0(pitch * sizeof(uint32_t), FB_ALLOC_NO_HINT) : NULL;
+
+    for (int j = 0, jj = IM_MIN(ksize, h - 1); j <= jj; j++) {
+        adaptive_col_update(sum, ssq, luma + (j * pitch), pitch, true);
+    }
+
+    for (int y = 0; y < h; y++) {
+        const uint8_t *row = luma + (y * pitch);
+        uint32_t *out_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(out, y);
+        int rows = IM_MIN(y + ksize, h - 1) - IM_MAX(y - ksize, 0) + 1;
+        int cols = IM_MIN(ksize, w - 1) + 1;
+        uint32_t acc = 0;
+        uint64_t acc_sq = 0;
+
+        for (int i = 0; i < cols; i++) {
+            acc += sum[i];
+            acc_sq += sauvola ? ssq[i] : 0;
+        }
+
+        for (int x = 0; x < w; x++) {
+            int pixel = row[x];
+            int n = rows * cols;
+            bool set;
+
+            if (sauvola) {
+                float mean = acc / (float) n;
+                float var = IM_MAX((acc_sq / (float) n) - (mean * mean), 0.0f);
+                float t = mean * (1.0f + (k * ((fast_sqrtf(var) / ADAPTIVE_SAUVOLA_R) - 1.0f)));
+                set = pixel > (t - offset);
+            } else {
+                // pixel > mean - offset without dividing.
+                set = (int64_t) ((pixel + offset) * n) > (int64_t) acc;
+            }
+
+            adaptive_put(out_row_ptr, mask, x, y, pixel, set, invert);
+
+            if ((x + ksize + 1) < w) {
+                acc += sum[x + ksize + 1];
+                acc_sq += sauvola ? ssq[x + ksize + 1] : 0;
+                cols += 1;
+            }
+
+            if ((x - ksize) >= 0) {
+                acc -= sum[x - ksize];
+                acc_sq -= sauvola ? ssq[x - ksize] : 0;
+                cols -= 1;
+            }
+        }
+
+        if ((y + ksize + 1) < h) {
+            adaptive_col_update(sum, ssq, luma + ((y + ksize + 1) * pitch), pitch, true);
+        }
+
+        if ((y - ksize) >= 0) {
+            adaptive_col_update(sum, ssq, luma + ((y - ksize) * pitch), pitch, false);
+        }
+    }
+
+    if (ssq) {
+        fb_free();
+    }
+
+    fb_free(); // sum
+}
+
+#ifdef IMLIB_ENABLE_GAUSSIAN
+static void adaptive_gaussian(image_t *out, uint8_t *luma, int pitch, int ksize, int offset, bool invert,
+                              image_t *mask) {
+    int w = out->w, h = out->h;
+    image_t blur = { .w = pitch, .h = h, .pixfmt = PIXFORMAT_GRAYSCALE };
+    blur.data = fb_alloc(pitch * h, FB_ALLOC_NO_HINT);
+    memcpy(blur.data, luma, pitch * h);
+
+    // The padding columns repeat the last pixel so they do not darken the right border.
+    for (int y = 0; y < h; y++) {
+        memset(blur.data + (y * pitch) + w, blur.data[(y * pitch) + w - 1], pitch - w);
+    }
+
+    imlib_gaussian_filter(&blur, ksize, false, 1.0f, 0.0f, false, 0, false, NULL);
+
+    for (int y = 0; y < h; y++) {
+        const uint8_t *row = luma + (y * pitch), *t = blur.data + (y * pitch);
+        uint32_t *out_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(out, y);
+
+        for (int x = 0; x < w; x++) {
+            adaptive_put(out_row_ptr, mask, x, y, row[x], row[x] > (t[x] - offset), invert);
+        }
+    }
+
+    fb_free(); // blur
+}
+#endif // IMLIB_ENABLE_GAUSSIAN
+
+// Otsu's method on a 256 bin histogram of n pixels.
+static int adaptive_otsu(const uint32_t *hist, uint32_t n) {
+    uint64_t sum = 0;
+
+    for (int i = 0; i < 256; i++) {
+        sum += i * hist[i];
+    }
+
+    uint64_t sum_b = 0;
+    uint32_t w_b = 0;
+    float max = -1.0f;
+    int threshold = 0;
+
+    for (int i = 0; i < 256; i++) {
+        w_b += hist[i];
+
+        if (!w_b) {
+            continue;
+        }
+
+        uint32_t w_f = n - w_b;
+
+        if (!w_f) {
+            break;
+        }
+
+        sum_b += i * hist[i];
+        float m_b = sum_b / (float) w_b;
+        float m_f = (sum - sum_b) / (float) w_f;
+        float between = w_b * (float) w_f * (m_b - m_f) * (m_b - m_f);
+
+        if (between > max) {
+            max = between;
+            threshold = i;
+        }
+    }
+
+    return threshold;
+}
+
+static void adaptive_tiled_otsu(image_t *out, uint8_t *luma, int pitch, int ksize, int offset, bool invert,
+                                image_t *mask) {
+    int w = out->w, h = out->h, tile = (ksize * 2) + 1;
+    int tiles_x = (w + tile - 1) / tile, tiles_y = (h + tile - 1) / tile;
+    uint32_t *hist = fb_alloc(256 * sizeof(uint32_t), FB_ALLOC_NO_HINT);
+    uint32_t *global = fb_alloc0(256 * sizeof(uint32_t), FB_ALLOC_NO_HINT);
+    int *thresholds = fb_alloc(tiles_x * tiles_y * sizeof(int), FB_ALLOC_NO_HINT);
+    uint8_t *ranges = fb_alloc(tiles_x * tiles_y, FB_ALLOC_NO_HINT);
+
+    for (int ty = 0; ty < tiles_y; ty++) {
+        for (int tx = 0; tx < tiles_x; tx++) {
+            int x0 = tx * tile, x1 = IM_MIN(x0 + tile, w);
+            int y0 = ty * tile, y1 = IM_MIN(y0 + tile, h);
+            int min = 255, max = 0;
+            memset(hist, 0, 256 * sizeof(uint32_t));
+
+            for (int y = y0; y < y1; y++) {
+                const uint8_t *row = luma + (y * pitch);
+
+                for (int x = x0; x < x1; x++) {
+                    int pixel = row[x];
+                    hist[pixel] += 1;
+                    min = IM_MIN(min, pixel);
+                    max = IM_MAX(max, pixel);
+                }
+            }
+
+            for (int i = 0; i < 256; i++) {
+                global[i] += hist[i];
+            }
+
+            thresholds[(ty * tiles_x) + tx] = adaptive_otsu(hist, (x1 - x0) * (y1 - y0));
+            ranges[(ty * tiles_x) + tx] = max - min;
+        }
+    }
+
+    int global_threshold = adaptive_otsu(global, w * h);
+
+    for (int i = 0, ii = tiles_x * tiles_y; i < ii; i++) {
+        int t = (ranges[i] < ADAPTIVE_OTSU_MIN_CONTRAST) ? global_threshold : thresholds[i];
+        thresholds[i] = t - offset;
+    }
+
+    for (int y = 0; y < h; y++) {
+        const uint8_t *row = luma + (y * pitch);
+        uint32_t *out_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(out, y);
+
+        // Tile centers are at (i * tile) + (tile / 2), clamp outside of the outer centers.
+        int fy = IM_MAX(((y - (tile / 2)) * 256) / tile, 0);
+        int ty0 = IM_MIN(fy >> 8, tiles_y - 1), ty1 = IM_MIN(ty0 + 1, tiles_y - 1);
+        int wy = (ty0 == ty1) ? 0 : (fy & 0xFF);
+        int *t0 = thresholds + (ty0 * tiles_x), *t1 = thresholds + (ty1 * tiles_x);
+
+        for (int x = 0; x < w; x++) {
+            int fx = IM_MAX(((x - (tile / 2)) * 256) / tile, 0);
+            int tx0 = IM_MIN(fx >> 8, tiles_x - 1), tx1 = IM_MIN(tx0 + 1, tiles_x - 1);
+            int wx = (tx0 == tx1) ? 0 : (fx & 0xFF);
+            int top = (t0[tx0] * (256 - wx)) + (t0[tx1] * wx);
+            int bottom = (t1[tx0] * (256 - wx)) + (t1[tx1] * wx);
+            int t = (top * (256 - wy)) + (bottom * wy); // 16.16
+            adaptive_put(out_row_ptr, mask, x, y, row[x], (row[x] << 16) > t, invert);
+        }
+    }
+
+    fb_free(); // ranges
+    fb_free(); // thresholds
+    fb_free(); // global
+    fb_free(); // hist
+}
+
+void imlib_adaptive_threshold(image_t *out, image_t *img, adaptive_threshold_method_t method, int ksize,
+                              int offset, float k, bool invert, image_t *mask) {
+    int pitch = ADAPTIVE_PITCH(img->w);
+    uint8_t *luma = fb_alloc0(pitch * img->h, FB_ALLOC_NO_HINT);
+    adaptive_luma(luma, img, pitch);
+
+    switch (method) {
+        case ADAPTIVE_THRESHOLD_MEAN:
+        case ADAPTIVE_THRESHOLD_SAUVOLA: {
+            adaptive_windowed(out, luma, pitch, method, ksize, offset, k, invert, mask);
+            break;
+        }
+        #ifdef IMLIB_ENABLE_GAUSSIAN
+        case ADAPTIVE_THRESHOLD_GAUSSIAN: {
+            adaptive_gaussian(out, luma, pitch, ksize, offset, invert, mask);
+            break;
+        }
+        #endif
+        case ADAPTIVE_THRESHOLD_OTSU: {
+            adaptive_tiled_otsu(out, luma, pitch, ksize, offset, invert, mask);
+            break;
+        }
+        default: {
+            mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("Invalid adaptive threshold method!"));
+        }
+    }
+
+    fb_free(); // luma
+}
+#endif // IMLIB_ENABLE_ADAPTIVE_THRESHOLD
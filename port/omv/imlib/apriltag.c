@@ -12272,20 +12272,22 @@ void imlib_find_rects(list_t *out, image_t *ptr, rectangle_t *roi, uint32_t thre
 
 #ifdef IMLIB_ENABLE_ROTATION_CORR
 // http://jepsonsblog.blogspot.com/2012/11/rotation-in-3d-using-opencvs.html
-void imlib_rotation_corr(image_t *img, float x_rotation, float y_rotation, float z_rotation,
-                         float x_translation, float y_translation,
-                         float zoom, float fov, float *corners)
+void imlib_remap_rotation_corr(remap_t *m, int w, int h, float x_rotation, float y_rotation, float z_rotation,
+                               float x_translation, float y_translation,
+                               float zoom, float fov, float *corners)
 {
-    // Create a tmp copy of the image to pull pixels from.
-    size_t size = image_size(img);
-    void *data = fb_alloc(size, FB_ALLOC_NO_HINT);
-    memcpy(data, img->data, size);
-    memset(img->data, 0, size);
+    float key[REMAP_KEY_SIZE] = { x_rotation, y_rotation, z_rotation, x_translation, y_translation, zoom, fov, !!corners };
+
+    if (corners) {
+        memcpy(key + 8, corners, sizeof(float[8]));
+    }
+
+    if (imlib_remap_prepare(m, REMAP_TYPE_ROTATION_CORR, w, h, key, REMAP_KEY_SIZE)) {
+        return;
+    }
 
     umm_init_x(fb_avail());
 
-    int w = img->w;
-    int h = img->h;
     float z = (fast_sqrtf((w * w) + (h * h)) / 2) / tanf(fov / 2);
     float z_z = z * zoom;
 
@@ -12376,148 +12378,18 @@ void imlib_rotation_corr(image_t *img, float x_rotation, float y_rotation, float
     }
 
     if (T4) {
-        float T4_00 = MATD_EL(T4, 0, 0), T4_01 = MATD_EL(T4, 0, 1), T4_02 = MATD_EL(T4, 0, 2);
-        float T4_10 = MATD_EL(T4, 1, 0), T4_11 = MATD_EL(T4, 1, 1), T4_12 = MATD_EL(T4, 1, 2);
-        float T4_20 = MATD_EL(T4, 2, 0), T4_21 = MATD_EL(T4, 2, 1), T4_22 = MATD_EL(T4, 2, 2);
-
-        if ((fast_fabsf(T4_20) < MATD_EPS) && (fast_fabsf(T4_21) < MATD_EPS)) { // warp affine
-            T4_00 /= T4_22;
-            T4_01 /= T4_22;
-            T4_02 /= T4_22;
-            T4_10 /= T4_22;
-            T4_11 /= T4_22;
-            T4_12 /= T4_22;
-            switch (img->pixfmt) {
-                case PIXFORMAT_BINARY: {
-                    uint32_t *tmp = (uint32_t *) data;
-
-                    for (int y = 0, yy = h; y < yy; y++) {
-                        uint32_t *row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, y);
-                        for (int x = 0, xx = w; x < xx; x++) {
-                            int sourceX = fast_roundf(T4_00*x + T4_01*y + T4_02);
-                            int sourceY = fast_roundf(T4_10*x + T4_11*y + T4_12);
-
-                            if ((0 <= sourceX) && (sourceX < w) && (0 <= sourceY) && (sourceY < h)) {
-                                uint32_t *ptr = tmp + (((w + UINT32_T_MASK) >> UINT32_T_SHIFT) * sourceY);
-                                int pixel = IMAGE_GET_BINARY_PIXEL_FAST(ptr, sourceX);
-                                IMAGE_PUT_BINARY_PIXEL_FAST(row_ptr, x, pixel);
-                            }
-                        }
-                    }
-                    break;
-                }
-                case PIXFORMAT_GRAYSCALE: {
-                    uint8_t *tmp = (uint8_t *) data;
-
-                    for (int y = 0, yy = h; y < yy; y++) {
-                        uint8_t *row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y);
-                        for (int x = 0, xx = w; x < xx; x++) {
-                            int sourceX = fast_roundf(T4_00*x + T4_01*y + T4_02);
-                            int sourceY = fast_roundf(T4_10*x + T4_11*y + T4_12);
-
-                            if ((0 <= sourceX) && (sourceX < w) && (0 <= sourceY) && (sourceY < h)) {
-                                uint8_t *ptr = tmp + (w * sourceY);
-                                int pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(ptr, sourceX);
-                                IMAGE_PUT_GRAYSCALE_PIXEL_FAST(row_ptr, x, pixel);
-                            }
-                        }
-                    }
-                    break;
-                }
-                case PIXFORMAT_RGB565: {
-                    uint16_t *tmp = (uint16_t *) data;
-
-                    for (int y = 0, yy = h; y < yy; y++) {
-                        uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y);
-                        for (int x = 0, xx = w; x < xx; x++) {
-                            int sourceX = fast_roundf(T4_00*x + T4_01*y + T4_02);
-                            int sourceY = fast_roundf(T4_10*x + T4_11*y + T4_12);
-
-                            if ((0 <= sourceX) && (sourceX < w) && (0 <= sourceY) && (sourceY < h)) {
-                                uint16_t *ptr = tmp + (w * sourceY);
-                                int pixel = IMAGE_GET_RGB565_PIXEL_FAST(ptr, sourceX);
-                                IMAGE_PUT_RGB565_PIXEL_FAST(row_ptr, x, pixel);
-                            }
-                        }
-                    }
-                    break;
-                }
-                default: {
-                    break;
-                }
-            }
-        } else { // warp persepective
-            switch (img->pixfmt) {
-                case PIXFORMAT_BINARY: {
-                    uint32_t *tmp = (uint32_t *) data;
-
-                    for (int y = 0, yy = h; y < yy; y++) {
-                        uint32_t *row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, y);
-                        for (int x = 0, xx = w; x < xx; x++) {
-                            float xxx = T4_00*x + T4_01*y + T4_02;
-                            float yyy = T4_10*x + T4_11*y + T4_12;
-                            float zzz = T4_20*x + T4_21*y + T4_22;
-                            int sourceX = fast_roundf(xxx / zzz);
-                            int sourceY = fast_roundf(yyy / zzz);
-
-                            if ((0 <= sourceX) && (sourceX < w) && (0 <= sourceY) && (sourceY < h)) {
-                                uint32_t *ptr = tmp + (((w + UINT32_T_MASK) >> UINT32_T_SHIFT) * sourceY);
-                                int pixel = IMAGE_GET_BINARY_PIXEL_FAST(ptr, sourceX);
-                                IMAGE_PUT_BINARY_PIXEL_FAST(row_ptr, x, pixel);
-                            }
-                        }
-                    }
-                    break;
-                }
-                case PIXFORMAT_GRAYSCALE: {
-                    uint8_t *tmp = (uint8_t *) data;
-
-                    for (int y = 0, yy = h; y < yy; y++) {
-                        uint8_t *row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y);
-                        for (int x = 0, xx = w; x < xx; x++) {
-                            float xxx = T4_00*x + T4_01*y + T4_02;
-                            float yyy = T4_10*x + T4_11*y + T4_12;
-                            float zzz = T4_20*x + T4_21*y + T4_22;
-                            int sourceX = fast_roundf(xxx / zzz);
-                            int sourceY = fast_roundf(yyy / zzz);
-
-                            if ((0 <= sourceX) && (sourceX < w) && (0 <= sourceY) && (sourceY < h)) {
-                                uint8_t *ptr = tmp + (w * sourceY);
-                                int pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(ptr, sourceX);
-                                IMAGE_PUT_GRAYSCALE_PIXEL_FAST(row_ptr, x, pixel);
-                            }
-                        }
-                    }
-                    break;
-                }
-                case PIXFORMAT_RGB565: {
-                    uint16_t *tmp = (uint16_t *) data;
-
-                    for (int y = 0, yy = h; y < yy; y++) {
-                        uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y);
-                        for (int x = 0, xx = w; x < xx; x++) {
-                            float xxx = T4_00*x + T4_01*y + T4_02;
-                            float yyy = T4_10*x + T4_11*y + T4_12;
-                            float zzz = T4_20*x + T4_21*y + T4_22;
-                            int sourceX = fast_roundf(xxx / zzz);
-                            int sourceY = fast_roundf(yyy / zzz);
-
-                            if ((0 <= sourceX) && (sourceX < w) && (0 <= sourceY) && (sourceY < h)) {
-                                uint16_t *ptr = tmp + (w * sourceY);
-                                int pixel = IMAGE_GET_RGB565_PIXEL_FAST(ptr, sourceX);
-                                IMAGE_PUT_RGB565_PIXEL_FAST(row_ptr, x, pixel);
-                            }
-                        }
-                    }
-                    break;
-                }
-                default: {
-                    break;
-                }
+        float H[9];
+
+        for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 3; j++) {
+                H[(i * 3) + j] = MATD_EL(T4, i, j);
             }
         }
 
+        imlib_remap_homography_int(m, H);
         matd_destroy(T4);
+    } else {
+        memset(m->map, 0xFF, w * h * sizeof(uint32_t)); // REMAP_INVALID
     }
 
     matd_destroy(T3);
@@ -12532,6 +12404,25 @@ void imlib_rotation_corr(image_t *img, float x_rotation, float y_rotation, float
     matd_destroy(A1);
 
     fb_free(); // umm_init_x();
+}
+
+void imlib_rotation_corr(image_t *img, float x_rotation, float y_rotation, float z_rotation,
+                         float x_translation, float y_translation,
+                         float zoom, float fov, float *corners)
+{
+    // The map is kept across calls and only recompiled when the parameters change.
+    remap_t *remap = imlib_remap_cache(REMAP_TYPE_ROTATION_CORR);
+    imlib_remap_rotation_corr(remap, img->w, img->h,
+                              x_rotation, y_rotation, z_rotation,
+                              x_translation, y_translation,
+                              zoom, fov, corners);
+
+    // Create a tmp copy of the image to pull pixels from.
+    image_t src = *img;
+    src.data = fb_alloc(image_size(img), FB_ALLOC_NO_HINT);
+    memcpy(src.data, img->data, image_size(img));
+
+    imlib_remap(remap, img, &src, false);
 
     fb_free();
 }
@@ -0,0 +1,439 @@
+/*
+ * This file is part of the OpenMV project.
+ *
+ * Copyright (c) 2013-2023 Ibrahim Abdelkader <iabdalkader@openmv.io>
+ * Copyright (c) 2013-2023 Kwabena W. Agyeman <kwagyeman@openmv.io>
+ *
+ * This work is licensed under the MIT license, see the file LICENSE for details.
+ *
+ * Gaussian and box blur.
+ *
+ * Rows are unpacked into one plane per channel holding BLUR_Q_BITS of fraction, so chained passes
+ * do not round to the pixel format in between. Small gaussians run the pascal kernel as a vertical
+ * and a horizontal pass (2n instead of n^2 multiply-adds per pixel). Box blurs and large gaussians
+ * use running sums whose cost does not depend on the radius, a large gaussian being approximated
+ * by three box passes of the same variance. Passes stream rows, output row y is written once
+ * every pass is past it, so the image is filtered in place.
+ */
+#include "imlib.h"
+#include "simd.h"
+#include "fmath.h"
+
+#if defined(IMLIB_ENABLE_MEAN) || defined(IMLIB_ENABLE_GAUSSIAN)
+
+#define BLUR_Q_BITS             (8)
+#define BLUR_Q_HALF             (1 << (BLUR_Q_BITS - 1))
+#define BLUR_BOX_PASSES         (3)
+#define BLUR_GAUSSIAN_MAX_KSIZE (8)         // Larger kernels use box passes, 2^16 * 255 << BLUR_Q_BITS fits 32-bits.
+#define BLUR_ROUND_UP(x)        ((((x) + VEC_LANES - 1) / VEC_LANES) * VEC_LANES)
+
+typedef struct blur_ctx {
+    image_t *img;
+    image_t *mask;
+    int channels;
+    int pitch;          // Plane stride, a multiple of VEC_LANES.
+    bool fast;          // Default mul/add, integer only.
+    bool unsharp;
+    float mul;
+    float add;
+    bool threshold;
+    int offset;
+    bool invert;
+} blur_ctx_t;
+
+typedef struct blur_box {
+    int r;
+    uint16_t *ring;     // 2r + 2 rows of horizontal means.
+    uint32_t *sum;      // Column sums of the horizontal means.
+    uint16_t *out;
+    uint64_t inv;       // 2^32 / (2r + 1) rounded up.
+    int in_y;           // Next input row.
+} blur_box_t;
+
+static void blur_ctx_init(blur_ctx_t *ctx, image_t *img, bool unsharp, float mul, float add,
+                          bool threshold, int offset, bool invert, image_t *mask) {
+    ctx->img = img;
+    ctx->mask = mask;
+    ctx->channels = ((img->pixfmt == PIXFORMAT_RGB565) || (img->pixfmt == PIXFORMAT_RGB888)) ? 3 : 1;
+    ctx->pitch = BLUR_ROUND_UP(img->w);
+    ctx->fast = (mul == (unsharp ? -1.0f : 1.0f)) && (add == 0.0f);
+    ctx->unsharp = unsharp;
+    ctx->mul = mul;
+    ctx->add = add;
+    ctx->threshold = threshold;
+    ctx->offset = offset;
+    ctx->invert = invert;
+}
+
+static void blur_unpack_row(blur_ctx_t *ctx, uint16_t *dst, int y) {
+    image_t *img = ctx->img;
+    int pitch = ctx->pitch;
+
+    switch (img->pixfmt) {
+        case PIXFORMAT_BINARY: {
+            uint32_t *row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, y);
+            for (int x = 0, xx = img->w; x < xx; x++) {
+                dst[x] = IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x) << BLUR_Q_BITS;
+            }
+            break;
+        }
+        case PIXFORMAT_GRAYSCALE: {
+            uint8_t *row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y);
+            for (int x = 0, xx = img->w; x < xx; x++) {
+                dst[x] = row_ptr[x] << BLUR_Q_BITS;
+            }
+            break;
+        }
+        case PIXFORMAT_RGB565: {
+            uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y);
+            for (int x = 0, xx = img->w; x < xx; x++) {
+                int pixel = row_ptr[x];
+                dst[x] = COLOR_RGB565_TO_R5(pixel) << BLUR_Q_BITS;
+                dst[pitch + x] = COLOR_RGB565_TO_G6(pixel) << BLUR_Q_BITS;
+                dst[(pitch * 2) + x] = COLOR_RGB565_TO_B5(pixel) << BLUR_Q_BITS;
+            }
+            break;
+        }
+        case PIXFORMAT_RGB888: {
+            uint8_t *row_ptr = ((uint8_t *) img->data) + (img->w * y * 3);
+            for (int x = 0, xx = img->w; x < xx; x++, row_ptr += 3) {
+                dst[x] = row_ptr[0] << BLUR_Q_BITS;
+                dst[pitch + x] = row_ptr[1] << BLUR_Q_BITS;
+                dst[(pitch * 2) + x] = row_ptr[2] << BLUR_Q_BITS;
+            }
+            break;
+        }
+        default: {
+            break;
+        }
+    }
+}
+
+// Same output arithmetic as imlib_morph(): out = mul * (blur - (unsharp ? 2 * pixel : 0)) + add.
+static inline int blur_value(blur_ctx_t *ctx, int q, int pixel, int max) {
+    int v;
+
+    if (ctx->fast) {
+        v = ((ctx->unsharp ? ((pixel << (BLUR_Q_BITS + 1)) - q) : q) + BLUR_Q_HALF) >> BLUR_Q_BITS;
+    } else {
+        float f = q * (1.0f / (1 << BLUR_Q_BITS));
+
+        if (ctx->unsharp) {
+            f -= pixel * 2;
+        }
+
+        v = fast_roundf((f * ctx->mul) + ctx->add);
+    }
+
+    return IM_MIN(IM_MAX(v, 0), max);
+}
+
+// Writes row y, which still holds the source pixels needed by unsharp, threshold and mask.
+static void blur_emit_row(blur_ctx_t *ctx, int y, const uint16_t *q) {
+    image_t *img = ctx->img;
+    int pitch = ctx->pitch;
+
+    switch (img->pixfmt) {
+        case PIXFORMAT_BINARY: {
+            uint32_t *row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, y);
+
+            for (int x = 0, xx = img->w; x < xx; x++) {
+                if (ctx->mask && (!image_get_mask_pixel(ctx->mask, x, y))) {
+                    continue;
+                }
+
+                int old = IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x);
+                int pixel = blur_value(ctx, q[x], old, COLOR_BINARY_MAX);
+
+                if (ctx->threshold) {
+                    pixel = (((pixel - ctx->offset) < old) ^ ctx->invert) ? COLOR_BINARY_MAX : COLOR_BINARY_MIN;
+                }
+
+                IMAGE_PUT_BINARY_PIXEL_FAST(row_ptr, x, pixel);
+            }
+            break;
+        }
+        case PIXFORMAT_GRAYSCALE: {
+            uint8_t *row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y);
+
+            if (ctx->fast && (!ctx->unsharp) && (!ctx->threshold) && (!ctx->mask)) {
+                for (int x = 0, xx = img->w; x < xx; x++) {
+                    row_ptr[x] = (q[x] + BLUR_Q_HALF) >> BLUR_Q_BITS;
+                }
+                break;
+            }
+
+            for (int x = 0, xx = img->w; x < xx; x++) {
+                if (ctx->mask && (!image_get_mask_pixel(ctx->mask, x, y))) {
+                    continue;
+                }
+
+                int old = row_ptr[x];
+                int pixel = blur_value(ctx, q[x], old, COLOR_GRAYSCALE_MAX);
+
+                if (ctx->threshold) {
+                    pixel = (((pixel - ctx->offset) < old) ^ ctx->invert) ?
+                            COLOR_GRAYSCALE_BINARY_MAX : COLOR_GRAYSCALE_BINARY_MIN;
+                }
+
+                row_ptr[x] = pixel;
+            }
+            break;
+        }
+        case PIXFORMAT_RGB565: {
+            uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y);
+
+            for (int x = 0, xx = img->w; x < xx; x++) {
+                if (ctx->mask && (!image_get_mask_pixel(ctx->mask, x, y))) {
+                    continue;
+                }
+
+                int old = row_ptr[x];
+                int r = blur_value(ctx, q[x], COLOR_RGB565_TO_R5(old), COLOR_R5_MAX);
+                int g = blur_value(ctx, q[pitch + x], COLOR_RGB565_TO_G6(old), COLOR_G6_MAX);
+                int b = blur_value(ctx, q[(pitch * 2) + x], COLOR_RGB565_TO_B5(old), COLOR_B5_MAX);
+                int pixel = COLOR_R5_G6_B5_TO_RGB565(r, g, b);
+
+                if (ctx->threshold) {
+                    pixel = (((COLOR_RGB565_TO_Y(pixel) - ctx->offset) < COLOR_RGB565_TO_Y(old)) ^ ctx->invert) ?
+                            COLOR_RGB565_BINARY_MAX : COLOR_RGB565_BINARY_MIN;
+                }
+
+                row_ptr[x] = pixel;
+            }
+            break;
+        }
+        case PIXFORMAT_RGB888: {
+            uint8_t *row_ptr = ((uint8_t *) img->data) + (img->w * y * 3);
+
+            for (int x = 0, xx = img->w; x < xx; x++) {
+                if (ctx->mask && (!image_get_mask_pixel(ctx->mask, x, y))) {
+                    continue;
+                }
+
+                uint8_t *src = row_ptr + (x * 3);
+                int r = blur_value(ctx, q[x], src[0], COLOR_R8_MAX);
+                int g = blur_value(ctx, q[pitch + x], src[1], COLOR_G8_MAX);
+                int b = blur_value(ctx, q[(pitch * 2) + x], src[2], COLOR_B8_MAX);
+
+                if (ctx->threshold) {
+                    if (((COLOR_RGB888_TO_Y(r, g, b) - ctx->offset) < COLOR_RGB888_TO_Y(src[0], src[1], src[2])) ^
+                        ctx->invert) {
+                        r = g = b = 0xFF;
+                    } else {
+                        r = g = b = 0x00;
+                    }
+                }
+
+                src[0] = r;
+                src[1] = g;
+                src[2] = b;
+            }
+            break;
+        }
+        default: {
+            break;
+        }
+    }
+}
+
+// Running mean of 2r + 1 values with replicated borders.
+static void blur_box_h(uint16_t *dst, const uint16_t *src, int w, int r, uint64_t inv) {
+    uint32_t acc = (r + 1) * src[0];
+    uint32_t half = r; // (2r + 1) / 2
+
+    for (int i = 1; i <= r; i++) {
+        acc += src[IM_MIN(i, w - 1)];
+    }
+
+    for (int x = 0; x < w; x++) {
+        dst[x] = ((acc + half) * inv) >> 32;
+        acc += src[IM_MIN(x + r + 1, w - 1)];
+        acc -= src[IM_MAX(x - r, 0)];
+    }
+}
+
+// Returns output row y of pass i, rows are requested in order.
+static uint16_t *blur_box_row(blur_ctx_t *ctx, blur_box_t *boxes, int i, int y) {
+    blur_box_t *box = boxes + i;
+    int w = ctx->img->w, h = ctx->img->h, r = box->r, rows = (r * 2) + 2;
+    int pitch = ctx->pitch, size = ctx->channels * pitch;
+
+    for (int yy = IM_MIN(y + r, h - 1); box->in_y <= yy; box->in_y++) {
+        uint16_t *src;
+
+        if (i) {
+            src = blur_box_row(ctx, boxes, i - 1, box->in_y);
+        } else {
+            src = box->out;
+            blur_unpack_row(ctx, src, box->in_y);
+        }
+
+        uint16_t *dst = box->ring + ((box->in_y % rows) * size);
+
+        for (int c = 0; c < ctx->channels; c++) {
+            blur_box_h(dst + (c * pitch), src + (c * pitch), w, r, box->inv);
+        }
+    }
+
+    if (!y) {
+        uint16_t *first = box->ring;
+
+        for (int x = 0; x < size; x++) {
+            box->sum[x] = (r + 1) * first[x];
+        }
+
+        for (int j = 1; j <= r; j++) {
+            uint16_t *add = box->ring + ((IM_MIN(j, h - 1) % rows) * size);
+
+            for (int x = 0; x < size; x += VEC_LANES) {
+                VEC_STORE(box->sum + x, VEC_LOAD(vec_u32_t, box->sum + x) +
+                          VEC_U16_TO_U32(VEC_LOAD(vec_u16_t, add + x)));
+            }
+        }
+    } else {
+        uint16_t *add = box->ring + ((IM_MIN(y + r, h - 1) % rows) * size);
+        uint16_t *sub = box->ring + ((IM_MAX(y - r - 1, 0) % rows) * size);
+
+        for (int x = 0; x < size; x += VEC_LANES) {
+            VEC_STORE(box->sum + x, VEC_LOAD(vec_u32_t, box->sum + x) +
+                      VEC_U16_TO_U32(VEC_LOAD(vec_u16_t, add + x)) -
+                      VEC_U16_TO_U32(VEC_LOAD(vec_u16_t, sub + x)));
+        }
+    }
+
+    for (int x = 0; x < size; x++) {
+        box->out[x] = ((box->sum[x] + r) * box->inv) >> 32;
+    }
+
+    return box->out;
+}
+
+static void blur_box_passes(blur_ctx_t *ctx, const int *radii, int passes) {
+    int size = ctx->channels * ctx->pitch;
+    blur_box_t boxes[BLUR_BOX_PASSES];
+
+    for (int i = 0; i < passes; i++) {
+        int r = radii[i];
+        boxes[i].r = r;
+        boxes[i].ring = fb_alloc0(((r * 2) + 2) * size * sizeof(uint16_t), FB_ALLOC_NO_HINT);
+        boxes[i].sum = fb_alloc0(size * sizeof(uint32_t), FB_ALLOC_NO_HINT);
+        boxes[i].out = fb_alloc0(size * sizeof(uint16_t), FB_ALLOC_NO_HINT);
+        boxes[i].inv = ((1ULL << 32) + (r * 2)) / ((r * 2) + 1);
+        boxes[i].in_y = 0;
+    }
+
+    for (int y = 0, yy = ctx->img->h; y < yy; y++) {
+        blur_emit_row(ctx, y, blur_box_row(ctx, boxes, passes - 1, y));
+    }
+
+    for (int i = 0; i < (passes * 3); i++) {
+        fb_free();
+    }
+}
+
+#ifdef IMLIB_ENABLE_GAUSSIAN
+// Pascal's triangle row 2 * ksize sums to 2^(2 * ksize), so each pass normalizes with a shift.
+static void blur_gaussian_sep(blur_ctx_t *ctx, int ksize) {
+    int w = ctx->img->w, h = ctx->img->h, n = (ksize * 2) + 1, shift = ksize * 2;
+    int pitch = ctx->pitch, size = ctx->channels * pitch, pad_pitch = pitch + (ksize * 2);
+    uint32_t half = (1 << shift) >> 1;
+    uint32_t krn[(BLUR_GAUSSIAN_MAX_KSIZE * 2) + 1];
+    krn[0] = 1;
+
+    for (int i = 0; i < shift; i++) {
+        krn[i + 1] = (krn[i] * (shift - i)) / (i + 1);
+    }
+
+    // Source rows are kept since the rows above are overwritten by the time they are read.
+    uint16_t *ring = fb_alloc0(n * size * sizeof(uint16_t), FB_ALLOC_NO_HINT);
+    uint16_t *pad = fb_alloc0(ctx->channels * pad_pitch * sizeof(uint16_t), FB_ALLOC_NO_HINT);
+    uint16_t *out = fb_alloc0(size * sizeof(uint16_t), FB_ALLOC_NO_HINT);
+
+    for (int y = 0; y < IM_MIN(ksize, h); y++) {
+        blur_unpack_row(ctx, ring + (y * size), y);
+    }
+
+    for (int y = 0; y < h; y++) {
+        if ((y + ksize) < h) {
+            blur_unpack_row(ctx, ring + (((y + ksize) % n) * size), y + ksize);
+        }
+
+        const uint16_t *rows[(BLUR_GAUSSIAN_MAX_KSIZE * 2) + 1];
+
+        for (int j = 0; j < n; j++) {
+            rows[j] = ring + ((IM_MIN(IM_MAX(y + j - ksize, 0), h - 1) % n) * size);
+        }
+
+        for (int c = 0; c < ctx->channels; c++) {
+            uint16_t *p = pad + (c * pad_pitch);
+
+            for (int x = 0; x < pitch; x += VEC_LANES) {
+                vec_u32_t acc = {0};
+
+                for (int j = 0; j < n; j++) {
+                    acc += VEC_U16_TO_U32(VEC_LOAD(vec_u16_t, rows[j] + (c * pitch) + x)) * krn[j];
+                }
+
+                VEC_STORE(p + ksize + x, VEC_U32_TO_U16((acc + half) >> shift));
+            }
+
+            for (int k = 0; k < ksize; k++) {
+                p[k] = p[ksize];
+                p[ksize + w + k] = p[ksize + w - 1];
+            }
+
+            for (int x = 0; x < pitch; x += VEC_LANES) {
+                vec_u32_t acc = {0};
+
+                for (int k = 0; k < n; k++) {
+                    acc += VEC_U16_TO_U32(VEC_LOAD(vec_u16_t, p + x + k)) * krn[k];
+                }
+
+                VEC_STORE(out + (c * pitch) + x, VEC_U32_TO_U16((acc + half) >> shift));
+            }
+        }
+
+        blur_emit_row(ctx, y, out);
+    }
+
+    fb_free(); // out
+    fb_free(); // pad
+    fb_free(); // ring
+}
+
+void imlib_gaussian_filter(image_t *img, const int ksize, bool unsharp, float mul, float add,
+                           bool threshold, int offset, bool invert, image_t *mask) {
+    blur_ctx_t ctx;
+    blur_ctx_init(&ctx, img, unsharp, mul, add, threshold, offset, invert, mask);
+
+    if (ksize <= BLUR_GAUSSIAN_MAX_KSIZE) {
+        blur_gaussian_sep(&ctx, ksize);
+        return;
+    }
+
+    // Box widths matching the binomial variance of ksize / 2 (Kovesi, "Fast Almost-Gaussian Filtering").
+    float var = ksize / 2.0f;
+    int wl = fast_floorf(fast_sqrtf(((12.0f * var) / BLUR_BOX_PASSES) + 1.0f));
+    wl -= !(wl % 2);
+    int m = fast_roundf(((12.0f * var) - (BLUR_BOX_PASSES * wl * wl) - (4 * BLUR_BOX_PASSES * wl) -
+                         (3 * BLUR_BOX_PASSES)) / ((-4.0f * wl) - 4.0f));
+    int radii[BLUR_BOX_PASSES];
+
+    for (int i = 0; i < BLUR_BOX_PASSES; i++) {
+        radii[i] = (((i < m) ? wl : (wl + 2)) - 1) / 2;
+    }
+
+    blur_box_passes(&ctx, radii, BLUR_BOX_PASSES);
+}
+#endif // IMLIB_ENABLE_GAUSSIAN
+
+#ifdef IMLIB_ENABLE_MEAN
+void imlib_mean_filter(image_t *img, const int ksize, bool threshold, int offset, bool invert, image_t *mask) {
+    blur_ctx_t ctx;
+    blur_ctx_init(&ctx, img, false, 1.0f, 0.0f, threshold, offset, invert, mask);
+    blur_box_passes(&ctx, &ksize, 1);
+}
+#endif // IMLIB_ENABLE_MEAN
+
+#endif // IMLIB_ENABLE_MEAN || IMLIB_ENABLE_GAUSSIAN
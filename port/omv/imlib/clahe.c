@@ -7,445 +7,284 @@
  * This work is licensed under the MIT license, see the file LICENSE for details.
  *
  * Contrast Limited Adaptive Histogram Equalization.
- */
-#include "imlib.h"
-#define BYTE_IMAGE
-
-/*
- * ANSI C code from the article
- * "Contrast Limited Adaptive Histogram Equalization"
- * by Karel Zuiderveld, karel@cv.ruu.nl
- * in "Graphics Gems IV", Academic Press, 1994
- *
- *
- *  These functions implement Contrast Limited Adaptive Histogram Equalization.
- *  The main routine (CLAHE) expects an input image that is stored contiguously in
- *  memory;  the CLAHE output image overwrites the original input image and has the
- *  same minimum and maximum values (which must be provided by the user).
- *  This implementation assumes that the X- and Y image resolutions are an integer
- *  multiple of the X- and Y sizes of the contextual regions. A check on various other
- *  error conditions is performed.
- *
- *  #define the symbol BYTE_IMAGE to make this implementation suitable for
- *  8-bit images. The maximum number of contextual regions can be redefined
- *  by changing uiMAX_REG_X and/or uiMAX_REG_Y; the use of more than 256
- *  contextual regions is not recommended.
- *
- *  The code is ANSI-C and is also C++ compliant.
  *
- *  Author: Karel Zuiderveld, Computer Vision Research Group,
- *           Utrecht, The Netherlands (karel@cv.ruu.nl)
+ * The image is split into a grid of tiles, each tile gets a clipped and equalized table and
+ * every pixel bilinearly interpolates between the tables of the four nearest tile centers
+ * (K. Zuiderveld, "Contrast Limited Adaptive Histogram Equalization", Graphics Gems IV).
+ * Tiles don't have to divide the image evenly and are computed on the luma plane in place,
+ * GRAYSCALE and YUV420 images are processed without a copy.
  */
+#include "imlib.h"
+#include "simd.h"
+#include "xalloc.h"
+
+#define CLAHE_BINS          (256)
+#define CLAHE_WEIGHT_BITS   (8)
+#define CLAHE_WEIGHT_ONE    (1 << CLAHE_WEIGHT_BITS)
+#define CLAHE_LUT_MAX       (COLOR_GRAYSCALE_MAX << CLAHE_LUT_BITS)
+
+static void clahe_grid(clahe_t *clahe, int w, int h, int *nx, int *ny) {
+    // Same default grid as before, scaled down from 16 tiles per axis with the image size.
+    *nx = clahe->tiles_x ? clahe->tiles_x : (CLAHE_MAX_TILES >> (10 - IM_MIN(IM_LOG2_32(w), 10)));
+    *ny = clahe->tiles_y ? clahe->tiles_y : (CLAHE_MAX_TILES >> (10 - IM_MIN(IM_LOG2_32(h), 10)));
+    // The interpolation needs two tiles per axis and tiles at least 2 pixels wide.
+    *nx = IM_MAX(IM_MIN(*nx, IM_MIN(w / 2, CLAHE_MAX_TILES)), 2);
+    *ny = IM_MAX(IM_MIN(*ny, IM_MIN(h / 2, CLAHE_MAX_TILES)), 2);
+}
 
-#ifdef BYTE_IMAGE
-typedef unsigned char kz_pixel_t;        /* for 8 bit-per-pixel images */
-#define uiNR_OF_GREY    (256)
-#else
-typedef unsigned short kz_pixel_t;       /* for 12 bit-per-pixel images (default) */
-#define uiNR_OF_GREY    (4096)
-#endif
-
-/******** Prototype of CLAHE function. Put this in a separate include file. *****/
-int CLAHE(kz_pixel_t *pImage, unsigned int uiXRes, unsigned int uiYRes, kz_pixel_t Min,
-          kz_pixel_t Max, unsigned int uiNrX, unsigned int uiNrY,
-          unsigned int uiNrBins, float fCliplimit);
-
-/*********************** Local prototypes ************************/
-static void ClipHistogram(unsigned long *, unsigned int, unsigned long);
-static void MakeHistogram(kz_pixel_t *, unsigned int, unsigned int, unsigned int,
-                          unsigned long *, unsigned int, kz_pixel_t *);
-static void MapHistogram(unsigned long *, kz_pixel_t, kz_pixel_t,
-                         unsigned int, unsigned long);
-static void MakeLut(kz_pixel_t *, kz_pixel_t, kz_pixel_t, unsigned int);
-static void Interpolate(kz_pixel_t *, int, unsigned long *, unsigned long *,
-                        unsigned long *, unsigned long *, unsigned int, unsigned int, kz_pixel_t *);
-
-/**************  Start of actual code **************/
-const unsigned int uiMAX_REG_X = 16;      /* max. # contextual regions in x-direction */
-const unsigned int uiMAX_REG_Y = 16;      /* max. # contextual regions in y-direction */
-
-/************************** main function CLAHE ******************/
-int CLAHE(kz_pixel_t *pImage, unsigned int uiXRes, unsigned int uiYRes,
-          kz_pixel_t Min, kz_pixel_t Max, unsigned int uiNrX, unsigned int uiNrY,
-          unsigned int uiNrBins, float fCliplimit) {
-/*   pImage - Pointer to the input/output image
- *   uiXRes - Image resolution in the X direction
- *   uiYRes - Image resolution in the Y direction
- *   Min - Minimum greyvalue of input image (also becomes minimum of output image)
- *   Max - Maximum greyvalue of input image (also becomes maximum of output image)
- *   uiNrX - Number of contextial regions in the X direction (min 2, max uiMAX_REG_X)
- *   uiNrY - Number of contextial regions in the Y direction (min 2, max uiMAX_REG_Y)
- *   uiNrBins - Number of greybins for histogram ("dynamic range")
- *   float fCliplimit - Normalized cliplimit (higher values give more contrast)
- * The number of "effective" greylevels in the output image is set by uiNrBins; selecting
- * a small value (eg. 128) speeds up processing and still produce an output image of
- * good quality. The output image will have the same minimum and maximum value as the input
- * image. A clip limit smaller than 1 results in standard (non-contrast limited) AHE.
- */
-    unsigned int uiX, uiY;                /* counters */
-    unsigned int uiXSize, uiYSize, uiSubX, uiSubY; /* size of context. reg. and subimages */
-    unsigned int uiXL, uiXR, uiYU, uiYB;  /* auxiliary variables interpolation routine */
-    unsigned long ulClipLimit, ulNrPixels;/* clip limit and region pixel count */
-    kz_pixel_t *pImPointer;               /* pointer to image */
-    kz_pixel_t aLUT[uiNR_OF_GREY];        /* lookup table used for scaling of input image */
-    unsigned long *pulHist, *pulMapArray; /* pointer to histogram and mappings*/
-    unsigned long *pulLU, *pulLB, *pulRU, *pulRB; /* auxiliary pointers interpolation */
-
-    if (uiNrX > uiMAX_REG_X) {
-        return -1;                        /* # of regions x-direction too large */
-    }
-    if (uiNrY > uiMAX_REG_Y) {
-        return -2;                        /* # of regions y-direction too large */
-    }
-    if (uiXRes % uiNrX) {
-        return -3;                        /* x-resolution no multiple of uiNrX */
-    }
-    if (uiYRes % uiNrY) {
-        return -4;                        /* y-resolution no multiple of uiNrY */
-    }
-    if (Max >= uiNR_OF_GREY) {
-        return -5;                        /* maximum too large */
-    }
-    if (Min >= Max) {
-        return -6;                        /* minimum equal or larger than maximum */
-    }
-    if (uiNrX < 2 || uiNrY < 2) {
-        return -7;                        /* at least 4 contextual regions required */
-    }
-    if (fCliplimit == 1.0) {
-        return 0;                         /* is OK, immediately returns original image. */
-    }
-    if (uiNrBins == 0) {
-        uiNrBins = 128;                   /* default value when not specified */
+static size_t clahe_state_size(int w, int h, int nx, int ny) {
+    return (nx * ny * CLAHE_BINS * sizeof(uint16_t)) + ((w + h) * sizeof(uint32_t));
+}
 
-    }
-    pulMapArray = (unsigned long *) fb_alloc(sizeof(unsigned long) * uiNrX * uiNrY * uiNrBins, FB_ALLOC_NO_HINT);
-    if (pulMapArray == 0) {
-        return -8;                        /* Not enough memory! (try reducing uiNrBins) */
+// Tile i spans [i * size / n, (i + 1) * size / n), the map holds the table offset of the tile
+// whose center is left of (above) the pixel and the weight of the next one.
+static void clahe_make_map(uint32_t *map, int size, int n, uint32_t stride) {
+    for (int i = 0, p = 0; p < size; p++) {
+        int pos = p * 2; // Doubled coordinates keep the centers integral.
 
-    }
-    uiXSize = uiXRes / uiNrX; uiYSize = uiYRes / uiNrY;  /* Actual size of contextual regions */
-    ulNrPixels = (unsigned long) uiXSize * (unsigned long) uiYSize;
-
-    if (fCliplimit > 0.0) {
-        /* Calculate actual cliplimit  */
-        ulClipLimit = (unsigned long) (fCliplimit * (uiXSize * uiYSize) / uiNrBins);
-        ulClipLimit = (ulClipLimit < 1UL) ? 1UL : ulClipLimit;
-    } else {
-        ulClipLimit = 1UL << 14;          /* Large value, do not clip (AHE) */
-    }
-    MakeLut(aLUT, Min, Max, uiNrBins);    /* Make lookup table for mapping of greyvalues */
-    /* Calculate greylevel mappings for each contextual region */
-    for (uiY = 0, pImPointer = pImage; uiY < uiNrY; uiY++) {
-        for (uiX = 0; uiX < uiNrX; uiX++, pImPointer += uiXSize) {
-            pulHist = &pulMapArray[uiNrBins * (uiY * uiNrX + uiX)];
-            MakeHistogram(pImPointer, uiXRes, uiXSize, uiYSize, pulHist, uiNrBins, aLUT);
-            ClipHistogram(pulHist, uiNrBins, ulClipLimit);
-            MapHistogram(pulHist, Min, Max, uiNrBins, ulNrPixels);
+        while ((i < (n - 2)) && (pos >= ((((i + 1) * size / n) + ((i + 2) * size / n)) - 1))) {
+            i++;
         }
-        pImPointer += (uiYSize - 1) * uiXRes;             /* skip lines, set pointer */
+
+        int c0 = ((i * size / n) + ((i + 1) * size / n)) - 1;
+        int c1 = (((i + 1) * size / n) + ((i + 2) * size / n)) - 1;
+        int weight = (((pos - c0) << CLAHE_WEIGHT_BITS) + ((c1 - c0) / 2)) / (c1 - c0);
+        map[p] = ((i * stride) << 16) | IM_MIN(IM_MAX(weight, 0), CLAHE_WEIGHT_ONE);
     }
+}
 
-    /* Interpolate greylevel mappings to get CLAHE image */
-    for (pImPointer = pImage, uiY = 0; uiY <= uiNrY; uiY++) {
-        if (uiY == 0) {
-            /* special case: top row */
-            uiSubY = uiYSize >> 1;  uiYU = 0; uiYB = 0;
-        } else {
-            if (uiY == uiNrY) {
-                /* special case: bottom row */
-                uiSubY = (uiYSize + 1) >> 1;        uiYU = uiNrY - 1;  uiYB = uiYU;
-            } else {
-                /* default values */
-                uiSubY = uiYSize; uiYU = uiY - 1; uiYB = uiYU + 1;
-            }
-        }
-        for (uiX = 0; uiX <= uiNrX; uiX++) {
-            if (uiX == 0) {
-                /* special case: left column */
-                uiSubX = uiXSize >> 1; uiXL = 0; uiXR = 0;
-            } else {
-                if (uiX == uiNrX) {
-                    /* special case: right column */
-                    uiSubX = (uiXSize + 1) >> 1;  uiXL = uiNrX - 1; uiXR = uiXL;
-                } else {
-                    /* default values */
-                    uiSubX = uiXSize; uiXL = uiX - 1; uiXR = uiXL + 1;
-                }
-            }
+static void clahe_state_init(clahe_t *clahe, int w, int h, int nx, int ny, void *buf) {
+    clahe->w = w;
+    clahe->h = h;
+    clahe->nx = nx;
+    clahe->ny = ny;
+    clahe->primed = false;
+    clahe->next_tile = 0;
+    clahe->luts = buf;
+    clahe->x_map = (uint32_t *) (clahe->luts + (nx * ny * CLAHE_BINS));
+    clahe->y_map = clahe->x_map + w;
+    clahe_make_map(clahe->x_map, w, nx, CLAHE_BINS);
+    clahe_make_map(clahe->y_map, h, ny, nx * CLAHE_BINS);
+}
 
-            pulLU = &pulMapArray[uiNrBins * (uiYU * uiNrX + uiXL)];
-            pulRU = &pulMapArray[uiNrBins * (uiYU * uiNrX + uiXR)];
-            pulLB = &pulMapArray[uiNrBins * (uiYB * uiNrX + uiXL)];
-            pulRB = &pulMapArray[uiNrBins * (uiYB * uiNrX + uiXR)];
-            Interpolate(pImPointer, uiXRes, pulLU, pulRU, pulLB, pulRB, uiSubX, uiSubY, aLUT);
-            pImPointer += uiSubX;                         /* set pointer on next matrix */
+// Builds the table of one tile from its histogram. Four interleaved histograms break the
+// store to load dependency between equal neighbouring pixels, they are merged with vectors.
+static void clahe_tile(clahe_t *clahe, const uint8_t *plane, int tx, int ty, uint32_t *hist) {
+    int x0 = tx * clahe->w / clahe->nx, x1 = (tx + 1) * clahe->w / clahe->nx;
+    int y0 = ty * clahe->h / clahe->ny, y1 = (ty + 1) * clahe->h / clahe->ny;
+    uint32_t n_pixels = (x1 - x0) * (y1 - y0);
+    uint32_t *h0 = hist, *h1 = hist + CLAHE_BINS, *h2 = h1 + CLAHE_BINS, *h3 = h2 + CLAHE_BINS;
+
+    memset(hist, 0, 4 * CLAHE_BINS * sizeof(uint32_t));
+
+    for (int y = y0; y < y1; y++) {
+        const uint8_t *row = plane + (y * clahe->w) + x0;
+        int x = 0, xx = x1 - x0;
+
+        for (; x <= (xx - 4); x += 4) {
+            h0[row[x + 0]]++;
+            h1[row[x + 1]]++;
+            h2[row[x + 2]]++;
+            h3[row[x + 3]]++;
         }
-        pImPointer += (uiSubY - 1) * uiXRes;
-    }
-    fb_free();                                            /* free space for histograms */
-    return 0;                                             /* return status OK */
-}
 
-void ClipHistogram(unsigned long *pulHistogram, unsigned int
-                   uiNrGreylevels, unsigned long ulClipLimit) {
-/* This function performs clipping of the histogram and redistribution of bins.
- * The histogram is clipped and the number of excess pixels is counted. Afterwards
- * the excess pixels are equally redistributed across the whole histogram (providing
- * the bin count is smaller than the cliplimit).
- */
-    unsigned long *pulBinPointer, *pulEndPointer, *pulHisto;
-    unsigned long ulNrExcess, ulUpper, ulBinIncr, ulStepSize, i;
-    long lBinExcess;
-
-    ulNrExcess = 0;  pulBinPointer = pulHistogram;
-    for (i = 0; i < uiNrGreylevels; i++) {
-        /* calculate total number of excess pixels */
-        lBinExcess = (long) pulBinPointer[i] - (long) ulClipLimit;
-        if (lBinExcess > 0) {
-            ulNrExcess += lBinExcess;                   /* excess in current bin */
+        for (; x < xx; x++) {
+            h0[row[x]]++;
         }
     }
-    ;
-
-    /* Second part: clip histogram and redistribute excess pixels in each bin */
-    ulBinIncr = ulNrExcess / uiNrGreylevels;            /* average binincrement */
-    ulUpper = ulClipLimit - ulBinIncr;     /* Bins larger than ulUpper set to cliplimit */
-
-    for (i = 0; i < uiNrGreylevels; i++) {
-        if (pulHistogram[i] > ulClipLimit) {
-            pulHistogram[i] = ulClipLimit;                              /* clip bin */
-        } else {
-            if (pulHistogram[i] > ulUpper) {
-                /* high bin count */
-                ulNrExcess -= pulHistogram[i] - ulUpper; pulHistogram[i] = ulClipLimit;
-            } else {
-                /* low bin count */
-                ulNrExcess -= ulBinIncr; pulHistogram[i] += ulBinIncr;
-            }
-        }
+
+    uint32_t limit = (clahe->clip_limit > 0.0f) ? IM_MAX((uint32_t) (clahe->clip_limit * n_pixels / CLAHE_BINS), 1u)
+                                                  : n_pixels;
+    vec_u32_t v_limit = {}, v_excess = {};
+    v_limit += limit;
+
+    for (int i = 0; i < CLAHE_BINS; i += VEC_LANES) {
+        vec_u32_t v = VEC_LOAD(vec_u32_t, h0 + i) + VEC_LOAD(vec_u32_t, h1 + i) +
+                      VEC_LOAD(vec_u32_t, h2 + i) + VEC_LOAD(vec_u32_t, h3 + i);
+        vec_u32_t over = (vec_u32_t) (v > v_limit);
+        vec_u32_t clipped = (v & ~over) | (v_limit & over);
+        v_excess += v - clipped;
+        VEC_STORE(h0 + i, clipped);
     }
 
-    while (ulNrExcess) {
-        /* Redistribute remaining excess  */
-        pulEndPointer = &pulHistogram[uiNrGreylevels]; pulHisto = pulHistogram;
+    uint32_t excess = 0;
+    for (int i = 0; i < VEC_LANES; i++) {
+        excess += v_excess[i];
+    }
 
-        while (ulNrExcess && pulHisto < pulEndPointer) {
-            ulStepSize = uiNrGreylevels / ulNrExcess;
-            if (ulStepSize < 1) {
-                ulStepSize = 1;                         /* stepsize at least 1 */
+    // Redistribute the clipped pixels evenly without pushing any bin over the limit, bins
+    // within one increment of the limit are filled up to it and the remainder is strided.
+    // The increment may exceed the limit itself when clip_limit < 1.
+    if (excess) {
+        uint32_t incr = excess / CLAHE_BINS;
+
+        for (int i = 0; i < CLAHE_BINS; i++) {
+            if (h0[i] < limit) {
+                uint32_t add = IM_MIN(incr, limit - h0[i]);
+                h0[i] += add;
+                excess -= add;
             }
-            for (pulBinPointer = pulHisto; pulBinPointer < pulEndPointer && ulNrExcess;
-                 pulBinPointer += ulStepSize) {
-                if (*pulBinPointer < ulClipLimit) {
-                    (*pulBinPointer)++;  ulNrExcess--;  /* reduce excess */
+        }
+
+        for (uint32_t last = 0; excess && (excess != last); ) {
+            last = excess;
+            for (int start = 0; (start < CLAHE_BINS) && excess; start++) {
+                int step = IM_MAX(CLAHE_BINS / excess, 1u);
+                for (int i = start; (i < CLAHE_BINS) && excess; i += step) {
+                    if (h0[i] < limit) {
+                        h0[i]++;
+                        excess--;
+                    }
                 }
             }
-            pulHisto++;  /* restart redistributing on other bin location */
         }
     }
-}
 
-void MakeHistogram(kz_pixel_t *pImage, unsigned int uiXRes,
-                   unsigned int uiSizeX, unsigned int uiSizeY,
-                   unsigned long *pulHistogram,
-                   unsigned int uiNrGreylevels, kz_pixel_t *pLookupTable) {
-/* This function classifies the greylevels present in the array image into
- * a greylevel histogram. The pLookupTable specifies the relationship
- * between the greyvalue of the pixel (typically between 0 and 4095) and
- * the corresponding bin in the histogram (usually containing only 128 bins).
- */
-    kz_pixel_t *pImagePointer;
-    unsigned int i;
+    // Equalize into 8.8 fixed point so temporal blending doesn't stall on rounding.
+    uint16_t *lut = clahe->luts + ((ty * clahe->nx) + tx) * CLAHE_BINS;
+    uint16_t new_lut[CLAHE_BINS];
+    uint64_t scale = (((uint64_t) CLAHE_LUT_MAX) << 32) / n_pixels;
 
-    for (i = 0; i < uiNrGreylevels; i++) {
-        pulHistogram[i] = 0L;                                  /* clear histogram */
+    for (uint32_t i = 0, sum = 0; i < CLAHE_BINS; i++) {
+        sum += h0[i];
+        new_lut[i] = IM_MIN((uint32_t) ((sum * scale) >> 32), (uint32_t) CLAHE_LUT_MAX);
+    }
 
+    if (!clahe->primed || (clahe->blend >= CLAHE_WEIGHT_ONE)) {
+        memcpy(lut, new_lut, sizeof(new_lut));
+        return;
     }
-    for (i = 0; i < uiSizeY; i++) {
-        pImagePointer = &pImage[uiSizeX];
-        while (pImage < pImagePointer) {
-            pulHistogram[pLookupTable[*pImage++]]++;
-        }
-        pImagePointer += uiXRes;
-        pImage = &pImagePointer[-(int) uiSizeX];        /* go to bdeginning of next row */
+
+    vec_u32_t v_alpha = {}, v_beta = {}, v_round = {};
+    v_alpha += clahe->blend;
+    v_beta += CLAHE_WEIGHT_ONE - clahe->blend;
+    v_round += CLAHE_WEIGHT_ONE / 2;
+
+    for (int i = 0; i < CLAHE_BINS; i += VEC_LANES) {
+        vec_u32_t o = VEC_U16_TO_U32(VEC_LOAD(vec_u16_t, lut + i));
+        vec_u32_t n = VEC_U16_TO_U32(VEC_LOAD(vec_u16_t, new_lut + i));
+        VEC_STORE(lut + i, VEC_U32_TO_U16(((o * v_beta) + (n * v_alpha) + v_round) >> CLAHE_WEIGHT_BITS));
     }
 }
 
-void MapHistogram(unsigned long *pulHistogram, kz_pixel_t Min, kz_pixel_t Max,
-                  unsigned int uiNrGreylevels, unsigned long ulNrOfPixels) {
-/* This function calculates the equalized lookup table (mapping) by
- * cumulating the input histogram. Note: lookup table is rescaled in range [Min..Max].
- */
-    unsigned int i;  unsigned long ulSum = 0;
-    const float fScale = ((float) (Max - Min)) / ulNrOfPixels;
-    const unsigned long ulMin = (unsigned long) Min;
-
-    for (i = 0; i < uiNrGreylevels; i++) {
-        ulSum += pulHistogram[i]; pulHistogram[i] = (unsigned long) (ulMin + ulSum * fScale);
-        if (pulHistogram[i] > Max) {
-            pulHistogram[i] = Max;
-        }
+// Maps one row of luma through the four surrounding tile tables.
+static void clahe_map_row(clahe_t *clahe, const uint8_t *src, uint8_t *dst, int y) {
+    uint32_t ym = clahe->y_map[y];
+    uint32_t wy = ym & 0xFFFF, iwy = CLAHE_WEIGHT_ONE - wy;
+    const uint16_t *top = clahe->luts + (ym >> 16);
+    const uint16_t *bot = top + (clahe->nx * CLAHE_BINS);
+
+    for (int x = 0, w = clahe->w; x < w; x++) {
+        uint32_t xm = clahe->x_map[x];
+        uint32_t wx = xm & 0xFFFF, iwx = CLAHE_WEIGHT_ONE - wx;
+        uint32_t v = src[x] + (xm >> 16);
+        uint32_t t = (top[v] * iwx) + (top[v + CLAHE_BINS] * wx);
+        uint32_t b = (bot[v] * iwx) + (bot[v + CLAHE_BINS] * wx);
+        dst[x] = ((t * iwy) + (b * wy) + (1 << (CLAHE_LUT_BITS + (CLAHE_WEIGHT_BITS * 2) - 1)))
+                 >> (CLAHE_LUT_BITS + (CLAHE_WEIGHT_BITS * 2));
     }
 }
 
-void MakeLut(kz_pixel_t *pLUT, kz_pixel_t Min, kz_pixel_t Max, unsigned int uiNrBins) {
-/* To speed up histogram clipping, the input image [Min,Max] is scaled down to
- * [0,uiNrBins-1]. This function calculates the LUT.
- */
-    int i;
-    const kz_pixel_t BinSize = (kz_pixel_t) (1 + (Max - Min) / uiNrBins);
-
-    for (i = Min; i <= Max; i++) {
-        pLUT[i] = (i - Min) / BinSize;
-    }
+void imlib_clahe_init(clahe_t *clahe, float clip_limit, int tiles_x, int tiles_y, float blend, int tiles_per_frame) {
+    memset(clahe, 0, sizeof(clahe_t));
+    clahe->clip_limit = clip_limit;
+    clahe->tiles_x = tiles_x;
+    clahe->tiles_y = tiles_y;
+    clahe->blend = fast_roundf(IM_MIN(IM_MAX(blend, 0.0f), 1.0f) * CLAHE_WEIGHT_ONE);
+    clahe->tiles_per_frame = IM_MAX(tiles_per_frame, 0);
 }
 
-void Interpolate(kz_pixel_t *pImage, int uiXRes, unsigned long *pulMapLU,
-                 unsigned long *pulMapRU, unsigned long *pulMapLB,  unsigned long *pulMapRB,
-                 unsigned int uiXSize, unsigned int uiYSize, kz_pixel_t *pLUT) {
-/* pImage      - pointer to input/output image
- * uiXRes      - resolution of image in x-direction
- * pulMap*     - mappings of greylevels from histograms
- * uiXSize     - uiXSize of image submatrix
- * uiYSize     - uiYSize of image submatrix
- * pLUT        - lookup table containing mapping greyvalues to bins
- * This function calculates the new greylevel assignments of pixels within a submatrix
- * of the image with size uiXSize and uiYSize. This is done by a bilinear interpolation
- * between four different mappings in order to eliminate boundary artifacts.
- * It uses a division; since division is often an expensive operation, I added code to
- * perform a logical shift instead when feasible.
- */
-    const unsigned int uiIncr = uiXRes - uiXSize; /* Pointer increment after processing row */
-    kz_pixel_t GreyValue; unsigned int uiNum = uiXSize * uiYSize; /* Normalization factor */
-
-    unsigned int uiXCoef, uiYCoef, uiXInvCoef, uiYInvCoef, uiShift = 0;
-
-    if (uiNum & (uiNum - 1)) {
-        /* If uiNum is not a power of two, use division */
-        for (uiYCoef = 0, uiYInvCoef = uiYSize; uiYCoef < uiYSize;
-             uiYCoef++, uiYInvCoef--, pImage += uiIncr) {
-            for (uiXCoef = 0, uiXInvCoef = uiXSize; uiXCoef < uiXSize;
-                 uiXCoef++, uiXInvCoef--) {
-                GreyValue = pLUT[*pImage];         /* get histogram bin value */
-                *pImage++ = (kz_pixel_t) ((uiYInvCoef * (uiXInvCoef * pulMapLU[GreyValue]
-                                                         + uiXCoef * pulMapRU[GreyValue])
-                                           + uiYCoef * (uiXInvCoef * pulMapLB[GreyValue]
-                                                        + uiXCoef * pulMapRB[GreyValue])) / uiNum);
-            }
-        }
-    } else{
-        /* avoid the division and use a right shift instead */
-        while (uiNum >>= 1) {
-            uiShift++;                             /* Calculate 2log of uiNum */
-        }
-        for (uiYCoef = 0, uiYInvCoef = uiYSize; uiYCoef < uiYSize;
-             uiYCoef++, uiYInvCoef--, pImage += uiIncr) {
-            for (uiXCoef = 0, uiXInvCoef = uiXSize; uiXCoef < uiXSize;
-                 uiXCoef++, uiXInvCoef--) {
-                GreyValue = pLUT[*pImage];        /* get histogram bin value */
-                *pImage++ = (kz_pixel_t) ((uiYInvCoef * (uiXInvCoef * pulMapLU[GreyValue]
-                                                         + uiXCoef * pulMapRU[GreyValue])
-                                           + uiYCoef * (uiXInvCoef * pulMapLB[GreyValue]
-                                                        + uiXCoef * pulMapRB[GreyValue])) >> uiShift);
-            }
-        }
+void imlib_clahe_free(clahe_t *clahe) {
+    if (clahe->luts) {
+        xfree(clahe->luts);
     }
+
+    clahe->luts = NULL;
+    clahe->primed = false;
 }
 
-void imlib_clahe_histeq(image_t *img, float clip_limit, image_t *mask) {
-    int xTileSize = IM_MAX(uiMAX_REG_X >> (10 - IM_MIN(IM_LOG2_32(img->w), 10)), 2u);
-    int yTileSize = IM_MAX(uiMAX_REG_Y >> (10 - IM_MIN(IM_LOG2_32(img->h), 10)), 2u);
-    int pImageW = img->w + ((img->w % xTileSize) ? (xTileSize - (img->w % xTileSize)) : 0);
-    int pImageH = img->h + ((img->h % yTileSize) ? (yTileSize - (img->h % yTileSize)) : 0);
-    int xOffset = (pImageW - img->w) / 2;
-    int yOffset = (pImageH - img->h) / 2;
-
-    image_t temp;
-    temp.w = img->w;
-    temp.h = img->h;
-    temp.pixfmt = img->pixfmt;
-    temp.data = fb_alloc0(pImageW * pImageH * sizeof(kz_pixel_t), FB_ALLOC_NO_HINT);
+void imlib_clahe(clahe_t *clahe, image_t *img, image_t *mask) {
+    uint8_t *plane = NULL;
 
     switch (img->pixfmt) {
-        case PIXFORMAT_BINARY: {
-            for (int y = 0, yy = img->h; y < yy; y++) {
-                uint8_t *clahe_row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(&temp, y + yOffset);
-                uint32_t *row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, y);
-                for (int x = 0, xx = img->w; x < xx; x++) {
-                    IMAGE_PUT_GRAYSCALE_PIXEL_FAST(clahe_row_ptr, x + xOffset,
-                                                   COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x)));
-                }
-            }
+        case PIXFORMAT_BINARY:
+        case PIXFORMAT_RGB565:
             break;
-        }
-        case PIXFORMAT_GRAYSCALE: {
-            for (int y = 0, yy = img->h; y < yy; y++) {
-                uint8_t *clahe_row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(&temp, y + yOffset);
-                uint8_t *row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y);
+        case PIXFORMAT_GRAYSCALE:
+        case PIXFORMAT_YUV420:
+        case PIXFORMAT_YVU420:
+            plane = img->data;
+            break;
+        default:
+            return;
+    }
+
+    if ((img->w < 4) || (img->h < 4)) {
+        return;
+    }
+
+    int nx, ny;
+    clahe_grid(clahe, img->w, img->h, &nx, &ny);
+
+    if ((!clahe->luts) || (clahe->w != img->w) || (clahe->h != img->h) || (clahe->nx != nx) || (clahe->ny != ny)) {
+        imlib_clahe_free(clahe);
+        clahe_state_init(clahe, img->w, img->h, nx, ny, xalloc(clahe_state_size(img->w, img->h, nx, ny)));
+    }
+
+    if (!plane) {
+        plane = fb_alloc(img->w * img->h, FB_ALLOC_NO_HINT);
+
+        for (int y = 0, yy = img->h; y < yy; y++) {
+            uint8_t *luma_row_ptr = plane + (y * img->w);
+
+            if (img->pixfmt == PIXFORMAT_BINARY) {
+                uint32_t *row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, y);
                 for (int x = 0, xx = img->w; x < xx; x++) {
-                    IMAGE_PUT_GRAYSCALE_PIXEL_FAST(clahe_row_ptr, x + xOffset,
-                                                   IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x));
+                    luma_row_ptr[x] = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x));
                 }
-            }
-            break;
-        }
-        case PIXFORMAT_RGB565: {
-            for (int y = 0, yy = img->h; y < yy; y++) {
-                uint8_t *clahe_row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(&temp, y + yOffset);
+            } else {
                 uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y);
                 for (int x = 0, xx = img->w; x < xx; x++) {
-                    IMAGE_PUT_GRAYSCALE_PIXEL_FAST(clahe_row_ptr, x + xOffset,
-                                                   COLOR_RGB565_TO_GRAYSCALE(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x)));
+                    luma_row_ptr[x] = COLOR_RGB565_TO_GRAYSCALE(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x));
                 }
             }
-            break;
-        }
-        default: {
-            break;
         }
     }
 
-    CLAHE((kz_pixel_t *) temp.data,
-          pImageW, pImageH,
-          COLOR_GRAYSCALE_MIN, COLOR_GRAYSCALE_MAX,
-          xTileSize, yTileSize,
-          COLOR_GRAYSCALE_MAX - COLOR_GRAYSCALE_MIN + 1,
-          clip_limit);
+    // All tiles are computed on the first frame, afterwards only a round robin subset if asked.
+    int n_tiles = nx * ny;
+    int count = (clahe->primed && clahe->tiles_per_frame) ? IM_MIN(clahe->tiles_per_frame, n_tiles) : n_tiles;
+    uint32_t *hist = fb_alloc(4 * CLAHE_BINS * sizeof(uint32_t), FB_ALLOC_NO_HINT);
 
-    switch (img->pixfmt) {
-        case PIXFORMAT_BINARY: {
-            for (int y = 0, yy = img->h; y < yy; y++) {
-                uint8_t *clahe_row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(&temp, y + yOffset);
+    for (int i = 0; i < count; i++) {
+        int tile = (clahe->next_tile + i) % n_tiles;
+        clahe_tile(clahe, plane, tile % nx, tile / nx, hist);
+    }
+
+    clahe->next_tile = (clahe->next_tile + count) % n_tiles;
+    clahe->primed = true;
+    fb_free(); // hist
+
+    uint8_t *out = fb_alloc(img->w, FB_ALLOC_NO_HINT);
+
+    for (int y = 0, yy = img->h; y < yy; y++) {
+        uint8_t *luma_row_ptr = plane + (y * img->w);
+
+        // Rows are mapped into a buffer first since the source row may be the destination.
+        clahe_map_row(clahe, luma_row_ptr, out, y);
+
+        switch (img->pixfmt) {
+            case PIXFORMAT_BINARY: {
                 uint32_t *row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, y);
                 for (int x = 0, xx = img->w; x < xx; x++) {
                     if (mask && (!image_get_mask_pixel(mask, x, y))) {
                         continue;
                     }
-                    IMAGE_PUT_BINARY_PIXEL_FAST(row_ptr, x,
-                                                COLOR_GRAYSCALE_TO_BINARY(IMAGE_GET_GRAYSCALE_PIXEL_FAST(clahe_row_ptr,
-                                                                                                         x + xOffset)));
-                }
-            }
-            break;
-        }
-        case PIXFORMAT_GRAYSCALE: {
-            for (int y = 0, yy = img->h; y < yy; y++) {
-                uint8_t *clahe_row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(&temp, y + yOffset);
-                uint8_t *row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y);
-                for (int x = 0, xx = img->w; x < xx; x++) {
-                    if (mask && (!image_get_mask_pixel(mask, x, y))) {
-                        continue;
-                    }
-                    IMAGE_PUT_GRAYSCALE_PIXEL_FAST(row_ptr, x,
-                                                   IMAGE_GET_GRAYSCALE_PIXEL_FAST(clahe_row_ptr, x + xOffset));
+                    IMAGE_PUT_BINARY_PIXEL_FAST(row_ptr, x, COLOR_GRAYSCALE_TO_BINARY(out[x]));
                 }
+                break;
             }
-            break;
-        }
-        case PIXFORMAT_RGB565: {
-            for (int y = 0, yy = img->h; y < yy; y++) {
-                uint8_t *clahe_row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(&temp, y + yOffset);
+            case PIXFORMAT_RGB565: {
                 uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y);
                 for (int x = 0, xx = img->w; x < xx; x++) {
                     if (mask && (!image_get_mask_pixel(mask, x, y))) {
@@ -453,17 +292,44 @@ void imlib_clahe_histeq(image_t *img, float clip_limit, image_t *mask) {
                     }
                     int pixel = IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x);
                     IMAGE_PUT_RGB565_PIXEL_FAST(row_ptr, x,
-                                                imlib_yuv_to_rgb(IMAGE_GET_GRAYSCALE_PIXEL_FAST(clahe_row_ptr, x + xOffset),
+                                                imlib_yuv_to_rgb(out[x],
                                                                  COLOR_RGB565_TO_U(pixel),
                                                                  COLOR_RGB565_TO_V(pixel)));
                 }
+                break;
+            }
+            default: {
+                // GRAYSCALE or the Y plane of YUV420, the chroma planes are left untouched.
+                if (!mask) {
+                    memcpy(luma_row_ptr, out, img->w);
+                    break;
+                }
+                for (int x = 0, xx = img->w; x < xx; x++) {
+                    if (image_get_mask_pixel(mask, x, y)) {
+                        luma_row_ptr[x] = out[x];
+                    }
+                }
+                break;
             }
-            break;
-        }
-        default: {
-            break;
         }
     }
 
+    fb_free(); // out
+
+    if (plane != img->data) {
+        fb_free(); // plane
+    }
+}
+
+void imlib_clahe_histeq(image_t *img, float clip_limit, image_t *mask) {
+    clahe_t clahe;
+    int nx, ny;
+
+    imlib_clahe_init(&clahe, clip_limit, 0, 0, 1.0f, 0);
+    clahe_grid(&clahe, img->w, img->h, &nx, &ny);
+    // Single frame, the tables live on the frame buffer stack instead of the heap.
+    clahe_state_init(&clahe, img->w, img->h, nx, ny,
+                     fb_alloc(clahe_state_size(img->w, img->h, nx, ny), FB_ALLOC_NO_HINT));
+    imlib_clahe(&clahe, img, mask);
     fb_free();
 }
@@ -0,0 +1,213 @@
+/*
+ * This file is part of the OpenMV project.
+ *
+ * Copyright (c) 2013-2023 Ibrahim Abdelkader <iabdalkader@openmv.io>
+ * Copyright (c) 2013-2023 Kwabena W. Agyeman <kwagyeman@openmv.io>
+ *
+ * This work is licensed under the MIT license, see the file LICENSE for details.
+ *
+ * Single pass color correction.
+ *
+ * awb(), ccm() and gamma() each walk the whole frame, and awb() walks it twice to gather its
+ * statistics first. White balance gains and gamma/contrast/brightness are per-channel curves and
+ * the CCM and saturation are linear, so the whole chain composes exactly into a table lookup per
+ * channel, one fixed-point matrix and a shared output table. The white balance statistics are
+ * gathered while a frame is corrected and give the gains used for the next frame.
+ */
+#include "imlib.h"
+#include "fmath.h"
+
+#ifdef IMLIB_ENABLE_COLOR_CORR
+
+#define COLOR_CORR_MAX      ((1 << COLOR_CORR_BITS) - 1)
+#define COLOR_CORR_MAX_GAIN (4.0f)  // Same limit as imlib_awb().
+
+void imlib_color_corr_init(color_corr_t *cc) {
+    memset(cc, 0, sizeof(color_corr_t));
+    cc->gains[0] = cc->gains[1] = cc->gains[2] = 1.0f;
+    cc->ccm[0] = cc->ccm[4] = cc->ccm[8] = 1.0f;
+    cc->saturation = 1.0f;
+    cc->gamma = 1.0f;
+    cc->contrast = 1.0f;
+    cc->dirty = true;
+}
+
+// Same curve as imlib_gamma().
+static int color_corr_tone(color_corr_t *cc, float inv_gamma, float x) {
+    int p = ((fast_powf(x, inv_gamma) * cc->contrast) + cc->brightness) * COLOR_R8_MAX;
+    return IM_MIN(IM_MAX(p, COLOR_R8_MIN), COLOR_R8_MAX);
+}
+
+static void color_corr_build(color_corr_t *cc) {
+    // Saturation scales the distance to luma: S = s * I + (1 - s) * [1, 1, 1]' * [0.299, 0.587, 0.114].
+    const float y_weights[3] = {0.299f, 0.587f, 0.114f};
+    float s = cc->saturation;
+    cc->linear = true;
+
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 4; j++) {
+            float acc = 0.0f;
+
+            for (int k = 0; k < 3; k++) {
+                float sat = ((i == k) ? s : 0.0f) + ((1.0f - s) * y_weights[k]);
+                acc += sat * ((j < 3) ? cc->ccm[(j * 3) + k] : (cc->ccm[9 + k] / COLOR_R8_MAX));
+            }
+
+            if (j < 3) {
+                cc->matrix[(i * 3) + j] = fast_roundf(acc * (1 << COLOR_CORR_MATRIX_BITS));
+                cc->linear &= fast_fabsf(acc - (i == j)) < 0.0001f;
+            } else {
+                cc->matrix[9 + i] = fast_roundf(acc * COLOR_CORR_MAX * (1 << COLOR_CORR_MATRIX_BITS));
+                cc->linear &= fast_fabsf(acc) < 0.0001f;
+            }
+        }
+    }
+
+    float inv_gamma = IM_DIV(1.0f, cc->gamma);
+
+    for (int i = 0; i <= COLOR_CORR_MAX; i++) {
+        cc->post[i] = color_corr_tone(cc, inv_gamma, i / ((float) COLOR_CORR_MAX));
+    }
+
+    cc->dirty = false;
+}
+
+// The gain tables are cheap and rebuilt per frame since auto white balance changes them.
+static void color_corr_build_gains(color_corr_t *cc, pixformat_t pixfmt) {
+    float inv_gamma = IM_DIV(1.0f, cc->gamma);
+
+    for (int c = 0; c < 3; c++) {
+        int max = (pixfmt == PIXFORMAT_RGB565) ? ((c == 1) ? COLOR_G6_MAX : COLOR_R5_MAX) : COLOR_R8_MAX;
+        float gain = cc->gains[c] / max;
+        cc->stats_scale[c] = max;
+
+        for (int v = 0; v <= max; v++) {
+            float x = IM_MIN(v * gain, 1.0f);
+            cc->pre[c][v] = cc->linear ? color_corr_tone(cc, inv_gamma, x) : fast_roundf(x * COLOR_CORR_MAX);
+        }
+    }
+}
+
+static void color_corr_update_gains(color_corr_t *cc) {
+    if (cc->awb == COLOR_CORR_AWB_OFF) {
+        return;
+    }
+
+    float r = cc->stats[0] / (float) cc->stats_scale[0];
+    float g = cc->stats[1] / (float) cc->stats_scale[1];
+    float b = cc->stats[2] / (float) cc->stats_scale[2];
+
+    cc->gains[0] = (r > 0.0f) ? IM_MIN(g / r, COLOR_CORR_MAX_GAIN) : 1.0f;
+    cc->gains[1] = 1.0f;
+    cc->gains[2] = (b > 0.0f) ? IM_MIN(g / b, COLOR_CORR_MAX_GAIN) : 1.0f;
+}
+
+static void color_corr_stats_row(color_corr_t *cc, uint8_t *row, int w, pixformat_t pixfmt) {
+    uint32_t r_acc = 0, g_acc = 0, b_acc = 0;
+    bool max = cc->awb == COLOR_CORR_AWB_WHITE_PATCH;
+
+    if (pixfmt == PIXFORMAT_RGB565) {
+        uint16_t *ptr = (uint16_t *) row;
+
+        for (int x = 0; x < w; x++) {
+            int pixel = ptr[x];
+            uint32_t r = COLOR_RGB565_TO_R5(pixel), g = COLOR_RGB565_TO_G6(pixel), b = COLOR_RGB565_TO_B5(pixel);
+            r_acc = max ? IM_MAX(r_acc, r) : (r_acc + r);
+            g_acc = max ? IM_MAX(g_acc, g) : (g_acc + g);
+            b_acc = max ? IM_MAX(b_acc, b) : (b_acc + b);
+        }
+    } else {
+        for (int x = 0; x < w; x++, row += 3) {
+            uint32_t r = row[0], g = row[1], b = row[2];
+            r_acc = max ? IM_MAX(r_acc, r) : (r_acc + r);
+            g_acc = max ? IM_MAX(g_acc, g) : (g_acc + g);
+            b_acc = max ? IM_MAX(b_acc, b) : (b_acc + b);
+        }
+    }
+
+    if (max) {
+        cc->stats[0] = IM_MAX(cc->stats[0], (uint64_t) r_acc);
+        cc->stats[1] = IM_MAX(cc->stats[1], (uint64_t) g_acc);
+        cc->stats[2] = IM_MAX(cc->stats[2], (uint64_t) b_acc);
+    } else {
+        cc->stats[0] += r_acc;
+        cc->stats[1] += g_acc;
+        cc->stats[2] += b_acc;
+    }
+}
+
+void imlib_color_corr(color_corr_t *cc, image_t *img) {
+    if ((img->pixfmt != PIXFORMAT_RGB565) && (img->pixfmt != PIXFORMAT_RGB888)) {
+        mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("Expected an RGB565 or RGB888 image!"));
+    }
+
+    if (cc->dirty) {
+        color_corr_build(cc);
+    }
+
+    color_corr_build_gains(cc, img->pixfmt);
+    memset(cc->stats, 0, sizeof(cc->stats));
+
+    const uint16_t *pre_r = cc->pre[0], *pre_g = cc->pre[1], *pre_b = cc->pre[2];
+    const uint8_t *post = cc->post;
+    const int32_t *m = cc->matrix;
+
+    for (int y = 0, w = img->w, yy = img->h; y < yy; y++) {
+        // The statistics pass reads the row while it is being corrected, so it stays in cache.
+        if (cc->awb != COLOR_CORR_AWB_OFF) {
+            color_corr_stats_row(cc, img->data + (y * w * img->bpp), w, img->pixfmt);
+        }
+
+        if (img->pixfmt == PIXFORMAT_RGB565) {
+            uint16_t *ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y);
+
+            if (cc->linear) {
+                for (int x = 0; x < w; x++) {
+                    int pixel = ptr[x];
+                    ptr[x] = COLOR_R8_G8_B8_TO_RGB565(pre_r[COLOR_RGB565_TO_R5(pixel)],
+                                                      pre_g[COLOR_RGB565_TO_G6(pixel)],
+                                                      pre_b[COLOR_RGB565_TO_B5(pixel)]);
+                }
+            } else {
+                for (int x = 0; x < w; x++) {
+                    int pixel = ptr[x];
+                    int r = pre_r[COLOR_RGB565_TO_R5(pixel)];
+                    int g = pre_g[COLOR_RGB565_TO_G6(pixel)];
+                    int b = pre_b[COLOR_RGB565_TO_B5(pixel)];
+                    int new_r = ((m[0] * r) + (m[1] * g) + (m[2] * b) + m[9]) >> COLOR_CORR_MATRIX_BITS;
+                    int new_g = ((m[3] * r) + (m[4] * g) + (m[5] * b) + m[10]) >> COLOR_CORR_MATRIX_BITS;
+                    int new_b = ((m[6] * r) + (m[7] * g) + (m[8] * b) + m[11]) >> COLOR_CORR_MATRIX_BITS;
+                    ptr[x] = COLOR_R8_G8_B8_TO_RGB565(post[IM_MIN(IM_MAX(new_r, 0), COLOR_CORR_MAX)],
+                                                      post[IM_MIN(IM_MAX(new_g, 0), COLOR_CORR_MAX)],
+                                                      post[IM_MIN(IM_MAX(new_b, 0), COLOR_CORR_MAX)]);
+                }
+            }
+        } else {
+            uint8_t *ptr = img->data + (y * w * 3);
+
+            if (cc->linear) {
+                for (int x = 0; x < w; x++, ptr += 3) {
+                    ptr[0] = pre_r[ptr[0]];
+                    ptr[1] = pre_g[ptr[1]];
+                    ptr[2] = pre_b[ptr[2]];
+                }
+            } else {
+                for (int x = 0; x < w; x++, ptr += 3) {
+                    int r = pre_r[ptr[0]];
+                    int g = pre_g[ptr[1]];
+                    int b = pre_b[ptr[2]];
+                    int new_r = ((m[0] * r) + (m[1] * g) + (m[2] * b) + m[9]) >> COLOR_CORR_MATRIX_BITS;
+                    int new_g = ((m[3] * r) + (m[4] * g) + (m[5] * b) + m[10]) >> COLOR_CORR_MATRIX_BITS;
+                    int new_b = ((m[6] * r) + (m[7] * g) + (m[8] * b) + m[11]) >> COLOR_CORR_MATRIX_BITS;
+                    ptr[0] = post[IM_MIN(IM_MAX(new_r, 0), COLOR_CORR_MAX)];
+                    ptr[1] = post[IM_MIN(IM_MAX(new_g, 0), COLOR_CORR_MAX)];
+                    ptr[2] = post[IM_MIN(IM_MAX(new_b, 0), COLOR_CORR_MAX)];
+                }
+            }
+        }
+    }
+
+    color_corr_update_gains(cc);
+}
+
+#endif // IMLIB_ENABLE_COLOR_CORR
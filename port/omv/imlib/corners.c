@@ -0,0 +1,240 @@
+/*
+ * This file is part of the OpenMV project.
+ *
+ * Copyright (c) 2013-2021 Ibrahim Abdelkader <iabdalkader@openmv.io>
+ * Copyright (c) 2013-2021 Kwabena W. Agyeman <kwagyeman@openmv.io>
+ *
+ * This work is licensed under the MIT license, see the file LICENSE for details.
+ *
+ * Shared corner detector back-end (FAST and AGAST).
+ *
+ * The segment test is evaluated for VEC_LANES pixels at once: every ring pixel is classified
+ * as brighter/darker than the center, and a pixel is a corner if either class has a long enough
+ * run of contiguous ring pixels. Corner scores are written into a score map which is reduced
+ * with a 3x3 non-maximum suppression, a per grid cell limit and a score histogram that picks
+ * the best max_keypoints without sorting.
+ */
+#include "imlib.h"
+#include "simd.h"
+
+#define CORNER_CELL_MIN         (8)
+#define CORNER_CELL_MAX         (64)
+#define CORNER_CELL_KEYPOINTS   (4)
+
+typedef struct corner {
+    uint16_t x;
+    uint16_t y;
+    uint16_t score;
+} corner_t;
+
+// Returns a nonzero value if the ring mask has a circular run of at least arc set bits.
+static inline uint32_t corner_has_arc(uint32_t m, int ring, int arc) {
+    int len = 1;
+
+    m |= m << ring;
+    uint32_t r = m;
+
+    for (; (len * 2) <= arc; len *= 2) {
+        r &= r >> len;
+    }
+
+    return (len < arc) ? (r & (r >> (arc - len))) : r;
+}
+
+// Segment test for n pixels starting at p, the ring (at most 16 pixels, a multiple of 4) must be
+// in circular order and arc at least ring/2. Sets out[i] to nonzero for corner candidates.
+void corner_segment_test_row(const uint8_t *p, int n, int b, const int *offsets, int ring, int arc, uint8_t *out) {
+    int step = ring / 4;
+    int x = 0;
+
+    if (b > 255) {
+        memset(out, 0, n);
+        return;
+    }
+
+    for (; x <= (n - VEC_LANES); x += VEC_LANES) {
+        vec_u8_t bright[16], dark[16];
+        vec_u8_t c = VEC_LOAD(vec_u8_t, p + x);
+        vec_u8_t hi = c + ((uint8_t) b);
+        vec_u8_t lo = c - ((uint8_t) b);
+        // Lanes where c + b (c - b) wraps around can't have brighter (darker) pixels.
+        vec_u8_t hi_ok = (vec_u8_t) (hi >= c);
+        vec_u8_t lo_ok = (vec_u8_t) (lo <= c);
+        vec_u8_t nb = {0}, nd = {0};
+
+        // An arc of at least ring/2 pixels always covers 2 of the 4 compass points, so a
+        // row segment where no pixel passes that test is rejected after 4 loads.
+        for (int k = 0; k < ring; k += step) {
+            vec_u8_t v = VEC_LOAD(vec_u8_t, p + x + offsets[k]);
+            bright[k] = ((vec_u8_t) (v > hi)) & hi_ok;
+            dark[k] = ((vec_u8_t) (v < lo)) & lo_ok;
+            nb -= bright[k];
+            nd -= dark[k];
+        }
+
+        uint64_t pass[2];
+        VEC_STORE(pass, (vec_u8_t) ((nb >= 2) | (nd >= 2)));
+
+        if (!(pass[0] | pass[1])) {
+            memset(out + x, 0, VEC_LANES);
+            continue;
+        }
+
+        for (int k = 0; k < ring; k++) {
+            if (k & (step - 1)) {
+                vec_u8_t v = VEC_LOAD(vec_u8_t, p + x + offsets[k]);
+                bright[k] = ((vec_u8_t) (v > hi)) & hi_ok;
+                dark[k] = ((vec_u8_t) (v < lo)) & lo_ok;
+                nb -= bright[k];
+                nd -= dark[k];
+            }
+        }
+
+        // Not enough brighter/darker pixels in total for an arc.
+        uint8_t len = arc;
+        VEC_STORE(pass, (vec_u8_t) ((nb >= len) | (nd >= len)));
+
+        if (!(pass[0] | pass[1])) {
+            memset(out + x, 0, VEC_LANES);
+            continue;
+        }
+
+        // Walk the ring (wrapping around once) counting consecutive brighter/darker pixels.
+        vec_u8_t run_b = {0}, run_d = {0}, hit = {0};
+
+        for (int i = 0, ii = ring + arc - 1; i < ii; i++) {
+            int k = (i < ring) ? i : (i - ring);
+            run_b = (run_b + 1) & bright[k];
+            run_d = (run_d + 1) & dark[k];
+            hit |= (vec_u8_t) ((run_b >= len) | (run_d >= len));
+        }
+
+        VEC_STORE(out + x, hit);
+    }
+
+    for (; x < n; x++) {
+        int hi = p[x] + b, lo = p[x] - b;
+        uint32_t bright = 0, dark = 0;
+
+        for (int k = 0; k < ring; k++) {
+            int v = p[x + offsets[k]];
+            bright |= (v > hi) << k;
+            dark |= (v < lo) << k;
+        }
+
+        out[x] = corner_has_arc(bright, ring, arc) || corner_has_arc(dark, ring, arc);
+    }
+}
+
+static void corner_cell_insert(corner_t *cell, uint8_t *count, int x, int y, int score) {
+    if (*count < CORNER_CELL_KEYPOINTS) {
+        corner_t c = { .x = x, .y = y, .score = score };
+        cell[(*count)++] = c;
+        return;
+    }
+
+    int min = 0;
+    for (int i = 1; i < CORNER_CELL_KEYPOINTS; i++) {
+        if (cell[i].score < cell[min].score) {
+            min = i;
+        }
+    }
+
+    if (score > cell[min].score) {
+        corner_t c = { .x = x, .y = y, .score = score };
+        cell[min] = c;
+    }
+}
+
+static kp_t *alloc_keypoint(uint16_t x, uint16_t y, uint16_t score) {
+    // Note must set keypoint descriptor to zeros
+    kp_t *kpt = xalloc0(sizeof *kpt);
+    kpt->x = x;
+    kpt->y = y;
+    kpt->score = score;
+    return kpt;
+}
+
+void corner_grid_nms(const uint8_t *map, rectangle_t *roi, array_t *keypoints, int max_keypoints) {
+    int w = roi->w, h = roi->h;
+
+    if ((w < 3) || (h < 3) || (max_keypoints <= 0)) {
+        return;
+    }
+
+    // Cells are sized so that the grid holds roughly max_keypoints cells.
+    int cell_size = fast_ceilf(fast_sqrtf((w * h) / ((float) max_keypoints)));
+    cell_size = IM_MIN(IM_MAX(cell_size, CORNER_CELL_MIN), CORNER_CELL_MAX);
+    int grid_w = (w + cell_size - 1) / cell_size;
+    int grid_h = (h + cell_size - 1) / cell_size;
+    corner_t *cells = fb_alloc(grid_w * grid_h * CORNER_CELL_KEYPOINTS * sizeof(corner_t), FB_ALLOC_NO_HINT);
+    uint8_t *counts = fb_alloc0(grid_w * grid_h, FB_ALLOC_NO_HINT);
+    uint32_t *hist = fb_alloc0(256 * sizeof(uint32_t), FB_ALLOC_NO_HINT);
+
+    for (int y = 1; y < (h - 1); y++) {
+        const uint8_t *row = map + (y * w);
+
+        for (int x = 1; x < (w - 1); x++) {
+            // Skip empty runs 8 pixels at a time.
+            if (x <= (w - 1 - 8)) {
+                uint64_t v;
+                memcpy(&v, row + x, sizeof(v));
+                if (!v) {
+                    x += 7;
+                    continue;
+                }
+            }
+
+            int s = row[x];
+
+            // Ties are broken in raster order so that flat plateaus keep a single corner.
+            if (!s
+                || (row[x - w - 1] >= s) || (row[x - w] >= s) || (row[x - w + 1] >= s)
+                || (row[x - 1] >= s) || (row[x + 1] > s)
+                || (row[x + w - 1] > s) || (row[x + w] > s) || (row[x + w + 1] > s)) {
+                continue;
+            }
+
+            int cell = ((y / cell_size) * grid_w) + (x / cell_size);
+            corner_cell_insert(cells + (cell * CORNER_CELL_KEYPOINTS), counts + cell, x, y, s);
+        }
+    }
+
+    // Find the lowest score that still fits in max_keypoints.
+    for (int i = 0, ii = grid_w * grid_h; i < ii; i++) {
+        for (int j = 0; j < counts[i]; j++) {
+            hist[cells[(i * CORNER_CELL_KEYPOINTS) + j].score]++;
+        }
+    }
+
+    int cutoff = 255;
+    for (int total = 0; cutoff > 0; cutoff--) {
+        total += hist[cutoff];
+        if (total >= max_keypoints) {
+            break;
+        }
+    }
+
+    // Keypoints scoring above the cutoff are all kept, ties at the cutoff fill the remainder.
+    int remaining = max_keypoints;
+    for (int i = 0, ii = grid_w * grid_h; i < ii; i++) {
+        for (int j = 0; j < counts[i]; j++) {
+            if (cells[(i * CORNER_CELL_KEYPOINTS) + j].score > cutoff) {
+                remaining--;
+            }
+        }
+    }
+
+    for (int i = 0, ii = grid_w * grid_h; i < ii; i++) {
+        for (int j = 0; j < counts[i]; j++) {
+            corner_t *c = cells + (i * CORNER_CELL_KEYPOINTS) + j;
+            if ((c->score > cutoff) || ((c->score == cutoff) && (remaining-- > 0))) {
+                array_push_back(keypoints, alloc_keypoint(roi->x + c->x, roi->y + c->y, c->score));
+            }
+        }
+    }
+
+    fb_free(); // hist
+    fb_free(); // counts
+    fb_free(); // cells
+}
@@ -0,0 +1,168 @@
+/*
+ * This file is part of the OpenMV project.
+ *
+ * Copyright (c) 2013-2021 Ibrahim Abdelkader <iabdalkader@openmv.io>
+ * Copyright (c) 2013-2021 Kwabena W. Agyeman <kwagyeman@openmv.io>
+ *
+ * This work is licensed under the MIT license, see the file LICENSE for details.
+ *
+ * Dirty rectangle tracking.
+ *
+ * Keeps a short list of image regions touched by draw calls so that overlays
+ * can be cleared and pushed to the display one region at a time instead of as
+ * a whole frame. Rects that overlap are merged, and once the list runs out of
+ * slots the new rect is folded into whichever one grows the least. When the
+ * regions cover half of the image the set degrades to "full" since a single
+ * linear copy is cheaper than many strided ones at that point.
+ */
+#include <limits.h>
+#include <string.h>
+#include "imlib.h"
+
+static int dirty_rects_bpp(image_t *img) {
+    switch (img->pixfmt) {
+        case PIXFORMAT_GRAYSCALE:
+            return sizeof(uint8_t);
+        case PIXFORMAT_RGB565:
+            return sizeof(uint16_t);
+        case PIXFORMAT_RGB888:
+            return 3;
+        case PIXFORMAT_ARGB8888:
+            return sizeof(uint32_t);
+        default:
+            return 0;
+    }
+}
+
+static int dirty_rects_area(rectangle_t *r) {
+    return r->w * r->h;
+}
+
+bool dirty_rects_supported(image_t *img) {
+    return (!img->is_compressed) && (dirty_rects_bpp(img) != 0);
+}
+
+void dirty_rects_init(dirty_rects_t *d, bool full) {
+    d->full = full;
+    d->count = 0;
+}
+
+void dirty_rects_add(dirty_rects_t *d, image_t *img, int x, int y, int w, int h) {
+    if (d->full) {
+        return;
+    }
+
+    if (!dirty_rects_supported(img)) {
+        d->full = true;
+        return;
+    }
+
+    int x0 = IM_MAX(x, 0);
+    int y0 = IM_MAX(y, 0);
+    int x1 = IM_MIN(x + w, img->w);
+    int y1 = IM_MIN(y + h, img->h);
+
+    if ((x0 >= x1) || (y0 >= y1)) {
+        return;
+    }
+
+    rectangle_t r;
+    rectangle_init(&r, x0, y0, x1 - x0, y1 - y0);
+
+    // Absorb every rect the new one overlaps. Growing may cause new overlaps so start over.
+    for (int i = 0; i < d->count;) {
+        if (rectangle_overlap(&d->rects[i], &r)) {
+            rectangle_united(&r, &d->rects[i]);
+            d->rects[i] = d->rects[--d->count];
+            i = 0;
+        } else {
+            i++;
+        }
+    }
+
+    if (d->count < DIRTY_RECTS_MAX) {
+        d->rects[d->count++] = r;
+    } else {
+        int best = 0, best_cost = INT_MAX;
+
+        for (int i = 0; i < d->count; i++) {
+            rectangle_t u = d->rects[i];
+            rectangle_united(&u, &r);
+            int cost = dirty_rects_area(&u) - dirty_rects_area(&d->rects[i]);
+
+            if (cost < best_cost) {
+                best = i;
+                best_cost = cost;
+            }
+        }
+
+        rectangle_united(&d->rects[best], &r);
+    }
+
+    int area = 0;
+
+    for (int i = 0; i < d->count; i++) {
+        area += dirty_rects_area(&d->rects[i]);
+    }
+
+    if ((area * 2) >= (img->w * img->h)) {
+        d->full = true;
+    }
+}
+
+void dirty_rects_merge(dirty_rects_t *dst, dirty_rects_t *src, image_t *img) {
+    if (src->full) {
+        dst->full = true;
+        return;
+    }
+
+    for (int i = 0; (i < src->count) && (!dst->full); i++) {
+        rectangle_t *r = &src->rects[i];
+        dirty_rects_add(dst, img, r->x, r->y, r->w, r->h);
+    }
+}
+
+void dirty_rects_clear(dirty_rects_t *d, image_t *img) {
+    if (d->full || (!dirty_rects_supported(img))) {
+        memset(img->data, 0, image_size(img));
+        return;
+    }
+
+    int bpp = dirty_rects_bpp(img);
+    int stride = img->w * bpp;
+
+    for (int i = 0; i < d->count; i++) {
+        rectangle_t *r = &d->rects[i];
+        uint8_t *row_ptr = img->data + (r->y * stride) + (r->x * bpp);
+
+        for (int y = 0; y < r->h; y++, row_ptr += stride) {
+            memset(row_ptr, 0, r->w * bpp);
+        }
+    }
+}
+
+size_t dirty_rects_copy(dirty_rects_t *d, image_t *img, uint8_t *dst) {
+    if (d->full || (!dirty_rects_supported(img))) {
+        size_t size = image_size(img);
+        memcpy(dst, img->data, size);
+        return size;
+    }
+
+    int bpp = dirty_rects_bpp(img);
+    int stride = img->w * bpp;
+    size_t size = 0;
+
+    for (int i = 0; i < d->count; i++) {
+        rectangle_t *r = &d->rects[i];
+        size_t offset = (r->y * stride) + (r->x * bpp);
+        size_t len = r->w * bpp;
+
+        for (int y = 0; y < r->h; y++, offset += stride) {
+            memcpy(dst + offset, img->data + offset, len);
+        }
+
+        size += len * r->h;
+    }
+
+    return size;
+}
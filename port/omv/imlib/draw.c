@@ -97,48 +97,81 @@ void imlib_set_pixel(image_t *img, int x, int y, int p) {
 // https://stackoverflow.com/questions/1201200/fast-algorithm-for-drawing-filled-circles
 static void point_fill(image_t *img, int cx, int cy, int r0, int r1, int c) {
     for (int y = r0; y <= r1; y++) {
-        for (int x = r0; x <= r1; x++) {
-            if (((x * x) + (y * y)) <= (r0 * r0)) {
-                imlib_set_pixel(img, cx + x, cy + y, c);
-            }
+        int v = (r0 * r0) - (y * y);
+        if (v < 0) {
+            continue;
+        }
+        int w = fast_floorf(fast_sqrtf(v));
+        while ((w * w) > v) {
+            w--;
         }
+        while (((w + 1) * (w + 1)) <= v) {
+            w++;
+        }
+        imlib_draw_hspan(img, cx + IM_MAX(r0, -w), cx + IM_MIN(r1, w), cy + y, c);
     }
 }
 
 // https://rosettacode.org/wiki/Bitmap/Bresenham%27s_line_algorithm#C
 void imlib_draw_line(image_t *img, int x0, int y0, int x1, int y1, int c, int thickness) {
-    if (thickness > 0) {
-        int thickness0 = (thickness - 0) / 2;
-        int thickness1 = (thickness - 1) / 2;
+    if (thickness > 1) {
+        // Even widths sit on the top left of the line like the point_fill() stamps did.
+        float offset = (thickness & 1) ? 0.0f : -0.5f;
+        imlib_draw_capsule(img, x0 + offset, y0 + offset, x1 + offset, y1 + offset, thickness / 2.0f, c, false);
+    } else if (thickness > 0) {
         int dx = abs(x1 - x0), sx = (x0 < x1) ? 1 : -1;
         int dy = abs(y1 - y0), sy = (y0 < y1) ? 1 : -1;
         int err = ((dx > dy) ? dx : -dy) / 2;
+        int run_x = x0, run_y = y0;
 
+        // Steps along the major axis are merged into one span until the minor axis moves.
         for (;;) {
-            point_fill(img, x0, y0, -thickness0, thickness1, c);
             if ((x0 == x1) && (y0 == y1)) {
                 break;
             }
             int e2 = err;
+            int nx = x0, ny = y0;
             if (e2 > -dx) {
-                err -= dy; x0 += sx;
+                err -= dy; nx += sx;
             }
             if (e2 < dy) {
-                err += dx; y0 += sy;
+                err += dx; ny += sy;
+            }
+            if ((dx >= dy) ? (ny != y0) : (nx != x0)) {
+                if (dx >= dy) {
+                    imlib_draw_hspan(img, IM_MIN(run_x, x0), IM_MAX(run_x, x0), y0, c);
+                } else {
+                    imlib_draw_vspan(img, x0, IM_MIN(run_y, y0), IM_MAX(run_y, y0), c);
+                }
+                run_x = nx;
+                run_y = ny;
             }
+            x0 = nx;
+            y0 = ny;
+        }
+
+        if (dx >= dy) {
+            imlib_draw_hspan(img, IM_MIN(run_x, x0), IM_MAX(run_x, x0), y0, c);
+        } else {
+            imlib_draw_vspan(img, x0, IM_MIN(run_y, y0), IM_MAX(run_y, y0), c);
         }
     }
 }
 
+// Single pixels, like thin circle outlines produce, are cheaper to plot directly.
 static void xLine(image_t *img, int x1, int x2, int y, int c) {
-    while (x1 <= x2) {
-        imlib_set_pixel(img, x1++, y, c);
+    if (x1 == x2) {
+        imlib_set_pixel(img, x1, y, c);
+    } else {
+        imlib_draw_hspan(img, x1, x2, y, c);
     }
 }
 
 static void yLine(image_t *img, int x, int y1, int y2, int c) {
-    while (y1 <= y2) {
-        imlib_set_pixel(img, x, y1++, c);
+    if (y1 == y2) {
+        imlib_set_pixel(img, x, y1, c);
+    } else {
+        imlib_draw_vspan(img, x, y1, y2, c);
     }
 }
 
@@ -146,23 +179,23 @@ void imlib_draw_rectangle(image_t *img, int rx, int ry, int rw, int rh, int c, i
     if (fill) {
 
         for (int y = ry, yy = ry + rh; y < yy; y++) {
-            for (int x = rx, xx = rx + rw; x < xx; x++) {
-                imlib_set_pixel(img, x, y, c);
-            }
+            xLine(img, rx, rx + rw - 1, y, c);
         }
 
     } else if (thickness > 0) {
         int thickness0 = (thickness - 0) / 2;
         int thickness1 = (thickness - 1) / 2;
+        int x0 = rx - thickness0, x1 = rx + rw - 1 + thickness1;
+        int top = ry + thickness1, bottom = ry + rh - 1 - thickness0;
 
-        for (int i = rx - thickness0, j = rx + rw + thickness1, k = ry + rh - 1; i < j; i++) {
-            yLine(img, i, ry - thickness0, ry + thickness1, c);
-            yLine(img, i, k - thickness0, k + thickness1, c);
-        }
-
-        for (int i = ry - thickness0, j = ry + rh + thickness1, k = rx + rw - 1; i < j; i++) {
-            xLine(img, rx - thickness0, rx + thickness1, i, c);
-            xLine(img, k - thickness0, k + thickness1, i, c);
+        // Top and bottom bands are whole spans, the sides are two short spans per row.
+        for (int y = ry - thickness0, yy = ry + rh - 1 + thickness1; y <= yy; y++) {
+            if ((y <= top) || (y >= bottom)) {
+                xLine(img, x0, x1, y, c);
+            } else {
+                xLine(img, x0, rx + thickness1, y, c);
+                xLine(img, rx + rw - 1 - thickness0, x1, y, c);
+            }
         }
     }
 }
@@ -369,6 +402,7 @@ void imlib_draw_ellipse(image_t *img, int cx, int cy, int rx, int ry, int rotati
 
 // char rotation == 0, 90, 180, 360, etc.
 // string rotation == 0, 90, 180, 360, etc.
+// bbox (optional) receives the drawn area clipped to the image, 0x0 when nothing was drawn.
 void imlib_draw_string(image_t *img,
                        int x_off,
                        int y_off,
@@ -383,7 +417,8 @@ void imlib_draw_string(image_t *img,
                        bool char_vflip,
                        int string_rotation,
                        bool string_hmirror,
-                       bool string_vflip) {
+                       bool string_vflip,
+                       rectangle_t *bbox) {
     char_rotation %= 360;
     if (char_rotation < 0) {
         char_rotation += 360;
@@ -409,6 +444,7 @@ void imlib_draw_string(image_t *img,
     int org_x_off = x_off;
     int org_y_off = y_off;
     const int anchor = x_off;
+    int bbox_x0 = img->w, bbox_y0 = img->h, bbox_x1 = -1, bbox_y1 = -1;
 
     for (char ch, last = '\0'; (ch = *str); str++, last = ch) {
 
@@ -469,12 +505,27 @@ void imlib_draw_string(image_t *img,
         }
 
         for (int y = 0, yy = fast_floorf(g->h * scale); y < yy; y++) {
+            uint8_t row = g->data[fast_floorf(y / scale)];
+
+            if (!row) {
+                continue;
+            }
+
             for (int x = 0, xx = fast_floorf(g->w * scale); x < xx; x++) {
-                if (g->data[fast_floorf(y / scale)] & (1 << (g->w - 1 - fast_floorf(x / scale)))) {
+                if (row & (1 << (g->w - 1 - fast_floorf(x / scale)))) {
                     int16_t x_tmp = x_off + (char_hmirror ? (xx - x - 1) : x), y_tmp = y_off + (char_vflip ? (yy - y - 1) : y);
-                    point_rotate(x_tmp, y_tmp, IM_DEG2RAD(char_rotation), x_off + (xx / 2), y_off + (yy / 2), &x_tmp, &y_tmp);
-                    point_rotate(x_tmp, y_tmp, IM_DEG2RAD(string_rotation), org_x_off, org_y_off, &x_tmp, &y_tmp);
+                    // Unrotated text is most of it, skip the trigonometry then.
+                    if (char_rotation) {
+                        point_rotate(x_tmp, y_tmp, IM_DEG2RAD(char_rotation), x_off + (xx / 2), y_off + (yy / 2), &x_tmp, &y_tmp);
+                    }
+                    if (string_rotation) {
+                        point_rotate(x_tmp, y_tmp, IM_DEG2RAD(string_rotation), org_x_off, org_y_off, &x_tmp, &y_tmp);
+                    }
                     imlib_set_pixel(img, x_tmp, y_tmp, c);
+                    bbox_x0 = IM_MIN(bbox_x0, x_tmp);
+                    bbox_y0 = IM_MIN(bbox_y0, y_tmp);
+                    bbox_x1 = IM_MAX(bbox_x1, x_tmp);
+                    bbox_y1 = IM_MAX(bbox_y1, y_tmp);
                 }
             }
         }
@@ -522,6 +573,19 @@ void imlib_draw_string(image_t *img,
             }
         }
     }
+
+    if (bbox) {
+        bbox_x0 = IM_MAX(bbox_x0, 0);
+        bbox_y0 = IM_MAX(bbox_y0, 0);
+        bbox_x1 = IM_MIN(bbox_x1, img->w - 1);
+        bbox_y1 = IM_MIN(bbox_y1, img->h - 1);
+
+        if ((bbox_x0 <= bbox_x1) && (bbox_y0 <= bbox_y1)) {
+            rectangle_init(bbox, bbox_x0, bbox_y0, bbox_x1 - bbox_x0 + 1, bbox_y1 - bbox_y0 + 1);
+        } else {
+            rectangle_init(bbox, 0, 0, 0, 0);
+        }
+    }
 }
 
 void imlib_draw_row_setup(imlib_draw_row_data_t *data) {
@@ -3097,11 +3161,17 @@ void imlib_draw_image(image_t *dst_img,
                 }
                 case PIXFORMAT_BAYER_ANY:
                 case PIXFORMAT_YUV_ANY: {
-                    memcpy(new_src_img.data, src_img->data, size);
+                    if (is_jpeg && (new_src_img.pixfmt == PIXFORMAT_YUV420)) {
+                        jpeg_decompress(&new_src_img, src_img);
+                    } else {
+                        memcpy(new_src_img.data, src_img->data, size);
+                    }
                     break;
                 }
                 default: {
-                    if (is_png) {
+                    if (is_jpeg) {
+                        jpeg_decompress(&new_src_img, src_img);
+                    } else if (is_png) {
                         png_decompress(&new_src_img, src_img);
                     }
                     break;
@@ -3117,6 +3187,21 @@ void imlib_draw_image(image_t *dst_img,
         src_img = &new_src_img;
     }
 
+    // Plain blits, integer downscales and format conversions have specialized kernels.
+    if ((dst_delta_x == 1) && (dst_delta_y == 1)
+        && (rgb_channel == -1) && (!color_palette) && (!alpha_palette)
+        && (!callback) && (!dst_row_override) && (dst_img->data != src_img->data)
+        && (!(hint & (IMAGE_HINT_BICUBIC | IMAGE_HINT_BILINEAR | IMAGE_HINT_BLACK_BACKGROUND)))
+        && (src_x_frac == src_y_frac) && (!(src_x_frac & 0xFFFF))
+        && imlib_draw_image_fast(dst_img, src_img, dst_x_start, dst_y_start, dst_x_end, dst_y_end,
+                                 src_x_accum_reset >> 16, src_y_accum_reset >> 16, src_x_frac >> 16,
+                                 hint & IMAGE_HINT_AREA, alpha)) {
+        if (&new_src_img == src_img) {
+            fb_free();
+        }
+        return;
+    }
+
     imlib_draw_row_data_t imlib_draw_row_data;
     imlib_draw_row_data.dst_img = dst_img;
     imlib_draw_row_data.src_img_pixfmt = (!src_img->is_mutable) ? new_not_mutable_pixfmt : src_img->pixfmt;
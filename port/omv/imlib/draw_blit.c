@@ -0,0 +1,258 @@
+/*
+ * This file is part of the OpenMV project.
+ *
+ * Copyright (c) 2013-2021 Ibrahim Abdelkader <iabdalkader@openmv.io>
+ * Copyright (c) 2013-2021 Kwabena W. Agyeman <kwagyeman@openmv.io>
+ *
+ * This work is licensed under the MIT license, see the file LICENSE for details.
+ *
+ * Specialized draw_image() kernels.
+ *
+ * imlib_draw_image() handles every combination of scaling, flipping, alpha, palettes and
+ * channel extraction one row at a time through imlib_draw_row(). The kernels below cover the
+ * common cases (1:1 blits, integer 2x/4x downscaling, RGB888 <-> GRAYSCALE/RGB565 conversion
+ * and ARGB8888 overlays) and write straight into the destination rows. The kernel is picked
+ * once per call, anything not listed here falls back to the generic path.
+ */
+#include "imlib.h"
+#include "simd.h"
+
+typedef void (*blit_row_t) (void *dst, const void *src, int n, int k);
+
+// Nearest neighbor row kernel, reads every k-th source pixel.
+#define BLIT_ROW(name, src_type, src_ch, dst_type, dst_ch, PIXEL)                    \
+    static void name(void *dst_row, const void *src_row, int n, int k) {             \
+        dst_type *d = (dst_type *) dst_row;                                          \
+        const src_type *s = (const src_type *) src_row;                              \
+        for (int x = 0; x < n; x++, d += (dst_ch), s += (src_ch) * k) {              \
+            PIXEL;                                                                   \
+        }                                                                            \
+    }
+
+BLIT_ROW(blit_row_gs_to_gs, uint8_t, 1, uint8_t, 1,
+         d[0] = s[0])
+BLIT_ROW(blit_row_gs_to_rgb565, uint8_t, 1, uint16_t, 1,
+         d[0] = COLOR_Y_TO_RGB565(s[0]))
+BLIT_ROW(blit_row_gs_to_rgb888, uint8_t, 1, uint8_t, 3,
+         d[0] = d[1] = d[2] = s[0])
+BLIT_ROW(blit_row_rgb565_to_gs, uint16_t, 1, uint8_t, 1,
+         int p = s[0]; d[0] = COLOR_RGB565_TO_Y(p))
+BLIT_ROW(blit_row_rgb565_to_rgb565, uint16_t, 1, uint16_t, 1,
+         d[0] = s[0])
+BLIT_ROW(blit_row_rgb565_to_rgb888, uint16_t, 1, uint8_t, 3,
+         int p = s[0]; d[0] = COLOR_RGB565_TO_R8(p); d[1] = COLOR_RGB565_TO_G8(p); d[2] = COLOR_RGB565_TO_B8(p))
+BLIT_ROW(blit_row_rgb888_to_gs, uint8_t, 3, uint8_t, 1,
+         d[0] = COLOR_RGB888_TO_Y(s[0], s[1], s[2]))
+BLIT_ROW(blit_row_rgb888_to_rgb565, uint8_t, 3, uint16_t, 1,
+         d[0] = COLOR_R8_G8_B8_TO_RGB565(s[0], s[1], s[2]))
+BLIT_ROW(blit_row_rgb888_to_rgb888, uint8_t, 3, uint8_t, 3,
+         d[0] = s[0]; d[1] = s[1]; d[2] = s[2])
+
+#undef BLIT_ROW
+
+// Area (box) row kernel, averages k x k source blocks. Channels are unpacked to 8-bits so
+// the accumulators can be shared by all formats.
+#define BLIT_AREA_ROW(name, src_type, src_ch, UNPACK, PACK)                                      \
+    static void name(void *dst_row, const void *src_row, int n, int k, int stride) {            \
+        const int shift = (k == 2) ? 2 : 4;                                                     \
+        const int round = 1 << (shift - 1);                                                     \
+        for (int x = 0; x < n; x++) {                                                           \
+            uint32_t a0 = 0, a1 = 0, a2 = 0;                                                    \
+            for (int i = 0; i < k; i++) {                                                       \
+                const src_type *s = ((const src_type *) (((const uint8_t *) src_row) +          \
+                                                         (i * stride))) + (x * k * (src_ch));   \
+                for (int j = 0; j < k; j++, s += (src_ch)) {                                    \
+                    UNPACK;                                                                     \
+                }                                                                               \
+            }                                                                                   \
+            a0 = (a0 + round) >> shift;                                                         \
+            a1 = (a1 + round) >> shift;                                                         \
+            a2 = (a2 + round) >> shift;                                                         \
+            PACK;                                                                               \
+        }                                                                                       \
+    }
+
+BLIT_AREA_ROW(blit_area_row_rgb565, uint16_t, 1,
+              int p = s[0]; a0 += COLOR_RGB565_TO_R8(p); a1 += COLOR_RGB565_TO_G8(p); a2 += COLOR_RGB565_TO_B8(p),
+              ((uint16_t *) dst_row)[x] = COLOR_R8_G8_B8_TO_RGB565(a0, a1, a2))
+BLIT_AREA_ROW(blit_area_row_rgb888, uint8_t, 3,
+              a0 += s[0]; a1 += s[1]; a2 += s[2],
+              ((uint8_t *) dst_row)[x * 3] = a0; ((uint8_t *) dst_row)[x * 3 + 1] = a1; ((uint8_t *) dst_row)[x * 3 + 2] = a2)
+
+#undef BLIT_AREA_ROW
+
+// Grayscale 2x2 box average, each 16-bit lane holds a horizontal pixel pair.
+static void blit_area2_row_gs(uint8_t *dst, const uint8_t *r0, const uint8_t *r1, int n) {
+    int x = 0;
+
+    for (; x <= (n - VEC_LANES); x += VEC_LANES) {
+        vec_u16_t a = VEC_LOAD(vec_u16_t, r0 + (x * 2));
+        vec_u16_t b = VEC_LOAD(vec_u16_t, r1 + (x * 2));
+        vec_u16_t s = (a & 0xFF) + (a >> 8) + (b & 0xFF) + (b >> 8) + 2;
+        VEC_STORE(dst + x, VEC_U16_TO_U8(s >> 2));
+    }
+
+    for (; x < n; x++) {
+        dst[x] = (r0[x * 2] + r0[x * 2 + 1] + r1[x * 2] + r1[x * 2 + 1] + 2) >> 2;
+    }
+}
+
+// Grayscale 4x4 box average, each source row word is summed 4 pixels at a time (SWAR).
+static void blit_area4_row_gs(uint8_t *dst, const uint8_t *src, int n, int stride) {
+    for (int x = 0; x < n; x++) {
+        const uint8_t *s = src + (x * 4);
+        uint32_t acc = 0;
+        for (int i = 0; i < 4; i++, s += stride) {
+            uint32_t p;
+            memcpy(&p, s, sizeof(p));
+            p = (p & 0x00FF00FF) + ((p >> 8) & 0x00FF00FF);
+            acc += (p & 0xFFFF) + (p >> 16);
+        }
+        dst[x] = (acc + 8) >> 4;
+    }
+}
+
+// Blends an ARGB8888 row over an RGB888 row, red and blue are blended together (SWAR).
+static void blit_row_argb8888_over_rgb888(uint8_t *dst, const uint32_t *src, int n, int alpha) {
+    for (int x = 0; x < n; x++, dst += 3) {
+        uint32_t p = src[x];
+        uint32_t a = p >> 24;
+        a = ((a + (a >> 7)) * alpha) >> 8; // 0..256
+
+        if (a == 0) {
+            continue;
+        }
+
+        if (a == 256) {
+            dst[0] = p >> 16;
+            dst[1] = p >> 8;
+            dst[2] = p;
+            continue;
+        }
+
+        uint32_t na = 256 - a;
+        uint32_t d_rb = (dst[0] << 16) | dst[2];
+        uint32_t rb = ((((p & 0xFF00FF) * a) + (d_rb * na)) >> 8) & 0xFF00FF;
+        uint32_t g = ((((p >> 8) & 0xFF) * a) + (dst[1] * na)) >> 8;
+        dst[0] = rb >> 16;
+        dst[1] = g;
+        dst[2] = rb;
+    }
+}
+
+static blit_row_t blit_row_kernel(pixformat_t src, pixformat_t dst) {
+    switch (src) {
+        case PIXFORMAT_GRAYSCALE: {
+            switch (dst) {
+                case PIXFORMAT_GRAYSCALE: return blit_row_gs_to_gs;
+                case PIXFORMAT_RGB565: return blit_row_gs_to_rgb565;
+                case PIXFORMAT_RGB888: return blit_row_gs_to_rgb888;
+                default: return NULL;
+            }
+        }
+        case PIXFORMAT_RGB565: {
+            switch (dst) {
+                case PIXFORMAT_GRAYSCALE: return blit_row_rgb565_to_gs;
+                case PIXFORMAT_RGB565: return blit_row_rgb565_to_rgb565;
+                case PIXFORMAT_RGB888: return blit_row_rgb565_to_rgb888;
+                default: return NULL;
+            }
+        }
+        case PIXFORMAT_RGB888: {
+            switch (dst) {
+                case PIXFORMAT_GRAYSCALE: return blit_row_rgb888_to_gs;
+                case PIXFORMAT_RGB565: return blit_row_rgb888_to_rgb565;
+                case PIXFORMAT_RGB888: return blit_row_rgb888_to_rgb888;
+                default: return NULL;
+            }
+        }
+        default: {
+            return NULL;
+        }
+    }
+}
+
+// Draws src (starting at src_x/src_y) into dst_x0..dst_x1 x dst_y0..dst_y1 downscaled by k.
+// Returns false if there is no specialized kernel for the combination.
+bool imlib_draw_image_fast(image_t *dst_img, image_t *src_img,
+                           int dst_x0, int dst_y0, int dst_x1, int dst_y1,
+                           int src_x, int src_y, int k, bool area, int alpha) {
+    int n = dst_x1 - dst_x0;
+    size_t src_bpp = image_size(src_img) / (src_img->w * src_img->h);
+    size_t dst_bpp = image_size(dst_img) / (dst_img->w * dst_img->h);
+    size_t src_stride = src_img->w * src_bpp;
+    size_t dst_stride = dst_img->w * dst_bpp;
+    const uint8_t *src_row = src_img->data + (src_y * src_stride) + (src_x * src_bpp);
+    uint8_t *dst_row = dst_img->data + (dst_y0 * dst_stride) + (dst_x0 * dst_bpp);
+
+    if ((k != 1) && (k != 2) && (k != 4)) {
+        return false;
+    }
+
+    if (src_img->pixfmt == PIXFORMAT_ARGB8888) {
+        if ((k != 1) || (dst_img->pixfmt != PIXFORMAT_RGB888)) {
+            return false;
+        }
+
+        for (int y = dst_y0; y < dst_y1; y++, src_row += src_stride, dst_row += dst_stride) {
+            blit_row_argb8888_over_rgb888(dst_row, (const uint32_t *) src_row, n, alpha);
+        }
+
+        return true;
+    }
+
+    if (alpha != 256) {
+        return false;
+    }
+
+    if (area && (k > 1)) {
+        if (src_img->pixfmt != dst_img->pixfmt) {
+            return false;
+        }
+
+        for (int y = dst_y0; y < dst_y1; y++, src_row += src_stride * k, dst_row += dst_stride) {
+            switch (src_img->pixfmt) {
+                case PIXFORMAT_GRAYSCALE: {
+                    if (k == 2) {
+                        blit_area2_row_gs(dst_row, src_row, src_row + src_stride, n);
+                    } else {
+                        blit_area4_row_gs(dst_row, src_row, n, src_stride);
+                    }
+                    break;
+                }
+                case PIXFORMAT_RGB565: {
+                    blit_area_row_rgb565(dst_row, src_row, n, k, src_stride);
+                    break;
+                }
+                case PIXFORMAT_RGB888: {
+                    blit_area_row_rgb888(dst_row, src_row, n, k, src_stride);
+                    break;
+                }
+                default: {
+                    return false;
+                }
+            }
+        }
+
+        return true;
+    }
+
+    blit_row_t kernel = blit_row_kernel(src_img->pixfmt, dst_img->pixfmt);
+
+    if (!kernel) {
+        return false;
+    }
+
+    // Same format 1:1 blits are plain row copies.
+    bool copy = (k == 1) && (src_img->pixfmt == dst_img->pixfmt);
+
+    for (int y = dst_y0; y < dst_y1; y++, src_row += src_stride * k, dst_row += dst_stride) {
+        if (copy) {
+            memcpy(dst_row, src_row, n * dst_bpp);
+        } else {
+            kernel(dst_row, src_row, n, k);
+        }
+    }
+
+    return true;
+}
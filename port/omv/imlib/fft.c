@@ -3,427 +3,242 @@
  * Copyright (c) 2013-2016 Kwabena W. Agyeman <kwagyeman@openmv.io>
  * This work is licensed under the MIT license, see the file LICENSE for details.
  *
- * FFT LIB - can do 1024 point real FFTs and 512 point complex FFTs
+ * FFT LIB - mixed radix (2, 3, 4, 5) FFTs of up to 2048 points.
  *
+ * The transforms are Stockham autosort FFTs (no bit reversal pass) that always run FFT_LANES
+ * transforms side by side, so every butterfly is a vector operation on FFT_LANES complex values.
+ * 2D transforms gather FFT_LANES adjacent columns (or 2 * FFT_LANES rows, packing two real rows
+ * into one complex transform) into a contiguous panel and transform the whole batch at once.
+ * Twiddles are computed once per size and kept in a small plan cache.
  */
 #include "py/runtime.h"
 #include "py/obj.h"
 #include "fb_alloc.h"
 #include "ff_wrapper.h"
 #include "omv_common.h"
+#include "simd.h"
 #include "fft.h"
-// http://processors.wiki.ti.com/index.php/Efficient_FFT_Computation_of_Real_Input
-
-const static float fft_cos_table[512] = {
-    1.000000f,  0.999981f,  0.999925f,  0.999831f,  0.999699f,  0.999529f,  0.999322f,  0.999078f,
-    0.998795f,  0.998476f,  0.998118f,  0.997723f,  0.997290f,  0.996820f,  0.996313f,  0.995767f,
-    0.995185f,  0.994565f,  0.993907f,  0.993212f,  0.992480f,  0.991710f,  0.990903f,  0.990058f,
-    0.989177f,  0.988258f,  0.987301f,  0.986308f,  0.985278f,  0.984210f,  0.983105f,  0.981964f,
-    0.980785f,  0.979570f,  0.978317f,  0.977028f,  0.975702f,  0.974339f,  0.972940f,  0.971504f,
-    0.970031f,  0.968522f,  0.966976f,  0.965394f,  0.963776f,  0.962121f,  0.960431f,  0.958703f,
-    0.956940f,  0.955141f,  0.953306f,  0.951435f,  0.949528f,  0.947586f,  0.945607f,  0.943593f,
-    0.941544f,  0.939459f,  0.937339f,  0.935184f,  0.932993f,  0.930767f,  0.928506f,  0.926210f,
-    0.923880f,  0.921514f,  0.919114f,  0.916679f,  0.914210f,  0.911706f,  0.909168f,  0.906596f,
-    0.903989f,  0.901349f,  0.898674f,  0.895966f,  0.893224f,  0.890449f,  0.887640f,  0.884797f,
-    0.881921f,  0.879012f,  0.876070f,  0.873095f,  0.870087f,  0.867046f,  0.863973f,  0.860867f,
-    0.857729f,  0.854558f,  0.851355f,  0.848120f,  0.844854f,  0.841555f,  0.838225f,  0.834863f,
-    0.831470f,  0.828045f,  0.824589f,  0.821103f,  0.817585f,  0.814036f,  0.810457f,  0.806848f,
-    0.803208f,  0.799537f,  0.795837f,  0.792107f,  0.788346f,  0.784557f,  0.780737f,  0.776888f,
-    0.773010f,  0.769103f,  0.765167f,  0.761202f,  0.757209f,  0.753187f,  0.749136f,  0.745058f,
-    0.740951f,  0.736817f,  0.732654f,  0.728464f,  0.724247f,  0.720003f,  0.715731f,  0.711432f,
-    0.707107f,  0.702755f,  0.698376f,  0.693971f,  0.689541f,  0.685084f,  0.680601f,  0.676093f,
-    0.671559f,  0.667000f,  0.662416f,  0.657807f,  0.653173f,  0.648514f,  0.643832f,  0.639124f,
-    0.634393f,  0.629638f,  0.624859f,  0.620057f,  0.615232f,  0.610383f,  0.605511f,  0.600616f,
-    0.595699f,  0.590760f,  0.585798f,  0.580814f,  0.575808f,  0.570781f,  0.565732f,  0.560662f,
-    0.555570f,  0.550458f,  0.545325f,  0.540171f,  0.534998f,  0.529804f,  0.524590f,  0.519356f,
-    0.514103f,  0.508830f,  0.503538f,  0.498228f,  0.492898f,  0.487550f,  0.482184f,  0.476799f,
-    0.471397f,  0.465976f,  0.460539f,  0.455084f,  0.449611f,  0.444122f,  0.438616f,  0.433094f,
-    0.427555f,  0.422000f,  0.416430f,  0.410843f,  0.405241f,  0.399624f,  0.393992f,  0.388345f,
-    0.382683f,  0.377007f,  0.371317f,  0.365613f,  0.359895f,  0.354164f,  0.348419f,  0.342661f,
-    0.336890f,  0.331106f,  0.325310f,  0.319502f,  0.313682f,  0.307850f,  0.302006f,  0.296151f,
-    0.290285f,  0.284408f,  0.278520f,  0.272621f,  0.266713f,  0.260794f,  0.254866f,  0.248928f,
-    0.242980f,  0.237024f,  0.231058f,  0.225084f,  0.219101f,  0.213110f,  0.207111f,  0.201105f,
-    0.195090f,  0.189069f,  0.183040f,  0.177004f,  0.170962f,  0.164913f,  0.158858f,  0.152797f,
-    0.146730f,  0.140658f,  0.134581f,  0.128498f,  0.122411f,  0.116319f,  0.110222f,  0.104122f,
-    0.098017f,  0.091909f,  0.085797f,  0.079682f,  0.073565f,  0.067444f,  0.061321f,  0.055195f,
-    0.049068f,  0.042938f,  0.036807f,  0.030675f,  0.024541f,  0.018407f,  0.012272f,  0.006136f,
-    0.000000f, -0.006136f, -0.012272f, -0.018407f, -0.024541f, -0.030675f, -0.036807f, -0.042938f,
-    -0.049068f, -0.055195f, -0.061321f, -0.067444f, -0.073565f, -0.079682f, -0.085797f, -0.091909f,
-    -0.098017f, -0.104122f, -0.110222f, -0.116319f, -0.122411f, -0.128498f, -0.134581f, -0.140658f,
-    -0.146730f, -0.152797f, -0.158858f, -0.164913f, -0.170962f, -0.177004f, -0.183040f, -0.189069f,
-    -0.195090f, -0.201105f, -0.207111f, -0.213110f, -0.219101f, -0.225084f, -0.231058f, -0.237024f,
-    -0.242980f, -0.248928f, -0.254866f, -0.260794f, -0.266713f, -0.272621f, -0.278520f, -0.284408f,
-    -0.290285f, -0.296151f, -0.302006f, -0.307850f, -0.313682f, -0.319502f, -0.325310f, -0.331106f,
-    -0.336890f, -0.342661f, -0.348419f, -0.354164f, -0.359895f, -0.365613f, -0.371317f, -0.377007f,
-    -0.382683f, -0.388345f, -0.393992f, -0.399624f, -0.405241f, -0.410843f, -0.416430f, -0.422000f,
-    -0.427555f, -0.433094f, -0.438616f, -0.444122f, -0.449611f, -0.455084f, -0.460539f, -0.465976f,
-    -0.471397f, -0.476799f, -0.482184f, -0.487550f, -0.492898f, -0.498228f, -0.503538f, -0.508830f,
-    -0.514103f, -0.519356f, -0.524590f, -0.529804f, -0.534998f, -0.540171f, -0.545325f, -0.550458f,
-    -0.555570f, -0.560662f, -0.565732f, -0.570781f, -0.575808f, -0.580814f, -0.585798f, -0.590760f,
-    -0.595699f, -0.600616f, -0.605511f, -0.610383f, -0.615232f, -0.620057f, -0.624859f, -0.629638f,
-    -0.634393f, -0.639124f, -0.643832f, -0.648514f, -0.653173f, -0.657807f, -0.662416f, -0.667000f,
-    -0.671559f, -0.676093f, -0.680601f, -0.685084f, -0.689541f, -0.693971f, -0.698376f, -0.702755f,
-    -0.707107f, -0.711432f, -0.715731f, -0.720003f, -0.724247f, -0.728464f, -0.732654f, -0.736817f,
-    -0.740951f, -0.745058f, -0.749136f, -0.753187f, -0.757209f, -0.761202f, -0.765167f, -0.769103f,
-    -0.773010f, -0.776888f, -0.780737f, -0.784557f, -0.788346f, -0.792107f, -0.795837f, -0.799537f,
-    -0.803208f, -0.806848f, -0.810457f, -0.814036f, -0.817585f, -0.821103f, -0.824589f, -0.828045f,
-    -0.831470f, -0.834863f, -0.838225f, -0.841555f, -0.844854f, -0.848120f, -0.851355f, -0.854558f,
-    -0.857729f, -0.860867f, -0.863973f, -0.867046f, -0.870087f, -0.873095f, -0.876070f, -0.879012f,
-    -0.881921f, -0.884797f, -0.887640f, -0.890449f, -0.893224f, -0.895966f, -0.898674f, -0.901349f,
-    -0.903989f, -0.906596f, -0.909168f, -0.911706f, -0.914210f, -0.916679f, -0.919114f, -0.921514f,
-    -0.923880f, -0.926210f, -0.928506f, -0.930767f, -0.932993f, -0.935184f, -0.937339f, -0.939459f,
-    -0.941544f, -0.943593f, -0.945607f, -0.947586f, -0.949528f, -0.951435f, -0.953306f, -0.955141f,
-    -0.956940f, -0.958703f, -0.960431f, -0.962121f, -0.963776f, -0.965394f, -0.966976f, -0.968522f,
-    -0.970031f, -0.971504f, -0.972940f, -0.974339f, -0.975702f, -0.977028f, -0.978317f, -0.979570f,
-    -0.980785f, -0.981964f, -0.983105f, -0.984210f, -0.985278f, -0.986308f, -0.987301f, -0.988258f,
-    -0.989177f, -0.990058f, -0.990903f, -0.991710f, -0.992480f, -0.993212f, -0.993907f, -0.994565f,
-    -0.995185f, -0.995767f, -0.996313f, -0.996820f, -0.997290f, -0.997723f, -0.998118f, -0.998476f,
-    -0.998795f, -0.999078f, -0.999322f, -0.999529f, -0.999699f, -0.999831f, -0.999925f, -0.999981f
-};
-
-OMV_ATTR_ALWAYS_INLINE static float get_cos(int k, int N_pow2) {
-    // N=512 -> N=pow2=9
-    return fft_cos_table[k << (9 - N_pow2)];
-}
-
-OMV_ATTR_ALWAYS_INLINE static float get_ai(int k, int N_pow2) {
-    // N=512 -> N=pow2=9
-    return 0.5 * (-get_cos(k, N_pow2));
-}
-
-OMV_ATTR_ALWAYS_INLINE static float get_bi(int k, int N_pow2) {
-    // N=512 -> N=pow2=9
-    return 0.5 * (+get_cos(k, N_pow2));
-}
-
-OMV_ATTR_ALWAYS_INLINE static float get_a_star_i(int k, int N_pow2) {
-    // N=512 -> N=pow2=9
-    return 0.5 * (+get_cos(k, N_pow2));
-}
-
-OMV_ATTR_ALWAYS_INLINE static float get_b_star_i(int k, int N_pow2) {
-    // N=512 -> N=pow2=9
-    return 0.5 * (-get_cos(k, N_pow2));
-}
-
-//// For samples 0 to (n/2)-1 --- Note: clog2(n/2) = N_pow2
-//OMV_ATTR_ALWAYS_INLINE static float get_hann_l_side(int k, int N_pow2)
-//{
-//    return 0.5 * (1 - get_cos(k, N_pow2));
-//}
-
-//// For samples (n/2) to n-1 --- Note: clog2(n/2) = N_pow2
-//OMV_ATTR_ALWAYS_INLINE static float get_hann_r_side(int k, int N_pow2)
-//{
-//    return 0.5 * (1 - get_cos((2 << N_pow2) - k - 1, N_pow2));
-//}
-
-const static float fft_sin_table[512] = {
-    0.000000f,  0.006136f,  0.012272f,  0.018407f,  0.024541f,  0.030675f,  0.036807f,  0.042938f,
-    0.049068f,  0.055195f,  0.061321f,  0.067444f,  0.073565f,  0.079682f,  0.085797f,  0.091909f,
-    0.098017f,  0.104122f,  0.110222f,  0.116319f,  0.122411f,  0.128498f,  0.134581f,  0.140658f,
-    0.146730f,  0.152797f,  0.158858f,  0.164913f,  0.170962f,  0.177004f,  0.183040f,  0.189069f,
-    0.195090f,  0.201105f,  0.207111f,  0.213110f,  0.219101f,  0.225084f,  0.231058f,  0.237024f,
-    0.242980f,  0.248928f,  0.254866f,  0.260794f,  0.266713f,  0.272621f,  0.278520f,  0.284408f,
-    0.290285f,  0.296151f,  0.302006f,  0.307850f,  0.313682f,  0.319502f,  0.325310f,  0.331106f,
-    0.336890f,  0.342661f,  0.348419f,  0.354164f,  0.359895f,  0.365613f,  0.371317f,  0.377007f,
-    0.382683f,  0.388345f,  0.393992f,  0.399624f,  0.405241f,  0.410843f,  0.416430f,  0.422000f,
-    0.427555f,  0.433094f,  0.438616f,  0.444122f,  0.449611f,  0.455084f,  0.460539f,  0.465976f,
-    0.471397f,  0.476799f,  0.482184f,  0.487550f,  0.492898f,  0.498228f,  0.503538f,  0.508830f,
-    0.514103f,  0.519356f,  0.524590f,  0.529804f,  0.534998f,  0.540171f,  0.545325f,  0.550458f,
-    0.555570f,  0.560662f,  0.565732f,  0.570781f,  0.575808f,  0.580814f,  0.585798f,  0.590760f,
-    0.595699f,  0.600616f,  0.605511f,  0.610383f,  0.615232f,  0.620057f,  0.624859f,  0.629638f,
-    0.634393f,  0.639124f,  0.643832f,  0.648514f,  0.653173f,  0.657807f,  0.662416f,  0.667000f,
-    0.671559f,  0.676093f,  0.680601f,  0.685084f,  0.689541f,  0.693971f,  0.698376f,  0.702755f,
-    0.707107f,  0.711432f,  0.715731f,  0.720003f,  0.724247f,  0.728464f,  0.732654f,  0.736817f,
-    0.740951f,  0.745058f,  0.749136f,  0.753187f,  0.757209f,  0.761202f,  0.765167f,  0.769103f,
-    0.773010f,  0.776888f,  0.780737f,  0.784557f,  0.788346f,  0.792107f,  0.795837f,  0.799537f,
-    0.803208f,  0.806848f,  0.810457f,  0.814036f,  0.817585f,  0.821103f,  0.824589f,  0.828045f,
-    0.831470f,  0.834863f,  0.838225f,  0.841555f,  0.844854f,  0.848120f,  0.851355f,  0.854558f,
-    0.857729f,  0.860867f,  0.863973f,  0.867046f,  0.870087f,  0.873095f,  0.876070f,  0.879012f,
-    0.881921f,  0.884797f,  0.887640f,  0.890449f,  0.893224f,  0.895966f,  0.898674f,  0.901349f,
-    0.903989f,  0.906596f,  0.909168f,  0.911706f,  0.914210f,  0.916679f,  0.919114f,  0.921514f,
-    0.923880f,  0.926210f,  0.928506f,  0.930767f,  0.932993f,  0.935184f,  0.937339f,  0.939459f,
-    0.941544f,  0.943593f,  0.945607f,  0.947586f,  0.949528f,  0.951435f,  0.953306f,  0.955141f,
-    0.956940f,  0.958703f,  0.960431f,  0.962121f,  0.963776f,  0.965394f,  0.966976f,  0.968522f,
-    0.970031f,  0.971504f,  0.972940f,  0.974339f,  0.975702f,  0.977028f,  0.978317f,  0.979570f,
-    0.980785f,  0.981964f,  0.983105f,  0.984210f,  0.985278f,  0.986308f,  0.987301f,  0.988258f,
-    0.989177f,  0.990058f,  0.990903f,  0.991710f,  0.992480f,  0.993212f,  0.993907f,  0.994565f,
-    0.995185f,  0.995767f,  0.996313f,  0.996820f,  0.997290f,  0.997723f,  0.998118f,  0.998476f,
-    0.998795f,  0.999078f,  0.999322f,  0.999529f,  0.999699f,  0.999831f,  0.999925f,  0.999981f,
-    1.000000f,  0.999981f,  0.999925f,  0.999831f,  0.999699f,  0.999529f,  0.999322f,  0.999078f,
-    0.998795f,  0.998476f,  0.998118f,  0.997723f,  0.997290f,  0.996820f,  0.996313f,  0.995767f,
-    0.995185f,  0.994565f,  0.993907f,  0.993212f,  0.992480f,  0.991710f,  0.990903f,  0.990058f,
-    0.989177f,  0.988258f,  0.987301f,  0.986308f,  0.985278f,  0.984210f,  0.983105f,  0.981964f,
-    0.980785f,  0.979570f,  0.978317f,  0.977028f,  0.975702f,  0.974339f,  0.972940f,  0.971504f,
-    0.970031f,  0.968522f,  0.966976f,  0.965394f,  0.963776f,  0.962121f,  0.960431f,  0.958703f,
-    0.956940f,  0.955141f,  0.953306f,  0.951435f,  0.949528f,  0.947586f,  0.945607f,  0.943593f,
-    0.941544f,  0.939459f,  0.937339f,  0.935184f,  0.932993f,  0.930767f,  0.928506f,  0.926210f,
-    0.923880f,  0.921514f,  0.919114f,  0.916679f,  0.914210f,  0.911706f,  0.909168f,  0.906596f,
-    0.903989f,  0.901349f,  0.898674f,  0.895966f,  0.893224f,  0.890449f,  0.887640f,  0.884797f,
-    0.881921f,  0.879012f,  0.876070f,  0.873095f,  0.870087f,  0.867046f,  0.863973f,  0.860867f,
-    0.857729f,  0.854558f,  0.851355f,  0.848120f,  0.844854f,  0.841555f,  0.838225f,  0.834863f,
-    0.831470f,  0.828045f,  0.824589f,  0.821103f,  0.817585f,  0.814036f,  0.810457f,  0.806848f,
-    0.803208f,  0.799537f,  0.795837f,  0.792107f,  0.788346f,  0.784557f,  0.780737f,  0.776888f,
-    0.773010f,  0.769103f,  0.765167f,  0.761202f,  0.757209f,  0.753187f,  0.749136f,  0.745058f,
-    0.740951f,  0.736817f,  0.732654f,  0.728464f,  0.724247f,  0.720003f,  0.715731f,  0.711432f,
-    0.707107f,  0.702755f,  0.698376f,  0.693971f,  0.689541f,  0.685084f,  0.680601f,  0.676093f,
-    0.671559f,  0.667000f,  0.662416f,  0.657807f,  0.653173f,  0.648514f,  0.643832f,  0.639124f,
-    0.634393f,  0.629638f,  0.624859f,  0.620057f,  0.615232f,  0.610383f,  0.605511f,  0.600616f,
-    0.595699f,  0.590760f,  0.585798f,  0.580814f,  0.575808f,  0.570781f,  0.565732f,  0.560662f,
-    0.555570f,  0.550458f,  0.545325f,  0.540171f,  0.534998f,  0.529804f,  0.524590f,  0.519356f,
-    0.514103f,  0.508830f,  0.503538f,  0.498228f,  0.492898f,  0.487550f,  0.482184f,  0.476799f,
-    0.471397f,  0.465976f,  0.460539f,  0.455084f,  0.449611f,  0.444122f,  0.438616f,  0.433094f,
-    0.427555f,  0.422000f,  0.416430f,  0.410843f,  0.405241f,  0.399624f,  0.393992f,  0.388345f,
-    0.382683f,  0.377007f,  0.371317f,  0.365613f,  0.359895f,  0.354164f,  0.348419f,  0.342661f,
-    0.336890f,  0.331106f,  0.325310f,  0.319502f,  0.313682f,  0.307850f,  0.302006f,  0.296151f,
-    0.290285f,  0.284408f,  0.278520f,  0.272621f,  0.266713f,  0.260794f,  0.254866f,  0.248928f,
-    0.242980f,  0.237024f,  0.231058f,  0.225084f,  0.219101f,  0.213110f,  0.207111f,  0.201105f,
-    0.195090f,  0.189069f,  0.183040f,  0.177004f,  0.170962f,  0.164913f,  0.158858f,  0.152797f,
-    0.146730f,  0.140658f,  0.134581f,  0.128498f,  0.122411f,  0.116319f,  0.110222f,  0.104122f,
-    0.098017f,  0.091909f,  0.085797f,  0.079682f,  0.073565f,  0.067444f,  0.061321f,  0.055195f,
-    0.049068f,  0.042938f,  0.036807f,  0.030675f,  0.024541f,  0.018407f,  0.012272f,  0.006136f
-};
-
-OMV_ATTR_ALWAYS_INLINE static float get_sin(int k, int N_pow2) {
-    // N=512 -> N=pow2=9
-    return fft_sin_table[k << (9 - N_pow2)];
-}
-
-OMV_ATTR_ALWAYS_INLINE static float get_ar(int k, int N_pow2) {
-    // N=512 -> N=pow2=9
-    return 0.5 * (1 - get_sin(k, N_pow2));
-}
-
-OMV_ATTR_ALWAYS_INLINE static float get_br(int k, int N_pow2) {
-    // N=512 -> N=pow2=9
-    return 0.5 * (1 + get_sin(k, N_pow2));
-}
-
-OMV_ATTR_ALWAYS_INLINE static float get_a_star_r(int k, int N_pow2) {
-    // N=512 -> N=pow2=9
-    return 0.5 * (1 - get_sin(k, N_pow2));
-}
-
-OMV_ATTR_ALWAYS_INLINE static float get_b_star_r(int k, int N_pow2) {
-    // N=512 -> N=pow2=9
-    return 0.5 * (1 + get_sin(k, N_pow2));
-}
 
-///////////////////////////////////////////////////////////////////////////////
+#define FFT_LANES           (VEC_LANES / 2) // Complex values per vector.
+#define FFT_MAX_N           (2048)
+#define FFT_MAX_FACTORS     (16)
+#define FFT_PLAN_CACHE      (4)
+
+#define FFT_LOAD(buf, i)        VEC_LOAD(vec_f32_t, (buf) + ((i) * VEC_LANES))
+#define FFT_STORE(buf, i, v)    VEC_STORE((buf) + ((i) * VEC_LANES), (v))
+
+// Complex values are interleaved real/imaginary pairs.
+static const vec_s32_t fft_swap_mask = {1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14};
+static const vec_f32_t fft_alt = {-1, 1, -1, 1, -1, 1, -1, 1, -1, 1, -1, 1, -1, 1, -1, 1};
+
+#define FFT_SWAP(v)             __builtin_shuffle((v), fft_swap_mask)
+#define FFT_CMUL(v, wr, wi)     ({ vec_f32_t _v = (v); (_v * (wr)) + (FFT_SWAP(_v) * (fft_alt * (wi))); })
+#define FFT_ROT(v, rot)         (FFT_SWAP(v) * (rot)) // Multiplies by -i (forward) or +i (inverse).
+
+typedef struct fft_plan {
+    int n;
+    int n_factors;
+    int factors[FFT_MAX_FACTORS];
+    int offsets[FFT_MAX_FACTORS];   // Start of the twiddles of each stage.
+    float twiddles[FFT_MAX_N * 2];  // The twiddles of all stages add up to n - 1.
+} fft_plan_t;
+
+static fft_plan_t fft_plans[FFT_PLAN_CACHE];
+static int fft_plans_next;
 
-// You give the FFT N real and imaginary pairs where each pair is an even/odd
-// real value from 2N data. The FFT will then output N real and imaginary pairs
-// and you can use the below function to unpack that into 2N real and imaginary
-// pairs the FFT would normally output with 2N data.
-
-// Unpack 2N data from N point fft
-// in = N real and complex floats
-// out = 2N real and complex floats
-static void unpack_fft(float *in, float *out, int N_pow2) {
-    for (int k = 0, l = 2 << N_pow2, m = l << 1; k < l; k += 2) {
-        int k_r = k + 0;
-        int k_i = k + 1;
-        int N_k_r = ((!k)?0:(l - k)) + 0;
-        int N_k_i = ((!k)?0:(l - k)) + 1;
-        int N2_K_r = ((!k)?0:(m - k)) + 0;
-        int N2_K_i = ((!k)?0:(m - k)) + 1;
-        int k_2 = k >> 1;
-        // real
-        out[k_r] = (in[k_r] * get_ar(k_2, N_pow2)) -
-                   (in[k_i] * get_ai(k_2, N_pow2)) +
-                   (in[N_k_r] * get_br(k_2, N_pow2)) +
-                   (in[N_k_i] * get_bi(k_2, N_pow2));
-        // imaginary
-        out[k_i] = (in[k_i] * get_ar(k_2, N_pow2)) +
-                   (in[k_r] * get_ai(k_2, N_pow2)) +
-                   (in[N_k_r] * get_bi(k_2, N_pow2)) -
-                   (in[N_k_i] * get_br(k_2, N_pow2));
-        if (k > 0) {
-            // real conj
-            out[N2_K_r] = out[k_r];
-            // imaginary conj
-            out[N2_K_i] = -out[k_i];
+// Smallest 2^a * 3^b * 5^c >= len with a >= 1 (fftshift needs an even size).
+static int fft_size(int len) {
+    for (int n = IM_MAX(len, 2); n <= FFT_MAX_N; n++) {
+        int m = n;
+
+        if (m % 2) {
+            continue;
+        }
+
+        while (!(m % 2)) {
+            m /= 2;
+        }
+
+        while (!(m % 3)) {
+            m /= 3;
+        }
+
+        while (!(m % 5)) {
+            m /= 5;
+        }
+
+        if (m == 1) {
+            return n;
         }
     }
-    out[(2 << N_pow2) + 0] = in[0 + 0] - in[0 + 1];
-    out[(2 << N_pow2) + 1] = 0;
-}
-
-// The IFFT takes N real and imaginary pairs to generate N real and imaginary
-// outputs with the imaginary part set to zero. To be more efficent this function
-// packs 2N data into an N IFFT so that the N real and imaginary outputs have
-// even/odd real values.
-
-// Pack 2N data to N point fft
-// in = 2N real and complex floats
-// out = N real and complex floats
-static void pack_fft(float *in, float *out, int N_pow2) {
-    for (int k = 0, l = 2 << N_pow2; k < l; k += 2) {
-        int k_r = k + 0;
-        int k_i = k + 1;
-        int N_k_r = (l - k) + 0;
-        int N_k_i = (l - k) + 1;
-        int k_2 = k >> 1;
-        // real
-        out[k_r] = (in[k_r] * get_a_star_r(k_2, N_pow2)) -
-                   (in[k_i] * get_a_star_i(k_2, N_pow2)) +
-                   (in[N_k_r] * get_b_star_r(k_2, N_pow2)) +
-                   (in[N_k_i] * get_b_star_i(k_2, N_pow2));
-        // imaginary
-        out[k_i] = (in[k_i] * get_a_star_r(k_2, N_pow2)) +
-                   (in[k_r] * get_a_star_i(k_2, N_pow2)) +
-                   (in[N_k_r] * get_b_star_i(k_2, N_pow2)) -
-                   (in[N_k_i] * get_b_star_r(k_2, N_pow2));
-    }
+
+    mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("FFT size too large!"));
 }
 
-///////////////////////////////////////////////////////////////////////////////
+static const fft_plan_t *fft_plan(int n) {
+    for (int i = 0; i < FFT_PLAN_CACHE; i++) {
+        if (fft_plans[i].n == n) {
+            return &fft_plans[i];
+        }
+    }
 
-OMV_ATTR_ALWAYS_INLINE static int int_flog2(int x) {
-    // floor log 2
-    return 31 - __CLZ(x);
-}
+    fft_plan_t *plan = &fft_plans[fft_plans_next];
+    fft_plans_next = (fft_plans_next + 1) % FFT_PLAN_CACHE;
+    plan->n = n;
+    plan->n_factors = 0;
+
+    // Stage i of length len uses W_len^(k * t) for k < len / p and 0 < t < p.
+    for (int len = n, offset = 0; len > 1; plan->n_factors++) {
+        int p = !(len % 4) ? 4 : !(len % 2) ? 2 : !(len % 3) ? 3 : 5;
+        plan->factors[plan->n_factors] = p;
+        plan->offsets[plan->n_factors] = offset;
+        len /= p;
+
+        for (int k = 0; k < len; k++) {
+            for (int t = 1; t < p; t++, offset += 2) {
+                double angle = (-2.0 * M_PI * k * t) / (len * p);
+                plan->twiddles[offset + 0] = cos(angle);
+                plan->twiddles[offset + 1] = sin(angle);
+            }
+        }
+    }
 
-OMV_ATTR_ALWAYS_INLINE static int int_clog2(int x) {
-    // ceiling log 2
-    int y = int_flog2(x);
-    return (x - (1 << y)) ? (y + 1) : y;
+    return plan;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 
-// Input even numbered index
-// Output even numbered index
-OMV_ATTR_ALWAYS_INLINE static int bit_reverse(int index, int N_pow2) {
-    return __RBIT(index) >> (30 - N_pow2);
-}
-
-OMV_ATTR_ALWAYS_INLINE static void swap(float *a, float *b) {
-    float tmp = *b;
-    *b = *a;
-    *a = tmp;
-}
-
-//OMV_ATTR_ALWAYS_INLINE static float get_hann(int k, int N_pow2)
-//{
-//    if (k < (1 << N_pow2)) {
-//        return get_hann_l_side(k, N_pow2);
-//    } else {
-//        return get_hann_r_side(k, N_pow2);
-//    }
-//}
-
-// Copies 2N real pairs (or pad with zero) from in to out while bit reversing
-// their indexes.
-
-static void prepare_real_input(uint8_t *in, int in_len, float *out, int N_pow2) {
-    for (int k = 0, l = 2 << N_pow2; k < l; k += 2) {
-        int m = bit_reverse(k, N_pow2);
-        out[m + 0] = ((k + 0) < in_len) ? in[k + 0] : 0;
-        out[m + 1] = ((k + 1) < in_len) ? in[k + 1] : 0;
-//        // Apply Hann Window (this is working on real numbers)
-//        out[m+0] *= get_hann(k+0, N_pow2);
-//        out[m+1] *= get_hann(k+1, N_pow2);
+// Stockham passes: x holds s interleaved sequences of length n = p * m, y receives them as
+// s * p interleaved sequences of length m (decimation in frequency, already in output order).
+static void fft_radix2(float *y, const float *x, const float *tw, int m, int s, float sign) {
+    for (int k = 0; k < m; k++, tw += 2) {
+        float w1r = tw[0], w1i = tw[1] * sign;
+
+        for (int q = 0; q < s; q++) {
+            vec_f32_t a0 = FFT_LOAD(x, q + (s * k));
+            vec_f32_t a1 = FFT_LOAD(x, q + (s * (k + m)));
+            FFT_STORE(y, q + (s * (2 * k)), a0 + a1);
+            FFT_STORE(y, q + (s * ((2 * k) + 1)), FFT_CMUL(a0 - a1, w1r, w1i));
+        }
     }
 }
 
-static void prepare_real_input_again(float *in, int in_len, float *out, int N_pow2) {
-    for (int k = 0, l = 2 << N_pow2; k < l; k += 2) {
-        int m = bit_reverse(k, N_pow2);
-        out[m + 0] = ((k + 0) < in_len) ? in[(k * 2) + 0] : 0;
-        out[m + 1] = ((k + 1) < in_len) ? in[(k * 2) + 2] : 0;
-//        // Apply Hann Window (this is working on real numbers)
-//        out[m+0] *= get_hann(k+0, N_pow2);
-//        out[m+1] *= get_hann(k+1, N_pow2);
+static void fft_radix3(float *y, const float *x, const float *tw, int m, int s, float sign) {
+    vec_f32_t rot = fft_alt * -sign;
+    const float c = -0.5f, d = 0.866025403784f;
+
+    for (int k = 0; k < m; k++, tw += 4) {
+        float w1r = tw[0], w1i = tw[1] * sign;
+        float w2r = tw[2], w2i = tw[3] * sign;
+
+        for (int q = 0; q < s; q++) {
+            vec_f32_t a0 = FFT_LOAD(x, q + (s * k));
+            vec_f32_t a1 = FFT_LOAD(x, q + (s * (k + m)));
+            vec_f32_t a2 = FFT_LOAD(x, q + (s * (k + (2 * m))));
+            vec_f32_t t0 = a1 + a2;
+            vec_f32_t t1 = a0 + (t0 * c);
+            vec_f32_t t2 = FFT_ROT(a1 - a2, rot) * d;
+            FFT_STORE(y, q + (s * (3 * k)), a0 + t0);
+            FFT_STORE(y, q + (s * ((3 * k) + 1)), FFT_CMUL(t1 + t2, w1r, w1i));
+            FFT_STORE(y, q + (s * ((3 * k) + 2)), FFT_CMUL(t1 - t2, w2r, w2i));
+        }
     }
 }
 
-//// This works on complex numbers...
-//static void apply_hann_window(float *inout, int N_pow2, int stride)
-//{
-//    for (int k = 0, l = 2 << N_pow2; k < l; k += 2) {
-//        inout[(k*stride)+0] *= get_hann(k>>1, N_pow2-1);
-//        inout[(k*stride)+1] *= get_hann(k>>1, N_pow2-1);
-//    }
-//}
-
-// Copies N complex pairs from in to out while bit reversing their indexes. The
-// in and out arrays may be the same.
-
-static void prepare_complex_input(float *in, float *out, int N_pow2, int stride) {
-    if (in == out) {
-        for (int k = 0, l = 2 << N_pow2; k < l; k += 2) {
-            int m = bit_reverse(k, N_pow2);
-            if (k < m) {
-                swap(out + (m * stride) + 0, in + (k * stride) + 0);
-                swap(out + (m * stride) + 1, in + (k * stride) + 1);
-            }
-        }
-    } else {
-        for (int k = 0, l = 2 << N_pow2; k < l; k += 2) {
-            int m = bit_reverse(k, N_pow2);
-            out[(m * stride) + 0] = in[(k * stride) + 0];
-            out[(m * stride) + 1] = in[(k * stride) + 1];
+static void fft_radix4(float *y, const float *x, const float *tw, int m, int s, float sign) {
+    vec_f32_t rot = fft_alt * -sign;
+    for (int k = 0; k < m; k++, tw += 6) {
+        float w1r = tw[0], w1i = tw[1] * sign;
+        float w2r = tw[2], w2i = tw[3] * sign;
+        float w3r = tw[4], w3i = tw[5] * sign;
+
+        for (int q = 0; q < s; q++) {
+            vec_f32_t a0 = FFT_LOAD(x, q + (s * k));
+            vec_f32_t a1 = FFT_LOAD(x, q + (s * (k + m)));
+            vec_f32_t a2 = FFT_LOAD(x, q + (s * (k + (2 * m))));
+            vec_f32_t a3 = FFT_LOAD(x, q + (s * (k + (3 * m))));
+            vec_f32_t t0 = a0 + a2;
+            vec_f32_t t1 = a0 - a2;
+            vec_f32_t t2 = a1 + a3;
+            vec_f32_t t3 = FFT_ROT(a1 - a3, rot);
+            FFT_STORE(y, q + (s * (4 * k)), t0 + t2);
+            FFT_STORE(y, q + (s * ((4 * k) + 1)), FFT_CMUL(t1 + t3, w1r, w1i));
+            FFT_STORE(y, q + (s * ((4 * k) + 2)), FFT_CMUL(t0 - t2, w2r, w2i));
+            FFT_STORE(y, q + (s * ((4 * k) + 3)), FFT_CMUL(t1 - t3, w3r, w3i));
         }
     }
 }
 
-///////////////////////////////////////////////////////////////////////////////
-
-// Performs the fft in place.
-static void do_fft(float *inout, int N_pow2, int stride) {
-    int N = 2 << N_pow2;
-    for (int N_pow2_i = 1; N_pow2_i <= N_pow2; N_pow2_i++) {
-        int N_mul2 = 2 << N_pow2_i;
-        int N_div2 = 1 << N_pow2_i;
-        for (int i = 0; i < N; i += N_mul2) {
-            for (int j = i, k = 0, l = i + N_div2, m = N >> N_pow2_i; j < l; j += 2, k += m) {
-                int x0_r = (j * stride) + 0;
-                int x0_i = (j * stride) + 1;
-                int x1_r = ((j + N_div2) * stride) + 0;
-                int x1_i = ((j + N_div2) * stride) + 1;
-                float tmp_r = (inout[x1_r] * get_cos(k, N_pow2)) +
-                              (inout[x1_i] * get_sin(k, N_pow2));
-                float tmp_i = (inout[x1_i] * get_cos(k, N_pow2)) -
-                              (inout[x1_r] * get_sin(k, N_pow2));
-                inout[x1_r] = inout[x0_r] - tmp_r;
-                inout[x1_i] = inout[x0_i] - tmp_i;
-                inout[x0_r] += tmp_r;
-                inout[x0_i] += tmp_i;
-            }
+static void fft_radix5(float *y, const float *x, const float *tw, int m, int s, float sign) {
+    vec_f32_t rot = fft_alt * -sign;
+    const float c1 = 0.309016994375f, c2 = -0.809016994375f;
+    const float s1 = 0.951056516295f, s2 = 0.587785252292f;
+
+    for (int k = 0; k < m; k++, tw += 8) {
+        float w1r = tw[0], w1i = tw[1] * sign;
+        float w2r = tw[2], w2i = tw[3] * sign;
+        float w3r = tw[4], w3i = tw[5] * sign;
+        float w4r = tw[6], w4i = tw[7] * sign;
+
+        for (int q = 0; q < s; q++) {
+            vec_f32_t a0 = FFT_LOAD(x, q + (s * k));
+            vec_f32_t a1 = FFT_LOAD(x, q + (s * (k + m)));
+            vec_f32_t a2 = FFT_LOAD(x, q + (s * (k + (2 * m))));
+            vec_f32_t a3 = FFT_LOAD(x, q + (s * (k + (3 * m))));
+            vec_f32_t a4 = FFT_LOAD(x, q + (s * (k + (4 * m))));
+            vec_f32_t t1 = a1 + a4, t2 = a2 + a3;
+            vec_f32_t t3 = FFT_ROT(a1 - a4, rot), t4 = FFT_ROT(a2 - a3, rot);
+            vec_f32_t b1 = a0 + (t1 * c1) + (t2 * c2);
+            vec_f32_t b2 = a0 + (t1 * c2) + (t2 * c1);
+            vec_f32_t d1 = (t3 * s1) + (t4 * s2);
+            vec_f32_t d2 = (t3 * s2) - (t4 * s1);
+            FFT_STORE(y, q + (s * (5 * k)), a0 + t1 + t2);
+            FFT_STORE(y, q + (s * ((5 * k) + 1)), FFT_CMUL(b1 + d1, w1r, w1i));
+            FFT_STORE(y, q + (s * ((5 * k) + 2)), FFT_CMUL(b2 + d2, w2r, w2i));
+            FFT_STORE(y, q + (s * ((5 * k) + 3)), FFT_CMUL(b2 - d2, w3r, w3i));
+            FFT_STORE(y, q + (s * ((5 * k) + 4)), FFT_CMUL(b1 - d1, w4r, w4i));
         }
     }
 }
 
-// Performs the ifft in place.
-static void do_ifft(float *inout, int N_pow2, int stride) {
-    int N = 2 << N_pow2;
-    for (int N_pow2_i = 1; N_pow2_i <= N_pow2; N_pow2_i++) {
-        int N_mul2 = 2 << N_pow2_i;
-        int N_div2 = 1 << N_pow2_i;
-        for (int i = 0; i < N; i += N_mul2) {
-            for (int j = i, k = 0, l = i + N_div2, m = N >> N_pow2_i; j < l; j += 2, k += m) {
-                int x0_r = (j * stride) + 0;
-                int x0_i = (j * stride) + 1;
-                int x1_r = ((j + N_div2) * stride) + 0;
-                int x1_i = ((j + N_div2) * stride) + 1;
-                float tmp_r = (inout[x1_r] * get_cos(k, N_pow2)) -
-                              (inout[x1_i] * get_sin(k, N_pow2));
-                float tmp_i = (inout[x1_i] * get_cos(k, N_pow2)) +
-                              (inout[x1_r] * get_sin(k, N_pow2));
-                inout[x1_r] = inout[x0_r] - tmp_r;
-                inout[x1_i] = inout[x0_i] - tmp_i;
-                inout[x0_r] += tmp_r;
-                inout[x0_i] += tmp_i;
+// Transforms FFT_LANES sequences of plan->n complex values in place (unscaled). Element i of
+// every sequence is the vector at data + (i * VEC_LANES). work must be as large as data.
+static void fft_exec(const fft_plan_t *plan, float *data, float *work, bool inverse) {
+    float sign = inverse ? -1.0f : 1.0f;
+    float *x = data, *y = work;
+
+    for (int i = 0, n = plan->n, s = 1; i < plan->n_factors; i++) {
+        int p = plan->factors[i], m = n / p;
+        const float *tw = plan->twiddles + plan->offsets[i];
+
+        switch (p) {
+            case 2: {
+                fft_radix2(y, x, tw, m, s, sign);
+                break;
+            }
+            case 3: {
+                fft_radix3(y, x, tw, m, s, sign);
+                break;
+            }
+            case 4: {
+                fft_radix4(y, x, tw, m, s, sign);
+                break;
+            }
+            default: {
+                fft_radix5(y, x, tw, m, s, sign);
+                break;
             }
         }
+
+        float *tmp = x;
+        x = y;
+        y = tmp;
+        n = m;
+        s *= p;
     }
 
-    float div = 1.0 / (N >> 1);
-    for (int i = 0; i < N; i += 2) {
-        inout[(i * stride) + 0] *= div;
-        inout[(i * stride) + 1] *= div;
+    if (x != data) {
+        memcpy(data, x, plan->n * VEC_LANES * sizeof(float));
     }
 }
 
@@ -432,42 +247,60 @@ static void do_ifft(float *inout, int N_pow2, int stride) {
 void fft1d_alloc(fft1d_controller_t *controller, uint8_t *buf, int len) {
     controller->d_pointer = buf;
     controller->d_len = len;
-    controller->pow2 = int_clog2(len);
-    controller->data = fb_alloc((2 << controller->pow2) * sizeof(float), FB_ALLOC_NO_HINT);
+    controller->n = fft_size(len);
+    controller->data = fb_alloc(controller->n * 2 * sizeof(float), FB_ALLOC_NO_HINT);
 }
 
 void fft1d_dealloc() {
     fb_free();
 }
 
-void fft1d_run(fft1d_controller_t *controller) {
-    // We can speed up the FFT by packing data into both the real and imaginary
-    // values. This results in having to do an FFT of half the size normally.
-
-    float *h_buffer = fb_alloc((1 << controller->pow2) * sizeof(float), FB_ALLOC_NO_HINT);
-    prepare_real_input(controller->d_pointer, controller->d_len,
-                       h_buffer, controller->pow2 - 1);
-    do_fft(h_buffer, controller->pow2 - 1, 1);
-    unpack_fft(h_buffer, controller->data, controller->pow2 - 1);
+// A single sequence only uses the first lane of the batch.
+static void fft1d_exec(fft1d_controller_t *controller, bool again, bool inverse) {
+    int n = controller->n;
+    const fft_plan_t *plan = fft_plan(n);
+    float *panel = fb_alloc0(n * VEC_LANES * 2 * sizeof(float), FB_ALLOC_NO_HINT);
+
+    for (int i = 0; i < n; i++) {
+        if (inverse) {
+            panel[(i * VEC_LANES) + 0] = controller->data[(i * 2) + 0];
+            panel[(i * VEC_LANES) + 1] = controller->data[(i * 2) + 1];
+        } else if (again) {
+            panel[i * VEC_LANES] = controller->data[i * 2];
+        } else {
+            panel[i * VEC_LANES] = (i < controller->d_len) ? controller->d_pointer[i] : 0;
+        }
+    }
+
+    fft_exec(plan, panel, panel + (n * VEC_LANES), inverse);
+
+    if (inverse) {
+        // The output is real and packed into the first n floats.
+        for (int i = 0; i < n; i++) {
+            controller->data[i] = panel[i * VEC_LANES] / n;
+        }
+
+        memset(controller->data + n, 0, n * sizeof(float));
+    } else {
+        for (int i = 0; i < n; i++) {
+            controller->data[(i * 2) + 0] = panel[(i * VEC_LANES) + 0];
+            controller->data[(i * 2) + 1] = panel[(i * VEC_LANES) + 1];
+        }
+    }
+
     fb_free();
 }
 
+void fft1d_run(fft1d_controller_t *controller) {
+    fft1d_exec(controller, false, false);
+}
+
 void ifft1d_run(fft1d_controller_t *controller) {
-    // We can speed up the FFT by packing data into both the real and imaginary
-    // values. This results in having to do an FFT of half the size normally.
-
-    float *h_buffer = fb_alloc((1 << controller->pow2) * sizeof(float), FB_ALLOC_NO_HINT);
-    pack_fft(controller->data, h_buffer, controller->pow2 - 1);
-    prepare_complex_input(h_buffer, h_buffer,
-                          controller->pow2 - 1, 1);
-    do_ifft(h_buffer, controller->pow2 - 1, 1);
-    memset(controller->data, 0, (2 << controller->pow2) * sizeof(float));
-    memcpy(controller->data, h_buffer, (1 << controller->pow2) * sizeof(float));
-    fb_free();
+    fft1d_exec(controller, false, true);
 }
 
 void fft1d_mag(fft1d_controller_t *controller) {
-    for (int i = 0, j = 2 << controller->pow2; i < j; i += 2) {
+    for (int i = 0, j = controller->n * 2; i < j; i += 2) {
         float tmp_r = controller->data[i + 0];
         float tmp_i = controller->data[i + 1];
         controller->data[i + 0] = fast_sqrtf((tmp_r * tmp_r) + (tmp_i * tmp_i));
@@ -476,7 +309,7 @@ void fft1d_mag(fft1d_controller_t *controller) {
 }
 
 void fft1d_phase(fft1d_controller_t *controller) {
-    for (int i = 0, j = 2 << controller->pow2; i < j; i += 2) {
+    for (int i = 0, j = controller->n * 2; i < j; i += 2) {
         float tmp_r = controller->data[i + 0];
         float tmp_i = controller->data[i + 1];
         controller->data[i + 0] = tmp_r ? fast_atan2f(tmp_i, tmp_r) : ((tmp_i < 0) ? (M_PI * 1.5) : (M_PI * 0.5));
@@ -485,7 +318,7 @@ void fft1d_phase(fft1d_controller_t *controller) {
 }
 
 void fft1d_log(fft1d_controller_t *controller) {
-    for (int i = 0, j = 2 << controller->pow2; i < j; i += 2) {
+    for (int i = 0, j = controller->n * 2; i < j; i += 2) {
         float tmp_r = controller->data[i + 0];
         float tmp_i = controller->data[i + 1];
         controller->data[i + 0] = fast_log(fast_sqrtf((tmp_r * tmp_r) + (tmp_i * tmp_i)));
@@ -494,7 +327,7 @@ void fft1d_log(fft1d_controller_t *controller) {
 }
 
 void fft1d_exp(fft1d_controller_t *controller) {
-    for (int i = 0, j = 2 << controller->pow2; i < j; i += 2) {
+    for (int i = 0, j = controller->n * 2; i < j; i += 2) {
         float tmp_r = controller->data[i + 0];
         float tmp_i = controller->data[i + 1];
         controller->data[i + 0] = fast_expf(tmp_r) * cosf(tmp_i);
@@ -503,7 +336,7 @@ void fft1d_exp(fft1d_controller_t *controller) {
 }
 
 void fft1d_swap(fft1d_controller_t *controller) {
-    for (int i = 0, j = ((1 << controller->pow2) / 2) * 2; i < j; i += 2) {
+    for (int i = 0, j = (controller->n / 2) * 2; i < j; i += 2) {
         float tmp_r = controller->data[i + 0];
         float tmp_i = controller->data[i + 1];
         controller->data[i + 0] = controller->data[j + i + 0];
@@ -514,15 +347,7 @@ void fft1d_swap(fft1d_controller_t *controller) {
 }
 
 void fft1d_run_again(fft1d_controller_t *controller) {
-    // We can speed up the FFT by packing data into both the real and imaginary
-    // values. This results in having to do an FFT of half the size normally.
-
-    float *h_buffer = fb_alloc((1 << controller->pow2) * sizeof(float), FB_ALLOC_NO_HINT);
-    prepare_real_input_again(controller->data, 1 << controller->pow2,
-                             h_buffer, controller->pow2 - 1);
-    do_fft(h_buffer, controller->pow2 - 1, 1);
-    unpack_fft(h_buffer, controller->data, controller->pow2 - 1);
-    fb_free();
+    fft1d_exec(controller, true, false);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -533,73 +358,181 @@ void fft2d_alloc(fft2d_controller_t *controller, image_t *img, rectangle_t *r) {
         mp_raise_msg(&mp_type_OSError, MP_ERROR_TEXT("No intersection!"));
     }
 
-    controller->w_pow2 = int_clog2(controller->r.w);
-    controller->h_pow2 = int_clog2(controller->r.h);
+    controller->w = fft_size(controller->r.w);
+    controller->h = fft_size(controller->r.h);
 
     controller->data =
-        fb_alloc0(2 * (1 << controller->w_pow2) * (1 << controller->h_pow2) * sizeof(float), FB_ALLOC_NO_HINT);
+        fb_alloc0(2 * controller->w * controller->h * sizeof(float), FB_ALLOC_NO_HINT);
 }
 
 void fft2d_dealloc() {
     fb_free();
 }
 
-void fft2d_run(fft2d_controller_t *controller) {
-    // This section copies image data into the fft buffer. It takes care of
-    // extracting the grey channel from RGB images if necessary. The code
-    // also handles dealing with a rect less than the image size.
-    for (int i = 0; i < controller->r.h; i++) {
-        // Get image data into buffer.
-        uint8_t *tmp = fb_alloc(controller->r.w * sizeof(uint8_t), FB_ALLOC_NO_HINT);
-        for (int j = 0; j < controller->r.w; j++) {
-            if (IM_IS_GS(controller->img)) {
-                tmp[j] = IM_GET_GS_PIXEL(controller->img,
-                                         controller->r.x + j, controller->r.y + i);
+// Loads ROI row y into every VEC_LANES-th float of dst, zero padded to the transform width. This
+// also extracts the grey channel from RGB images.
+static void fft2d_load_row(fft2d_controller_t *controller, int y, float *dst) {
+    image_t *img = controller->img;
+    int x = 0;
+
+    if (IM_IS_GS(img)) {
+        uint8_t *row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, controller->r.y + y) + controller->r.x;
+        for (; x < controller->r.w; x++) {
+            dst[x * VEC_LANES] = row_ptr[x];
+        }
+    } else {
+        uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, controller->r.y + y) + controller->r.x;
+        for (; x < controller->r.w; x++) {
+            dst[x * VEC_LANES] = COLOR_RGB565_TO_Y(row_ptr[x]);
+        }
+    }
+
+    for (; x < controller->w; x++) {
+        dst[x * VEC_LANES] = 0;
+    }
+}
+
+// Real rows are transformed two at a time as the real and imaginary parts of one complex row and
+// separated afterwards using the symmetry of real input spectra.
+static void fft2d_rows(fft2d_controller_t *controller, float *panel, float *work, bool again) {
+    int w = controller->w;
+    int rows = again ? controller->h : controller->r.h;
+    const fft_plan_t *plan = fft_plan(w);
+
+    for (int y = 0; y < rows; y += FFT_LANES * 2) {
+        for (int i = 0; i < VEC_LANES; i++) {
+            float *dst = panel + i;
+
+            if ((y + i) >= rows) {
+                for (int x = 0; x < w; x++) {
+                    dst[x * VEC_LANES] = 0;
+                }
+            } else if (again) {
+                float *src = controller->data + ((y + i) * w * 2);
+                for (int x = 0; x < w; x++) {
+                    dst[x * VEC_LANES] = src[x * 2];
+                }
             } else {
-                tmp[j] = COLOR_RGB565_TO_Y(IM_GET_RGB565_PIXEL(controller->img,
-                                                               controller->r.x + j, controller->r.y + i));
+                fft2d_load_row(controller, y + i, dst);
             }
         }
-        // Do FFT on image data and copy to main buffer.
-        fft1d_controller_t fft1d_controller_i;
-        fft1d_alloc(&fft1d_controller_i, tmp, controller->r.w);
-        fft1d_run(&fft1d_controller_i);
-        memcpy(controller->data + (i * (2 << controller->w_pow2)),
-               fft1d_controller_i.data, (2 << fft1d_controller_i.pow2) * sizeof(float));
-        fft1d_dealloc();
-        // Free image data buffer.
-        fb_free();
-    }
 
-    // The above operates on the rows and this fft operates on the columns. To
-    // avoid having to transpose the array the fft takes a stride input.
-    for (int i = 0, ii = 2 << controller->w_pow2; i < ii; i += 2) {
-        float *p = controller->data + i;
-//        apply_hann_window(p, controller->h_pow2, (1 << controller->w_pow2));
-        prepare_complex_input(p, p, controller->h_pow2, (1 << controller->w_pow2));
-        do_fft(p, controller->h_pow2, (1 << controller->w_pow2));
+        fft_exec(plan, panel, work, false);
+
+        for (int i = 0; i < VEC_LANES; i += 2) {
+            if ((y + i) >= rows) {
+                break;
+            }
+
+            float *row_0 = controller->data + ((y + i) * w * 2);
+            float *row_1 = ((y + i + 1) < rows) ? (row_0 + (w * 2)) : NULL;
+
+            for (int k = 0; k < w; k++) {
+                float *z_k = panel + (k * VEC_LANES) + i;
+                float *z_n_k = panel + ((k ? (w - k) : 0) * VEC_LANES) + i;
+                row_0[(k * 2) + 0] = (z_k[0] + z_n_k[0]) * 0.5f;
+                row_0[(k * 2) + 1] = (z_k[1] - z_n_k[1]) * 0.5f;
+                if (row_1) {
+                    row_1[(k * 2) + 0] = (z_k[1] + z_n_k[1]) * 0.5f;
+                    row_1[(k * 2) + 1] = (z_n_k[0] - z_k[0]) * 0.5f;
+                }
+            }
+        }
     }
 }
 
-void ifft2d_run(fft2d_controller_t *controller) {
-    // Do columns...
-    for (int i = 0, ii = 2 << controller->w_pow2; i < ii; i += 2) {
-        float *p = controller->data + i;
-        prepare_complex_input(p, p, controller->h_pow2, (1 << controller->w_pow2));
-        do_ifft(p, controller->h_pow2, (1 << controller->w_pow2));
+// The inverse of fft2d_rows() for real output, which is packed into the first w floats of each row.
+static void ifft2d_rows(fft2d_controller_t *controller, float *panel, float *work) {
+    int w = controller->w;
+    int h = controller->h;
+    float scale = 1.0f / (w * h);
+    const fft_plan_t *plan = fft_plan(w);
+
+    for (int y = 0; y < h; y += FFT_LANES * 2) {
+        for (int i = 0; i < VEC_LANES; i += 2) {
+            float *dst = panel + i;
+
+            if ((y + i) >= h) {
+                for (int x = 0; x < w; x++) {
+                    dst[(x * VEC_LANES) + 0] = 0;
+                    dst[(x * VEC_LANES) + 1] = 0;
+                }
+            } else {
+                float *row_0 = controller->data + ((y + i) * w * 2);
+                float *row_1 = row_0 + (w * 2);
+                for (int x = 0; x < w; x++) {
+                    dst[(x * VEC_LANES) + 0] = row_0[(x * 2) + 0] - row_1[(x * 2) + 1];
+                    dst[(x * VEC_LANES) + 1] = row_0[(x * 2) + 1] + row_1[(x * 2) + 0];
+                }
+            }
+        }
+
+        fft_exec(plan, panel, work, true);
+
+        for (int i = 0; i < VEC_LANES; i += 2) {
+            if ((y + i) >= h) {
+                break;
+            }
+
+            float *row_0 = controller->data + ((y + i) * w * 2);
+            float *row_1 = row_0 + (w * 2);
+
+            for (int x = 0; x < w; x++) {
+                row_0[x] = panel[(x * VEC_LANES) + i + 0] * scale;
+                row_1[x] = panel[(x * VEC_LANES) + i + 1] * scale;
+            }
+
+            memset(row_0 + w, 0, w * sizeof(float));
+            memset(row_1 + w, 0, w * sizeof(float));
+        }
     }
+}
 
-    // Do rows...
-    for (int i = 0, ii = 1 << controller->h_pow2; i < ii; i++) {
-        fft1d_controller_t fft1d_controller_i;
-        fft1d_controller_i.pow2 = controller->w_pow2;
-        fft1d_controller_i.data = controller->data + (i * (2 << controller->w_pow2));
-        ifft1d_run(&fft1d_controller_i);
+// Columns are transformed FFT_LANES at a time from a contiguous panel instead of walking the
+// whole array with a stride once per column.
+static void fft2d_cols(fft2d_controller_t *controller, float *panel, float *work, bool inverse) {
+    int w = controller->w;
+    int h = controller->h;
+    const fft_plan_t *plan = fft_plan(h);
+
+    for (int x = 0; x < w; x += FFT_LANES) {
+        int size = IM_MIN(FFT_LANES, w - x) * 2 * sizeof(float);
+
+        if (size != (VEC_LANES * sizeof(float))) {
+            memset(panel, 0, h * VEC_LANES * sizeof(float));
+        }
+
+        for (int y = 0; y < h; y++) {
+            memcpy(panel + (y * VEC_LANES), controller->data + (((y * w) + x) * 2), size);
+        }
+
+        fft_exec(plan, panel, work, inverse);
+
+        for (int y = 0; y < h; y++) {
+            memcpy(controller->data + (((y * w) + x) * 2), panel + (y * VEC_LANES), size);
+        }
     }
 }
 
+void fft2d_run(fft2d_controller_t *controller) {
+    int size = IM_MAX(controller->w, controller->h) * VEC_LANES * sizeof(float);
+    float *panel = fb_alloc(size * 2, FB_ALLOC_NO_HINT);
+    fft2d_rows(controller, panel, panel + (size / sizeof(float)), false);
+    fft2d_cols(controller, panel, panel + (size / sizeof(float)), false);
+    fb_free();
+}
+
+void ifft2d_run(fft2d_controller_t *controller) {
+    int size = IM_MAX(controller->w, controller->h) * VEC_LANES * sizeof(float);
+    float *panel = fb_alloc(size * 2, FB_ALLOC_NO_HINT);
+    fft2d_cols(controller, panel, panel + (size / sizeof(float)), true);
+    ifft2d_rows(controller, panel, panel + (size / sizeof(float)));
+    fb_free();
+}
+
+
 void fft2d_mag(fft2d_controller_t *controller) {
-    for (int i = 0, j = (1 << controller->h_pow2) * (1 << controller->w_pow2) * 2; i < j; i += 2) {
+    for (int i = 0, j = controller->h * controller->w * 2; i < j; i += 2) {
         float tmp_r = controller->data[i + 0];
         float tmp_i = controller->data[i + 1];
         controller->data[i + 0] = fast_sqrtf((tmp_r * tmp_r) + (tmp_i * tmp_i));
@@ -608,7 +541,7 @@ void fft2d_mag(fft2d_controller_t *controller) {
 }
 
 void fft2d_phase(fft2d_controller_t *controller) {
-    for (int i = 0, j = (1 << controller->h_pow2) * (1 << controller->w_pow2) * 2; i < j; i += 2) {
+    for (int i = 0, j = controller->h * controller->w * 2; i < j; i += 2) {
         float tmp_r = controller->data[i + 0];
         float tmp_i = controller->data[i + 1];
         controller->data[i + 0] = tmp_r ? fast_atan2f(tmp_i, tmp_r) : ((tmp_i < 0) ? (M_PI * 1.5) : (M_PI * 0.5));
@@ -617,7 +550,7 @@ void fft2d_phase(fft2d_controller_t *controller) {
 }
 
 void fft2d_log(fft2d_controller_t *controller) {
-    for (int i = 0, j = (1 << controller->h_pow2) * (1 << controller->w_pow2) * 2; i < j; i += 2) {
+    for (int i = 0, j = controller->h * controller->w * 2; i < j; i += 2) {
         float tmp_r = controller->data[i + 0];
         float tmp_i = controller->data[i + 1];
         controller->data[i + 0] = fast_log(fast_sqrtf((tmp_r * tmp_r) + (tmp_i * tmp_i)));
@@ -626,7 +559,7 @@ void fft2d_log(fft2d_controller_t *controller) {
 }
 
 void fft2d_exp(fft2d_controller_t *controller) {
-    for (int i = 0, j = (1 << controller->h_pow2) * (1 << controller->w_pow2) * 2; i < j; i += 2) {
+    for (int i = 0, j = controller->h * controller->w * 2; i < j; i += 2) {
         float tmp_r = controller->data[i + 0];
         float tmp_i = controller->data[i + 1];
         controller->data[i + 0] = fast_expf(tmp_r) * cosf(tmp_i);
@@ -636,18 +569,18 @@ void fft2d_exp(fft2d_controller_t *controller) {
 
 void fft2d_swap(fft2d_controller_t *controller) {
     // Do rows...
-    for (int i = 0, ii = 1 << controller->h_pow2; i < ii; i++) {
+    for (int i = 0, ii = controller->h; i < ii; i++) {
         fft1d_controller_t fft1d_controller_i;
-        fft1d_controller_i.pow2 = controller->w_pow2;
-        fft1d_controller_i.data = controller->data + (i * (2 << controller->w_pow2));
+        fft1d_controller_i.n = controller->w;
+        fft1d_controller_i.data = controller->data + (i * (controller->w * 2));
         fft1d_swap(&fft1d_controller_i);
     }
 
     // Do columns...
-    for (int x = 0, xx = 2 << controller->w_pow2; x < xx; x += 2) {
-        for (int y = 0, yy = (1 << controller->h_pow2) / 2; y < yy; y++) {
-            int i = (y * (2 << controller->w_pow2)) + x;
-            int j = yy * (2 << controller->w_pow2);
+    for (int x = 0, xx = controller->w * 2; x < xx; x += 2) {
+        for (int y = 0, yy = controller->h / 2; y < yy; y++) {
+            int i = (y * (controller->w * 2)) + x;
+            int j = yy * (controller->w * 2);
             float tmp_r = controller->data[i + 0];
             float tmp_i = controller->data[i + 1];
             controller->data[i + 0] = controller->data[j + i + 0];
@@ -659,8 +592,8 @@ void fft2d_swap(fft2d_controller_t *controller) {
 }
 
 void fft2d_linpolar(fft2d_controller_t *controller) {
-    int w = 1 << controller->w_pow2;
-    int h = 1 << controller->h_pow2;
+    int w = controller->w;
+    int h = controller->h;
     int s = h * w * 2 * sizeof(float);
     float *tmp = fb_alloc(s, FB_ALLOC_NO_HINT);
     memcpy(tmp, controller->data, s);
@@ -694,8 +627,8 @@ void fft2d_linpolar(fft2d_controller_t *controller) {
 }
 
 void fft2d_logpolar(fft2d_controller_t *controller) {
-    int w = 1 << controller->w_pow2;
-    int h = 1 << controller->h_pow2;
+    int w = controller->w;
+    int h = controller->h;
     int s = h * w * 2 * sizeof(float);
     float *tmp = fb_alloc(s, FB_ALLOC_NO_HINT);
     memcpy(tmp, controller->data, s);
@@ -729,19 +662,9 @@ void fft2d_logpolar(fft2d_controller_t *controller) {
 }
 
 void fft2d_run_again(fft2d_controller_t *controller) {
-    for (int i = 0, ii = 1 << controller->h_pow2; i < ii; i++) {
-        fft1d_controller_t fft1d_controller_i;
-        fft1d_controller_i.pow2 = controller->w_pow2;
-        fft1d_controller_i.data = controller->data + (i * (2 << controller->w_pow2));
-        fft1d_run_again(&fft1d_controller_i);
-    }
-
-    // The above operates on the rows and this fft operates on the columns. To
-    // avoid having to transpose the array the fft takes a stride input.
-    for (int i = 0, ii = 2 << controller->w_pow2; i < ii; i += 2) {
-        float *p = controller->data + i;
-//        apply_hann_window(p, controller->h_pow2, (1 << controller->w_pow2));
-        prepare_complex_input(p, p, controller->h_pow2, (1 << controller->w_pow2));
-        do_fft(p, controller->h_pow2, (1 << controller->w_pow2));
-    }
+    int size = IM_MAX(controller->w, controller->h) * VEC_LANES * sizeof(float);
+    float *panel = fb_alloc(size * 2, FB_ALLOC_NO_HINT);
+    fft2d_rows(controller, panel, panel + (size / sizeof(float)), true);
+    fft2d_cols(controller, panel, panel + (size / sizeof(float)), false);
+    fb_free();
 }
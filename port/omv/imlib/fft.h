@@ -3,7 +3,8 @@
  * Copyright (c) 2013-2016 Kwabena W. Agyeman <kwagyeman@openmv.io>
  * This work is licensed under the MIT license, see the file LICENSE for details.
  *
- * FFT LIB - can do 1024 point real FFTs and 512 point complex FFTs
+ * FFT LIB - mixed radix (2, 3, 4, 5) FFTs of up to 2048 points, sizes are rounded up to the next
+ * 2^a * 3^b * 5^c instead of the next power of two.
  *
  */
 #ifndef __FFT_H__
@@ -13,7 +14,7 @@
 typedef struct fft1d_controller {
     uint8_t *d_pointer;
     int d_len;
-    int pow2;
+    int n;
     float *data;
 } fft1d_controller_t;
 void fft1d_alloc(fft1d_controller_t *controller, uint8_t *buf, int len);
@@ -29,7 +30,7 @@ void fft1d_run_again(fft1d_controller_t *controller); // Do FFT again on real ma
 typedef struct fft2d_controller {
     image_t *img;
     rectangle_t r;
-    int w_pow2, h_pow2;
+    int w, h;
     float *data;
 } fft2d_controller_t;
 void fft2d_alloc(fft2d_controller_t *controller, image_t *img, rectangle_t *r);
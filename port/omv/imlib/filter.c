@@ -10,6 +10,7 @@
  */
 #include "fsort.h"
 #include "imlib.h"
+#include "simd.h"
 
 void imlib_histeq(image_t *img, image_t *mask) {
     switch (img->pixfmt) {
@@ -121,863 +122,384 @@ void imlib_histeq(image_t *img, image_t *mask) {
     }
 }
 
-// ksize == 0 -> 1x1 kernel
-// ksize == 1 -> 3x3 kernel
-// ...
-// ksize == n -> ((n*2)+1)x((n*2)+1) kernel
-//
-// To speed up this filter, we can help in two ways:
-// 1) For the 'center portion' of the image area, we don't need to check
-//   the x+y values against the boundary conditions on each pixel.
-// 2) In that same region we can take advantage of the filter property being
-//   the sum of all of the pixels by subtracting the last left edge values
-//   and adding the new right edge values instead of re-calculating the sum
-//   of every pixel. This will allow very large filters to be used without
-//   much change in performance.
-//
-#ifdef IMLIB_ENABLE_MEAN
-void imlib_mean_filter(image_t *img, const int ksize, bool threshold, int offset, bool invert, image_t *mask) {
-    int brows = ksize + 1;
-    image_t buf;
-    buf.w = img->w;
-    buf.h = brows;
-    buf.pixfmt = img->pixfmt;
-
-    int32_t over32_n = 65536 / (((ksize * 2) + 1) * ((ksize * 2) + 1));
-
+#if defined(IMLIB_ENABLE_MEDIAN) || defined(IMLIB_ENABLE_MODE) || defined(IMLIB_ENABLE_MIDPOINT) || \
+    defined(IMLIB_ENABLE_BILATERAL)
+// Points planes[] at the channels of row y (RGB565 is unpacked into scratch) and returns the stride.
+static int filter_planes(image_t *img, int y, uint8_t *scratch, const uint8_t **planes) {
     switch (img->pixfmt) {
-        case PIXFORMAT_BINARY: {
-            buf.data = fb_alloc(IMAGE_BINARY_LINE_LEN_BYTES(img) * brows, FB_ALLOC_NO_HINT);
+        case PIXFORMAT_GRAYSCALE: {
+            planes[0] = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y);
+            return 1;
+        }
+        case PIXFORMAT_RGB565: {
+            uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y);
 
-            for (int y = 0, yy = img->h; y < yy; y++) {
-                int pixel, acc = 0;
-                uint32_t *row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, y);
-                uint32_t *buf_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(&buf, (y % brows));
+            for (int x = 0, xx = img->w; x < xx; x++) {
+                int pixel = row_ptr[x];
+                scratch[x] = COLOR_RGB565_TO_R5(pixel);
+                scratch[xx + x] = COLOR_RGB565_TO_G6(pixel);
+                scratch[(xx * 2) + x] = COLOR_RGB565_TO_B5(pixel);
+            }
 
-                for (int x = 0, xx = img->w; x < xx; x++) {
-                    if (mask && (!image_get_mask_pixel(mask, x, y))) {
-                        IMAGE_PUT_BINARY_PIXEL_FAST(buf_row_ptr, x, IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x));
-                        continue; // Short circuit.
-                    }
+            planes[0] = scratch;
+            planes[1] = scratch + img->w;
+            planes[2] = scratch + (img->w * 2);
+            return 1;
+        }
+        default: {
+            uint8_t *row_ptr = ((uint8_t *) img->data) + (img->w * y * 3);
+            planes[0] = row_ptr;
+            planes[1] = row_ptr + 1;
+            planes[2] = row_ptr + 2;
+            return 3;
+        }
+    }
+}
+#endif
 
-                    if (!mask && x > ksize && x < img->w - ksize && y >= ksize && y < img->h - ksize) {
-                        for (int j = -ksize; j <= ksize; j++) {
-                            uint32_t *k_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, y + j);
-                            acc -= IMAGE_GET_BINARY_PIXEL_FAST(k_row_ptr, x - ksize - 1);
-                            acc += IMAGE_GET_BINARY_PIXEL_FAST(k_row_ptr, x + ksize);
-                        }
-                    } else {
-                        acc = 0;
+#if defined(IMLIB_ENABLE_MEDIAN) || defined(IMLIB_ENABLE_MODE) || defined(IMLIB_ENABLE_MIDPOINT)
+// Constant time rank filters (Perreault and Hebert, "Median Filtering in Constant Time").
+//
+// Every column keeps a histogram of the 2*ksize+1 pixels around the current row which is updated
+// with one add and one remove per row. The kernel histogram is the sum of the 2*ksize+1 column
+// histograms around x and slides right with one add and one remove per pixel. Histograms are split
+// into 16 coarse bins, which are kept up to date for every pixel, and 256 fine bins, a segment of
+// which is only brought up to date when a query needs it.
+#define RANK_COARSE_BINS    (16)
+#define RANK_FINE_BINS      (256)
+#define RANK_SEGMENT_BINS   (RANK_FINE_BINS / RANK_COARSE_BINS)
+
+#if (RANK_COARSE_BINS != VEC_LANES) || (RANK_SEGMENT_BINS != VEC_LANES)
+#error "Rank filter histograms must be one vector wide!"
+#endif
 
-                        for (int j = -ksize; j <= ksize; j++) {
-                            uint32_t *k_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img,
-                                                                                     IM_MIN(IM_MAX(y + j, 0), (img->h - 1)));
+typedef enum rank_filter_op {
+    RANK_FILTER_PERCENTILE,
+    RANK_FILTER_MODE,
+    RANK_FILTER_MIDPOINT
+} rank_filter_op_t;
+
+typedef struct rank_hist {
+    int w, ksize, n;
+    int segments;                           // Coarse bins the channel values can reach.
+    uint16_t *col_coarse;                   // w * RANK_COARSE_BINS
+    uint16_t *col_fine;                     // w * RANK_FINE_BINS
+    uint16_t coarse[RANK_COARSE_BINS];
+    uint16_t fine[RANK_FINE_BINS];
+    int last[RANK_COARSE_BINS];             // Column each fine segment was last updated at.
+} rank_hist_t;
+
+static inline int rank_clamp(int x, int w) {
+    return IM_MIN(IM_MAX(x, 0), (w - 1));
+}
 
-                            for (int k = -ksize; k <= ksize; k++) {
-                                acc += IMAGE_GET_BINARY_PIXEL_FAST(k_row_ptr,
-                                                                   IM_MIN(IM_MAX(x + k, 0), (img->w - 1)));
-                            }
-                        }
-                    }
+// Adds (delta = 1) or removes (delta = -1) a row of 8-bit values to/from the column histograms.
+static void rank_hist_update(rank_hist_t *h, const uint8_t *row, int stride, int delta) {
+    for (int x = 0; x < h->w; x++, row += stride) {
+        int v = *row;
+        h->col_coarse[(x * RANK_COARSE_BINS) + (v / RANK_SEGMENT_BINS)] += delta;
+        h->col_fine[(x * RANK_FINE_BINS) + v] += delta;
+    }
+}
 
-                    pixel = (int) ((acc * over32_n) >> 16);
+static void rank_hist_row_start(rank_hist_t *h) {
+    vec_u16_t sum = {0};
 
-                    if (threshold) {
-                        if (((pixel - offset) < IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x)) ^ invert) {
-                            pixel = COLOR_BINARY_MAX;
-                        } else {
-                            pixel = COLOR_BINARY_MIN;
-                        }
-                    }
+    for (int j = -h->ksize; j <= h->ksize; j++) {
+        sum += VEC_LOAD(vec_u16_t, h->col_coarse + (rank_clamp(j, h->w) * RANK_COARSE_BINS));
+    }
 
-                    IMAGE_PUT_BINARY_PIXEL_FAST(buf_row_ptr, x, pixel);
-                }
+    VEC_STORE(h->coarse, sum);
 
-                if (y >= ksize) {
-                    // Transfer buffer lines...
-                    memcpy(IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, (y - ksize)),
-                           IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(&buf, ((y - ksize) % brows)),
-                           IMAGE_BINARY_LINE_LEN_BYTES(img));
-                }
-            }
+    for (int i = 0; i < RANK_COARSE_BINS; i++) {
+        h->last[i] = -0x10000; // Forces a rebuild.
+    }
+}
 
-            // Copy any remaining lines from the buffer image...
-            for (int y = IM_MAX(img->h - ksize, 0), yy = img->h; y < yy; y++) {
-                memcpy(IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, y),
-                       IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(&buf, (y % brows)),
-                       IMAGE_BINARY_LINE_LEN_BYTES(img));
-            }
+// Moves the kernel from x - 1 to x.
+static inline void rank_hist_slide(rank_hist_t *h, int x) {
+    int add = rank_clamp(x + h->ksize, h->w);
+    int sub = rank_clamp(x - h->ksize - 1, h->w);
 
-            fb_free();
-            break;
-        }
-        case PIXFORMAT_GRAYSCALE: {
-            buf.data = fb_alloc(IMAGE_GRAYSCALE_LINE_LEN_BYTES(img) * brows, FB_ALLOC_NO_HINT);
+    if (add != sub) {
+        vec_u16_t sum = VEC_LOAD(vec_u16_t, h->coarse);
+        sum += VEC_LOAD(vec_u16_t, h->col_coarse + (add * RANK_COARSE_BINS));
+        sum -= VEC_LOAD(vec_u16_t, h->col_coarse + (sub * RANK_COARSE_BINS));
+        VEC_STORE(h->coarse, sum);
+    }
+}
 
-            for (int y = 0, yy = img->h; y < yy; y++) {
-                int pixel, acc = 0;
-                uint8_t *row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y);
-                uint8_t *buf_row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(&buf, (y % brows));
+// Returns the fine bins of coarse bin c at column x, either by sliding the segment from where it
+// was last used or by summing the column segments when that's cheaper.
+static const uint16_t *rank_hist_segment(rank_hist_t *h, int x, int c) {
+    uint16_t *seg = h->fine + (c * RANK_SEGMENT_BINS);
+    const uint16_t *col = h->col_fine + (c * RANK_SEGMENT_BINS);
+    vec_u16_t sum = {0};
 
-                for (int x = 0, xx = img->w; x < xx; x++) {
-                    if (mask && (!image_get_mask_pixel(mask, x, y))) {
-                        IMAGE_PUT_GRAYSCALE_PIXEL_FAST(buf_row_ptr, x, IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x));
-                        continue; // Short circuit.
-                    }
-                    if (!mask && x > ksize && x < img->w - ksize && y >= ksize && y < img->h - ksize) {
-                        for (int j = -ksize; j <= ksize; j++) {
-                            uint8_t *k_row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y + j);
-                            acc -= IMAGE_GET_GRAYSCALE_PIXEL_FAST(k_row_ptr, x - ksize - 1);
-                            acc += IMAGE_GET_GRAYSCALE_PIXEL_FAST(k_row_ptr, x + ksize);
-                        }
-                    } else {
-                        acc = 0;
-                        for (int j = -ksize; j <= ksize; j++) {
-                            uint8_t *k_row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img,
-                                                                                       IM_MIN(IM_MAX(y + j, 0), (img->h - 1)));
+    if ((x - h->last[c]) > h->ksize) {
+        for (int j = x - h->ksize; j <= (x + h->ksize); j++) {
+            sum += VEC_LOAD(vec_u16_t, col + (rank_clamp(j, h->w) * RANK_FINE_BINS));
+        }
+    } else {
+        sum = VEC_LOAD(vec_u16_t, seg);
 
-                            for (int k = -ksize; k <= ksize; k++) {
-                                acc += IMAGE_GET_GRAYSCALE_PIXEL_FAST(k_row_ptr,
-                                                                      IM_MIN(IM_MAX(x + k, 0), (img->w - 1)));
-                            }
-                        }
-                    }
+        for (int j = h->last[c] + 1; j <= x; j++) {
+            sum += VEC_LOAD(vec_u16_t, col + (rank_clamp(j + h->ksize, h->w) * RANK_FINE_BINS));
+            sum -= VEC_LOAD(vec_u16_t, col + (rank_clamp(j - h->ksize - 1, h->w) * RANK_FINE_BINS));
+        }
+    }
 
-                    pixel = (int) ((acc * over32_n) >> 16);
+    VEC_STORE(seg, sum);
+    h->last[c] = x;
+    return seg;
+}
 
-                    if (threshold) {
-                        if (((pixel - offset) < IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x)) ^ invert) {
-                            pixel = COLOR_GRAYSCALE_BINARY_MAX;
-                        } else {
-                            pixel = COLOR_GRAYSCALE_BINARY_MIN;
-                        }
-                    }
+// Returns the k-th smallest (0 based) value in the kernel.
+static int rank_hist_select(rank_hist_t *h, int x, int k) {
+    int c = 0, i = 0;
 
-                    IMAGE_PUT_GRAYSCALE_PIXEL_FAST(buf_row_ptr, x, pixel);
-                }
+    for (; k >= h->coarse[c]; c++) {
+        k -= h->coarse[c];
+    }
 
-                if (y >= ksize) {
-                    // Transfer buffer lines...
-                    memcpy(IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, (y - ksize)),
-                           IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(&buf, ((y - ksize) % brows)),
-                           IMAGE_GRAYSCALE_LINE_LEN_BYTES(img));
-                }
-            }
+    const uint16_t *seg = rank_hist_segment(h, x, c);
 
-            // Copy any remaining lines from the buffer image...
-            for (int y = IM_MAX(img->h - ksize, 0), yy = img->h; y < yy; y++) {
-                memcpy(IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y),
-                       IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(&buf, (y % brows)),
-                       IMAGE_GRAYSCALE_LINE_LEN_BYTES(img));
-            }
+    for (; k >= seg[i]; i++) {
+        k -= seg[i];
+    }
 
-            fb_free();
-            break;
-        }
-        case PIXFORMAT_RGB565: {
-            int pixel, r, g, b, r_acc, g_acc, b_acc;
-            buf.data = fb_alloc(IMAGE_RGB565_LINE_LEN_BYTES(img) * brows, FB_ALLOC_NO_HINT);
+    return (c * RANK_SEGMENT_BINS) + i;
+}
 
-            for (int y = 0, yy = img->h; y < yy; y++) {
-                uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y);
-                uint16_t *buf_row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(&buf, (y % brows));
+// Returns the most common value in the kernel (the smallest one on ties). Every bin is needed
+// here, so all fine bins in use are brought to x (usually a one column slide, a rebuild after
+// masked pixels) and reduced with a lane-wise max.
+static int rank_hist_mode(rank_hist_t *h, int x) {
+    vec_u16_t max = {0};
 
-                r_acc = g_acc = b_acc = 0;
-                for (int x = 0, xx = img->w; x < xx; x++) {
-                    if (mask && (!image_get_mask_pixel(mask, x, y))) {
-                        IMAGE_PUT_RGB565_PIXEL_FAST(buf_row_ptr, x, IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x));
-                        continue; // Short circuit.
-                    }
-                    if (!mask && x > ksize && x < img->w - ksize && y >= ksize && y < img->h - ksize) {
-                        for (int j = -ksize; j <= ksize; j++) {
-                            uint16_t *k_row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y + j);
-                            // subtract last left-most pixel from the sums
-                            pixel = IMAGE_GET_RGB565_PIXEL_FAST(k_row_ptr, x - ksize - 1);
-                            r_acc -= COLOR_RGB565_TO_R5(pixel);
-                            g_acc -= COLOR_RGB565_TO_G6(pixel);
-                            b_acc -= COLOR_RGB565_TO_B5(pixel);
-                            // add new right edge pixel to the sums
-                            pixel = IMAGE_GET_RGB565_PIXEL_FAST(k_row_ptr, x + ksize);
-                            r_acc += COLOR_RGB565_TO_R5(pixel);
-                            g_acc += COLOR_RGB565_TO_G6(pixel);
-                            b_acc += COLOR_RGB565_TO_B5(pixel);
-                        }
-                    } else {
-                        // check bounds and do full sum calculations
-                        r_acc = g_acc = b_acc = 0;
-                        for (int j = -ksize; j <= ksize; j++) {
-                            uint16_t *k_row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img,
-                                                                                     IM_MIN(IM_MAX(y + j, 0), (img->h - 1)));
+    for (int c = 0; c < h->segments; c++) {
+        vec_u16_t seg = VEC_LOAD(vec_u16_t, rank_hist_segment(h, x, c));
+        vec_u16_t gt = (vec_u16_t) (seg > max);
+        max = (seg & gt) | (max & ~gt);
+    }
 
-                            for (int k = -ksize; k <= ksize; k++) {
-                                pixel = IMAGE_GET_RGB565_PIXEL_FAST(k_row_ptr,
-                                                                    IM_MIN(IM_MAX(x + k, 0), (img->w - 1)));
-                                r_acc += COLOR_RGB565_TO_R5(pixel);
-                                g_acc += COLOR_RGB565_TO_G6(pixel);
-                                b_acc += COLOR_RGB565_TO_B5(pixel);
-                            }
-                        }
-                    }
-                    int pixel;
-                    r = (int) ((r_acc * over32_n) >> 16);
-                    g = (int) ((g_acc * over32_n) >> 16);
-                    b = (int) ((b_acc * over32_n) >> 16);
-                    pixel = COLOR_R5_G6_B5_TO_RGB565(r, g, b);
+    uint16_t lanes[VEC_LANES];
+    int best = 0;
+    VEC_STORE(lanes, max);
 
-                    if (threshold) {
-                        if (((COLOR_RGB565_TO_Y(pixel) - offset) <
-                             COLOR_RGB565_TO_Y(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x))) ^ invert) {
-                            pixel = COLOR_RGB565_BINARY_MAX;
-                        } else {
-                            pixel = COLOR_RGB565_BINARY_MIN;
-                        }
-                    }
+    for (int i = 0; i < VEC_LANES; i++) {
+        best = IM_MAX(best, lanes[i]);
+    }
 
-                    IMAGE_PUT_RGB565_PIXEL_FAST(buf_row_ptr, x, pixel);
-                }
+    for (int i = 0; ; i += RANK_SEGMENT_BINS) {
+        uint64_t any[4];
+        VEC_STORE(any, (vec_u16_t) (VEC_LOAD(vec_u16_t, h->fine + i) == ((uint16_t) best)));
 
-                if (y >= ksize) {
-                    // Transfer buffer lines...
-                    memcpy(IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, (y - ksize)),
-                           IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(&buf, ((y - ksize) % brows)),
-                           IMAGE_RGB565_LINE_LEN_BYTES(img));
+        if (any[0] | any[1] | any[2] | any[3]) {
+            for (int v = i; ; v++) {
+                if (h->fine[v] == best) {
+                    return v;
                 }
             }
+        }
+    }
+}
 
-            // Copy any remaining lines from the buffer image...
-            for (int y = IM_MAX(img->h - ksize, 0), yy = img->h; y < yy; y++) {
-                memcpy(IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y),
-                       IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(&buf, (y % brows)),
-                       IMAGE_RGB565_LINE_LEN_BYTES(img));
-            }
+static void rank_filter_update(rank_hist_t *hist, int channels, image_t *img, int y, uint8_t *scratch, int delta) {
+    const uint8_t *planes[3];
+    int stride = filter_planes(img, y, scratch, planes);
 
-            fb_free();
-            break;
+    for (int c = 0; c < channels; c++) {
+        rank_hist_update(&hist[c], planes[c], stride, delta);
+    }
+}
+
+static inline int rank_filter_query(rank_hist_t *h, int x, rank_filter_op_t op, int k, const uint8_t *bias_table) {
+    switch (op) {
+        case RANK_FILTER_PERCENTILE: {
+            return rank_hist_select(h, x, k);
+        }
+        case RANK_FILTER_MODE: {
+            return rank_hist_mode(h, x);
         }
         default: {
-            break;
+            int min = rank_hist_select(h, x, 0);
+            int max = rank_hist_select(h, x, h->n - 1);
+            return min + bias_table[max - min];
         }
     }
 }
-#endif // IMLIB_ENABLE_MEAN
 
-#ifdef IMLIB_ENABLE_MEDIAN
-static uint8_t hist_median(uint8_t *data, int len, const int cutoff) {
-    int i;
-#if defined(ARM_MATH_CM7) || defined(ARM_MATH_CM4)
-    uint32_t oldsum = 0, sum32 = 0;
-
-    for (i = 0; i < len; i += 4) {
-        // work 4 at time with SIMD
-        sum32 = __USADA8(*(uint32_t *) &data[i], 0, sum32);
-        if (sum32 >= cutoff) {
-            // within this group
-            while (oldsum < cutoff && i < len) {
-                oldsum += data[i++];
-            }
-            break;
-        } // if we're at the last 4 values
-        oldsum = sum32;
-    } // for each group of 4 elements
-#else // generic C version
-    int sum = 0;
-    for (i = 0; i < len && sum < cutoff; i++) {
-        sum += data[i];
+// GRAYSCALE, RGB565 and RGB888 rank filter, param is the percentile or the midpoint bias.
+static void rank_filter(image_t *img, int ksize, rank_filter_op_t op, float param,
+                        bool threshold, int offset, bool invert, image_t *mask) {
+    int w = img->w, h = img->h;
+    int n = ((ksize * 2) + 1) * ((ksize * 2) + 1);
+    int channels = (img->pixfmt == PIXFORMAT_GRAYSCALE) ? 1 : 3;
+    int bpp = (img->pixfmt == PIXFORMAT_GRAYSCALE) ? 1 : ((img->pixfmt == PIXFORMAT_RGB565) ? 2 : 3);
+    int line_len = w * bpp;
+    // Output rows are buffered until the column histograms no longer need the input rows.
+    int brows = ksize + 2;
+    int k = (op == RANK_FILTER_PERCENTILE) ? fast_floorf(param * (n - 1)) : 0;
+
+    if (n > UINT16_MAX) {
+        mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("KernelSize is too large!"));
     }
-#endif
-    return i - 1;
-} /* hist_median() */
 
-void imlib_median_filter(image_t *img, const int ksize, float percentile, bool threshold, int offset, bool invert,
-                         image_t *mask) {
-    int brows = ksize + 1;
-    image_t buf;
-    buf.w = img->w;
-    buf.h = brows;
-    buf.pixfmt = img->pixfmt;
+    uint8_t *bias_table = fb_alloc(256, FB_ALLOC_NO_HINT);
+    rank_hist_t *hist = fb_alloc(channels * sizeof(rank_hist_t), FB_ALLOC_NO_HINT);
+    uint16_t *bins = fb_alloc0(channels * w * (RANK_COARSE_BINS + RANK_FINE_BINS) * sizeof(uint16_t),
+                               FB_ALLOC_NO_HINT);
+    uint8_t *scratch = fb_alloc(w * 3, FB_ALLOC_NO_HINT);
+    uint8_t *buf = fb_alloc(line_len * brows, FB_ALLOC_NO_HINT);
 
-    const int n = ((ksize * 2) + 1) * ((ksize * 2) + 1);
-    const int median_cutoff = fast_floorf(percentile * (float) n);
+    if (op == RANK_FILTER_MIDPOINT) {
+        for (int i = 0; i < 256; i++) {
+            bias_table[i] = (uint8_t) fast_floorf((float) i * param);
+        }
+    }
 
-    switch (img->pixfmt) {
-        case PIXFORMAT_BINARY: {
-            buf.data = fb_alloc(IMAGE_BINARY_LINE_LEN_BYTES(img) * brows, FB_ALLOC_NO_HINT);
-            int sum = 0;
+    for (int c = 0; c < channels; c++) {
+        hist[c].w = w;
+        hist[c].ksize = ksize;
+        hist[c].n = n;
+        hist[c].segments = RANK_COARSE_BINS;
 
-            for (int y = 0, yy = img->h; y < yy; y++) {
-                uint32_t *row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, y);
-                uint32_t *buf_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(&buf, (y % brows));
+        if (img->pixfmt == PIXFORMAT_RGB565) {
+            hist[c].segments = (((c == 1) ? COLOR_G6_MAX : COLOR_R5_MAX) / RANK_SEGMENT_BINS) + 1;
+        }
+        hist[c].col_coarse = bins + (c * w * (RANK_COARSE_BINS + RANK_FINE_BINS));
+        hist[c].col_fine = hist[c].col_coarse + (w * RANK_COARSE_BINS);
+    }
 
-                for (int x = 0, xx = img->w; x < xx; x++) {
-                    if (mask && (!image_get_mask_pixel(mask, x, y))) {
-                        IMAGE_PUT_BINARY_PIXEL_FAST(buf_row_ptr, x, IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x));
-                        continue; // Short circuit.
-                    }
-                    if (!mask && x > ksize && x < img->w - ksize && y >= ksize && y < img->h - ksize) {
-                        for (int j = -ksize; j <= ksize; j++) {
-                            uint32_t *k_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, y + j);
-                            sum -= IMAGE_GET_BINARY_PIXEL_FAST(k_row_ptr, x - ksize - 1);
-                            sum += IMAGE_GET_BINARY_PIXEL_FAST(k_row_ptr, x + ksize);
-                        }
-                    } else {
-                        sum = 0;
-                        for (int j = -ksize; j <= ksize; j++) {
-                            uint32_t *k_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img,
-                                                                                     IM_MIN(IM_MAX(y + j, 0), (img->h - 1)));
+    for (int j = -ksize; j <= ksize; j++) {
+        rank_filter_update(hist, channels, img, rank_clamp(j, h), scratch, 1);
+    }
 
-                            for (int k = -ksize; k <= ksize; k++) {
-                                sum += IMAGE_GET_BINARY_PIXEL_FAST(k_row_ptr,
-                                                                   IM_MIN(IM_MAX(x + k, 0), (img->w - 1)));
-                            }
-                        }
-                    }
-                    int pixel = (sum >= median_cutoff);
+    for (int y = 0; y < h; y++) {
+        if (y) {
+            int add = rank_clamp(y + ksize, h);
+            int sub = rank_clamp(y - ksize - 1, h);
+
+            if (add != sub) {
+                rank_filter_update(hist, channels, img, sub, scratch, -1);
+                rank_filter_update(hist, channels, img, add, scratch, 1);
+            }
+        }
+
+        if (y > ksize) {
+            // Transfer buffer lines...
+            memcpy(((uint8_t *) img->data) + ((y - ksize - 1) * line_len),
+                   buf + (((y - ksize - 1) % brows) * line_len), line_len);
+        }
+
+        for (int c = 0; c < channels; c++) {
+            rank_hist_row_start(&hist[c]);
+        }
+
+        uint8_t *row_ptr = ((uint8_t *) img->data) + (y * line_len);
+        uint8_t *buf_row_ptr = buf + ((y % brows) * line_len);
+
+        for (int x = 0; x < w; x++) {
+            // The mode slides its fine bins itself and doesn't use the coarse bins.
+            if (x && (op != RANK_FILTER_MODE)) {
+                for (int c = 0; c < channels; c++) {
+                    rank_hist_slide(&hist[c], x);
+                }
+            }
+
+            if (mask && (!image_get_mask_pixel(mask, x, y))) {
+                memcpy(buf_row_ptr + (x * bpp), row_ptr + (x * bpp), bpp);
+                continue; // Short circuit.
+            }
+
+            switch (img->pixfmt) {
+                case PIXFORMAT_GRAYSCALE: {
+                    int pixel = rank_filter_query(&hist[0], x, op, k, bias_table);
 
                     if (threshold) {
-                        if (((pixel - offset) < IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x)) ^ invert) {
-                            pixel = COLOR_BINARY_MAX;
+                        if (((pixel - offset) < row_ptr[x]) ^ invert) {
+                            pixel = COLOR_GRAYSCALE_BINARY_MAX;
                         } else {
-                            pixel = COLOR_BINARY_MIN;
+                            pixel = COLOR_GRAYSCALE_BINARY_MIN;
                         }
                     }
 
-                    IMAGE_PUT_BINARY_PIXEL_FAST(buf_row_ptr, x, pixel);
+                    buf_row_ptr[x] = pixel;
+                    break;
                 }
-
-                if (y >= ksize) {
-                    // Transfer buffer lines...
-                    memcpy(IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, (y - ksize)),
-                           IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(&buf, ((y - ksize) % brows)),
-                           IMAGE_BINARY_LINE_LEN_BYTES(img));
-                }
-            }
-
-            // Copy any remaining lines from the buffer image...
-            for (int y = IM_MAX(img->h - ksize, 0), yy = img->h; y < yy; y++) {
-                memcpy(IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, y),
-                       IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(&buf, (y % brows)),
-                       IMAGE_BINARY_LINE_LEN_BYTES(img));
-            }
-
-            fb_free();
-            break;
-        }
-        case PIXFORMAT_GRAYSCALE: {
-            buf.data = fb_alloc(IMAGE_GRAYSCALE_LINE_LEN_BYTES(img) * brows, FB_ALLOC_NO_HINT);
-            uint8_t *data = fb_alloc(64, FB_ALLOC_NO_HINT);
-            uint8_t pixel;
-            for (int y = 0, yy = img->h; y < yy; y++) {
-                uint8_t *row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y);
-                uint8_t *buf_row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(&buf, (y % brows));
-
-                for (int x = 0, xx = img->w; x < xx; x++) {
-                    if (mask && (!image_get_mask_pixel(mask, x, y))) {
-                        IMAGE_PUT_GRAYSCALE_PIXEL_FAST(buf_row_ptr, x, IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x));
-                        continue; // Short circuit.
-                    }
-
-                    if (!mask && x > ksize && x < img->w - ksize && y >= ksize && y < img->h - ksize) {
-                        // update histogram edges
-                        for (int j = -ksize; j <= ksize; j++) {
-                            uint8_t *k_row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y + j);
-                            pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(k_row_ptr, x - ksize - 1);
-                            data[pixel >> 2]--; // remove old pixels
-                            pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(k_row_ptr, x + ksize);
-                            data[pixel >> 2]++; // add new pixels
-                        } // for j
-                    } else {
-                        // slow way
-                        memset(data, 0, 64);
-                        for (int j = -ksize; j <= ksize; j++) {
-                            uint8_t *k_row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img,
-                                                                                       IM_MIN(IM_MAX(y + j, 0), (img->h - 1)));
-
-                            for (int k = -ksize; k <= ksize; k++) {
-                                pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(k_row_ptr,
-                                                                       IM_MIN(IM_MAX(x + k, 0), (img->w - 1)));
-                                data[pixel >> 2]++;
-                            }
-                        }
-                    }
-
-                    pixel = hist_median(data, 64, median_cutoff); // find the median
-                    pixel <<= 2; // scale it back up
-                    if (threshold) {
-                        if (((pixel - offset) < IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x)) ^ invert) {
-                            pixel = COLOR_GRAYSCALE_BINARY_MAX;
-                        } else {
-                            pixel = COLOR_GRAYSCALE_BINARY_MIN;
-                        }
-                    }
-
-                    IMAGE_PUT_GRAYSCALE_PIXEL_FAST(buf_row_ptr, x, pixel);
-                }
-
-                if (y >= ksize) {
-                    // Transfer buffer lines...
-                    memcpy(IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, (y - ksize)),
-                           IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(&buf, ((y - ksize) % brows)),
-                           IMAGE_GRAYSCALE_LINE_LEN_BYTES(img));
-                }
-            }
-
-            // Copy any remaining lines from the buffer image...
-            for (int y = IM_MAX(img->h - ksize, 0), yy = img->h; y < yy; y++) {
-                memcpy(IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y),
-                       IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(&buf, (y % brows)),
-                       IMAGE_GRAYSCALE_LINE_LEN_BYTES(img));
-            }
-
-            fb_free();
-            fb_free();
-            break;
-        }
-        case PIXFORMAT_RGB565: {
-            buf.data = fb_alloc(IMAGE_RGB565_LINE_LEN_BYTES(img) * brows, FB_ALLOC_NO_HINT);
-            uint8_t *r_data = fb_alloc(32, FB_ALLOC_NO_HINT);
-            uint8_t *g_data = fb_alloc(64, FB_ALLOC_NO_HINT);
-            uint8_t *b_data = fb_alloc(32, FB_ALLOC_NO_HINT);
-            uint8_t r, g, b;
-            for (int y = 0, yy = img->h; y < yy; y++) {
-                uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y);
-                uint16_t *buf_row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(&buf, (y % brows));
-
-                for (int x = 0, xx = img->w; x < xx; x++) {
-                    if (mask && (!image_get_mask_pixel(mask, x, y))) {
-                        IMAGE_PUT_RGB565_PIXEL_FAST(buf_row_ptr, x, IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x));
-                        continue; // Short circuit.
-                    }
-
-
-                    if (!mask && x > ksize && x < img->w - ksize && y >= ksize && y < img->h - ksize) {
-                        for (int j = -ksize; j <= ksize; j++) {
-                            uint16_t *k_row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y + j);
-                            int pixel = IMAGE_GET_RGB565_PIXEL_FAST(k_row_ptr, x - ksize - 1);
-                            r_data[COLOR_RGB565_TO_R5(pixel)]--; // remove left pixel
-                            g_data[COLOR_RGB565_TO_G6(pixel)]--;
-                            b_data[COLOR_RGB565_TO_B5(pixel)]--;
-                            pixel = IMAGE_GET_RGB565_PIXEL_FAST(k_row_ptr, x + ksize);
-                            r_data[COLOR_RGB565_TO_R5(pixel)]++; // add right pixel
-                            g_data[COLOR_RGB565_TO_G6(pixel)]++;
-                            b_data[COLOR_RGB565_TO_B5(pixel)]++;
-                        }
-                    } else {
-                        // need to check bounds
-                        memset(r_data, 0, 32); memset(g_data, 0, 64); memset(b_data, 0, 32);
-                        for (int j = -ksize; j <= ksize; j++) {
-                            uint16_t *k_row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img,
-                                                                                     IM_MIN(IM_MAX(y + j, 0), (img->h - 1)));
-
-                            for (int k = -ksize; k <= ksize; k++) {
-                                int pixel = IMAGE_GET_RGB565_PIXEL_FAST(k_row_ptr,
-                                                                        IM_MIN(IM_MAX(x + k, 0), (img->w - 1)));
-                                r_data[COLOR_RGB565_TO_R5(pixel)]++;
-                                g_data[COLOR_RGB565_TO_G6(pixel)]++;
-                                b_data[COLOR_RGB565_TO_B5(pixel)]++;
-                            }
-                        }
-                    }
-
-                    r = hist_median(r_data, 32, median_cutoff);
-                    g = hist_median(g_data, 64, median_cutoff);
-                    b = hist_median(b_data, 32, median_cutoff);
-
-                    int pixel = COLOR_R5_G6_B5_TO_RGB565(r, g, b);
+                case PIXFORMAT_RGB565: {
+                    int r = rank_filter_query(&hist[0], x, op, k, bias_table);
+                    int g = rank_filter_query(&hist[1], x, op, k, bias_table);
+                    int b = rank_filter_query(&hist[2], x, op, k, bias_table);
+                    int pixel = COLOR_R5_G6_B5_TO_RGB565(r, g, b);
 
                     if (threshold) {
                         if (((COLOR_RGB565_TO_Y(pixel) - offset) <
-                             COLOR_RGB565_TO_Y(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x))) ^ invert) {
+                             COLOR_RGB565_TO_Y(((uint16_t *) row_ptr)[x])) ^ invert) {
                             pixel = COLOR_RGB565_BINARY_MAX;
                         } else {
                             pixel = COLOR_RGB565_BINARY_MIN;
                         }
                     }
 
-                    IMAGE_PUT_RGB565_PIXEL_FAST(buf_row_ptr, x, pixel);
-                }
-
-                if (y >= ksize) {
-                    // Transfer buffer lines...
-                    memcpy(IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, (y - ksize)),
-                           IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(&buf, ((y - ksize) % brows)),
-                           IMAGE_RGB565_LINE_LEN_BYTES(img));
+                    ((uint16_t *) buf_row_ptr)[x] = pixel;
+                    break;
                 }
-            }
-
-            // Copy any remaining lines from the buffer image...
-            for (int y = IM_MAX(img->h - ksize, 0), yy = img->h; y < yy; y++) {
-                memcpy(IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y),
-                       IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(&buf, (y % brows)),
-                       IMAGE_RGB565_LINE_LEN_BYTES(img));
-            }
-
-            fb_free();
-            fb_free();
-            fb_free();
-            fb_free();
-            break;
-        }
-        default: {
-            break;
-        }
-    }
-}
-#endif // IMLIB_ENABLE_MEDIAN
-
-#ifdef IMLIB_ENABLE_MODE
-static uint8_t find_mode(uint8_t *bins, int len) {
-    int i, j;
-    uint8_t mode = 0, mcount = 0;
-    for (i = 0; i < len; i += 4) {
-        if (*(uint32_t *) &bins[i] == 0) {
-            continue; // skip empty bins quickly
-        }
-        for (j = i; j < i + 4; j++) {
-            if (bins[j] > mcount) {
-                mcount = bins[j];
-                mode = j;
-            }
-        }
-    }
-    return mode;
-} /* find_mode() */
-
-void imlib_mode_filter(image_t *img, const int ksize, bool threshold, int offset, bool invert, image_t *mask) {
-    int brows = ksize + 1;
-    image_t buf;
-    buf.w = img->w;
-    buf.h = brows;
-    buf.pixfmt = img->pixfmt;
-    const uint8_t n2 = (((ksize * 2) + 1) * ((ksize * 2) + 1)) / 2;
-    switch (img->pixfmt) {
-        case PIXFORMAT_BINARY: {
-            buf.data = fb_alloc(IMAGE_BINARY_LINE_LEN_BYTES(img) * brows, FB_ALLOC_NO_HINT);
-            int bins = 0;
-
-            for (int y = 0, yy = img->h; y < yy; y++) {
-                uint32_t *row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, y);
-                uint32_t *buf_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(&buf, (y % brows));
-
-                for (int x = 0, xx = img->w; x < xx; x++) {
-                    if (mask && (!image_get_mask_pixel(mask, x, y))) {
-                        IMAGE_PUT_BINARY_PIXEL_FAST(buf_row_ptr, x, IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x));
-                        continue; // Short circuit.
-                    }
-                    if (!mask && x > ksize && x < img->w - ksize && y >= ksize && y < img->h - ksize) {
-                        for (int j = -ksize; j <= ksize; j++) {
-                            uint32_t *k_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, y + j);
-                            bins -= IMAGE_GET_BINARY_PIXEL_FAST(k_row_ptr, x - ksize - 1);
-                            bins += IMAGE_GET_BINARY_PIXEL_FAST(k_row_ptr, x + ksize);
-                        }
-                    } else {
-                        bins = 0;
-                        for (int j = -ksize; j <= ksize; j++) {
-                            uint32_t *k_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img,
-                                                                                     IM_MIN(IM_MAX(y + j, 0), (img->h - 1)));
-                            for (int k = -ksize; k <= ksize; k++) {
-                                bins += IMAGE_GET_BINARY_PIXEL_FAST(k_row_ptr,
-                                                                    IM_MIN(IM_MAX(x + k, 0), (img->w - 1)));
-                            }
-                        }
-                    }
-
-                    uint8_t pixel = (bins > n2);
+                default: {
+                    int r = rank_filter_query(&hist[0], x, op, k, bias_table);
+                    int g = rank_filter_query(&hist[1], x, op, k, bias_table);
+                    int b = rank_filter_query(&hist[2], x, op, k, bias_table);
+                    uint8_t *src = row_ptr + (x * 3), *dst = buf_row_ptr + (x * 3);
 
                     if (threshold) {
-                        if (((pixel - offset) < IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x)) ^ invert) {
-                            pixel = COLOR_BINARY_MAX;
+                        if (((COLOR_RGB888_TO_Y(r, g, b) - offset) < COLOR_RGB888_TO_Y(src[0], src[1], src[2])) ^ invert) {
+                            r = g = b = 0xFF;
                         } else {
-                            pixel = COLOR_BINARY_MIN;
+                            r = g = b = 0x00;
                         }
                     }
 
-                    IMAGE_PUT_BINARY_PIXEL_FAST(buf_row_ptr, x, pixel);
-                }
-
-                if (y >= ksize) {
-                    // Transfer buffer lines...
-                    memcpy(IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, (y - ksize)),
-                           IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(&buf, ((y - ksize) % brows)),
-                           IMAGE_BINARY_LINE_LEN_BYTES(img));
-                }
-            }
-
-            // Copy any remaining lines from the buffer image...
-            for (int y = IM_MAX(img->h - ksize, 0), yy = img->h; y < yy; y++) {
-                memcpy(IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, y),
-                       IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(&buf, (y % brows)),
-                       IMAGE_BINARY_LINE_LEN_BYTES(img));
-            }
-
-            fb_free();
-            fb_free();
-            break;
-        }
-        case PIXFORMAT_GRAYSCALE: {
-            buf.data = fb_alloc(IMAGE_GRAYSCALE_LINE_LEN_BYTES(img) * brows, FB_ALLOC_NO_HINT);
-            uint8_t *bins = fb_alloc((COLOR_GRAYSCALE_MAX - COLOR_GRAYSCALE_MIN + 1), FB_ALLOC_NO_HINT);
-
-            for (int y = 0, yy = img->h; y < yy; y++) {
-                uint8_t *row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y);
-                uint8_t *buf_row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(&buf, (y % brows));
-                uint8_t pixel = 0, mode = 0;
-                int mcount = -1;
-                for (int x = 0, xx = img->w; x < xx; x++) {
-                    if (mask && (!image_get_mask_pixel(mask, x, y))) {
-                        IMAGE_PUT_GRAYSCALE_PIXEL_FAST(buf_row_ptr, x, IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x));
-                        continue; // Short circuit.
-                    }
-                    if (!mask && x > ksize && x < img->w - ksize && y >= ksize && y < img->h - ksize) {
-                        for (int j = -ksize; j <= ksize; j++) {
-                            uint8_t m, *k_row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y + j);
-                            pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(k_row_ptr, x - ksize - 1);
-                            m = --bins[pixel];
-                            if (pixel == mode) {
-                                if (m < n2) {
-                                    mcount = 256; // need to search later
-                                } else {
-                                    mcount = m; // we're still the mode
-                                }
-                            }
-                            pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(k_row_ptr, x + ksize);
-                            m = ++bins[pixel];
-                            if (m > mcount) {
-                                mcount = m;
-                                mode = pixel;
-                            }
-                        }
-                        if (mcount == 256) {
-                            // need to find max
-                            mode = find_mode(bins, 256);
-                            mcount = bins[mode];
-                        }
-                    } else {
-                        // slow way
-                        mcount = -1;
-                        memset(bins, 0, (COLOR_GRAYSCALE_MAX - COLOR_GRAYSCALE_MIN + 1));
-                        for (int j = -ksize; j <= ksize; j++) {
-                            uint8_t *k_row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img,
-                                                                                       IM_MIN(IM_MAX(y + j, 0), (img->h - 1)));
-
-                            for (int k = -ksize; k <= ksize; k++) {
-                                pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(k_row_ptr,
-                                                                       IM_MIN(IM_MAX(x + k, 0), (img->w - 1)));
-                                bins[pixel]++;
-
-                                if (bins[pixel] > mcount) {
-                                    mcount = bins[pixel];
-                                    mode = pixel;
-                                }
-                            }
-                        }
-                    }
-                    pixel = mode;
-
-                    if (threshold) {
-                        if (((pixel - offset) < IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x)) ^ invert) {
-                            pixel = COLOR_GRAYSCALE_BINARY_MAX;
-                        } else {
-                            pixel = COLOR_GRAYSCALE_BINARY_MIN;
-                        }
-                    }
-
-                    IMAGE_PUT_GRAYSCALE_PIXEL_FAST(buf_row_ptr, x, pixel);
-                }
-
-                if (y >= ksize) {
-                    // Transfer buffer lines...
-                    memcpy(IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, (y - ksize)),
-                           IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(&buf, ((y - ksize) % brows)),
-                           IMAGE_GRAYSCALE_LINE_LEN_BYTES(img));
-                }
-            }
-
-            // Copy any remaining lines from the buffer image...
-            for (int y = IM_MAX(img->h - ksize, 0), yy = img->h; y < yy; y++) {
-                memcpy(IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y),
-                       IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(&buf, (y % brows)),
-                       IMAGE_GRAYSCALE_LINE_LEN_BYTES(img));
-            }
-
-            fb_free();
-            fb_free();
-            break;
-        }
-        case PIXFORMAT_RGB565: {
-            buf.data = fb_alloc(IMAGE_RGB565_LINE_LEN_BYTES(img) * brows, FB_ALLOC_NO_HINT);
-            uint8_t *r_bins = fb_alloc((COLOR_R5_MAX - COLOR_R5_MIN + 1), FB_ALLOC_NO_HINT);
-            uint8_t *g_bins = fb_alloc((COLOR_G6_MAX - COLOR_G6_MIN + 1), FB_ALLOC_NO_HINT);
-            uint8_t *b_bins = fb_alloc((COLOR_B5_MAX - COLOR_B5_MIN + 1), FB_ALLOC_NO_HINT);
-            int r_pixel, g_pixel, b_pixel;
-
-            for (int y = 0, yy = img->h; y < yy; y++) {
-                uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y);
-                uint16_t *buf_row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(&buf, (y % brows));
-                int r_mcount = 0, g_mcount = 0, b_mcount = 0;
-                int pixel, r_mode, g_mode, b_mode;
-                r_mode = g_mode = b_mode = 0;
-                for (int x = 0, xx = img->w; x < xx; x++) {
-                    if (mask && (!image_get_mask_pixel(mask, x, y))) {
-                        IMAGE_PUT_RGB565_PIXEL_FAST(buf_row_ptr, x, IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x));
-                        continue; // Short circuit.
-                    }
-
-                    if (!mask && x > ksize && x < img->w - ksize && y >= ksize && y < img->h - ksize) {
-                        for (int j = -ksize; j <= ksize; j++) {
-                            uint16_t *k_row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y + j);
-                            pixel = IMAGE_GET_RGB565_PIXEL_FAST(k_row_ptr, x - ksize - 1);
-                            r_pixel = COLOR_RGB565_TO_R5(pixel);
-                            g_pixel = COLOR_RGB565_TO_G6(pixel);
-                            b_pixel = COLOR_RGB565_TO_B5(pixel);
-                            r_bins[r_pixel]--;
-                            g_bins[g_pixel]--;
-                            b_bins[b_pixel]--;
-                            if (r_pixel == r_mode) {
-                                if (r_bins[r_pixel] < n2) {
-                                    r_mcount = 256; // need to search later
-                                } else {
-                                    r_mcount = r_bins[r_pixel]; // we're still the mode
-                                }
-                            }
-                            if (g_pixel == g_mode) {
-                                if (g_bins[g_pixel] < n2) {
-                                    g_mcount = 256; // need to search later
-                                } else {
-                                    g_mcount = g_bins[g_pixel]; // we're still the mode
-                                }
-                            }
-                            if (b_pixel == b_mode) {
-                                if (b_bins[b_pixel] < n2) {
-                                    b_mcount = 256; // need to search later
-                                } else {
-                                    b_mcount = b_bins[b_pixel]; // we're still the mode
-                                }
-                            }
-
-                            pixel = IMAGE_GET_RGB565_PIXEL_FAST(k_row_ptr, x + ksize);
-                            r_pixel = COLOR_RGB565_TO_R5(pixel);
-                            g_pixel = COLOR_RGB565_TO_G6(pixel);
-                            b_pixel = COLOR_RGB565_TO_B5(pixel);
-                            r_bins[r_pixel]++;
-                            g_bins[g_pixel]++;
-                            b_bins[b_pixel]++;
-                            if (r_bins[r_pixel] > r_mcount) {
-                                r_mcount = r_bins[r_pixel];
-                                r_mode = r_pixel;
-                            }
-
-                            if (g_bins[g_pixel] > g_mcount) {
-                                g_mcount = g_bins[g_pixel];
-                                g_mode = g_pixel;
-                            }
-
-                            if (b_bins[b_pixel] > b_mcount) {
-                                b_mcount = b_bins[b_pixel];
-                                b_mode = b_pixel;
-                            }
-                        } // for j
-                        if (r_mcount == 256) {
-                            // need to find max
-                            r_mode = find_mode(r_bins, 32);
-                            r_mcount = r_bins[r_mode];
-                        }
-                        if (g_mcount == 256) {
-                            // need to find max
-                            g_mode = find_mode(g_bins, 64);
-                            g_mcount = g_bins[g_mode];
-                        }
-                        if (b_mcount == 256) {
-                            // need to find max
-                            b_mode = find_mode(b_bins, 32);
-                            b_mcount = r_bins[b_mode];
-                        }
-                    } else {
-                        // slower way
-                        memset(r_bins, 0, (COLOR_R5_MAX - COLOR_R5_MIN + 1));
-                        memset(g_bins, 0, (COLOR_G6_MAX - COLOR_G6_MIN + 1));
-                        memset(b_bins, 0, (COLOR_B5_MAX - COLOR_B5_MIN + 1));
-                        r_mcount = g_mcount = b_mcount = 0;
-                        for (int j = -ksize; j <= ksize; j++) {
-                            uint16_t *k_row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img,
-                                                                                     IM_MIN(IM_MAX(y + j, 0), (img->h - 1)));
-
-                            for (int k = -ksize; k <= ksize; k++) {
-                                pixel = IMAGE_GET_RGB565_PIXEL_FAST(k_row_ptr,
-                                                                    IM_MIN(IM_MAX(x + k, 0), (img->w - 1)));
-                                r_pixel = COLOR_RGB565_TO_R5(pixel);
-                                g_pixel = COLOR_RGB565_TO_G6(pixel);
-                                b_pixel = COLOR_RGB565_TO_B5(pixel);
-                                r_bins[r_pixel]++;
-                                g_bins[g_pixel]++;
-                                b_bins[b_pixel]++;
-
-                                if (r_bins[r_pixel] > r_mcount) {
-                                    r_mcount = r_bins[r_pixel];
-                                    r_mode = r_pixel;
-                                }
-
-                                if (g_bins[g_pixel] > g_mcount) {
-                                    g_mcount = g_bins[g_pixel];
-                                    g_mode = g_pixel;
-                                }
-
-                                if (b_bins[b_pixel] > b_mcount) {
-                                    b_mcount = b_bins[b_pixel];
-                                    b_mode = b_pixel;
-                                }
-                            } // for k
-                        } // for j
-                    } // slow/fast way
-                    pixel = COLOR_R5_G6_B5_TO_RGB565(r_mode, g_mode, b_mode);
-                    IMAGE_PUT_RGB565_PIXEL_FAST(buf_row_ptr, x, pixel);
-                }
-
-                if (y >= ksize) {
-                    // Transfer buffer lines...
-                    memcpy(IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, (y - ksize)),
-                           IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(&buf, ((y - ksize) % brows)),
-                           IMAGE_RGB565_LINE_LEN_BYTES(img));
-                }
-            }
-
-            // Copy any remaining lines from the buffer image...
-            for (int y = IM_MAX(img->h - ksize, 0), yy = img->h; y < yy; y++) {
-                memcpy(IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y),
-                       IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(&buf, (y % brows)),
-                       IMAGE_RGB565_LINE_LEN_BYTES(img));
-            }
-
-            fb_free();
-            fb_free();
-            fb_free();
-            fb_free();
-            break;
-        }
-        default: {
-            break;
+                    dst[0] = r;
+                    dst[1] = g;
+                    dst[2] = b;
+                    break;
+                }
+            }
         }
     }
+
+    // Copy any remaining lines from the buffer image...
+    for (int y = IM_MAX(h - ksize - 1, 0); y < h; y++) {
+        memcpy(((uint8_t *) img->data) + (y * line_len), buf + ((y % brows) * line_len), line_len);
+    }
+
+    fb_free(); // buf
+    fb_free(); // scratch
+    fb_free(); // bins
+    fb_free(); // hist
+    fb_free(); // bias_table
 }
-#endif // IMLIB_ENABLE_MODE
+#endif // IMLIB_ENABLE_MEDIAN || IMLIB_ENABLE_MODE || IMLIB_ENABLE_MIDPOINT
 
-#ifdef IMLIB_ENABLE_MIDPOINT
-void imlib_midpoint_filter(image_t *img, const int ksize, float bias, bool threshold, int offset, bool invert, image_t *mask) {
+#ifdef IMLIB_ENABLE_MEDIAN
+void imlib_median_filter(image_t *img, const int ksize, float percentile, bool threshold, int offset, bool invert,
+                         image_t *mask) {
     int brows = ksize + 1;
     image_t buf;
     buf.w = img->w;
     buf.h = brows;
     buf.pixfmt = img->pixfmt;
-    uint8_t *u8BiasTable;
-    float max_bias = bias, min_bias = 1.0f - bias;
 
-    u8BiasTable = fb_alloc(256, FB_ALLOC_NO_HINT);
-    for (int i = 0; i < 256; i++) {
-        u8BiasTable[i] = (uint8_t) fast_floorf((float) i * bias);
-    }
+    const int n = ((ksize * 2) + 1) * ((ksize * 2) + 1);
+    // The k-th smallest value (k = floor(percentile * (n - 1)) as in rank_filter()) is set when
+    // at most k pixels are clear.
+    const int median_cutoff = n - fast_floorf(percentile * (float) (n - 1));
 
     switch (img->pixfmt) {
         case PIXFORMAT_BINARY: {
             buf.data = fb_alloc(IMAGE_BINARY_LINE_LEN_BYTES(img) * brows, FB_ALLOC_NO_HINT);
+            int sum = 0;
 
             for (int y = 0, yy = img->h; y < yy; y++) {
                 uint32_t *row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, y);
@@ -988,33 +510,25 @@ void imlib_midpoint_filter(image_t *img, const int ksize, float bias, bool thres
                         IMAGE_PUT_BINARY_PIXEL_FAST(buf_row_ptr, x, IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x));
                         continue; // Short circuit.
                     }
-
-                    int min = COLOR_BINARY_MAX, max = COLOR_BINARY_MIN;
-
-                    if (x >= ksize && x < img->w - ksize && y >= ksize && y < img->h - ksize) {
+                    if (!mask && x > ksize && x < img->w - ksize && y >= ksize && y < img->h - ksize) {
                         for (int j = -ksize; j <= ksize; j++) {
                             uint32_t *k_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, y + j);
-                            for (int k = -ksize; k <= ksize; k++) {
-                                int pixel = IMAGE_GET_BINARY_PIXEL_FAST(k_row_ptr, x + k);
-                                min &= pixel;
-                                max |= pixel;
-                            }
+                            sum -= IMAGE_GET_BINARY_PIXEL_FAST(k_row_ptr, x - ksize - 1);
+                            sum += IMAGE_GET_BINARY_PIXEL_FAST(k_row_ptr, x + ksize);
                         }
                     } else {
+                        sum = 0;
                         for (int j = -ksize; j <= ksize; j++) {
                             uint32_t *k_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img,
                                                                                      IM_MIN(IM_MAX(y + j, 0), (img->h - 1)));
 
                             for (int k = -ksize; k <= ksize; k++) {
-                                int pixel = IMAGE_GET_BINARY_PIXEL_FAST(k_row_ptr,
-                                                                        IM_MIN(IM_MAX(x + k, 0), (img->w - 1)));
-                                min &= pixel;
-                                max |= pixel;
+                                sum += IMAGE_GET_BINARY_PIXEL_FAST(k_row_ptr,
+                                                                   IM_MIN(IM_MAX(x + k, 0), (img->w - 1)));
                             }
                         }
                     }
-
-                    int pixel = fast_floorf((min * min_bias) + (max * max_bias));
+                    int pixel = (sum >= median_cutoff);
 
                     if (threshold) {
                         if (((pixel - offset) < IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x)) ^ invert) {
@@ -1045,191 +559,192 @@ void imlib_midpoint_filter(image_t *img, const int ksize, float bias, bool thres
             fb_free();
             break;
         }
-        case PIXFORMAT_GRAYSCALE: {
-            buf.data = fb_alloc(IMAGE_GRAYSCALE_LINE_LEN_BYTES(img) * brows, FB_ALLOC_NO_HINT);
+        case PIXFORMAT_GRAYSCALE:
+        case PIXFORMAT_RGB565:
+        case PIXFORMAT_RGB888: {
+            rank_filter(img, ksize, RANK_FILTER_PERCENTILE, percentile, threshold, offset, invert, mask);
+            break;
+        }
+        default: {
+            break;
+        }
+    }
+}
+#endif // IMLIB_ENABLE_MEDIAN
+
+#ifdef IMLIB_ENABLE_MODE
+void imlib_mode_filter(image_t *img, const int ksize, bool threshold, int offset, bool invert, image_t *mask) {
+    int brows = ksize + 1;
+    image_t buf;
+    buf.w = img->w;
+    buf.h = brows;
+    buf.pixfmt = img->pixfmt;
+    const uint8_t n2 = (((ksize * 2) + 1) * ((ksize * 2) + 1)) / 2;
+    switch (img->pixfmt) {
+        case PIXFORMAT_BINARY: {
+            buf.data = fb_alloc(IMAGE_BINARY_LINE_LEN_BYTES(img) * brows, FB_ALLOC_NO_HINT);
+            int bins = 0;
 
             for (int y = 0, yy = img->h; y < yy; y++) {
-                uint8_t *row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y);
-                uint8_t *buf_row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(&buf, (y % brows));
+                uint32_t *row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, y);
+                uint32_t *buf_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(&buf, (y % brows));
 
                 for (int x = 0, xx = img->w; x < xx; x++) {
                     if (mask && (!image_get_mask_pixel(mask, x, y))) {
-                        IMAGE_PUT_GRAYSCALE_PIXEL_FAST(buf_row_ptr, x, IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x));
+                        IMAGE_PUT_BINARY_PIXEL_FAST(buf_row_ptr, x, IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x));
                         continue; // Short circuit.
                     }
-
-                    int min = COLOR_GRAYSCALE_MAX, max = COLOR_GRAYSCALE_MIN;
-                    if (x >= ksize && x < img->w - ksize && y >= ksize && y < img->h - ksize) {
+                    if (!mask && x > ksize && x < img->w - ksize && y >= ksize && y < img->h - ksize) {
                         for (int j = -ksize; j <= ksize; j++) {
-                            uint8_t *k_row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y + j);
-                            for (int k = -ksize; k <= ksize; k++) {
-                                int pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(k_row_ptr, x + k);
-                                if (pixel < min) {
-                                    min = pixel;
-                                } else if (pixel > max) {
-                                    max = pixel;
-                                }
-                            }
+                            uint32_t *k_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, y + j);
+                            bins -= IMAGE_GET_BINARY_PIXEL_FAST(k_row_ptr, x - ksize - 1);
+                            bins += IMAGE_GET_BINARY_PIXEL_FAST(k_row_ptr, x + ksize);
                         }
                     } else {
+                        bins = 0;
                         for (int j = -ksize; j <= ksize; j++) {
-                            uint8_t *k_row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img,
-                                                                                       IM_MIN(IM_MAX(y + j, 0), (img->h - 1)));
-
+                            uint32_t *k_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img,
+                                                                                     IM_MIN(IM_MAX(y + j, 0), (img->h - 1)));
                             for (int k = -ksize; k <= ksize; k++) {
-                                int pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(k_row_ptr,
-                                                                           IM_MIN(IM_MAX(x + k, 0), (img->w - 1)));
-                                if (pixel < min) {
-                                    min = pixel;
-                                } else if (pixel > max) {
-                                    max = pixel;
-                                }
+                                bins += IMAGE_GET_BINARY_PIXEL_FAST(k_row_ptr,
+                                                                    IM_MIN(IM_MAX(x + k, 0), (img->w - 1)));
                             }
                         }
                     }
 
-                    int pixel = min + u8BiasTable[max - min];
+                    uint8_t pixel = (bins > n2);
 
                     if (threshold) {
-                        if (((pixel - offset) < IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x)) ^ invert) {
-                            pixel = COLOR_GRAYSCALE_BINARY_MAX;
+                        if (((pixel - offset) < IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x)) ^ invert) {
+                            pixel = COLOR_BINARY_MAX;
                         } else {
-                            pixel = COLOR_GRAYSCALE_BINARY_MIN;
+                            pixel = COLOR_BINARY_MIN;
                         }
                     }
 
-                    IMAGE_PUT_GRAYSCALE_PIXEL_FAST(buf_row_ptr, x, pixel);
+                    IMAGE_PUT_BINARY_PIXEL_FAST(buf_row_ptr, x, pixel);
                 }
 
                 if (y >= ksize) {
                     // Transfer buffer lines...
-                    memcpy(IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, (y - ksize)),
-                           IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(&buf, ((y - ksize) % brows)),
-                           IMAGE_GRAYSCALE_LINE_LEN_BYTES(img));
+                    memcpy(IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, (y - ksize)),
+                           IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(&buf, ((y - ksize) % brows)),
+                           IMAGE_BINARY_LINE_LEN_BYTES(img));
                 }
             }
 
             // Copy any remaining lines from the buffer image...
             for (int y = IM_MAX(img->h - ksize, 0), yy = img->h; y < yy; y++) {
-                memcpy(IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y),
-                       IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(&buf, (y % brows)),
-                       IMAGE_GRAYSCALE_LINE_LEN_BYTES(img));
+                memcpy(IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, y),
+                       IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(&buf, (y % brows)),
+                       IMAGE_BINARY_LINE_LEN_BYTES(img));
             }
 
             fb_free();
             break;
         }
-        case PIXFORMAT_RGB565: {
-            buf.data = fb_alloc(IMAGE_RGB565_LINE_LEN_BYTES(img) * brows, FB_ALLOC_NO_HINT);
+        case PIXFORMAT_GRAYSCALE:
+        case PIXFORMAT_RGB565:
+        case PIXFORMAT_RGB888: {
+            rank_filter(img, ksize, RANK_FILTER_MODE, 0.0f, threshold, offset, invert, mask);
+            break;
+        }
+        default: {
+            break;
+        }
+    }
+}
+#endif // IMLIB_ENABLE_MODE
+
+#ifdef IMLIB_ENABLE_MIDPOINT
+void imlib_midpoint_filter(image_t *img, const int ksize, float bias, bool threshold, int offset, bool invert, image_t *mask) {
+    int brows = ksize + 1;
+    image_t buf;
+    buf.w = img->w;
+    buf.h = brows;
+    buf.pixfmt = img->pixfmt;
+    float max_bias = bias, min_bias = 1.0f - bias;
+
+    switch (img->pixfmt) {
+        case PIXFORMAT_BINARY: {
+            buf.data = fb_alloc(IMAGE_BINARY_LINE_LEN_BYTES(img) * brows, FB_ALLOC_NO_HINT);
 
             for (int y = 0, yy = img->h; y < yy; y++) {
-                uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y);
-                uint16_t *buf_row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(&buf, (y % brows));
+                uint32_t *row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, y);
+                uint32_t *buf_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(&buf, (y % brows));
 
                 for (int x = 0, xx = img->w; x < xx; x++) {
                     if (mask && (!image_get_mask_pixel(mask, x, y))) {
-                        IMAGE_PUT_RGB565_PIXEL_FAST(buf_row_ptr, x, IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x));
+                        IMAGE_PUT_BINARY_PIXEL_FAST(buf_row_ptr, x, IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x));
                         continue; // Short circuit.
                     }
 
-                    int r_min = COLOR_R5_MAX, r_max = COLOR_R5_MIN;
-                    int g_min = COLOR_G6_MAX, g_max = COLOR_G6_MIN;
-                    int b_min = COLOR_B5_MAX, b_max = COLOR_B5_MIN;
+                    int min = COLOR_BINARY_MAX, max = COLOR_BINARY_MIN;
+
                     if (x >= ksize && x < img->w - ksize && y >= ksize && y < img->h - ksize) {
                         for (int j = -ksize; j <= ksize; j++) {
-                            uint16_t *k_row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y + j);
+                            uint32_t *k_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, y + j);
                             for (int k = -ksize; k <= ksize; k++) {
-                                int pixel = IMAGE_GET_RGB565_PIXEL_FAST(k_row_ptr, x + k);
-                                int r_pixel = COLOR_RGB565_TO_R5(pixel);
-                                int g_pixel = COLOR_RGB565_TO_G6(pixel);
-                                int b_pixel = COLOR_RGB565_TO_B5(pixel);
-                                if (r_pixel < r_min) {
-                                    r_min = r_pixel;
-                                } else if (r_pixel > r_max) {
-                                    r_max = r_pixel;
-                                }
-                                if (g_pixel < g_min) {
-                                    g_min = g_pixel;
-                                } else if (g_pixel > g_max) {
-                                    g_max = g_pixel;
-                                }
-                                if (b_pixel < b_min) {
-                                    b_min = b_pixel;
-                                } else if (b_pixel > b_max) {
-                                    b_max = b_pixel;
-                                }
+                                int pixel = IMAGE_GET_BINARY_PIXEL_FAST(k_row_ptr, x + k);
+                                min &= pixel;
+                                max |= pixel;
                             }
                         }
                     } else {
                         for (int j = -ksize; j <= ksize; j++) {
-                            uint16_t *k_row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img,
+                            uint32_t *k_row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img,
                                                                                      IM_MIN(IM_MAX(y + j, 0), (img->h - 1)));
 
                             for (int k = -ksize; k <= ksize; k++) {
-                                int pixel = IMAGE_GET_RGB565_PIXEL_FAST(k_row_ptr,
+                                int pixel = IMAGE_GET_BINARY_PIXEL_FAST(k_row_ptr,
                                                                         IM_MIN(IM_MAX(x + k, 0), (img->w - 1)));
-                                int r_pixel = COLOR_RGB565_TO_R5(pixel);
-                                int g_pixel = COLOR_RGB565_TO_G6(pixel);
-                                int b_pixel = COLOR_RGB565_TO_B5(pixel);
-                                if (r_pixel < r_min) {
-                                    r_min = r_pixel;
-                                } else if (r_pixel > r_max) {
-                                    r_max = r_pixel;
-                                }
-                                if (g_pixel < g_min) {
-                                    g_min = g_pixel;
-                                } else if (g_pixel > g_max) {
-                                    g_max = g_pixel;
-                                }
-                                if (b_pixel < b_min) {
-                                    b_min = b_pixel;
-                                } else if (b_pixel > b_max) {
-                                    b_max = b_pixel;
-                                }
+                                min &= pixel;
+                                max |= pixel;
                             }
                         }
                     }
 
-                    r_min += u8BiasTable[r_max - r_min];
-                    g_min += u8BiasTable[g_max - g_min];
-                    b_min += u8BiasTable[b_max - b_min];
-                    int pixel = COLOR_R5_G6_B5_TO_RGB565(r_min, g_min, b_min);
+                    int pixel = fast_floorf((min * min_bias) + (max * max_bias));
 
                     if (threshold) {
-                        if (((COLOR_RGB565_TO_Y(pixel) - offset) <
-                             COLOR_RGB565_TO_Y(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x))) ^ invert) {
-                            pixel = COLOR_RGB565_BINARY_MAX;
+                        if (((pixel - offset) < IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x)) ^ invert) {
+                            pixel = COLOR_BINARY_MAX;
                         } else {
-                            pixel = COLOR_RGB565_BINARY_MIN;
+                            pixel = COLOR_BINARY_MIN;
                         }
                     }
 
-                    IMAGE_PUT_RGB565_PIXEL_FAST(buf_row_ptr, x, pixel);
+                    IMAGE_PUT_BINARY_PIXEL_FAST(buf_row_ptr, x, pixel);
                 }
 
                 if (y >= ksize) {
                     // Transfer buffer lines...
-                    memcpy(IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, (y - ksize)),
-                           IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(&buf, ((y - ksize) % brows)),
-                           IMAGE_RGB565_LINE_LEN_BYTES(img));
+                    memcpy(IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, (y - ksize)),
+                           IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(&buf, ((y - ksize) % brows)),
+                           IMAGE_BINARY_LINE_LEN_BYTES(img));
                 }
             }
 
             // Copy any remaining lines from the buffer image...
             for (int y = IM_MAX(img->h - ksize, 0), yy = img->h; y < yy; y++) {
-                memcpy(IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y),
-                       IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(&buf, (y % brows)),
-                       IMAGE_RGB565_LINE_LEN_BYTES(img));
+                memcpy(IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, y),
+                       IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(&buf, (y % brows)),
+                       IMAGE_BINARY_LINE_LEN_BYTES(img));
             }
 
             fb_free();
             break;
         }
+        case PIXFORMAT_GRAYSCALE:
+        case PIXFORMAT_RGB565:
+        case PIXFORMAT_RGB888: {
+            rank_filter(img, ksize, RANK_FILTER_MIDPOINT, bias, threshold, offset, invert, mask);
+            break;
+        }
         default: {
             break;
         }
     }
-    fb_free();
 }
 #endif // IMLIB_ENABLE_MIDPOINT
 
@@ -1499,14 +1014,273 @@ static float distance(int x, int y) {
     return fast_sqrtf((x * x) + (y * y));
 }
 
+// Fast mode: a bilateral grid (Chen, Paris and Durand, "Real-time Edge-Aware Image Processing
+// with the Bilateral Grid"). Pixels are splatted into cells about one space sigma wide and one
+// color sigma deep, the grid is blurred with a [1 4 6 4 1] kernel along each axis in fixed point
+// and every pixel is sliced back out with trilinear interpolation, so the cost per pixel doesn't
+// grow with the kernel size. Grid rows are streamed through a small ring, the image is processed
+// top to bottom in place.
+#define BILATERAL_GRID_SLABS        (5)
+#define BILATERAL_GRID_MAX_CELL     (16)
+#define BILATERAL_GRID_MAX_DEPTH    (64)
+
+typedef struct bilateral_grid {
+    int gd;                         // Cells along the intensity axis.
+    int slab_len;                   // Grid row length in (value sum, weight) pairs.
+    uint32_t *slabs;                // BILATERAL_GRID_SLABS splatted and x/z blurred grid rows.
+    uint32_t *blurred[2];           // Fully blurred grid rows (even/odd).
+    float *row;                     // Blurred rows interpolated at the current image row.
+    uint16_t zlut[256];             // Intensity to 8.8 fixed point grid depth.
+} bilateral_grid_t;
+
+static const uint8_t bilateral_grid_kernel[5] = {1, 4, 6, 4, 1};
+
+// Splats image rows [g * cell - cell / 2, g * cell + cell / 2) into slab g and blurs it along x and z.
+static void bilateral_grid_splat(bilateral_grid_t *grid, int channels, image_t *img, int g, int cell,
+                                 const uint16_t *x_cells, int gw, uint8_t *scratch, uint32_t *tmp) {
+    int y_start = IM_MAX((g * cell) - (cell / 2), 0);
+    int y_end = IM_MIN((g * cell) + cell - (cell / 2), img->h);
+
+    for (int c = 0; c < channels; c++) {
+        memset(grid[c].slabs + ((g % BILATERAL_GRID_SLABS) * grid[c].slab_len * 2), 0,
+               grid[c].slab_len * 2 * sizeof(uint32_t));
+    }
+
+    for (int y = y_start; y < y_end; y++) {
+        const uint8_t *planes[3];
+        int stride = filter_planes(img, y, scratch, planes);
+
+        for (int c = 0; c < channels; c++) {
+            uint32_t *slab = grid[c].slabs + ((g % BILATERAL_GRID_SLABS) * grid[c].slab_len * 2);
+            const uint8_t *p = planes[c];
+
+            for (int x = 0, xx = img->w; x < xx; x++, p += stride) {
+                int v = *p;
+                uint32_t *cell_ptr = slab + (((x_cells[x] * grid[c].gd) + ((grid[c].zlut[v] + 128) >> 8)) * 2);
+                cell_ptr[0] += v;
+                cell_ptr[1] += 1;
+            }
+        }
+    }
+
+    for (int c = 0; c < channels; c++) {
+        uint32_t *slab = grid[c].slabs + ((g % BILATERAL_GRID_SLABS) * grid[c].slab_len * 2);
+        int row_len = grid[c].gd * 2;
+
+        // Along x, whole rows of cells at a time.
+        for (int gx = 0; gx < gw; gx++) {
+            uint32_t *dst = tmp + (gx * row_len);
+            memset(dst, 0, row_len * sizeof(uint32_t));
+
+            for (int k = -2; k <= 2; k++) {
+                if (((gx + k) >= 0) && ((gx + k) < gw)) {
+                    const uint32_t *src = slab + ((gx + k) * row_len);
+                    uint32_t w = bilateral_grid_kernel[k + 2];
+
+                    for (int i = 0; i < row_len; i++) {
+                        dst[i] += src[i] * w;
+                    }
+                }
+            }
+        }
+
+        // Along z, back into the slab.
+        for (int gx = 0; gx < gw; gx++) {
+            const uint32_t *src = tmp + (gx * row_len);
+            uint32_t *dst = slab + (gx * row_len);
+
+            for (int gz = 0; gz < grid[c].gd; gz++) {
+                uint32_t v = 0, w = 0;
+
+                for (int k = IM_MAX(-2, -gz), kk = IM_MIN(2, grid[c].gd - 1 - gz); k <= kk; k++) {
+                    v += src[((gz + k) * 2) + 0] * bilateral_grid_kernel[k + 2];
+                    w += src[((gz + k) * 2) + 1] * bilateral_grid_kernel[k + 2];
+                }
+
+                dst[(gz * 2) + 0] = v;
+                dst[(gz * 2) + 1] = w;
+            }
+        }
+    }
+}
+
+// Blurs grid row g along y from slabs g - 2 .. g + 2, slabs at or past splatted are empty.
+static void bilateral_grid_blur(bilateral_grid_t *grid, int channels, int g, int splatted) {
+    for (int c = 0; c < channels; c++) {
+        uint32_t *dst = grid[c].blurred[g & 1];
+        int len = grid[c].slab_len * 2;
+        memset(dst, 0, len * sizeof(uint32_t));
+
+        for (int k = -2; k <= 2; k++) {
+            if (((g + k) >= 0) && ((g + k) < splatted)) {
+                const uint32_t *src = grid[c].slabs + (((g + k) % BILATERAL_GRID_SLABS) * len);
+                uint32_t w = bilateral_grid_kernel[k + 2];
+
+                for (int i = 0; i < len; i++) {
+                    dst[i] += src[i] * w;
+                }
+            }
+        }
+    }
+}
+
+// Slices a pixel out of the interpolated grid row.
+static inline int bilateral_grid_slice(bilateral_grid_t *grid, int gx, float ax, int v) {
+    int z = grid->zlut[v];
+    float az = (z & 0xFF) * (1.0f / 256.0f);
+    const float *c0 = grid->row + (((gx * grid->gd) + (z >> 8)) * 2);
+    const float *c1 = c0 + (grid->gd * 2);
+    float v0 = c0[0] + ((c0[2] - c0[0]) * az), w0 = c0[1] + ((c0[3] - c0[1]) * az);
+    float v1 = c1[0] + ((c1[2] - c1[0]) * az), w1 = c1[1] + ((c1[3] - c1[1]) * az);
+    float num = v0 + ((v1 - v0) * ax);
+    float den = w0 + ((w1 - w0) * ax);
+    return (den > 0.0f) ? fast_roundf(num / den) : v;
+}
+
+static void imlib_bilateral_grid_filter(image_t *img, const int ksize, float color_sigma, float space_sigma,
+                                        bool threshold, int offset, bool invert, image_t *mask) {
+    int w = img->w, h = img->h;
+    int channels = (img->pixfmt == PIXFORMAT_GRAYSCALE) ? 1 : 3;
+    int bpp = (img->pixfmt == PIXFORMAT_GRAYSCALE) ? 1 : 2;
+    // The exact filter measures distance relative to the kernel corner and truncates at ksize.
+    float sigma = IM_MIN(space_sigma * distance(ksize, ksize), ksize);
+    int cell = IM_MIN(IM_MAX(fast_roundf(sigma), 2), BILATERAL_GRID_MAX_CELL);
+    int gw = ((w - 1) / cell) + 2;
+    int gh = ((h - 1) / cell) + 2;
+
+    bilateral_grid_t *grid = fb_alloc(channels * sizeof(bilateral_grid_t), FB_ALLOC_NO_HINT);
+    int max_len = 0;
+
+    for (int c = 0; c < channels; c++) {
+        int max = (img->pixfmt == PIXFORMAT_GRAYSCALE) ? COLOR_GRAYSCALE_MAX : ((c == 1) ? COLOR_G6_MAX : COLOR_R5_MAX);
+        float depth = IM_MAX(color_sigma * max, max / ((float) (BILATERAL_GRID_MAX_DEPTH - 2)));
+
+        for (int i = 0; i <= max; i++) {
+            grid[c].zlut[i] = fast_floorf((i * 256) / depth);
+        }
+
+        grid[c].gd = (grid[c].zlut[max] >> 8) + 2;
+        grid[c].slab_len = gw * grid[c].gd;
+        max_len = IM_MAX(max_len, grid[c].slab_len);
+    }
+
+    for (int c = 0; c < channels; c++) {
+        grid[c].slabs = fb_alloc(BILATERAL_GRID_SLABS * grid[c].slab_len * 2 * sizeof(uint32_t), FB_ALLOC_NO_HINT);
+        grid[c].blurred[0] = fb_alloc(grid[c].slab_len * 2 * sizeof(uint32_t), FB_ALLOC_NO_HINT);
+        grid[c].blurred[1] = fb_alloc(grid[c].slab_len * 2 * sizeof(uint32_t), FB_ALLOC_NO_HINT);
+        grid[c].row = fb_alloc(grid[c].slab_len * 2 * sizeof(float), FB_ALLOC_NO_HINT);
+    }
+
+    uint32_t *tmp = fb_alloc(max_len * 2 * sizeof(uint32_t), FB_ALLOC_NO_HINT);
+    uint8_t *scratch = fb_alloc(w * 3, FB_ALLOC_NO_HINT);
+    uint8_t *line = fb_alloc(w * bpp, FB_ALLOC_NO_HINT);
+    uint16_t *x_cells = fb_alloc(w * sizeof(uint16_t), FB_ALLOC_NO_HINT);
+    uint16_t *x_slices = fb_alloc(w * sizeof(uint16_t), FB_ALLOC_NO_HINT);
+    float *x_alpha = fb_alloc(w * sizeof(float), FB_ALLOC_NO_HINT);
+
+    for (int x = 0; x < w; x++) {
+        x_cells[x] = (x + (cell / 2)) / cell;
+        x_slices[x] = x / cell;
+        x_alpha[x] = (x % cell) / ((float) cell);
+    }
+
+    for (int y = 0, splatted = 0, blurred = 0; y < h; y++) {
+        int g = y / cell;
+        float ay = (y % cell) / ((float) cell);
+
+        // Grid rows g and g + 1 are needed, each needs the slabs 2 rows past it.
+        for (; blurred <= (g + 1); blurred++) {
+            for (; (splatted <= (blurred + 2)) && (splatted < gh); splatted++) {
+                bilateral_grid_splat(grid, channels, img, splatted, cell, x_cells, gw, scratch, tmp);
+            }
+
+            bilateral_grid_blur(grid, channels, blurred, splatted);
+        }
+
+        for (int c = 0; c < channels; c++) {
+            const uint32_t *b0 = grid[c].blurred[g & 1], *b1 = grid[c].blurred[(g + 1) & 1];
+
+            for (int i = 0, ii = grid[c].slab_len * 2; i < ii; i++) {
+                grid[c].row[i] = b0[i] + ((((float) b1[i]) - b0[i]) * ay);
+            }
+        }
+
+        const uint8_t *planes[3];
+        int stride = filter_planes(img, y, scratch, planes);
+
+        for (int x = 0; x < w; x++) {
+            if (mask && (!image_get_mask_pixel(mask, x, y))) {
+                memcpy(line + (x * bpp), ((uint8_t *) img->data) + (((y * w) + x) * bpp), bpp);
+                continue; // Short circuit.
+            }
+
+            if (img->pixfmt == PIXFORMAT_GRAYSCALE) {
+                int this_pixel = planes[0][x * stride];
+                int pixel = bilateral_grid_slice(&grid[0], x_slices[x], x_alpha[x], this_pixel);
+
+                if (threshold) {
+                    if (((pixel - offset) < this_pixel) ^ invert) {
+                        pixel = COLOR_GRAYSCALE_BINARY_MAX;
+                    } else {
+                        pixel = COLOR_GRAYSCALE_BINARY_MIN;
+                    }
+                }
+
+                line[x] = pixel;
+            } else {
+                int r = bilateral_grid_slice(&grid[0], x_slices[x], x_alpha[x], planes[0][x]);
+                int g = bilateral_grid_slice(&grid[1], x_slices[x], x_alpha[x], planes[1][x]);
+                int b = bilateral_grid_slice(&grid[2], x_slices[x], x_alpha[x], planes[2][x]);
+                int pixel = COLOR_R5_G6_B5_TO_RGB565(r, g, b);
+
+                if (threshold) {
+                    if (((COLOR_RGB565_TO_Y(pixel) - offset) <
+                         COLOR_RGB565_TO_Y(IMAGE_GET_RGB565_PIXEL(img, x, y))) ^ invert) {
+                        pixel = COLOR_RGB565_BINARY_MAX;
+                    } else {
+                        pixel = COLOR_RGB565_BINARY_MIN;
+                    }
+                }
+
+                ((uint16_t *) line)[x] = pixel;
+            }
+        }
+
+        // Rows above the next splat are no longer read, so the result goes straight back.
+        memcpy(((uint8_t *) img->data) + (y * w * bpp), line, w * bpp);
+    }
+
+    fb_free(); // x_alpha
+    fb_free(); // x_slices
+    fb_free(); // x_cells
+    fb_free(); // line
+    fb_free(); // scratch
+    fb_free(); // tmp
+
+    for (int c = 0; c < channels; c++) {
+        fb_free(); // row
+        fb_free(); // blurred[1]
+        fb_free(); // blurred[0]
+        fb_free(); // slabs
+    }
+
+    fb_free(); // grid
+}
+
 void imlib_bilateral_filter(image_t *img,
                             const int ksize,
                             float color_sigma,
                             float space_sigma,
+                            bool fast,
                             bool threshold,
                             int offset,
                             bool invert,
                             image_t *mask) {
+    if (fast && ((img->pixfmt == PIXFORMAT_GRAYSCALE) || (img->pixfmt == PIXFORMAT_RGB565))) {
+        imlib_bilateral_grid_filter(img, ksize, color_sigma, space_sigma, threshold, offset, invert, mask);
+        return;
+    }
+
     int brows = ksize + 1;
     image_t buf;
     buf.w = img->w;
@@ -6,12 +6,14 @@
 #include FT_CACHE_IMAGE_H
 #include FT_CACHE_CHARMAP_H
 
+#include <limits.h>
 #include <stdio.h>
 
 #include "py/obj.h"
 #include "py/runtime.h"
 
 #include "imlib.h"
+#include "simd.h"
 #include "ff_wrapper.h"
 
 #define CONFIG_FREETYPE_SUPPORT_CACHE 1
@@ -27,6 +29,107 @@ static int s_ft_init_flag = 0;
 static char s_ft_font_path[128];
 static const char *s_ft_dft_font_path = FREETYPE_DEFAULT_FONT_PATH;
 
+// Glyph atlas, rendered alpha masks of the current font keyed by (size, codepoint) and
+// recycled least recently used first. FreeType is only asked on a miss.
+#define GLYPH_CACHE_ENTRIES     (256)
+#define GLYPH_CACHE_BUCKETS     (128) // power of two
+#define GLYPH_CACHE_BYTES       (256 * 1024)
+#define KERNING_CACHE_ENTRIES   (256) // power of two
+
+typedef struct glyph_entry {
+    struct glyph_entry *prev, *next;    // LRU list, most recently used first.
+    struct glyph_entry *chain;          // Hash bucket.
+    FT_ULong charcode;
+    FT_UInt index;
+    uint16_t size;
+    int16_t left, top, advance;
+    uint16_t w, h;
+    uint8_t *mask;                      // w * h alpha values.
+} glyph_entry_t;
+
+typedef struct kerning_entry {
+    FT_UInt left, right;
+    uint16_t size;
+    int16_t dx;
+} kerning_entry_t;
+
+static glyph_entry_t s_glyph_pool[GLYPH_CACHE_ENTRIES];
+static glyph_entry_t *s_glyph_buckets[GLYPH_CACHE_BUCKETS];
+static glyph_entry_t *s_glyph_head, *s_glyph_tail;
+static glyph_entry_t *s_glyph_free;     // Unused entries, linked through chain.
+static size_t s_glyph_bytes;
+static kerning_entry_t s_kerning_cache[KERNING_CACHE_ENTRIES];
+
+static inline uint32_t glyph_cache_hash(FT_ULong charcode, int size) {
+    return ((charcode * 2654435761U) ^ (size * 40503U)) & (GLYPH_CACHE_BUCKETS - 1);
+}
+
+static void glyph_cache_flush(void)
+{
+    for (int i = 0; i < GLYPH_CACHE_ENTRIES; i++) {
+        free(s_glyph_pool[i].mask);
+    }
+
+    memset(s_glyph_pool, 0, sizeof(s_glyph_pool));
+    memset(s_glyph_buckets, 0, sizeof(s_glyph_buckets));
+    memset(s_kerning_cache, 0, sizeof(s_kerning_cache));
+    s_glyph_head = s_glyph_tail = NULL;
+    s_glyph_free = NULL;
+    s_glyph_bytes = 0;
+
+    for (int i = GLYPH_CACHE_ENTRIES - 1; i >= 0; i--) {
+        s_glyph_pool[i].chain = s_glyph_free;
+        s_glyph_free = &s_glyph_pool[i];
+    }
+}
+
+static void glyph_cache_unlink(glyph_entry_t *e)
+{
+    if (e->prev) {
+        e->prev->next = e->next;
+    } else {
+        s_glyph_head = e->next;
+    }
+
+    if (e->next) {
+        e->next->prev = e->prev;
+    } else {
+        s_glyph_tail = e->prev;
+    }
+}
+
+static void glyph_cache_push(glyph_entry_t *e)
+{
+    e->prev = NULL;
+    e->next = s_glyph_head;
+
+    if (s_glyph_head) {
+        s_glyph_head->prev = e;
+    } else {
+        s_glyph_tail = e;
+    }
+
+    s_glyph_head = e;
+}
+
+// Removes the least recently used glyph and returns its (empty) entry.
+static glyph_entry_t *glyph_cache_evict(void)
+{
+    glyph_entry_t *e = s_glyph_tail;
+    glyph_entry_t **link = &s_glyph_buckets[glyph_cache_hash(e->charcode, e->size)];
+
+    while (*link != e) {
+        link = &(*link)->chain;
+    }
+
+    *link = e->chain;
+    glyph_cache_unlink(e);
+    s_glyph_bytes -= e->w * e->h;
+    free(e->mask);
+    memset(e, 0, sizeof(glyph_entry_t));
+    return e;
+}
+
 static FT_Error ftwrap_face_requester( FTC_FaceID   face_id,
                       FT_Library   library,
                       FT_Pointer   request_data,
@@ -39,6 +142,8 @@ static FT_Error ftwrap_face_requester( FTC_FaceID   face_id,
 
 void freetype_deinit(void)
 {
+    glyph_cache_flush();
+
     if(s_ft_cacheManager) {
         FTC_Manager_Done(s_ft_cacheManager);
         s_ft_cacheManager = NULL;
@@ -64,6 +169,8 @@ static int imlib_freetype_init(const char *font_path)
         return 0;
     }
 
+    glyph_cache_flush();
+
     if(s_ft_init_flag) {
         if(s_ft_cacheManager) {
             FTC_Manager_Done(s_ft_cacheManager);
@@ -174,19 +281,253 @@ static FT_ULong utf8_to_unicode(const char **ptr) {
     return unicode;
 }
 
-static void inline draw_bitmap(image_t *img, int color, int x, int y, FT_Bitmap *bitmap) {
-    FT_Int i, j, p, q;
-    FT_Int x_max = x + bitmap->width;
-    FT_Int y_max = y + bitmap->rows;
+// Returns the cached glyph of charcode, rendering it on a miss. NULL if FreeType fails.
+static glyph_entry_t *glyph_cache_lookup(FTC_FaceID face_id, FT_Int charmap_index,
+                                         FTC_ScalerRec *scaler, FT_ULong charcode)
+{
+    uint32_t hash = glyph_cache_hash(charcode, scaler->width);
+
+    for (glyph_entry_t *e = s_glyph_buckets[hash]; e; e = e->chain) {
+        if ((e->charcode == charcode) && (e->size == scaler->width)) {
+            if (e != s_glyph_head) {
+                glyph_cache_unlink(e);
+                glyph_cache_push(e);
+            }
+            return e;
+        }
+    }
+
+    FT_Glyph glyph;
+    FT_UInt glyph_index = FTC_CMapCache_Lookup(s_ft_cmapCache, face_id, charmap_index, charcode);
+
+    if (FTC_ImageCache_LookupScaler(s_ft_imageCache, scaler, FT_LOAD_RENDER | FT_LOAD_TARGET_NORMAL,
+                                    glyph_index, &glyph, NULL) || (glyph->format != FT_GLYPH_FORMAT_BITMAP)) {
+        return NULL;
+    }
+
+    FT_BitmapGlyph bitmap_glyph = (FT_BitmapGlyph) glyph;
+    FT_Bitmap *bitmap = &bitmap_glyph->bitmap;
+    size_t bytes = bitmap->width * bitmap->rows;
+    uint8_t *mask = NULL;
+
+    if (bytes) {
+        while (s_glyph_tail && ((s_glyph_bytes + bytes) > GLYPH_CACHE_BYTES)) {
+            glyph_entry_t *e = glyph_cache_evict();
+            e->chain = s_glyph_free;
+            s_glyph_free = e;
+        }
+
+        if (!(mask = malloc(bytes))) {
+            return NULL;
+        }
+
+        for (unsigned int y = 0; y < bitmap->rows; y++) {
+            const uint8_t *src = bitmap->buffer + (y * bitmap->pitch);
+            uint8_t *dst = mask + (y * bitmap->width);
+
+            if (bitmap->pixel_mode == FT_PIXEL_MODE_MONO) {
+                for (unsigned int x = 0; x < bitmap->width; x++) {
+                    dst[x] = ((src[x >> 3] >> (7 - (x & 7))) & 1) ? 255 : 0;
+                }
+            } else {
+                memcpy(dst, src, bitmap->width);
+            }
+        }
+    }
+
+    glyph_entry_t *e;
+
+    if (s_glyph_free) {
+        e = s_glyph_free;
+        s_glyph_free = e->chain;
+    } else {
+        e = glyph_cache_evict();
+    }
+
+    e->charcode = charcode;
+    e->index = glyph_index;
+    e->size = scaler->width;
+    e->left = bitmap_glyph->left;
+    e->top = bitmap_glyph->top;
+    e->advance = bitmap_glyph->root.advance.x >> 16;
+    e->w = bitmap->width;
+    e->h = bitmap->rows;
+    e->mask = mask;
+    e->chain = s_glyph_buckets[hash];
+    s_glyph_buckets[hash] = e;
+    s_glyph_bytes += bytes;
+    glyph_cache_push(e);
+    return e;
+}
+
+static int kerning_lookup(FT_Face face, FT_UInt left, FT_UInt right, int size)
+{
+    kerning_entry_t *k = &s_kerning_cache[((left * 31U) ^ (right * 2654435761U) ^ size) & (KERNING_CACHE_ENTRIES - 1)];
+
+    if ((k->left != left) || (k->right != right) || (k->size != size)) {
+        FT_Vector delta;
+
+        if (FT_Get_Kerning(face, left, right, FT_KERNING_DEFAULT, &delta)) {
+            delta.x = 0;
+        }
+
+        k->left = left;
+        k->right = right;
+        k->size = size;
+        k->dx = delta.x >> 6;
+    }
+
+    return k->dx;
+}
+
+// Row blends for glyph_blit(). A mask value a (0-255) is widened to a + (a >> 7) (0-256) and
+// each 8-bit channel becomes (bg * (256 - a) + fg * a) >> 8, which fits 16-bit lanes. Rows
+// are blended VEC_LANES pixels at a time with a scalar tail.
+static void glyph_blend_row_grayscale(uint8_t *row, const uint8_t *m, int n, int color)
+{
+    int i = 0;
+
+    for (; (i + VEC_LANES) <= n; i += VEC_LANES) {
+        vec_u16_t a = VEC_U8_TO_U16(VEC_LOAD(vec_u8_t, m + i));
+        a += a >> 7;
+        vec_u16_t bg = VEC_U8_TO_U16(VEC_LOAD(vec_u8_t, row + i));
+        VEC_STORE(row + i, VEC_U16_TO_U8(((bg * (256 - a)) + (a * (uint16_t) color)) >> 8));
+    }
+
+    for (; i < n; i++) {
+        int a = m[i] + (m[i] >> 7);
+        row[i] = ((row[i] * (256 - a)) + (color * a)) >> 8;
+    }
+}
+
+// 5/6-bit channels are blended two at a time with the usual 0x07E0F81F spread and a 5-bit alpha.
+static void glyph_blend_row_rgb565(uint16_t *row, const uint8_t *m, int n, int color)
+{
+    uint32_t fg = (((uint32_t) color) | (((uint32_t) color) << 16)) & 0x07E0F81F;
+    int i = 0;
+
+    for (; (i + VEC_LANES) <= n; i += VEC_LANES) {
+        vec_u32_t a = VEC_U16_TO_U32((VEC_U8_TO_U16(VEC_LOAD(vec_u8_t, m + i)) + 4) >> 3);
+        vec_u32_t bg = VEC_U16_TO_U32(VEC_LOAD(vec_u16_t, row + i));
+        bg = (bg | (bg << 16)) & 0x07E0F81F;
+        vec_u32_t blend = (bg + (((fg - bg) * a) >> 5)) & 0x07E0F81F;
+        vec_u32_t opaque = (vec_u32_t) (a == 32);
+        blend = (blend & ~opaque) | (fg & opaque);
+        VEC_STORE(row + i, VEC_U32_TO_U16(blend | (blend >> 16)));
+    }
+
+    for (; i < n; i++) {
+        uint32_t a = (m[i] + 4) >> 3;
+        if (a == 32) {
+            row[i] = color;
+        } else if (a) {
+            uint32_t bg = (((uint32_t) row[i]) | (((uint32_t) row[i]) << 16)) & 0x07E0F81F;
+            bg = (bg + (((fg - bg) * a) >> 5)) & 0x07E0F81F;
+            row[i] = bg | (bg >> 16);
+        }
+    }
+}
+
+// Packed R, G, B bytes: the mask is expanded to one alpha per byte so that a block of VEC_LANES
+// pixels is blended as three byte vectors against the matching R/G/B, G/B/R and B/R/G patterns.
+static void glyph_blend_row_rgb888(uint8_t *row, const uint8_t *m, int n, int color)
+{
+    uint8_t fg[3] = { color >> 16, color >> 8, color };
+    uint16_t pattern[3 * VEC_LANES];
+    uint8_t alpha[3 * VEC_LANES];
+    int i = 0;
+
+    for (int k = 0; k < (3 * VEC_LANES); k++) {
+        pattern[k] = fg[k % 3];
+    }
+
+    for (; (i + VEC_LANES) <= n; i += VEC_LANES, row += 3 * VEC_LANES) {
+        for (int k = 0; k < VEC_LANES; k++) {
+            alpha[(k * 3) + 0] = alpha[(k * 3) + 1] = alpha[(k * 3) + 2] = m[i + k];
+        }
+
+        for (int k = 0; k < (3 * VEC_LANES); k += VEC_LANES) {
+            vec_u16_t a = VEC_U8_TO_U16(VEC_LOAD(vec_u8_t, alpha + k));
+            a += a >> 7;
+            vec_u16_t bg = VEC_U8_TO_U16(VEC_LOAD(vec_u8_t, row + k));
+            vec_u16_t c = VEC_LOAD(vec_u16_t, pattern + k);
+            VEC_STORE(row + k, VEC_U16_TO_U8(((bg * (256 - a)) + (a * c)) >> 8));
+        }
+    }
+
+    for (; i < n; i++, row += 3) {
+        int a = m[i] + (m[i] >> 7);
+        if (a) {
+            row[0] = ((row[0] * (256 - a)) + (fg[0] * a)) >> 8;
+            row[1] = ((row[1] * (256 - a)) + (fg[1] * a)) >> 8;
+            row[2] = ((row[2] * (256 - a)) + (fg[2] * a)) >> 8;
+        }
+    }
+}
+
+// Alpha blends a glyph mask in color, clipped to the image.
+static void glyph_blit(image_t *img, int x, int y, const glyph_entry_t *g, int color)
+{
+    int x0 = IM_MAX(x, 0), x1 = IM_MIN(x + g->w, img->w);
+    int y0 = IM_MAX(y, 0), y1 = IM_MIN(y + g->h, img->h);
 
-    for (i = x, p = 0; i < x_max; i++, p++) {
-        for (j = y, q = 0; j < y_max; j++, q++) {
-            if (i < 0 || j < 0 || i >= img->w || j >= img->h)
-                continue;
+    if ((x0 >= x1) || (y0 >= y1)) {
+        return;
+    }
 
-            if(bitmap->buffer[q * bitmap->width + p]) {
-                imlib_set_pixel(img, i, j, color);
+    switch (img->pixfmt) {
+        case PIXFORMAT_GRAYSCALE: {
+            for (int j = y0; j < y1; j++) {
+                glyph_blend_row_grayscale(IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, j) + x0,
+                                          g->mask + ((j - y) * g->w) + (x0 - x), x1 - x0, color);
             }
+            break;
+        }
+        case PIXFORMAT_RGB565: {
+            for (int j = y0; j < y1; j++) {
+                glyph_blend_row_rgb565(IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, j) + x0,
+                                       g->mask + ((j - y) * g->w) + (x0 - x), x1 - x0, color);
+            }
+            break;
+        }
+        case PIXFORMAT_RGB888: {
+            for (int j = y0; j < y1; j++) {
+                glyph_blend_row_rgb888(img->data + (((j * img->w) + x0) * 3),
+                                       g->mask + ((j - y) * g->w) + (x0 - x), x1 - x0, color);
+            }
+            break;
+        }
+        case PIXFORMAT_ARGB8888: {
+            // The straight alpha "over" divides by the output alpha per pixel, so it stays scalar.
+            uint32_t fg = (uint32_t) color;
+
+            for (int j = y0; j < y1; j++) {
+                const uint8_t *m = g->mask + ((j - y) * g->w) + (x0 - x);
+                uint32_t *row = ((uint32_t *) img->data) + (j * img->w);
+
+                for (int i = x0; i < x1; i++) {
+                    uint32_t a = *m++;
+                    if (a == 255) {
+                        row[i] = fg;
+                    } else if (a) {
+                        row[i] = imlib_blend_argb8888(row[i], fg, a + (a >> 7));
+                    }
+                }
+            }
+            break;
+        }
+        default: {
+            // Binary and YUV images can't blend, threshold the mask instead.
+            for (int j = y0; j < y1; j++) {
+                const uint8_t *m = g->mask + ((j - y) * g->w) + (x0 - x);
+
+                for (int i = x0; i < x1; i++) {
+                    if (*m++ > 127) {
+                        imlib_set_pixel(img, i, j, color);
+                    }
+                }
+            }
+            break;
         }
     }
 }
@@ -197,9 +538,11 @@ void imlib_draw_string_advance(image_t *img,
                                int char_size,
                                const char *str,
                                int color,
-                               const char *font_path)
+                               const char *font_path,
+                               rectangle_t *bbox)
 {
     int error = 0;
+    int bbox_x0 = INT_MAX, bbox_y0 = INT_MAX, bbox_x1 = INT_MIN, bbox_y1 = INT_MIN;
 
     int point_x = x_off;
     int point_y = y_off + char_size;
@@ -210,16 +553,17 @@ void imlib_draw_string_advance(image_t *img,
     }
 
     FTC_FaceID face_id;
-	FT_Face face;
-	FT_Glyph glyph;
-	FT_UInt glyph_index, previous = 0;
-	FT_Int charmap_index;
+    FT_Face face;
+    FT_UInt previous = 0;
+    FT_Int charmap_index;
     FTC_ScalerRec scaler;
 
-	face_id = (FTC_FaceID)&s_ft_font_path;
+    face_id = (FTC_FaceID)&s_ft_font_path;
 
-	FTC_Manager_LookupFace(s_ft_cacheManager, face_id, &face);
-	charmap_index = FT_Get_Charmap_Index(face->charmap);
+    if (FTC_Manager_LookupFace(s_ft_cacheManager, face_id, &face)) {
+        mp_raise_msg_varg(&mp_type_RuntimeError, MP_ERROR_TEXT("Load font %s failed."), s_ft_font_path);
+    }
+    charmap_index = FT_Get_Charmap_Index(face->charmap);
 
     FT_Bool use_kerning = FT_HAS_KERNING(face);
 
@@ -227,40 +571,56 @@ void imlib_draw_string_advance(image_t *img,
     scaler.pixel = 1;
     scaler.width = char_size;
     scaler.height = char_size;
-
-    (void)previous;
-    (void)use_kerning;
+    scaler.x_res = 0;
+    scaler.y_res = 0;
 
     while (*text) {
-		if(*text == '\n') {
-			point_x = x_off;
-			point_y += char_size;
-			text++;
-			continue;
-		}
+        if(*text == '\n') {
+            point_x = x_off;
+            point_y += char_size;
+            previous = 0;
+            text++;
+            continue;
+        }
 
         FT_ULong charcode = utf8_to_unicode(&text);
         if(0x00 == charcode) {
             continue;
         }
 
-		glyph_index = FTC_CMapCache_Lookup(s_ft_cmapCache, face_id, charmap_index, charcode);
-        FTC_ImageCache_LookupScaler(s_ft_imageCache, &scaler, FT_LOAD_RENDER | FT_LOAD_TARGET_NORMAL, glyph_index, &glyph, NULL);
-
-		if (use_kerning && previous && glyph_index) {
-			FT_Vector delta;
-			FT_Get_Kerning(face, previous, glyph_index, FT_KERNING_DEFAULT, &delta);
-			point_x += delta.x >> 6;
-		}
-        previous = glyph_index;
+        glyph_entry_t *g = glyph_cache_lookup(face_id, charmap_index, &scaler, charcode);
+        if (!g) {
+            continue;
+        }
 
-        FT_BitmapGlyph bitmapGlyph = (FT_BitmapGlyph)glyph;
-        FT_Bitmap *bitmap = &bitmapGlyph->bitmap;
-        // Draw the bitmap
-        draw_bitmap(img, color, point_x + bitmapGlyph->left, point_y - bitmapGlyph->top, bitmap);
+        if (use_kerning && previous && g->index) {
+            point_x += kerning_lookup(face, previous, g->index, char_size);
+        }
+        previous = g->index;
+
+        if (g->mask) {
+            glyph_blit(img, point_x + g->left, point_y - g->top, g, color);
+            bbox_x0 = IM_MIN(bbox_x0, point_x + g->left);
+            bbox_y0 = IM_MIN(bbox_y0, point_y - g->top);
+            bbox_x1 = IM_MAX(bbox_x1, point_x + g->left + g->w);
+            bbox_y1 = IM_MAX(bbox_y1, point_y - g->top + g->h);
+        }
 
         // Advance the cursor to the start of the next character
-        // point_x += (face->glyph->advance.x >> 6);
-        point_x += (bitmapGlyph->root.advance.x >> 16);
-	}
+        point_x += g->advance;
+    }
+
+    if (bbox) {
+        // Report the touched area clipped to the image so it fits in a rectangle_t.
+        bbox_x0 = IM_MAX(bbox_x0, 0);
+        bbox_y0 = IM_MAX(bbox_y0, 0);
+        bbox_x1 = IM_MIN(bbox_x1, img->w);
+        bbox_y1 = IM_MIN(bbox_y1, img->h);
+
+        if ((bbox_x0 < bbox_x1) && (bbox_y0 < bbox_y1)) {
+            rectangle_init(bbox, bbox_x0, bbox_y0, bbox_x1 - bbox_x0, bbox_y1 - bbox_y0);
+        } else {
+            rectangle_init(bbox, 0, 0, 0, 0);
+        }
+    }
 }
@@ -6,114 +6,702 @@
  *
  * This work is licensed under the MIT license, see the file LICENSE for details.
  *
- * A simple GIF encoder.
+ * A GIF89a encoder with LZW compression, median cut palettes and frame differencing.
  */
 #include "imlib.h"
 #if defined(IMLIB_ENABLE_IMAGE_FILE_IO)
 
 #include "fb_alloc.h"
+#include "xalloc.h"
 #include "ff_wrapper.h"
-#define BLOCK_SIZE    (126) // (2^7) - 2 // (DO NOT CHANGE!)
 
-void gif_open(FIL *fp, int width, int height, bool color, bool loop) {
-    file_buffer_on(fp);
+#define GIF_LZW_MAX_CODE     (4095)
+#define GIF_HASH_BITS        (13) // 8192 entries, twice the LZW dictionary
+#define GIF_HASH_SIZE        (1 << GIF_HASH_BITS)
+#define GIF_HASH_MASK        (GIF_HASH_SIZE - 1)
+#define GIF_HASH_EMPTY       (0xFFFFFFFF)
+#define GIF_BLOCK_SIZE       (255)
 
-    write_data(fp, "GIF89a", 6);
-    write_word(fp, width);
-    write_word(fp, height);
-    write_data(fp, (uint8_t []) {0xF6, 0x00, 0x00}, 3);
+#define GIF_HIST_SIZE        (1 << 15) // RGB555
+#define GIF_INVERSE_UNKNOWN  (0xFFFF)
+
+#define GIF_RGB565_TO_RGB555(p) ((((p) >> 1) & 0x7FE0) | ((p) & 0x1F))
+#define GIF_RGB555_TO_R5(p)     (((p) >> 10) & 0x1F)
+#define GIF_RGB555_TO_G5(p)     (((p) >> 5) & 0x1F)
+#define GIF_RGB555_TO_B5(p)     ((p) & 0x1F)
+#define GIF_5_TO_8(v)           (((v) << 3) | ((v) >> 2))
+
+// 4x4 ordered dither offsets in 8-bit units (about one palette step).
+static const int8_t gif_dither[4][4] = {
+    { -15,   1, -11,   5 },
+    {   9,  -7,  13,  -3 },
+    {  -9,   7, -13,   3 },
+    {  15,  -1,  11,  -5 }
+};
+
+typedef struct gif_box {
+    uint8_t lo[3], hi[3]; // inclusive RGB555 bounds
+    uint32_t count;
+} gif_box_t;
+
+typedef struct gif_lzw {
+    FIL *fp;
+    uint32_t *hash;
+    uint32_t bits;
+    int bit_count;
+    int code_size;
+    int min_code_size;
+    int next_code;
+    int max_code;
+    int block_len;
+    uint8_t block[GIF_BLOCK_SIZE];
+} gif_lzw_t;
+
+static void gif_lzw_flush_block(gif_lzw_t *lzw) {
+    if (lzw->block_len) {
+        write_byte(lzw->fp, lzw->block_len);
+        write_data(lzw->fp, lzw->block, lzw->block_len);
+        lzw->block_len = 0;
+    }
+}
+
+static void gif_lzw_put(gif_lzw_t *lzw, int code) {
+    lzw->bits |= code << lzw->bit_count;
+    lzw->bit_count += lzw->code_size;
+
+    while (lzw->bit_count >= 8) {
+        lzw->block[lzw->block_len++] = lzw->bits;
+        lzw->bits >>= 8;
+        lzw->bit_count -= 8;
 
-    if (color) {
-        for (int i = 0; i < 128; i++) {
-            int red = ((((i & 0x60) >> 5) * 255) + 1.5) / 3;
-            int green = ((((i & 0x1C) >> 2) * 255) + 3.5) / 7;
-            int blue = (((i & 0x3) * 255) + 1.5) / 3;
-            write_data(fp, (uint8_t []) {red, green, blue}, 3);
+        if (lzw->block_len == GIF_BLOCK_SIZE) {
+            gif_lzw_flush_block(lzw);
+        }
+    }
+
+    // The code size grows once the next code to be assigned no longer fits.
+    if ((lzw->next_code >= lzw->max_code) && (lzw->code_size < 12)) {
+        lzw->code_size += 1;
+        lzw->max_code = 1 << lzw->code_size;
+    }
+}
+
+static void gif_lzw_reset(gif_lzw_t *lzw) {
+    memset(lzw->hash, 0xFF, GIF_HASH_SIZE * sizeof(uint32_t));
+    lzw->code_size = lzw->min_code_size + 1;
+    lzw->max_code = 1 << lzw->code_size;
+    lzw->next_code = (1 << lzw->min_code_size) + 2;
+}
+
+// Encodes a w x h window of a row stride wide index image as LZW sub-blocks, the dictionary
+// is a (prefix, pixel) -> code hash table with linear probing.
+static void gif_lzw_encode(FIL *fp, const uint8_t *pixels, int stride, int w, int h, int min_code_size) {
+    gif_lzw_t lzw = { .fp = fp, .min_code_size = min_code_size };
+    const int clear_code = 1 << min_code_size;
+    lzw.hash = fb_alloc(GIF_HASH_SIZE * sizeof(uint32_t), FB_ALLOC_NO_HINT);
+
+    write_byte(fp, min_code_size);
+    gif_lzw_reset(&lzw);
+    gif_lzw_put(&lzw, clear_code);
+
+    int prefix = pixels[0];
+
+    for (int y = 0; y < h; y++) {
+        const uint8_t *row = pixels + (y * stride);
+
+        for (int x = (y ? 0 : 1); x < w; x++) {
+            uint32_t key = (prefix << 8) | row[x];
+            uint32_t i = ((key >> 12) ^ key) & GIF_HASH_MASK;
+
+            for (; lzw.hash[i] != GIF_HASH_EMPTY; i = (i + 1) & GIF_HASH_MASK) {
+                if ((lzw.hash[i] >> 12) == key) {
+                    break;
+                }
+            }
+
+            if (lzw.hash[i] != GIF_HASH_EMPTY) {
+                prefix = lzw.hash[i] & 0xFFF;
+                continue;
+            }
+
+            gif_lzw_put(&lzw, prefix);
+            prefix = row[x];
+
+            if (lzw.next_code >= GIF_LZW_MAX_CODE) {
+                gif_lzw_put(&lzw, clear_code);
+                gif_lzw_reset(&lzw);
+            } else {
+                lzw.hash[i] = (key << 12) | lzw.next_code++;
+            }
+        }
+    }
+
+    gif_lzw_put(&lzw, prefix);
+    gif_lzw_put(&lzw, clear_code + 1); // end of information
+
+    if (lzw.bit_count) {
+        lzw.block[lzw.block_len++] = lzw.bits;
+    }
+
+    gif_lzw_flush_block(&lzw);
+    write_byte(fp, 0x00); // block terminator
+
+    fb_free(); // lzw.hash
+}
+
+// Fetches a row as RGB565 (color) or grayscale, gif_add_frame() rejects other source formats.
+static void gif_get_row(gif_t *gif, image_t *img, int y, void *row) {
+    if (gif->color) {
+        uint16_t *row_ptr = row;
+
+        switch (img->pixfmt) {
+            case PIXFORMAT_BINARY: {
+                uint32_t *src = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, y);
+                for (int x = 0; x < img->w; x++) {
+                    row_ptr[x] = IMAGE_GET_BINARY_PIXEL_FAST(src, x) ? 0xFFFF : 0x0000;
+                }
+                break;
+            }
+            case PIXFORMAT_GRAYSCALE: {
+                uint8_t *src = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y);
+                for (int x = 0; x < img->w; x++) {
+                    row_ptr[x] = COLOR_Y_TO_RGB565(src[x]);
+                }
+                break;
+            }
+            case PIXFORMAT_RGB565: {
+                memcpy(row_ptr, IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y), img->w * sizeof(uint16_t));
+                break;
+            }
+            case PIXFORMAT_RGB888: {
+                uint8_t *src = ((uint8_t *) img->data) + (img->w * y * 3);
+                for (int x = 0; x < img->w; x++, src += 3) {
+                    row_ptr[x] = COLOR_R8_G8_B8_TO_RGB565(src[0], src[1], src[2]);
+                }
+                break;
+            }
+            case PIXFORMAT_ARGB8888: {
+                uint32_t *src = ((uint32_t *) img->data) + (img->w * y);
+                for (int x = 0; x < img->w; x++) {
+                    uint32_t p = src[x];
+                    row_ptr[x] = COLOR_R8_G8_B8_TO_RGB565((p >> 16) & 0xFF, (p >> 8) & 0xFF, p & 0xFF);
+                }
+                break;
+            }
+            case PIXFORMAT_BAYER_ANY: {
+                imlib_debayer_line(0, img->w, y, row_ptr, PIXFORMAT_RGB565, img);
+                break;
+            }
+            case PIXFORMAT_YUV_ANY: {
+                imlib_deyuv_line(0, img->w, y, row_ptr, PIXFORMAT_RGB565, img);
+                break;
+            }
+            default: {
+                break;
+            }
         }
     } else {
-        for (int i = 0; i < 128; i++) {
-            int gray = ((i * 255) + 63.5) / 127;
-            write_data(fp, (uint8_t []) {gray, gray, gray}, 3);
+        uint8_t *row_ptr = row;
+
+        switch (img->pixfmt) {
+            case PIXFORMAT_BINARY: {
+                uint32_t *src = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, y);
+                for (int x = 0; x < img->w; x++) {
+                    row_ptr[x] = IMAGE_GET_BINARY_PIXEL_FAST(src, x) ? 0xFF : 0x00;
+                }
+                break;
+            }
+            case PIXFORMAT_GRAYSCALE: {
+                memcpy(row_ptr, IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y), img->w);
+                break;
+            }
+            case PIXFORMAT_RGB565: {
+                uint16_t *src = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y);
+                for (int x = 0; x < img->w; x++) {
+                    row_ptr[x] = COLOR_RGB565_TO_Y(src[x]);
+                }
+                break;
+            }
+            case PIXFORMAT_RGB888: {
+                uint8_t *src = ((uint8_t *) img->data) + (img->w * y * 3);
+                for (int x = 0; x < img->w; x++, src += 3) {
+                    row_ptr[x] = COLOR_RGB888_TO_Y(src[0], src[1], src[2]);
+                }
+                break;
+            }
+            case PIXFORMAT_ARGB8888: {
+                uint32_t *src = ((uint32_t *) img->data) + (img->w * y);
+                for (int x = 0; x < img->w; x++) {
+                    uint32_t p = src[x];
+                    row_ptr[x] = COLOR_RGB888_TO_Y((p >> 16) & 0xFF, (p >> 8) & 0xFF, p & 0xFF);
+                }
+                break;
+            }
+            case PIXFORMAT_BAYER_ANY: {
+                imlib_debayer_line(0, img->w, y, row_ptr, PIXFORMAT_GRAYSCALE, img);
+                break;
+            }
+            case PIXFORMAT_YUV_ANY: {
+                imlib_deyuv_line(0, img->w, y, row_ptr, PIXFORMAT_GRAYSCALE, img);
+                break;
+            }
+            default: {
+                break;
+            }
+        }
+    }
+}
+
+// Shrinks a box to the occupied part of the histogram and recounts it.
+static void gif_box_shrink(gif_box_t *box, const uint32_t *hist) {
+    uint8_t lo[3] = { 31, 31, 31 }, hi[3] = { 0, 0, 0 };
+    uint32_t count = 0;
+
+    for (int r = box->lo[0]; r <= box->hi[0]; r++) {
+        for (int g = box->lo[1]; g <= box->hi[1]; g++) {
+            const uint32_t *bins = hist + (r << 10) + (g << 5);
+
+            for (int b = box->lo[2]; b <= box->hi[2]; b++) {
+                if (bins[b]) {
+                    count += bins[b];
+                    lo[0] = IM_MIN(lo[0], r); hi[0] = IM_MAX(hi[0], r);
+                    lo[1] = IM_MIN(lo[1], g); hi[1] = IM_MAX(hi[1], g);
+                    lo[2] = IM_MIN(lo[2], b); hi[2] = IM_MAX(hi[2], b);
+                }
+            }
+        }
+    }
+
+    if (count) {
+        memcpy(box->lo, lo, sizeof(lo));
+        memcpy(box->hi, hi, sizeof(hi));
+    }
+
+    box->count = count;
+}
+
+// Splits a box at the median of its longest side.
+static void gif_box_split(gif_box_t *box, gif_box_t *new_box, const uint32_t *hist) {
+    uint32_t proj[32] = {};
+    int axis = 0;
+
+    for (int i = 1; i < 3; i++) {
+        if ((box->hi[i] - box->lo[i]) > (box->hi[axis] - box->lo[axis])) {
+            axis = i;
+        }
+    }
+
+    for (int r = box->lo[0]; r <= box->hi[0]; r++) {
+        for (int g = box->lo[1]; g <= box->hi[1]; g++) {
+            const uint32_t *bins = hist + (r << 10) + (g << 5);
+
+            for (int b = box->lo[2]; b <= box->hi[2]; b++) {
+                proj[(axis == 0) ? r : ((axis == 1) ? g : b)] += bins[b];
+            }
+        }
+    }
+
+    int cut = box->lo[axis];
+
+    for (uint32_t sum = proj[cut]; ((sum * 2) < box->count) && (cut < (box->hi[axis] - 1)); ) {
+        sum += proj[++cut];
+    }
+
+    *new_box = *box;
+    box->hi[axis] = cut;
+    new_box->lo[axis] = cut + 1;
+    gif_box_shrink(box, hist);
+    gif_box_shrink(new_box, hist);
+}
+
+// Median cut of the RGB555 histogram into at most max_colors boxes, fills the palette with the
+// mean of each box and the inverse map for every occupied bin.
+static int gif_median_cut(const uint32_t *hist, int max_colors, uint8_t *palette, uint16_t *inverse) {
+    gif_box_t *boxes = fb_alloc(max_colors * sizeof(gif_box_t), FB_ALLOC_NO_HINT);
+    int n = 1;
+
+    boxes[0] = (gif_box_t) { .lo = { 0, 0, 0 }, .hi = { 31, 31, 31 } };
+    gif_box_shrink(&boxes[0], hist);
+
+    while (n < max_colors) {
+        int best = -1;
+        uint32_t best_score = 0;
+
+        for (int i = 0; i < n; i++) {
+            int side = IM_MAX(IM_MAX(boxes[i].hi[0] - boxes[i].lo[0], boxes[i].hi[1] - boxes[i].lo[1]),
+                              boxes[i].hi[2] - boxes[i].lo[2]);
+            uint32_t score = boxes[i].count * side;
+
+            if (score > best_score) {
+                best = i;
+                best_score = score;
+            }
+        }
+
+        if (best < 0) {
+            break; // every box is a single color
         }
+
+        gif_box_split(&boxes[best], &boxes[n++], hist);
     }
 
-    if (loop) {
+    for (int i = 0; i < n; i++) {
+        uint64_t sum[3] = {};
+        uint32_t count = 0;
+
+        for (int r = boxes[i].lo[0]; r <= boxes[i].hi[0]; r++) {
+            for (int g = boxes[i].lo[1]; g <= boxes[i].hi[1]; g++) {
+                int bin = (r << 10) | (g << 5);
+
+                for (int b = boxes[i].lo[2]; b <= boxes[i].hi[2]; b++) {
+                    uint32_t c = hist[bin | b];
+
+                    if (c) {
+                        sum[0] += c * GIF_5_TO_8(r);
+                        sum[1] += c * GIF_5_TO_8(g);
+                        sum[2] += c * GIF_5_TO_8(b);
+                        count += c;
+                        inverse[bin | b] = i;
+                    }
+                }
+            }
+        }
+
+        count = IM_MAX(count, 1U);
+
+        for (int j = 0; j < 3; j++) {
+            palette[(i * 3) + j] = (sum[j] + (count / 2)) / count;
+        }
+    }
+
+    fb_free(); // boxes
+    return n;
+}
+
+// Maps an RGB555 color that was not in the histogram to the nearest palette entry.
+static int gif_nearest(const uint8_t *palette, int n, int c) {
+    int r = GIF_5_TO_8(GIF_RGB555_TO_R5(c));
+    int g = GIF_5_TO_8(GIF_RGB555_TO_G5(c));
+    int b = GIF_5_TO_8(GIF_RGB555_TO_B5(c));
+    int best = 0, best_dist = INT_MAX;
+
+    for (int i = 0; i < n; i++) {
+        int dr = palette[(i * 3) + 0] - r;
+        int dg = palette[(i * 3) + 1] - g;
+        int db = palette[(i * 3) + 2] - b;
+        int dist = (dr * dr) + (dg * dg) + (db * db);
+
+        if (dist < best_dist) {
+            best = i;
+            best_dist = dist;
+        }
+    }
+
+    return best;
+}
+
+static int gif_table_bits(int entries) {
+    int bits = 1;
+
+    while ((1 << bits) < entries) {
+        bits += 1;
+    }
+
+    return bits;
+}
+
+static void gif_write_palette(FIL *fp, const uint8_t *palette, int n, int bits) {
+    uint8_t zeros[3] = {};
+    write_data(fp, palette, n * 3);
+
+    for (int i = n; i < (1 << bits); i++) {
+        write_data(fp, zeros, sizeof(zeros));
+    }
+}
+
+// Palette entries available to the frame, one table slot is kept for the transparent index when
+// frames are differenced.
+static int gif_max_colors(gif_t *gif) {
+    return gif->diff ? 255 : 256;
+}
+
+static void gif_gray_palette(gif_t *gif) {
+    int levels = gif_max_colors(gif);
+
+    for (int i = 0; i < levels; i++) {
+        int gray = ((i * 255) + ((levels - 1) / 2)) / (levels - 1);
+        gif->palette[(i * 3) + 0] = gray;
+        gif->palette[(i * 3) + 1] = gray;
+        gif->palette[(i * 3) + 2] = gray;
+    }
+
+    gif->palette_size = levels;
+}
+
+static void gif_write_header(FIL *fp, gif_t *gif) {
+    write_data(fp, "GIF89a", 6);
+    write_word(fp, gif->w);
+    write_word(fp, gif->h);
+
+    if (gif->palette_size) {
+        int bits = gif_table_bits(gif->palette_size + gif->diff);
+        write_data(fp, (uint8_t []) {0xF0 | (bits - 1), 0x00, 0x00}, 3);
+        gif_write_palette(fp, gif->palette, gif->palette_size, bits);
+    } else {
+        write_data(fp, (uint8_t []) {0x70, 0x00, 0x00}, 3);
+    }
+
+    if (gif->loop) {
         write_data(fp, (uint8_t []) {'!', 0xFF, 0x0B}, 3);
         write_data(fp, "NETSCAPE2.0", 11);
         write_data(fp, (uint8_t []) {0x03, 0x01, 0x00, 0x00, 0x00}, 5);
     }
+}
 
-    file_buffer_off(fp);
+void gif_open(FIL *fp, gif_t *gif, int width, int height, bool color, bool loop,
+              bool global_palette, bool dither, bool diff) {
+    memset(gif, 0, sizeof(gif_t));
+    gif->w = width;
+    gif->h = height;
+    gif->color = color;
+    gif->loop = loop;
+    gif->global_palette = global_palette || (!color);
+    gif->dither = dither && color;
+    gif->diff = diff;
+
+    // A global color palette comes from the first frame, so the header is written with it.
+    if (!color) {
+        gif_gray_palette(gif);
+    }
 }
 
-void gif_add_frame(FIL *fp, image_t *img, uint16_t delay) {
-    file_buffer_on(fp);
+void gif_add_frame(FIL *fp, gif_t *gif, image_t *img, uint16_t delay) {
+    switch (img->pixfmt) {
+        case PIXFORMAT_BINARY:
+        case PIXFORMAT_GRAYSCALE:
+        case PIXFORMAT_RGB565:
+        case PIXFORMAT_RGB888:
+        case PIXFORMAT_ARGB8888:
+        case PIXFORMAT_BAYER_ANY:
+        case PIXFORMAT_YUV_ANY: {
+            break;
+        }
+        default: {
+            mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("Unsupported GIF frame format!"));
+        }
+    }
 
-    if (delay) {
-        write_data(fp, (uint8_t []) {'!', 0xF9, 0x04, 0x04}, 4);
-        write_word(fp, delay);
-        write_word(fp, 0); // end
+    if (gif->frames && ((img->w != gif->w) || (img->h != gif->h))) {
+        mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("Frame size does not match the GIF size!"));
     }
 
-    write_byte(fp, 0x2C);
-    write_long(fp, 0);
-    write_word(fp, img->w);
-    write_word(fp, img->h);
-    write_data(fp, (uint8_t []) {0x00, 0x07}, 2); // 7-bits
-
-    int bytes = img->h * img->w;
-    int blocks = (bytes + BLOCK_SIZE - 1) / BLOCK_SIZE;
-
-    if (IM_IS_GS(img)) {
-        for (int y = 0; y < blocks; y++) {
-            int block_size = IM_MIN(BLOCK_SIZE, bytes - (y * BLOCK_SIZE));
-            write_byte(fp, 1 + block_size);
-            write_byte(fp, 0x80); // clear code
-            for (int x = 0; x < block_size; x++) {
-                write_byte(fp, img->pixels[(y * BLOCK_SIZE) + x] >> 1);
-            }
-        }
-    } else if (IM_IS_RGB565(img)) {
-        for (int y = 0; y < blocks; y++) {
-            int block_size = IM_MIN(BLOCK_SIZE, bytes - (y * BLOCK_SIZE));
-            write_byte(fp, 1 + block_size);
-            write_byte(fp, 0x80); // clear code
-            for (int x = 0; x < block_size; x++) {
-                int pixel = ((uint16_t *) img->pixels)[(y * BLOCK_SIZE) + x];
-                int red = COLOR_RGB565_TO_R5(pixel) >> 3;
-                int green = COLOR_RGB565_TO_G6(pixel) >> 3;
-                int blue = COLOR_RGB565_TO_B5(pixel) >> 3;
-                write_byte(fp, (red << 5) | (green << 2) | blue);
-            }
-        }
-    } else if (img->is_bayer || img->is_yuv) {
-        for (int y = 0; y < blocks; y++) {
-            int block_size = IM_MIN(BLOCK_SIZE, bytes - (y * BLOCK_SIZE));
-            write_byte(fp, 1 + block_size);
-            write_byte(fp, 0x80); // clear code
-            uint16_t pixels[block_size];
-            if (img->is_bayer) {
-                imlib_debayer_line(0, block_size, y, pixels, PIXFORMAT_RGB565, img);
+    if (!gif->frames) {
+        gif->w = gif->w ? gif->w : img->w;
+        gif->h = gif->h ? gif->h : img->h;
+
+        if ((img->w != gif->w) || (img->h != gif->h)) {
+            mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("Frame size does not match the GIF size!"));
+        }
+
+        if (gif->diff) {
+            gif->prev = xalloc(gif->w * gif->h * (gif->color ? sizeof(uint16_t) : sizeof(uint8_t)));
+        }
+    }
+
+    file_buffer_on(fp);
+
+    int w = gif->w, h = gif->h;
+    bool first = !gif->frames;
+    bool local_palette = gif->color && (!gif->global_palette);
+    uint8_t *indices = fb_alloc(w * h, FB_ALLOC_NO_HINT);
+    uint8_t *row = fb_alloc(w * sizeof(uint16_t), FB_ALLOC_NO_HINT);
+    uint8_t *palette = gif->palette;
+    int palette_size = gif->palette_size;
+    // The slot after the palette, the color table and the LZW code size are sized to include it.
+    int transparent = palette_size;
+    int x_min = w, x_max = -1, y_min = h, y_max = -1;
+
+    if (gif->color) {
+        uint16_t *inverse = gif->inverse;
+
+        if (local_palette || first) {
+            uint32_t *hist = fb_alloc0(GIF_HIST_SIZE * sizeof(uint32_t), FB_ALLOC_NO_HINT);
+
+            for (int y = 0; y < h; y++) {
+                gif_get_row(gif, img, y, row);
+
+                for (int x = 0; x < w; x++) {
+                    hist[GIF_RGB565_TO_RGB555(((uint16_t *) row)[x])] += 1;
+                }
+            }
+
+            if (local_palette) {
+                palette = fb_alloc(256 * 3, FB_ALLOC_NO_HINT);
+                inverse = fb_alloc(GIF_HIST_SIZE * sizeof(uint16_t), FB_ALLOC_NO_HINT);
             } else {
-                imlib_deyuv_line(0, block_size, y, pixels, PIXFORMAT_RGB565, img);
+                inverse = gif->inverse = xalloc(GIF_HIST_SIZE * sizeof(uint16_t));
+            }
+
+            memset(inverse, 0xFF, GIF_HIST_SIZE * sizeof(uint16_t));
+            palette_size = gif_median_cut(hist, gif_max_colors(gif), palette, inverse);
+            transparent = palette_size;
+
+            if (!local_palette) {
+                gif->palette_size = palette_size;
+            }
+        }
+
+        uint16_t palette565[256];
+
+        for (int i = 0; i < palette_size; i++) {
+            palette565[i] = COLOR_R8_G8_B8_TO_RGB565(palette[(i * 3) + 0],
+                                                     palette[(i * 3) + 1],
+                                                     palette[(i * 3) + 2]);
+        }
+
+        for (int y = 0; y < h; y++) {
+            uint16_t *row_ptr = (uint16_t *) row;
+            uint16_t *prev_row = gif->prev ? (((uint16_t *) gif->prev) + (y * w)) : NULL;
+            uint8_t *index_row = indices + (y * w);
+            gif_get_row(gif, img, y, row);
+
+            for (int x = 0; x < w; x++) {
+                int pixel = row_ptr[x], c;
+
+                if (gif->dither) {
+                    int d = gif_dither[y & 3][x & 3];
+                    int r = IM_MIN(IM_MAX(COLOR_RGB565_TO_R8(pixel) + d, 0), 255);
+                    int g = IM_MIN(IM_MAX(COLOR_RGB565_TO_G8(pixel) + d, 0), 255);
+                    int b = IM_MIN(IM_MAX(COLOR_RGB565_TO_B8(pixel) + d, 0), 255);
+                    c = ((r >> 3) << 10) | ((g >> 3) << 5) | (b >> 3);
+                } else {
+                    c = GIF_RGB565_TO_RGB555(pixel);
+                }
+
+                int index = inverse[c];
+
+                if (index == GIF_INVERSE_UNKNOWN) {
+                    index = inverse[c] = gif_nearest(palette, palette_size, c);
+                }
+
+                if (prev_row) {
+                    if ((!first) && (prev_row[x] == palette565[index])) {
+                        index = transparent; // unchanged, keep the previous frame
+                    } else {
+                        prev_row[x] = palette565[index];
+                    }
+                }
+
+                index_row[x] = index;
+
+                if (index != transparent) {
+                    x_min = IM_MIN(x_min, x); x_max = IM_MAX(x_max, x);
+                    y_min = IM_MIN(y_min, y); y_max = IM_MAX(y_max, y);
+                }
             }
-            for (int x = 0; x < block_size; x++) {
-                int r = COLOR_RGB565_TO_R8(pixels[x]);
-                int g = COLOR_RGB565_TO_G8(pixels[x]);
-                int b = COLOR_RGB565_TO_B8(pixels[x]);
-                r >>= 3; g >>= 3; b >>= 3;
-                write_byte(fp, (r << 5) | (g << 2) | b);
+        }
+    } else {
+        // 255 (or 256) gray levels, the lut rounds to the nearest one.
+        uint8_t lut[256];
+
+        for (int i = 0; i < 256; i++) {
+            lut[i] = ((i * (palette_size - 1)) + 127) / 255;
+        }
+
+        for (int y = 0; y < h; y++) {
+            uint8_t *prev_row = gif->prev ? (gif->prev + (y * w)) : NULL;
+            uint8_t *index_row = indices + (y * w);
+            gif_get_row(gif, img, y, row);
+
+            for (int x = 0; x < w; x++) {
+                int index = lut[row[x]];
+
+                if (prev_row) {
+                    if ((!first) && (prev_row[x] == index)) {
+                        index = transparent; // unchanged, keep the previous frame
+                    } else {
+                        prev_row[x] = index;
+                    }
+                }
+
+                index_row[x] = index;
+
+                if (index != transparent) {
+                    x_min = IM_MIN(x_min, x); x_max = IM_MAX(x_max, x);
+                    y_min = IM_MIN(y_min, y); y_max = IM_MAX(y_max, y);
+                }
             }
         }
     }
 
-    write_data(fp, (uint8_t []) {0x01, 0x81, 0x00}, 3); // end code
+    if (first) {
+        gif_write_header(fp, gif);
+    }
+
+    // Only the rectangle that changed is encoded, a static frame is a single transparent pixel.
+    if (x_max < 0) {
+        x_min = x_max = y_min = y_max = 0;
+    }
+
+    bool has_transparency = gif->diff && (!first);
+
+    if (delay || has_transparency) {
+        write_data(fp, (uint8_t []) {'!', 0xF9, 0x04, 0x04 | has_transparency}, 4);
+        write_word(fp, delay);
+        write_byte(fp, has_transparency ? transparent : 0);
+        write_byte(fp, 0); // end
+    }
+
+    int bits = gif_table_bits(palette_size + gif->diff);
+
+    write_byte(fp, 0x2C);
+    write_word(fp, x_min);
+    write_word(fp, y_min);
+    write_word(fp, x_max - x_min + 1);
+    write_word(fp, y_max - y_min + 1);
+
+    if (local_palette) {
+        write_byte(fp, 0x80 | (bits - 1));
+        gif_write_palette(fp, palette, palette_size, bits);
+    } else {
+        write_byte(fp, 0x00);
+    }
+
+    gif_lzw_encode(fp, indices + (y_min * w) + x_min, w, x_max - x_min + 1, y_max - y_min + 1, IM_MAX(bits, 2));
+
+    if (local_palette) {
+        fb_free(); // inverse
+        fb_free(); // palette
+    }
+
+    if (gif->color && (local_palette || first)) {
+        fb_free(); // hist
+    }
+
+    fb_free(); // row
+    fb_free(); // indices
+
+    gif->frames += 1;
 
     file_buffer_off(fp);
 }
 
-void gif_close(FIL *fp) {
+void gif_close(FIL *fp, gif_t *gif) {
+    if (!gif->frames) {
+        gif_write_header(fp, gif);
+    }
+
     write_byte(fp, ';');
     file_close(fp);
+
+    if (gif->prev) {
+        xfree(gif->prev);
+        gif->prev = NULL;
+    }
+
+    if (gif->inverse) {
+        xfree(gif->inverse);
+        gif->inverse = NULL;
+    }
 }
 #endif //IMLIB_ENABLE_IMAGE_FILE_IO
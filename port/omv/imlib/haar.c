@@ -73,6 +73,34 @@ static int run_cascade_classifier(cascade_t *cascade, point_t pt) {
     return 1;
 }
 
+// Shifts the filter window over one scale of the image, szw/szh is the size of the scaled ROI.
+// Detections are mapped back with (x * x_factor) + x_offset and (y * y_factor) + y_offset.
+static void detect_objects_scale(image_t *image, cascade_t *cascade, rectangle_t *roi, int szw, int szh,
+                                 float x_factor, float y_factor, int x_offset, int y_offset, array_t *objects) {
+    // When filter window shifts to borders, some margin need to be kept
+    int y2 = szh - cascade->window.h;
+    int x2 = szw - cascade->window.w;
+
+    // Shift the filter window over the image.
+    for (int y = 0; y < y2; y += cascade->step) {
+        for (int x = 0; x < x2; x += cascade->step) {
+            point_t p = {x, y};
+            // If an object is detected, record the coordinates of the filter window
+            if (run_cascade_classifier(cascade, p) > 0) {
+                array_push_back(objects,
+                                rectangle_alloc(fast_roundf(x * x_factor) + x_offset, fast_roundf(y * y_factor) + y_offset,
+                                                fast_roundf(cascade->window.w * x_factor),
+                                                fast_roundf(cascade->window.h * y_factor)));
+            }
+        }
+
+        // If not last line, shift integral images
+        if ((y + cascade->step) < y2) {
+            imlib_integral_mw_shift_ss(image, cascade->sum, cascade->ssq, roi, cascade->step);
+        }
+    }
+}
+
 array_t *imlib_detect_objects(image_t *image, cascade_t *cascade, rectangle_t *roi) {
     // Integral images
     mw_image_t sum;
@@ -127,28 +155,84 @@ array_t *imlib_detect_objects(image_t *image, cascade_t *cascade, rectangle_t *r
         cascade->step = (cascade->step == 0) ? 1 : cascade->step;
 
         // Process image at the current scale
-        // When filter window shifts to borders, some margin need to be kept
-        int y2 = szh - cascade->window.h;
-        int x2 = szw - cascade->window.w;
-
-        // Shift the filter window over the image.
-        for (int y = 0; y < y2; y += cascade->step) {
-            for (int x = 0; x < x2; x += cascade->step) {
-                point_t p = {x, y};
-                // If an object is detected, record the coordinates of the filter window
-                if (run_cascade_classifier(cascade, p) > 0) {
-                    array_push_back(objects,
-                                    rectangle_alloc(fast_roundf(x * factor) + roi->x, fast_roundf(y * factor) + roi->y,
-                                                    fast_roundf(cascade->window.w * factor),
-                                                    fast_roundf(cascade->window.h * factor)));
-                }
-            }
+        detect_objects_scale(image, cascade, roi, szw, szh, factor, factor, roi->x, roi->y, objects);
+    }
 
-            // If not last line, shift integral images
-            if ((y + cascade->step) < y2) {
-                imlib_integral_mw_shift_ss(image, &sum, &ssq, roi, cascade->step);
-            }
+    imlib_integral_mw_free(&ssq);
+    imlib_integral_mw_free(&sum);
+
+    if (array_length(objects) > 1) {
+        // Merge objects detected at different scales
+        objects = rectangle_merge(objects);
+    }
+
+    return objects;
+}
+
+#ifdef IMLIB_ENABLE_PYRAMID
+array_t *imlib_detect_objects_pyramid(pyramid_t *pyr, cascade_t *cascade, rectangle_t *roi) {
+    // Integral images
+    mw_image_t sum;
+    mw_image_t ssq;
+
+    // Detected objects array
+    array_t *objects;
+
+    // Allocate the objects array
+    array_alloc(&objects, xfree);
+
+    // Set cascade image pointers
+    cascade->sum = &sum;
+    cascade->ssq = &ssq;
+
+    // Start with a step of 5% of the image width and scale it down with each level.
+    int step = (roi->w * 50) / 1000;
+
+    // Make sure step is less than window height + 1
+    if (step > cascade->window.h) {
+        step = cascade->window.h;
+    }
+
+    // Allocate integral images, level 0 has the widest ROI.
+    imlib_integral_mw_alloc(&sum, roi->w, cascade->window.h + 1);
+    imlib_integral_mw_alloc(&ssq, roi->w, cascade->window.h + 1);
+
+    // Iterate over the shared pyramid, each level is scanned at a 1:1 scale.
+    for (int i = 0; i < pyr->n_levels; i++) {
+        pyramid_level_t *level = &pyr->levels[i];
+        rectangle_t roi_scaled = {
+            .x = fast_roundf(roi->x / level->x_scale),
+            .y = fast_roundf(roi->y / level->y_scale),
+            .w = fast_roundf(roi->w / level->x_scale),
+            .h = fast_roundf(roi->h / level->y_scale)
+        };
+
+        roi_scaled.w = IM_MIN(roi_scaled.w, level->img.w - roi_scaled.x);
+        roi_scaled.h = IM_MIN(roi_scaled.h, level->img.h - roi_scaled.y);
+
+        // Break if scaled image is smaller than feature size
+        if (roi_scaled.w < cascade->window.w || roi_scaled.h < cascade->window.h) {
+            break;
         }
+
+        image_t *image = imlib_pyramid_level(pyr, i);
+        cascade->img = image;
+
+        // Set the integral images scale
+        imlib_integral_mw_scale(&roi_scaled, &sum, roi_scaled.w, roi_scaled.h);
+        imlib_integral_mw_scale(&roi_scaled, &ssq, roi_scaled.w, roi_scaled.h);
+
+        // Compute new integral images
+        imlib_integral_mw_ss(image, &sum, &ssq, &roi_scaled);
+
+        // Scale the scanning step
+        cascade->step = IM_MAX(fast_roundf(step / level->x_scale), 1);
+
+        // Process image at the current scale
+        detect_objects_scale(image, cascade, &roi_scaled, roi_scaled.w, roi_scaled.h,
+                             level->x_scale, level->y_scale,
+                             fast_roundf(roi_scaled.x * level->x_scale),
+                             fast_roundf(roi_scaled.y * level->y_scale), objects);
     }
 
     imlib_integral_mw_free(&ssq);
@@ -161,6 +245,7 @@ array_t *imlib_detect_objects(image_t *image, cascade_t *cascade, rectangle_t *r
 
     return objects;
 }
+#endif // IMLIB_ENABLE_PYRAMID
 
 #if defined(IMLIB_ENABLE_IMAGE_FILE_IO)
 int imlib_load_cascade_from_file(cascade_t *cascade, const char *path) {
@@ -9,267 +9,358 @@
  * Hough Transform feature extraction.
  */
 #include "imlib.h"
-
-#ifdef IMLIB_ENABLE_FIND_LINES
-void imlib_find_lines(list_t *out, image_t *ptr, rectangle_t *roi, unsigned int x_stride, unsigned int y_stride,
-                      uint32_t threshold, unsigned int theta_margin, unsigned int rho_margin) {
-    int r_diag_len, r_diag_len_div, theta_size, r_size, hough_divide = 1; // divides theta and rho accumulators
-
-    for (;;) {
-        // shrink to fit...
-        r_diag_len = fast_roundf(fast_sqrtf((roi->w * roi->w) + (roi->h * roi->h)));
-        r_diag_len_div = (r_diag_len + hough_divide - 1) / hough_divide;
-        theta_size = 1 + ((180 + hough_divide - 1) / hough_divide) + 1; // left & right padding
-        r_size = (r_diag_len_div * 2) + 1; // -r_diag_len to +r_diag_len
-        if ((sizeof(uint32_t) * theta_size * r_size) <= fb_avail()) {
-            break;
-        }
-        hough_divide = hough_divide << 1; // powers of 2...
-        if (hough_divide > 4) {
-            fb_alloc_fail();                   // support 1, 2, 4
-        }
+#include "simd.h"
+
+#if defined(IMLIB_ENABLE_FIND_LINES) || defined(IMLIB_ENABLE_FIND_CIRCLES)
+// Gradient rows are computed with a separable Sobel: the vertical [1 2 1] smooth and [1 0 -1]
+// difference are applied first, then the horizontal [1 0 -1] and [1 2 1] kernels. Grayscale
+// rows are cached in a three entry ring so each source row is only converted once.
+typedef struct hough_gradient {
+    image_t *ptr;
+    rectangle_t *roi;
+    int16_t *sv, *dv;   // Vertical smooth/difference.
+    int16_t *gx, *gy;   // Gradient, indexed by x - roi->x.
+    uint8_t *rows[3];
+    int row_y[3];
+} hough_gradient_t;
+
+static void hough_gradient_alloc(hough_gradient_t *g, image_t *ptr, rectangle_t *roi) {
+    int w = roi->w;
+    int16_t *buf = fb_alloc((sizeof(int16_t) * 4 * w) + (sizeof(uint8_t) * 3 * w), FB_ALLOC_NO_HINT);
+
+    g->ptr = ptr;
+    g->roi = roi;
+    g->sv = buf;
+    g->dv = buf + w;
+    g->gx = buf + (w * 2);
+    g->gy = buf + (w * 3);
+
+    for (int i = 0; i < 3; i++) {
+        g->rows[i] = ((uint8_t *) (buf + (w * 4))) + (w * i);
+        g->row_y[i] = -1;
     }
+}
 
-    uint32_t *acc = fb_alloc0(sizeof(uint32_t) * theta_size * r_size, FB_ALLOC_NO_HINT);
-
-    switch (ptr->pixfmt) {
-        case PIXFORMAT_BINARY: {
-            for (int y = roi->y + 1, yy = roi->y + roi->h - 1; y < yy; y += y_stride) {
-                uint32_t *row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(ptr, y);
-                for (int x = roi->x + (y % x_stride) + 1, xx = roi->x + roi->w - 1; x < xx; x += x_stride) {
-                    int pixel; // Sobel Algorithm Below
-                    int x_acc = 0;
-                    int y_acc = 0;
-
-                    row_ptr -= ((ptr->w + UINT32_T_MASK) >> UINT32_T_SHIFT);
-
-                    pixel = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x - 1));
-                    x_acc += pixel * +1; // x[0,0] -> pixel * +1
-                    y_acc += pixel * +1; // y[0,0] -> pixel * +1
-
-                    pixel = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x));
-                    // x[0,1] -> pixel * 0
-                    y_acc += pixel * +2; // y[0,1] -> pixel * +2
-
-                    pixel = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x + 1));
-                    x_acc += pixel * -1; // x[0,2] -> pixel * -1
-                    y_acc += pixel * +1; // y[0,2] -> pixel * +1
-
-                    row_ptr += ((ptr->w + UINT32_T_MASK) >> UINT32_T_SHIFT);
-
-                    pixel = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x - 1));
-                    x_acc += pixel * +2; // x[1,0] -> pixel * +2
-                                         // y[1,0] -> pixel * 0
-
-                    // pixel = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x));
-                    // x[1,1] -> pixel * 0
-                    // y[1,1] -> pixel * 0
-
-                    pixel = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x + 1));
-                    x_acc += pixel * -2; // x[1,2] -> pixel * -2
-                                         // y[1,2] -> pixel * 0
-
-                    row_ptr += ((ptr->w + UINT32_T_MASK) >> UINT32_T_SHIFT);
-
-                    pixel = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x - 1));
-                    x_acc += pixel * +1; // x[2,0] -> pixel * +1
-                    y_acc += pixel * -1; // y[2,0] -> pixel * -1
-
-                    pixel = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x));
-                    // x[2,1] -> pixel * 0
-                    y_acc += pixel * -2; // y[2,1] -> pixel * -2
+static void hough_gradient_free() {
+    fb_free(); // buf
+}
 
-                    pixel = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x + 1));
-                    x_acc += pixel * -1; // x[2,2] -> pixel * -1
-                    y_acc += pixel * -1; // y[2,2] -> pixel * -1
+static uint8_t *hough_gradient_gray_row(hough_gradient_t *g, int y) {
+    int slot = y % 3;
+    uint8_t *out = g->rows[slot];
 
-                    row_ptr -= ((ptr->w + UINT32_T_MASK) >> UINT32_T_SHIFT);
+    if (g->row_y[slot] == y) {
+        return out;
+    }
 
-                    int mag = (abs(x_acc) + abs(y_acc)) / 2;
-                    if (mag < 126) {
-                        continue;
-                    }
+    g->row_y[slot] = y;
 
-                    int theta = fast_roundf((x_acc ? fast_atan2f(y_acc, x_acc) : 1.570796f) * 57.295780) % 180; // * (180 / PI)
-                    if (theta < 0) {
-                        theta += 180;
-                    }
-                    int rho = (fast_roundf(((x - roi->x) * cos_table[theta]) +
-                                           ((y - roi->y) * sin_table[theta])) / hough_divide) + r_diag_len_div;
-                    int acc_index = (rho * theta_size) + ((theta / hough_divide) + 1); // add offset
-                    acc[acc_index] += mag;
-                }
+    switch (g->ptr->pixfmt) {
+        case PIXFORMAT_BINARY: {
+            uint32_t *row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(g->ptr, y);
+            for (int x = 0; x < g->roi->w; x++) {
+                out[x] = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, g->roi->x + x));
             }
             break;
         }
         case PIXFORMAT_GRAYSCALE: {
-            for (int y = roi->y + 1, yy = roi->y + roi->h - 1; y < yy; y += y_stride) {
-                uint8_t *row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(ptr, y);
-                for (int x = roi->x + (y % x_stride) + 1, xx = roi->x + roi->w - 1; x < xx; x += x_stride) {
-                    int pixel; // Sobel Algorithm Below
-                    int x_acc = 0;
-                    int y_acc = 0;
-
-                    row_ptr -= ptr->w;
-
-                    pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x - 1);
-                    x_acc += pixel * +1; // x[0,0] -> pixel * +1
-                    y_acc += pixel * +1; // y[0,0] -> pixel * +1
-
-                    pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x);
-                    // x[0,1] -> pixel * 0
-                    y_acc += pixel * +2; // y[0,1] -> pixel * +2
+            memcpy(out, IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(g->ptr, y) + g->roi->x, g->roi->w);
+            break;
+        }
+        case PIXFORMAT_RGB565: {
+            uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(g->ptr, y) + g->roi->x;
+            for (int x = 0; x < g->roi->w; x++) {
+                out[x] = COLOR_RGB565_TO_GRAYSCALE(row_ptr[x]);
+            }
+            break;
+        }
+        default: {
+            // Unsupported formats produce no gradient (and so no votes).
+            memset(out, 0, g->roi->w);
+            break;
+        }
+    }
 
-                    pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x + 1);
-                    x_acc += pixel * -1; // x[0,2] -> pixel * -1
-                    y_acc += pixel * +1; // y[0,2] -> pixel * +1
+    return out;
+}
 
-                    row_ptr += ptr->w;
+// Computes gx/gy for image row y (roi->y < y < roi->y + roi->h - 1). The signs match the
+// 3x3 kernels used before: gx = left - right, gy = top - bottom.
+static void hough_gradient_row(hough_gradient_t *g, int y) {
+    const uint8_t *r0 = hough_gradient_gray_row(g, y - 1);
+    const uint8_t *r1 = hough_gradient_gray_row(g, y);
+    const uint8_t *r2 = hough_gradient_gray_row(g, y + 1);
+    int16_t *sv = g->sv, *dv = g->dv, *gx = g->gx, *gy = g->gy;
+    int w = g->roi->w, x = 0;
+
+    for (; x <= (w - VEC_LANES); x += VEC_LANES) {
+        vec_s16_t a = VEC_U8_TO_S16(VEC_LOAD(vec_u8_t, r0 + x));
+        vec_s16_t b = VEC_U8_TO_S16(VEC_LOAD(vec_u8_t, r1 + x));
+        vec_s16_t c = VEC_U8_TO_S16(VEC_LOAD(vec_u8_t, r2 + x));
+        VEC_STORE(sv + x, a + (b * 2) + c);
+        VEC_STORE(dv + x, a - c);
+    }
 
-                    pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x - 1);
-                    x_acc += pixel * +2; // x[1,0] -> pixel * +2
-                                         // y[1,0] -> pixel * 0
+    for (; x < w; x++) {
+        sv[x] = r0[x] + (r1[x] * 2) + r2[x];
+        dv[x] = r0[x] - r2[x];
+    }
 
-                    // pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x);
-                    // x[1,1] -> pixel * 0
-                    // y[1,1] -> pixel * 0
+    gx[0] = gy[0] = gx[w - 1] = gy[w - 1] = 0;
 
-                    pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x + 1);
-                    x_acc += pixel * -2; // x[1,2] -> pixel * -2
-                                         // y[1,2] -> pixel * 0
+    for (x = 1; x <= (w - 1 - VEC_LANES); x += VEC_LANES) {
+        vec_s16_t sl = VEC_LOAD(vec_s16_t, sv + x - 1);
+        vec_s16_t sr = VEC_LOAD(vec_s16_t, sv + x + 1);
+        vec_s16_t dl = VEC_LOAD(vec_s16_t, dv + x - 1);
+        vec_s16_t dm = VEC_LOAD(vec_s16_t, dv + x);
+        vec_s16_t dr = VEC_LOAD(vec_s16_t, dv + x + 1);
+        VEC_STORE(gx + x, sl - sr);
+        VEC_STORE(gy + x, dl + (dm * 2) + dr);
+    }
 
-                    row_ptr += ptr->w;
+    for (; x < (w - 1); x++) {
+        gx[x] = sv[x - 1] - sv[x + 1];
+        gy[x] = dv[x - 1] + (dv[x] * 2) + dv[x + 1];
+    }
+}
 
-                    pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x - 1);
-                    x_acc += pixel * +1; // x[2,0] -> pixel * +1
-                    y_acc += pixel * -1; // y[2,0] -> pixel * -1
+typedef struct hough_peak {
+    int x, y;
+    uint32_t value;
+} hough_peak_t;
 
-                    pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x);
-                    // x[2,1] -> pixel * 0
-                    y_acc += pixel * -2; // y[2,1] -> pixel * -2
+// Non-maximum suppression over a w x h accumulator with a one cell border. Emits every cell
+// >= threshold that is >= its 8 neighbors. Runs of cells below the threshold (nearly all of
+// them) are rejected a vector at a time before the neighborhood is examined.
+static void hough_find_peaks(list_t *out, uint32_t *acc, int w, int h, uint32_t threshold) {
+    list_init(out, sizeof(hough_peak_t));
 
-                    pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x + 1);
-                    x_acc += pixel * -1; // x[2,2] -> pixel * -1
-                    y_acc += pixel * -1; // y[2,2] -> pixel * -1
+    for (int y = 1, yy = h - 1; y < yy; y++) {
+        uint32_t *row_ptr = acc + (w * y);
 
-                    row_ptr -= ptr->w;
+        for (int x = 1, xx = w - 1; x < xx; ) {
+            if (x <= (xx - VEC_LANES)) {
+                vec_u32_t v = VEC_LOAD(vec_u32_t, row_ptr + x);
+                vec_u32_t m = (vec_u32_t) (v >= threshold);
+                uint32_t any = 0;
 
-                    int mag = (abs(x_acc) + abs(y_acc)) / 2;
-                    if (mag < 126) {
-                        continue;
-                    }
+                for (int i = 0; i < VEC_LANES; i++) {
+                    any |= m[i];
+                }
 
-                    int theta = fast_roundf((x_acc ? fast_atan2f(y_acc, x_acc) : 1.570796f) * 57.295780) % 180; // * (180 / PI)
-                    if (theta < 0) {
-                        theta += 180;
-                    }
-                    int rho = (fast_roundf(((x - roi->x) * cos_table[theta]) +
-                                           ((y - roi->y) * sin_table[theta])) / hough_divide) + r_diag_len_div;
-                    int acc_index = (rho * theta_size) + ((theta / hough_divide) + 1); // add offset
-                    acc[acc_index] += mag;
+                if (!any) {
+                    x += VEC_LANES;
+                    continue;
                 }
             }
-            break;
+
+            uint32_t val = row_ptr[x];
+
+            if ((val >= threshold)
+                && (val >= row_ptr[x - w - 1])
+                && (val >= row_ptr[x - w])
+                && (val >= row_ptr[x - w + 1])
+                && (val >= row_ptr[x - 1])
+                && (val >= row_ptr[x + 1])
+                && (val >= row_ptr[x + w - 1])
+                && (val >= row_ptr[x + w])
+                && (val >= row_ptr[x + w + 1])) {
+                hough_peak_t peak = { .x = x, .y = y, .value = val };
+                list_push_back(out, &peak);
+            }
+
+            x++;
         }
-        case PIXFORMAT_RGB565: {
-            for (int y = roi->y + 1, yy = roi->y + roi->h - 1; y < yy; y += y_stride) {
-                uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(ptr, y);
-                for (int x = roi->x + (y % x_stride) + 1, xx = roi->x + roi->w - 1; x < xx; x += x_stride) {
-                    int pixel; // Sobel Algorithm Below
-                    int x_acc = 0;
-                    int y_acc = 0;
+    }
+}
+#endif // IMLIB_ENABLE_FIND_LINES || IMLIB_ENABLE_FIND_CIRCLES
 
-                    row_ptr -= ptr->w;
+#ifdef IMLIB_ENABLE_FIND_LINES
+typedef struct hough_point {
+    int16_t x, y;
+    uint16_t theta;
+    uint16_t magnitude;
+} hough_point_t;
+
+// Lines confirmed by the probabilistic mode, later edge points on them no longer vote.
+#define HOUGH_MAX_CONFIRMED_LINES   (64)
+
+// Returns a step that is coprime with n so that (i * step) % n visits every point once in a
+// scattered order.
+static size_t hough_coprime_step(size_t n) {
+    size_t step = (n > 1) ? (7919 % n) : 1;
+
+    for (step = IM_MAX(step, 1U); ; step++) {
+        size_t a = step, b = n;
+        while (b) {
+            size_t t = a % b;
+            a = b;
+            b = t;
+        }
+        if (a == 1) {
+            return step;
+        }
+    }
+}
 
-                    pixel = COLOR_RGB565_TO_GRAYSCALE(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x - 1));
-                    x_acc += pixel * +1; // x[0,0] -> pixel * +1
-                    y_acc += pixel * +1; // y[0,0] -> pixel * +1
+void imlib_find_lines(list_t *out, image_t *ptr, rectangle_t *roi, unsigned int x_stride, unsigned int y_stride,
+                      uint32_t threshold, unsigned int theta_margin, unsigned int rho_margin,
+                      unsigned int theta_window, bool probabilistic) {
+    int r_diag_len, r_diag_len_div, theta_size, r_size, hough_divide = 1; // divides theta and rho accumulators
+    for (;;) {
+        // shrink to fit...
+        r_diag_len = fast_roundf(fast_sqrtf((roi->w * roi->w) + (roi->h * roi->h)));
+        r_diag_len_div = (r_diag_len + hough_divide - 1) / hough_divide;
+        theta_size = 1 + ((180 + hough_divide - 1) / hough_divide) + 1; // left & right padding
+        r_size = (r_diag_len_div * 2) + 1; // -r_diag_len to +r_diag_len
+        if ((sizeof(uint32_t) * theta_size * r_size) <= fb_avail()) {
+            break;
+        }
+        hough_divide = hough_divide << 1; // powers of 2...
+        if (hough_divide > 4) {
+            fb_alloc_fail();                   // support 1, 2, 4
+        }
+    }
 
-                    pixel = COLOR_RGB565_TO_GRAYSCALE(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x));
-                    // x[0,1] -> pixel * 0
-                    y_acc += pixel * +2; // y[0,1] -> pixel * +2
+    theta_window = IM_MIN(theta_window, 89U);
 
-                    pixel = COLOR_RGB565_TO_GRAYSCALE(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x + 1));
-                    x_acc += pixel * -1; // x[0,2] -> pixel * -1
-                    y_acc += pixel * +1; // y[0,2] -> pixel * +1
+    // Not kept between calls: a buffer outside the frame buffer would never be released and
+    // its size would not follow the roi. Clearing it here costs one memset per call.
+    uint32_t *acc = fb_alloc0(sizeof(uint32_t) * theta_size * r_size, FB_ALLOC_NO_HINT);
 
-                    row_ptr += ptr->w;
+    hough_gradient_t grad;
+    hough_gradient_alloc(&grad, ptr, roi);
+
+    find_lines_list_lnk_data_t *confirmed = NULL;
+    hough_point_t *points = NULL;
+    size_t points_max = 0, points_count = 0;
+
+    if (probabilistic) {
+        // Edge points are collected first and voted on in a shuffled order, points beyond what
+        // fits in the frame buffer are dropped.
+        confirmed = fb_alloc(sizeof(find_lines_list_lnk_data_t) * HOUGH_MAX_CONFIRMED_LINES, FB_ALLOC_NO_HINT);
+        size_t n = ((roi->w / x_stride) + 1) * ((roi->h / y_stride) + 1);
+        size_t avail = fb_avail();
+        points_max = IM_MIN(n, ((avail > 64) ? (avail - 64) : 0) / sizeof(hough_point_t));
+        points = fb_alloc(IM_MAX(points_max, 1U) * sizeof(hough_point_t), FB_ALLOC_NO_HINT);
+    }
 
-                    pixel = COLOR_RGB565_TO_GRAYSCALE(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x - 1));
-                    x_acc += pixel * +2; // x[1,0] -> pixel * +2
-                                         // y[1,0] -> pixel * 0
+    for (int y = roi->y + 1, yy = roi->y + roi->h - 1; y < yy; y += y_stride) {
+        hough_gradient_row(&grad, y);
 
-                    // pixel = COLOR_RGB565_TO_GRAYSCALE(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x));
-                    // x[1,1] -> pixel * 0
-                    // y[1,1] -> pixel * 0
+        for (int x = roi->x + (y % x_stride) + 1, xx = roi->x + roi->w - 1; x < xx; x += x_stride) {
+            int x_acc = grad.gx[x - roi->x];
+            int y_acc = grad.gy[x - roi->x];
 
-                    pixel = COLOR_RGB565_TO_GRAYSCALE(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x + 1));
-                    x_acc += pixel * -2; // x[1,2] -> pixel * -2
-                                         // y[1,2] -> pixel * 0
+            int mag = (abs(x_acc) + abs(y_acc)) / 2;
+            if (mag < 126) {
+                continue;
+            }
 
-                    row_ptr += ptr->w;
+            int theta = fast_roundf((x_acc ? fast_atan2f(y_acc, x_acc) : 1.570796f) * 57.295780) % 180; // * (180 / PI)
+            if (theta < 0) {
+                theta += 180;
+            }
 
-                    pixel = COLOR_RGB565_TO_GRAYSCALE(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x - 1));
-                    x_acc += pixel * +1; // x[2,0] -> pixel * +1
-                    y_acc += pixel * -1; // y[2,0] -> pixel * -1
+            if (probabilistic) {
+                if (points_count < points_max) {
+                    hough_point_t p = { .x = x - roi->x, .y = y - roi->y, .theta = theta, .magnitude = mag };
+                    points[points_count++] = p;
+                }
+                continue;
+            }
 
-                    pixel = COLOR_RGB565_TO_GRAYSCALE(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x));
-                    // x[2,1] -> pixel * 0
-                    y_acc += pixel * -2; // y[2,1] -> pixel * -2
+            // Vote inside a window around the gradient direction. Angles that wrap around 180
+            // describe the same line with a negated rho which the tables take care of.
+            for (int t = theta - ((int) theta_window), tt = theta + theta_window; t <= tt; t++) {
+                int tw = (t < 0) ? (t + 180) : ((t >= 180) ? (t - 180) : t);
+                int rho = (fast_roundf(((x - roi->x) * cos_table[tw]) +
+                                       ((y - roi->y) * sin_table[tw])) / hough_divide) + r_diag_len_div;
+                int acc_index = (rho * theta_size) + ((tw / hough_divide) + 1); // add offset
+                acc[acc_index] += mag;
+            }
+        }
+    }
 
-                    pixel = COLOR_RGB565_TO_GRAYSCALE(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x + 1));
-                    x_acc += pixel * -1; // x[2,2] -> pixel * -1
-                    y_acc += pixel * -1; // y[2,2] -> pixel * -1
+    list_init(out, sizeof(find_lines_list_lnk_data_t));
 
-                    row_ptr -= ptr->w;
+    if (probabilistic) {
+        // Progressive probabilistic Hough: points vote in a random order and a line is confirmed
+        // as soon as one of its cells reaches the threshold. Edge points that lie on a confirmed
+        // line are then skipped, so long lines stop voting once they are found.
+        int n_confirmed = 0;
+        size_t step = hough_coprime_step(points_count);
+
+        for (size_t i = 0, j = 0; (i < points_count) && (n_confirmed < HOUGH_MAX_CONFIRMED_LINES); i++) {
+            hough_point_t *p = points + j;
+            bool skip = false;
+            j = (j + step) % points_count;
+
+            for (int k = 0; k < n_confirmed; k++) {
+                int theta_diff = abs(((int) p->theta) - confirmed[k].theta);
+                theta_diff = IM_MIN(theta_diff, 180 - theta_diff);
+                int rho = fast_roundf((p->x * cos_table[confirmed[k].theta]) + (p->y * sin_table[confirmed[k].theta]));
+                if ((theta_diff <= ((int) theta_window + hough_divide))
+                    && (abs(rho - confirmed[k].rho) <= (hough_divide * 2))) {
+                    skip = true;
+                    break;
+                }
+            }
 
-                    int mag = (abs(x_acc) + abs(y_acc)) / 2;
-                    if (mag < 126) {
-                        continue;
-                    }
+            if (skip) {
+                continue;
+            }
 
-                    int theta = fast_roundf((x_acc ? fast_atan2f(y_acc, x_acc) : 1.570796f) * 57.295780) % 180; // * (180 / PI)
-                    if (theta < 0) {
-                        theta += 180;
+            for (int t = p->theta - ((int) theta_window), tt = p->theta + theta_window; t <= tt; t++) {
+                int tw = (t < 0) ? (t + 180) : ((t >= 180) ? (t - 180) : t);
+                int rho = (fast_roundf((p->x * cos_table[tw]) + (p->y * sin_table[tw])) / hough_divide) + r_diag_len_div;
+                int theta_index = (tw / hough_divide) + 1; // add offset
+                uint32_t *cell = acc + (rho * theta_size) + theta_index;
+                *cell += p->magnitude;
+
+                if ((*cell >= threshold) && (n_confirmed < HOUGH_MAX_CONFIRMED_LINES)) {
+                    find_lines_list_lnk_data_t lnk_line;
+                    memset(&lnk_line, 0, sizeof(find_lines_list_lnk_data_t));
+
+                    lnk_line.magnitude = *cell;
+                    lnk_line.theta = (theta_index - 1) * hough_divide; // remove offset
+                    lnk_line.rho = (rho - r_diag_len_div) * hough_divide;
+
+                    confirmed[n_confirmed++] = lnk_line;
+                    list_push_back(out, &lnk_line);
+
+                    // Remove the votes around the peak so it is not confirmed twice.
+                    for (int dy = -1; dy <= 1; dy++) {
+                        if (((rho + dy) >= 0) && ((rho + dy) < r_size)) {
+                            memset(cell + (dy * theta_size) - 1, 0, sizeof(uint32_t) * 3);
+                        }
                     }
-                    int rho = (fast_roundf(((x - roi->x) * cos_table[theta]) +
-                                           ((y - roi->y) * sin_table[theta])) / hough_divide) + r_diag_len_div;
-                    int acc_index = (rho * theta_size) + ((theta / hough_divide) + 1); // add offset
-                    acc[acc_index] += mag;
+                    break;
                 }
             }
-            break;
-        }
-        default: {
-            break;
         }
-    }
 
-    list_init(out, sizeof(find_lines_list_lnk_data_t));
+        fb_free(); // points
+        fb_free(); // confirmed
+        hough_gradient_free();
+    } else {
+        hough_gradient_free();
 
-    for (int y = 1, yy = r_size - 1; y < yy; y++) {
-        uint32_t *row_ptr = acc + (theta_size * y);
+        list_t peaks;
+        hough_find_peaks(&peaks, acc, theta_size, r_size, threshold);
 
-        for (int x = 1, xx = theta_size - 1; x < xx; x++) {
-            if ((row_ptr[x] >= threshold)
-                && (row_ptr[x] >= row_ptr[x - theta_size - 1])
-                && (row_ptr[x] >= row_ptr[x - theta_size])
-                && (row_ptr[x] >= row_ptr[x - theta_size + 1])
-                && (row_ptr[x] >= row_ptr[x - 1])
-                && (row_ptr[x] >= row_ptr[x + 1])
-                && (row_ptr[x] >= row_ptr[x + theta_size - 1])
-                && (row_ptr[x] >= row_ptr[x + theta_size])
-                && (row_ptr[x] >= row_ptr[x + theta_size + 1])) {
+        while (list_size(&peaks)) {
+            hough_peak_t peak;
+            list_pop_front(&peaks, &peak);
 
-                find_lines_list_lnk_data_t lnk_line;
-                memset(&lnk_line, 0, sizeof(find_lines_list_lnk_data_t));
+            find_lines_list_lnk_data_t lnk_line;
+            memset(&lnk_line, 0, sizeof(find_lines_list_lnk_data_t));
 
-                lnk_line.magnitude = row_ptr[x];
-                lnk_line.theta = (x - 1) * hough_divide; // remove offset
-                lnk_line.rho = (y - r_diag_len_div) * hough_divide;
+            lnk_line.magnitude = peak.value;
+            lnk_line.theta = (peak.x - 1) * hough_divide; // remove offset
+            lnk_line.rho = (peak.y - r_diag_len_div) * hough_divide;
 
-                list_push_back(out, &lnk_line);
-            }
+            list_push_back(out, &lnk_line);
         }
     }
 
@@ -392,7 +483,7 @@ void imlib_find_line_segments(list_t *out, image_t *ptr, rectangle_t *roi, unsig
     const unsigned int max_gap_pixels = 5;
 
     list_t temp_out;
-    imlib_find_lines(&temp_out, ptr, roi, x_stride, y_stride, threshold, theta_margin, rho_margin);
+    imlib_find_lines(&temp_out, ptr, roi, x_stride, y_stride, threshold, theta_margin, rho_margin, 0, false);
     list_init(out, sizeof(find_lines_list_lnk_data_t));
 
     const int r_diag_len = fast_roundf(fast_sqrtf((roi->w * roi->w) + (roi->h * roi->h))) * 2;
@@ -489,207 +580,30 @@ void imlib_find_circles(list_t *out, image_t *ptr, rectangle_t *roi, unsigned in
     uint16_t *theta_acc = fb_alloc0(sizeof(uint16_t) * roi->w * roi->h, FB_ALLOC_NO_HINT);
     uint16_t *magnitude_acc = fb_alloc0(sizeof(uint16_t) * roi->w * roi->h, FB_ALLOC_NO_HINT);
 
-    switch (ptr->pixfmt) {
-        case PIXFORMAT_BINARY: {
-            for (int y = roi->y + 1, yy = roi->y + roi->h - 1; y < yy; y += y_stride) {
-                uint32_t *row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(ptr, y);
-                for (int x = roi->x + (y % x_stride) + 1, xx = roi->x + roi->w - 1; x < xx; x += x_stride) {
-                    int pixel; // Sobel Algorithm Below
-                    int x_acc = 0;
-                    int y_acc = 0;
-
-                    row_ptr -= ((ptr->w + UINT32_T_MASK) >> UINT32_T_SHIFT);
-
-                    pixel = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x - 1));
-                    x_acc += pixel * +1; // x[0,0] -> pixel * +1
-                    y_acc += pixel * +1; // y[0,0] -> pixel * +1
-
-                    pixel = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x));
-                    // x[0,1] -> pixel * 0
-                    y_acc += pixel * +2; // y[0,1] -> pixel * +2
-
-                    pixel = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x + 1));
-                    x_acc += pixel * -1; // x[0,2] -> pixel * -1
-                    y_acc += pixel * +1; // y[0,2] -> pixel * +1
-
-                    row_ptr += ((ptr->w + UINT32_T_MASK) >> UINT32_T_SHIFT);
-
-                    pixel = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x - 1));
-                    x_acc += pixel * +2; // x[1,0] -> pixel * +2
-                                         // y[1,0] -> pixel * 0
-
-                    // pixel = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x));
-                    // x[1,1] -> pixel * 0
-                    // y[1,1] -> pixel * 0
-
-                    pixel = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x + 1));
-                    x_acc += pixel * -2; // x[1,2] -> pixel * -2
-                                         // y[1,2] -> pixel * 0
-
-                    row_ptr += ((ptr->w + UINT32_T_MASK) >> UINT32_T_SHIFT);
-
-                    pixel = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x - 1));
-                    x_acc += pixel * +1; // x[2,0] -> pixel * +1
-                    y_acc += pixel * -1; // y[2,0] -> pixel * -1
-
-                    pixel = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x));
-                    // x[2,1] -> pixel * 0
-                    y_acc += pixel * -2; // y[2,1] -> pixel * -2
-
-                    pixel = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, x + 1));
-                    x_acc += pixel * -1; // x[2,2] -> pixel * -1
-                    y_acc += pixel * -1; // y[2,2] -> pixel * -1
-
-                    row_ptr -= ((ptr->w + UINT32_T_MASK) >> UINT32_T_SHIFT);
-
-                    int theta = fast_roundf((x_acc ? fast_atan2f(y_acc, x_acc) : 1.570796f) * 57.295780) % 360; // * (180 / PI)
-                    if (theta < 0) {
-                        theta += 360;
-                    }
-                    int magnitude = fast_roundf(fast_sqrtf((x_acc * x_acc) + (y_acc * y_acc)));
-                    int index = (roi->w * (y - roi->y)) + (x - roi->x);
-
-                    theta_acc[index] = theta;
-                    magnitude_acc[index] = magnitude;
-                }
-            }
-            break;
-        }
-        case PIXFORMAT_GRAYSCALE: {
-            for (int y = roi->y + 1, yy = roi->y + roi->h - 1; y < yy; y += y_stride) {
-                uint8_t *row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(ptr, y);
-                for (int x = roi->x + (y % x_stride) + 1, xx = roi->x + roi->w - 1; x < xx; x += x_stride) {
-                    int pixel; // Sobel Algorithm Below
-                    int x_acc = 0;
-                    int y_acc = 0;
-
-                    row_ptr -= ptr->w;
-
-                    pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x - 1);
-                    x_acc += pixel * +1; // x[0,0] -> pixel * +1
-                    y_acc += pixel * +1; // y[0,0] -> pixel * +1
-
-                    pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x);
-                    // x[0,1] -> pixel * 0
-                    y_acc += pixel * +2; // y[0,1] -> pixel * +2
-
-                    pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x + 1);
-                    x_acc += pixel * -1; // x[0,2] -> pixel * -1
-                    y_acc += pixel * +1; // y[0,2] -> pixel * +1
-
-                    row_ptr += ptr->w;
-
-                    pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x - 1);
-                    x_acc += pixel * +2; // x[1,0] -> pixel * +2
-                                         // y[1,0] -> pixel * 0
-
-                    // pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x);
-                    // x[1,1] -> pixel * 0
-                    // y[1,1] -> pixel * 0
-
-                    pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x + 1);
-                    x_acc += pixel * -2; // x[1,2] -> pixel * -2
-                                         // y[1,2] -> pixel * 0
-
-                    row_ptr += ptr->w;
-
-                    pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x - 1);
-                    x_acc += pixel * +1; // x[2,0] -> pixel * +1
-                    y_acc += pixel * -1; // y[2,0] -> pixel * -1
+    hough_gradient_t grad;
+    hough_gradient_alloc(&grad, ptr, roi);
 
-                    pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x);
-                    // x[2,1] -> pixel * 0
-                    y_acc += pixel * -2; // y[2,1] -> pixel * -2
+    for (int y = roi->y + 1, yy = roi->y + roi->h - 1; y < yy; y += y_stride) {
+        hough_gradient_row(&grad, y);
 
-                    pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x + 1);
-                    x_acc += pixel * -1; // x[2,2] -> pixel * -1
-                    y_acc += pixel * -1; // y[2,2] -> pixel * -1
+        for (int x = roi->x + (y % x_stride) + 1, xx = roi->x + roi->w - 1; x < xx; x += x_stride) {
+            int x_acc = grad.gx[x - roi->x];
+            int y_acc = grad.gy[x - roi->x];
 
-                    row_ptr -= ptr->w;
-
-                    int theta = fast_roundf((x_acc ? fast_atan2f(y_acc, x_acc) : 1.570796f) * 57.295780) % 360; // * (180 / PI)
-                    if (theta < 0) {
-                        theta += 360;
-                    }
-                    int magnitude = fast_roundf(fast_sqrtf((x_acc * x_acc) + (y_acc * y_acc)));
-                    int index = (roi->w * (y - roi->y)) + (x - roi->x);
-
-                    theta_acc[index] = theta;
-                    magnitude_acc[index] = magnitude;
-                }
+            int theta = fast_roundf((x_acc ? fast_atan2f(y_acc, x_acc) : 1.570796f) * 57.295780) % 360; // * (180 / PI)
+            if (theta < 0) {
+                theta += 360;
             }
-            break;
-        }
-        case PIXFORMAT_RGB565: {
-            for (int y = roi->y + 1, yy = roi->y + roi->h - 1; y < yy; y += y_stride) {
-                uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(ptr, y);
-                for (int x = roi->x + (y % x_stride) + 1, xx = roi->x + roi->w - 1; x < xx; x += x_stride) {
-                    int pixel; // Sobel Algorithm Below
-                    int x_acc = 0;
-                    int y_acc = 0;
-
-                    row_ptr -= ptr->w;
-
-                    pixel = COLOR_RGB565_TO_GRAYSCALE(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x - 1));
-                    x_acc += pixel * +1; // x[0,0] -> pixel * +1
-                    y_acc += pixel * +1; // y[0,0] -> pixel * +1
-
-                    pixel = COLOR_RGB565_TO_GRAYSCALE(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x));
-                    // x[0,1] -> pixel * 0
-                    y_acc += pixel * +2; // y[0,1] -> pixel * +2
-
-                    pixel = COLOR_RGB565_TO_GRAYSCALE(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x + 1));
-                    x_acc += pixel * -1; // x[0,2] -> pixel * -1
-                    y_acc += pixel * +1; // y[0,2] -> pixel * +1
-
-                    row_ptr += ptr->w;
-
-                    pixel = COLOR_RGB565_TO_GRAYSCALE(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x - 1));
-                    x_acc += pixel * +2; // x[1,0] -> pixel * +2
-                                         // y[1,0] -> pixel * 0
+            int magnitude = fast_roundf(fast_sqrtf((x_acc * x_acc) + (y_acc * y_acc)));
+            int index = (roi->w * (y - roi->y)) + (x - roi->x);
 
-                    // pixel = COLOR_RGB565_TO_GRAYSCALE(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x));
-                    // x[1,1] -> pixel * 0
-                    // y[1,1] -> pixel * 0
-
-                    pixel = COLOR_RGB565_TO_GRAYSCALE(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x + 1));
-                    x_acc += pixel * -2; // x[1,2] -> pixel * -2
-                                         // y[1,2] -> pixel * 0
-
-                    row_ptr += ptr->w;
-
-                    pixel = COLOR_RGB565_TO_GRAYSCALE(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x - 1));
-                    x_acc += pixel * +1; // x[2,0] -> pixel * +1
-                    y_acc += pixel * -1; // y[2,0] -> pixel * -1
-
-                    pixel = COLOR_RGB565_TO_GRAYSCALE(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x));
-                    // x[2,1] -> pixel * 0
-                    y_acc += pixel * -2; // y[2,1] -> pixel * -2
-
-                    pixel = COLOR_RGB565_TO_GRAYSCALE(IMAGE_GET_RGB565_PIXEL_FAST(row_ptr, x + 1));
-                    x_acc += pixel * -1; // x[2,2] -> pixel * -1
-                    y_acc += pixel * -1; // y[2,2] -> pixel * -1
-
-                    row_ptr -= ptr->w;
-
-                    int theta = fast_roundf((x_acc ? fast_atan2f(y_acc, x_acc) : 1.570796f) * 57.295780) % 360; // * (180 / PI)
-                    if (theta < 0) {
-                        theta += 360;
-                    }
-                    int magnitude = fast_roundf(fast_sqrtf((x_acc * x_acc) + (y_acc * y_acc)));
-                    int index = (roi->w * (y - roi->y)) + (x - roi->x);
-
-                    theta_acc[index] = theta;
-                    magnitude_acc[index] = magnitude;
-                }
-            }
-            break;
-        }
-        default: {
-            break;
+            theta_acc[index] = theta;
+            magnitude_acc[index] = magnitude;
         }
     }
 
+    hough_gradient_free();
+
     // Theta Direction (% 180)
     //
     // 0,0         X_MAX
@@ -712,6 +626,30 @@ void imlib_find_circles(list_t *out, image_t *ptr, rectangle_t *roi, unsigned in
 
     list_init(out, sizeof(find_circles_list_lnk_data_t));
 
+    // The accumulator is allocated once for the smallest radius (the largest search window)
+    // and reused for every other radius.
+    int16_t *rcos = fb_alloc(sizeof(int16_t) * 360, FB_ALLOC_NO_HINT);
+    int16_t *rsin = fb_alloc(sizeof(int16_t) * 360, FB_ALLOC_NO_HINT);
+    uint32_t acc_max_size = 0;
+    uint32_t *acc = NULL;
+
+    if (r_min < r_max) {
+        for (int hough_divide = 1; ; hough_divide <<= 1) {
+            // shrink to fit...
+            int a_size = 1 + ((roi->w - (2 * r_min) + hough_divide - 1) / hough_divide) + 1; // left & right padding
+            int b_size = 1 + ((roi->h - (2 * r_min) + hough_divide - 1) / hough_divide) + 1; // top & bottom padding
+            acc_max_size = sizeof(uint32_t) * a_size * b_size;
+            if (acc_max_size <= fb_avail()) {
+                break;
+            }
+            if (hough_divide >= 4) {
+                fb_alloc_fail();                   // support 1, 2, 4
+            }
+        }
+
+        acc = fb_alloc(acc_max_size, FB_ALLOC_NO_HINT);
+    }
+
     for (int r = r_min, rr = r_max; r < rr; r += r_step) {
         // ignore r = 0/1
         int a_size, b_size, hough_divide = 1; // divides a and b accumulators
@@ -723,19 +661,14 @@ void imlib_find_circles(list_t *out, image_t *ptr, rectangle_t *roi, unsigned in
             // shrink to fit...
             a_size = 1 + ((w_size + hough_divide - 1) / hough_divide) + 1; // left & right padding
             b_size = 1 + ((h_size + hough_divide - 1) / hough_divide) + 1; // top & bottom padding
-            if ((sizeof(uint32_t) * a_size * b_size) <= fb_avail()) {
+            if ((sizeof(uint32_t) * a_size * b_size) <= acc_max_size) {
                 break;
             }
             hough_divide = hough_divide << 1; // powers of 2...
             hough_shift++;
-            if (hough_divide > 4) {
-                fb_alloc_fail();                   // support 1, 2, 4
-            }
         }
 
-        uint32_t *acc = fb_alloc0(sizeof(uint32_t) * a_size * b_size, FB_ALLOC_NO_HINT);
-        int16_t *rcos = fb_alloc(sizeof(int16_t) * 360, FB_ALLOC_NO_HINT);
-        int16_t *rsin = fb_alloc(sizeof(int16_t) * 360, FB_ALLOC_NO_HINT);
+        memset(acc, 0, sizeof(uint32_t) * a_size * b_size);
         for (int i = 0; i < 360; i++) {
             rcos[i] = (int16_t) roundf(r * cos_table[i]);
             rsin[i] = (int16_t) roundf(r * sin_table[i]);
@@ -788,40 +721,28 @@ void imlib_find_circles(list_t *out, image_t *ptr, rectangle_t *roi, unsigned in
             }
         }
 
-        for (int y = 1, yy = b_size - 1; y < yy; y++) {
-            uint32_t *row_ptr = acc + (a_size * y);
-            uint32_t val;
-            for (int x = 1, xx = a_size - 1; x < xx; x++) {
-                val = row_ptr[x];
-                if ((val >= threshold)
-                    && (val >= row_ptr[x - a_size - 1])
-                    && (val >= row_ptr[x - a_size])
-                    && (val >= row_ptr[x - a_size + 1])
-                    && (val >= row_ptr[x - 1])
-                    && (val >= row_ptr[x + 1])
-                    && (val >= row_ptr[x + a_size - 1])
-                    && (val >= row_ptr[x + a_size])
-                    && (val >= row_ptr[x + a_size + 1])) {
-
-                    find_circles_list_lnk_data_t lnk_data;
-                    lnk_data.magnitude = val;
-                    lnk_data.p.x = ((x - 1) << hough_shift) + r + roi->x; // remove offset
-                    lnk_data.p.y = ((y - 1) << hough_shift) + r + roi->y; // remove offset
-                    lnk_data.r = r;
-
-                    list_push_back(out, &lnk_data);
-                    if (val > row_ptr[x + 1]) {
-                        x++; // can skip the next pixel
-                    }
-                }
-            }
+        list_t peaks;
+        hough_find_peaks(&peaks, acc, a_size, b_size, threshold);
+
+        while (list_size(&peaks)) {
+            hough_peak_t peak;
+            list_pop_front(&peaks, &peak);
+
+            find_circles_list_lnk_data_t lnk_data;
+            lnk_data.magnitude = peak.value;
+            lnk_data.p.x = ((peak.x - 1) << hough_shift) + r + roi->x; // remove offset
+            lnk_data.p.y = ((peak.y - 1) << hough_shift) + r + roi->y; // remove offset
+            lnk_data.r = r;
+
+            list_push_back(out, &lnk_data);
         }
+    }
 
-        fb_free(); // rsin
-        fb_free(); // rcos
+    if (acc) {
         fb_free(); // acc
     }
-
+    fb_free(); // rsin
+    fb_free(); // rcos
     fb_free(); // magnitude_acc
     fb_free(); // theta_acc
 
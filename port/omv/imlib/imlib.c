@@ -32,6 +32,9 @@ void imlib_deinit_all() {
     #if (OMV_HARDWARE_JPEG == 1)
     imlib_jpeg_compress_deinit();
     #endif
+    #ifdef IMLIB_ENABLE_REMAP
+    imlib_remap_deinit_all();
+    #endif
 }
 
 /////////////////
@@ -749,7 +752,8 @@ void imlib_load_image(image_t *img, const char *path) {
 void imlib_save_image(image_t *img, const char *path, rectangle_t *roi, int quality) {
     save_image_format_t format = imblib_parse_extension(img, path);
     if ((img->pixfmt_id == PIXFORMAT_ID_RGB8 || img->pixfmt_id == PIXFORMAT_ID_ARGB8 ||
-        img->pixfmt_id == PIXFORMAT_ID_YUV420) && format != FORMAT_DONT_CARE) {
+        img->pixfmt_id == PIXFORMAT_ID_YUV420) && format != FORMAT_DONT_CARE &&
+        !(img->pixfmt == PIXFORMAT_RGB888 && format == FORMAT_PNG)) {
         fb_alloc_free_till_mark();
         mp_raise_msg(&mp_type_OSError, MP_ERROR_TEXT("current format not support save function!"));
     }
@@ -771,7 +775,7 @@ void imlib_save_image(image_t *img, const char *path, rectangle_t *roi, int qual
             jpeg_write(img, path, quality);
             break;
         case FORMAT_PNG:
-            png_write(img, path);
+            png_write(img, path, quality);
             break;
         case FORMAT_DONT_CARE:
             // Path doesn't have an extension.
@@ -781,7 +785,7 @@ void imlib_save_image(image_t *img, const char *path, rectangle_t *roi, int qual
                 fb_free();
             } else if (img->pixfmt == PIXFORMAT_PNG) {
                 char *new_path = strcat(strcpy(fb_alloc(strlen(path) + 5, FB_ALLOC_NO_HINT), path), ".png");
-                png_write(img, new_path);
+                png_write(img, new_path, quality);
                 fb_free();
             } else if (IM_IS_BAYER(img)) {
                 FIL fp;
@@ -845,202 +849,19 @@ void imlib_zero(image_t *img, image_t *mask, bool invert) {
 }
 
 #ifdef IMLIB_ENABLE_LENS_CORR
-// A simple algorithm for correcting lens distortion.
-// See http://www.tannerhelland.com/4743/simple-algorithm-correcting-lens-distortion/
 void imlib_lens_corr(image_t *img, float strength, float zoom, float x_corr, float y_corr) {
-    int w = img->w;
-    int h = img->h;
-    int halfWidth = w / 2;
-    int halfHeight = h / 2;
-    float maximum_diameter = fast_sqrtf((w * w) + (h * h));
-    float lens_corr_diameter = strength / maximum_diameter;
-    zoom = 1 / zoom;
-
-    // Convert percentage offset to pixels from center of image
-    int x_off = w * x_corr;
-    int y_off = h * y_corr;
+    // The map is kept across calls and only recompiled when the parameters change.
+    remap_t *remap = imlib_remap_cache(REMAP_TYPE_LENS_CORR);
+    imlib_remap_lens_corr(remap, img->w, img->h, strength, zoom, x_corr, y_corr);
 
     // Create a tmp copy of the image to pull pixels from.
-    size_t size = image_size(img);
-    void *data = fb_alloc(size, FB_ALLOC_NO_HINT);
-    memcpy(data, img->data, size);
-    memset(img->data, 0, size);
-
-    int maximum_radius = fast_ceilf(maximum_diameter / 2) + 1; // +1 inclusive of final value
-    float *precalculated_table = fb_alloc(maximum_radius * sizeof(float), FB_ALLOC_NO_HINT);
-
-    for (int i = 0; i < maximum_radius; i++) {
-        float r = lens_corr_diameter * i;
-        precalculated_table[i] = (fast_atanf(r) / r) * zoom;
-    }
-
-    int down_adj = halfHeight + y_off;
-    int up_adj = h - 1 - halfHeight + y_off;
-    int right_adj = halfWidth + x_off;
-    int left_adj = w - 1 - halfWidth + x_off;
-
-    switch (img->pixfmt) {
-        case PIXFORMAT_BINARY: {
-            uint32_t *tmp = (uint32_t *) data;
-
-            for (int y = 0; y < halfHeight; y++) {
-                uint32_t *row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, y);
-                uint32_t *row_ptr2 = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, h - 1 - y);
-                int newY = y - halfHeight;
-                int newY2 = newY * newY;
-
-                for (int x = 0; x < halfWidth; x++) {
-                    int newX = x - halfWidth;
-                    int newX2 = newX * newX;
-                    float precalculated = precalculated_table[(int) fast_sqrtf(newX2 + newY2)];
-                    int sourceY = fast_roundf(precalculated * newY); // rounding is necessary
-                    int sourceX = fast_roundf(precalculated * newX); // rounding is necessary
-                    int sourceY_down = down_adj + sourceY;
-                    int sourceY_up = up_adj - sourceY;
-                    int sourceX_right = right_adj + sourceX;
-                    int sourceX_left = left_adj - sourceX;
-
-                    // plot the 4 symmetrical pixels
-                    // top 2 pixels
-                    if (sourceY_down >= 0 && sourceY_down < h) {
-                        uint32_t *ptr = tmp + (((w + UINT32_T_MASK) >> UINT32_T_SHIFT) * sourceY_down);
-
-                        if (sourceX_right >= 0 && sourceX_right < w) {
-                            uint8_t pixel = IMAGE_GET_BINARY_PIXEL_FAST(ptr, sourceX_right);
-                            IMAGE_PUT_BINARY_PIXEL_FAST(row_ptr, x, pixel);
-                        }
-
-                        if (sourceX_left >= 0 && sourceX_left < w) {
-                            uint8_t pixel = IMAGE_GET_BINARY_PIXEL_FAST(ptr, sourceX_left);
-                            IMAGE_PUT_BINARY_PIXEL_FAST(row_ptr, w - 1 - x, pixel);
-                        }
-                    }
-
-                    // bottom 2 pixels
-                    if (sourceY_up >= 0 && sourceY_up < h) {
-                        uint32_t *ptr = tmp + (((w + UINT32_T_MASK) >> UINT32_T_SHIFT) * sourceY_up);
-
-                        if (sourceX_right >= 0 && sourceX_right < w) {
-                            uint8_t pixel = IMAGE_GET_BINARY_PIXEL_FAST(ptr, sourceX_right);
-                            IMAGE_PUT_BINARY_PIXEL_FAST(row_ptr2, x, pixel);
-                        }
-
-                        if (sourceX_left >= 0 && sourceX_left < w) {
-                            uint8_t pixel = IMAGE_GET_BINARY_PIXEL_FAST(ptr, sourceX_left);
-                            IMAGE_PUT_BINARY_PIXEL_FAST(row_ptr2, w - 1 - x, pixel);
-                        }
-                    }
-                }
-            }
-            break;
-        }
-        case PIXFORMAT_GRAYSCALE: {
-            uint8_t *tmp = (uint8_t *) data;
-
-            for (int y = 0; y < halfHeight; y++) {
-                uint8_t *row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y);
-                uint8_t *row_ptr2 = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, h - 1 - y);
-                int newY = y - halfHeight;
-                int newY2 = newY * newY;
-
-                for (int x = 0; x < halfWidth; x++) {
-                    int newX = x - halfWidth;
-                    int newX2 = newX * newX;
-                    float precalculated = precalculated_table[(int) fast_sqrtf(newX2 + newY2)];
-                    int sourceY = fast_roundf(precalculated * newY); // rounding is necessary
-                    int sourceX = fast_roundf(precalculated * newX); // rounding is necessary
-                    int sourceY_down = down_adj + sourceY;
-                    int sourceY_up = up_adj - sourceY;
-                    int sourceX_right = right_adj + sourceX;
-                    int sourceX_left = left_adj - sourceX;
-
-                    // plot the 4 symmetrical pixels
-                    // top 2 pixels
-                    if (sourceY_down >= 0 && sourceY_down < h) {
-                        uint8_t *ptr = tmp + (w * sourceY_down);
-
-                        if (sourceX_right >= 0 && sourceX_right < w) {
-                            row_ptr[x] = ptr[sourceX_right];
-                        }
-
-                        if (sourceX_left >= 0 && sourceX_left < w) {
-                            row_ptr[w - 1 - x] = ptr[sourceX_left];
-                        }
-                    }
-
-                    // bottom 2 pixels
-                    if (sourceY_up >= 0 && sourceY_up < h) {
-                        uint8_t *ptr = tmp + (w * sourceY_up);
+    image_t src = *img;
+    src.data = fb_alloc(image_size(img), FB_ALLOC_NO_HINT);
+    memcpy(src.data, img->data, image_size(img));
 
-                        if (sourceX_right >= 0 && sourceX_right < w) {
-                            row_ptr2[x] = ptr[sourceX_right];
-                        }
+    imlib_remap(remap, img, &src, false);
 
-                        if (sourceX_left >= 0 && sourceX_left < w) {
-                            row_ptr2[w - 1 - x] = ptr[sourceX_left];
-                        }
-                    }
-                }
-            }
-            break;
-        }
-        case PIXFORMAT_RGB565: {
-            uint16_t *tmp = (uint16_t *) data;
-
-            for (int y = 0; y < halfHeight; y++) {
-                uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y);
-                uint16_t *row_ptr2 = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, h - 1 - y);
-                int newY = y - halfHeight;
-                int newY2 = newY * newY;
-
-                for (int x = 0; x < halfWidth; x++) {
-                    int newX = x - halfWidth;
-                    int newX2 = newX * newX;
-                    float precalculated = precalculated_table[(int) fast_sqrtf(newX2 + newY2)];
-                    int sourceY = fast_roundf(precalculated * newY); // rounding is necessary
-                    int sourceX = fast_roundf(precalculated * newX); // rounding is necessary
-                    int sourceY_down = down_adj + sourceY;
-                    int sourceY_up = up_adj - sourceY;
-                    int sourceX_right = right_adj + sourceX;
-                    int sourceX_left = left_adj - sourceX;
-
-                    // plot the 4 symmetrical pixels
-                    // top 2 pixels
-                    if (sourceY_down >= 0 && sourceY_down < h) {
-                        uint16_t *ptr = tmp + (w * sourceY_down);
-
-                        if (sourceX_right >= 0 && sourceX_right < w) {
-                            row_ptr[x] = ptr[sourceX_right];
-                        }
-
-                        if (sourceX_left >= 0 && sourceX_left < w) {
-                            row_ptr[w - 1 - x] = ptr[sourceX_left];
-                        }
-                    }
-
-                    // bottom 2 pixels
-                    if (sourceY_up >= 0 && sourceY_up < h) {
-                        uint16_t *ptr = tmp + (w * sourceY_up);
-
-                        if (sourceX_right >= 0 && sourceX_right < w) {
-                            row_ptr2[x] = ptr[sourceX_right];
-                        }
-
-                        if (sourceX_left >= 0 && sourceX_left < w) {
-                            row_ptr2[w - 1 - x] = ptr[sourceX_left];
-                        }
-                    }
-                }
-            }
-            break;
-        }
-        default: {
-            break;
-        }
-    }
-
-    fb_free(); // precalculated_table
-    fb_free(); // data
+    fb_free();
 }
 #endif //IMLIB_ENABLE_LENS_CORR
 
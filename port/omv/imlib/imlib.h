@@ -976,6 +976,191 @@ typedef struct cascade {
     int8_t *rectangles_array;       // Rectangles array.
 } cascade_t;
 
+/* Image pyramid */
+#define PYRAMID_MAX_LEVELS          (16)
+
+typedef struct pyramid_level {
+    image_t img;                    // Level image (GRAYSCALE, or RGB888 for color pyramids).
+    float x_scale;                  // Base width / level width.
+    float y_scale;                  // Base height / level height.
+    bool valid;                     // Level is up to date with the current frame.
+    bool owned;                     // Level pixels are allocated by the pyramid.
+} pyramid_level_t;
+
+typedef struct pyramid {
+    image_t src;                    // Current frame (not owned).
+    float scale_factor;             // Scale between consecutive levels.
+    int max_levels;                 // Maximum number of levels.
+    int min_size;                   // Minimum level width/height.
+    bool luma;                      // Build a luma (grayscale) pyramid.
+    int n_levels;                   // Number of levels for the current geometry.
+    pyramid_level_t levels[PYRAMID_MAX_LEVELS];
+} pyramid_t;
+
+/* Remap */
+#define REMAP_FRAC_BITS             (4)
+#define REMAP_MAX_SIZE              (4095)
+#define REMAP_INVALID               (0xFFFFFFFFU)
+#define REMAP_KEY_SIZE              (16)
+
+typedef enum remap_type {
+    REMAP_TYPE_NONE,
+    REMAP_TYPE_LENS_CORR,
+    REMAP_TYPE_ROTATION_CORR,
+    REMAP_TYPE_HOMOGRAPHY
+} remap_type_t;
+
+// Each entry holds the source coordinate of a destination pixel packed as x:12.4 and y:12.4,
+// (x << 20) | (y << 8) | (x_frac << 4) | y_frac, or REMAP_INVALID if it falls outside the source.
+typedef struct remap {
+    int w;                          // Map (destination and source) width.
+    int h;                          // Map (destination and source) height.
+    uint32_t *map;                  // Packed source coordinates.
+    remap_type_t type;              // Parameters the map was compiled from.
+    float key[REMAP_KEY_SIZE];
+} remap_t;
+
+/* Pipeline */
+#define PIPELINE_MAX_STAGES         (16)
+#define PIPELINE_GAUSSIAN_MAX_KSIZE (8)     // 2^(2 * ksize) * 255 << 8 fits 32-bits.
+
+typedef enum pipeline_op {
+    PIPELINE_OP_ADD,
+    PIPELINE_OP_SUB,
+    PIPELINE_OP_MUL,
+    PIPELINE_OP_DIV,
+    PIPELINE_OP_MIN,
+    PIPELINE_OP_MAX,
+    PIPELINE_OP_DIFFERENCE,
+    PIPELINE_OP_B_AND,
+    PIPELINE_OP_B_NAND,
+    PIPELINE_OP_B_OR,
+    PIPELINE_OP_B_NOR,
+    PIPELINE_OP_B_XOR,
+    PIPELINE_OP_B_XNOR,
+    PIPELINE_OP_INVERT,
+    PIPELINE_OP_NEGATE,
+    PIPELINE_OP_BINARY,
+    PIPELINE_OP_TO_BITMAP,
+    PIPELINE_OP_TO_GRAYSCALE,
+    PIPELINE_OP_TO_RGB565,
+    PIPELINE_OP_ERODE,
+    PIPELINE_OP_DILATE,
+    PIPELINE_OP_MORPH
+} pipeline_op_t;
+
+// One recorded operation. Math/logic ops take either another image (read one row at a time)
+// or an RGB888 color that is converted to the pixel format the stage runs in. Morph kernels
+// are (2 * ksize + 1)^2 ints, or when krn_sep is set, a gaussian given as its pascal row krn_sep[0..n)
+// that is applied vertically and then horizontally, each pass normalized by the row sum like
+// Image.gaussian(). krn_center times the center pixel is then added and mul applies to that
+// normalized value instead of to the raw kernel sum.
+typedef struct pipeline_stage {
+    pipeline_op_t op;
+    int ksize;                      // Neighbourhood radius, 0 for per-pixel ops.
+    image_t *other;                 // Optional image operand (not owned).
+    uint32_t color;                 // Scalar operand when other is NULL.
+    int threshold;                  // Erode/dilate neighbour count.
+    bool invert;                    // Also sub(reverse).
+    bool zero;
+    bool mod;
+    bool to_bitmap;
+    bool morph_threshold;
+    int offset;
+    float mul;
+    int add;
+    int *krn;
+    int *krn_sep;
+    int krn_center;
+    list_t *thresholds;
+} pipeline_stage_t;
+
+typedef struct pipeline {
+    int n_stages;
+    pipeline_stage_t stages[PIPELINE_MAX_STAGES];
+} pipeline_t;
+
+/* Color Correction */
+#define COLOR_CORR_BITS             (12)    // Linear precision between the input and output tables.
+#define COLOR_CORR_MATRIX_BITS      (10)
+
+typedef enum color_corr_awb {
+    COLOR_CORR_AWB_OFF,
+    COLOR_CORR_AWB_GRAY_WORLD,
+    COLOR_CORR_AWB_WHITE_PATCH
+} color_corr_awb_t;
+
+// White balance, color correction matrix, saturation and gamma/contrast/brightness composed into
+// one pass: per-channel gain table -> one fixed-point 3x3 matrix -> shared output table. When the
+// matrix is the identity the output table is folded into the gain tables.
+typedef struct color_corr {
+    color_corr_awb_t awb;           // Gains come from the statistics of the previous frame.
+    float gains[3];                 // Red, green and blue white balance gains.
+    float ccm[12];                  // Column-major 3x3 matrix and offsets (0-255 units), as Image.ccm().
+    float saturation;
+    float gamma;
+    float contrast;
+    float brightness;
+    bool dirty;                     // Matrix and output table have to be rebuilt.
+    bool linear;                    // No matrix, the gain tables hold the output values.
+    int32_t matrix[12];             // Row-major fixed-point matrix followed by offsets.
+    uint16_t pre[3][256];
+    uint8_t post[1 << COLOR_CORR_BITS];
+    uint64_t stats[3];              // Channel sums (gray world) or maxima (white patch).
+    uint32_t stats_scale[3];        // Channel maximum of the format the statistics were taken in.
+} color_corr_t;
+
+/* CLAHE */
+#define CLAHE_MAX_TILES             (16)    // Maximum number of tiles per axis.
+#define CLAHE_LUT_BITS              (8)     // Fractional bits of the tile tables (temporal blending).
+
+// Tile tables are kept between frames so that video can blend them over time and only
+// recompute a round robin subset of tiles per frame, the interpolation weights are cached too.
+typedef struct clahe {
+    float clip_limit;               // Normalized clip limit, <= 0 disables clipping (AHE).
+    int tiles_x;                    // Tiles per axis, 0 picks them from the image size.
+    int tiles_y;
+    uint32_t blend;                 // Weight of the new tile tables (0-256), 256 disables blending.
+    int tiles_per_frame;            // Tiles recomputed per frame once primed, 0 for all of them.
+    bool primed;                    // Tile tables hold a previous frame.
+    int next_tile;                  // Round robin position of the partial updates.
+    int w, h, nx, ny;               // Geometry the tables were built for.
+    uint16_t *luts;                 // nx * ny tables of 256 entries, followed by the weights.
+    uint32_t *x_map;                // Left tile table offset << 16 | right weight, per column.
+    uint32_t *y_map;                // Top tile table offset << 16 | bottom weight, per row.
+} clahe_t;
+
+/* GIF */
+// Encoder state kept between frames, the previous frame is what a decoder displays so that
+// unchanged pixels can be written as transparent.
+typedef struct gif {
+    int w, h;                       // 0 takes the size from the first frame.
+    bool color;                     // Palette quantized color, grayscale otherwise.
+    bool loop;
+    bool global_palette;            // Quantize once on the first frame instead of per frame.
+    bool dither;                    // 4x4 ordered dither before quantizing.
+    bool diff;                      // Encode only the changed rectangle with transparency.
+    uint32_t frames;
+    uint8_t *prev;                  // Previous displayed frame (RGB565 or palette indices).
+    uint16_t *inverse;              // RGB555 to global palette index map.
+    int palette_size;
+    uint8_t palette[256 * 3];
+} gif_t;
+
+/* MJPEG */
+// AVI recorder state, the index is kept in memory and appended as idx1 on sync and close.
+typedef struct mjpeg {
+    int w, h;                       // 0 takes the size from the first frame.
+    uint32_t count;                 // Frames accepted, including the ones still queued.
+    uint32_t frames;                // Frames written to the file.
+    uint32_t bytes;                 // Frame data written to the file, chunk headers excluded.
+    uint32_t *index;                // movi relative offset and size of every written frame.
+    uint32_t index_cap;
+    uint32_t checkpoint;            // Frames between index checkpoints, 0 disables them.
+    uint32_t start_ms, last_ms;     // Timestamps of the first and last frame for the rate estimate.
+    struct mjpeg_writer *writer;    // Encoder thread, NULL encodes on the caller.
+} mjpeg_t;
+
 typedef struct bmp_read_settings {
     int32_t bmp_w;
     int32_t bmp_h;
@@ -1029,6 +1214,13 @@ typedef enum descriptor_type {
     DESC_ORB,
 } descriptor_t;
 
+typedef enum adaptive_threshold_method {
+    ADAPTIVE_THRESHOLD_MEAN,        // pixel > mean - offset
+    ADAPTIVE_THRESHOLD_GAUSSIAN,    // pixel > gaussian(ksize) - offset
+    ADAPTIVE_THRESHOLD_SAUVOLA,     // pixel > mean * (1 + k * (stdev / 128 - 1)) - offset
+    ADAPTIVE_THRESHOLD_OTSU         // pixel > interpolated tile otsu threshold - offset
+} adaptive_threshold_method_t;
+
 typedef enum edge_detector_type {
     EDGE_CANNY,
     EDGE_SIMPLE,
@@ -1245,6 +1437,9 @@ void imlib_jpeg_compress_deinit();
 void jpeg_mdma_irq_handler();
 #endif
 void jpeg_decompress(image_t *dst, image_t *src);
+// Decodes roi (NULL for all) downscaled by 1 << scale_shift (0-3) in the IDCT into dst, which
+// is (roi->w >> scale_shift, roi->h >> scale_shift) BINARY, GRAYSCALE, RGB565, RGB888, RGBP888 or YUV420.
+void jpeg_decompress_ex(image_t *dst, image_t *src, rectangle_t *roi, int scale_shift);
 bool jpeg_compress(image_t *src, image_t *dst, int quality, bool realloc);
 int jpeg_clean_trailing_bytes(int bpp, uint8_t *data);
 void jpeg_read_geometry(FIL *fp, image_t *img, const char *path, jpg_read_settings_t *rs);
@@ -1253,27 +1448,28 @@ void jpeg_read(image_t *img, const char *path);
 void jpeg_write(image_t *img, const char *path, int quality);
 void png_decompress(image_t *dst, image_t *src);
 bool png_compress(image_t *src, image_t *dst);
+bool png_compress_fast(image_t *src, image_t *dst);
 void png_read_geometry(FIL *fp, image_t *img, const char *path, png_read_settings_t *rs);
 void png_read_pixels(FIL *fp, image_t *img);
 void png_read(image_t *img, const char *path);
-void png_write(image_t *img, const char *path);
+void png_write(image_t *img, const char *path, int quality);
 bool imlib_read_geometry(FIL *fp, image_t *img, const char *path, img_read_settings_t *rs);
 void imlib_image_operation(image_t *img, const char *path, image_t *other, int scalar, line_op_t op, void *data);
 void imlib_load_image(image_t *img, const char *path);
 void imlib_save_image(image_t *img, const char *path, rectangle_t *roi, int quality);
 
 /* GIF functions */
-void gif_open(FIL *fp, int width, int height, bool color, bool loop);
-void gif_add_frame(FIL *fp, image_t *img, uint16_t delay);
-void gif_close(FIL *fp);
+void gif_open(FIL *fp, gif_t *gif, int width, int height, bool color, bool loop,
+              bool global_palette, bool dither, bool diff);
+void gif_add_frame(FIL *fp, gif_t *gif, image_t *img, uint16_t delay);
+void gif_close(FIL *fp, gif_t *gif);
 
 /* MJPEG functions */
-void mjpeg_open(FIL *fp, int width, int height);
-void mjpeg_write(FIL *fp, int width, int height, uint32_t *frames, uint32_t *bytes,
-                 image_t *img, int quality, rectangle_t *roi, int rgb_channel, int alpha,
+void mjpeg_open(FIL *fp, mjpeg_t *mjpeg, int width, int height, uint32_t queue, uint32_t checkpoint);
+void mjpeg_write(FIL *fp, mjpeg_t *mjpeg, image_t *img, int quality, rectangle_t *roi, int rgb_channel, int alpha,
                  const uint16_t *color_palette, const uint8_t *alpha_palette, image_hint_t hint);
-void mjpeg_sync(FIL *fp, uint32_t *frames, uint32_t *bytes, float fps);
-void mjpeg_close(FIL *fp, uint32_t *frames, uint32_t *bytes, float fps);
+void mjpeg_sync(FIL *fp, mjpeg_t *mjpeg, float fps);
+void mjpeg_close(FIL *fp, mjpeg_t *mjpeg, float fps);
 
 /* Point functions */
 point_t *point_alloc(int16_t x, int16_t y);
@@ -1301,6 +1497,15 @@ void imlib_mean_pool(image_t *img_i, image_t *img_o, int x_div, int y_div);
 float imlib_template_match_ds(image_t *image, image_t *t, rectangle_t *r);
 float imlib_template_match_ex(image_t *image, image_t *t, rectangle_t *roi, int step, rectangle_t *r);
 
+/* Image pyramid */
+void imlib_pyramid_init(pyramid_t *pyr, float scale_factor, int max_levels, int min_size, bool luma);
+void imlib_pyramid_free(pyramid_t *pyr);
+void imlib_pyramid_update(pyramid_t *pyr, image_t *img);
+image_t *imlib_pyramid_level(pyramid_t *pyr, int level);
+int imlib_pyramid_find_level(pyramid_t *pyr, float scale);
+void imlib_area_scale(image_t *src, image_t *dst);
+float imlib_template_match_pyramid(pyramid_t *pyr, image_t *t, rectangle_t *roi, int step, rectangle_t *r);
+
 /* Clustering functions */
 array_t *cluster_kmeans(array_t *points, int k, cluster_dist_t dist_func);
 
@@ -1327,14 +1532,19 @@ long imlib_integral_mw_lookup(mw_image_t *sum, int x, int y, int w, int h);
 /* Haar/VJ */
 int imlib_load_cascade(struct cascade *cascade, const char *path);
 array_t *imlib_detect_objects(struct image *image, struct cascade *cascade, struct rectangle *roi);
+array_t *imlib_detect_objects_pyramid(pyramid_t *pyr, struct cascade *cascade, struct rectangle *roi);
 
 /* Corner detectors */
-void fast_detect(image_t *image, array_t *keypoints, int threshold, rectangle_t *roi);
-void agast_detect(image_t *image, array_t *keypoints, int threshold, rectangle_t *roi);
+void corner_segment_test_row(const uint8_t *p, int n, int b, const int *offsets, int ring, int arc, uint8_t *out);
+void corner_grid_nms(const uint8_t *map, rectangle_t *roi, array_t *keypoints, int max_keypoints);
+void fast_detect(image_t *image, array_t *keypoints, int threshold, rectangle_t *roi, int max_keypoints);
+void agast_detect(image_t *image, array_t *keypoints, int threshold, rectangle_t *roi, int max_keypoints);
 
 /* ORB descriptor */
 array_t *orb_find_keypoints(image_t *image, bool normalized, int threshold,
                             float scale_factor, int max_keypoints, corner_detector_t corner_detector, rectangle_t *roi);
+array_t *orb_find_keypoints_pyramid(pyramid_t *pyr, bool normalized, int threshold,
+                                    int max_keypoints, corner_detector_t corner_detector, rectangle_t *roi);
 int orb_match_keypoints(array_t *kpts1, array_t *kpts2, int *match, int threshold, rectangle_t *r, point_t *c, int *angle);
 int orb_filter_keypoints(array_t *kpts, rectangle_t *r, point_t *c);
 int orb_save_descriptor(FIL *fp, array_t *kpts);
@@ -1410,14 +1620,16 @@ void imlib_draw_string(image_t *img,
                        bool char_vflip,
                        int string_rotation,
                        bool string_hmirror,
-                       bool string_hflip);
+                       bool string_hflip,
+                       rectangle_t *bbox);
 void imlib_draw_string_advance(image_t *img,
                                 int x_off,
                                 int y_off,
                                 int char_size,
                                 const char *str,
                                 int color,
-                                const char *font_path);
+                                const char *font_path,
+                                rectangle_t *bbox);
 void imlib_draw_image(image_t *dst_img,
                       image_t *src_img,
                       int dst_x_start,
@@ -1432,15 +1644,44 @@ void imlib_draw_image(image_t *dst_img,
                       image_hint_t hint,
                       imlib_draw_row_callback_t callback,
                       void *dst_row_override);
+bool imlib_draw_image_fast(image_t *dst_img, image_t *src_img,
+                           int dst_x0, int dst_y0, int dst_x1, int dst_y1,
+                           int src_x, int src_y, int k, bool area, int alpha);
 void imlib_flood_fill(image_t *img, int x, int y,
                       float seed_threshold, float floating_threshold,
                       int c, bool invert, bool clear_background, image_t *mask);
+// Span Rasterizer
+void imlib_draw_hspan(image_t *img, int x0, int x1, int y, int c);
+void imlib_draw_vspan(image_t *img, int x, int y0, int y1, int c);
+void imlib_blend_pixel(image_t *img, int x, int y, int c, int alpha);
+uint32_t imlib_blend_argb8888(uint32_t bg, uint32_t fg, int alpha);
+void imlib_draw_capsule(image_t *img, float x0, float y0, float x1, float y1, float r, int c, bool antialias);
+void imlib_draw_annulus(image_t *img, float cx, float cy, float r, float half_width, int c, bool antialias);
+void imlib_draw_line_aa(image_t *img, int x0, int y0, int x1, int y1, int c, int thickness);
+void imlib_draw_circle_aa(image_t *img, int cx, int cy, int r, int c, int thickness, bool fill);
+void imlib_draw_polyline(image_t *img, const point_t *points, int n, bool closed, int c, int thickness, bool antialias);
+void imlib_fill_polygon(image_t *img, const point_t *points, int n, int c);
+// Dirty Rectangles
+#define DIRTY_RECTS_MAX    (32)
+typedef struct dirty_rects {
+    bool full;
+    int count;
+    rectangle_t rects[DIRTY_RECTS_MAX];
+} dirty_rects_t;
+bool dirty_rects_supported(image_t *img);
+void dirty_rects_init(dirty_rects_t *d, bool full);
+void dirty_rects_add(dirty_rects_t *d, image_t *img, int x, int y, int w, int h);
+void dirty_rects_merge(dirty_rects_t *dst, dirty_rects_t *src, image_t *img);
+void dirty_rects_clear(dirty_rects_t *d, image_t *img);
+size_t dirty_rects_copy(dirty_rects_t *d, image_t *img, uint8_t *dst);
 // ISP Functions
 void imlib_awb(image_t *img, bool max);
 void imlib_ccm(image_t *img, float *ccm, bool offset);
 void imlib_gamma(image_t *img, float gamma, float scale, float offset);
 // Binary Functions
 void imlib_binary(image_t *out, image_t *img, list_t *thresholds, bool invert, bool zero, image_t *mask);
+void imlib_adaptive_threshold(image_t *out, image_t *img, adaptive_threshold_method_t method, int ksize,
+                              int offset, float k, bool invert, image_t *mask);
 void imlib_invert(image_t *img);
 void imlib_b_and(image_t *img, const char *path, image_t *other, int scalar, image_t *mask);
 void imlib_b_nand(image_t *img, const char *path, image_t *other, int scalar, image_t *mask);
@@ -1475,7 +1716,12 @@ void imlib_blend(image_t *img, const char *path, image_t *other, int scalar, flo
 // Filtering Functions
 void imlib_histeq(image_t *img, image_t *mask);
 void imlib_clahe_histeq(image_t *img, float clip_limit, image_t *mask);
+void imlib_clahe_init(clahe_t *clahe, float clip_limit, int tiles_x, int tiles_y, float blend, int tiles_per_frame);
+void imlib_clahe_free(clahe_t *clahe);
+void imlib_clahe(clahe_t *clahe, image_t *img, image_t *mask);
 void imlib_mean_filter(image_t *img, const int ksize, bool threshold, int offset, bool invert, image_t *mask);
+void imlib_gaussian_filter(image_t *img, const int ksize, bool unsharp, float mul, float add,
+                           bool threshold, int offset, bool invert, image_t *mask);
 void imlib_median_filter(image_t *img, const int ksize, float percentile, bool threshold, int offset, bool invert,
                          image_t *mask);
 void imlib_mode_filter(image_t *img, const int ksize, bool threshold, int offset, bool invert, image_t *mask);
@@ -1493,6 +1739,7 @@ void imlib_bilateral_filter(image_t *img,
                             const int ksize,
                             float color_sigma,
                             float space_sigma,
+                            bool fast,
                             bool threshold,
                             int offset,
                             bool invert,
@@ -1506,6 +1753,27 @@ void imlib_lens_corr(image_t *img, float strength, float zoom, float x_corr, flo
 void imlib_rotation_corr(image_t *img, float x_rotation, float y_rotation,
                          float z_rotation, float x_translation, float y_translation,
                          float zoom, float fov, float *corners);
+// Remap
+void imlib_remap_init(remap_t *m);
+void imlib_remap_free(remap_t *m);
+remap_t *imlib_remap_cache(remap_type_t type);
+void imlib_remap_deinit_all();
+bool imlib_remap_prepare(remap_t *m, remap_type_t type, int w, int h, const float *key, int key_len); // helper/internal
+void imlib_remap_homography_int(remap_t *m, const float *H); // helper/internal
+void imlib_remap_lens_corr(remap_t *m, int w, int h, float strength, float zoom, float x_corr, float y_corr);
+void imlib_remap_rotation_corr(remap_t *m, int w, int h, float x_rotation, float y_rotation,
+                               float z_rotation, float x_translation, float y_translation,
+                               float zoom, float fov, float *corners);
+void imlib_remap_homography(remap_t *m, int w, int h, const float *H);
+void imlib_remap(remap_t *m, image_t *dst, image_t *src, bool bilinear);
+// Pipeline
+void imlib_pipeline_init(pipeline_t *p);
+pipeline_stage_t *imlib_pipeline_push(pipeline_t *p, pipeline_op_t op, int ksize);
+pixformat_t imlib_pipeline_pixfmt(pipeline_t *p, pixformat_t pixfmt);
+void imlib_pipeline_run(pipeline_t *p, image_t *dst, image_t *src);
+// Color Correction
+void imlib_color_corr_init(color_corr_t *cc);
+void imlib_color_corr(color_corr_t *cc, image_t *img);
 // Statistics
 void imlib_get_similarity(image_t *img,
                           const char *path,
@@ -1540,12 +1808,14 @@ void imlib_find_blobs(list_t *out, image_t *ptr, rectangle_t *roi, unsigned int
 size_t trace_line(image_t *ptr, line_t *l, int *theta_buffer, uint32_t *mag_buffer, point_t *point_buffer); // helper/internal
 void merge_alot(list_t *out, int threshold, int theta_threshold); // helper/internal
 void imlib_find_lines(list_t *out, image_t *ptr, rectangle_t *roi, unsigned int x_stride, unsigned int y_stride,
-                      uint32_t threshold, unsigned int theta_margin, unsigned int rho_margin);
+                      uint32_t threshold, unsigned int theta_margin, unsigned int rho_margin,
+                      unsigned int theta_window, bool probabilistic);
 void imlib_lsd_find_line_segments(list_t *out,
                                   image_t *ptr,
                                   rectangle_t *roi,
                                   unsigned int merge_distance,
-                                  unsigned int max_theta_diff);
+                                  unsigned int max_theta_diff,
+                                  bool fast);
 void imlib_find_line_segments(list_t *out, image_t *ptr, rectangle_t *roi, unsigned int x_stride, unsigned int y_stride,
                               uint32_t threshold, unsigned int theta_margin, unsigned int rho_margin,
                               uint32_t segment_threshold);
@@ -1573,7 +1843,22 @@ void imlib_phasecorrelate(image_t *img0,
                           float *scale,
                           float *response);
 // Stereo Imaging
-void imlib_stereo_disparity(image_t *img, bool reversed, int max_disparity, int threshold);
+#define STEREO_SUBPIXEL_BITS    (4)         // Disparities are in 1/16th of a pixel.
+#define STEREO_INVALID          (0xFFFF)    // Failed the left-right consistency check.
+#define STEREO_DEFAULT_P1       (8)
+#define STEREO_DEFAULT_P2       (96)
+
+typedef struct stereo_settings {
+    int max_disparity;
+    int p1;             // Penalty for disparity changes of 1 pixel.
+    int p2;             // Penalty for larger disparity changes.
+    int lr_max_diff;    // Left-right consistency check tolerance, < 0 disables it.
+    bool subpixel;
+} stereo_settings_t;
+
+void imlib_stereo_sgm(uint16_t *out, image_t *left, rectangle_t *roi_l, image_t *right, rectangle_t *roi_r,
+                      stereo_settings_t *settings);
+void imlib_stereo_disparity(image_t *img, bool reversed, int max_disparity);
 
 array_t *imlib_selective_search(image_t *src, float t, int min_size, float a1, float a2, float a3);
 #endif //__IMLIB_H__
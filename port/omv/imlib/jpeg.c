@@ -240,7 +240,82 @@ static void jpeg_get_mcu(image_t *src, int x_offset, int y_offset, int dx, int d
             }
             break;
         }
-        case PIXFORMAT_YUV_ANY: {
+        case PIXFORMAT_RGB888: {
+            if ((dx != MCU_W) || (dy != MCU_H)) {
+                // partial MCU, fill with 0's to start
+                memset(Y0, 0, JPEG_444_GS_MCU_SIZE);
+                memset(CB, 0, JPEG_444_GS_MCU_SIZE);
+                memset(CR, 0, JPEG_444_GS_MCU_SIZE);
+            }
+
+            for (int y = y_offset, yy = y + dy, index = 0; y < yy; y++) {
+                uint8_t *rp = src->data + (((y * src->w) + x_offset) * 3);
+
+                for (int x = 0; x < dx; x++, rp += 3) {
+                    int y0 = COLOR_RGB888_TO_Y(rp[0], rp[1], rp[2]);
+
+                    #if (OMV_HARDWARE_JPEG == 0)
+                    y0 ^= 0x80;
+                    #endif
+
+                    Y0[index] = y0;
+
+                    int cb = COLOR_RGB888_TO_U(rp[0], rp[1], rp[2]);
+
+                    #if (OMV_HARDWARE_JPEG == 1)
+                    cb ^= 0x80;
+                    #endif
+
+                    CB[index] = cb;
+
+                    int cr = COLOR_RGB888_TO_V(rp[0], rp[1], rp[2]);
+
+                    #if (OMV_HARDWARE_JPEG == 1)
+                    cr ^= 0x80;
+                    #endif
+
+                    CR[index++] = cr;
+                }
+
+                index += MCU_W - dx;
+            }
+            break;
+        }
+        case PIXFORMAT_YUV420:
+        case PIXFORMAT_YVU420: {
+            // Y plane followed by the interleaved (2x2 subsampled) chroma plane, NV12 or NV21.
+            if ((dx != MCU_W) || (dy != MCU_H)) {
+                // partial MCU, fill with 0's to start
+                memset(Y0, 0, JPEG_444_GS_MCU_SIZE);
+                memset(CB, 0, JPEG_444_GS_MCU_SIZE);
+                memset(CR, 0, JPEG_444_GS_MCU_SIZE);
+            }
+
+            int cb_offset = (src->pixfmt == PIXFORMAT_YUV420) ? 0 : 1;
+            int uv_rows = IM_MAX(src->h / 2, 1);
+
+            for (int y = y_offset, yy = y + dy, index = 0; y < yy; y++) {
+                uint8_t *yp = src->data + (y * src->w) + x_offset;
+                uint8_t *uvp = src->data + (src->w * src->h) + (IM_MIN(y / 2, uv_rows - 1) * src->w) + x_offset;
+
+                for (int x = 0; x < dx; x++) {
+                    #if (OMV_HARDWARE_JPEG == 0)
+                    Y0[index] = yp[x] ^ 0x80;
+                    CB[index] = uvp[(x & ~1) + cb_offset] ^ 0x80;
+                    CR[index++] = uvp[(x & ~1) + (cb_offset ^ 1)] ^ 0x80;
+                    #else
+                    Y0[index] = yp[x];
+                    CB[index] = uvp[(x & ~1) + cb_offset];
+                    CR[index++] = uvp[(x & ~1) + (cb_offset ^ 1)];
+                    #endif
+                }
+
+                index += MCU_W - dx;
+            }
+            break;
+        }
+        case PIXFORMAT_YUV422:
+        case PIXFORMAT_YVU422: {
             if ((dx != MCU_W) || (dy != MCU_H)) {
                 // partial MCU, fill with 0's to start
                 memset(Y0, 0, JPEG_444_GS_MCU_SIZE);
@@ -1946,41 +2021,85 @@ static void jpeg_write_headers(jpeg_buf_t *jpeg_buf, int w, int h, int bpp, jpeg
     jpeg_put_bytes(jpeg_buf, (uint8_t [3]) {0x00, 0x3F, 0x0}, 3);
 }
 
-volatile int jpeg_encoder_created = -1;
-static pthread_mutex_t hd_jpeg_mutex = PTHREAD_MUTEX_INITIALIZER;
+// The q factor of a venc channel is fixed at creation, changing it means rebuilding the
+// channel. The IDE writeback shares the channel reserved for image.compress() unless the
+// board gives it another one (OMV_IDE_JPEG_VENC_CHN). On the shared channel, IDE frames
+// take the quality a script last created the channel with instead of rebuilding it back,
+// until the script has not encoded for HD_JPEG_IDE_RECLAIM_FRAMES IDE frames.
+#define HD_JPEG_IDE_RECLAIM_FRAMES 30
+
+typedef struct hd_jpeg_chn {
+    int chn;
+    volatile int created; // -1: disabled, 0: not created, 1: created
+    bool first_frame;
+    bool ide_owned;       // Last created for an IDE frame.
+    int ide_streak;       // IDE frames since the last script frame.
+    k_venc_chn_attr attr;
+    pthread_mutex_t mutex;
+} hd_jpeg_chn_t;
+
+static hd_jpeg_chn_t hd_jpeg_chn = {
+    .chn = VENC_MAX_CHN_NUMS - 1, .created = -1, .mutex = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static hd_jpeg_chn_t hd_jpeg_ide_chn = {
+    .chn = OMV_IDE_JPEG_VENC_CHN, .created = -1, .mutex = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static void hd_jpeg_chn_enable(hd_jpeg_chn_t *c)
+{
+    pthread_mutex_lock(&c->mutex);
+    c->created = 0;
+    pthread_mutex_unlock(&c->mutex);
+}
+
+static void hd_jpeg_chn_destory(hd_jpeg_chn_t *c)
+{
+    pthread_mutex_lock(&c->mutex);
+    if (c->created > 0) {
+        kd_mpi_venc_stop_chn(c->chn);
+        kd_mpi_venc_destroy_chn(c->chn);
+    }
+    c->created = -1;
+    pthread_mutex_unlock(&c->mutex);
+}
 
 void hd_jpeg_encoder_enable(void)
 {
-    pthread_mutex_lock(&hd_jpeg_mutex);
-    jpeg_encoder_created = 0;
-    pthread_mutex_unlock(&hd_jpeg_mutex);
+    hd_jpeg_chn_enable(&hd_jpeg_chn);
+    if (hd_jpeg_ide_chn.chn != hd_jpeg_chn.chn) {
+        hd_jpeg_chn_enable(&hd_jpeg_ide_chn);
+    }
 }
 
 void hd_jpeg_encoder_destory(void)
 {
-    pthread_mutex_lock(&hd_jpeg_mutex);
-    if(jpeg_encoder_created) {
-        jpeg_encoder_created = -1;
-        kd_mpi_venc_stop_chn(VENC_MAX_CHN_NUMS - 1);
-        kd_mpi_venc_destroy_chn(VENC_MAX_CHN_NUMS - 1);
-    }
-    pthread_mutex_unlock(&hd_jpeg_mutex);
+    hd_jpeg_chn_destory(&hd_jpeg_chn);
+    hd_jpeg_chn_destory(&hd_jpeg_ide_chn);
 }
 
 /**
  * Hardware JPEG compressing
  * @retval -1: error, 0: overflow, >0: JPEG size
  */
-int hd_jpeg_encode(k_video_frame_info* frame, void** buffer, size_t size, int timeout, int quality, void*(*realloc)(void*, unsigned long)) {
+static int hd_jpeg_chn_encode(hd_jpeg_chn_t *c, k_video_frame_info* frame, void** buffer, size_t size, int timeout, int quality, void*(*realloc)(void*, unsigned long), bool ide) {
     int ret = -1;
     int error = 0;
 
-    pthread_mutex_lock(&hd_jpeg_mutex);
-    if (jpeg_encoder_created < 0) {
+    pthread_mutex_lock(&c->mutex);
+    if (c->created < 0) {
         goto skip;
     }
-    static bool first_frame = true;
-    static k_venc_chn_attr attr;
+    k_venc_chn_attr *attr = &c->attr;
+    if (!ide) {
+        c->ide_streak = 0;
+    } else if (c->ide_streak < HD_JPEG_IDE_RECLAIM_FRAMES) {
+        c->ide_streak++;
+        if ((c->created > 0) && (!c->ide_owned)
+            && (attr->venc_attr.pic_width == frame->v_frame.width) && (attr->venc_attr.pic_height == frame->v_frame.height)) {
+            quality = attr->rc_attr.mjpeg_fixqp.q_factor;
+        }
+    }
     init:
 
     if(10 > quality) {
@@ -1989,52 +2108,54 @@ int hd_jpeg_encode(k_video_frame_info* frame, void** buffer, size_t size, int ti
         quality = 100;
     }
 
-    if (jpeg_encoder_created == 0) {
+    if (c->created == 0) {
         // create channel
-        memset(&attr, 0, sizeof(attr));
-        attr.venc_attr.pic_width = frame->v_frame.width;
-        attr.venc_attr.pic_height = frame->v_frame.height;
-        attr.venc_attr.stream_buf_size = (frame->v_frame.width * frame->v_frame.height + 0xfff) & ~0xfff;
-        attr.venc_attr.stream_buf_cnt = 1;
-        attr.venc_attr.type = K_PT_JPEG;
-        attr.rc_attr.rc_mode = K_VENC_RC_MODE_MJPEG_FIXQP;
-        attr.rc_attr.mjpeg_fixqp.src_frame_rate = 30;
-        attr.rc_attr.mjpeg_fixqp.dst_frame_rate = 30;
-        attr.rc_attr.mjpeg_fixqp.q_factor = quality;
-        error = kd_mpi_venc_create_chn(VENC_MAX_CHN_NUMS - 1, &attr);
+        memset(attr, 0, sizeof(*attr));
+        attr->venc_attr.pic_width = frame->v_frame.width;
+        attr->venc_attr.pic_height = frame->v_frame.height;
+        attr->venc_attr.stream_buf_size = (frame->v_frame.width * frame->v_frame.height + 0xfff) & ~0xfff;
+        attr->venc_attr.stream_buf_cnt = 1;
+        attr->venc_attr.type = K_PT_JPEG;
+        attr->rc_attr.rc_mode = K_VENC_RC_MODE_MJPEG_FIXQP;
+        attr->rc_attr.mjpeg_fixqp.src_frame_rate = 30;
+        attr->rc_attr.mjpeg_fixqp.dst_frame_rate = 30;
+        attr->rc_attr.mjpeg_fixqp.q_factor = quality;
+        error = kd_mpi_venc_create_chn(c->chn, attr);
         if (error) {
             fprintf(stderr, "[omv] kd_mpi_venc_create_chn error %u\n", error);
-            jpeg_encoder_created = -1;
+            c->created = -1;
             goto skip;
         }
         // fprintf(stderr, "[omv] kd_mpi_venc_create_chn success\n");
-        error = kd_mpi_venc_start_chn(VENC_MAX_CHN_NUMS - 1);
+        error = kd_mpi_venc_start_chn(c->chn);
         if (error) {
             fprintf(stderr, "[omv] kd_mpi_venc_start_chn error %u\n", error);
-            kd_mpi_venc_destroy_chn(VENC_MAX_CHN_NUMS - 1);
-            jpeg_encoder_created = -1;
+            kd_mpi_venc_destroy_chn(c->chn);
+            c->created = -1;
             goto skip;
         }
-        jpeg_encoder_created = 1;
-        first_frame = true;
+        c->created = 1;
+        c->first_frame = true;
+        c->ide_owned = ide;
     }
-    // check resolution and format
-    if ((attr.venc_attr.pic_width != frame->v_frame.width) || (attr.venc_attr.pic_height != frame->v_frame.height)) {
+    // check resolution, format and quality (the q factor is fixed per channel)
+    if ((attr->venc_attr.pic_width != frame->v_frame.width) || (attr->venc_attr.pic_height != frame->v_frame.height)
+        || (attr->rc_attr.mjpeg_fixqp.q_factor != quality)) {
         // reinit
-        kd_mpi_venc_stop_chn(VENC_MAX_CHN_NUMS - 1);
-        kd_mpi_venc_destroy_chn(VENC_MAX_CHN_NUMS - 1);
-        jpeg_encoder_created = 0;
+        kd_mpi_venc_stop_chn(c->chn);
+        kd_mpi_venc_destroy_chn(c->chn);
+        c->created = 0;
         goto init;
     }
     send_again:
-    error = kd_mpi_venc_send_frame(VENC_MAX_CHN_NUMS - 1, frame, timeout);
+    error = kd_mpi_venc_send_frame(c->chn, frame, timeout);
     if (error) {
         fprintf(stderr, "[omv] kd_mpi_venc_start_chn error %u\n", error);
         goto skip;
     }
     k_venc_chn_status status;
     k_venc_stream output;
-    error = kd_mpi_venc_query_status(VENC_MAX_CHN_NUMS - 1, &status);
+    error = kd_mpi_venc_query_status(c->chn, &status);
     if (error) {
         fprintf(stderr, "[omv] kd_mpi_venc_query_status error %u\n", error);
         goto skip;
@@ -2047,13 +2168,13 @@ int hd_jpeg_encode(k_video_frame_info* frame, void** buffer, size_t size, int ti
     }
     // fprintf(stderr, "[omv] pack_cnt: %u\n", output.pack_cnt);
     // FIXME: skip first frame, venc workaround
-    if (first_frame) {
-        first_frame = false;
+    if (c->first_frame) {
+        c->first_frame = false;
         // send again
         goto send_again;
     }
     output.pack = malloc(sizeof(k_venc_pack) * output.pack_cnt);
-    error = kd_mpi_venc_get_stream(VENC_MAX_CHN_NUMS - 1, &output, timeout);
+    error = kd_mpi_venc_get_stream(c->chn, &output, timeout);
     if (error) {
         fprintf(stderr, "[omv] kd_mpi_venc_get_stream error %u\n", error);
         goto free_output;
@@ -2085,88 +2206,27 @@ int hd_jpeg_encode(k_video_frame_info* frame, void** buffer, size_t size, int ti
     *buffer = jbuffer;
     ret = ptr;
     release_stream:
-    kd_mpi_venc_release_stream(VENC_MAX_CHN_NUMS - 1, &output);
+    kd_mpi_venc_release_stream(c->chn, &output);
     free_output:
     free(output.pack);
     skip:
-    pthread_mutex_unlock(&hd_jpeg_mutex);
+    pthread_mutex_unlock(&c->mutex);
     return ret;
 }
 
-bool jpeg_compress(image_t *src, image_t *dst, int quality, bool realloc) {
-    #if (TIME_JPEG == 1)
-    mp_uint_t start = mp_hal_ticks_ms();
-    #endif
-
-    if (!dst->data) {
-        uint32_t size = 0;
-        dst->data = fb_alloc_all(&size, FB_ALLOC_PREFER_SIZE | FB_ALLOC_CACHE_ALIGN);
-        dst->size = IMLIB_IMAGE_MAX_SIZE(size);
-    }
+int hd_jpeg_encode(k_video_frame_info* frame, void** buffer, size_t size, int timeout, int quality, void*(*realloc)(void*, unsigned long)) {
+    return hd_jpeg_chn_encode(&hd_jpeg_chn, frame, buffer, size, timeout, quality, realloc, false);
+}
 
-    if (src->is_compressed) {
-        return true;
-    }
+// Uses the shared channel unless the board configured a separate one that could be created.
+int hd_jpeg_encode_ide(k_video_frame_info* frame, void** buffer, size_t size, int timeout, int quality, void*(*realloc)(void*, unsigned long)) {
+    hd_jpeg_chn_t *c = (hd_jpeg_ide_chn.created < 0) ? &hd_jpeg_chn : &hd_jpeg_ide_chn;
+    return hd_jpeg_chn_encode(c, frame, buffer, size, timeout, quality, realloc, true);
+}
 
-    // hardware encoder
-    // fprintf(stderr, "[omv] JPEG src %08lx, %ux%u, alloc: %u\n", src->phy_addr, src->w, src->h, src->alloc_type);
-    if ((jpeg_encoder_created >= 0) && src->phy_addr && ((src->phy_addr & 0xfffU) == 0) && (src->alloc_type == ALLOC_VB)) { // align 4k, from vb'
-        k_video_frame_info frame = {
-            .mod_id = K_ID_VENC,
-            .pool_id = src->pool_id,
-            .v_frame.phys_addr[0] = src->phy_addr,
-            .v_frame.virt_addr[0] = src->data,
-            .v_frame.width = src->w,
-            .v_frame.height = src->h,
-        };
-        // fprintf(stderr, "[omv] omv pixfmt: %u\n", src->pixfmt);
-        #define ALIGN_UP(x, align) (((x) + ((align) - 1)) & ~((align)-1))
-        switch (src->pixfmt) {
-            case PIXFORMAT_YUV420: {
-                frame.v_frame.pixel_format = PIXEL_FORMAT_YUV_SEMIPLANAR_420;
-                frame.v_frame.phys_addr[1] = ALIGN_UP(src->phy_addr + src->w * src->h, 0x1000);
-                frame.v_frame.virt_addr[1] = ALIGN_UP((uint64_t)src->data + src->w * src->h, 0x1000);
-                break;
-            }
-            case PIXFORMAT_YUV422: {
-                frame.v_frame.pixel_format = PIXEL_FORMAT_YUV_SEMIPLANAR_422;
-                frame.v_frame.phys_addr[1] = ALIGN_UP(src->phy_addr + src->w * src->h, 0x1000);
-                frame.v_frame.virt_addr[1] = ALIGN_UP((uint64_t)src->data + src->w * src->h, 0x1000);
-                break;
-            }
-            case PIXFORMAT_BGRA8888: {
-                frame.v_frame.pixel_format = PIXEL_FORMAT_BGRA_8888;
-                break;
-            }
-            case PIXFORMAT_ARGB8888: {
-                frame.v_frame.pixel_format = PIXEL_FORMAT_ARGB_8888;
-                break;
-            }
-            default: {
-                frame.v_frame.pixel_format = PIXEL_FORMAT_BUTT;
-                break;
-            }
-        }
-        // fprintf(stderr, "[omv] pool id: %u, phys: %08lx\n", src->pool_id, src->phy_addr);
-        // fprintf(stderr, "[omv] system pixfmt: %u\n", frame.v_frame.pixel_format);
-        if (frame.v_frame.pixel_format == PIXEL_FORMAT_BUTT) {
-            // unsupported
-            goto skip;
-        }
-        int ssize = hd_jpeg_encode(&frame, (void**)&dst->data, dst->size, 1000, quality, NULL);
-        if (ssize > 0) {
-            dst->size = ssize;
-        } else if (ssize == 0) {
-            // overflow
-            return true;
-        } else {
-            goto skip;
-        }
-        return false;
-    }
-    skip:
-    fprintf(stderr, "[omv] software JPEG\n");
+static pthread_mutex_t sw_jpeg_mutex = PTHREAD_MUTEX_INITIALIZER;
 
+static bool jpeg_compress_sw(image_t *src, image_t *dst, int quality, bool realloc) {
     // JPEG buffer
     jpeg_buf_t jpeg_buf = {
         .idx = 0,
@@ -2390,12 +2450,93 @@ bool jpeg_compress(image_t *src, image_t *dst, int quality, bool realloc) {
 
     dst->size = jpeg_buf.idx;
     dst->data = jpeg_buf.buf;
+    return false;
+}
+
+bool jpeg_compress(image_t *src, image_t *dst, int quality, bool realloc) {
+    #if (TIME_JPEG == 1)
+    mp_uint_t start = mp_hal_ticks_ms();
+    #endif
+
+    if (!dst->data) {
+        uint32_t size = 0;
+        dst->data = fb_alloc_all(&size, FB_ALLOC_PREFER_SIZE | FB_ALLOC_CACHE_ALIGN);
+        dst->size = IMLIB_IMAGE_MAX_SIZE(size);
+    }
+
+    if (src->is_compressed) {
+        return true;
+    }
+
+    // hardware encoder
+    // fprintf(stderr, "[omv] JPEG src %08lx, %ux%u, alloc: %u\n", src->phy_addr, src->w, src->h, src->alloc_type);
+    if ((hd_jpeg_chn.created >= 0) && src->phy_addr && ((src->phy_addr & 0xfffU) == 0) && (src->alloc_type == ALLOC_VB)) { // align 4k, from vb'
+        k_video_frame_info frame = {
+            .mod_id = K_ID_VENC,
+            .pool_id = src->pool_id,
+            .v_frame.phys_addr[0] = src->phy_addr,
+            .v_frame.virt_addr[0] = src->data,
+            .v_frame.width = src->w,
+            .v_frame.height = src->h,
+        };
+        // fprintf(stderr, "[omv] omv pixfmt: %u\n", src->pixfmt);
+        #define ALIGN_UP(x, align) (((x) + ((align) - 1)) & ~((align)-1))
+        switch (src->pixfmt) {
+            case PIXFORMAT_YUV420: {
+                frame.v_frame.pixel_format = PIXEL_FORMAT_YUV_SEMIPLANAR_420;
+                frame.v_frame.phys_addr[1] = ALIGN_UP(src->phy_addr + src->w * src->h, 0x1000);
+                frame.v_frame.virt_addr[1] = ALIGN_UP((uint64_t)src->data + src->w * src->h, 0x1000);
+                break;
+            }
+            case PIXFORMAT_YUV422: {
+                frame.v_frame.pixel_format = PIXEL_FORMAT_YUV_SEMIPLANAR_422;
+                frame.v_frame.phys_addr[1] = ALIGN_UP(src->phy_addr + src->w * src->h, 0x1000);
+                frame.v_frame.virt_addr[1] = ALIGN_UP((uint64_t)src->data + src->w * src->h, 0x1000);
+                break;
+            }
+            case PIXFORMAT_BGRA8888: {
+                frame.v_frame.pixel_format = PIXEL_FORMAT_BGRA_8888;
+                break;
+            }
+            case PIXFORMAT_ARGB8888: {
+                frame.v_frame.pixel_format = PIXEL_FORMAT_ARGB_8888;
+                break;
+            }
+            default: {
+                frame.v_frame.pixel_format = PIXEL_FORMAT_BUTT;
+                break;
+            }
+        }
+        // fprintf(stderr, "[omv] pool id: %u, phys: %08lx\n", src->pool_id, src->phy_addr);
+        // fprintf(stderr, "[omv] system pixfmt: %u\n", frame.v_frame.pixel_format);
+        if (frame.v_frame.pixel_format == PIXEL_FORMAT_BUTT) {
+            // unsupported
+            goto skip;
+        }
+        int ssize = hd_jpeg_encode(&frame, (void**)&dst->data, dst->size, 1000, quality, NULL);
+        if (ssize > 0) {
+            dst->size = ssize;
+        } else if (ssize == 0) {
+            // overflow
+            return true;
+        } else {
+            goto skip;
+        }
+        return false;
+    }
+    skip:
+    fprintf(stderr, "[omv] software JPEG\n");
+
+    // The quantization tables are shared, frames may be encoded by a recorder thread too.
+    pthread_mutex_lock(&sw_jpeg_mutex);
+    bool overflow = jpeg_compress_sw(src, dst, quality, realloc);
+    pthread_mutex_unlock(&sw_jpeg_mutex);
 
     #if (TIME_JPEG == 1)
     printf("time: %lums\n", mp_hal_ticks_ms() - start);
     #endif
 
-    return false;
+    return overflow;
 }
 
 #endif // (OMV_HARDWARE_JPEG == 1)
@@ -428,6 +428,8 @@ typedef struct jpeg_image_tag {
     int iVLCSize;                // current quantity of data in the VLC buffer
     int iResInterval, iResCount; // restart interval
     int iMaxMCUs;                // max MCUs of pixels per JPEGDraw call
+    image_t *pOutImage;          // imlib destination of JPEGPutMCUImage(), NULL for the writers above
+    int iOutX, iOutY;            // scaled source position of the first destination pixel
     JPEG_READ_CALLBACK *pfnRead;
     JPEG_SEEK_CALLBACK *pfnSeek;
     JPEG_DRAW_CALLBACK *pfnDraw;
@@ -1389,7 +1391,7 @@ static int JPEGDecodeMCU(JPEGIMAGE *pJPEG, int iMCU, int *iDCPredictor) {
         ulBitOff &= 7;
         ulBits = MOTOLONG(pBuf);
     }
-    if (pJPEG->iOptions & (JPEG_SCALE_QUARTER | JPEG_SCALE_EIGHTH)) {
+    if (pJPEG->iOptions & JPEG_SCALE_EIGHTH) {
         // reduced size DCT
         pMCU[1] = pMCU[8] = pMCU[9] = 0;
         pEnd2 = (uint8_t *) &cZigZag2[5];    // we only need to store the 4 elements we care about
@@ -1581,26 +1583,63 @@ static void JPEGIDCT(JPEGIMAGE *pJPEG, int iMCUOffset, int iQuantTable, int iACF
     // but the patent is invalidated by prior art:
     // http://netilium.org/~mad/dtj/DTJ/DTJK04/
     pQuant = &pJPEG->sQuantTable[iQuantTable * DCTSIZE];
+    if (pJPEG->iOptions & JPEG_SCALE_HALF) {
+        // 4x4 IDCT of the low frequency coefficients, the AAN prescaling of the quantization
+        // table is divided out of the weights (cos((2j+1)u*pi/8) * C(u) / 2 / s(u) in Q12).
+        int32_t sTemp[16];
+        for (iCol = 0; iCol < 4; iCol++) {
+            tmp0 = pMCUSrc[iCol] * pQuant[iCol];
+            tmp1 = pMCUSrc[iCol + 8] * pQuant[iCol + 8];
+            tmp2 = pMCUSrc[iCol + 16] * pQuant[iCol + 16];
+            tmp3 = pMCUSrc[iCol + 24] * pQuant[iCol + 24];
+            tmp10 = (tmp0 * 1448) + (tmp2 * 1108);
+            tmp11 = (tmp0 * 1448) - (tmp2 * 1108);
+            tmp12 = (tmp1 * 1364) + (tmp3 * 667);
+            tmp13 = (tmp1 * 565) - (tmp3 * 1609);
+            sTemp[iCol] = (tmp10 + tmp12) >> 12;
+            sTemp[iCol + 4] = (tmp11 + tmp13) >> 12;
+            sTemp[iCol + 8] = (tmp11 - tmp13) >> 12;
+            sTemp[iCol + 12] = (tmp10 - tmp12) >> 12;
+        }
+        pOutput = (unsigned char *) pMCUSrc;    // store output pixels back into MCU
+        for (iRow = 0; iRow < 16; iRow += 4) {
+            // Q12 * Q12 and the x4 of the prescaled table, rounded
+            tmp10 = (sTemp[iRow] * 1448) + (sTemp[iRow + 2] * 1108) + (1 << 13);
+            tmp11 = (sTemp[iRow] * 1448) - (sTemp[iRow + 2] * 1108) + (1 << 13);
+            tmp12 = (sTemp[iRow + 1] * 1364) + (sTemp[iRow + 3] * 667);
+            tmp13 = (sTemp[iRow + 1] * 565) - (sTemp[iRow + 3] * 1609);
+            pOutput[iRow + 0] = ucRangeTable[(((tmp10 + tmp12) >> 14) & 0x3ff)];
+            pOutput[iRow + 1] = ucRangeTable[(((tmp11 + tmp13) >> 14) & 0x3ff)];
+            pOutput[iRow + 2] = ucRangeTable[(((tmp11 - tmp13) >> 14) & 0x3ff)];
+            pOutput[iRow + 3] = ucRangeTable[(((tmp10 - tmp12) >> 14) & 0x3ff)];
+        }
+        return;
+    }
     if (pJPEG->iOptions & JPEG_SCALE_QUARTER) {
-        // special case
-        /* Column 0 */
-        tmp4 = pMCUSrc[0] * pQuant[0];
-        tmp5 = pMCUSrc[8] * pQuant[8];
-        tmp0 = tmp4 + tmp5;
-        tmp2 = tmp4 - tmp5;
-        /* Column 1 */
-        tmp4 = pMCUSrc[1] * pQuant[1];
-        tmp5 = pMCUSrc[9] * pQuant[9];
-        tmp1 = tmp4 + tmp5;
-        tmp3 = tmp4 - tmp5;
-        /* Pass 2: process 2 rows, store into output array. */
-        /* Row 0 */
+        // 2x2 box average of the 8x8 IDCT. Averaging either half of a row cancels the even AC
+        // frequencies, the rest get sum(cos((2j+1)u*pi/16), j=0..3) * C(u) / 8 / s(u) in Q12, and
+        // the odd terms change sign in the second half.
+        static const int16_t sBoxWeight[8] = {1448, 946, 0, -392, 0, 392, 0, -946};
+        int32_t sTemp[16];
+        for (iCol = 0; iCol < 8; iCol += (iCol ? 2 : 1)) {
+            tmp10 = pMCUSrc[iCol] * pQuant[iCol] * sBoxWeight[0];
+            tmp12 = 0;
+            for (iRow = 1; iRow < 8; iRow += 2) {
+                tmp12 += pMCUSrc[iCol + (iRow * 8)] * pQuant[iCol + (iRow * 8)] * sBoxWeight[iRow];
+            }
+            sTemp[iCol] = (tmp10 + tmp12) >> 12;
+            sTemp[iCol + 8] = (tmp10 - tmp12) >> 12;
+        }
         pOutput = (unsigned char *) pMCUSrc;    // store output pixels back into MCU
-        pOutput[0] = ucRangeTable[(((tmp0 + tmp1) >> 5) & 0x3ff)];
-        pOutput[1] = ucRangeTable[(((tmp0 - tmp1) >> 5) & 0x3ff)];
-        /* Row 1 */
-        pOutput[2] = ucRangeTable[(((tmp2 + tmp3) >> 5) & 0x3ff)];
-        pOutput[3] = ucRangeTable[(((tmp2 - tmp3) >> 5) & 0x3ff)];
+        for (iRow = 0; iRow < 2; iRow++) {
+            // Q12 * Q12 and the x4 of the prescaled table, rounded
+            int32_t *pRow = &sTemp[iRow * 8];
+            tmp10 = (pRow[0] * sBoxWeight[0]) + (1 << 13);
+            tmp12 = (pRow[1] * sBoxWeight[1]) + (pRow[3] * sBoxWeight[3]) +
+                    (pRow[5] * sBoxWeight[5]) + (pRow[7] * sBoxWeight[7]);
+            pOutput[(iRow * 2) + 0] = ucRangeTable[(((tmp10 + tmp12) >> 14) & 0x3ff)];
+            pOutput[(iRow * 2) + 1] = ucRangeTable[(((tmp10 - tmp12) >> 14) & 0x3ff)];
+        }
         return;
     }
     // do columns first
@@ -2854,15 +2893,138 @@ static void JPEGPutMCU21(JPEGIMAGE *pJPEG, int x, int y) {
 
 // Decode the image
 // returns 0 for error, 1 for success
+// JPEG YCbCr (full range BT.601) to RGB in Q14.
+static inline void JPEGYCCToRGB(int iY, int iCb, int iCr, uint8_t *pRGB) {
+    int r = iY + (((iCr - 128) * 22970 + 8192) >> 14);
+    int g = iY - (((iCb - 128) * 5638 + (iCr - 128) * 11700 - 8192) >> 14);
+    int b = iY + (((iCb - 128) * 29032 + 8192) >> 14);
+    pRGB[0] = __USAT(r, 8);
+    pRGB[1] = __USAT(g, 8);
+    pRGB[2] = __USAT(b, 8);
+}
+
+// Writes the part of the current MCU that falls in the output window to an imlib image of any
+// supported pixel format, the MCU is (iCX, iCY) pixels at (x, y) in scaled source coordinates.
+// Blocks hold (8 >> scale) rows of (8 >> scale) pixels, chroma is upsampled by replication.
+static void JPEGPutMCUImage(JPEGIMAGE *pJPEG, int x, int y, int iCX, int iCY, int iCbMCU, int iCrMCU) {
+    image_t *img = pJPEG->pOutImage;
+    const int iShift = (pJPEG->iOptions & JPEG_SCALE_HALF) ? 1 :
+                       (pJPEG->iOptions & JPEG_SCALE_QUARTER) ? 2 :
+                       (pJPEG->iOptions & JPEG_SCALE_EIGHTH) ? 3 : 0;
+    const int iBlockShift = 3 - iShift, iBlockMask = (1 << iBlockShift) - 1;
+    const int iBlocksX = iCX >> iBlockShift;
+    const int iHS = (iCX >> iBlockShift) - 1, iVS = (iCY >> iBlockShift) - 1; // chroma subsampling
+    const int bColor = pJPEG->ucSubSample && (pJPEG->ucNumComponents == 3);
+    const uint8_t *pMCU = (const uint8_t *) pJPEG->sMCUs;
+    const uint8_t *pCb = (const uint8_t *) &pJPEG->sMCUs[iCbMCU];
+    const uint8_t *pCr = (const uint8_t *) &pJPEG->sMCUs[iCrMCU];
+    int x0 = IM_MAX(x, pJPEG->iOutX), x1 = IM_MIN(x + iCX, pJPEG->iOutX + img->w);
+    int y0 = IM_MAX(y, pJPEG->iOutY), y1 = IM_MIN(y + iCY, pJPEG->iOutY + img->h);
+
+    for (int sy = y0; sy < y1; sy++) {
+        int py = sy - y, dy = sy - pJPEG->iOutY;
+        const uint8_t *pYRow = pMCU + ((py >> iBlockShift) * iBlocksX * DCTSIZE * 2) + ((py & iBlockMask) << iBlockShift);
+        const uint8_t *pCbRow = pCb + ((py >> iVS) << iBlockShift);
+        const uint8_t *pCrRow = pCr + ((py >> iVS) << iBlockShift);
+        int dx = x0 - pJPEG->iOutX;
+
+        #define JPEG_Y(px)    pYRow[(((px) >> iBlockShift) * DCTSIZE * 2) + ((px) & iBlockMask)]
+        #define JPEG_CB(px)   (bColor ? pCbRow[(px) >> iHS] : 128)
+        #define JPEG_CR(px)   (bColor ? pCrRow[(px) >> iHS] : 128)
+
+        switch (img->pixfmt) {
+            case PIXFORMAT_BINARY: {
+                uint32_t *row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, dy);
+                for (int px = x0 - x; px < x1 - x; px++, dx++) {
+                    IMAGE_PUT_BINARY_PIXEL_FAST(row_ptr, dx, JPEG_Y(px) > 127);
+                }
+                break;
+            }
+            case PIXFORMAT_GRAYSCALE: {
+                uint8_t *row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, dy);
+                for (int px = x0 - x; px < x1 - x; px++, dx++) {
+                    row_ptr[dx] = JPEG_Y(px);
+                }
+                break;
+            }
+            case PIXFORMAT_RGB565: {
+                uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, dy);
+                for (int px = x0 - x; px < x1 - x; px++, dx++) {
+                    uint8_t rgb[3];
+                    JPEGYCCToRGB(JPEG_Y(px), JPEG_CB(px), JPEG_CR(px), rgb);
+                    row_ptr[dx] = COLOR_R8_G8_B8_TO_RGB565(rgb[0], rgb[1], rgb[2]);
+                }
+                break;
+            }
+            case PIXFORMAT_RGB888: {
+                uint8_t *row_ptr = img->data + (dy * img->w + dx) * 3;
+                for (int px = x0 - x; px < x1 - x; px++, row_ptr += 3) {
+                    JPEGYCCToRGB(JPEG_Y(px), JPEG_CB(px), JPEG_CR(px), row_ptr);
+                }
+                break;
+            }
+            case PIXFORMAT_RGBP888: {
+                // Planar R, G and B, the layout the KPU takes.
+                size_t plane = img->w * img->h;
+                uint8_t *row_ptr = img->data + (dy * img->w);
+                for (int px = x0 - x; px < x1 - x; px++, dx++) {
+                    uint8_t rgb[3];
+                    JPEGYCCToRGB(JPEG_Y(px), JPEG_CB(px), JPEG_CR(px), rgb);
+                    row_ptr[dx] = rgb[0];
+                    row_ptr[dx + plane] = rgb[1];
+                    row_ptr[dx + (plane * 2)] = rgb[2];
+                }
+                break;
+            }
+            case PIXFORMAT_YUV420: {
+                // Y plane followed by interleaved UV at half resolution (NV12).
+                uint8_t *row_ptr = img->data + (dy * img->w);
+                uint8_t *uv_ptr = img->data + (img->w * img->h) + ((dy / 2) * img->w);
+                for (int px = x0 - x; px < x1 - x; px++, dx++) {
+                    row_ptr[dx] = JPEG_Y(px);
+                    if (!((dy | dx) & 1) && (dy + 1 < img->h) && (dx + 1 < img->w)) {
+                        uv_ptr[dx] = JPEG_CB(px);
+                        uv_ptr[dx + 1] = JPEG_CR(px);
+                    }
+                }
+                break;
+            }
+            default: {
+                break;
+            }
+        }
+
+        #undef JPEG_Y
+        #undef JPEG_CB
+        #undef JPEG_CR
+    }
+}
+
+// Turns the coefficients of one block into pixels, blocks without AC terms are filled from the
+// (dequantized) DC term directly.
+static void JPEGBlockPixels(JPEGIMAGE *pJPEG, int iMCU, int iDC, int iComponent, int iMaxFill, int bThumbnail) {
+    if (pJPEG->ucMaxACCol == 0 || bThumbnail) {
+        // no AC components, save some time
+        uint8_t c = ucRangeTable[(iDC >> 5) & 0x3ff];
+        uint32_t l = c | ((uint32_t) c << 8) | ((uint32_t) c << 16) | ((uint32_t) c << 24);
+        uint32_t *pl = (uint32_t *) &pJPEG->sMCUs[iMCU];
+        // dct stores byte values
+        for (int i = 0; i < iMaxFill; i++) {
+            // 8x8 bytes = 16 longs
+            pl[i] = l;
+        }
+    } else {
+        JPEGIDCT(pJPEG, iMCU, pJPEG->JPCI[iComponent].quant_tbl_no, (pJPEG->ucMaxACCol | (pJPEG->ucMaxACRow << 8)));
+    }
+}
+
 static int DecodeJPEG(JPEGIMAGE *pJPEG) {
     int cx, cy, x, y, mcuCX, mcuCY;
     int iLum0, iLum1, iLum2, iLum3, iCr, iCb;
     signed int iDCPred0, iDCPred1, iDCPred2;
-    int i, iQuant1, iQuant2, iQuant3, iErr;
-    uint8_t c;
+    int iQuant1, iQuant2, iQuant3, iErr;
     int iMCUCount, /*xoff, iPitch,*/ bThumbnail = 0;
     int bContinue = 1; // early exit if the DRAW callback wants to stop
-    uint32_t l, *pl;
     unsigned char cDCTable0, cACTable0, cDCTable1, cACTable1, cDCTable2, cACTable2;
     int iMaxFill = 16, iScaleShift = 0;
 
@@ -2881,6 +3043,7 @@ static int DecodeJPEG(JPEGIMAGE *pJPEG) {
     // Fast downscaling options
     if (pJPEG->iOptions & JPEG_SCALE_HALF) {
         iScaleShift = 1;
+        iMaxFill = 4;
     } else if (pJPEG->iOptions & JPEG_SCALE_QUARTER) {
         iScaleShift = 2;
         iMaxFill = 1;
@@ -2974,73 +3137,36 @@ static int DecodeJPEG(JPEGIMAGE *pJPEG) {
         iMCUCount = cx; // do the whole row
     }
     for (y = 0; y < cy && bContinue; y++) {
+        if (pJPEG->pOutImage && (y * mcuCY >= pJPEG->iOutY + pJPEG->pOutImage->h)) {
+            break; // past the bottom of the output window, the rest of the scan isn't needed
+        }
         for (x = 0; x < cx && bContinue && iErr == 0; x++) {
+            // MCUs outside of the output window are entropy decoded (to track the DC predictors) only.
+            int bDraw = (!pJPEG->pOutImage) ||
+                        (((x + 1) * mcuCX > pJPEG->iOutX) && (x * mcuCX < pJPEG->iOutX + pJPEG->pOutImage->w) &&
+                         ((y + 1) * mcuCY > pJPEG->iOutY));
             pJPEG->ucACTable = cACTable0;
             pJPEG->ucDCTable = cDCTable0;
             // do the first luminance component
             iErr = JPEGDecodeMCU(pJPEG, iLum0, &iDCPred0);
-            if (pJPEG->ucMaxACCol == 0 || bThumbnail) {
-                // no AC components, save some time
-                pl = (uint32_t *) &pJPEG->sMCUs[iLum0];
-                c = ucRangeTable[((iDCPred0 * iQuant1) >> 5) & 0x3ff];
-                l = c | ((uint32_t) c << 8) | ((uint32_t) c << 16) | ((uint32_t) c << 24);
-                // dct stores byte values
-                for (i = 0; i < iMaxFill; i++) {
-                    // 8x8 bytes = 16 longs
-                    pl[i] = l;
-                }
-            } else {
-                // first quantization table
-                JPEGIDCT(pJPEG, iLum0, pJPEG->JPCI[0].quant_tbl_no, (pJPEG->ucMaxACCol | (pJPEG->ucMaxACRow << 8)));
+            if (bDraw) {
+                JPEGBlockPixels(pJPEG, iLum0, iDCPred0 * iQuant1, 0, iMaxFill, bThumbnail);
             }
             // do the second luminance component
             if (pJPEG->ucSubSample > 0x11) {
                 // subsampling
                 iErr |= JPEGDecodeMCU(pJPEG, iLum1, &iDCPred0);
-                if (pJPEG->ucMaxACCol == 0 || bThumbnail) {
-                    // no AC components, save some time
-                    c = ucRangeTable[((iDCPred0 * iQuant1) >> 5) & 0x3ff];
-                    l = c | ((uint32_t) c << 8) | ((uint32_t) c << 16) | ((uint32_t) c << 24);
-                    // dct stores byte values
-                    pl = (uint32_t *) &pJPEG->sMCUs[iLum1];
-                    for (i = 0; i < iMaxFill; i++) {
-                        // 8x8 bytes = 16 longs
-                        pl[i] = l;
-                    }
-                } else {
-                    // first quantization table
-                    JPEGIDCT(pJPEG, iLum1, pJPEG->JPCI[0].quant_tbl_no, (pJPEG->ucMaxACCol | (pJPEG->ucMaxACRow << 8)));
+                if (bDraw) {
+                    JPEGBlockPixels(pJPEG, iLum1, iDCPred0 * iQuant1, 0, iMaxFill, bThumbnail);
                 }
                 if (pJPEG->ucSubSample == 0x22) {
                     iErr |= JPEGDecodeMCU(pJPEG, iLum2, &iDCPred0);
-                    if (pJPEG->ucMaxACCol == 0 || bThumbnail) {
-                        // no AC components, save some time
-                        c = ucRangeTable[((iDCPred0 * iQuant1) >> 5) & 0x3ff];
-                        l = c | ((uint32_t) c << 8) | ((uint32_t) c << 16) | ((uint32_t) c << 24);
-                        // dct stores byte values
-                        pl = (uint32_t *) &pJPEG->sMCUs[iLum2];
-                        for (i = 0; i < iMaxFill; i++) {
-                            // 8x8 bytes = 16 longs
-                            pl[i] = l;
-                        }
-                    } else {
-                        // first quantization table
-                        JPEGIDCT(pJPEG, iLum2, pJPEG->JPCI[0].quant_tbl_no, (pJPEG->ucMaxACCol | (pJPEG->ucMaxACRow << 8)));
+                    if (bDraw) {
+                        JPEGBlockPixels(pJPEG, iLum2, iDCPred0 * iQuant1, 0, iMaxFill, bThumbnail);
                     }
                     iErr |= JPEGDecodeMCU(pJPEG, iLum3, &iDCPred0);
-                    if (pJPEG->ucMaxACCol == 0 || bThumbnail) {
-                        // no AC components, save some time
-                        c = ucRangeTable[((iDCPred0 * iQuant1) >> 5) & 0x3ff];
-                        l = c | ((uint32_t) c << 8) | ((uint32_t) c << 16) | ((uint32_t) c << 24);
-                        // dct stores byte values
-                        pl = (uint32_t *) &pJPEG->sMCUs[iLum3];
-                        for (i = 0; i < iMaxFill; i++) {
-                            // 8x8 bytes = 16 longs
-                            pl[i] = l;
-                        }
-                    } else {
-                        // first quantization table
-                        JPEGIDCT(pJPEG, iLum3, pJPEG->JPCI[0].quant_tbl_no, (pJPEG->ucMaxACCol | (pJPEG->ucMaxACRow << 8)));
+                    if (bDraw) {
+                        JPEGBlockPixels(pJPEG, iLum3, iDCPred0 * iQuant1, 0, iMaxFill, bThumbnail);
                     }
                 } // if 2:2 subsampling
             } // if subsampling used
@@ -3050,60 +3176,44 @@ static int DecodeJPEG(JPEGIMAGE *pJPEG) {
                 pJPEG->ucACTable = cACTable1;
                 pJPEG->ucDCTable = cDCTable1;
                 iErr |= JPEGDecodeMCU(pJPEG, iCr, &iDCPred1);
-                if (pJPEG->ucMaxACCol == 0 || bThumbnail) {
-                    // no AC components, save some time
-                    c = ucRangeTable[((iDCPred1 * iQuant2) >> 5) & 0x3ff];
-                    l = c | ((uint32_t) c << 8) | ((uint32_t) c << 16) | ((uint32_t) c << 24);
-                    // dct stores byte values
-                    pl = (uint32_t *) &pJPEG->sMCUs[iCr];
-                    for (i = 0; i < iMaxFill; i++) {
-                        // 8x8 bytes = 16 longs
-                        pl[i] = l;
-                    }
-                } else {
-                    // second quantization table
-                    JPEGIDCT(pJPEG, iCr, pJPEG->JPCI[1].quant_tbl_no, (pJPEG->ucMaxACCol | (pJPEG->ucMaxACRow << 8)));
+                if (bDraw) {
+                    JPEGBlockPixels(pJPEG, iCr, iDCPred1 * iQuant2, 1, iMaxFill, bThumbnail);
                 }
                 // second chroma
                 pJPEG->ucACTable = cACTable2;
                 pJPEG->ucDCTable = cDCTable2;
                 iErr |= JPEGDecodeMCU(pJPEG, iCb, &iDCPred2);
-                if (pJPEG->ucMaxACCol == 0 || bThumbnail) {
-                    // no AC components, save some time
-                    c = ucRangeTable[((iDCPred2 * iQuant3) >> 5) & 0x3ff];
-                    l = c | ((uint32_t) c << 8) | ((uint32_t) c << 16) | ((uint32_t) c << 24);
-                    // dct stores byte values
-                    pl = (uint32_t *) &pJPEG->sMCUs[iCb];
-                    for (i = 0; i < iMaxFill; i++) {
-                        // 8x8 bytes = 16 longs
-                        pl[i] = l;
-                    }
-                } else {
-                    JPEGIDCT(pJPEG, iCb, pJPEG->JPCI[2].quant_tbl_no, (pJPEG->ucMaxACCol | (pJPEG->ucMaxACRow << 8)));
+                if (bDraw) {
+                    JPEGBlockPixels(pJPEG, iCb, iDCPred2 * iQuant3, 2, iMaxFill, bThumbnail);
                 }
             } // if color components present
-            if (pJPEG->ucPixelType == EIGHT_BIT_GRAYSCALE) {
-                JPEGPutMCU8BitGray(pJPEG, x * mcuCX, y * mcuCY);
-            } else if (pJPEG->ucPixelType == ONE_BIT_GRAYSCALE) {
-                JPEGPutMCU1BitGray(pJPEG, x * mcuCX, y * mcuCY);
-            } else {
-                switch (pJPEG->ucSubSample) {
-                    case 0x00: // grayscale
-                        JPEGPutMCUGray(pJPEG, x * mcuCX, y * mcuCY);
-                        break; // not used
-                    case 0x11:
-                        JPEGPutMCU11(pJPEG, x * mcuCX, y * mcuCY);
-                        break;
-                    case 0x12:
-                        JPEGPutMCU12(pJPEG, x * mcuCX, y * mcuCY);
-                        break;
-                    case 0x21:
-                        JPEGPutMCU21(pJPEG, x * mcuCX, y * mcuCY);
-                        break;
-                    case 0x22:
-                        JPEGPutMCU22(pJPEG, x * mcuCX, y * mcuCY);
-                        break;
-                } // switch on color option
+            if (bDraw) {
+                if (pJPEG->pOutImage) {
+                    // iCr and iCb are named after the legacy writers, they hold Cb and Cr in that order.
+                    JPEGPutMCUImage(pJPEG, x * mcuCX, y * mcuCY, mcuCX, mcuCY, iCr, iCb);
+                } else if (pJPEG->ucPixelType == EIGHT_BIT_GRAYSCALE) {
+                    JPEGPutMCU8BitGray(pJPEG, x * mcuCX, y * mcuCY);
+                } else if (pJPEG->ucPixelType == ONE_BIT_GRAYSCALE) {
+                    JPEGPutMCU1BitGray(pJPEG, x * mcuCX, y * mcuCY);
+                } else {
+                    switch (pJPEG->ucSubSample) {
+                        case 0x00: // grayscale
+                            JPEGPutMCUGray(pJPEG, x * mcuCX, y * mcuCY);
+                            break; // not used
+                        case 0x11:
+                            JPEGPutMCU11(pJPEG, x * mcuCX, y * mcuCY);
+                            break;
+                        case 0x12:
+                            JPEGPutMCU12(pJPEG, x * mcuCX, y * mcuCY);
+                            break;
+                        case 0x21:
+                            JPEGPutMCU21(pJPEG, x * mcuCX, y * mcuCY);
+                            break;
+                        case 0x22:
+                            JPEGPutMCU22(pJPEG, x * mcuCX, y * mcuCY);
+                            break;
+                    } // switch on color option
+                }
             }
             if (pJPEG->iResInterval) {
                 if (--pJPEG->iResCount == 0) {
@@ -3128,7 +3238,7 @@ static int DecodeJPEG(JPEGIMAGE *pJPEG) {
     return (iErr == 0);
 }
 
-void jpeg_decompress(image_t *dst, image_t *src) {
+void jpeg_decompress_ex(image_t *dst, image_t *src, rectangle_t *roi, int scale_shift) {
     JPEGIMAGE jpg;
 
     #if (TIME_JPEG == 1)
@@ -3145,6 +3255,11 @@ void jpeg_decompress(image_t *dst, image_t *src) {
         mp_raise_msg(&mp_type_OSError, MP_ERROR_TEXT("JPEG decoder failed."));
     }
 
+    bool cropped = roi && ((roi->x != 0) || (roi->y != 0) || (roi->w != jpg.iWidth) || (roi->h != jpg.iHeight));
+    int options = (scale_shift == 1) ? JPEG_SCALE_HALF :
+                  (scale_shift == 2) ? JPEG_SCALE_QUARTER :
+                  (scale_shift == 3) ? JPEG_SCALE_EIGHTH : 0;
+
     switch (dst->pixfmt) {
         case PIXFORMAT_BINARY:
             // Force 1-bit (binary) output in the draw function.
@@ -3158,18 +3273,31 @@ void jpeg_decompress(image_t *dst, image_t *src) {
             // Force output to be RGB565
             jpg.ucPixelType = RGB565_LITTLE_ENDIAN;
             break;
+        case PIXFORMAT_RGB888:
+        case PIXFORMAT_RGBP888:
+        case PIXFORMAT_YUV420:
+            break;
         default:
             mp_raise_msg(&mp_type_OSError, MP_ERROR_TEXT("Unsupported format."));
     }
 
+    // The legacy writers only do full size BINARY, GRAYSCALE and RGB565 images, everything
+    // else goes through the generic writer which also clips to the (scaled) roi.
+    if (options || cropped
+        || (dst->pixfmt == PIXFORMAT_RGB888) || (dst->pixfmt == PIXFORMAT_RGBP888) || (dst->pixfmt == PIXFORMAT_YUV420)) {
+        jpg.pOutImage = dst;
+        jpg.iOutX = roi ? (roi->x >> scale_shift) : 0;
+        jpg.iOutY = roi ? (roi->y >> scale_shift) : 0;
+    } else {
+        // Fill buffer with 0's so we only need to write "set" bits
+        memset(dst->data, 0, image_size(dst));
+    }
+
     // Set up dest image params
     jpg.pUser = (void *) dst;
 
-    // Fill buffer with 0's so we only need to write "set" bits
-    memset(dst->data, 0, image_size(dst));
-
     // Start decoding.
-    if (JPEG_decode(&jpg, 0, 0, 0) == 0) {
+    if (JPEG_decode(&jpg, 0, 0, options) == 0) {
         mp_raise_msg(&mp_type_OSError, MP_ERROR_TEXT("JPEG decoder failed."));
     }
 
@@ -3177,4 +3305,8 @@ void jpeg_decompress(image_t *dst, image_t *src) {
     printf("time: %u ms\n", mp_hal_ticks_ms() - start);
     #endif
 }
+
+void jpeg_decompress(image_t *dst, image_t *src) {
+    jpeg_decompress_ex(dst, src, NULL, 0);
+}
 #endif
@@ -8,21 +8,61 @@
  *
  * A simple MJPEG encoder.
  */
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
 #include "imlib.h"
 #if defined(IMLIB_ENABLE_IMAGE_FILE_IO)
 
+#include "py/mphal.h"
+#include "py/runtime.h"
+#include "fb_alloc.h"
 #include "ff_wrapper.h"
 
 #define SIZE_OFFSET        (1 * 4)
 #define MICROS_OFFSET      (8 * 4)
+#define FLAGS_OFFSET       (11 * 4)
 #define FRAMES_OFFSET      (12 * 4)
 #define RATE_0_OFFSET      (19 * 4)
 #define LENGTH_0_OFFSET    (21 * 4)
 #define RATE_1_OFFSET      (33 * 4)
 #define LENGTH_1_OFFSET    (35 * 4)
 #define MOVI_OFFSET        (54 * 4)
+#define HEADER_SIZE        (56 * 4)
+// idx1 chunk offsets are relative to the "movi" FOURCC.
+#define INDEX_BASE         (HEADER_SIZE - 4)
 
-void mjpeg_open(FIL *fp, int width, int height) {
+#define AVIF_HASINDEX      (0x10)
+#define AVIIF_KEYFRAME     (0x10)
+#define JPEG_BUFFER_MIN    (64 * 1024)
+
+// A frame waiting for the encoder thread, raw pixels or an already compressed JPEG.
+typedef struct mjpeg_slot {
+    image_t img;
+    uint32_t capacity;
+    int quality;
+    float fps;                      // Rate estimate when the frame was queued, used by checkpoints.
+} mjpeg_slot_t;
+
+typedef struct mjpeg_writer {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    FILE *fp;
+    mjpeg_t *mjpeg;
+    mjpeg_slot_t *slots;
+    uint32_t slot_count;
+    uint32_t head;                  // next slot to fill
+    uint32_t tail;                  // next slot to encode
+    uint32_t pending;               // slots filled and not written yet
+    uint8_t *jpeg;                  // encoder output, doubled on overflow
+    uint32_t jpeg_capacity;
+    bool quit;
+    int error;
+} mjpeg_writer_t;
+
+static void mjpeg_write_header(FIL *fp, int width, int height) {
     write_data(fp, "RIFF", 4); // FOURCC fcc; - 0
     write_long(fp, 0); // DWORD cb; size - updated on close - 1
     write_data(fp, "AVI ", 4); // FOURCC fcc; - 2
@@ -36,7 +76,7 @@ void mjpeg_open(FIL *fp, int width, int height) {
     write_long(fp, 0); // DWORD dwMicroSecPerFrame; micros - updated on close - 8
     write_long(fp, 0); // DWORD dwMaxBytesPerSec; updated on close - 9
     write_long(fp, 4); // DWORD dwPaddingGranularity; - 10
-    write_long(fp, 0); // DWORD dwFlags; - 11
+    write_long(fp, 0); // DWORD dwFlags; AVIF_HASINDEX - updated on close - 11
     write_long(fp, 0); // DWORD dwTotalFrames; frames - updated on close - 12
     write_long(fp, 0); // DWORD dwInitialFrames; - 13
     write_long(fp, 1); // DWORD dwStreams; - 14
@@ -91,9 +131,379 @@ void mjpeg_open(FIL *fp, int width, int height) {
     write_data(fp, "movi", 4); // FOURCC fcc; - 55
 }
 
-void mjpeg_write(FIL *fp, int width, int height, uint32_t *frames, uint32_t *bytes,
-                 image_t *img, int quality, rectangle_t *roi, int rgb_channel, int alpha,
+
+// The helpers below only use stdio and return an errno value, they run on the encoder thread too.
+static int mjpeg_put(FILE *fp, const void *data, uint32_t size) {
+    if (size && (fwrite(data, size, 1, fp) != 1)) {
+        return errno ? errno : EIO;
+    }
+
+    return 0;
+}
+
+static int mjpeg_put_long_at(FILE *fp, uint32_t offset, uint32_t value) {
+    uint8_t buf[4] = {value, value >> 8, value >> 16, value >> 24};
+
+    if (fseek(fp, offset, SEEK_SET)) {
+        return errno ? errno : EIO;
+    }
+
+    return mjpeg_put(fp, buf, sizeof(buf));
+}
+
+static float mjpeg_rate(mjpeg_t *mjpeg) {
+    uint32_t elapsed = mjpeg->last_ms - mjpeg->start_ms;
+    return ((mjpeg->count > 1) && elapsed) ? (((mjpeg->count - 1) * 1000.0f) / elapsed) : 0.0f;
+}
+
+// Appends a 00dc chunk at the end of the movi list and records it in the index.
+static int mjpeg_append(FILE *fp, mjpeg_t *mjpeg, const uint8_t *data, uint32_t size) {
+    static const uint8_t padding[3] = {0};
+    uint32_t size_padded = (((size + 3) / 4) * 4);
+
+    if ((mjpeg->frames * 2) == mjpeg->index_cap) {
+        uint32_t cap = IM_MAX(mjpeg->index_cap * 2, 256U);
+        uint32_t *index = realloc(mjpeg->index, cap * sizeof(uint32_t));
+
+        if (!index) {
+            return ENOMEM;
+        }
+
+        mjpeg->index = index;
+        mjpeg->index_cap = cap;
+    }
+
+    uint8_t chunk[8] = {'0', '0', 'd', 'c', size_padded, size_padded >> 8, size_padded >> 16, size_padded >> 24};
+    int error = mjpeg_put(fp, chunk, sizeof(chunk));
+
+    if (!error) {
+        error = mjpeg_put(fp, data, size);
+    }
+
+    if (!error) {
+        error = mjpeg_put(fp, padding, size_padded - size);
+    }
+
+    if (error) {
+        return error;
+    }
+
+    mjpeg->index[mjpeg->frames * 2] = HEADER_SIZE - INDEX_BASE + (mjpeg->frames * 8) + mjpeg->bytes;
+    mjpeg->index[(mjpeg->frames * 2) + 1] = size_padded;
+    mjpeg->frames += 1;
+    mjpeg->bytes += size_padded;
+    return 0;
+}
+
+// Writes idx1 after the last frame and updates the header so that the file is playable up to
+// here. The next frame overwrites the index, which is written again, larger, on the next sync.
+static int mjpeg_write_index(FILE *fp, mjpeg_t *mjpeg, float fps) {
+    uint32_t frames = mjpeg->frames;
+    uint32_t end = HEADER_SIZE + (frames * 8) + mjpeg->bytes;
+    uint32_t buf[64];
+    int error = 0;
+
+    if (fseek(fp, end, SEEK_SET)) {
+        return errno ? errno : EIO;
+    }
+
+    buf[0] = 0x31786469; // "idx1"
+    buf[1] = frames * 16;
+    error = mjpeg_put(fp, buf, 8);
+
+    for (uint32_t i = 0; (i < frames) && (!error); ) {
+        uint32_t n = IM_MIN(frames - i, 16U);
+
+        for (uint32_t j = 0; j < n; j++, i++) {
+            buf[(j * 4) + 0] = 0x63643030; // "00dc"
+            buf[(j * 4) + 1] = AVIIF_KEYFRAME;
+            buf[(j * 4) + 2] = mjpeg->index[i * 2];
+            buf[(j * 4) + 3] = mjpeg->index[(i * 2) + 1];
+        }
+
+        error = mjpeg_put(fp, buf, n * 16);
+    }
+
+    uint32_t micros = (!fast_roundf(fps)) ? 0 : fast_roundf(1000000 / fps);
+    uint32_t length = (!fast_roundf(fps)) ? 0 : fast_roundf((frames * 1000) / fps);
+    uint32_t rate = fast_roundf(fps * 1000);
+
+    if (!error) {
+        // RIFF header excluded, idx1 header included.
+        error = mjpeg_put_long_at(fp, SIZE_OFFSET, end + (frames * 16));
+    }
+
+    if (!error) {
+        error = mjpeg_put_long_at(fp, MICROS_OFFSET, micros);
+    }
+
+    if (!error) {
+        error = mjpeg_put_long_at(fp, MICROS_OFFSET + 4, (!frames) ? 0 :
+                                  fast_roundf((((frames * 8) + mjpeg->bytes) * fps) / frames));
+    }
+
+    if (!error) {
+        error = mjpeg_put_long_at(fp, FLAGS_OFFSET, AVIF_HASINDEX);
+    }
+
+    if (!error) {
+        error = mjpeg_put_long_at(fp, FRAMES_OFFSET, frames);
+    }
+
+    // Probably not needed but writing them just in case.
+    if (!error) {
+        error = mjpeg_put_long_at(fp, RATE_0_OFFSET, rate);
+    }
+
+    if (!error) {
+        error = mjpeg_put_long_at(fp, LENGTH_0_OFFSET, length);
+    }
+
+    if (!error) {
+        error = mjpeg_put_long_at(fp, RATE_1_OFFSET, rate);
+    }
+
+    if (!error) {
+        error = mjpeg_put_long_at(fp, LENGTH_1_OFFSET, length);
+    }
+
+    if (!error) {
+        error = mjpeg_put_long_at(fp, MOVI_OFFSET, 4 + (frames * 8) + mjpeg->bytes);
+    }
+
+    if ((!error) && (fflush(fp) || fsync(fileno(fp)))) {
+        error = errno ? errno : EIO;
+    }
+
+    if ((!error) && fseek(fp, end, SEEK_SET)) {
+        error = errno ? errno : EIO;
+    }
+
+    return error;
+}
+
+static int mjpeg_encode_slot(mjpeg_writer_t *writer, mjpeg_slot_t *slot) {
+    if (slot->img.pixfmt == PIXFORMAT_JPEG) {
+        return mjpeg_append(writer->fp, writer->mjpeg, slot->img.data, slot->img.size);
+    }
+
+    for (;;) {
+        image_t dst = {
+            .w = slot->img.w,
+            .h = slot->img.h,
+            .pixfmt = PIXFORMAT_JPEG,
+            .size = writer->jpeg_capacity,
+            .data = writer->jpeg
+        };
+
+        if (!jpeg_compress(&slot->img, &dst, slot->quality, false)) {
+            return mjpeg_append(writer->fp, writer->mjpeg, dst.data, dst.size);
+        }
+
+        uint8_t *jpeg = realloc(writer->jpeg, writer->jpeg_capacity * 2);
+
+        if (!jpeg) {
+            return ENOMEM;
+        }
+
+        writer->jpeg = jpeg;
+        writer->jpeg_capacity *= 2;
+    }
+}
+
+static void *mjpeg_writer_task(void *arg) {
+    mjpeg_writer_t *writer = arg;
+
+    pthread_mutex_lock(&writer->lock);
+
+    for (;;) {
+        while ((!writer->pending) && (!writer->quit)) {
+            pthread_cond_wait(&writer->cond, &writer->lock);
+        }
+
+        if (!writer->pending) {
+            break;
+        }
+
+        mjpeg_slot_t *slot = &writer->slots[writer->tail];
+        bool failed = writer->error;
+        pthread_mutex_unlock(&writer->lock);
+
+        int error = 0;
+
+        if (!failed) {
+            mjpeg_t *mjpeg = writer->mjpeg;
+            error = mjpeg_encode_slot(writer, slot);
+
+            if ((!error) && mjpeg->checkpoint && (!(mjpeg->frames % mjpeg->checkpoint))) {
+                error = mjpeg_write_index(writer->fp, mjpeg, slot->fps);
+            }
+        }
+
+        pthread_mutex_lock(&writer->lock);
+
+        if (error) {
+            writer->error = error;
+        }
+
+        writer->tail = (writer->tail + 1) % writer->slot_count;
+        writer->pending -= 1;
+        pthread_cond_broadcast(&writer->cond);
+    }
+
+    pthread_mutex_unlock(&writer->lock);
+    return NULL;
+}
+
+static void mjpeg_writer_start(FILE *fp, mjpeg_t *mjpeg, uint32_t slot_count) {
+    mjpeg_writer_t *writer = calloc(1, sizeof(mjpeg_writer_t));
+    mjpeg_slot_t *slots = calloc(slot_count, sizeof(mjpeg_slot_t));
+    uint8_t *jpeg = malloc(JPEG_BUFFER_MIN);
+
+    if ((!writer) || (!slots) || (!jpeg)) {
+        free(writer);
+        free(slots);
+        free(jpeg);
+        mp_raise_msg(&mp_type_MemoryError, MP_ERROR_TEXT("Failed to allocate the encoder queue"));
+    }
+
+    writer->fp = fp;
+    writer->mjpeg = mjpeg;
+    writer->slots = slots;
+    writer->slot_count = slot_count;
+    writer->jpeg = jpeg;
+    writer->jpeg_capacity = JPEG_BUFFER_MIN;
+    pthread_mutex_init(&writer->lock, NULL);
+    pthread_cond_init(&writer->cond, NULL);
+
+    if (pthread_create(&writer->thread, NULL, mjpeg_writer_task, writer)) {
+        pthread_cond_destroy(&writer->cond);
+        pthread_mutex_destroy(&writer->lock);
+        free(jpeg);
+        free(slots);
+        free(writer);
+        mp_raise_msg(&mp_type_OSError, MP_ERROR_TEXT("Failed to start the encoder thread"));
+    }
+
+    mjpeg->writer = writer;
+}
+
+// Waits for the encoder thread to go idle and returns the first error, if any.
+static int mjpeg_writer_wait(mjpeg_writer_t *writer) {
+    MP_THREAD_GIL_EXIT();
+    pthread_mutex_lock(&writer->lock);
+
+    while (writer->pending) {
+        pthread_cond_wait(&writer->cond, &writer->lock);
+    }
+
+    int error = writer->error;
+    writer->error = 0;
+    pthread_mutex_unlock(&writer->lock);
+    MP_THREAD_GIL_ENTER();
+    return error;
+}
+
+static int mjpeg_writer_stop(mjpeg_writer_t *writer) {
+    pthread_mutex_lock(&writer->lock);
+    writer->quit = true;
+    pthread_cond_broadcast(&writer->cond);
+    pthread_mutex_unlock(&writer->lock);
+
+    MP_THREAD_GIL_EXIT();
+    pthread_join(writer->thread, NULL);
+    MP_THREAD_GIL_ENTER();
+
+    int error = writer->error;
+
+    for (uint32_t i = 0; i < writer->slot_count; i++) {
+        free(writer->slots[i].img.data);
+    }
+
+    pthread_cond_destroy(&writer->cond);
+    pthread_mutex_destroy(&writer->lock);
+    free(writer->jpeg);
+    free(writer->slots);
+    free(writer);
+    return error;
+}
+
+// Copies a frame into the next free slot, blocks while all slots are queued.
+static void mjpeg_writer_queue(mjpeg_writer_t *writer, image_t *img, int quality, float fps) {
+    MP_THREAD_GIL_EXIT();
+    pthread_mutex_lock(&writer->lock);
+
+    while (writer->pending == writer->slot_count) {
+        pthread_cond_wait(&writer->cond, &writer->lock);
+    }
+
+    int error = writer->error;
+    writer->error = 0;
+    pthread_mutex_unlock(&writer->lock);
+    MP_THREAD_GIL_ENTER();
+
+    if (error) {
+        mp_raise_OSError(error);
+    }
+
+    // The head slot is not used by the encoder thread until it is committed.
+    mjpeg_slot_t *slot = &writer->slots[writer->head];
+    uint32_t size = img->is_compressed ? img->size : image_size(img);
+
+    if (slot->capacity < size) {
+        uint8_t *data = realloc(slot->img.data, size);
+
+        if (!data) {
+            mp_raise_msg(&mp_type_MemoryError, MP_ERROR_TEXT("Failed to allocate an encoder slot"));
+        }
+
+        slot->img.data = data;
+        slot->capacity = size;
+    }
+
+    uint8_t *data = slot->img.data;
+    memcpy(data, img->data, size);
+    memset(&slot->img, 0, sizeof(image_t));
+    slot->img.w = img->w;
+    slot->img.h = img->h;
+    slot->img.pixfmt = img->pixfmt;
+    slot->img.size = size;
+    slot->img.data = data;
+    slot->quality = quality;
+    slot->fps = fps;
+
+    pthread_mutex_lock(&writer->lock);
+    writer->head = (writer->head + 1) % writer->slot_count;
+    writer->pending += 1;
+    pthread_cond_broadcast(&writer->cond);
+    pthread_mutex_unlock(&writer->lock);
+}
+
+void mjpeg_open(FIL *fp, mjpeg_t *mjpeg, int width, int height, uint32_t queue, uint32_t checkpoint) {
+    memset(mjpeg, 0, sizeof(mjpeg_t));
+    mjpeg->w = width;
+    mjpeg->h = height;
+    mjpeg->checkpoint = checkpoint;
+
+    if (width && height) {
+        mjpeg_write_header(fp, width, height);
+    }
+
+    if (queue) {
+        mjpeg_writer_start(*fp, mjpeg, queue);
+    }
+}
+
+void mjpeg_write(FIL *fp, mjpeg_t *mjpeg, image_t *img, int quality, rectangle_t *roi, int rgb_channel, int alpha,
                  const uint16_t *color_palette, const uint8_t *alpha_palette, image_hint_t hint) {
+    if (!(mjpeg->w && mjpeg->h)) {
+        mjpeg->w = roi->w;
+        mjpeg->h = roi->h;
+        mjpeg_write_header(fp, mjpeg->w, mjpeg->h);
+    }
+
+    int width = mjpeg->w;
+    int height = mjpeg->h;
     float xscale = width / ((float) roi->w);
     float yscale = height / ((float) roi->h);
     // MAX == KeepAspectRationByExpanding - MIN == KeepAspectRatio
@@ -116,150 +526,143 @@ void mjpeg_write(FIL *fp, int width, int height, uint32_t *frames, uint32_t *byt
                   (rgb_channel == -1) &&
                   (alpha == 256) &&
                   (color_palette == NULL) &&
-                  (alpha_palette == NULL);
+                  (alpha_palette == NULL) &&
+                  ((!img->is_compressed) || (img->pixfmt == PIXFORMAT_JPEG));
+
+    mjpeg->last_ms = mp_hal_ticks_ms();
+
+    if (!mjpeg->count) {
+        mjpeg->start_ms = mjpeg->last_ms;
+    }
+
+    mjpeg->count += 1;
 
     fb_alloc_mark();
 
-    if ((dst_img.pixfmt != img->pixfmt) || (!simple)) {
-        image_t temp;
-        memcpy(&temp, img, sizeof(image_t));
-
-        if (img->is_compressed || (!simple)) {
-            temp.w = dst_img.w;
-            temp.h = dst_img.h;
-            temp.pixfmt = PIXFORMAT_RGB565; // TODO PIXFORMAT_ARGB8888
-            temp.size = 0;
-            temp.data = fb_alloc(image_size(&temp), FB_ALLOC_NO_HINT);
-
-            int center_x = fast_floorf((width - (roi->w * scale)) / 2);
-            int center_y = fast_floorf((height - (roi->h * scale)) / 2);
-
-            int x0, x1, y0, y1;
-            bool black = !imlib_draw_image_rectangle(&temp, img, center_x, center_y, scale, scale, roi,
-                                                     alpha, alpha_palette, hint, &x0, &x1, &y0, &y1);
-
-            if (black) {
-                // zero the whole image
-                memset(temp.data, 0, temp.w * temp.h * sizeof(uint16_t));
-            } else {
-                // Zero the top rows
-                if (y0) {
-                    memset(temp.data, 0, temp.w * y0 * sizeof(uint16_t));
-                }
+    // RGB888 and YUV420 frames go to the encoder as they are, only scaled or
+    // compressed non-JPEG frames are drawn into a temporary image first.
+    image_t temp;
+    memcpy(&temp, img, sizeof(image_t));
 
-                if (x0) {
-                    for (int i = y0; i < y1; i++) {
-                        // Zero left
-                        memset(IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(&temp, i), 0, x0 * sizeof(uint16_t));
-                    }
-                }
+    if (!simple) {
+        temp.w = dst_img.w;
+        temp.h = dst_img.h;
+        temp.pixfmt = PIXFORMAT_RGB565;
+        temp.size = 0;
+        temp.phy_addr = 0;
+        temp.data = fb_alloc(image_size(&temp), FB_ALLOC_NO_HINT);
 
-                imlib_draw_image(&temp, img, center_x, center_y, scale, scale, roi,
-                                 rgb_channel, alpha, color_palette, alpha_palette,
-                                 (hint & (~IMAGE_HINT_CENTER)) | IMAGE_HINT_BLACK_BACKGROUND,
-                                 NULL, NULL);
-
-                if (temp.w - x1) {
-                    for (int i = y0; i < y1; i++) {
-                        // Zero right
-                        memset(IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(&temp, i) + x1,
-                               0, (temp.w - x1) * sizeof(uint16_t));
-                    }
+        int center_x = fast_floorf((width - (roi->w * scale)) / 2);
+        int center_y = fast_floorf((height - (roi->h * scale)) / 2);
+
+        int x0, x1, y0, y1;
+        bool black = !imlib_draw_image_rectangle(&temp, img, center_x, center_y, scale, scale, roi,
+                                                 alpha, alpha_palette, hint, &x0, &x1, &y0, &y1);
+
+        if (black) {
+            // zero the whole image
+            memset(temp.data, 0, temp.w * temp.h * sizeof(uint16_t));
+        } else {
+            // Zero the top rows
+            if (y0) {
+                memset(temp.data, 0, temp.w * y0 * sizeof(uint16_t));
+            }
+
+            if (x0) {
+                for (int i = y0; i < y1; i++) {
+                    // Zero left
+                    memset(IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(&temp, i), 0, x0 * sizeof(uint16_t));
                 }
+            }
+
+            imlib_draw_image(&temp, img, center_x, center_y, scale, scale, roi,
+                             rgb_channel, alpha, color_palette, alpha_palette,
+                             (hint & (~IMAGE_HINT_CENTER)) | IMAGE_HINT_BLACK_BACKGROUND,
+                             NULL, NULL);
 
-                // Zero the bottom rows
-                if (temp.h - y1) {
-                    memset(IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(&temp, y1),
-                           0, temp.w * (temp.h - y1) * sizeof(uint16_t));
+            if (temp.w - x1) {
+                for (int i = y0; i < y1; i++) {
+                    // Zero right
+                    memset(IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(&temp, i) + x1,
+                           0, (temp.w - x1) * sizeof(uint16_t));
                 }
             }
+
+            // Zero the bottom rows
+            if (temp.h - y1) {
+                memset(IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(&temp, y1),
+                       0, temp.w * (temp.h - y1) * sizeof(uint16_t));
+            }
         }
+    }
+
+    // VB frames are hardware encoded here, the queue only gets their JPEG bytes.
+    bool hardware = temp.phy_addr && (temp.alloc_type == ALLOC_VB) && (!temp.is_compressed);
 
-        // When jpeg_compress needs more memory than in currently allocated it
-        // will try to realloc. MP will detect that the pointer is outside of
-        // the heap and return NULL which will cause an out of memory error.
-        jpeg_compress(&temp, &dst_img, quality, true);
+    if (mjpeg->writer && (!hardware)) {
+        mjpeg_writer_queue(mjpeg->writer, &temp, quality, mjpeg_rate(mjpeg));
     } else {
-        dst_img.size = img->size;
-        dst_img.data = img->data;
-    }
+        if (temp.pixfmt != PIXFORMAT_JPEG) {
+            // When jpeg_compress needs more memory than in currently allocated it
+            // will try to realloc. MP will detect that the pointer is outside of
+            // the heap and return NULL which will cause an out of memory error.
+            jpeg_compress(&temp, &dst_img, quality, true);
+        } else {
+            dst_img.size = temp.size;
+            dst_img.data = temp.data;
+        }
 
-    uint32_t size_padded = (((dst_img.size + 3) / 4) * 4);
-    write_data(fp, "00dc", 4); // FOURCC fcc;
-    write_long(fp, size_padded); // DWORD cb;
-    write_data(fp, dst_img.data, size_padded); // reading past okay
+        if (mjpeg->writer) {
+            mjpeg_writer_queue(mjpeg->writer, &dst_img, quality, mjpeg_rate(mjpeg));
+        } else {
+            int error = mjpeg_append(*fp, mjpeg, dst_img.data, dst_img.size);
 
-    *frames += 1;
-    *bytes += size_padded;
+            if ((!error) && mjpeg->checkpoint && (!(mjpeg->frames % mjpeg->checkpoint))) {
+                error = mjpeg_write_index(*fp, mjpeg, mjpeg_rate(mjpeg));
+            }
+
+            if (error) {
+                mp_raise_OSError(error);
+            }
+        }
+    }
 
     fb_alloc_free_till_mark();
 }
 
-void mjpeg_sync(FIL *fp, uint32_t *frames, uint32_t *bytes, float fps) {
-    uint32_t position = f_tell(fp);
-    // Needed
-    file_seek(fp, SIZE_OFFSET);
-    write_long(fp, 216 + (*frames * 8) + *bytes);
-    // Needed
-    file_seek(fp, MICROS_OFFSET);
-    write_long(fp, (!fast_roundf(fps)) ? 0 :
-               fast_roundf(1000000 / fps));
-    write_long(fp, (!(*frames)) ? 0 :
-               fast_roundf((((*frames * 8) + *bytes) * fps) / *frames));
-    // Needed
-    file_seek(fp, FRAMES_OFFSET);
-    write_long(fp, *frames);
-    // Probably not needed but writing it just in case.
-    file_seek(fp, RATE_0_OFFSET);
-    write_long(fp, fast_roundf(fps * 1000));
-    // Probably not needed but writing it just in case.
-    file_seek(fp, LENGTH_0_OFFSET);
-    write_long(fp, (!fast_roundf(fps)) ? 0 :
-               fast_roundf((*frames * 1000) / fps));
-    // Probably not needed but writing it just in case.
-    file_seek(fp, RATE_1_OFFSET);
-    write_long(fp, fast_roundf(fps * 1000));
-    // Probably not needed but writing it just in case.
-    file_seek(fp, LENGTH_1_OFFSET);
-    write_long(fp, (!fast_roundf(fps)) ? 0 :
-               fast_roundf((*frames * 1000) / fps));
-    // Needed
-    file_seek(fp, MOVI_OFFSET);
-    write_long(fp, 4 + (*frames * 8) + *bytes);
-    file_sync(fp);
-    file_seek(fp, position);
+void mjpeg_sync(FIL *fp, mjpeg_t *mjpeg, float fps) {
+    int error = mjpeg->writer ? mjpeg_writer_wait(mjpeg->writer) : 0;
+
+    if (!error) {
+        error = mjpeg_write_index(*fp, mjpeg, (fps > 0) ? fps : mjpeg_rate(mjpeg));
+    }
+
+    if (error) {
+        mp_raise_OSError(error);
+    }
 }
 
-void mjpeg_close(FIL *fp, uint32_t *frames, uint32_t *bytes, float fps) {
-    // Needed
-    file_seek(fp, SIZE_OFFSET);
-    write_long(fp, 216 + (*frames * 8) + *bytes);
-    // Needed
-    file_seek(fp, MICROS_OFFSET);
-    write_long(fp, (!fast_roundf(fps)) ? 0 :
-               fast_roundf(1000000 / fps));
-    write_long(fp, (!(*frames)) ? 0 :
-               fast_roundf((((*frames * 8) + *bytes) * fps) / *frames));
-    // Needed
-    file_seek(fp, FRAMES_OFFSET);
-    write_long(fp, *frames);
-    // Probably not needed but writing it just in case.
-    file_seek(fp, RATE_0_OFFSET);
-    write_long(fp, fast_roundf(fps * 1000));
-    // Probably not needed but writing it just in case.
-    file_seek(fp, LENGTH_0_OFFSET);
-    write_long(fp, (!fast_roundf(fps)) ? 0 :
-               fast_roundf((*frames * 1000) / fps));
-    // Probably not needed but writing it just in case.
-    file_seek(fp, RATE_1_OFFSET);
-    write_long(fp, fast_roundf(fps * 1000));
-    // Probably not needed but writing it just in case.
-    file_seek(fp, LENGTH_1_OFFSET);
-    write_long(fp, (!fast_roundf(fps)) ? 0 :
-               fast_roundf((*frames * 1000) / fps));
-    // Needed
-    file_seek(fp, MOVI_OFFSET);
-    write_long(fp, 4 + (*frames * 8) + *bytes);
+void mjpeg_close(FIL *fp, mjpeg_t *mjpeg, float fps) {
+    int error = 0;
+
+    if (mjpeg->writer) {
+        error = mjpeg_writer_stop(mjpeg->writer);
+        mjpeg->writer = NULL;
+    }
+
+    if ((!error) && mjpeg->w && mjpeg->h) {
+        error = mjpeg_write_index(*fp, mjpeg, (fps > 0) ? fps : mjpeg_rate(mjpeg));
+    }
+
+    free(mjpeg->index);
+    mjpeg->index = NULL;
+    mjpeg->index_cap = 0;
+
+    if (error) {
+        fclose(*fp);
+        mp_raise_OSError(error);
+    }
+
     file_close(fp);
 }
 
@@ -374,13 +374,107 @@ static void image_scale(image_t *src, image_t *dst) {
     }
 }
 
+// Detects and describes keypoints on a single (blurred) pyramid level.
+// At most max_keypoints are kept per level so that only those get described.
+static void orb_find_level_keypoints(image_t *img_scaled, array_t *kpts, int threshold, int octave,
+                                     float x_scale, float y_scale, corner_detector_t corner_detector,
+                                     rectangle_t *roi_scaled, int max_keypoints) {
+    int kpts_index = array_length(kpts);
+
+    // Find kpts
+    #ifdef IMLIB_ENABLE_FAST
+    if (corner_detector == CORNER_FAST) {
+        fast_detect(img_scaled, kpts, threshold, roi_scaled, max_keypoints);
+    } else
+    #endif
+    {
+        agast_detect(img_scaled, kpts, threshold, roi_scaled, max_keypoints);
+    }
+
+    for (int k = kpts_index; k < array_length(kpts); k++) {
+        // Set keypoint octave/scale
+        kp_t *kpt = array_at(kpts, k);
+        kpt->octave = octave;
+
+        int x, y;
+        float a, b;
+        sample_point_t *pattern = (sample_point_t *) sample_pattern;
+        kpt->angle = comp_angle(img_scaled, kpt, &a, &b);
+
+        #if 1
+#define GET_VALUE(idx)                                          \
+    (x = (int) roundf(pattern[idx].x * a - pattern[idx].y * b), \
+     y = (int) roundf(pattern[idx].x * b + pattern[idx].y * a), \
+     img_scaled->pixels[((kpt->y + y) * img_scaled->w) + (kpt->x + x)])
+        #else
+#define GET_VALUE(idx) \
+    (img_scaled->pixels[((kpt->y + pattern[idx].y) * img_scaled->w) + (kpt->x + pattern[idx].x)])
+        #endif
+
+        for (int i = 0; i < KDESC_SIZE; ++i, pattern += 16) {
+            int t0, t1, t2, t3, u, v, k, val;
+            t0 = GET_VALUE(0); t1 = GET_VALUE(1);
+            t2 = GET_VALUE(2); t3 = GET_VALUE(3);
+            u = 0, v = 2;
+            if (t1 > t0) {
+                t0 = t1, u = 1;
+            }
+            if (t3 > t2) {
+                t2 = t3, v = 3;
+            }
+            k = t0 > t2 ? u : v;
+            val = k;
+
+            t0 = GET_VALUE(4); t1 = GET_VALUE(5);
+            t2 = GET_VALUE(6); t3 = GET_VALUE(7);
+            u = 0, v = 2;
+            if (t1 > t0) {
+                t0 = t1, u = 1;
+            }
+            if (t3 > t2) {
+                t2 = t3, v = 3;
+            }
+            k = t0 > t2 ? u : v;
+            val |= k << 2;
+
+            t0 = GET_VALUE(8); t1 = GET_VALUE(9);
+            t2 = GET_VALUE(10); t3 = GET_VALUE(11);
+            u = 0, v = 2;
+            if (t1 > t0) {
+                t0 = t1, u = 1;
+            }
+            if (t3 > t2) {
+                t2 = t3, v = 3;
+            }
+            k = t0 > t2 ? u : v;
+            val |= k << 4;
+
+            t0 = GET_VALUE(12); t1 = GET_VALUE(13);
+            t2 = GET_VALUE(14); t3 = GET_VALUE(15);
+            u = 0, v = 2;
+            if (t1 > t0) {
+                t0 = t1, u = 1;
+            }
+            if (t3 > t2) {
+                t2 = t3, v = 3;
+            }
+            k = t0 > t2 ? u : v;
+            val |= k << 6;
+
+            kpt->desc[i] = (uint8_t) val;
+        }
+
+        kpt->x = (int) floorf(kpt->x * x_scale);
+        kpt->y = (int) floorf(kpt->y * y_scale);
+    }
+}
+
 array_t *orb_find_keypoints(image_t *img, bool normalized, int threshold,
                             float scale_factor, int max_keypoints, corner_detector_t corner_detector, rectangle_t *roi) {
     array_t *kpts;
     array_alloc(&kpts, xfree);
 
     int octave = 1;
-    int kpts_index = 0;
     rectangle_t roi_scaled;
 
     for (float scale = 1.0f; ; scale *= scale_factor, octave++) {
@@ -409,93 +503,64 @@ array_t *orb_find_keypoints(image_t *img, bool normalized, int threshold,
         // Gaussian smooth the image before extracting keypoints
         imlib_sepconv3(&img_scaled, kernel_gauss_3, 1.0f / 16.0f, 0.0f);
 
-        // Find kpts
-        #ifdef IMLIB_ENABLE_FAST
-        if (corner_detector == CORNER_FAST) {
-            fast_detect(&img_scaled, kpts, threshold, &roi_scaled);
-        } else
-        #endif
-        {
-            agast_detect(&img_scaled, kpts, threshold, &roi_scaled);
+        orb_find_level_keypoints(&img_scaled, kpts, threshold, octave, scale, scale,
+                                 corner_detector, &roi_scaled, max_keypoints);
+
+        // Free current scale
+        fb_free();
+
+        if (normalized) {
+            break;
         }
+    }
 
-        for (int k = kpts_index; k < array_length(kpts); k++, kpts_index++) {
-            // Set keypoint octave/scale
-            kp_t *kpt = array_at(kpts, k);
-            kpt->octave = octave;
+    // Sort keypoints by score and return top n keypoints
+    array_sort(kpts, (array_comp_t) kpt_comp);
+    if (array_length(kpts) > max_keypoints) {
+        array_resize(kpts, max_keypoints);
+    }
 
-            int x, y;
-            float a, b;
-            sample_point_t *pattern = (sample_point_t *) sample_pattern;
-            kpt->angle = comp_angle(&img_scaled, kpt, &a, &b);
+    return kpts;
+}
 
-            #if 1
-#define GET_VALUE(idx)                                          \
-    (x = (int) roundf(pattern[idx].x * a - pattern[idx].y * b), \
-     y = (int) roundf(pattern[idx].x * b + pattern[idx].y * a), \
-     img_scaled.pixels[((kpt->y + y) * img_scaled.w) + (kpt->x + x)])
-            #else
-#define GET_VALUE(idx) \
-    (img_scaled.pixels[((kpt->y + pattern[idx].y) * img_scaled.w) + (kpt->x + pattern[idx].x)])
-            #endif
-
-            for (int i = 0; i < KDESC_SIZE; ++i, pattern += 16) {
-                int t0, t1, t2, t3, u, v, k, val;
-                t0 = GET_VALUE(0); t1 = GET_VALUE(1);
-                t2 = GET_VALUE(2); t3 = GET_VALUE(3);
-                u = 0, v = 2;
-                if (t1 > t0) {
-                    t0 = t1, u = 1;
-                }
-                if (t3 > t2) {
-                    t2 = t3, v = 3;
-                }
-                k = t0 > t2 ? u : v;
-                val = k;
-
-                t0 = GET_VALUE(4); t1 = GET_VALUE(5);
-                t2 = GET_VALUE(6); t3 = GET_VALUE(7);
-                u = 0, v = 2;
-                if (t1 > t0) {
-                    t0 = t1, u = 1;
-                }
-                if (t3 > t2) {
-                    t2 = t3, v = 3;
-                }
-                k = t0 > t2 ? u : v;
-                val |= k << 2;
-
-                t0 = GET_VALUE(8); t1 = GET_VALUE(9);
-                t2 = GET_VALUE(10); t3 = GET_VALUE(11);
-                u = 0, v = 2;
-                if (t1 > t0) {
-                    t0 = t1, u = 1;
-                }
-                if (t3 > t2) {
-                    t2 = t3, v = 3;
-                }
-                k = t0 > t2 ? u : v;
-                val |= k << 4;
-
-                t0 = GET_VALUE(12); t1 = GET_VALUE(13);
-                t2 = GET_VALUE(14); t3 = GET_VALUE(15);
-                u = 0, v = 2;
-                if (t1 > t0) {
-                    t0 = t1, u = 1;
-                }
-                if (t3 > t2) {
-                    t2 = t3, v = 3;
-                }
-                k = t0 > t2 ? u : v;
-                val |= k << 6;
-
-                kpt->desc[i] = (uint8_t) val;
-            }
+#ifdef IMLIB_ENABLE_PYRAMID
+array_t *orb_find_keypoints_pyramid(pyramid_t *pyr, bool normalized, int threshold,
+                                    int max_keypoints, corner_detector_t corner_detector, rectangle_t *roi) {
+    array_t *kpts;
+    array_alloc(&kpts, xfree);
 
-            kpt->x = (int) floorf(kpt->x * scale);
-            kpt->y = (int) floorf(kpt->y * scale);
+    rectangle_t roi_scaled;
+
+    for (int i = 0; i < pyr->n_levels; i++) {
+        pyramid_level_t *level = &pyr->levels[i];
+
+        // Add patch size to ROI
+        roi_scaled.x = (int) roundf(roi->x / level->x_scale) + (PATCH_SIZE);
+        roi_scaled.y = (int) roundf(roi->y / level->y_scale) + (PATCH_SIZE);
+        roi_scaled.w = (int) roundf(roi->w / level->x_scale) - (PATCH_SIZE * 2);
+        roi_scaled.h = (int) roundf(roi->h / level->y_scale) - (PATCH_SIZE * 2);
+
+        if (roi_scaled.w <= (PATCH_SIZE * 2) ||
+            roi_scaled.h <= (PATCH_SIZE * 2)) {
+            break;
         }
 
+        // The level is shared, so blur a scratch copy of it.
+        image_t *img = imlib_pyramid_level(pyr, i);
+        image_t img_scaled = {
+            .w = img->w,
+            .h = img->h,
+            .pixfmt = PIXFORMAT_GRAYSCALE,
+            .pixels = fb_alloc(img->w * img->h, FB_ALLOC_NO_HINT)
+        };
+        memcpy(img_scaled.pixels, img->pixels, img->w * img->h);
+
+        // Gaussian smooth the image before extracting keypoints
+        imlib_sepconv3(&img_scaled, kernel_gauss_3, 1.0f / 16.0f, 0.0f);
+
+        orb_find_level_keypoints(&img_scaled, kpts, threshold, i + 1,
+                                 level->x_scale, level->y_scale, corner_detector, &roi_scaled, max_keypoints);
+
         // Free current scale
         fb_free();
 
@@ -512,6 +577,7 @@ array_t *orb_find_keypoints(image_t *img, bool normalized, int threshold,
 
     return kpts;
 }
+#endif // IMLIB_ENABLE_PYRAMID
 
 // This is a modifed popcount that counts every 2 different bits as 1.
 // This is what should actually be used with wta_k == 3 or 4.
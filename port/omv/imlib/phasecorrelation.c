@@ -300,8 +300,8 @@ void imlib_phasecorrelate(image_t *img0,
         fft2d_run_again(&fft0);
         fft2d_run_again(&fft1);
 
-        int w = (1 << fft0.w_pow2);
-        int h = (1 << fft0.h_pow2);
+        int w = fft0.w;
+        int h = fft0.h;
 
         for (int i = 0, j = h * w * 2; i < j; i += 2) {
             float ga_r = fft0.data[i + 0];
@@ -511,8 +511,8 @@ void imlib_phasecorrelate(image_t *img0,
         fft2d_run(&fft0);
         fft2d_run(&fft1);
 
-        int w = (1 << fft0.w_pow2);
-        int h = (1 << fft0.h_pow2);
+        int w = fft0.w;
+        int h = fft0.h;
 
         for (int i = 0, j = h * w * 2; i < j; i += 2) {
             float ga_r = fft0.data[i + 0];
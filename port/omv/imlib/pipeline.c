@@ -0,0 +1,618 @@
+/*
+ * This file is part of the OpenMV project.
+ *
+ * Copyright (c) 2013-2021 Ibrahim Abdelkader <iabdalkader@openmv.io>
+ * Copyright (c) 2013-2021 Kwabena W. Agyeman <kwagyeman@openmv.io>
+ *
+ * This work is licensed under the MIT license, see the file LICENSE for details.
+ *
+ * Fused image operation pipeline.
+ *
+ * A pipeline is a recorded chain of math/logic ops, thresholding, color conversion, erode/dilate
+ * and morph kernels that runs in a single top to bottom pass over the image. Every stage keeps
+ * only the rows its consumer still needs in a small ring buffer, so intermediate results stay in
+ * cache instead of making a full frame round trip through memory per operation. Per-pixel stages
+ * reuse the regular imlib functions on one row views so both paths produce the same pixels.
+ */
+#include "py/runtime.h"
+#include "fb_alloc.h"
+#include "imlib.h"
+#include "fmath.h"
+
+#ifdef IMLIB_ENABLE_PIPELINE
+
+#define PIPELINE_Q_BITS     (8)     // Fraction kept by the gaussian passes, as in blur.c.
+#define PIPELINE_Q_HALF     (1 << (PIPELINE_Q_BITS - 1))
+
+typedef struct pipeline_state {
+    pixformat_t in_fmt;
+    pixformat_t out_fmt;
+    image_t *in;                    // Ring holding the input rows.
+    size_t in_line;
+    int delay;                      // Output row y is produced after source row y + delay is read.
+    image_t ring;                   // Output rows kept for the next stage.
+    image_t scalar;                 // One row filled with the color operand.
+    void *scratch;
+} pipeline_state_t;
+
+static size_t pipeline_line_size(int w, pixformat_t pixfmt) {
+    image_t img = {.w = w, .h = 1, .pixfmt = pixfmt};
+    return image_size(&img);
+}
+
+static uint8_t *pipeline_ring_row(image_t *ring, size_t line, int y) {
+    return ring->data + ((y % ring->h) * line);
+}
+
+static void pipeline_row_view(image_t *view, image_t *img, pixformat_t pixfmt, uint8_t *data) {
+    *view = *img;
+    view->h = 1;
+    view->pixfmt = pixfmt;
+    view->data = data;
+}
+
+static uint32_t pipeline_color(pixformat_t pixfmt, uint32_t p) {
+    // Same conversion as py_helper_keyword_color() for an RGB888 color.
+    switch (pixfmt) {
+        case PIXFORMAT_BINARY:
+            p = COLOR_RGB888_TO_Y((uint8_t) (p >> 16), (uint8_t) (p >> 8), (uint8_t) p);
+            return p > (((COLOR_Y_MAX - COLOR_Y_MIN) / 2) + COLOR_Y_MIN);
+        case PIXFORMAT_GRAYSCALE:
+            return COLOR_RGB888_TO_Y((uint8_t) (p >> 16), (uint8_t) (p >> 8), (uint8_t) p);
+        default:
+            return ((p & 0x00f80000) >> 8) | ((p & 0x0000fc00) >> 5) | ((p & 0x000000f8) >> 3);
+    }
+}
+
+static bool pipeline_is_neighbourhood(pipeline_op_t op) {
+    return (op == PIPELINE_OP_ERODE) || (op == PIPELINE_OP_DILATE) || (op == PIPELINE_OP_MORPH);
+}
+
+void imlib_pipeline_init(pipeline_t *p) {
+    memset(p, 0, sizeof(pipeline_t));
+}
+
+pipeline_stage_t *imlib_pipeline_push(pipeline_t *p, pipeline_op_t op, int ksize) {
+    if (p->n_stages >= PIPELINE_MAX_STAGES) {
+        return NULL;
+    }
+
+    pipeline_stage_t *stage = &p->stages[p->n_stages++];
+    memset(stage, 0, sizeof(pipeline_stage_t));
+    stage->op = op;
+    stage->ksize = pipeline_is_neighbourhood(op) ? ksize : 0;
+    return stage;
+}
+
+static pixformat_t pipeline_stage_pixfmt(pipeline_stage_t *stage, pixformat_t pixfmt) {
+    if ((pixfmt != PIXFORMAT_BINARY) && (pixfmt != PIXFORMAT_GRAYSCALE) && (pixfmt != PIXFORMAT_RGB565)) {
+        mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("Pipeline only supports binary, grayscale and rgb565!"));
+    }
+
+    switch (stage->op) {
+        case PIPELINE_OP_BINARY:
+            return stage->to_bitmap ? PIXFORMAT_BINARY : pixfmt;
+        case PIPELINE_OP_TO_BITMAP:
+            return PIXFORMAT_BINARY;
+        case PIPELINE_OP_TO_GRAYSCALE:
+            return PIXFORMAT_GRAYSCALE;
+        case PIPELINE_OP_TO_RGB565:
+            return PIXFORMAT_RGB565;
+        default:
+            return pixfmt;
+    }
+}
+
+pixformat_t imlib_pipeline_pixfmt(pipeline_t *p, pixformat_t pixfmt) {
+    for (int i = 0; i < p->n_stages; i++) {
+        pixfmt = pipeline_stage_pixfmt(&p->stages[i], pixfmt);
+    }
+
+    return pixfmt;
+}
+
+static void pipeline_convert_row(image_t *out, image_t *in) {
+    if (out->pixfmt == in->pixfmt) {
+        memcpy(out->data, in->data, pipeline_line_size(in->w, in->pixfmt));
+        return;
+    }
+
+    for (int x = 0, w = in->w; x < w; x++) {
+        int pixel;
+
+        switch (in->pixfmt) {
+            case PIXFORMAT_BINARY: {
+                pixel = IMAGE_GET_BINARY_PIXEL_FAST((uint32_t *) in->data, x);
+                pixel = (out->pixfmt == PIXFORMAT_GRAYSCALE) ?
+                        COLOR_BINARY_TO_GRAYSCALE(pixel) : COLOR_BINARY_TO_RGB565(pixel);
+                break;
+            }
+            case PIXFORMAT_GRAYSCALE: {
+                pixel = IMAGE_GET_GRAYSCALE_PIXEL_FAST(in->data, x);
+                pixel = (out->pixfmt == PIXFORMAT_BINARY) ?
+                        COLOR_GRAYSCALE_TO_BINARY(pixel) : COLOR_GRAYSCALE_TO_RGB565(pixel);
+                break;
+            }
+            default: {
+                pixel = IMAGE_GET_RGB565_PIXEL_FAST((uint16_t *) in->data, x);
+                pixel = (out->pixfmt == PIXFORMAT_BINARY) ?
+                        COLOR_RGB565_TO_BINARY(pixel) : COLOR_RGB565_TO_GRAYSCALE(pixel);
+                break;
+            }
+        }
+
+        switch (out->pixfmt) {
+            case PIXFORMAT_BINARY: {
+                IMAGE_PUT_BINARY_PIXEL_FAST((uint32_t *) out->data, x, pixel);
+                break;
+            }
+            case PIXFORMAT_GRAYSCALE: {
+                IMAGE_PUT_GRAYSCALE_PIXEL_FAST(out->data, x, pixel);
+                break;
+            }
+            default: {
+                IMAGE_PUT_RGB565_PIXEL_FAST((uint16_t *) out->data, x, pixel);
+                break;
+            }
+        }
+    }
+}
+
+// Adds delta to the column counts of every nonzero pixel in the row.
+static void pipeline_count_row(uint16_t *cols, uint8_t *row, int w, pixformat_t pixfmt, int delta) {
+    switch (pixfmt) {
+        case PIXFORMAT_BINARY: {
+            for (int x = 0; x < w; x++) {
+                if (IMAGE_GET_BINARY_PIXEL_FAST((uint32_t *) row, x)) {
+                    cols[x] += delta;
+                }
+            }
+            break;
+        }
+        case PIXFORMAT_GRAYSCALE: {
+            for (int x = 0; x < w; x++) {
+                if (row[x]) {
+                    cols[x] += delta;
+                }
+            }
+            break;
+        }
+        default: {
+            for (int x = 0; x < w; x++) {
+                if (((uint16_t *) row)[x]) {
+                    cols[x] += delta;
+                }
+            }
+            break;
+        }
+    }
+}
+
+// Same result as imlib_erode()/imlib_dilate(): a pixel is cleared (erode) when fewer than threshold
+// of its neighbours are set, or set (dilate) when more than threshold are set. Rows arrive in
+// order so the per-column counts are updated incrementally instead of summed over the window.
+static void pipeline_erode_dilate_row(pipeline_stage_t *stage, pipeline_state_t *st, int y, int h, image_t *out) {
+    int w = out->w, ksize = stage->ksize;
+    bool dilate = stage->op == PIPELINE_OP_DILATE;
+    uint16_t *cols = st->scratch;
+
+    if (!y) {
+        memset(cols, 0, w * sizeof(uint16_t));
+        for (int j = -ksize; j <= ksize; j++) {
+            pipeline_count_row(cols, pipeline_ring_row(st->in, st->in_line, IM_MIN(IM_MAX(j, 0), h - 1)),
+                               w, st->in_fmt, 1);
+        }
+    } else {
+        pipeline_count_row(cols, pipeline_ring_row(st->in, st->in_line, IM_MAX(y - ksize - 1, 0)),
+                           w, st->in_fmt, -1);
+        pipeline_count_row(cols, pipeline_ring_row(st->in, st->in_line, IM_MIN(y + ksize, h - 1)),
+                           w, st->in_fmt, 1);
+    }
+
+    memcpy(out->data, pipeline_ring_row(st->in, st->in_line, y), st->in_line);
+
+    // The center pixel is assumed set when eroding (imlib_erode() starts counting at -1).
+    int acc = dilate ? 0 : -1;
+
+    for (int k = -ksize; k <= ksize; k++) {
+        acc += cols[IM_MIN(IM_MAX(k, 0), w - 1)];
+    }
+
+    for (int x = 0; x < w; x++) {
+        if (dilate ? (acc > stage->threshold) : (acc < stage->threshold)) {
+            switch (st->in_fmt) {
+                case PIXFORMAT_BINARY: {
+                    IMAGE_PUT_BINARY_PIXEL_FAST((uint32_t *) out->data, x, dilate);
+                    break;
+                }
+                case PIXFORMAT_GRAYSCALE: {
+                    IMAGE_PUT_GRAYSCALE_PIXEL_FAST(out->data, x,
+                                                   dilate ? COLOR_GRAYSCALE_BINARY_MAX : COLOR_GRAYSCALE_BINARY_MIN);
+                    break;
+                }
+                default: {
+                    IMAGE_PUT_RGB565_PIXEL_FAST((uint16_t *) out->data, x,
+                                                dilate ? COLOR_RGB565_BINARY_MAX : COLOR_RGB565_BINARY_MIN);
+                    break;
+                }
+            }
+        }
+
+        acc += cols[IM_MIN(x + ksize + 1, w - 1)] - cols[IM_MAX(x - ksize, 0)];
+    }
+}
+
+// Unpacks a row into per-channel planes of w + 2 * ksize values with replicated borders.
+static void pipeline_unpack_row(int32_t *pad, uint8_t *row, int w, int ksize, pixformat_t pixfmt) {
+    int pw = w + (ksize * 2);
+
+    switch (pixfmt) {
+        case PIXFORMAT_BINARY: {
+            for (int x = 0; x < w; x++) {
+                pad[ksize + x] = IMAGE_GET_BINARY_PIXEL_FAST((uint32_t *) row, x);
+            }
+            break;
+        }
+        case PIXFORMAT_GRAYSCALE: {
+            for (int x = 0; x < w; x++) {
+                pad[ksize + x] = row[x];
+            }
+            break;
+        }
+        default: {
+            for (int x = 0; x < w; x++) {
+                int pixel = ((uint16_t *) row)[x];
+                pad[ksize + x] = COLOR_RGB565_TO_R5(pixel);
+                pad[pw + ksize + x] = COLOR_RGB565_TO_G6(pixel);
+                pad[(pw * 2) + ksize + x] = COLOR_RGB565_TO_B5(pixel);
+            }
+            break;
+        }
+    }
+
+    for (int c = 0, cc = (pixfmt == PIXFORMAT_RGB565) ? 3 : 1; c < cc; c++, pad += pw) {
+        for (int k = 0; k < ksize; k++) {
+            pad[k] = pad[ksize];
+            pad[ksize + w + k] = pad[ksize + w - 1];
+        }
+    }
+}
+
+// Output arithmetic of imlib_morph() for raw kernel sums (mul is 1/kernel_weight by default) and of
+// imlib_gaussian_filter() for the normalized gaussian values, which is exact for the default mul/add.
+static inline int pipeline_morph_value(pipeline_stage_t *stage, int32_t m_int, int32_t acc, int max) {
+    int v;
+
+    if (!stage->krn_sep) {
+        v = ((acc * m_int) >> 16) + stage->add;
+    } else if ((stage->mul == (stage->krn_center ? -1.0f : 1.0f)) && (!stage->add)) {
+        v = ((stage->krn_center ? -acc : acc) + PIPELINE_Q_HALF) >> PIPELINE_Q_BITS;
+    } else {
+        v = fast_roundf((acc * (1.0f / (1 << PIPELINE_Q_BITS)) * stage->mul) + stage->add);
+    }
+
+    return IM_MIN(IM_MAX(v, 0), max);
+}
+
+// Same result as imlib_morph(), or for gaussian kernels the same as imlib_gaussian_filter(): the
+// pascal row is applied vertically and then horizontally with PIPELINE_Q_BITS of fraction kept
+// and each pass normalized with a shift, so large kernels neither overflow nor lose precision.
+static void pipeline_morph_row(pipeline_stage_t *stage, pipeline_state_t *st, int y, int h, image_t *out) {
+    int w = out->w, ksize = stage->ksize, n = (ksize * 2) + 1, pw = w + (ksize * 2);
+    int channels = (st->in_fmt == PIXFORMAT_RGB565) ? 3 : 1;
+    int32_t *acc = st->scratch;
+    int32_t *pad = acc + (channels * w);
+    int32_t *sum = pad + (channels * pw);
+
+    if (stage->krn_sep) {
+        int shift = ksize * 2;
+        uint32_t half = (1 << shift) >> 1;
+        uint32_t *col = (uint32_t *) sum;
+        memset(col, 0, channels * pw * sizeof(uint32_t));
+
+        for (int j = 0; j < n; j++) {
+            uint32_t k_y = stage->krn_sep[j];
+            pipeline_unpack_row(pad, pipeline_ring_row(st->in, st->in_line, IM_MIN(IM_MAX(y + j - ksize, 0), h - 1)),
+                                w, ksize, st->in_fmt);
+
+            for (int i = 0, ii = channels * pw; i < ii; i++) {
+                col[i] += k_y * (pad[i] << PIPELINE_Q_BITS);
+            }
+
+            if (j == ksize) {
+                for (int c = 0; c < channels; c++) {
+                    for (int x = 0; x < w; x++) {
+                        acc[(c * w) + x] = stage->krn_center * (pad[(c * pw) + ksize + x] << PIPELINE_Q_BITS);
+                    }
+                }
+            }
+        }
+
+        for (int i = 0, ii = channels * pw; i < ii; i++) {
+            col[i] = (col[i] + half) >> shift;
+        }
+
+        for (int c = 0; c < channels; c++) {
+            int32_t *a = acc + (c * w);
+            uint32_t *s = col + (c * pw);
+            for (int x = 0; x < w; x++) {
+                uint32_t tmp = 0;
+                for (int k = 0; k < n; k++) {
+                    tmp += stage->krn_sep[k] * s[x + k];
+                }
+                a[x] += (tmp + half) >> shift;
+            }
+        }
+    } else {
+        memset(acc, 0, channels * w * sizeof(int32_t));
+
+        for (int j = 0; j < n; j++) {
+            const int *k_row = stage->krn + (j * n);
+            pipeline_unpack_row(pad, pipeline_ring_row(st->in, st->in_line, IM_MIN(IM_MAX(y + j - ksize, 0), h - 1)),
+                                w, ksize, st->in_fmt);
+
+            for (int c = 0; c < channels; c++) {
+                int32_t *a = acc + (c * w), *p = pad + (c * pw);
+                for (int x = 0; x < w; x++) {
+                    int32_t tmp = 0;
+                    for (int k = 0; k < n; k++) {
+                        tmp += k_row[k] * p[x + k];
+                    }
+                    a[x] += tmp;
+                }
+            }
+        }
+    }
+
+    const int32_t m_int = (int32_t) (65536.0 * stage->mul); // mul is 1/kernel_weight for non-gaussian kernels.
+    uint8_t *row_ptr = pipeline_ring_row(st->in, st->in_line, y);
+
+    switch (st->in_fmt) {
+        case PIXFORMAT_BINARY: {
+            for (int x = 0; x < w; x++) {
+                int pixel = pipeline_morph_value(stage, m_int, acc[x], 1);
+
+                if (stage->morph_threshold) {
+                    pixel = (((pixel - stage->offset) <
+                              IMAGE_GET_BINARY_PIXEL_FAST((uint32_t *) row_ptr, x)) ^ stage->invert) ?
+                            COLOR_BINARY_MAX : COLOR_BINARY_MIN;
+                }
+
+                IMAGE_PUT_BINARY_PIXEL_FAST((uint32_t *) out->data, x, pixel);
+            }
+            break;
+        }
+        case PIXFORMAT_GRAYSCALE: {
+            for (int x = 0; x < w; x++) {
+                int pixel = pipeline_morph_value(stage, m_int, acc[x], COLOR_GRAYSCALE_MAX);
+
+                if (stage->morph_threshold) {
+                    pixel = (((pixel - stage->offset) <
+                              IMAGE_GET_GRAYSCALE_PIXEL_FAST(row_ptr, x)) ^ stage->invert) ?
+                            COLOR_GRAYSCALE_BINARY_MAX : COLOR_GRAYSCALE_BINARY_MIN;
+                }
+
+                IMAGE_PUT_GRAYSCALE_PIXEL_FAST(out->data, x, pixel);
+            }
+            break;
+        }
+        default: {
+            for (int x = 0; x < w; x++) {
+                int r_acc = pipeline_morph_value(stage, m_int, acc[x], COLOR_R5_MAX);
+                int g_acc = pipeline_morph_value(stage, m_int, acc[w + x], COLOR_G6_MAX);
+                int b_acc = pipeline_morph_value(stage, m_int, acc[(w * 2) + x], COLOR_B5_MAX);
+                int pixel = COLOR_R5_G6_B5_TO_RGB565(r_acc, g_acc, b_acc);
+
+                if (stage->morph_threshold) {
+                    pixel = (((COLOR_RGB565_TO_Y(pixel) - stage->offset) <
+                              COLOR_RGB565_TO_Y(IMAGE_GET_RGB565_PIXEL_FAST((uint16_t *) row_ptr, x))) ^ stage->invert) ?
+                            COLOR_RGB565_BINARY_MAX : COLOR_RGB565_BINARY_MIN;
+                }
+
+                IMAGE_PUT_RGB565_PIXEL_FAST((uint16_t *) out->data, x, pixel);
+            }
+            break;
+        }
+    }
+}
+
+static void pipeline_point_row(pipeline_stage_t *stage, pipeline_state_t *st, int y, image_t *out) {
+    image_t in, other_row, *other = &st->scalar;
+    pipeline_row_view(&in, out, st->in_fmt, pipeline_ring_row(st->in, st->in_line, y));
+
+    switch (stage->op) {
+        case PIPELINE_OP_BINARY: {
+            imlib_binary(out, &in, stage->thresholds, stage->invert, stage->zero, NULL);
+            return;
+        }
+        case PIPELINE_OP_TO_BITMAP:
+        case PIPELINE_OP_TO_GRAYSCALE:
+        case PIPELINE_OP_TO_RGB565: {
+            pipeline_convert_row(out, &in);
+            return;
+        }
+        default: {
+            memcpy(out->data, in.data, st->in_line);
+            break;
+        }
+    }
+
+    if (stage->other) {
+        pipeline_row_view(&other_row, out, st->in_fmt, stage->other->data + (y * st->in_line));
+        other = &other_row;
+    }
+
+    switch (stage->op) {
+        case PIPELINE_OP_ADD:
+            imlib_add(out, NULL, other, 0, NULL);
+            break;
+        case PIPELINE_OP_SUB:
+            imlib_sub(out, NULL, other, 0, stage->invert, NULL);
+            break;
+        case PIPELINE_OP_MUL:
+            imlib_mul(out, NULL, other, 0, stage->invert, NULL);
+            break;
+        case PIPELINE_OP_DIV:
+            imlib_div(out, NULL, other, 0, stage->invert, stage->mod, NULL);
+            break;
+        case PIPELINE_OP_MIN:
+            imlib_min(out, NULL, other, 0, NULL);
+            break;
+        case PIPELINE_OP_MAX:
+            imlib_max(out, NULL, other, 0, NULL);
+            break;
+        case PIPELINE_OP_DIFFERENCE:
+            imlib_difference(out, NULL, other, 0, NULL);
+            break;
+        case PIPELINE_OP_B_AND:
+            imlib_b_and(out, NULL, other, 0, NULL);
+            break;
+        case PIPELINE_OP_B_NAND:
+            imlib_b_nand(out, NULL, other, 0, NULL);
+            break;
+        case PIPELINE_OP_B_OR:
+            imlib_b_or(out, NULL, other, 0, NULL);
+            break;
+        case PIPELINE_OP_B_NOR:
+            imlib_b_nor(out, NULL, other, 0, NULL);
+            break;
+        case PIPELINE_OP_B_XOR:
+            imlib_b_xor(out, NULL, other, 0, NULL);
+            break;
+        case PIPELINE_OP_B_XNOR:
+            imlib_b_xnor(out, NULL, other, 0, NULL);
+            break;
+        case PIPELINE_OP_INVERT:
+            imlib_invert(out);
+            break;
+        case PIPELINE_OP_NEGATE:
+            imlib_negate(out);
+            break;
+        default:
+            break;
+    }
+}
+
+static bool pipeline_has_operand(pipeline_op_t op) {
+    return (op <= PIPELINE_OP_B_XNOR);
+}
+
+void imlib_pipeline_run(pipeline_t *p, image_t *dst, image_t *src) {
+    int w = src->w, h = src->h, n = p->n_stages;
+    pixformat_t pixfmt = imlib_pipeline_pixfmt(p, src->pixfmt);
+    size_t dst_line = pipeline_line_size(w, pixfmt);
+
+    if (!n) {
+        if (dst->data != src->data) {
+            memcpy(dst->data, src->data, image_size(src));
+        }
+        return;
+    }
+
+    fb_alloc_mark();
+
+    pipeline_state_t *states = fb_alloc0(n * sizeof(pipeline_state_t), FB_ALLOC_NO_HINT);
+    image_t src_ring;
+    int delay = 0;
+    pixfmt = src->pixfmt;
+
+    for (int i = 0; i < n; i++) {
+        pipeline_stage_t *stage = &p->stages[i];
+        pipeline_state_t *st = &states[i];
+        st->in_fmt = pixfmt;
+        st->out_fmt = pipeline_stage_pixfmt(stage, pixfmt);
+        st->in_line = pipeline_line_size(w, st->in_fmt);
+        delay += stage->ksize;
+        st->delay = delay;
+
+        // A stage reads 2 * ksize + 1 rows, erode/dilate also need the row that leaves the window.
+        image_t *in = i ? &states[i - 1].ring : &src_ring;
+        pipeline_row_view(in, src, st->in_fmt, NULL);
+        in->h = (stage->ksize * 2) + 2;
+        in->data = fb_alloc(in->h * st->in_line, FB_ALLOC_NO_HINT);
+        st->in = in;
+
+        if (pipeline_has_operand(stage->op)) {
+            if (stage->other) {
+                if ((stage->other->w != w) || (stage->other->h != h) || (stage->other->pixfmt != st->in_fmt)) {
+                    mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("Images not equal!"));
+                }
+            } else {
+                image_t *scalar = &st->scalar;
+                pipeline_row_view(scalar, src, st->in_fmt, fb_alloc(st->in_line, FB_ALLOC_NO_HINT));
+                uint32_t color = pipeline_color(st->in_fmt, stage->color);
+
+                for (int x = 0; x < w; x++) {
+                    switch (st->in_fmt) {
+                        case PIXFORMAT_BINARY: {
+                            IMAGE_PUT_BINARY_PIXEL_FAST((uint32_t *) scalar->data, x, color);
+                            break;
+                        }
+                        case PIXFORMAT_GRAYSCALE: {
+                            IMAGE_PUT_GRAYSCALE_PIXEL_FAST(scalar->data, x, color);
+                            break;
+                        }
+                        default: {
+                            IMAGE_PUT_RGB565_PIXEL_FAST((uint16_t *) scalar->data, x, color);
+                            break;
+                        }
+                    }
+                }
+            }
+        } else if (stage->op == PIPELINE_OP_MORPH) {
+            int channels = (st->in_fmt == PIXFORMAT_RGB565) ? 3 : 1;
+            int pw = w + (stage->ksize * 2);
+            st->scratch = fb_alloc(channels * (w + (pw * 2)) * sizeof(int32_t), FB_ALLOC_NO_HINT);
+        } else if (pipeline_is_neighbourhood(stage->op)) {
+            st->scratch = fb_alloc(w * sizeof(uint16_t), FB_ALLOC_NO_HINT);
+        }
+
+        pixfmt = st->out_fmt;
+    }
+
+    size_t src_line = pipeline_line_size(w, src->pixfmt);
+
+    // Source row y enters the first ring at step y and stage i emits row y - delay_i. The last
+    // stage writes straight to the destination, which is never ahead of the source rows still
+    // to be read as long as an output row is not larger than an input row.
+    for (int y = 0, yy = h + delay; y < yy; y++) {
+        if (y < h) {
+            memcpy(pipeline_ring_row(&src_ring, src_line, y), src->data + (y * src_line), src_line);
+        }
+
+        for (int i = 0; i < n; i++) {
+            pipeline_stage_t *stage = &p->stages[i];
+            pipeline_state_t *st = &states[i];
+            int ys = y - st->delay;
+
+            if ((ys < 0) || (ys >= h)) {
+                continue;
+            }
+
+            image_t out;
+            pipeline_row_view(&out, src, st->out_fmt, (i == (n - 1)) ?
+                              (dst->data + (ys * dst_line)) :
+                              pipeline_ring_row(st[1].in, st[1].in_line, ys));
+
+            switch (stage->op) {
+                case PIPELINE_OP_ERODE:
+                case PIPELINE_OP_DILATE: {
+                    pipeline_erode_dilate_row(stage, st, ys, h, &out);
+                    break;
+                }
+                case PIPELINE_OP_MORPH: {
+                    pipeline_morph_row(stage, st, ys, h, &out);
+                    break;
+                }
+                default: {
+                    pipeline_point_row(stage, st, ys, &out);
+                    break;
+                }
+            }
+        }
+    }
+
+    fb_alloc_free_till_mark();
+}
+
+#endif // IMLIB_ENABLE_PIPELINE
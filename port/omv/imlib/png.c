@@ -18,6 +18,9 @@
 
 #define TIME_PNG    (0)
 
+// png_write() quality that selects lodepng (best compression) over the fast encoder.
+#define PNG_LODEPNG_QUALITY (100)
+
 unsigned lodepng_convert_cb(unsigned char *out, const unsigned char *in,
                             const LodePNGColorMode *mode_out, const LodePNGColorMode *mode_in, unsigned w, unsigned h) {
     unsigned error = 0;
@@ -135,6 +138,14 @@ bool png_compress(image_t *src, image_t *dst) {
             state.info_raw.colortype = LCT_CUSTOM;
             state.info_raw.customfmt = PIXFORMAT_RGB565;
 
+            state.encoder.auto_convert = false;
+            state.info_png.color.bitdepth = 8;
+            state.info_png.color.colortype = LCT_RGB;
+            break;
+        case PIXFORMAT_RGB888:
+            state.info_raw.bitdepth = 8;
+            state.info_raw.colortype = LCT_RGB;
+
             state.encoder.auto_convert = false;
             state.info_png.color.bitdepth = 8;
             state.info_png.color.colortype = LCT_RGB;
@@ -177,6 +188,679 @@ bool png_compress(image_t *src, image_t *dst) {
 
     return false;
 }
+
+// Fast encoder, one pass over the image with Sub/Up filtering picked per row and a run length
+// only deflate (distance 1 matches) with dynamic Huffman codes, written straight into the output.
+// Binary images are written as 1-bit grayscale and images with few colors as palette images.
+#define PNG_FAST_TOKENS         (16384) // Symbols per deflate block.
+#define PNG_FAST_FILE_BUFFER    (16384) // IDAT chunk size when streaming to a file.
+#define PNG_FAST_BLOCK_HEADER   (512)   // Upper bound of a dynamic block header in bytes.
+#define PNG_FAST_MAX_COLORS     (256)
+#define PNG_FAST_COLOR_HASH     (1024)
+
+unsigned lodepng_crc32(const unsigned char *data, size_t length); // lodepng.c
+
+static const uint16_t png_fast_len_base[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+
+static const uint8_t png_fast_len_extra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+
+static const uint8_t png_fast_cl_order[19] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+};
+
+typedef struct png_fast {
+    FIL *fp;                // Output file, NULL when writing to memory.
+    uint8_t *buf;
+    uint32_t cap, pos;
+    uint32_t chunk;         // Offset of the open chunk.
+    uint64_t bit_buf;
+    int bit_cnt;
+    uint32_t adler_a, adler_b;
+    int prev;               // Last byte fed, -1 at the start.
+    int run;                // Repeats of prev not emitted yet.
+    int n_tokens;
+    uint16_t *tokens;       // Literals (< 256) and 256 + match length - 3.
+    uint32_t freq[286];
+} png_fast_t;
+
+typedef struct png_fast_sym {
+    uint32_t key;
+    uint16_t sym;
+} png_fast_sym_t;
+
+static void png_fast_put32(png_fast_t *s, uint32_t value) {
+    s->buf[s->pos++] = value >> 24;
+    s->buf[s->pos++] = value >> 16;
+    s->buf[s->pos++] = value >> 8;
+    s->buf[s->pos++] = value;
+}
+
+static void png_fast_chunk_begin(png_fast_t *s, const char *type) {
+    s->chunk = s->pos;
+    png_fast_put32(s, 0);
+    memcpy(s->buf + s->pos, type, 4);
+    s->pos += 4;
+}
+
+static void png_fast_chunk_end(png_fast_t *s) {
+    uint32_t len = s->pos - s->chunk - 8;
+    uint32_t pos = s->pos;
+    s->pos = s->chunk;
+    png_fast_put32(s, len);
+    s->pos = pos;
+    png_fast_put32(s, lodepng_crc32(s->buf + s->chunk + 4, len + 4));
+}
+
+// Makes room for n bytes (and the chunk crc), a file stream closes the IDAT chunk and opens a new one.
+static void png_fast_ensure(png_fast_t *s, uint32_t n) {
+    if ((s->pos + n + 4) > s->cap) {
+        if (!s->fp) {
+            mp_raise_msg(&mp_type_RuntimeError, MP_ERROR_TEXT("Failed to compress image in place"));
+        }
+
+        png_fast_chunk_end(s);
+        write_data(s->fp, s->buf, s->pos);
+        s->pos = 0;
+        png_fast_chunk_begin(s, "IDAT");
+    }
+}
+
+static inline void png_fast_bits(png_fast_t *s, uint32_t bits, int n) {
+    s->bit_buf |= ((uint64_t) bits) << s->bit_cnt;
+    s->bit_cnt += n;
+
+    if (s->bit_cnt >= 32) {
+        png_fast_ensure(s, 4);
+
+        for (int i = 0; i < 4; i++) {
+            s->buf[s->pos++] = s->bit_buf;
+            s->bit_buf >>= 8;
+        }
+
+        s->bit_cnt -= 32;
+    }
+}
+
+static void png_fast_bits_align(png_fast_t *s) {
+    for (; s->bit_cnt > 0; s->bit_cnt -= 8) {
+        png_fast_ensure(s, 1);
+        s->buf[s->pos++] = s->bit_buf;
+        s->bit_buf >>= 8;
+    }
+
+    s->bit_cnt = 0;
+}
+
+// In place minimum redundancy code lengths (Moffat and Katajainen), syms sorted by ascending key.
+static void png_fast_code_lengths(png_fast_sym_t *a, int n) {
+    int root = 0, leaf = 2, next;
+    a[0].key += a[1].key;
+
+    for (next = 1; next < (n - 1); next++) {
+        if ((leaf >= n) || (a[root].key < a[leaf].key)) {
+            a[next].key = a[root].key;
+            a[root++].key = next;
+        } else {
+            a[next].key = a[leaf++].key;
+        }
+
+        if ((leaf >= n) || ((root < next) && (a[root].key < a[leaf].key))) {
+            a[next].key += a[root].key;
+            a[root++].key = next;
+        } else {
+            a[next].key += a[leaf++].key;
+        }
+    }
+
+    a[n - 2].key = 0;
+
+    for (next = n - 3; next >= 0; next--) {
+        a[next].key = a[a[next].key].key + 1;
+    }
+
+    int avbl = 1, used = 0, dpth = 0;
+    root = n - 2;
+    next = n - 1;
+
+    while (avbl > 0) {
+        while ((root >= 0) && (a[root].key == dpth)) {
+            used++;
+            root--;
+        }
+
+        while (avbl > used) {
+            a[next--].key = dpth;
+            avbl--;
+        }
+
+        avbl = 2 * used;
+        dpth++;
+        used = 0;
+    }
+}
+
+// Huffman code lengths limited to max_bits, a single used symbol gets a partner so that the
+// code stays complete.
+static void png_fast_huffman(const uint32_t *freq, int n, int max_bits, uint8_t *lens) {
+    png_fast_sym_t syms[286];
+    int used = 0;
+
+    memset(lens, 0, n);
+
+    for (int i = 0; i < n; i++) {
+        if (freq[i]) {
+            png_fast_sym_t sym = { .key = freq[i], .sym = i };
+            int j = used++;
+
+            for (; (j > 0) && (syms[j - 1].key > sym.key); j--) {
+                syms[j] = syms[j - 1];
+            }
+
+            syms[j] = sym;
+        }
+    }
+
+    if (used < 2) {
+        int sym = used ? syms[0].sym : 0;
+        lens[sym] = 1;
+        lens[sym ? 0 : 1] = 1;
+        return;
+    }
+
+    png_fast_code_lengths(syms, used);
+
+    int count[16] = {};
+
+    for (int i = 0; i < used; i++) {
+        count[IM_MIN(syms[i].key, (uint32_t) max_bits)] += 1;
+    }
+
+    uint32_t total = 0;
+
+    for (int i = 1; i <= max_bits; i++) {
+        total += count[i] << (max_bits - i);
+    }
+
+    for (; total != (1U << max_bits); total--) {
+        count[max_bits] -= 1;
+
+        for (int i = max_bits - 1; i > 0; i--) {
+            if (count[i]) {
+                count[i] -= 1;
+                count[i + 1] += 2;
+                break;
+            }
+        }
+    }
+
+    for (int i = 1, j = used; i <= max_bits; i++) {
+        for (int k = count[i]; k > 0; k--) {
+            lens[syms[--j].sym] = i;
+        }
+    }
+}
+
+// Canonical codes, bit reversed for the lsb first bit writer.
+static void png_fast_codes(const uint8_t *lens, int n, uint16_t *codes) {
+    int count[16] = {}, next[16] = {};
+
+    for (int i = 0; i < n; i++) {
+        count[lens[i]] += 1;
+    }
+
+    count[0] = 0;
+
+    for (int b = 1, code = 0; b < 16; b++) {
+        code = (code + count[b - 1]) << 1;
+        next[b] = code;
+    }
+
+    for (int i = 0; i < n; i++) {
+        int code = next[lens[i]]++, rev = 0;
+
+        for (int b = 0; b < lens[i]; b++, code >>= 1) {
+            rev = (rev << 1) | (code & 1);
+        }
+
+        codes[i] = rev;
+    }
+}
+
+static int png_fast_len_code(int len) {
+    int i = 28;
+
+    while (png_fast_len_base[i] > len) {
+        i--;
+    }
+
+    return i;
+}
+
+static void png_fast_block(png_fast_t *s, bool final) {
+    uint8_t lit_lens[286], cl_lens[19], all_lens[286 + 2];
+    uint16_t lit_codes[286], cl_codes[19], cl_syms[286 + 2];
+    uint32_t cl_freq[19] = {};
+    int n_cl_syms = 0;
+
+    s->freq[256] = 1; // end of block
+    png_fast_huffman(s->freq, 286, 15, lit_lens);
+    png_fast_codes(lit_lens, 286, lit_codes);
+
+    int n_lit = 286;
+
+    while ((n_lit > 257) && (!lit_lens[n_lit - 1])) {
+        n_lit--;
+    }
+
+    // Only distance 1 is used, the distance code has two 1-bit codes.
+    memcpy(all_lens, lit_lens, n_lit);
+    all_lens[n_lit] = 1;
+    all_lens[n_lit + 1] = 1;
+
+    for (int i = 0, n = n_lit + 2; i < n; ) {
+        int len = all_lens[i], r = 1;
+
+        while (((i + r) < n) && (all_lens[i + r] == len)) {
+            r++;
+        }
+
+        i += r;
+
+        if (!len) {
+            for (; r >= 11; ) {
+                int k = IM_MIN(r, 138);
+                cl_syms[n_cl_syms++] = 18 | ((k - 11) << 8);
+                r -= k;
+            }
+
+            if (r >= 3) {
+                cl_syms[n_cl_syms++] = 17 | ((r - 3) << 8);
+                r = 0;
+            }
+        } else {
+            cl_syms[n_cl_syms++] = len;
+            r -= 1;
+
+            for (; r >= 3; ) {
+                int k = IM_MIN(r, 6);
+                cl_syms[n_cl_syms++] = 16 | ((k - 3) << 8);
+                r -= k;
+            }
+        }
+
+        for (; r > 0; r--) {
+            cl_syms[n_cl_syms++] = len;
+        }
+    }
+
+    for (int i = 0; i < n_cl_syms; i++) {
+        cl_freq[cl_syms[i] & 0xFF] += 1;
+    }
+
+    png_fast_huffman(cl_freq, 19, 7, cl_lens);
+    png_fast_codes(cl_lens, 19, cl_codes);
+
+    int n_cl = 19;
+
+    while ((n_cl > 4) && (!cl_lens[png_fast_cl_order[n_cl - 1]])) {
+        n_cl--;
+    }
+
+    png_fast_bits(s, final, 1);
+    png_fast_bits(s, 2, 2); // dynamic huffman
+    png_fast_bits(s, n_lit - 257, 5);
+    png_fast_bits(s, 2 - 1, 5);
+    png_fast_bits(s, n_cl - 4, 4);
+
+    for (int i = 0; i < n_cl; i++) {
+        png_fast_bits(s, cl_lens[png_fast_cl_order[i]], 3);
+    }
+
+    for (int i = 0; i < n_cl_syms; i++) {
+        int sym = cl_syms[i] & 0xFF, extra = cl_syms[i] >> 8;
+        png_fast_bits(s, cl_codes[sym], cl_lens[sym]);
+
+        if (sym >= 16) {
+            png_fast_bits(s, extra, (sym == 16) ? 2 : ((sym == 17) ? 3 : 7));
+        }
+    }
+
+    for (int i = 0; i < s->n_tokens; i++) {
+        int token = s->tokens[i];
+
+        if (token < 256) {
+            png_fast_bits(s, lit_codes[token], lit_lens[token]);
+        } else {
+            int len = token - 256 + 3, code = png_fast_len_code(len);
+            png_fast_bits(s, lit_codes[257 + code], lit_lens[257 + code]);
+            png_fast_bits(s, len - png_fast_len_base[code], png_fast_len_extra[code]);
+            png_fast_bits(s, 0, 1); // distance 1
+        }
+    }
+
+    png_fast_bits(s, lit_codes[256], lit_lens[256]);
+
+    s->n_tokens = 0;
+    memset(s->freq, 0, sizeof(s->freq));
+}
+
+static inline void png_fast_token(png_fast_t *s, int token, int sym) {
+    s->tokens[s->n_tokens++] = token;
+    s->freq[sym] += 1;
+
+    if (s->n_tokens == PNG_FAST_TOKENS) {
+        png_fast_block(s, false);
+    }
+}
+
+static void png_fast_flush_run(png_fast_t *s) {
+    if (s->run >= 3) {
+        png_fast_token(s, 256 + s->run - 3, 257 + png_fast_len_code(s->run));
+    } else {
+        for (int i = 0; i < s->run; i++) {
+            png_fast_token(s, s->prev, s->prev);
+        }
+    }
+
+    s->run = 0;
+}
+
+static void png_fast_feed(png_fast_t *s, const uint8_t *data, int len) {
+    uint32_t a = s->adler_a, b = s->adler_b;
+
+    for (int i = 0; i < len; ) {
+        // 5552 bytes is the most that can be summed before the adler32 sums overflow.
+        for (int n = IM_MIN(len, i + 5552); i < n; i++) {
+            int value = data[i];
+            a += value;
+            b += a;
+
+            if (value == s->prev) {
+                if (++s->run == 258) {
+                    png_fast_flush_run(s);
+                }
+            } else {
+                png_fast_flush_run(s);
+                png_fast_token(s, value, value);
+                s->prev = value;
+            }
+        }
+
+        a %= 65521;
+        b %= 65521;
+    }
+
+    s->adler_a = a;
+    s->adler_b = b;
+}
+
+static inline uint8_t png_fast_reverse8(uint32_t b) {
+    return ((((b & 0xFF) * 0x0802LU & 0x22110LU) | ((b & 0xFF) * 0x8020LU & 0x88440LU)) * 0x10101LU) >> 16;
+}
+
+// Looks for at most 256 colors, palette_lut maps gray levels and color_hash RGB565 values to indices.
+static int png_fast_palette(image_t *src, uint8_t *palette, uint8_t *palette_lut, uint32_t *color_hash) {
+    int colors = 0;
+
+    if (src->pixfmt == PIXFORMAT_GRAYSCALE) {
+        bool seen[256] = {};
+
+        for (int i = 0, n = src->w * src->h; i < n; i++) {
+            seen[src->data[i]] = true;
+        }
+
+        for (int i = 0; i < 256; i++) {
+            if (seen[i]) {
+                palette_lut[i] = colors;
+                memset(palette + (colors++ * 3), i, 3);
+            }
+        }
+    } else if (src->pixfmt == PIXFORMAT_RGB565) {
+        uint16_t *pixels = (uint16_t *) src->data;
+        memset(color_hash, 0, PNG_FAST_COLOR_HASH * sizeof(uint32_t));
+
+        for (int i = 0, n = src->w * src->h; i < n; i++) {
+            int pixel = pixels[i];
+            uint32_t h = ((((uint32_t) pixel) * 0x9E37) >> 6) & (PNG_FAST_COLOR_HASH - 1);
+
+            for (; color_hash[h] && ((color_hash[h] & 0xFFFF) != pixel); h = (h + 1) & (PNG_FAST_COLOR_HASH - 1)) {
+            }
+
+            if (!color_hash[h]) {
+                if (colors == PNG_FAST_MAX_COLORS) {
+                    return PNG_FAST_MAX_COLORS + 1; // not a palette image
+                }
+
+                palette[(colors * 3) + 0] = COLOR_RGB565_TO_R8(pixel);
+                palette[(colors * 3) + 1] = COLOR_RGB565_TO_G8(pixel);
+                palette[(colors * 3) + 2] = COLOR_RGB565_TO_B8(pixel);
+                color_hash[h] = (1 << 24) | (colors++ << 16) | pixel;
+            }
+        }
+    } else {
+        return PNG_FAST_MAX_COLORS + 1;
+    }
+
+    return colors;
+}
+
+static int png_fast_palette_index(uint32_t *color_hash, int pixel) {
+    uint32_t h = ((((uint32_t) pixel) * 0x9E37) >> 6) & (PNG_FAST_COLOR_HASH - 1);
+
+    for (; (color_hash[h] & 0xFFFF) != pixel; h = (h + 1) & (PNG_FAST_COLOR_HASH - 1)) {
+    }
+
+    return (color_hash[h] >> 16) & 0xFF;
+}
+
+static void png_fast_encode(png_fast_t *s, image_t *src) {
+    uint8_t *palette = fb_alloc(PNG_FAST_MAX_COLORS * 3, FB_ALLOC_NO_HINT);
+    uint8_t *palette_lut = fb_alloc(256, FB_ALLOC_NO_HINT);
+    uint32_t *color_hash = fb_alloc(PNG_FAST_COLOR_HASH * sizeof(uint32_t), FB_ALLOC_NO_HINT);
+    int colors = png_fast_palette(src, palette, palette_lut, color_hash);
+    int depth = 8, color_type, bpp;
+
+    if (src->pixfmt == PIXFORMAT_BINARY) {
+        depth = 1;
+        color_type = 0; // grayscale
+        bpp = 1;
+    } else if (colors <= 16) {
+        depth = (colors <= 2) ? 1 : ((colors <= 4) ? 2 : 4);
+        color_type = 3; // palette
+        bpp = 1;
+    } else if ((colors <= PNG_FAST_MAX_COLORS) && (src->pixfmt == PIXFORMAT_RGB565)) {
+        color_type = 3; // palette
+        bpp = 1;
+    } else if (src->pixfmt == PIXFORMAT_GRAYSCALE) {
+        color_type = 0; // grayscale
+        bpp = 1;
+    } else {
+        color_type = 2; // rgb
+        bpp = 3;
+    }
+
+    // Sub/Up do well on 8-bit samples, packed and palette rows choose between None and Up.
+    bool packed = (depth < 8) || (color_type == 3);
+    int stride = packed ? (((src->w * depth) + 7) / 8) : (src->w * bpp);
+    uint8_t *rows[2] = { fb_alloc0(stride, FB_ALLOC_NO_HINT), fb_alloc0(stride, FB_ALLOC_NO_HINT) };
+    uint8_t *filtered[2] = { fb_alloc(stride + 1, FB_ALLOC_NO_HINT), fb_alloc(stride + 1, FB_ALLOC_NO_HINT) };
+    uint16_t *rgb565 = fb_alloc(src->w * sizeof(uint16_t), FB_ALLOC_NO_HINT);
+    uint8_t *prev = rows[1];
+    s->tokens = fb_alloc(PNG_FAST_TOKENS * sizeof(uint16_t), FB_ALLOC_NO_HINT);
+
+    s->buf[s->pos++] = 0x89;
+    memcpy(s->buf + s->pos, "PNG\r\n\x1a\n", 7);
+    s->pos += 7;
+
+    png_fast_chunk_begin(s, "IHDR");
+    png_fast_put32(s, src->w);
+    png_fast_put32(s, src->h);
+    s->buf[s->pos++] = depth;
+    s->buf[s->pos++] = color_type;
+    s->buf[s->pos++] = 0; // deflate
+    s->buf[s->pos++] = 0; // adaptive filtering
+    s->buf[s->pos++] = 0; // no interlace
+    png_fast_chunk_end(s);
+
+    if (color_type == 3) {
+        png_fast_chunk_begin(s, "PLTE");
+        memcpy(s->buf + s->pos, palette, colors * 3);
+        s->pos += colors * 3;
+        png_fast_chunk_end(s);
+    }
+
+    png_fast_chunk_begin(s, "IDAT");
+    s->buf[s->pos++] = 0x78; // zlib, 32K window
+    s->buf[s->pos++] = 0x01; // fastest
+    s->adler_a = 1;
+    s->adler_b = 0;
+    s->prev = -1;
+
+    for (int y = 0; y < src->h; y++) {
+        uint8_t *row = rows[y & 1];
+
+        if (src->pixfmt == PIXFORMAT_BINARY) {
+            uint32_t *src_row = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(src, y);
+
+            for (int x = 0; x < stride; x++) {
+                row[x] = png_fast_reverse8(src_row[x >> 2] >> ((x & 3) * 8));
+            }
+
+            if (src->w & 7) {
+                row[stride - 1] &= 0xFF00 >> (src->w & 7);
+            }
+        } else if (color_type == 3) {
+            uint8_t *gray_row = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(src, y);
+            uint16_t *rgb_row = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(src, y);
+            int per_byte = 8 / depth;
+            memset(row, 0, stride);
+
+            for (int x = 0; x < src->w; x++) {
+                int index = (src->pixfmt == PIXFORMAT_GRAYSCALE) ?
+                            palette_lut[gray_row[x]] : png_fast_palette_index(color_hash, rgb_row[x]);
+                row[x / per_byte] |= index << ((per_byte - 1 - (x % per_byte)) * depth);
+            }
+        } else if (src->pixfmt == PIXFORMAT_GRAYSCALE) {
+            row = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(src, y);
+        } else if (src->pixfmt == PIXFORMAT_RGB888) {
+            row = src->data + (y * src->w * 3);
+        } else {
+            uint16_t *rgb_row = rgb565;
+
+            if (src->pixfmt == PIXFORMAT_RGB565) {
+                rgb_row = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(src, y);
+            } else if (src->is_bayer) {
+                imlib_debayer_line(0, src->w, y, rgb_row, PIXFORMAT_RGB565, src);
+            } else {
+                imlib_deyuv_line(0, src->w, y, rgb_row, PIXFORMAT_RGB565, src);
+            }
+
+            for (int x = 0; x < src->w; x++) {
+                row[(x * 3) + 0] = COLOR_RGB565_TO_R8(rgb_row[x]);
+                row[(x * 3) + 1] = COLOR_RGB565_TO_G8(rgb_row[x]);
+                row[(x * 3) + 2] = COLOR_RGB565_TO_B8(rgb_row[x]);
+            }
+        }
+
+        // filtered[0] holds Sub (or None), filtered[1] holds Up, the cheaper one is compressed.
+        uint8_t *a = filtered[0] + 1, *b = filtered[1] + 1;
+        uint32_t cost_a = 0, cost_b = 0;
+
+        if (packed) {
+            for (int x = 0; x < stride; x++) {
+                a[x] = row[x];
+                b[x] = row[x] - prev[x];
+                cost_a += (x > 0) && (a[x] != a[x - 1]);
+                cost_b += b[x] != 0;
+            }
+
+            filtered[0][0] = 0; // none
+        } else {
+            for (int x = 0; x < stride; x++) {
+                a[x] = row[x] - ((x >= bpp) ? row[x - bpp] : 0);
+                b[x] = row[x] - prev[x];
+                cost_a += abs((int8_t) a[x]);
+                cost_b += abs((int8_t) b[x]);
+            }
+
+            filtered[0][0] = 1; // sub
+        }
+
+        filtered[1][0] = 2; // up
+        png_fast_feed(s, filtered[(y > 0) && (cost_b <= cost_a)], stride + 1);
+        prev = row;
+    }
+
+    png_fast_flush_run(s);
+    png_fast_block(s, true);
+    png_fast_bits_align(s);
+    // Room for the adler32 and the IEND chunk too, the IDAT chunk can't be reopened once closed.
+    png_fast_ensure(s, 4 + 12);
+    png_fast_put32(s, (s->adler_b << 16) | s->adler_a);
+    png_fast_chunk_end(s);
+
+    png_fast_chunk_begin(s, "IEND");
+    png_fast_chunk_end(s);
+
+    fb_free(); // s->tokens
+    fb_free(); // rgb565
+    fb_free(); // filtered[1]
+    fb_free(); // filtered[0]
+    fb_free(); // rows[1]
+    fb_free(); // rows[0]
+    fb_free(); // color_hash
+    fb_free(); // palette_lut
+    fb_free(); // palette
+}
+
+bool png_compress_fast(image_t *src, image_t *dst) {
+    #if (TIME_PNG == 1)
+    mp_uint_t start = mp_hal_ticks_ms();
+    #endif
+
+    if (src->is_compressed) {
+        return true;
+    }
+
+    png_fast_t s = { .fp = NULL };
+
+    if (dst->data == NULL) {
+        // Deflate never takes more than 9 bits per byte plus the block headers.
+        uint32_t raw = src->h * ((src->w * 3) + 1);
+        s.cap = raw + (raw / 8) + (((raw / PNG_FAST_TOKENS) + 1) * PNG_FAST_BLOCK_HEADER) + 1024;
+        s.buf = fb_alloc(s.cap, FB_ALLOC_NO_HINT); // will be free'd by the caller.
+    } else {
+        s.cap = image_size(dst);
+        s.buf = dst->data;
+    }
+
+    png_fast_encode(&s, src);
+    dst->data = s.buf;
+    dst->size = s.pos;
+
+    #if (TIME_PNG == 1)
+    printf("time: %u ms\n", mp_hal_ticks_ms() - start);
+    #endif
+
+    return false;
+}
+
+#if defined(IMLIB_ENABLE_IMAGE_FILE_IO)
+// Streams the image to a file through a small buffer, one IDAT chunk per buffer.
+static void png_fast_write(FIL *fp, image_t *img) {
+    png_fast_t s = { .fp = fp, .cap = PNG_FAST_FILE_BUFFER };
+    s.buf = fb_alloc(s.cap, FB_ALLOC_NO_HINT);
+    png_fast_encode(&s, img);
+    write_data(fp, s.buf, s.pos);
+    fb_free(); // s.buf
+}
+#endif // IMLIB_ENABLE_IMAGE_FILE_IO
 #endif // IMLIB_ENABLE_PNG_ENCODER
 
 #if defined(IMLIB_ENABLE_PNG_DECODER)
@@ -241,6 +925,10 @@ void png_decompress(image_t *dst, image_t *src) {
 bool png_compress(image_t *src, image_t *dst) {
     mp_raise_msg_varg(&mp_type_RuntimeError, MP_ERROR_TEXT("PNG encoder is not enabled"));
 }
+
+bool png_compress_fast(image_t *src, image_t *dst) {
+    mp_raise_msg_varg(&mp_type_RuntimeError, MP_ERROR_TEXT("PNG encoder is not enabled"));
+}
 #endif
 
 #if !defined(IMLIB_ENABLE_PNG_DECODER)
@@ -299,11 +987,15 @@ void png_read(image_t *img, const char *path) {
     file_close(&fp);
 }
 
-void png_write(image_t *img, const char *path) {
+void png_write(image_t *img, const char *path, int quality) {
     FIL fp;
     file_write_open(&fp, path);
     if (img->pixfmt == PIXFORMAT_PNG) {
         write_data(&fp, img->pixels, img->size);
+    #if defined(IMLIB_ENABLE_PNG_ENCODER)
+    } else if (quality < PNG_LODEPNG_QUALITY) {
+        png_fast_write(&fp, img);
+    #endif
     } else {
         image_t out = { .w = img->w, .h = img->h, .pixfmt = PIXFORMAT_PNG, .size = 0, .pixels = NULL }; // alloc in png compress
         png_compress(img, &out);
@@ -0,0 +1,279 @@
+/*
+ * This file is part of the OpenMV project.
+ *
+ * Copyright (c) 2013-2021 Ibrahim Abdelkader <iabdalkader@openmv.io>
+ * Copyright (c) 2013-2021 Kwabena W. Agyeman <kwagyeman@openmv.io>
+ *
+ * This work is licensed under the MIT license, see the file LICENSE for details.
+ *
+ * Image pyramid (scale-space) shared between detectors.
+ *
+ * Levels are built lazily from the previous level with an area (box) filter, the exact
+ * 2x case uses a vectorized 2x2 averaging kernel. Level buffers are kept across frames
+ * and are only reallocated when the source geometry changes.
+ */
+#include "imlib.h"
+#include "simd.h"
+
+#ifdef IMLIB_ENABLE_PYRAMID
+
+typedef struct area_tap {
+    uint16_t start;     // First source index.
+    uint16_t n;         // Number of fully covered source indices after start.
+    uint16_t w0;        // Weight of the first source index (x/256).
+    uint16_t w1;        // Weight of the trailing partial source index (x/256), 0 if none.
+    uint32_t inv;       // 2^24 / total weight.
+} area_tap_t;
+
+static void area_taps(area_tap_t *taps, int src_len, int dst_len) {
+    for (int i = 0; i < dst_len; i++) {
+        uint32_t a = (((uint64_t) i) * src_len * 256) / dst_len;
+        uint32_t b = (((uint64_t) (i + 1)) * src_len * 256) / dst_len;
+        int x0 = a >> 8, x1 = b >> 8;
+
+        taps[i].start = x0;
+        if (x0 == x1) {
+            taps[i].n = 0;
+            taps[i].w0 = b - a;
+            taps[i].w1 = 0;
+        } else {
+            taps[i].n = x1 - x0 - 1;
+            taps[i].w0 = 256 - (a & 255);
+            taps[i].w1 = (x1 < src_len) ? (b & 255) : 0;
+        }
+        taps[i].inv = (1 << 24) / (b - a);
+    }
+}
+
+// Exact 2x downscale of a grayscale image, odd trailing rows/columns are dropped.
+static void pyramid_half_gray(image_t *src, image_t *dst) {
+    for (int y = 0; y < dst->h; y++) {
+        const uint8_t *r0 = src->data + (y * 2 * src->w);
+        const uint8_t *r1 = r0 + src->w;
+        uint8_t *out = dst->data + (y * dst->w);
+        int x = 0;
+
+        // Each 16-bit lane holds a horizontal pixel pair, so the 2x2 sum needs no shuffles.
+        for (; x <= (dst->w - VEC_LANES); x += VEC_LANES) {
+            vec_u16_t a = VEC_LOAD(vec_u16_t, r0 + (x * 2));
+            vec_u16_t b = VEC_LOAD(vec_u16_t, r1 + (x * 2));
+            vec_u16_t s = (a & 0xFF) + (a >> 8) + (b & 0xFF) + (b >> 8) + 2;
+            VEC_STORE(out + x, VEC_U16_TO_U8(s >> 2));
+        }
+
+        for (; x < dst->w; x++) {
+            out[x] = (r0[x * 2] + r0[x * 2 + 1] + r1[x * 2] + r1[x * 2 + 1] + 2) >> 2;
+        }
+    }
+}
+
+void imlib_area_scale(image_t *src, image_t *dst) {
+    int c = (src->pixfmt == PIXFORMAT_RGB888) ? 3 : 1;
+
+    if ((c == 1) && ((src->w / 2) == dst->w) && ((src->h / 2) == dst->h)) {
+        pyramid_half_gray(src, dst);
+        return;
+    }
+
+    int row_len = src->w * c;
+    area_tap_t *x_taps = fb_alloc(dst->w * sizeof(area_tap_t), FB_ALLOC_NO_HINT);
+    area_tap_t *y_taps = fb_alloc(dst->h * sizeof(area_tap_t), FB_ALLOC_NO_HINT);
+    uint32_t *acc = fb_alloc(row_len * sizeof(uint32_t), FB_ALLOC_NO_HINT);
+
+    area_taps(x_taps, src->w, dst->w);
+    area_taps(y_taps, src->h, dst->h);
+
+    for (int y = 0; y < dst->h; y++) {
+        area_tap_t *ty = y_taps + y;
+        const uint8_t *row = src->data + (ty->start * row_len);
+        uint8_t *out = dst->data + (y * dst->w * c);
+
+        // Vertical pass, accumulates weighted source rows.
+        for (int i = 0; i < row_len; i++) {
+            acc[i] = row[i] * ty->w0;
+        }
+
+        for (int j = 0; j < ty->n; j++) {
+            row += row_len;
+            for (int i = 0; i < row_len; i++) {
+                acc[i] += row[i] << 8;
+            }
+        }
+
+        if (ty->w1) {
+            row += row_len;
+            for (int i = 0; i < row_len; i++) {
+                acc[i] += row[i] * ty->w1;
+            }
+        }
+
+        // Normalize to 8.8 fixed point (acc <= 255 * weight so this fits in 32-bits).
+        for (int i = 0; i < row_len; i++) {
+            acc[i] = (acc[i] * ty->inv) >> 16;
+        }
+
+        // Horizontal pass.
+        for (int x = 0; x < dst->w; x++) {
+            area_tap_t *tx = x_taps + x;
+            const uint32_t *p = acc + (tx->start * c);
+            for (int k = 0; k < c; k++) {
+                uint32_t s = p[k] * tx->w0;
+                for (int j = 1; j <= tx->n; j++) {
+                    s += p[(j * c) + k] << 8;
+                }
+                if (tx->w1) {
+                    s += p[((tx->n + 1) * c) + k] * tx->w1;
+                }
+                uint32_t v = ((((uint64_t) s) * tx->inv) + (1U << 31)) >> 32;
+                out[(x * c) + k] = IM_MIN(v, 255U);
+            }
+        }
+    }
+
+    fb_free(); // acc
+    fb_free(); // y_taps
+    fb_free(); // x_taps
+}
+
+static void pyramid_to_luma(image_t *src, image_t *dst) {
+    switch (src->pixfmt) {
+        case PIXFORMAT_RGB565: {
+            for (int y = 0; y < src->h; y++) {
+                uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(src, y);
+                uint8_t *out = dst->data + (y * dst->w);
+                for (int x = 0; x < src->w; x++) {
+                    out[x] = COLOR_RGB565_TO_Y(row_ptr[x]);
+                }
+            }
+            break;
+        }
+        case PIXFORMAT_RGB888: {
+            const uint8_t *in = src->data;
+            for (int i = 0, ii = src->w * src->h; i < ii; i++, in += 3) {
+                dst->data[i] = COLOR_RGB888_TO_Y(in[0], in[1], in[2]);
+            }
+            break;
+        }
+        default: {
+            // Grayscale and YUV420 levels reference the source Y plane directly.
+            break;
+        }
+    }
+}
+
+// Level buffers are only dropped (not freed) on geometry changes since images returned from
+// older levels may still reference them, the GC reclaims them once they are unreachable.
+static void pyramid_free_levels(pyramid_t *pyr, bool release) {
+    for (int i = 0; release && (i < pyr->n_levels); i++) {
+        if (pyr->levels[i].owned) {
+            xfree(pyr->levels[i].img.data);
+        }
+    }
+
+    memset(pyr->levels, 0, sizeof(pyr->levels));
+    pyr->n_levels = 0;
+}
+
+void imlib_pyramid_init(pyramid_t *pyr, float scale_factor, int max_levels, int min_size, bool luma) {
+    memset(pyr, 0, sizeof(pyramid_t));
+    pyr->scale_factor = scale_factor;
+    pyr->max_levels = IM_MIN(IM_MAX(max_levels, 1), PYRAMID_MAX_LEVELS);
+    pyr->min_size = IM_MAX(min_size, 1);
+    pyr->luma = luma;
+}
+
+void imlib_pyramid_free(pyramid_t *pyr) {
+    pyramid_free_levels(pyr, true);
+    pyr->src.data = NULL;
+}
+
+void imlib_pyramid_update(pyramid_t *pyr, image_t *img) {
+    bool luma = pyr->luma || (img->pixfmt != PIXFORMAT_RGB888);
+
+    switch (img->pixfmt) {
+        case PIXFORMAT_GRAYSCALE:
+        case PIXFORMAT_RGB565:
+        case PIXFORMAT_RGB888:
+        case PIXFORMAT_YUV420:
+            break;
+        default:
+            mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("Pyramid expects a GRAYSCALE, RGB565, RGB888 or YUV420 image"));
+    }
+
+    if ((pyr->n_levels == 0)
+        || (pyr->src.w != img->w)
+        || (pyr->src.h != img->h)
+        || (pyr->src.pixfmt != img->pixfmt)) {
+        pyramid_free_levels(pyr, false);
+
+        pixformat_t pixfmt = luma ? PIXFORMAT_GRAYSCALE : PIXFORMAT_RGB888;
+        bool half = fast_fabsf(pyr->scale_factor - 2.0f) < 0.001f;
+
+        for (int i = 0, w = img->w, h = img->h; i < pyr->max_levels; i++) {
+            if ((w < pyr->min_size) || (h < pyr->min_size)) {
+                break;
+            }
+
+            pyramid_level_t *level = &pyr->levels[i];
+            level->img.w = w;
+            level->img.h = h;
+            level->img.pixfmt = pixfmt;
+            level->x_scale = img->w / ((float) w);
+            level->y_scale = img->h / ((float) h);
+            // Level 0 references the source unless it has to be converted to luma.
+            level->owned = (i > 0) || (luma && ((img->pixfmt == PIXFORMAT_RGB565) || (img->pixfmt == PIXFORMAT_RGB888)));
+
+            if (level->owned) {
+                level->img.data = xalloc(image_size(&level->img));
+            }
+
+            pyr->n_levels++;
+            w = half ? (w / 2) : fast_roundf(w / pyr->scale_factor);
+            h = half ? (h / 2) : fast_roundf(h / pyr->scale_factor);
+        }
+    }
+
+    pyr->src = *img;
+
+    for (int i = 0; i < pyr->n_levels; i++) {
+        pyr->levels[i].valid = false;
+    }
+
+    if (pyr->n_levels && !pyr->levels[0].owned) {
+        pyr->levels[0].img.data = img->data;
+        pyr->levels[0].valid = true;
+    }
+}
+
+image_t *imlib_pyramid_level(pyramid_t *pyr, int level) {
+    if ((level < 0) || (level >= pyr->n_levels)) {
+        return NULL;
+    }
+
+    pyramid_level_t *l = &pyr->levels[level];
+
+    if (!l->valid) {
+        if (level == 0) {
+            pyramid_to_luma(&pyr->src, &l->img);
+        } else {
+            imlib_area_scale(imlib_pyramid_level(pyr, level - 1), &l->img);
+        }
+        l->valid = true;
+    }
+
+    return &l->img;
+}
+
+int imlib_pyramid_find_level(pyramid_t *pyr, float scale) {
+    int level = 0;
+
+    for (int i = 1; i < pyr->n_levels; i++) {
+        if ((pyr->levels[i].x_scale > scale) || (pyr->levels[i].y_scale > scale)) {
+            break;
+        }
+        level = i;
+    }
+
+    return level;
+}
+#endif // IMLIB_ENABLE_PYRAMID
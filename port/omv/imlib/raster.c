@@ -0,0 +1,526 @@
+/*
+ * This file is part of the OpenMV project.
+ *
+ * Copyright (c) 2013-2021 Ibrahim Abdelkader <iabdalkader@openmv.io>
+ * Copyright (c) 2013-2021 Kwabena W. Agyeman <kwagyeman@openmv.io>
+ *
+ * This work is licensed under the MIT license, see the file LICENSE for details.
+ *
+ * Span rasterizer.
+ *
+ * Shapes are broken into horizontal (or vertical) runs that are clipped once and
+ * filled by a per-format kernel, instead of going through imlib_set_pixel() one
+ * point at a time. Thick lines are rasterized as capsules (a segment swept by a
+ * disk) and circle outlines as annuli, which also gives them an anti-aliased mode:
+ * pixels fully inside the shape are filled as spans and only the one or two pixel
+ * fringe is alpha blended by coverage.
+ */
+#include <limits.h>
+#include <string.h>
+#include "imlib.h"
+
+void imlib_draw_hspan(image_t *img, int x0, int x1, int y, int c) {
+    if ((y < 0) || (y >= img->h)) {
+        return;
+    }
+
+    x0 = IM_MAX(x0, 0);
+    x1 = IM_MIN(x1, img->w - 1);
+
+    if (x0 > x1) {
+        return;
+    }
+
+    int n = x1 - x0 + 1;
+
+    switch (img->pixfmt) {
+        case PIXFORMAT_BINARY: {
+            uint32_t *row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, y);
+            uint32_t v = (c & 1) ? 0xFFFFFFFF : 0;
+            int i0 = x0 >> UINT32_T_SHIFT, i1 = x1 >> UINT32_T_SHIFT;
+            uint32_t m0 = 0xFFFFFFFF << (x0 & UINT32_T_MASK);
+            uint32_t m1 = 0xFFFFFFFF >> (UINT32_T_MASK - (x1 & UINT32_T_MASK));
+
+            if (i0 == i1) {
+                m0 &= m1;
+                row_ptr[i0] = (row_ptr[i0] & ~m0) | (v & m0);
+            } else {
+                row_ptr[i0] = (row_ptr[i0] & ~m0) | (v & m0);
+                for (int i = i0 + 1; i < i1; i++) {
+                    row_ptr[i] = v;
+                }
+                row_ptr[i1] = (row_ptr[i1] & ~m1) | (v & m1);
+            }
+            break;
+        }
+        case PIXFORMAT_GRAYSCALE: {
+            memset(IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y) + x0, c, n);
+            break;
+        }
+        case PIXFORMAT_RGB565: {
+            uint16_t *p = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y) + x0;
+
+            if (((uintptr_t) p) & 2) {
+                *p++ = c;
+                n--;
+            }
+
+            uint32_t c2 = (((uint32_t) c) & 0xFFFF) * 0x00010001;
+            uint32_t *q = (uint32_t *) p;
+
+            for (; n >= 2; n -= 2) {
+                *q++ = c2;
+            }
+
+            if (n) {
+                *((uint16_t *) q) = c;
+            }
+            break;
+        }
+        case PIXFORMAT_RGB888: {
+            uint8_t *p = img->data + (((y * img->w) + x0) * 3);
+            uint8_t r = c >> 16, g = c >> 8, b = c;
+
+            for (; n > 0; n--, p += 3) {
+                p[0] = r;
+                p[1] = g;
+                p[2] = b;
+            }
+            break;
+        }
+        case PIXFORMAT_ARGB8888: {
+            uint32_t *p = ((uint32_t *) img->data) + (y * img->w) + x0;
+
+            for (; n > 0; n--) {
+                *p++ = c;
+            }
+            break;
+        }
+        case PIXFORMAT_YUV420: {
+            uint8_t *uv = img->data + (img->w * img->h) + (img->w * (y / 2));
+            memset(img->data + (img->w * y) + x0, c >> 16, n);
+
+            for (int x = x0 & ~1; x <= x1; x += 2) {
+                uv[x] = c >> 8;
+                uv[x | 1] = c;
+            }
+            break;
+        }
+        default: {
+            for (int x = x0; x <= x1; x++) {
+                imlib_set_pixel(img, x, y, c);
+            }
+            break;
+        }
+    }
+}
+
+void imlib_draw_vspan(image_t *img, int x, int y0, int y1, int c) {
+    if ((x < 0) || (x >= img->w)) {
+        return;
+    }
+
+    y0 = IM_MAX(y0, 0);
+    y1 = IM_MIN(y1, img->h - 1);
+
+    if (y0 > y1) {
+        return;
+    }
+
+    switch (img->pixfmt) {
+        case PIXFORMAT_GRAYSCALE: {
+            uint8_t *p = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y0) + x;
+            for (int y = y0; y <= y1; y++, p += img->w) {
+                *p = c;
+            }
+            break;
+        }
+        case PIXFORMAT_RGB565: {
+            uint16_t *p = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y0) + x;
+            for (int y = y0; y <= y1; y++, p += img->w) {
+                *p = c;
+            }
+            break;
+        }
+        case PIXFORMAT_ARGB8888: {
+            uint32_t *p = ((uint32_t *) img->data) + (y0 * img->w) + x;
+            for (int y = y0; y <= y1; y++, p += img->w) {
+                *p = c;
+            }
+            break;
+        }
+        default: {
+            for (int y = y0; y <= y1; y++) {
+                imlib_set_pixel(img, x, y, c);
+            }
+            break;
+        }
+    }
+}
+
+// Straight alpha "over": fg scaled by a coverage of 0 to 256 onto bg, which may itself be
+// transparent (a cleared OSD layer), so the colors are weighted by their alphas.
+uint32_t imlib_blend_argb8888(uint32_t bg, uint32_t fg, int alpha) {
+    uint32_t src_a = (((fg >> 24) * alpha) + 128) >> 8;
+    uint32_t dst_a = (((bg >> 24) * (255 - src_a)) + 127) / 255;
+    uint32_t out_a = src_a + dst_a;
+
+    if (!out_a) {
+        return 0;
+    }
+
+    uint32_t out = out_a << 24;
+
+    for (int shift = 0; shift < 24; shift += 8) {
+        uint32_t s = (fg >> shift) & 0xFF, d = (bg >> shift) & 0xFF;
+        out |= (((s * src_a) + (d * dst_a) + (out_a / 2)) / out_a) << shift;
+    }
+
+    return out;
+}
+
+// Alpha is 0 to 256. Binary and YUV images can't blend so they threshold at half coverage.
+void imlib_blend_pixel(image_t *img, int x, int y, int c, int alpha) {
+    if ((x < 0) || (x >= img->w) || (y < 0) || (y >= img->h) || (alpha <= 0)) {
+        return;
+    }
+
+    if (alpha >= 256) {
+        imlib_set_pixel(img, x, y, c);
+        return;
+    }
+
+    switch (img->pixfmt) {
+        case PIXFORMAT_GRAYSCALE: {
+            uint8_t *p = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y) + x;
+            *p += ((c - *p) * alpha) >> 8;
+            break;
+        }
+        case PIXFORMAT_RGB565: {
+            uint16_t *p = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, y) + x;
+            uint32_t a = alpha >> 3;
+            uint32_t fg = (((uint32_t) c) | (((uint32_t) c) << 16)) & 0x07E0F81F;
+            uint32_t bg = (((uint32_t) *p) | (((uint32_t) *p) << 16)) & 0x07E0F81F;
+            bg = (bg + (((fg - bg) * a) >> 5)) & 0x07E0F81F;
+            *p = bg | (bg >> 16);
+            break;
+        }
+        case PIXFORMAT_RGB888: {
+            uint8_t *p = img->data + (((y * img->w) + x) * 3);
+            uint32_t bg = (p[0] << 16) | (p[1] << 8) | p[2];
+            uint32_t rb = bg & 0x00FF00FF, g = bg & 0x0000FF00;
+            rb = (rb + ((((c & 0x00FF00FF) - rb) * alpha) >> 8)) & 0x00FF00FF;
+            g = (g + ((((c & 0x0000FF00) - g) * alpha) >> 8)) & 0x0000FF00;
+            bg = rb | g;
+            p[0] = bg >> 16;
+            p[1] = bg >> 8;
+            p[2] = bg;
+            break;
+        }
+        case PIXFORMAT_ARGB8888: {
+            uint32_t *p = ((uint32_t *) img->data) + (y * img->w) + x;
+            *p = imlib_blend_argb8888(*p, c, alpha);
+            break;
+        }
+        default: {
+            if (alpha >= 128) {
+                imlib_set_pixel(img, x, y, c);
+            }
+            break;
+        }
+    }
+}
+
+typedef struct raster_shape {
+    bool annulus;
+    float x0, y0;       // Segment start or annulus center.
+    float x1, y1;       // Segment end.
+    float ux, uy, len;  // Segment direction and length.
+    float inv_ux;       // 1 / ux and 1 / uy, 0 when the segment is axis aligned.
+    float inv_uy;
+    float r;            // Annulus center line radius.
+} raster_shape_t;
+
+// Distance from the capsule segment or the annulus center line.
+static float raster_shape_dist(const raster_shape_t *s, float x, float y) {
+    float px = x - s->x0, py = y - s->y0;
+
+    if (s->annulus) {
+        return fast_fabsf(fast_sqrtf((px * px) + (py * py)) - s->r);
+    }
+
+    float t = IM_MIN(IM_MAX((px * s->ux) + (py * s->uy), 0.0f), s->len);
+    float ex = px - (t * s->ux), ey = py - (t * s->uy);
+    return fast_sqrtf((ex * ex) + (ey * ey));
+}
+
+// Narrows [lo, hi] to the x where lo_v <= (a * x) + b <= hi_v, inv_a is 1 / a or 0 if a is 0.
+static void raster_clip_linear(float inv_a, float b, float lo_v, float hi_v, float *lo, float *hi) {
+    if (inv_a == 0.0f) {
+        if ((b < lo_v) || (b > hi_v)) {
+            *lo = 1.0f;
+            *hi = -1.0f;
+        }
+        return;
+    }
+
+    float t0 = (lo_v - b) * inv_a, t1 = (hi_v - b) * inv_a;
+    *lo = IM_MAX(*lo, IM_MIN(t0, t1));
+    *hi = IM_MIN(*hi, IM_MAX(t0, t1));
+}
+
+// Returns the x interval(s) of row y within distance q of the shape, the annulus may
+// split a row in two. Returns the number of intervals.
+static int raster_shape_row(const raster_shape_t *s, float q, float y, float *iv) {
+    if (q < 0.0f) {
+        return 0;
+    }
+
+    if (s->annulus) {
+        float dy = y - s->y0, ro = s->r + q, ri = s->r - q;
+
+        if (fast_fabsf(dy) > ro) {
+            return 0;
+        }
+
+        float xo = fast_sqrtf((ro * ro) - (dy * dy));
+
+        if ((ri > 0.0f) && (fast_fabsf(dy) < ri)) {
+            float xi = fast_sqrtf((ri * ri) - (dy * dy));
+            iv[0] = s->x0 - xo;
+            iv[1] = s->x0 - xi;
+            iv[2] = s->x0 + xi;
+            iv[3] = s->x0 + xo;
+            return 2;
+        }
+
+        iv[0] = s->x0 - xo;
+        iv[1] = s->x0 + xo;
+        return 1;
+    }
+
+    float lo = 1.0f, hi = -1.0f;
+
+    // End caps.
+    for (int i = 0; i < 2; i++) {
+        float ex = i ? s->x1 : s->x0, dy = y - (i ? s->y1 : s->y0);
+
+        if (fast_fabsf(dy) <= q) {
+            float h = fast_sqrtf((q * q) - (dy * dy));
+
+            if (lo > hi) {
+                lo = ex - h;
+                hi = ex + h;
+            } else {
+                lo = IM_MIN(lo, ex - h);
+                hi = IM_MAX(hi, ex + h);
+            }
+        }
+    }
+
+    // Body, between the two normal lines and the two end lines.
+    if (s->len > 0.0f) {
+        float bl = -1e9f, bh = 1e9f;
+        raster_clip_linear(-s->inv_uy, (s->uy * s->x0) + (s->ux * (y - s->y0)), -q, q, &bl, &bh);
+        raster_clip_linear(s->inv_ux, (s->uy * (y - s->y0)) - (s->ux * s->x0), 0.0f, s->len, &bl, &bh);
+
+        if (bl <= bh) {
+            if (lo > hi) {
+                lo = bl;
+                hi = bh;
+            } else {
+                lo = IM_MIN(lo, bl);
+                hi = IM_MAX(hi, bh);
+            }
+        }
+    }
+
+    if (lo > hi) {
+        return 0;
+    }
+
+    iv[0] = lo;
+    iv[1] = hi;
+    return 1;
+}
+
+// Converts [lo, hi] to the pixel centers it contains, clamped around the image.
+static bool raster_pixels(image_t *img, float lo, float hi, int *x0, int *x1) {
+    lo = IM_MAX(lo, -1.0f);
+    hi = IM_MIN(hi, (float) img->w);
+
+    if (lo > hi) {
+        return false;
+    }
+
+    *x0 = fast_ceilf(lo);
+    *x1 = fast_floorf(hi);
+    return *x0 <= *x1;
+}
+
+static void raster_shape(image_t *img, const raster_shape_t *s, float radius, int c, bool antialias) {
+    float extent = radius + 1.0f + (s->annulus ? s->r : 0.0f);
+    int y_start = IM_MAX(fast_floorf(IM_MIN(s->y0, s->y1) - extent), 0);
+    int y_end = IM_MIN(fast_ceilf(IM_MAX(s->y0, s->y1) + extent), img->h - 1);
+
+    for (int y = y_start; y <= y_end; y++) {
+        float outer[4], solid[4];
+        int n_outer, n_solid;
+        int x0, x1;
+
+        if (!antialias) {
+            n_outer = raster_shape_row(s, radius, y, outer);
+
+            for (int i = 0; i < n_outer; i++) {
+                if (raster_pixels(img, outer[i * 2], outer[(i * 2) + 1], &x0, &x1)) {
+                    imlib_draw_hspan(img, x0, x1, y, c);
+                }
+            }
+
+            continue;
+        }
+
+        // Coverage is radius + 0.5 - distance, full inside radius - 0.5 and zero past radius + 0.5.
+        n_outer = raster_shape_row(s, radius + 0.5f, y, outer);
+        n_solid = raster_shape_row(s, radius - 0.5f, y, solid);
+
+        for (int i = 0; i < n_outer; i++) {
+            if (!raster_pixels(img, outer[i * 2], outer[(i * 2) + 1], &x0, &x1)) {
+                continue;
+            }
+
+            int x = x0;
+
+            for (int j = 0; (j < n_solid) && (x <= x1); j++) {
+                int s0, s1;
+
+                if ((!raster_pixels(img, solid[j * 2], solid[(j * 2) + 1], &s0, &s1)) || (s1 < x)) {
+                    continue;
+                }
+
+                for (; (x < s0) && (x <= x1); x++) {
+                    imlib_blend_pixel(img, x, y, c, fast_floorf((radius + 0.5f - raster_shape_dist(s, x, y)) * 256));
+                }
+
+                if (x <= x1) {
+                    imlib_draw_hspan(img, x, IM_MIN(s1, x1), y, c);
+                    x = IM_MIN(s1, x1) + 1;
+                }
+            }
+
+            for (; x <= x1; x++) {
+                imlib_blend_pixel(img, x, y, c, fast_floorf((radius + 0.5f - raster_shape_dist(s, x, y)) * 256));
+            }
+        }
+    }
+}
+
+void imlib_draw_capsule(image_t *img, float x0, float y0, float x1, float y1, float r, int c, bool antialias) {
+    float dx = x1 - x0, dy = y1 - y0;
+    float len = fast_sqrtf((dx * dx) + (dy * dy));
+    float ux = (len > 0.0f) ? (dx / len) : 1.0f;
+    float uy = (len > 0.0f) ? (dy / len) : 0.0f;
+
+    raster_shape_t s = {
+        .annulus = false,
+        .x0 = x0, .y0 = y0, .x1 = x1, .y1 = y1,
+        .ux = ux, .uy = uy, .len = len,
+        .inv_ux = (fast_fabsf(ux) < 1e-6f) ? 0.0f : (1.0f / ux),
+        .inv_uy = (fast_fabsf(uy) < 1e-6f) ? 0.0f : (1.0f / uy)
+    };
+
+    raster_shape(img, &s, r, c, antialias);
+}
+
+void imlib_draw_annulus(image_t *img, float cx, float cy, float r, float half_width, int c, bool antialias) {
+    raster_shape_t s = {
+        .annulus = true,
+        .x0 = cx, .y0 = cy, .x1 = cx, .y1 = cy,
+        .r = r
+    };
+
+    raster_shape(img, &s, half_width, c, antialias);
+}
+
+void imlib_draw_line_aa(image_t *img, int x0, int y0, int x1, int y1, int c, int thickness) {
+    if (thickness > 0) {
+        imlib_draw_capsule(img, x0, y0, x1, y1, thickness / 2.0f, c, true);
+    }
+}
+
+void imlib_draw_circle_aa(image_t *img, int cx, int cy, int r, int c, int thickness, bool fill) {
+    if (fill) {
+        imlib_draw_capsule(img, cx, cy, cx, cy, r, c, true);
+    } else if (thickness > 0) {
+        imlib_draw_annulus(img, cx, cy, r, thickness / 2.0f, c, true);
+    }
+}
+
+void imlib_draw_polyline(image_t *img, const point_t *points, int n, bool closed, int c, int thickness, bool antialias) {
+    for (int i = 1, ii = n + ((closed && (n > 2)) ? 1 : 0); i < ii; i++) {
+        const point_t *p0 = &points[i - 1], *p1 = &points[i % n];
+
+        if (antialias) {
+            imlib_draw_line_aa(img, p0->x, p0->y, p1->x, p1->y, c, thickness);
+        } else {
+            imlib_draw_line(img, p0->x, p0->y, p1->x, p1->y, c, thickness);
+        }
+    }
+
+    if (n == 1) {
+        if (antialias) {
+            imlib_draw_line_aa(img, points[0].x, points[0].y, points[0].x, points[0].y, c, thickness);
+        } else {
+            imlib_draw_line(img, points[0].x, points[0].y, points[0].x, points[0].y, c, thickness);
+        }
+    }
+}
+
+// Even-odd scanline fill sampled at pixel centers with a top-left rule, so polygons
+// sharing an edge don't overlap.
+void imlib_fill_polygon(image_t *img, const point_t *points, int n, int c) {
+    if (n < 3) {
+        return;
+    }
+
+    int y_min = INT_MAX, y_max = INT_MIN;
+
+    for (int i = 0; i < n; i++) {
+        y_min = IM_MIN(y_min, points[i].y);
+        y_max = IM_MAX(y_max, points[i].y);
+    }
+
+    y_min = IM_MAX(y_min, 0);
+    y_max = IM_MIN(y_max, img->h - 1);
+
+    float *xs = fb_alloc(n * sizeof(float), FB_ALLOC_NO_HINT);
+
+    for (int y = y_min; y <= y_max; y++) {
+        int k = 0;
+
+        for (int i = 0, j = n - 1; i < n; j = i++) {
+            int ya = points[j].y, yb = points[i].y;
+
+            if ((ya <= y) != (yb <= y)) {
+                float x = points[j].x + (((float) (y - ya) * (points[i].x - points[j].x)) / (yb - ya));
+
+                // Insertion sort, there are only a handful of crossings per row.
+                int m = k++;
+                for (; (m > 0) && (xs[m - 1] > x); m--) {
+                    xs[m] = xs[m - 1];
+                }
+                xs[m] = x;
+            }
+        }
+
+        for (int i = 0; (i + 1) < k; i += 2) {
+            float lo = IM_MAX(xs[i], -1.0f), hi = IM_MIN(xs[i + 1], (float) img->w);
+
+            if (lo < hi) {
+                imlib_draw_hspan(img, fast_ceilf(lo), fast_ceilf(hi) - 1, y, c);
+            }
+        }
+    }
+
+    fb_free();
+}
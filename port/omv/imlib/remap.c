@@ -0,0 +1,363 @@
+/*
+ * This file is part of the OpenMV project.
+ *
+ * Copyright (c) 2013-2021 Ibrahim Abdelkader <iabdalkader@openmv.io>
+ * Copyright (c) 2013-2021 Kwabena W. Agyeman <kwagyeman@openmv.io>
+ *
+ * This work is licensed under the MIT license, see the file LICENSE for details.
+ *
+ * Cached fixed-point remapping (lens and rotation correction, homographies).
+ *
+ * The geometric transform is compiled once into a table holding the packed source coordinate
+ * of every destination pixel, the table is only rebuilt when the parameters change. Applying
+ * the map is a nearest or bilinear gather done in tiles so that rotated maps keep reading from
+ * a narrow band of source rows.
+ */
+#include <stdlib.h>
+#include "py/runtime.h"
+#include "imlib.h"
+
+#ifdef IMLIB_ENABLE_REMAP
+
+#define REMAP_ONE       (1 << REMAP_FRAC_BITS)
+#define REMAP_TILE_W    (64)
+#define REMAP_TILE_H    (16)
+
+void imlib_remap_init(remap_t *m) {
+    memset(m, 0, sizeof(remap_t));
+}
+
+void imlib_remap_free(remap_t *m) {
+    free(m->map);
+    imlib_remap_init(m);
+}
+
+// Maps of the in-place lens_corr()/rotation_corr() kept across calls, one per remap type.
+static remap_t remap_cache[REMAP_TYPE_HOMOGRAPHY + 1];
+
+remap_t *imlib_remap_cache(remap_type_t type) {
+    return &remap_cache[type];
+}
+
+void imlib_remap_deinit_all() {
+    for (int i = 0; i < (sizeof(remap_cache) / sizeof(remap_cache[0])); i++) {
+        imlib_remap_free(&remap_cache[i]);
+    }
+}
+
+// Returns true if the map was already compiled from these parameters. Otherwise the table is
+// (re)allocated for the new size and the caller has to fill it in.
+bool imlib_remap_prepare(remap_t *m, remap_type_t type, int w, int h, const float *key, int key_len) {
+    float k[REMAP_KEY_SIZE] = {};
+    memcpy(k, key, key_len * sizeof(float));
+
+    if (m->map && (m->type == type) && (m->w == w) && (m->h == h) && !memcmp(m->key, k, sizeof(k))) {
+        return true;
+    }
+
+    if ((w <= 0) || (h <= 0) || (w > REMAP_MAX_SIZE) || (h > REMAP_MAX_SIZE)) {
+        mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("Invalid remap size!"));
+    }
+
+    if ((!m->map) || ((m->w * m->h) != (w * h))) {
+        free(m->map);
+        // Kept outside of the GC heap, maps for large frames are bigger than the heap.
+        m->map = malloc(w * h * sizeof(uint32_t));
+        if (!m->map) {
+            imlib_remap_init(m);
+            mp_raise_msg(&mp_type_MemoryError, MP_ERROR_TEXT("Out of memory!"));
+        }
+    }
+
+    m->w = w;
+    m->h = h;
+    m->type = type;
+    memcpy(m->key, k, sizeof(k));
+    return false;
+}
+
+// Pixels whose nearest source pixel is outside the image are invalid.
+static inline uint32_t remap_pack(float sx, float sy, int w, int h) {
+    if (!((-0.5f < sx) && (sx < (w - 0.5f)) && (-0.5f < sy) && (sy < (h - 0.5f)))) {
+        return REMAP_INVALID;
+    }
+
+    int qx = IM_MIN(IM_MAX(sx, 0.0f), w - 1) * REMAP_ONE;
+    int qy = IM_MIN(IM_MAX(sy, 0.0f), h - 1) * REMAP_ONE;
+    return ((qx >> REMAP_FRAC_BITS) << 20) | ((qy >> REMAP_FRAC_BITS) << 8) |
+           ((qx & (REMAP_ONE - 1)) << 4) | (qy & (REMAP_ONE - 1));
+}
+
+// A simple algorithm for correcting lens distortion.
+// See http://www.tannerhelland.com/4743/simple-algorithm-correcting-lens-distortion/
+void imlib_remap_lens_corr(remap_t *m, int w, int h, float strength, float zoom, float x_corr, float y_corr) {
+    float key[] = { strength, zoom, x_corr, y_corr };
+
+    if (imlib_remap_prepare(m, REMAP_TYPE_LENS_CORR, w, h, key, sizeof(key) / sizeof(float))) {
+        return;
+    }
+
+    int halfWidth = w / 2;
+    int halfHeight = h / 2;
+    float maximum_diameter = fast_sqrtf((w * w) + (h * h));
+    float lens_corr_diameter = strength / maximum_diameter;
+    zoom = 1 / zoom;
+
+    // Convert percentage offset to pixels from center of image
+    int x_off = w * x_corr;
+    int y_off = h * y_corr;
+
+    int maximum_radius = fast_ceilf(maximum_diameter / 2) + 1; // +1 inclusive of final value
+    float *precalculated_table = fb_alloc(maximum_radius * sizeof(float), FB_ALLOC_NO_HINT);
+
+    for (int i = 0; i < maximum_radius; i++) {
+        float r = lens_corr_diameter * i;
+        precalculated_table[i] = (fast_atanf(r) / r) * zoom;
+    }
+
+    int down_adj = halfHeight + y_off;
+    int up_adj = h - 1 - halfHeight + y_off;
+    int right_adj = halfWidth + x_off;
+    int left_adj = w - 1 - halfWidth + x_off;
+
+    // The 4 symmetrical pixels share one lookup. With an odd size the center row/column maps
+    // onto itself (newX/newY is 0 and the left/right, up/down adjustments are equal).
+    for (int y = 0; y < ((h + 1) / 2); y++) {
+        uint32_t *row_ptr = m->map + (y * w);
+        uint32_t *row_ptr2 = m->map + ((h - 1 - y) * w);
+        int newY = y - halfHeight;
+        int newY2 = newY * newY;
+
+        for (int x = 0; x < ((w + 1) / 2); x++) {
+            int newX = x - halfWidth;
+            int newX2 = newX * newX;
+            float precalculated = precalculated_table[(int) fast_sqrtf(newX2 + newY2)];
+            float sourceY = precalculated * newY;
+            float sourceX = precalculated * newX;
+
+            row_ptr[x] = remap_pack(right_adj + sourceX, down_adj + sourceY, w, h);
+            row_ptr[w - 1 - x] = remap_pack(left_adj - sourceX, down_adj + sourceY, w, h);
+            row_ptr2[x] = remap_pack(right_adj + sourceX, up_adj - sourceY, w, h);
+            row_ptr2[w - 1 - x] = remap_pack(left_adj - sourceX, up_adj - sourceY, w, h);
+        }
+    }
+
+    fb_free(); // precalculated_table
+}
+
+// H maps destination pixels to source pixels.
+void imlib_remap_homography_int(remap_t *m, const float *H) {
+    int w = m->w, h = m->h;
+    bool affine = (fast_fabsf(H[6]) < 1e-6f) && (fast_fabsf(H[7]) < 1e-6f);
+
+    for (int y = 0; y < h; y++) {
+        uint32_t *row_ptr = m->map + (y * w);
+        float xxx = (H[1] * y) + H[2];
+        float yyy = (H[4] * y) + H[5];
+        float zzz = (H[7] * y) + H[8];
+
+        if (affine) {
+            // Constant steps along the row.
+            for (int x = 0; x < w; x++, xxx += H[0], yyy += H[3]) {
+                row_ptr[x] = remap_pack(xxx / zzz, yyy / zzz, w, h);
+            }
+        } else {
+            for (int x = 0; x < w; x++, xxx += H[0], yyy += H[3], zzz += H[6]) {
+                row_ptr[x] = remap_pack(xxx / zzz, yyy / zzz, w, h);
+            }
+        }
+    }
+}
+
+void imlib_remap_homography(remap_t *m, int w, int h, const float *H) {
+    if (!imlib_remap_prepare(m, REMAP_TYPE_HOMOGRAPHY, w, h, H, 9)) {
+        imlib_remap_homography_int(m, H);
+    }
+}
+
+// Unpacks a map entry for a plane subsampled by 2^shift, frac is 0..REMAP_ONE.
+#define REMAP_UNPACK(e, shift, sw, sh, x, y, fx, fy)                                    \
+    ({                                                                                  \
+        x = (e) >> 20;                                                                  \
+        y = ((e) >> 8) & 0xFFF;                                                         \
+        fx = ((e) >> 4) & (REMAP_ONE - 1);                                              \
+        fy = (e) & (REMAP_ONE - 1);                                                     \
+        if (shift) {                                                                    \
+            fx = ((x & 1) << (REMAP_FRAC_BITS - 1)) | (fx >> 1);                        \
+            fy = ((y & 1) << (REMAP_FRAC_BITS - 1)) | (fy >> 1);                        \
+            x >>= 1;                                                                    \
+            y >>= 1;                                                                    \
+        }                                                                               \
+        if (x >= ((sw) - 1)) {                                                          \
+            fx = 0;                                                                     \
+        }                                                                               \
+        if (y >= ((sh) - 1)) {                                                          \
+            fy = 0;                                                                     \
+        }                                                                               \
+    })
+
+// Row kernels for 8-bit channel planes (GRAYSCALE, RGB888, YUV420 Y and interleaved UV).
+#define REMAP_ROW_U8(name, ch)                                                                  \
+    static void name(uint8_t *dst, const uint8_t *src, int stride, int sw, int sh,             \
+                     const uint32_t *map, int shift, int n, bool bilinear, int fill) {         \
+        for (int i = 0; i < n; i++, dst += (ch)) {                                              \
+            uint32_t e = map[i << shift];                                                       \
+            int x, y, fx, fy;                                                                   \
+            if (e == REMAP_INVALID) {                                                           \
+                memset(dst, fill, (ch));                                                        \
+                continue;                                                                       \
+            }                                                                                   \
+            REMAP_UNPACK(e, shift, sw, sh, x, y, fx, fy);                                       \
+            if (!bilinear) {                                                                    \
+                x += fx >> (REMAP_FRAC_BITS - 1);                                               \
+                y += fy >> (REMAP_FRAC_BITS - 1);                                               \
+                const uint8_t *s = src + (y * stride) + (x * (ch));                             \
+                for (int c = 0; c < (ch); c++) {                                                \
+                    dst[c] = s[c];                                                              \
+                }                                                                               \
+            } else {                                                                            \
+                const uint8_t *s = src + (y * stride) + (x * (ch));                             \
+                int dx = fx ? (ch) : 0, dy = fy ? stride : 0;                                   \
+                int w00 = (REMAP_ONE - fx) * (REMAP_ONE - fy), w01 = fx * (REMAP_ONE - fy);     \
+                int w10 = (REMAP_ONE - fx) * fy, w11 = fx * fy;                                 \
+                for (int c = 0; c < (ch); c++) {                                                \
+                    dst[c] = ((s[c] * w00) + (s[c + dx] * w01) + (s[c + dy] * w10) +            \
+                              (s[c + dx + dy] * w11) + (REMAP_ONE * REMAP_ONE / 2))             \
+                             >> (REMAP_FRAC_BITS * 2);                                          \
+                }                                                                               \
+            }                                                                                   \
+        }                                                                                       \
+    }
+
+REMAP_ROW_U8(remap_row_u8x1, 1)
+REMAP_ROW_U8(remap_row_u8x2, 2)
+REMAP_ROW_U8(remap_row_u8x3, 3)
+
+#undef REMAP_ROW_U8
+
+typedef void (*remap_row_t) (uint8_t *dst, const uint8_t *src, int stride, int sw, int sh,
+                             const uint32_t *map, int shift, int n, bool bilinear, int fill);
+
+static void remap_row_rgb565(uint8_t *dst_row, const uint8_t *src_row, int stride, int sw, int sh,
+                             const uint32_t *map, int shift, int n, bool bilinear, int fill) {
+    uint16_t *dst = (uint16_t *) dst_row;
+
+    for (int i = 0; i < n; i++) {
+        uint32_t e = map[i];
+        int x, y, fx, fy;
+
+        if (e == REMAP_INVALID) {
+            dst[i] = 0;
+            continue;
+        }
+
+        REMAP_UNPACK(e, 0, sw, sh, x, y, fx, fy);
+
+        if (!bilinear) {
+            x += fx >> (REMAP_FRAC_BITS - 1);
+            y += fy >> (REMAP_FRAC_BITS - 1);
+            dst[i] = ((const uint16_t *) (src_row + (y * stride)))[x];
+        } else {
+            const uint16_t *s0 = (const uint16_t *) (src_row + (y * stride)) + x;
+            const uint16_t *s1 = (const uint16_t *) (((const uint8_t *) s0) + (fy ? stride : 0));
+            int dx = fx ? 1 : 0;
+            int w00 = (REMAP_ONE - fx) * (REMAP_ONE - fy), w01 = fx * (REMAP_ONE - fy);
+            int w10 = (REMAP_ONE - fx) * fy, w11 = fx * fy;
+            int p00 = s0[0], p01 = s0[dx], p10 = s1[0], p11 = s1[dx];
+            int r = ((COLOR_RGB565_TO_R5(p00) * w00) + (COLOR_RGB565_TO_R5(p01) * w01) +
+                     (COLOR_RGB565_TO_R5(p10) * w10) + (COLOR_RGB565_TO_R5(p11) * w11) + 128) >> 8;
+            int g = ((COLOR_RGB565_TO_G6(p00) * w00) + (COLOR_RGB565_TO_G6(p01) * w01) +
+                     (COLOR_RGB565_TO_G6(p10) * w10) + (COLOR_RGB565_TO_G6(p11) * w11) + 128) >> 8;
+            int b = ((COLOR_RGB565_TO_B5(p00) * w00) + (COLOR_RGB565_TO_B5(p01) * w01) +
+                     (COLOR_RGB565_TO_B5(p10) * w10) + (COLOR_RGB565_TO_B5(p11) * w11) + 128) >> 8;
+            dst[i] = COLOR_R5_G6_B5_TO_RGB565(r, g, b);
+        }
+    }
+}
+
+// Binary images are always sampled with the nearest neighbor.
+static void remap_row_binary(uint8_t *dst_row, const uint8_t *src_row, int stride, int sw, int sh,
+                             const uint32_t *map, int shift, int n, bool bilinear, int fill) {
+    uint32_t *dst = (uint32_t *) dst_row;
+
+    for (int i = 0; i < n; i++) {
+        uint32_t e = map[i];
+        int x, y, fx, fy;
+
+        if (e == REMAP_INVALID) {
+            IMAGE_CLEAR_BINARY_PIXEL_FAST(dst, i);
+            continue;
+        }
+
+        REMAP_UNPACK(e, 0, sw, sh, x, y, fx, fy);
+        x += fx >> (REMAP_FRAC_BITS - 1);
+        y += fy >> (REMAP_FRAC_BITS - 1);
+        const uint32_t *s = (const uint32_t *) (src_row + (y * stride));
+        IMAGE_PUT_BINARY_PIXEL_FAST(dst, i, IMAGE_GET_BINARY_PIXEL_FAST(s, x));
+    }
+}
+
+// Remaps one plane. The map is sampled at every 2^shift-th pixel for subsampled planes.
+static void remap_plane(remap_t *m, uint8_t *dst, const uint8_t *src, int w, int h, int stride, int bpp,
+                        int shift, remap_row_t kernel, bool bilinear, int fill) {
+    for (int ty = 0; ty < h; ty += REMAP_TILE_H) {
+        for (int tx = 0; tx < w; tx += REMAP_TILE_W) {
+            int n = IM_MIN(REMAP_TILE_W, w - tx);
+            for (int y = ty, yy = IM_MIN(ty + REMAP_TILE_H, h); y < yy; y++) {
+                const uint32_t *map = m->map + ((y << shift) * m->w) + (tx << shift);
+                kernel(dst + (y * stride) + (tx * bpp), src, stride, w, h, map, shift, n, bilinear, fill);
+            }
+        }
+    }
+}
+
+void imlib_remap(remap_t *m, image_t *dst, image_t *src, bool bilinear) {
+    if (!m->map) {
+        mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("Remap has not been compiled!"));
+    }
+
+    if ((src->w != m->w) || (src->h != m->h) || (dst->w != m->w) || (dst->h != m->h)) {
+        mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("Image size does not match the remap size!"));
+    }
+
+    if (src->pixfmt != dst->pixfmt) {
+        mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("Images must have the same format!"));
+    }
+
+    int w = m->w, h = m->h;
+
+    switch (src->pixfmt) {
+        case PIXFORMAT_BINARY: {
+            int stride = ((w + UINT32_T_MASK) >> UINT32_T_SHIFT) * sizeof(uint32_t);
+            for (int y = 0; y < h; y++) {
+                remap_row_binary(dst->data + (y * stride), src->data, stride, w, h,
+                                 m->map + (y * w), 0, w, false, 0);
+            }
+            break;
+        }
+        case PIXFORMAT_GRAYSCALE: {
+            remap_plane(m, dst->data, src->data, w, h, w, 1, 0, remap_row_u8x1, bilinear, 0);
+            break;
+        }
+        case PIXFORMAT_RGB565: {
+            remap_plane(m, dst->data, src->data, w, h, w * 2, 2, 0, remap_row_rgb565, bilinear, 0);
+            break;
+        }
+        case PIXFORMAT_RGB888: {
+            remap_plane(m, dst->data, src->data, w, h, w * 3, 3, 0, remap_row_u8x3, bilinear, 0);
+            break;
+        }
+        case PIXFORMAT_YUV420: {
+            // Y plane followed by the interleaved UV plane (2x2 subsampled), the chroma plane
+            // reuses the full resolution map and is filled with neutral chroma.
+            remap_plane(m, dst->data, src->data, w, h, w, 1, 0, remap_row_u8x1, bilinear, 0);
+            remap_plane(m, dst->data + (w * h), src->data + (w * h), w / 2, h / 2, w, 2, 1,
+                        remap_row_u8x2, bilinear, 128);
+            break;
+        }
+        default: {
+            mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("Unsupported image format!"));
+        }
+    }
+}
+#endif // IMLIB_ENABLE_REMAP
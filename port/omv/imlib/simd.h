@@ -0,0 +1,42 @@
+/*
+ * This file is part of the OpenMV project.
+ *
+ * Copyright (c) 2013-2021 Ibrahim Abdelkader <iabdalkader@openmv.io>
+ * Copyright (c) 2013-2021 Kwabena W. Agyeman <kwagyeman@openmv.io>
+ *
+ * This work is licensed under the MIT license, see the file LICENSE for details.
+ *
+ * Portable vector types for pixel kernels.
+ *
+ * These use the GCC vector extension, which the compiler lowers to the target's vector unit
+ * (RVV on the K230) when one is available and to plain scalar code otherwise. Kernels process
+ * VEC_LANES pixels per iteration and finish the row with a scalar tail loop.
+ */
+#ifndef __SIMD_H__
+#define __SIMD_H__
+#include <stdint.h>
+#include <string.h>
+
+#define VEC_LANES   (16)
+
+typedef uint8_t vec_u8_t __attribute__((vector_size(VEC_LANES)));
+typedef int16_t vec_s16_t __attribute__((vector_size(VEC_LANES * 2)));
+typedef uint16_t vec_u16_t __attribute__((vector_size(VEC_LANES * 2)));
+typedef int32_t vec_s32_t __attribute__((vector_size(VEC_LANES * 4)));
+typedef uint32_t vec_u32_t __attribute__((vector_size(VEC_LANES * 4)));
+typedef float vec_f32_t __attribute__((vector_size(VEC_LANES * 4)));
+
+// Unaligned loads/stores, memcpy compiles down to a single vector load/store. These are macros
+// rather than functions so that vector values never cross a call boundary (psABI).
+#define VEC_LOAD(type, p)   ({ type _v; memcpy(&_v, (p), sizeof(_v)); _v; })
+#define VEC_STORE(p, v)     ({ __typeof__ (v) _v = (v); memcpy((p), &_v, sizeof(_v)); })
+
+// Widen/narrow between 8-bit and 16-bit lanes (narrowing truncates, saturate first if needed).
+#define VEC_U8_TO_U16(v)    __builtin_convertvector((v), vec_u16_t)
+#define VEC_U16_TO_U8(v)    __builtin_convertvector((v), vec_u8_t)
+#define VEC_U8_TO_S16(v)    __builtin_convertvector((v), vec_s16_t)
+#define VEC_S16_TO_U8(v)    __builtin_convertvector((v), vec_u8_t)
+#define VEC_U16_TO_U32(v)   __builtin_convertvector((v), vec_u32_t)
+#define VEC_U32_TO_U16(v)   __builtin_convertvector((v), vec_u16_t)
+
+#endif // __SIMD_H__
@@ -7,231 +7,321 @@
  * This work is licensed under the MIT license, see the file LICENSE for details.
  *
  * Stero Image Disparity
+ *
+ * Semi-global matching on census transforms. Matching costs are the hamming distances between
+ * 5x5 census codes and are aggregated along the 4 paths that reach a pixel from the previous
+ * pixel and the previous row (left, top-left, top and top-right), so the image is processed in a
+ * single top-down pass holding only two rows of path costs. Each row runs the disparity range
+ * as vectors of VEC_LANES costs.
  */
 #include "imlib.h"
+#include "simd.h"
 
 #ifdef IMLIB_ENABLE_STEREO_DISPARITY
 
-#define BLOCK_W       4
-#define BLOCK_H       4
-
-#define BLOCK_W_L     (((BLOCK_W) / 2) - 1)
-#define BLOCK_W_R     ((BLOCK_W) / 2)
-#define BLOCK_H_U     (((BLOCK_H) / 2) - 1)
-#define BLOCK_H_D     ((BLOCK_H) / 2)
-
-#define BLOCK_SIZE    ((BLOCK_W) *(BLOCK_H))
-
-static inline void shift(uint8_t *data, image_t *img, int x, int y) {
-#if (defined(ARM_MATH_CM7) || defined(ARM_MATH_CM4)) && (!(BLOCK_SIZE % 4))
-    int x_2 = x + BLOCK_W_R;
-    uint32_t *data_32 = (uint32_t *) data;
-
-    #if BLOCK_SIZE == 4
-    uint32_t temp = __UXTB16_RORn(*data_32, 8);
-    temp |= IMAGE_GET_GRAYSCALE_PIXEL(img, x_2, y) << 8;
-    temp |= IMAGE_GET_GRAYSCALE_PIXEL(img, x_2, y + 1) << 24;
-    *data_32 = temp;
-    #elif BLOCK_SIZE == 16
-    data_32[0] = (data_32[0] >> 8) | (IMAGE_GET_GRAYSCALE_PIXEL(img, x_2, y - 1) << 24);
-    data_32[1] = (data_32[1] >> 8) | (IMAGE_GET_GRAYSCALE_PIXEL(img, x_2, y) << 24);
-    data_32[2] = (data_32[2] >> 8) | (IMAGE_GET_GRAYSCALE_PIXEL(img, x_2, y + 1) << 24);
-    data_32[3] = (data_32[3] >> 8) | (IMAGE_GET_GRAYSCALE_PIXEL(img, x_2, y + 2) << 24);
-    #elif BLOCK_SIZE == 64
-    data_32[0] = (data_32[0] >> 8) | (data_32[1] << 24);
-    data_32[1] = (data_32[1] >> 8) | (IMAGE_GET_GRAYSCALE_PIXEL(img, x_2, y - 3) << 24);
-    data_32[2] = (data_32[2] >> 8) | (data_32[3] << 24);
-    data_32[3] = (data_32[3] >> 8) | (IMAGE_GET_GRAYSCALE_PIXEL(img, x_2, y - 2) << 24);
-    data_32[4] = (data_32[4] >> 8) | (data_32[5] << 24);
-    data_32[5] = (data_32[5] >> 8) | (IMAGE_GET_GRAYSCALE_PIXEL(img, x_2, y - 1) << 24);
-    data_32[6] = (data_32[6] >> 8) | (data_32[7] << 24);
-    data_32[7] = (data_32[7] >> 8) | (IMAGE_GET_GRAYSCALE_PIXEL(img, x_2, y) << 24);
-    data_32[8] = (data_32[8] >> 8) | (data_32[9] << 24);
-    data_32[9] = (data_32[9] >> 8) | (IMAGE_GET_GRAYSCALE_PIXEL(img, x_2, y + 1) << 24);
-    data_32[10] = (data_32[10] >> 8) | (data_32[11] << 24);
-    data_32[11] = (data_32[11] >> 8) | (IMAGE_GET_GRAYSCALE_PIXEL(img, x_2, y + 2) << 24);
-    data_32[12] = (data_32[12] >> 8) | (data_32[13] << 24);
-    data_32[13] = (data_32[13] >> 8) | (IMAGE_GET_GRAYSCALE_PIXEL(img, x_2, y + 3) << 24);
-    data_32[14] = (data_32[14] >> 8) | (data_32[15] << 24);
-    data_32[15] = (data_32[15] >> 8) | (IMAGE_GET_GRAYSCALE_PIXEL(img, x_2, y + 4) << 24);
-    #else
-    for (int j = -BLOCK_H_U, last = (BLOCK_W / sizeof(uint32_t)) - 1; j <= BLOCK_H_D; j++, data_32 += last + 1) {
-        for (int i = 0; i < last; i++) {
-            data_32[i] = (data_32[i] >> 8) | (data_32[i + 1] << 24);
+#define STEREO_CENSUS_BITS  (24)        // 5x5 window without the center pixel.
+#define STEREO_PAD          (0x3FFF)    // Path cost outside of the disparity range.
+#define STEREO_PATHS        (3)         // Paths coming from the previous row.
+
+#define VEC_MIN_U16(a, b)   ({ vec_u16_t _a = (a), _b = (b); vec_u16_t _m = (vec_u16_t) (_a < _b); (_a & _m) | (_b & ~_m); })
+
+typedef struct stereo_path {
+    uint16_t *prev, *cur;           // w + 2 pixels of d_len + 2 costs, first and last pixel are zero.
+    uint16_t *prev_min, *cur_min;   // w + 2 minimums.
+} stereo_path_t;
+
+static void stereo_luma(uint8_t *dst, image_t *img, rectangle_t *roi) {
+    for (int y = 0; y < roi->h; y++, dst += roi->w) {
+        switch (img->pixfmt) {
+            case PIXFORMAT_BINARY: {
+                uint32_t *row_ptr = IMAGE_COMPUTE_BINARY_PIXEL_ROW_PTR(img, roi->y + y);
+                for (int x = 0; x < roi->w; x++) {
+                    dst[x] = COLOR_BINARY_TO_GRAYSCALE(IMAGE_GET_BINARY_PIXEL_FAST(row_ptr, roi->x + x));
+                }
+                break;
+            }
+            case PIXFORMAT_GRAYSCALE: {
+                memcpy(dst, IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, roi->y + y) + roi->x, roi->w);
+                break;
+            }
+            case PIXFORMAT_RGB565: {
+                uint16_t *row_ptr = IMAGE_COMPUTE_RGB565_PIXEL_ROW_PTR(img, roi->y + y) + roi->x;
+                for (int x = 0; x < roi->w; x++) {
+                    dst[x] = COLOR_RGB565_TO_Y(row_ptr[x]);
+                }
+                break;
+            }
+            default: {
+                memset(dst, 0, roi->w);
+                break;
+            }
         }
-        data_32[last] = (data_32[last] >> 8) | (IMAGE_GET_GRAYSCALE_PIXEL(img, x_2, y + j) << 24);
     }
-    #endif
-#else
-    for (int i = 0, j = -BLOCK_H_U; j <= BLOCK_H_D; j++) {
-        int y_p = y + j;
-        uint8_t *k_row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y_p);
-        for (int k = -BLOCK_W_L; k <= BLOCK_W_R; k++) {
-            int x_p = x + k;
-            data[i++] = IMAGE_GET_GRAYSCALE_PIXEL_FAST(k_row_ptr, x_p);
+}
+
+// 5x5 census transform of row y, clamped at the borders.
+static void stereo_census(uint32_t *dst, const uint8_t *luma, int w, int h, int y) {
+    const uint8_t *rows[5];
+
+    for (int j = 0; j < 5; j++) {
+        rows[j] = luma + (IM_MIN(IM_MAX(y + j - 2, 0), h - 1) * w);
+    }
+
+    for (int x = 0; x < w; x++) {
+        int c = rows[2][x];
+        uint32_t bits = 0;
+
+        if ((x >= 2) && (x < (w - 2))) {
+            for (int j = 0; j < 5; j++) {
+                const uint8_t *p = rows[j] + x - 2;
+                bits = (bits << 1) | (p[0] < c);
+                bits = (bits << 1) | (p[1] < c);
+                if (j != 2) {
+                    bits = (bits << 1) | (p[2] < c);
+                }
+                bits = (bits << 1) | (p[3] < c);
+                bits = (bits << 1) | (p[4] < c);
+            }
+        } else {
+            for (int j = 0; j < 5; j++) {
+                for (int i = -2; i <= 2; i++) {
+                    if ((j != 2) || i) {
+                        bits = (bits << 1) | (rows[j][IM_MIN(IM_MAX(x + i, 0), w - 1)] < c);
+                    }
+                }
+            }
         }
+
+        dst[x] = bits;
     }
-#endif
 }
 
-static inline uint32_t sad(uint8_t *data_l, uint8_t *data_r) {
-    uint32_t diff = 0;
-
-#if (defined(ARM_MATH_CM7) || defined(ARM_MATH_CM4)) && (!(BLOCK_SIZE % 4))
-    uint32_t *data_l_32 = (uint32_t *) data_l;
-    uint32_t *data_r_32 = (uint32_t *) data_r;
-
-    #if BLOCK_SIZE == 4
-    diff = __USADA8(*data_l_32, *data_r_32, diff);
-    #elif BLOCK_SIZE == 16
-    diff = __USADA8(data_l_32[0], data_r_32[0], diff);
-    diff = __USADA8(data_l_32[1], data_r_32[1], diff);
-    diff = __USADA8(data_l_32[2], data_r_32[2], diff);
-    diff = __USADA8(data_l_32[3], data_r_32[3], diff);
-    #elif BLOCK_SIZE == 64
-    diff = __USADA8(data_l_32[0],  data_r_32[0],  diff);
-    diff = __USADA8(data_l_32[1],  data_r_32[1],  diff);
-    diff = __USADA8(data_l_32[2],  data_r_32[2],  diff);
-    diff = __USADA8(data_l_32[3],  data_r_32[3],  diff);
-    diff = __USADA8(data_l_32[4],  data_r_32[4],  diff);
-    diff = __USADA8(data_l_32[5],  data_r_32[5],  diff);
-    diff = __USADA8(data_l_32[6],  data_r_32[6],  diff);
-    diff = __USADA8(data_l_32[7],  data_r_32[7],  diff);
-    diff = __USADA8(data_l_32[8],  data_r_32[8],  diff);
-    diff = __USADA8(data_l_32[9],  data_r_32[9],  diff);
-    diff = __USADA8(data_l_32[10], data_r_32[10], diff);
-    diff = __USADA8(data_l_32[11], data_r_32[11], diff);
-    diff = __USADA8(data_l_32[12], data_r_32[12], diff);
-    diff = __USADA8(data_l_32[13], data_r_32[13], diff);
-    diff = __USADA8(data_l_32[14], data_r_32[14], diff);
-    diff = __USADA8(data_l_32[15], data_r_32[15], diff);
-    #else
-    for (int i = 0; i < (BLOCK_SIZE / sizeof(uint32_t)); i++) {
-        diff = __USADA8(data_l_32[i], data_r_32[i], diff);
+// L(p, d) = C(p, d) + min(L(p - r, d), L(p - r, d +- 1) + p1, min(L(p - r)) + p2) - min(L(p - r))
+static inline uint16_t stereo_path_step(uint16_t *out, const uint16_t *prev, uint16_t prev_min,
+                                        const uint16_t *cost, int d_len, uint16_t p1, uint16_t p2) {
+    uint16_t jump = prev_min + p2;
+    vec_u16_t min = {0};
+    min += (uint16_t) STEREO_PAD;
+
+    for (int d = 0; d < d_len; d += VEC_LANES) {
+        vec_u16_t l = VEC_LOAD(vec_u16_t, prev + d);
+        vec_u16_t l_m = VEC_LOAD(vec_u16_t, prev + d - 1) + p1;
+        vec_u16_t l_p = VEC_LOAD(vec_u16_t, prev + d + 1) + p1;
+        vec_u16_t l_j = (l * 0) + jump;
+        vec_u16_t v = VEC_MIN_U16(VEC_MIN_U16(l, l_m), VEC_MIN_U16(l_p, l_j));
+        v += VEC_LOAD(vec_u16_t, cost + d) - prev_min;
+        VEC_STORE(out + d, v);
+        min = VEC_MIN_U16(min, v);
     }
-    #endif
-#else
-    for (int i = 0; i < BLOCK_SIZE; i++) {
-        int d = data_l[i] - data_r[i];
-        diff += abs(d);
+
+    uint16_t m = min[0];
+    for (int i = 1; i < VEC_LANES; i++) {
+        m = IM_MIN(m, min[i]);
     }
-#endif
 
-    return diff;
+    return m;
 }
 
-void imlib_stereo_disparity(image_t *img, bool reversed, int max_disparity, int threshold) {
-    int width_2 = img->w / 2, width_2_m_1 = width_2 - 1;
-    int height_1 = img->h, height_1_m_1 = height_1 - 1;
+void imlib_stereo_sgm(uint16_t *out, image_t *left, rectangle_t *roi_l, image_t *right, rectangle_t *roi_r,
+                      stereo_settings_t *settings) {
+    int w = roi_l->w, h = roi_l->h;
+    int max_d = IM_MIN(settings->max_disparity, w - 1);
+    int d_len = ((max_d + VEC_LANES) / VEC_LANES) * VEC_LANES;
+    int d_pitch = d_len + 2;
+    int p1 = settings->p1, p2 = settings->p2;
+
+    uint8_t *luma_l = fb_alloc(w * h, FB_ALLOC_NO_HINT);
+    uint8_t *luma_r = fb_alloc(w * h, FB_ALLOC_NO_HINT);
+    stereo_luma(luma_l, left, roi_l);
+    stereo_luma(luma_r, right, roi_r);
+
+    uint32_t *census_l = fb_alloc(w * sizeof(uint32_t), FB_ALLOC_NO_HINT);
+    uint32_t *census_r = fb_alloc(w * sizeof(uint32_t), FB_ALLOC_NO_HINT);
+    // Reversed right census so that census_r[x - d] is census_rev[(w - 1 - x) + d], ascending in d.
+    uint32_t *census_rev = fb_alloc0((w + d_len) * sizeof(uint32_t), FB_ALLOC_NO_HINT);
+    uint16_t *cost = fb_alloc(d_len * sizeof(uint16_t), FB_ALLOC_NO_HINT);
+    uint16_t *sum = fb_alloc(w * d_len * sizeof(uint16_t), FB_ALLOC_NO_HINT);
+    uint16_t *row_d = fb_alloc(w * sizeof(uint16_t), FB_ALLOC_NO_HINT);
+    uint16_t *row_d_r = fb_alloc(w * sizeof(uint16_t), FB_ALLOC_NO_HINT);
+
+    // Path costs, the left path only needs the previous pixel.
+    uint16_t *left_prev = (uint16_t *) fb_alloc0(d_pitch * 2 * sizeof(uint16_t), FB_ALLOC_NO_HINT) + 1;
+    uint16_t *left_cur = left_prev + d_pitch;
+    left_prev[-1] = left_prev[d_len] = left_cur[-1] = left_cur[d_len] = STEREO_PAD;
 
-    int xl_offset = 0;
-    int xr_offset = width_2;
+    stereo_path_t paths[STEREO_PATHS];
+    for (int i = 0; i < STEREO_PATHS; i++) {
+        paths[i].prev = (uint16_t *) fb_alloc0((w + 2) * d_pitch * sizeof(uint16_t), FB_ALLOC_NO_HINT) + 1;
+        paths[i].cur = (uint16_t *) fb_alloc0((w + 2) * d_pitch * sizeof(uint16_t), FB_ALLOC_NO_HINT) + 1;
+        paths[i].prev_min = fb_alloc0((w + 2) * sizeof(uint16_t), FB_ALLOC_NO_HINT);
+        paths[i].cur_min = fb_alloc0((w + 2) * sizeof(uint16_t), FB_ALLOC_NO_HINT);
 
-    if (reversed) {
-        xl_offset = xr_offset;
-        xr_offset = 0;
+        for (int x = 0; x < (w + 2); x++) {
+            paths[i].prev[(x * d_pitch) - 1] = paths[i].prev[(x * d_pitch) + d_len] = STEREO_PAD;
+            paths[i].cur[(x * d_pitch) - 1] = paths[i].cur[(x * d_pitch) + d_len] = STEREO_PAD;
+        }
     }
 
-    float disparity_scale = COLOR_GRAYSCALE_MAX / max_disparity;
+    for (int y = 0; y < h; y++) {
+        stereo_census(census_l, luma_l, w, h, y);
+        stereo_census(census_r, luma_r, w, h, y);
+
+        for (int x = 0; x < w; x++) {
+            census_rev[w - 1 - x] = census_r[x];
+        }
+
+        memset(left_prev, 0, d_len * sizeof(uint16_t));
+        int left_min = 0;
+
+        for (int x = 0; x < w; x++) {
+            // Hamming distances to every disparity (SWAR popcount).
+            uint32_t *r = census_rev + (w - 1 - x);
+
+            for (int d = 0; d < d_len; d += VEC_LANES) {
+                vec_u32_t v = VEC_LOAD(vec_u32_t, r + d) ^ census_l[x];
+                v = v - ((v >> 1) & 0x55555555);
+                v = (v & 0x33333333) + ((v >> 2) & 0x33333333);
+                v = (v + (v >> 4)) & 0x0F0F0F0F;
+                v = (v * 0x01010101) >> 24;
+                VEC_STORE(cost + d, VEC_U32_TO_U16(v));
+            }
 
-    image_t buf;
-    buf.w = width_2;
-    buf.h = BLOCK_H_D;
-    buf.pixfmt = img->pixfmt;
+            // Disparities past the image border or max_disparity get the worst cost.
+            for (int d = IM_MIN(x, max_d) + 1; d < d_len; d++) {
+                cost[d] = STEREO_CENSUS_BITS;
+            }
+
+            left_min = stereo_path_step(left_cur, left_prev, left_min, cost, d_len, p1, p2);
+            uint16_t *tmp = left_prev;
+            left_prev = left_cur;
+            left_cur = tmp;
+
+            uint16_t *s = sum + (x * d_len);
+            memcpy(s, left_prev, d_len * sizeof(uint16_t));
 
-    switch (img->pixfmt) {
-        case PIXFORMAT_BINARY: {
-            break;
+            // Top-left, top and top-right paths read pixels x - 1, x and x + 1 of the previous row.
+            for (int i = 0; i < STEREO_PATHS; i++) {
+                stereo_path_t *path = paths + i;
+                int src = x + i; // Pixel x is at slot x + 1.
+                uint16_t *dst = path->cur + ((x + 1) * d_pitch);
+                path->cur_min[x + 1] = stereo_path_step(dst, path->prev + (src * d_pitch), path->prev_min[src],
+                                                        cost, d_len, p1, p2);
+
+                for (int d = 0; d < d_len; d += VEC_LANES) {
+                    VEC_STORE(s + d, VEC_LOAD(vec_u16_t, s + d) + VEC_LOAD(vec_u16_t, dst + d));
+                }
+            }
         }
-        case PIXFORMAT_GRAYSCALE: {
-            buf.data = fb_alloc(IMAGE_GRAYSCALE_LINE_LEN_BYTES(&buf) * BLOCK_H_D, FB_ALLOC_NO_HINT);
-            uint8_t *data_l = fb_alloc(BLOCK_SIZE, FB_ALLOC_NO_HINT);
-            uint8_t *data_r = fb_alloc(BLOCK_SIZE, FB_ALLOC_NO_HINT);
-
-            for (int y = 0, yy = height_1 - BLOCK_H_D; y < height_1; y++) {
-                for (int xl = 0, xx = width_2 - BLOCK_W_R; xl < width_2; xl++) {
-                    if ((xl >= BLOCK_W_L) && (xl < xx) && (y >= BLOCK_H_U) && (y < yy)) {
-                        // fast way
-                        shift(data_l, img, xl + xl_offset, y);
-                    } else {
-                        // slow way
-                        for (int i = 0, j = -BLOCK_H_U; j <= BLOCK_H_D; j++) {
-                            int y_p = y + j;
-                            int y = IM_MIN(IM_MAX(y_p, 0), height_1_m_1);
-                            uint8_t *k_row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y);
-                            for (int k = -BLOCK_W_L; k <= BLOCK_W_R; k++) {
-                                int x_p = xl + k;
-                                int x = IM_MIN(IM_MAX(x_p, 0), width_2_m_1) + xl_offset;
-                                data_l[i++] = IMAGE_GET_GRAYSCALE_PIXEL_FAST(k_row_ptr, x);
-                            }
-                        }
-                    }
 
-                    uint32_t min_diff = UINT32_MAX;
-                    int min_disparity = 0;
-
-                    for (int xr = xl, disparity = 0;
-                         (xr < width_2) && (disparity <= max_disparity); xr++, disparity++) {
-                        if (disparity && (xr >= BLOCK_W_L) && (xr < xx) && (y >= BLOCK_H_U) && (y < yy)) {
-                            // fast way
-                            shift(data_r, img, xr + xr_offset, y);
-                        } else {
-                            // slow way
-                            for (int i = 0, j = -BLOCK_H_U; j <= BLOCK_H_D; j++) {
-                                int y_p = y + j;
-                                int y = IM_MIN(IM_MAX(y_p, 0), height_1_m_1);
-                                uint8_t *k_row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y);
-                                for (int k = -BLOCK_W_L; k <= BLOCK_W_R; k++) {
-                                    int x_p = xr + k;
-                                    int x = IM_MIN(IM_MAX(x_p, 0), width_2_m_1) + xr_offset;
-                                    data_r[i++] = IMAGE_GET_GRAYSCALE_PIXEL_FAST(k_row_ptr, x);
-                                }
-                            }
-                        }
-
-                        // Record the closest matching block in the scan line.
-                        uint32_t diff = sad(data_l, data_r);
-                        if (diff < min_diff) {
-                            min_diff = diff;
-                            min_disparity = disparity;
-                        }
-
-                        if (min_diff <= threshold) {
-                            break;
-                        }
-                    }
+        for (int i = 0; i < STEREO_PATHS; i++) {
+            uint16_t *tmp = paths[i].prev;
+            paths[i].prev = paths[i].cur;
+            paths[i].cur = tmp;
+            tmp = paths[i].prev_min;
+            paths[i].prev_min = paths[i].cur_min;
+            paths[i].cur_min = tmp;
+        }
 
-                    uint8_t *buf_row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(&buf, (y % BLOCK_H_D));
-                    IMAGE_PUT_GRAYSCALE_PIXEL_FAST(buf_row_ptr, xl, fast_floorf(min_disparity * disparity_scale));
+        // Winner takes all.
+        uint16_t *out_row = out + (y * w);
+
+        for (int x = 0; x < w; x++) {
+            uint16_t *s = sum + (x * d_len);
+            int best = 0;
+
+            for (int d = 1, dd = IM_MIN(x, max_d); d <= dd; d++) {
+                if (s[d] < s[best]) {
+                    best = d;
                 }
+            }
 
-                if (y >= BLOCK_H_U) {
-                    // Transfer buffer lines...
-                    memcpy(IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, (y - BLOCK_H_U)) + xr_offset,
-                           IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(&buf, ((y - BLOCK_H_U) % BLOCK_H_D)),
-                           IMAGE_GRAYSCALE_LINE_LEN_BYTES(&buf));
+            row_d[x] = best;
+            out_row[x] = best << STEREO_SUBPIXEL_BITS;
+
+            // Parabola through the neighboring costs.
+            if (settings->subpixel && (best > 0) && (best < IM_MIN(x, max_d))) {
+                int a = s[best - 1], b = s[best], c = s[best + 1];
+                int den = a + c - (2 * b);
+                if (den > 0) {
+                    out_row[x] += (((a - c) << STEREO_SUBPIXEL_BITS) + den) / (2 * den);
                 }
             }
+        }
+
+        // The right image disparities come from the same costs: pixel x of the right image matched
+        // pixel x + d of the left image.
+        if (settings->lr_max_diff >= 0) {
+            for (int x = 0; x < w; x++) {
+                int best = 0;
+
+                for (int d = 1, dd = IM_MIN(w - 1 - x, max_d); d <= dd; d++) {
+                    if (sum[((x + d) * d_len) + d] < sum[((x + best) * d_len) + best]) {
+                        best = d;
+                    }
+                }
 
-            // Copy any remaining lines from the buffer image...
-            for (int y = IM_MAX(height_1 - BLOCK_H_U, 0); y < height_1; y++) {
-                memcpy(IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y) + xr_offset,
-                       IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(&buf, (y % BLOCK_H_D)),
-                       IMAGE_GRAYSCALE_LINE_LEN_BYTES(&buf));
+                row_d_r[x] = best;
             }
 
-            fb_free(); // data_r
-            fb_free(); // data_l
-            fb_free(); // buf
-            break;
-        }
-        case PIXFORMAT_RGB565: {
-            break;
+            for (int x = 0; x < w; x++) {
+                if (abs(row_d[x] - row_d_r[x - row_d[x]]) > settings->lr_max_diff) {
+                    out_row[x] = STEREO_INVALID;
+                }
+            }
         }
-        default: {
-            break;
+    }
+
+    for (int i = 0; i < (STEREO_PATHS * 4); i++) {
+        fb_free();
+    }
+
+    fb_free(); // left_prev
+    fb_free(); // row_d_r
+    fb_free(); // row_d
+    fb_free(); // sum
+    fb_free(); // cost
+    fb_free(); // census_rev
+    fb_free(); // census_r
+    fb_free(); // census_l
+    fb_free(); // luma_r
+    fb_free(); // luma_l
+}
+
+// Writes an 8-bit disparity map over the half of the side by side image being matched against.
+void imlib_stereo_disparity(image_t *img, bool reversed, int max_disparity) {
+    int width_2 = img->w / 2;
+    int xl_offset = reversed ? width_2 : 0;
+    int xr_offset = reversed ? 0 : width_2;
+
+    // Pixels at xl of the first half match pixels at xl + d of the second half, which is the
+    // usual left/right relationship with the halves swapped.
+    rectangle_t roi_l = { xr_offset, 0, width_2, img->h };
+    rectangle_t roi_r = { xl_offset, 0, width_2, img->h };
+
+    stereo_settings_t settings = {
+        .max_disparity = max_disparity,
+        .p1 = STEREO_DEFAULT_P1,
+        .p2 = STEREO_DEFAULT_P2,
+        .lr_max_diff = -1,
+        .subpixel = false
+    };
+
+    uint16_t *disparity = fb_alloc(width_2 * img->h * sizeof(uint16_t), FB_ALLOC_NO_HINT);
+    imlib_stereo_sgm(disparity, img, &roi_l, img, &roi_r, &settings);
+
+    float disparity_scale = COLOR_GRAYSCALE_MAX / max_disparity;
+
+    for (int y = 0; y < img->h; y++) {
+        uint8_t *row_ptr = IMAGE_COMPUTE_GRAYSCALE_PIXEL_ROW_PTR(img, y) + xr_offset;
+        uint16_t *disparity_row = disparity + (y * width_2);
+
+        for (int x = 0; x < width_2; x++) {
+            int d = disparity_row[x] >> STEREO_SUBPIXEL_BITS;
+            row_ptr[x] = fast_floorf(IM_MIN(d, max_disparity) * disparity_scale);
         }
     }
+
+    fb_free(); // disparity
 }
 
 #endif // IMLIB_ENABLE_STEREO_DISPARITY
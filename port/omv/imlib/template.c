@@ -276,3 +276,74 @@ float imlib_template_match_ex(image_t *f, image_t *t, rectangle_t *roi, int step
     imlib_integral_image_free(&sumsq);
     return corr;
 }
+
+#ifdef IMLIB_ENABLE_PYRAMID
+#define PYRAMID_TEMPLATE_MIN_SIZE   (8)
+
+// Coarse-to-fine search, exhaustive on the coarsest usable pyramid level and refined at full
+// resolution around the coarse match.
+float imlib_template_match_pyramid(pyramid_t *pyr, image_t *t, rectangle_t *roi, int step, rectangle_t *r) {
+    int level = 0;
+
+    // Pick the coarsest level where the template keeps enough detail to match.
+    for (int i = 1; i < pyr->n_levels; i++) {
+        if (((t->w / pyr->levels[i].x_scale) < PYRAMID_TEMPLATE_MIN_SIZE)
+            || ((t->h / pyr->levels[i].y_scale) < PYRAMID_TEMPLATE_MIN_SIZE)) {
+            break;
+        }
+        level = i;
+    }
+
+    if (level == 0) {
+        return imlib_template_match_ex(imlib_pyramid_level(pyr, 0), t, roi, step, r);
+    }
+
+    float x_scale = pyr->levels[level].x_scale;
+    float y_scale = pyr->levels[level].y_scale;
+    image_t *f = imlib_pyramid_level(pyr, level);
+
+    image_t t_scaled = {
+        .w = fast_roundf(t->w / x_scale),
+        .h = fast_roundf(t->h / y_scale),
+        .pixfmt = PIXFORMAT_GRAYSCALE,
+    };
+    t_scaled.data = fb_alloc(t_scaled.w * t_scaled.h, FB_ALLOC_NO_HINT);
+    imlib_area_scale(t, &t_scaled);
+
+    rectangle_t roi_scaled = {
+        .x = fast_roundf(roi->x / x_scale),
+        .y = fast_roundf(roi->y / y_scale),
+        .w = fast_roundf(roi->w / x_scale),
+        .h = fast_roundf(roi->h / y_scale)
+    };
+    roi_scaled.w = IM_MIN(roi_scaled.w, f->w - roi_scaled.x);
+    roi_scaled.h = IM_MIN(roi_scaled.h, f->h - roi_scaled.y);
+
+    rectangle_t r_scaled;
+    float corr = 0.0f;
+
+    if ((roi_scaled.w >= t_scaled.w) && (roi_scaled.h >= t_scaled.h)) {
+        corr = imlib_template_match_ex(f, &t_scaled, &roi_scaled, 1, &r_scaled);
+    }
+
+    fb_free(); // t_scaled
+
+    if (corr <= 0.0f) {
+        return imlib_template_match_ex(imlib_pyramid_level(pyr, 0), t, roi, step, r);
+    }
+
+    // Refine within one coarse pixel (plus rounding) of the coarse match.
+    int x_margin = fast_ceilf(x_scale) + 1;
+    int y_margin = fast_ceilf(y_scale) + 1;
+    int x = IM_MAX(fast_roundf(r_scaled.x * x_scale) - x_margin, roi->x);
+    int y = IM_MAX(fast_roundf(r_scaled.y * y_scale) - y_margin, roi->y);
+    rectangle_t roi_fine = {
+        .x = x,
+        .y = y,
+        .w = IM_MIN(t->w + (x_margin * 2), roi->x + roi->w - x),
+        .h = IM_MIN(t->h + (y_margin * 2), roi->y + roi->h - y)
+    };
+
+    return imlib_template_match_ex(imlib_pyramid_level(pyr, 0), t, &roi_fine, 1, r);
+}
+#endif // IMLIB_ENABLE_PYRAMID
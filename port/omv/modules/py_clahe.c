@@ -0,0 +1,123 @@
+/*
+ * This file is part of the OpenMV project.
+ *
+ * Copyright (c) 2013-2021 Ibrahim Abdelkader <iabdalkader@openmv.io>
+ * Copyright (c) 2013-2021 Kwabena W. Agyeman <kwagyeman@openmv.io>
+ *
+ * This work is licensed under the MIT license, see the file LICENSE for details.
+ *
+ * CLAHE Python module.
+ */
+#include "imlib_config.h"
+#if defined(IMLIB_ENABLE_CLAHE)
+
+#include "py/obj.h"
+#include "py/nlr.h"
+#include "py/runtime.h"
+
+#include "py_assert.h"
+#include "py_helper.h"
+#include "py_image.h"
+#include "py_clahe.h"
+
+typedef struct py_clahe_obj {
+    mp_obj_base_t base;
+    clahe_t _cobj;
+} py_clahe_obj_t;
+
+clahe_t *py_clahe_cobj(mp_obj_t obj) {
+    PY_ASSERT_TYPE(obj, &py_clahe_type);
+    return &((py_clahe_obj_t *) MP_OBJ_TO_PTR(obj))->_cobj;
+}
+
+// Returns the "clahe" keyword argument if set.
+clahe_t *py_helper_keyword_clahe(uint n_args, const mp_obj_t *args, uint arg_index, mp_map_t *kw_args) {
+    mp_obj_t obj = py_helper_keyword_object(n_args, args, arg_index, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_clahe), NULL);
+
+    if (obj == NULL || obj == mp_const_none) {
+        return NULL;
+    }
+
+    return py_clahe_cobj(obj);
+}
+
+STATIC void py_clahe_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind) {
+    clahe_t *clahe = py_clahe_cobj(self_in);
+    mp_printf(print, "{\"clip_limit\":%f, \"tiles\":(%d, %d), \"blend\":%f, \"tiles_per_frame\":%d}",
+              (double) clahe->clip_limit,
+              clahe->luts ? clahe->nx : clahe->tiles_x,
+              clahe->luts ? clahe->ny : clahe->tiles_y,
+              (double) (clahe->blend / 256.0f),
+              clahe->tiles_per_frame);
+}
+
+// Forgets the previous frames (e.g. on a scene change), the next frame recomputes every tile.
+STATIC mp_obj_t py_clahe_reset(mp_obj_t self_in) {
+    clahe_t *clahe = py_clahe_cobj(self_in);
+    clahe->primed = false;
+    clahe->next_tile = 0;
+    return self_in;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_clahe_reset_obj, py_clahe_reset);
+
+STATIC mp_obj_t py_clahe_free(mp_obj_t self_in) {
+    imlib_clahe_free(py_clahe_cobj(self_in));
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_clahe_free_obj, py_clahe_free);
+
+STATIC mp_obj_t py_clahe_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *args) {
+    mp_arg_check_num(n_args, n_kw, 0, 4, true);
+
+    mp_map_t kw_args;
+    mp_map_init_fixed_table(&kw_args, n_kw, args + n_args);
+
+    float clip_limit =
+        py_helper_keyword_float(n_args, args, 0, &kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_clip_limit), -1);
+    mp_obj_t tiles_obj =
+        py_helper_keyword_object(n_args, args, 1, &kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_tiles), NULL);
+    float blend =
+        py_helper_keyword_float(n_args, args, 2, &kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_blend), 1.0f);
+    PY_ASSERT_TRUE_MSG((blend > 0.0f) && (blend <= 1.0f), "0 < blend <= 1!");
+    int tiles_per_frame =
+        py_helper_keyword_int(n_args, args, 3, &kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_tiles_per_frame), 0);
+    PY_ASSERT_TRUE_MSG(tiles_per_frame >= 0, "tiles_per_frame must be >= 0!");
+
+    int tiles_x = 0, tiles_y = 0;
+
+    if (tiles_obj && (tiles_obj != mp_const_none)) {
+        if (mp_obj_is_int(tiles_obj)) {
+            tiles_x = tiles_y = mp_obj_get_int(tiles_obj);
+        } else {
+            mp_obj_t *items;
+            mp_obj_get_array_fixed_n(tiles_obj, 2, &items);
+            tiles_x = mp_obj_get_int(items[0]);
+            tiles_y = mp_obj_get_int(items[1]);
+        }
+
+        PY_ASSERT_TRUE_MSG((tiles_x >= 2) && (tiles_x <= CLAHE_MAX_TILES) &&
+                           (tiles_y >= 2) && (tiles_y <= CLAHE_MAX_TILES), "2 <= tiles <= 16!");
+    }
+
+    py_clahe_obj_t *self = m_new_obj_with_finaliser(py_clahe_obj_t);
+    self->base.type = &py_clahe_type;
+    imlib_clahe_init(&self->_cobj, clip_limit, tiles_x, tiles_y, blend, tiles_per_frame);
+    return MP_OBJ_FROM_PTR(self);
+}
+
+STATIC const mp_rom_map_elem_t py_clahe_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR___del__),         MP_ROM_PTR(&py_clahe_free_obj)          },
+    { MP_ROM_QSTR(MP_QSTR_reset),           MP_ROM_PTR(&py_clahe_reset_obj)         }
+};
+
+STATIC MP_DEFINE_CONST_DICT(py_clahe_locals_dict, py_clahe_locals_dict_table);
+
+MP_DEFINE_CONST_OBJ_TYPE(
+    py_clahe_type,
+    MP_QSTR_CLAHE,
+    MP_TYPE_FLAG_NONE,
+    print, py_clahe_print,
+    make_new, py_clahe_make_new,
+    locals_dict, &py_clahe_locals_dict
+    );
+#endif // IMLIB_ENABLE_CLAHE
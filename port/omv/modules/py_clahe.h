@@ -0,0 +1,17 @@
+/*
+ * This file is part of the OpenMV project.
+ *
+ * Copyright (c) 2013-2021 Ibrahim Abdelkader <iabdalkader@openmv.io>
+ * Copyright (c) 2013-2021 Kwabena W. Agyeman <kwagyeman@openmv.io>
+ *
+ * This work is licensed under the MIT license, see the file LICENSE for details.
+ *
+ * CLAHE Python module.
+ */
+#ifndef __PY_CLAHE_H__
+#define __PY_CLAHE_H__
+#include "imlib.h"
+extern const mp_obj_type_t py_clahe_type;
+clahe_t *py_clahe_cobj(mp_obj_t obj);
+clahe_t *py_helper_keyword_clahe(uint n_args, const mp_obj_t *args, uint arg_index, mp_map_t *kw_args);
+#endif // __PY_CLAHE_H__
@@ -0,0 +1,154 @@
+/*
+ * This file is part of the OpenMV project.
+ *
+ * Copyright (c) 2013-2023 Ibrahim Abdelkader <iabdalkader@openmv.io>
+ * Copyright (c) 2013-2023 Kwabena W. Agyeman <kwagyeman@openmv.io>
+ *
+ * This work is licensed under the MIT license, see the file LICENSE for details.
+ *
+ * Color correction Python module.
+ */
+#include "imlib_config.h"
+#if defined(IMLIB_ENABLE_COLOR_CORR)
+
+#include "py/obj.h"
+#include "py/nlr.h"
+#include "py/runtime.h"
+
+#include "py_assert.h"
+#include "py_helper.h"
+#include "py_image.h"
+#include "py_color_corr.h"
+
+typedef struct py_color_corr_obj {
+    mp_obj_base_t base;
+    color_corr_t _cobj;
+} py_color_corr_obj_t;
+
+color_corr_t *py_color_corr_cobj(mp_obj_t obj) {
+    PY_ASSERT_TYPE(obj, &py_color_corr_type);
+    return &((py_color_corr_obj_t *) MP_OBJ_TO_PTR(obj))->_cobj;
+}
+
+STATIC void py_color_corr_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind) {
+    color_corr_t *cc = py_color_corr_cobj(self_in);
+    mp_printf(print, "{\"awb\":\"%s\", \"gains\":(%f, %f, %f), \"saturation\":%f, "
+              "\"gamma\":%f, \"contrast\":%f, \"brightness\":%f}",
+              (cc->awb == COLOR_CORR_AWB_GRAY_WORLD) ? "gray_world" :
+              (cc->awb == COLOR_CORR_AWB_WHITE_PATCH) ? "white_patch" : "off",
+              (double) cc->gains[0], (double) cc->gains[1], (double) cc->gains[2],
+              (double) cc->saturation, (double) cc->gamma, (double) cc->contrast, (double) cc->brightness);
+}
+
+// The gains used for a frame come from the statistics of the previous frame.
+STATIC mp_obj_t py_color_corr_awb(size_t n_args, const mp_obj_t *args, mp_map_t *kw_args) {
+    color_corr_t *cc = py_color_corr_cobj(args[0]);
+    bool arg_max =
+        py_helper_keyword_int(n_args, args, 1, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_max), false);
+    bool arg_enable =
+        py_helper_keyword_int(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_enable), true);
+
+    cc->awb = !arg_enable ? COLOR_CORR_AWB_OFF : arg_max ? COLOR_CORR_AWB_WHITE_PATCH : COLOR_CORR_AWB_GRAY_WORLD;
+    return args[0];
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_color_corr_awb_obj, 1, py_color_corr_awb);
+
+STATIC mp_obj_t py_color_corr_set_gains(size_t n_args, const mp_obj_t *args) {
+    color_corr_t *cc = py_color_corr_cobj(args[0]);
+
+    for (int i = 0; i < 3; i++) {
+        float gain = mp_obj_get_float(args[1 + i]);
+        PY_ASSERT_TRUE_MSG(gain >= 0.0f, "Gains must be >= 0!");
+        cc->gains[i] = gain;
+    }
+
+    cc->awb = COLOR_CORR_AWB_OFF;
+    return args[0];
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(py_color_corr_set_gains_obj, 4, 4, py_color_corr_set_gains);
+
+STATIC mp_obj_t py_color_corr_get_gains(mp_obj_t self_in) {
+    color_corr_t *cc = py_color_corr_cobj(self_in);
+    return mp_obj_new_tuple(3, (mp_obj_t []) {mp_obj_new_float(cc->gains[0]),
+                                              mp_obj_new_float(cc->gains[1]),
+                                              mp_obj_new_float(cc->gains[2])});
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_color_corr_get_gains_obj, py_color_corr_get_gains);
+
+// Same column-major 3x3 or 4x3 layout as image.ccm(), None resets to identity.
+STATIC mp_obj_t py_color_corr_ccm(mp_obj_t self_in, mp_obj_t ccm_obj) {
+    color_corr_t *cc = py_color_corr_cobj(self_in);
+    float ccm[12] = {1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f};
+
+    if (ccm_obj != mp_const_none) {
+        size_t len;
+        mp_obj_t *items;
+        mp_obj_get_array(ccm_obj, &len, &items);
+
+        if ((len != 9) && (len != 12)) {
+            mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("Expected a 3x3 or 4x3 matrix!"));
+        }
+
+        for (size_t i = 0; i < len; i++) {
+            ccm[i] = mp_obj_get_float(items[i]);
+        }
+    }
+
+    memcpy(cc->ccm, ccm, sizeof(ccm));
+    cc->dirty = true;
+    return self_in;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(py_color_corr_ccm_obj, py_color_corr_ccm);
+
+STATIC mp_obj_t py_color_corr_saturation(mp_obj_t self_in, mp_obj_t saturation_obj) {
+    color_corr_t *cc = py_color_corr_cobj(self_in);
+    float saturation = mp_obj_get_float(saturation_obj);
+    PY_ASSERT_TRUE_MSG(saturation >= 0.0f, "Saturation must be >= 0!");
+    cc->saturation = saturation;
+    cc->dirty = true;
+    return self_in;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(py_color_corr_saturation_obj, py_color_corr_saturation);
+
+STATIC mp_obj_t py_color_corr_gamma(size_t n_args, const mp_obj_t *args, mp_map_t *kw_args) {
+    color_corr_t *cc = py_color_corr_cobj(args[0]);
+    cc->gamma =
+        py_helper_keyword_float(n_args, args, 1, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_gamma), 1.0f);
+    cc->contrast =
+        py_helper_keyword_float(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_contrast), 1.0f);
+    cc->brightness =
+        py_helper_keyword_float(n_args, args, 3, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_brightness), 0.0f);
+    cc->dirty = true;
+    return args[0];
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_color_corr_gamma_obj, 1, py_color_corr_gamma);
+
+STATIC mp_obj_t py_color_corr_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *args) {
+    mp_arg_check_num(n_args, n_kw, 0, 0, false);
+
+    py_color_corr_obj_t *self = m_new_obj(py_color_corr_obj_t);
+    self->base.type = &py_color_corr_type;
+    imlib_color_corr_init(&self->_cobj);
+    return MP_OBJ_FROM_PTR(self);
+}
+
+STATIC const mp_rom_map_elem_t py_color_corr_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR_awb),             MP_ROM_PTR(&py_color_corr_awb_obj)         },
+    { MP_ROM_QSTR(MP_QSTR_set_gains),       MP_ROM_PTR(&py_color_corr_set_gains_obj)   },
+    { MP_ROM_QSTR(MP_QSTR_get_gains),       MP_ROM_PTR(&py_color_corr_get_gains_obj)   },
+    { MP_ROM_QSTR(MP_QSTR_ccm),             MP_ROM_PTR(&py_color_corr_ccm_obj)         },
+    { MP_ROM_QSTR(MP_QSTR_saturation),      MP_ROM_PTR(&py_color_corr_saturation_obj)  },
+    { MP_ROM_QSTR(MP_QSTR_gamma),           MP_ROM_PTR(&py_color_corr_gamma_obj)       }
+};
+
+STATIC MP_DEFINE_CONST_DICT(py_color_corr_locals_dict, py_color_corr_locals_dict_table);
+
+MP_DEFINE_CONST_OBJ_TYPE(
+    py_color_corr_type,
+    MP_QSTR_ColorCorrection,
+    MP_TYPE_FLAG_NONE,
+    print, py_color_corr_print,
+    make_new, py_color_corr_make_new,
+    locals_dict, &py_color_corr_locals_dict
+    );
+#endif // IMLIB_ENABLE_COLOR_CORR
@@ -0,0 +1,16 @@
+/*
+ * This file is part of the OpenMV project.
+ *
+ * Copyright (c) 2013-2023 Ibrahim Abdelkader <iabdalkader@openmv.io>
+ * Copyright (c) 2013-2023 Kwabena W. Agyeman <kwagyeman@openmv.io>
+ *
+ * This work is licensed under the MIT license, see the file LICENSE for details.
+ *
+ * Color correction Python module.
+ */
+#ifndef __PY_COLOR_CORR_H__
+#define __PY_COLOR_CORR_H__
+#include "imlib.h"
+extern const mp_obj_type_t py_color_corr_type;
+color_corr_t *py_color_corr_cobj(mp_obj_t obj);
+#endif // __PY_COLOR_CORR_H__
@@ -0,0 +1,152 @@
+/*
+ * This file is part of the OpenMV project.
+ *
+ * Copyright (c) 2013-2021 Ibrahim Abdelkader <iabdalkader@openmv.io>
+ * Copyright (c) 2013-2021 Kwabena W. Agyeman <kwagyeman@openmv.io>
+ *
+ * This work is licensed under the MIT license, see the file LICENSE for details.
+ *
+ * GIF Python module.
+ */
+#include "imlib_config.h"
+#if defined(IMLIB_ENABLE_IMAGE_FILE_IO)
+
+#include "py/obj.h"
+#include "py/nlr.h"
+#include "py/runtime.h"
+
+#include "py_assert.h"
+#include "py_helper.h"
+#include "py_image.h"
+#include "py_gif.h"
+#include "fb_alloc.h"
+#include "ff_wrapper.h"
+
+typedef struct py_gif_obj {
+    mp_obj_base_t base;
+    bool closed;
+    FIL fp;
+    gif_t _cobj;
+} py_gif_obj_t;
+
+STATIC py_gif_obj_t *py_gif_obj(mp_obj_t self) {
+    py_gif_obj_t *gif = MP_OBJ_TO_PTR(self);
+
+    if (gif->closed) {
+        mp_raise_msg(&mp_type_OSError, MP_ERROR_TEXT("GIF closed"));
+    }
+
+    return gif;
+}
+
+STATIC void py_gif_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind) {
+    py_gif_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    gif_t *gif = &self->_cobj;
+    mp_printf(print, "{\"closed\":%s, \"width\":%d, \"height\":%d, \"color\":%s, \"frames\":%u}",
+              self->closed ? "\"true\"" : "\"false\"",
+              gif->w, gif->h,
+              gif->color ? "\"true\"" : "\"false\"",
+              gif->frames);
+}
+
+STATIC mp_obj_t py_gif_width(mp_obj_t self) {
+    return mp_obj_new_int(((py_gif_obj_t *) MP_OBJ_TO_PTR(self))->_cobj.w);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_gif_width_obj, py_gif_width);
+
+STATIC mp_obj_t py_gif_height(mp_obj_t self) {
+    return mp_obj_new_int(((py_gif_obj_t *) MP_OBJ_TO_PTR(self))->_cobj.h);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_gif_height_obj, py_gif_height);
+
+STATIC mp_obj_t py_gif_format(mp_obj_t self) {
+    return mp_obj_new_int(((py_gif_obj_t *) MP_OBJ_TO_PTR(self))->_cobj.color ?
+                          PIXFORMAT_RGB565 : PIXFORMAT_GRAYSCALE);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_gif_format_obj, py_gif_format);
+
+STATIC mp_obj_t py_gif_frames(mp_obj_t self) {
+    return mp_obj_new_int(((py_gif_obj_t *) MP_OBJ_TO_PTR(self))->_cobj.frames);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_gif_frames_obj, py_gif_frames);
+
+STATIC mp_obj_t py_gif_add_frame(uint n_args, const mp_obj_t *args, mp_map_t *kw_args) {
+    py_gif_obj_t *self = py_gif_obj(args[0]);
+    image_t *image = py_helper_arg_to_image_not_compressed(args[1]);
+
+    int delay = py_helper_keyword_int(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_delay), 10);
+    PY_ASSERT_TRUE_MSG((delay >= 0) && (delay <= 65535), "0 <= delay <= 65535!");
+
+    fb_alloc_mark();
+    gif_add_frame(&self->fp, &self->_cobj, image, delay);
+    fb_alloc_free_till_mark();
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_gif_add_frame_obj, 2, py_gif_add_frame);
+
+STATIC mp_obj_t py_gif_close(mp_obj_t self_in) {
+    py_gif_obj_t *self = MP_OBJ_TO_PTR(self_in);
+
+    if (!self->closed) {
+        self->closed = true;
+        gif_close(&self->fp, &self->_cobj);
+    }
+
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_gif_close_obj, py_gif_close);
+
+STATIC mp_obj_t py_gif_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *args) {
+    mp_arg_check_num(n_args, n_kw, 1, 8, true);
+
+    mp_map_t kw_args;
+    mp_map_init_fixed_table(&kw_args, n_kw, args + n_args);
+
+    int width =
+        py_helper_keyword_int(n_args, args, 1, &kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_width), 0);
+    int height =
+        py_helper_keyword_int(n_args, args, 2, &kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_height), 0);
+    PY_ASSERT_TRUE_MSG((width >= 0) && (width <= 65535) && (height >= 0) && (height <= 65535),
+                       "0 <= width/height <= 65535!");
+    bool color =
+        py_helper_keyword_int(n_args, args, 3, &kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_color), true);
+    bool loop =
+        py_helper_keyword_int(n_args, args, 4, &kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_loop), true);
+    bool global_palette =
+        py_helper_keyword_int(n_args, args, 5, &kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_global_palette), false);
+    bool dither =
+        py_helper_keyword_int(n_args, args, 6, &kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_dither), false);
+    bool diff =
+        py_helper_keyword_int(n_args, args, 7, &kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_diff), true);
+
+    py_gif_obj_t *self = m_new_obj_with_finaliser(py_gif_obj_t);
+    self->base.type = &py_gif_type;
+    self->closed = true;
+
+    file_write_open(&self->fp, mp_obj_str_get_str(args[0]));
+    gif_open(&self->fp, &self->_cobj, width, height, color, loop, global_palette, dither, diff);
+    self->closed = false;
+    return MP_OBJ_FROM_PTR(self);
+}
+
+STATIC const mp_rom_map_elem_t py_gif_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR___del__),         MP_ROM_PTR(&py_gif_close_obj)           },
+    { MP_ROM_QSTR(MP_QSTR_width),           MP_ROM_PTR(&py_gif_width_obj)           },
+    { MP_ROM_QSTR(MP_QSTR_height),          MP_ROM_PTR(&py_gif_height_obj)          },
+    { MP_ROM_QSTR(MP_QSTR_format),          MP_ROM_PTR(&py_gif_format_obj)          },
+    { MP_ROM_QSTR(MP_QSTR_frames),          MP_ROM_PTR(&py_gif_frames_obj)          },
+    { MP_ROM_QSTR(MP_QSTR_add_frame),       MP_ROM_PTR(&py_gif_add_frame_obj)       },
+    { MP_ROM_QSTR(MP_QSTR_close),           MP_ROM_PTR(&py_gif_close_obj)           }
+};
+
+STATIC MP_DEFINE_CONST_DICT(py_gif_locals_dict, py_gif_locals_dict_table);
+
+MP_DEFINE_CONST_OBJ_TYPE(
+    py_gif_type,
+    MP_QSTR_Gif,
+    MP_TYPE_FLAG_NONE,
+    print, py_gif_print,
+    make_new, py_gif_make_new,
+    locals_dict, &py_gif_locals_dict
+    );
+#endif // IMLIB_ENABLE_IMAGE_FILE_IO
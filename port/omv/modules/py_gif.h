@@ -0,0 +1,15 @@
+/*
+ * This file is part of the OpenMV project.
+ *
+ * Copyright (c) 2013-2021 Ibrahim Abdelkader <iabdalkader@openmv.io>
+ * Copyright (c) 2013-2021 Kwabena W. Agyeman <kwagyeman@openmv.io>
+ *
+ * This work is licensed under the MIT license, see the file LICENSE for details.
+ *
+ * GIF Python module.
+ */
+#ifndef __PY_GIF_H__
+#define __PY_GIF_H__
+#include "imlib.h"
+extern const mp_obj_type_t py_gif_type;
+#endif // __PY_GIF_H__
@@ -15,6 +15,7 @@
 #include "py_assert.h"
 
 extern void *py_image_cobj(mp_obj_t img_obj);
+extern void py_image_dirty_touch(mp_obj_t img_obj);
 
 mp_obj_t py_func_unavailable(size_t n_args, const mp_obj_t *args, mp_map_t *kw_args) {
     PY_ASSERT_TRUE_MSG(false, "This function is unavailable on your OpenMV Cam.");
@@ -25,6 +26,7 @@ MP_DEFINE_CONST_FUN_OBJ_KW(py_func_unavailable_obj, 0, py_func_unavailable);
 image_t *py_helper_arg_to_image_mutable(const mp_obj_t arg) {
     image_t *arg_img = py_image_cobj(arg);
     PY_ASSERT_TRUE_MSG(arg_img->is_mutable, "Image is not mutable!");
+    py_image_dirty_touch(arg);
     return arg_img;
 }
 
@@ -278,40 +280,25 @@ uint py_helper_consume_array(uint n_args, const mp_obj_t *args, uint arg_index,
     }
 }
 
-int py_helper_keyword_color(image_t *img, uint n_args, const mp_obj_t *args, uint arg_index,
-                            mp_map_t *kw_args, int default_val) {
-    mp_map_elem_t *kw_arg = kw_args ? mp_map_lookup(kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_color), MP_MAP_LOOKUP) : NULL;
+// Shifts ([A,]R,G,B) components into val, so 3 tuples keep the alpha of val.
+static int py_helper_obj_to_argb(const mp_obj_t obj, int val) {
+    if (mp_obj_is_integer(obj)) {
+        return mp_obj_get_int(obj);
+    }
 
-    if (kw_arg) {
-        if (mp_obj_is_integer(kw_arg->value)) {
-            default_val = mp_obj_get_int(kw_arg->value);
-        } else {
-            size_t len;
-            mp_obj_t *arg_color;
-            mp_obj_get_array(kw_arg->value, &len, &arg_color);
-            if (len != 3 && len != 4)
-                mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("color=([A,]R,G,B)"));
-            for (int i = 0; i < len; i++) {
-                default_val <<= 8;
-                default_val |= (uint8_t)mp_obj_get_int(arg_color[i]);
-            }
-        }
-    } else if (n_args > arg_index) {
-        if (mp_obj_is_integer(args[arg_index])) {
-            default_val = mp_obj_get_int(args[arg_index]);
-        } else {
-            size_t len;
-            mp_obj_t *arg_color;
-            mp_obj_get_array(args[arg_index], &len, &arg_color);
-            if (len != 3 && len != 4)
-                mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("color=([A,]R,G,B)"));
-            for (int i = 0; i < len; i++) {
-                default_val <<= 8;
-                default_val |= (uint8_t)mp_obj_get_int(arg_color[i]);
-            }
-        }
+    size_t len;
+    mp_obj_t *arg_color;
+    mp_obj_get_array(obj, &len, &arg_color);
+    if (len != 3 && len != 4)
+        mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("color=([A,]R,G,B)"));
+    for (int i = 0; i < len; i++) {
+        val <<= 8;
+        val |= (uint8_t)mp_obj_get_int(arg_color[i]);
     }
+    return val;
+}
 
+static int py_helper_argb_to_color(image_t *img, int default_val) {
     uint32_t p = default_val;
 
     switch (img->pixfmt) {
@@ -348,6 +335,23 @@ int py_helper_keyword_color(image_t *img, uint n_args, const mp_obj_t *args, uin
     return p;
 }
 
+int py_helper_arg_to_color(image_t *img, const mp_obj_t arg) {
+    return py_helper_argb_to_color(img, py_helper_obj_to_argb(arg, -1));
+}
+
+int py_helper_keyword_color(image_t *img, uint n_args, const mp_obj_t *args, uint arg_index,
+                            mp_map_t *kw_args, int default_val) {
+    mp_map_elem_t *kw_arg = kw_args ? mp_map_lookup(kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_color), MP_MAP_LOOKUP) : NULL;
+
+    if (kw_arg) {
+        default_val = py_helper_obj_to_argb(kw_arg->value, default_val);
+    } else if (n_args > arg_index) {
+        default_val = py_helper_obj_to_argb(args[arg_index], default_val);
+    }
+
+    return py_helper_argb_to_color(img, default_val);
+}
+
 void py_helper_arg_to_thresholds(const mp_obj_t arg, list_t *thresholds) {
     mp_uint_t arg_thresholds_len;
     mp_obj_t *arg_thresholds;
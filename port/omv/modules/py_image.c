@@ -8,6 +8,7 @@
  *
  * Image Python module.
  */
+#include <limits.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdbool.h>
@@ -36,6 +37,25 @@
 #if defined(IMLIB_ENABLE_IMAGE_IO)
 #include "py_imageio.h"
 #endif
+#if defined(IMLIB_ENABLE_IMAGE_FILE_IO)
+#include "py_gif.h"
+#include "py_mjpeg.h"
+#endif
+#if defined(IMLIB_ENABLE_PYRAMID)
+#include "py_pyramid.h"
+#endif
+#if defined(IMLIB_ENABLE_REMAP)
+#include "py_remap.h"
+#endif
+#if defined(IMLIB_ENABLE_PIPELINE)
+#include "py_pipeline.h"
+#endif
+#if defined(IMLIB_ENABLE_COLOR_CORR)
+#include "py_color_corr.h"
+#endif
+#if defined(IMLIB_ENABLE_CLAHE)
+#include "py_clahe.h"
+#endif
 
 static const mp_obj_type_t py_cascade_type;
 static const mp_obj_type_t py_image_type;
@@ -277,9 +297,16 @@ STATIC MP_DEFINE_CONST_OBJ_TYPE(
 
 // Image //////////////////////////////////////////////////////////////////////
 
+typedef struct _py_image_dirty_t {
+    bool pending;           // Mutated by an untracked call since the last tracked draw.
+    dirty_rects_t drawn;    // Drawn since the last clear(), zeroed by the next clear().
+    dirty_rects_t flush;    // Changed since the last flush_dirty().
+} py_image_dirty_t;
+
 typedef struct _py_image_obj_t {
     mp_obj_base_t base;
     image_t _cobj;
+    py_image_dirty_t *dirty;
 } py_image_obj_t;
 
 typedef struct _mp_obj_py_image_it_t {
@@ -294,6 +321,40 @@ void *py_image_cobj(mp_obj_t img_obj) {
     return &((py_image_obj_t *) img_obj)->_cobj;
 }
 
+// An untracked mutation left unresolved by a tracked draw may have touched anything.
+static void py_image_dirty_resolve(py_image_dirty_t *dirty) {
+    if (dirty->pending) {
+        dirty->drawn.full = true;
+        dirty->flush.full = true;
+        dirty->pending = false;
+    }
+}
+
+// Called for every image about to be mutated. Draw calls that know what they touch
+// follow up with py_image_dirty_mark(), everything else escalates to a full redraw.
+void py_image_dirty_touch(mp_obj_t img_obj) {
+    py_image_dirty_t *dirty = ((py_image_obj_t *) img_obj)->dirty;
+    if (dirty) {
+        py_image_dirty_resolve(dirty);
+        dirty->pending = true;
+    }
+}
+
+static void py_image_dirty_mark(mp_obj_t img_obj, int x, int y, int w, int h) {
+    py_image_obj_t *self = MP_OBJ_TO_PTR(img_obj);
+    if (self->dirty) {
+        self->dirty->pending = false;
+        dirty_rects_add(&self->dirty->drawn, &self->_cobj, x, y, w, h);
+        dirty_rects_add(&self->dirty->flush, &self->_cobj, x, y, w, h);
+    }
+}
+
+static void py_image_dirty_mark_line(mp_obj_t img_obj, int x0, int y0, int x1, int y1, int margin) {
+    int x = IM_MIN(x0, x1) - margin;
+    int y = IM_MIN(y0, y1) - margin;
+    py_image_dirty_mark(img_obj, x, y, abs(x1 - x0) + (margin * 2) + 1, abs(y1 - y0) + (margin * 2) + 1);
+}
+
 mp_obj_t py_image_unary_op(mp_unary_op_t op, mp_obj_t self_in) {
     py_image_obj_t *self = MP_OBJ_TO_PTR(self_in);
     switch (op) {
@@ -509,7 +570,8 @@ static mp_obj_t py_image_subscr(mp_obj_t self_in, mp_obj_t index, mp_obj_t value
                 mp_raise_msg(&mp_type_OSError, MP_ERROR_TEXT("Invalid pixel format"));
         }
     } else {
-        // store
+        // store, slices can span any number of rows so tracked images take a full redraw
+        py_image_dirty_touch(self_in);
         switch (image->pixfmt) {
             case PIXFORMAT_BINARY: {
                 if (MP_OBJ_IS_TYPE(index, &mp_type_slice)) {
@@ -896,22 +958,26 @@ STATIC mp_obj_t py_image_set_pixel(size_t n_args, const mp_obj_t *args, mp_map_t
     switch (arg_img->pixfmt) {
         case PIXFORMAT_BINARY: {
             IMAGE_PUT_BINARY_PIXEL(arg_img, arg_x, arg_y, arg_c);
-            return args[0];
+            break;
         }
         case PIXFORMAT_GRAYSCALE:
         case PIXFORMAT_BAYER_ANY: {
             // re-use
             IMAGE_PUT_GRAYSCALE_PIXEL(arg_img, arg_x, arg_y, arg_c);
-            return args[0];
+            break;
         }
         case PIXFORMAT_RGB565:
         case PIXFORMAT_YUV_ANY: {
             // re-use
             IMAGE_PUT_RGB565_PIXEL(arg_img, arg_x, arg_y, arg_c);
-            return args[0];
+            break;
         }
         default: return args[0];
     }
+
+    py_image_dirty_touch(args[0]);
+    py_image_dirty_mark(args[0], arg_x, arg_y, 1, 1);
+    return args[0];
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_set_pixel_obj, 2, py_image_set_pixel);
 
@@ -955,6 +1021,22 @@ static mp_obj_t py_image_mean_pooled(size_t n_args, const mp_obj_t *args, mp_map
     out_img.w = arg_img->w / arg_x_div;
     out_img.h = arg_img->h / arg_y_div;
     out_img.pixfmt = arg_img->pixfmt;
+
+    #ifdef IMLIB_ENABLE_PYRAMID
+    // A pyramid level covering exactly the same pixels is already the pooled image.
+    pyramid_t *pyr = py_helper_keyword_pyramid(arg_img, n_args, args, 3, kw_args);
+    if (pyr && ((arg_img->w % arg_x_div) == 0) && ((arg_img->h % arg_y_div) == 0)) {
+        for (int i = 0; i < pyr->n_levels; i++) {
+            image_t *level = &pyr->levels[i].img;
+            if ((level->w == out_img.w) && (level->h == out_img.h) && (level->pixfmt == out_img.pixfmt)) {
+                py_image_alloc(&out_img, kw_args);
+                memcpy(out_img.data, imlib_pyramid_level(pyr, i)->data, image_size(&out_img));
+                return py_image_from_struct(&out_img);
+            }
+        }
+    }
+    #endif
+
     py_image_alloc(&out_img, kw_args);
 
     imlib_mean_pool(arg_img, &out_img, arg_x_div, arg_y_div);
@@ -1097,7 +1179,38 @@ static mp_obj_t py_image_to(pixformat_t pixfmt, const uint16_t *default_color_pa
     bool dst_is_rgb888 = false;
     bool src_is_rgb888 = false;
 
-    if (pixfmt == PIXFORMAT_RGB888) {
+    // JPEG sources are only decoded inside the roi and 1/2, 1/4 and 1/8 of the downscale is done
+    // by the IDCT. Crops and exact power of two downscales are decoded straight into the result.
+    int jpeg_scale_shift = 0;
+    bool jpeg_direct = false;
+
+    if ((src_img->pixfmt == PIXFORMAT_JPEG) && (arg_x_scale > 0) && (arg_y_scale > 0)) {
+        while ((jpeg_scale_shift < 3)
+               && ((arg_x_scale * (2 << jpeg_scale_shift)) <= 1)
+               && ((arg_y_scale * (2 << jpeg_scale_shift)) <= 1)) {
+            jpeg_scale_shift += 1;
+        }
+
+        jpeg_direct = (arg_x_scale == arg_y_scale) &&
+                      ((arg_x_scale * (1 << jpeg_scale_shift)) == 1) &&
+                      (arg_rgb_channel == -1) &&
+                      (arg_alpha == 256) &&
+                      (color_palette == NULL) &&
+                      (alpha_palette == NULL) &&
+                      ((pixfmt == PIXFORMAT_BINARY) ||
+                       (pixfmt == PIXFORMAT_GRAYSCALE) ||
+                       (pixfmt == PIXFORMAT_RGB565) ||
+                       (pixfmt == PIXFORMAT_RGB888) ||
+                       (pixfmt == PIXFORMAT_RGBP888) ||
+                       (pixfmt == PIXFORMAT_YUV420));
+    }
+
+    if (((pixfmt == PIXFORMAT_RGBP888) || (pixfmt == PIXFORMAT_YUV420)) && (!jpeg_direct)) {
+        mp_raise_msg(&mp_type_ValueError,
+                     MP_ERROR_TEXT("Only 1/2^n scaled and cropped JPEG decoding is supported!"));
+    }
+
+    if ((pixfmt == PIXFORMAT_RGB888) && (!jpeg_direct)) {
         dst_is_rgb888 = true;
         pixfmt = PIXFORMAT_RGB565;
     }
@@ -1192,7 +1305,7 @@ static mp_obj_t py_image_to(pixformat_t pixfmt, const uint16_t *default_color_pa
                       IMAGE_HINT_EXTRACT_RGB_CHANNEL_FIRST |
                       IMAGE_HINT_APPLY_COLOR_PALETTE_FIRST);
         }
-    } else if (dst_img.is_yuv) {
+    } else if (dst_img.is_yuv && (!jpeg_direct)) {
         if (((arg_x_scale != 1) && (arg_x_scale != -1)) ||
             ((arg_y_scale != 1) && (arg_y_scale != -1)) ||
             (arg_rgb_channel != -1) ||
@@ -1240,7 +1353,8 @@ static mp_obj_t py_image_to(pixformat_t pixfmt, const uint16_t *default_color_pa
             }
 
             if (((dst_img.pixfmt == PIXFORMAT_JPEG) && jpeg_compress(&temp, &dst_img_tmp, arg_q, false))
-                || ((dst_img.pixfmt == PIXFORMAT_PNG) && png_compress(&temp, &dst_img_tmp))) {
+                || ((dst_img.pixfmt == PIXFORMAT_PNG) && (arg_q == 100) && png_compress(&temp, &dst_img_tmp))
+                || ((dst_img.pixfmt == PIXFORMAT_PNG) && (arg_q != 100) && png_compress_fast(&temp, &dst_img_tmp))) {
                 mp_raise_msg(&mp_type_OSError, MP_ERROR_TEXT("Compression Failed!"));
             }
         } else {
@@ -1265,9 +1379,38 @@ static mp_obj_t py_image_to(pixformat_t pixfmt, const uint16_t *default_color_pa
         fb_alloc_mark();
         nlr_buf_t nlr;
         if (nlr_push(&nlr) == 0) {
-            imlib_draw_image(&dst_img, src_img, 0, 0, arg_x_scale, arg_y_scale, &arg_roi,
-                         arg_rgb_channel, arg_alpha, color_palette, alpha_palette,
-                         (hint & (~IMAGE_HINT_CENTER)) | IMAGE_HINT_BLACK_BACKGROUND, NULL, NULL);
+            image_t *draw_img = src_img;
+            image_t jpeg_img;
+
+            if (jpeg_direct) {
+                jpeg_decompress_ex(&dst_img, src_img, &arg_roi, jpeg_scale_shift);
+                draw_img = NULL;
+            } else if ((src_img->pixfmt == PIXFORMAT_JPEG) && (jpeg_scale_shift || (arg_roi.x != 0) || (arg_roi.y != 0)
+                                                                || (arg_roi.w != src_img->w) || (arg_roi.h != src_img->h))) {
+                // Decode the roi at the nearest 1/2^n scale and let draw image do the rest.
+                jpeg_img.w = arg_roi.w >> jpeg_scale_shift;
+                jpeg_img.h = arg_roi.h >> jpeg_scale_shift;
+                jpeg_img.pixfmt = (arg_rgb_channel != -1) ? PIXFORMAT_RGB565 :
+                                  (color_palette ? PIXFORMAT_GRAYSCALE :
+                                   (((dst_img.pixfmt == PIXFORMAT_BINARY) || (dst_img.pixfmt == PIXFORMAT_GRAYSCALE)) ?
+                                    dst_img.pixfmt : PIXFORMAT_RGB565));
+                jpeg_img.size = 0;
+                jpeg_img.data = fb_alloc(image_size(&jpeg_img), FB_ALLOC_NO_HINT);
+                jpeg_decompress_ex(&jpeg_img, src_img, &arg_roi, jpeg_scale_shift);
+                arg_x_scale *= (1 << jpeg_scale_shift);
+                arg_y_scale *= (1 << jpeg_scale_shift);
+                arg_roi.x = 0;
+                arg_roi.y = 0;
+                arg_roi.w = jpeg_img.w;
+                arg_roi.h = jpeg_img.h;
+                draw_img = &jpeg_img;
+            }
+
+            if (draw_img) {
+                imlib_draw_image(&dst_img, draw_img, 0, 0, arg_x_scale, arg_y_scale, &arg_roi,
+                                 arg_rgb_channel, arg_alpha, color_palette, alpha_palette,
+                                 (hint & (~IMAGE_HINT_CENTER)) | IMAGE_HINT_BLACK_BACKGROUND, NULL, NULL);
+            }
             nlr_pop();
         } else {
             py_image_free(&dst_img);
@@ -1319,6 +1462,16 @@ static mp_obj_t py_image_to_rgb888(size_t n_args, const mp_obj_t *args, mp_map_t
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_to_rgb888_obj, 1, py_image_to_rgb888);
 
+static mp_obj_t py_image_to_rgbp888(size_t n_args, const mp_obj_t *args, mp_map_t *kw_args) {
+    return py_image_to(PIXFORMAT_RGBP888, NULL, false, NULL, false, false, n_args, args, kw_args);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_to_rgbp888_obj, 1, py_image_to_rgbp888);
+
+static mp_obj_t py_image_to_yuv420(size_t n_args, const mp_obj_t *args, mp_map_t *kw_args) {
+    return py_image_to(PIXFORMAT_YUV420, NULL, false, NULL, false, false, n_args, args, kw_args);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_to_yuv420_obj, 1, py_image_to_yuv420);
+
 static mp_obj_t py_image_to_rainbow(size_t n_args, const mp_obj_t *args, mp_map_t *kw_args) {
     return py_image_to(PIXFORMAT_RGB565, rainbow_table, false, NULL, false, false, n_args, args, kw_args);
 }
@@ -1404,16 +1557,100 @@ STATIC mp_obj_t py_image_clear(size_t n_args, const mp_obj_t *args, mp_map_t *kw
     image_t *arg_msk =
         py_helper_keyword_to_image_mutable_mask(n_args, args, 1, kw_args);
 
-    if (!arg_msk) {
+    py_image_dirty_t *dirty = ((py_image_obj_t *) MP_OBJ_TO_PTR(args[0]))->dirty;
+
+    if (dirty && (!arg_msk)) {
+        // Only zero what was drawn since the last clear, which is also what the display needs again.
+        py_image_dirty_resolve(dirty);
+        dirty_rects_clear(&dirty->drawn, arg_img);
+        dirty_rects_merge(&dirty->flush, &dirty->drawn, arg_img);
+        dirty_rects_init(&dirty->drawn, false);
+    } else if (!arg_msk) {
         memset(arg_img->data, 0, image_size(arg_img));
     } else {
         imlib_zero(arg_img, arg_msk, false);
+        if (dirty) {
+            dirty->pending = true;
+        }
     }
 
     return args[0];
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_clear_obj, 1, py_image_clear);
 
+STATIC mp_obj_t py_image_track_dirty(size_t n_args, const mp_obj_t *args) {
+    py_image_obj_t *self = MP_OBJ_TO_PTR(args[0]);
+    bool enable = (n_args > 1) ? mp_obj_is_true(args[1]) : true;
+
+    if (!enable) {
+        self->dirty = NULL;
+    } else if (!self->dirty) {
+        if (!dirty_rects_supported(&self->_cobj)) {
+            mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("Dirty tracking needs a GRAYSCALE, RGB565, RGB888 or ARGB8888 image!"));
+        }
+        // Whatever was in the image before tracking started is unknown.
+        self->dirty = m_new_obj(py_image_dirty_t);
+        self->dirty->pending = false;
+        dirty_rects_init(&self->dirty->drawn, true);
+        dirty_rects_init(&self->dirty->flush, true);
+    }
+
+    return args[0];
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(py_image_track_dirty_obj, 1, 2, py_image_track_dirty);
+
+STATIC mp_obj_t py_image_dirty_rects(mp_obj_t img_obj) {
+    py_image_obj_t *self = MP_OBJ_TO_PTR(img_obj);
+    image_t *img = &self->_cobj;
+    mp_obj_t list = mp_obj_new_list(0, NULL);
+
+    if ((!self->dirty) || self->dirty->flush.full || self->dirty->pending) {
+        mp_obj_t tuple[4] = {
+            mp_obj_new_int(0), mp_obj_new_int(0), mp_obj_new_int(img->w), mp_obj_new_int(img->h)
+        };
+        mp_obj_list_append(list, mp_obj_new_tuple(4, tuple));
+        return list;
+    }
+
+    for (int i = 0; i < self->dirty->flush.count; i++) {
+        rectangle_t *r = &self->dirty->flush.rects[i];
+        mp_obj_t tuple[4] = {
+            mp_obj_new_int(r->x), mp_obj_new_int(r->y), mp_obj_new_int(r->w), mp_obj_new_int(r->h)
+        };
+        mp_obj_list_append(list, mp_obj_new_tuple(4, tuple));
+    }
+
+    return list;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_image_dirty_rects_obj, py_image_dirty_rects);
+
+// Copies what changed since the last flush into a buffer laid out like this image.
+STATIC mp_obj_t py_image_flush_dirty(size_t n_args, const mp_obj_t *args) {
+    py_image_obj_t *self = MP_OBJ_TO_PTR(args[0]);
+    image_t *img = py_helper_arg_to_image_not_compressed(args[0]);
+    uint8_t *dst = (uint8_t *) mp_obj_get_int(args[1]);
+    bool full = (n_args > 2) ? mp_obj_is_true(args[2]) : false;
+    size_t size;
+
+    if (self->dirty) {
+        py_image_dirty_resolve(self->dirty);
+    }
+
+    if ((!self->dirty) || full) {
+        size = image_size(img);
+        memcpy(dst, img->data, size);
+    } else {
+        size = dirty_rects_copy(&self->dirty->flush, img, dst);
+    }
+
+    if (self->dirty) {
+        dirty_rects_init(&self->dirty->flush, false);
+    }
+
+    return mp_obj_new_int(size);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(py_image_flush_dirty_obj, 2, 3, py_image_flush_dirty);
+
 STATIC mp_obj_t py_image_draw_line(size_t n_args, const mp_obj_t *args, mp_map_t *kw_args) {
     image_t *arg_img = py_helper_arg_to_image_mutable(args[0]);
 
@@ -1428,8 +1665,15 @@ STATIC mp_obj_t py_image_draw_line(size_t n_args, const mp_obj_t *args, mp_map_t
         py_helper_keyword_color(arg_img, n_args, args, offset + 0, kw_args, -1); // White.
     int arg_thickness =
         py_helper_keyword_int(n_args, args, offset + 1, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_thickness), 1);
+    bool arg_antialias =
+        py_helper_keyword_int(n_args, args, offset + 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_antialias), false);
 
-    imlib_draw_line(arg_img, arg_x0, arg_y0, arg_x1, arg_y1, arg_c, arg_thickness);
+    if (arg_antialias) {
+        imlib_draw_line_aa(arg_img, arg_x0, arg_y0, arg_x1, arg_y1, arg_c, arg_thickness);
+    } else {
+        imlib_draw_line(arg_img, arg_x0, arg_y0, arg_x1, arg_y1, arg_c, arg_thickness);
+    }
+    py_image_dirty_mark_line(args[0], arg_x0, arg_y0, arg_x1, arg_y1, arg_thickness);
     return args[0];
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_draw_line_obj, 2, py_image_draw_line);
@@ -1452,6 +1696,8 @@ STATIC mp_obj_t py_image_draw_rectangle(size_t n_args, const mp_obj_t *args, mp_
         py_helper_keyword_int(n_args, args, offset + 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_fill), false);
 
     imlib_draw_rectangle(arg_img, arg_rx, arg_ry, arg_rw, arg_rh, arg_c, arg_thickness, arg_fill);
+    py_image_dirty_mark(args[0], arg_rx - arg_thickness, arg_ry - arg_thickness,
+                        arg_rw + (arg_thickness * 2), arg_rh + (arg_thickness * 2));
     return args[0];
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_draw_rectangle_obj, 2, py_image_draw_rectangle);
@@ -1471,8 +1717,15 @@ STATIC mp_obj_t py_image_draw_circle(size_t n_args, const mp_obj_t *args, mp_map
         py_helper_keyword_int(n_args, args, offset + 1, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_thickness), 1);
     bool arg_fill =
         py_helper_keyword_int(n_args, args, offset + 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_fill), false);
+    bool arg_antialias =
+        py_helper_keyword_int(n_args, args, offset + 3, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_antialias), false);
 
-    imlib_draw_circle(arg_img, arg_cx, arg_cy, arg_cr, arg_c, arg_thickness, arg_fill);
+    if (arg_antialias) {
+        imlib_draw_circle_aa(arg_img, arg_cx, arg_cy, arg_cr, arg_c, arg_thickness, arg_fill);
+    } else {
+        imlib_draw_circle(arg_img, arg_cx, arg_cy, arg_cr, arg_c, arg_thickness, arg_fill);
+    }
+    py_image_dirty_mark_line(args[0], arg_cx, arg_cy, arg_cx, arg_cy, arg_cr + arg_thickness);
     return args[0];
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_draw_circle_obj, 2, py_image_draw_circle);
@@ -1496,6 +1749,7 @@ STATIC mp_obj_t py_image_draw_ellipse(size_t n_args, const mp_obj_t *args, mp_ma
         py_helper_keyword_int(n_args, args, offset + 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_fill), false);
 
     imlib_draw_ellipse(arg_img, arg_cx, arg_cy, arg_rx, arg_ry, arg_r, arg_c, arg_thickness, arg_fill);
+    py_image_dirty_mark_line(args[0], arg_cx, arg_cy, arg_cx, arg_cy, IM_MAX(abs(arg_rx), abs(arg_ry)) + arg_thickness);
     return args[0];
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_draw_ellipse_obj, 2, py_image_draw_ellipse);
@@ -1535,10 +1789,12 @@ STATIC mp_obj_t py_image_draw_string(size_t n_args, const mp_obj_t *args, mp_map
 
     mp_printf(&mp_plat_print, "Deprecated function, please use draw_string_advanced.");
 
+    rectangle_t bbox;
     imlib_draw_string(arg_img, arg_x_off, arg_y_off, arg_str,
                       arg_c, arg_scale, arg_x_spacing, arg_y_spacing, arg_mono_space,
                       arg_char_rotation, arg_char_hmirror, arg_char_vflip,
-                      arg_string_rotation, arg_string_hmirror, arg_string_vflip);
+                      arg_string_rotation, arg_string_hmirror, arg_string_vflip, &bbox);
+    py_image_dirty_mark(args[0], bbox.x, bbox.y, bbox.w, bbox.h);
     return args[0];
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_draw_string_obj, 2, py_image_draw_string);
@@ -1561,7 +1817,9 @@ STATIC mp_obj_t py_image_draw_string_advance(size_t n_args, const mp_obj_t *args
         arg_font_path = mp_obj_str_get_str(font_path_obj);
     }
 
-    imlib_draw_string_advance(arg_img, arg_x_off, arg_y_off, arg_char_size, arg_str, arg_color, arg_font_path);
+    rectangle_t bbox;
+    imlib_draw_string_advance(arg_img, arg_x_off, arg_y_off, arg_char_size, arg_str, arg_color, arg_font_path, &bbox);
+    py_image_dirty_mark(args[0], bbox.x, bbox.y, bbox.w, bbox.h);
 
     return args[0];
 }
@@ -1584,6 +1842,7 @@ STATIC mp_obj_t py_image_draw_cross(size_t n_args, const mp_obj_t *args, mp_map_
 
     imlib_draw_line(arg_img, arg_x - arg_s, arg_y, arg_x + arg_s, arg_y, arg_c, arg_thickness);
     imlib_draw_line(arg_img, arg_x, arg_y - arg_s, arg_x, arg_y + arg_s, arg_c, arg_thickness);
+    py_image_dirty_mark_line(args[0], arg_x, arg_y, arg_x, arg_y, arg_s + arg_thickness);
     return args[0];
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_draw_cross_obj, 2, py_image_draw_cross);
@@ -1622,6 +1881,8 @@ STATIC mp_obj_t py_image_draw_arrow(size_t n_args, const mp_obj_t *args, mp_map_
     imlib_draw_line(arg_img, arg_x0, arg_y0, arg_x1, arg_y1, arg_c, arg_thickness);
     imlib_draw_line(arg_img, arg_x1, arg_y1, a0x, a0y, arg_c, arg_thickness);
     imlib_draw_line(arg_img, arg_x1, arg_y1, a1x, a1y, arg_c, arg_thickness);
+    py_image_dirty_mark_line(args[0], arg_x0, arg_y0, arg_x1, arg_y1, arg_thickness);
+    py_image_dirty_mark_line(args[0], a0x, a0y, a1x, a1y, arg_thickness);
     return args[0];
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_draw_arrow_obj, 2, py_image_draw_arrow);
@@ -1667,6 +1928,9 @@ STATIC mp_obj_t py_image_draw_edges(size_t n_args, const mp_obj_t *args, mp_map_
         imlib_draw_circle(arg_img, x3, y3, arg_s, arg_c, arg_thickness, arg_fill);
     }
 
+    py_image_dirty_mark_line(args[0], IM_MIN(IM_MIN(x0, x1), IM_MIN(x2, x3)), IM_MIN(IM_MIN(y0, y1), IM_MIN(y2, y3)),
+                             IM_MAX(IM_MAX(x0, x1), IM_MAX(x2, x3)), IM_MAX(IM_MAX(y0, y1), IM_MAX(y2, y3)),
+                             IM_MAX(arg_s, 0) + arg_thickness);
     return args[0];
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_draw_edges_obj, 2, py_image_draw_edges);
@@ -1751,10 +2015,38 @@ STATIC mp_obj_t py_image_draw_image(size_t n_args, const mp_obj_t *args, mp_map_
         arg_y_scale = arg_x_scale;
     }
 
+    #ifdef IMLIB_ENABLE_PYRAMID
+    // Downscale from the closest pyramid level of the source image instead of the full image.
+    pyramid_t *pyr = py_helper_keyword_pyramid(arg_other, n_args, args, offset + 10, kw_args);
+    if (pyr && (arg_x_scale < 1.0f) && (arg_y_scale < 1.0f)) {
+        int level = imlib_pyramid_find_level(pyr, 1.0f / IM_MAX(arg_x_scale, arg_y_scale));
+        image_t *level_img = imlib_pyramid_level(pyr, level);
+        if (level && (level_img->pixfmt == arg_other->pixfmt)) {
+            float x_level_scale = pyr->levels[level].x_scale;
+            float y_level_scale = pyr->levels[level].y_scale;
+            arg_other = level_img;
+            arg_roi.x = fast_floorf(arg_roi.x / x_level_scale);
+            arg_roi.y = fast_floorf(arg_roi.y / y_level_scale);
+            arg_roi.w = IM_MAX(IM_MIN(fast_roundf(arg_roi.w / x_level_scale), level_img->w - arg_roi.x), 1);
+            arg_roi.h = IM_MAX(IM_MIN(fast_roundf(arg_roi.h / y_level_scale), level_img->h - arg_roi.y), 1);
+            arg_x_scale *= x_level_scale;
+            arg_y_scale *= y_level_scale;
+        }
+    }
+    #endif
+
     fb_alloc_mark();
     imlib_draw_image(arg_img, arg_other, arg_x_off, arg_y_off, arg_x_scale, arg_y_scale, &arg_roi,
                      arg_rgb_channel, arg_alpha, color_palette, alpha_palette, hint, NULL, NULL);
     fb_alloc_free_till_mark();
+
+    int dirty_w = fast_ceilf(fast_fabsf(arg_x_scale) * arg_roi.w);
+    int dirty_h = fast_ceilf(fast_fabsf(arg_y_scale) * arg_roi.h);
+    if (hint & IMAGE_HINT_CENTER) {
+        arg_x_off -= dirty_w / 2;
+        arg_y_off -= dirty_h / 2;
+    }
+    py_image_dirty_mark(args[0], arg_x_off - 1, arg_y_off - 1, dirty_w + 2, dirty_h + 2);
     return args[0];
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_draw_image_obj, 3, py_image_draw_image);
@@ -1785,6 +2077,7 @@ STATIC mp_obj_t py_image_draw_keypoints(size_t n_args, const mp_obj_t *args, mp_
             int co = cos_table[angle] * arg_s;
             imlib_draw_line(arg_img, cx, cy, cx + co, cy + si, arg_c, arg_thickness);
             imlib_draw_circle(arg_img, cx, cy, (arg_s - 2) / 2, arg_c, arg_thickness, arg_fill);
+            py_image_dirty_mark_line(args[0], cx, cy, cx, cy, abs(arg_s) + arg_thickness);
         }
     } else {
 #ifdef IMLIB_ENABLE_FIND_KEYPOINTS
@@ -1798,16 +2091,522 @@ STATIC mp_obj_t py_image_draw_keypoints(size_t n_args, const mp_obj_t *args, mp_
             int co = cos_table[angle] * arg_s;
             imlib_draw_line(arg_img, cx, cy, cx + co, cy + si, arg_c, arg_thickness);
             imlib_draw_circle(arg_img, cx, cy, (arg_s - 2) / 2, arg_c, arg_thickness, arg_fill);
+            py_image_dirty_mark_line(args[0], cx, cy, cx, cy, abs(arg_s) + arg_thickness);
         }
 #else
         PY_ASSERT_TRUE_MSG(false, "Expected a list of tuples!");
 #endif // IMLIB_ENABLE_FIND_KEYPOINTS
     }
 
+    py_image_dirty_mark(args[0], 0, 0, 0, 0); // Nothing else was touched, even with no keypoints.
     return args[0];
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_draw_keypoints_obj, 2, py_image_draw_keypoints);
 
+typedef struct py_image_polyline_args {
+    int c;
+    int thickness;
+    bool closed;
+    bool fill;
+    bool antialias;
+    int x_min, y_min, x_max, y_max;
+} py_image_polyline_args_t;
+
+static void py_image_polyline_draw(image_t *img, point_t *points, int n, py_image_polyline_args_t *pl) {
+    for (int i = 0; i < n; i++) {
+        pl->x_min = IM_MIN(pl->x_min, points[i].x);
+        pl->y_min = IM_MIN(pl->y_min, points[i].y);
+        pl->x_max = IM_MAX(pl->x_max, points[i].x);
+        pl->y_max = IM_MAX(pl->y_max, points[i].y);
+    }
+
+    if (pl->fill) {
+        imlib_fill_polygon(img, points, n, pl->c);
+        // Smooth the stair-stepped edges of the fill.
+        if (pl->antialias) {
+            imlib_draw_polyline(img, points, n, true, pl->c, 1, true);
+        }
+    } else {
+        imlib_draw_polyline(img, points, n, pl->closed, pl->c, pl->thickness, pl->antialias);
+    }
+}
+
+static bool py_image_is_point(mp_obj_t obj) {
+    if ((!MP_OBJ_IS_TYPE(obj, &mp_type_tuple)) && (!MP_OBJ_IS_TYPE(obj, &mp_type_list))) {
+        return false;
+    }
+
+    size_t len;
+    mp_obj_t *items;
+    mp_obj_get_array(obj, &len, &items);
+    return (len == 2) && (mp_obj_is_int(items[0]) || mp_obj_is_float(items[0]));
+}
+
+// Draws a (K, 2) ndarray, a (N, K, 2) ndarray of N polylines or a sequence of (x, y) pairs.
+static void py_image_polyline_obj(image_t *img, mp_obj_t obj, py_image_polyline_args_t *pl) {
+    if (mp_obj_is_type(obj, &ulab_ndarray_type)) {
+        ndarray_obj_t *nd = MP_OBJ_TO_PTR(obj);
+
+        if (((nd->ndim != 2) && (nd->ndim != 3)) || (nd->shape[ULAB_MAX_DIMS - 1] != 2)) {
+            mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("Expected a (K, 2) or (N, K, 2) ndarray!"));
+        }
+
+        int lines = (nd->ndim == 3) ? nd->shape[ULAB_MAX_DIMS - 3] : 1;
+        int n = nd->shape[ULAB_MAX_DIMS - 2];
+        int32_t *strides = nd->strides;
+        point_t *points = fb_alloc(n * sizeof(point_t), FB_ALLOC_NO_HINT);
+
+        for (int l = 0; l < lines; l++) {
+            uint8_t *row = ((uint8_t *) nd->array) + (l * strides[ULAB_MAX_DIMS - 3]);
+
+            for (int i = 0; i < n; i++, row += strides[ULAB_MAX_DIMS - 2]) {
+                points[i].x = fast_roundf(ndarray_get_float_value(row, nd->dtype));
+                points[i].y = fast_roundf(ndarray_get_float_value(row + strides[ULAB_MAX_DIMS - 1], nd->dtype));
+            }
+
+            py_image_polyline_draw(img, points, n, pl);
+        }
+
+        fb_free();
+    } else {
+        size_t n;
+        mp_obj_t *items;
+        mp_obj_get_array(obj, &n, &items);
+        point_t *points = fb_alloc(IM_MAX(n, 1U) * sizeof(point_t), FB_ALLOC_NO_HINT);
+
+        for (size_t i = 0; i < n; i++) {
+            mp_obj_t *xy;
+            mp_obj_get_array_fixed_n(items[i], 2, &xy);
+            points[i].x = fast_roundf(mp_obj_get_float(xy[0]));
+            points[i].y = fast_roundf(mp_obj_get_float(xy[1]));
+        }
+
+        py_image_polyline_draw(img, points, n, pl);
+        fb_free();
+    }
+}
+
+STATIC mp_obj_t py_image_draw_polyline(size_t n_args, const mp_obj_t *args, mp_map_t *kw_args) {
+    image_t *arg_img = py_helper_arg_to_image_mutable(args[0]);
+
+    py_image_polyline_args_t pl = {
+        .x_min = INT_MAX, .y_min = INT_MAX, .x_max = INT_MIN, .y_max = INT_MIN
+    };
+
+    pl.c =
+        py_helper_keyword_color(arg_img, n_args, args, 2, kw_args, -1); // White.
+    pl.thickness =
+        py_helper_keyword_int(n_args, args, 3, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_thickness), 1);
+    pl.closed =
+        py_helper_keyword_int(n_args, args, 4, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_closed), false);
+    pl.fill =
+        py_helper_keyword_int(n_args, args, 5, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_fill), false);
+    pl.antialias =
+        py_helper_keyword_int(n_args, args, 6, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_antialias), false);
+
+    fb_alloc_mark();
+
+    // A list of polylines (each a list of pairs or an ndarray) or a single polyline.
+    size_t len = 0;
+    mp_obj_t *items = NULL;
+    if (!mp_obj_is_type(args[1], &ulab_ndarray_type)) {
+        mp_obj_get_array(args[1], &len, &items);
+    }
+
+    if ((len > 0) && (!py_image_is_point(items[0]))) {
+        for (size_t i = 0; i < len; i++) {
+            py_image_polyline_obj(arg_img, items[i], &pl);
+        }
+    } else {
+        py_image_polyline_obj(arg_img, args[1], &pl);
+    }
+
+    fb_alloc_free_till_mark();
+
+    if (pl.x_min <= pl.x_max) {
+        int margin = pl.thickness + 1;
+        py_image_dirty_mark(args[0], pl.x_min - margin, pl.y_min - margin,
+                            pl.x_max - pl.x_min + (margin * 2) + 1, pl.y_max - pl.y_min + (margin * 2) + 1);
+    } else {
+        py_image_dirty_mark(args[0], 0, 0, 0, 0);
+    }
+
+    return args[0];
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_draw_polyline_obj, 2, py_image_draw_polyline);
+
+// Batch drawing. AI post-processing hands back ndarrays, these walk them in C so a frame
+// with a hundred detections is one call instead of a hundred.
+
+typedef struct py_image_matrix {
+    ndarray_obj_t *nd;      // NULL for nested sequences.
+    mp_obj_t *items;
+    size_t rows;
+} py_image_matrix_t;
+
+// Accepts a (N, C) or (N, K, C) ndarray, matching ndim, or nested sequences of numbers.
+static void py_image_matrix_init(py_image_matrix_t *m, mp_obj_t obj, int ndim, size_t min_cols) {
+    m->nd = NULL;
+    m->items = NULL;
+
+    if (mp_obj_is_type(obj, &ulab_ndarray_type)) {
+        m->nd = MP_OBJ_TO_PTR(obj);
+        if ((m->nd->ndim != ndim) || (m->nd->shape[ULAB_MAX_DIMS - 1] < min_cols)) {
+            mp_raise_msg_varg(&mp_type_ValueError, MP_ERROR_TEXT("Expected a %dD ndarray with at least %d columns!"),
+                              ndim, (int) min_cols);
+        }
+        m->rows = m->nd->shape[ULAB_MAX_DIMS - ndim];
+    } else {
+        mp_obj_get_array(obj, &m->rows, &m->items);
+
+        // Same column check as the ndarray shape, so a short row can't turn into NAN coordinates.
+        for (size_t i = 0; i < m->rows; i++) {
+            size_t n, len;
+            mp_obj_t *row, *items;
+            mp_obj_get_array(m->items[i], &n, &row);
+
+            for (size_t k = 0, kk = (ndim == 3) ? n : 1; k < kk; k++) {
+                len = n;
+                if (ndim == 3) {
+                    mp_obj_get_array(row[k], &len, &items);
+                }
+                if (len < min_cols) {
+                    mp_raise_msg_varg(&mp_type_ValueError,
+                                      MP_ERROR_TEXT("Expected %dD sequences with at least %d columns!"),
+                                      ndim, (int) min_cols);
+                }
+            }
+        }
+    }
+}
+
+// Number of K entries in row i of a 3D matrix.
+static size_t py_image_matrix_len(py_image_matrix_t *m, size_t i) {
+    if (m->nd) {
+        return m->nd->shape[ULAB_MAX_DIMS - 2];
+    }
+
+    size_t len;
+    mp_obj_t *items;
+    mp_obj_get_array(m->items[i], &len, &items);
+    return len;
+}
+
+// Element [i][j] of a 2D matrix or [i][k][j] of a 3D matrix, NAN if j is out of range.
+static float py_image_matrix_get(py_image_matrix_t *m, size_t i, size_t k, size_t j, bool three_d) {
+    if (m->nd) {
+        if (j >= m->nd->shape[ULAB_MAX_DIMS - 1]) {
+            return NAN;
+        }
+        int32_t *strides = m->nd->strides;
+        uint8_t *p = ((uint8_t *) m->nd->array) + (j * strides[ULAB_MAX_DIMS - 1]);
+        if (three_d) {
+            p += (i * strides[ULAB_MAX_DIMS - 3]) + (k * strides[ULAB_MAX_DIMS - 2]);
+        } else {
+            p += i * strides[ULAB_MAX_DIMS - 2];
+        }
+        return ndarray_get_float_value(p, m->nd->dtype);
+    }
+
+    size_t len;
+    mp_obj_t *items;
+    mp_obj_get_array(m->items[i], &len, &items);
+    if (three_d) {
+        mp_obj_get_array(items[k], &len, &items);
+    }
+    return (j < len) ? mp_obj_get_float(items[j]) : NAN;
+}
+
+// Reads element i of a 1D ndarray or a sequence.
+static float py_image_vector_get(mp_obj_t obj, size_t i) {
+    if (mp_obj_is_type(obj, &ulab_ndarray_type)) {
+        ndarray_obj_t *nd = MP_OBJ_TO_PTR(obj);
+        if (i >= nd->len) {
+            mp_raise_msg(&mp_type_IndexError, MP_ERROR_TEXT("Index out of range!"));
+        }
+        return ndarray_get_float_value(((uint8_t *) nd->array) + (i * nd->strides[ULAB_MAX_DIMS - 1]), nd->dtype);
+    }
+
+    size_t len;
+    mp_obj_t *items;
+    mp_obj_get_array(obj, &len, &items);
+    if (i >= len) {
+        mp_raise_msg(&mp_type_IndexError, MP_ERROR_TEXT("Index out of range!"));
+    }
+    return mp_obj_get_float(items[i]);
+}
+
+typedef struct py_image_palette {
+    int color;
+    size_t len;
+    int *colors;
+    mp_obj_t class_ids;
+} py_image_palette_t;
+
+// color= is a single color or a list of ([A,]R,G,B) colors picked by class id, or by
+// element index without class_ids.
+static void py_image_palette_init(py_image_palette_t *pal, image_t *img, uint n_args, const mp_obj_t *args,
+                                  uint arg_index, mp_map_t *kw_args, mp_obj_t class_ids) {
+    mp_obj_t color = py_helper_keyword_object(n_args, args, arg_index, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_color), NULL);
+    size_t len = 0;
+    mp_obj_t *items = NULL;
+
+    if (color && (!mp_obj_is_integer(color))) {
+        mp_obj_get_array(color, &len, &items);
+        if (len && mp_obj_is_integer(items[0])) {
+            len = 0;    // A single ([A,]R,G,B) tuple.
+        }
+    }
+
+    pal->color = len ? 0 : py_helper_keyword_color(img, n_args, args, arg_index, kw_args, -1);
+    pal->len = len;
+    pal->colors = NULL;
+    pal->class_ids = class_ids;
+
+    if (len) {
+        // Convert the palette once.
+        pal->colors = m_new(int, len);
+        for (size_t i = 0; i < len; i++) {
+            pal->colors[i] = py_helper_arg_to_color(img, items[i]);
+        }
+    }
+}
+
+static int py_image_palette_class(py_image_palette_t *pal, size_t i) {
+    return (pal->class_ids && (pal->class_ids != mp_const_none)) ? fast_floorf(py_image_vector_get(pal->class_ids, i)) : i;
+}
+
+static int py_image_palette_get(py_image_palette_t *pal, size_t i) {
+    if (!pal->len) {
+        return pal->color;
+    }
+
+    int index = py_image_palette_class(pal, i) % (int) pal->len;
+    return pal->colors[(index < 0) ? (index + pal->len) : index];
+}
+
+typedef struct py_image_box_args {
+    bool xyxy;
+    float x_scale, y_scale;
+} py_image_box_args_t;
+
+static void py_image_box_args_init(py_image_box_args_t *ba, uint n_args, const mp_obj_t *args,
+                                   uint arg_index, mp_map_t *kw_args) {
+    ba->xyxy = py_helper_keyword_int(n_args, args, arg_index, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_xyxy), false);
+    ba->x_scale = py_helper_keyword_float(n_args, args, arg_index + 1, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_x_scale), 1.0f);
+    ba->y_scale = py_helper_keyword_float(n_args, args, arg_index + 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_y_scale), 1.0f);
+}
+
+static void py_image_box_get(py_image_matrix_t *m, size_t i, py_image_box_args_t *ba, rectangle_t *r) {
+    float x = py_image_matrix_get(m, i, 0, 0, false);
+    float y = py_image_matrix_get(m, i, 0, 1, false);
+    float w = py_image_matrix_get(m, i, 0, 2, false);
+    float h = py_image_matrix_get(m, i, 0, 3, false);
+
+    if (ba->xyxy) {
+        w -= x;
+        h -= y;
+    }
+
+    int x0 = fast_roundf(x * ba->x_scale), y0 = fast_roundf(y * ba->y_scale);
+    int x1 = fast_roundf((x + w) * ba->x_scale), y1 = fast_roundf((y + h) * ba->y_scale);
+    rectangle_init(r, IM_MIN(x0, x1), IM_MIN(y0, y1), abs(x1 - x0), abs(y1 - y0));
+}
+
+STATIC mp_obj_t py_image_draw_boxes(size_t n_args, const mp_obj_t *args, mp_map_t *kw_args) {
+    image_t *arg_img = py_helper_arg_to_image_mutable(args[0]);
+
+    py_image_matrix_t boxes;
+    py_image_matrix_init(&boxes, args[1], 2, 4);
+
+    mp_obj_t arg_class_ids =
+        py_helper_keyword_object(n_args, args, 3, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_class_ids), NULL);
+    py_image_palette_t pal;
+    py_image_palette_init(&pal, arg_img, n_args, args, 2, kw_args, arg_class_ids);
+    int arg_thickness =
+        py_helper_keyword_int(n_args, args, 4, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_thickness), 1);
+    bool arg_fill =
+        py_helper_keyword_int(n_args, args, 5, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_fill), false);
+    py_image_box_args_t ba;
+    py_image_box_args_init(&ba, n_args, args, 6, kw_args);
+
+    for (size_t i = 0; i < boxes.rows; i++) {
+        rectangle_t r;
+        py_image_box_get(&boxes, i, &ba, &r);
+        imlib_draw_rectangle(arg_img, r.x, r.y, r.w, r.h, py_image_palette_get(&pal, i), arg_thickness, arg_fill);
+        py_image_dirty_mark(args[0], r.x - arg_thickness, r.y - arg_thickness,
+                            r.w + (arg_thickness * 2), r.h + (arg_thickness * 2));
+    }
+
+    py_image_dirty_mark(args[0], 0, 0, 0, 0);
+    return args[0];
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_draw_boxes_obj, 2, py_image_draw_boxes);
+
+STATIC mp_obj_t py_image_draw_labels(size_t n_args, const mp_obj_t *args, mp_map_t *kw_args) {
+    image_t *arg_img = py_helper_arg_to_image_mutable(args[0]);
+
+    py_image_matrix_t boxes;
+    py_image_matrix_init(&boxes, args[1], 2, 2);
+
+    mp_obj_t arg_class_ids =
+        py_helper_keyword_object(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_class_ids), mp_const_none);
+    mp_obj_t arg_scores =
+        py_helper_keyword_object(n_args, args, 3, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_scores), mp_const_none);
+    mp_obj_t arg_names =
+        py_helper_keyword_object(n_args, args, 4, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_names), mp_const_none);
+    py_image_palette_t pal;
+    py_image_palette_init(&pal, arg_img, n_args, args, 5, kw_args, arg_class_ids);
+    int arg_char_size =
+        py_helper_keyword_int(n_args, args, 6, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_char_size), 32);
+    mp_obj_t font_path_obj =
+        py_helper_keyword_object(n_args, args, 7, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_font), NULL);
+    py_image_box_args_t ba;
+    py_image_box_args_init(&ba, n_args, args, 8, kw_args);
+
+    const char *arg_font_path = font_path_obj ? mp_obj_str_get_str(font_path_obj) : NULL;
+
+    size_t names_len = 0;
+    mp_obj_t *names = NULL;
+    if (arg_names != mp_const_none) {
+        mp_obj_get_array(arg_names, &names_len, &names);
+    }
+
+    for (size_t i = 0; i < boxes.rows; i++) {
+        char text[64] = "";
+        int len = 0;
+        int class_id = (arg_class_ids != mp_const_none) ? fast_floorf(py_image_vector_get(arg_class_ids, i)) : -1;
+
+        if ((class_id >= 0) && (((size_t) class_id) < names_len)) {
+            len = snprintf(text, sizeof(text), "%s", mp_obj_str_get_str(names[class_id]));
+        } else if (class_id >= 0) {
+            len = snprintf(text, sizeof(text), "%d", class_id);
+        }
+
+        if ((arg_scores != mp_const_none) && (((size_t) len) < sizeof(text))) {
+            int score = fast_roundf(py_image_vector_get(arg_scores, i) * 100);
+            snprintf(text + len, sizeof(text) - len, "%s%d.%02d", len ? " " : "", score / 100, abs(score % 100));
+        }
+
+        if (!text[0]) {
+            continue; // No class name and no score, nothing to label.
+        }
+
+        // Just above the box, or inside it when the box touches the top of the image.
+        float x = py_image_matrix_get(&boxes, i, 0, 0, false);
+        float y = py_image_matrix_get(&boxes, i, 0, 1, false);
+        int x_off = fast_roundf(x * ba.x_scale);
+        int y_off = fast_roundf(y * ba.y_scale) - ((arg_char_size * 5) / 4);
+        if (y_off < 0) {
+            y_off += (arg_char_size * 5) / 4;
+        }
+
+        rectangle_t bbox;
+        imlib_draw_string_advance(arg_img, x_off, y_off, arg_char_size, text,
+                                  py_image_palette_get(&pal, i), arg_font_path, &bbox);
+        py_image_dirty_mark(args[0], bbox.x, bbox.y, bbox.w, bbox.h);
+    }
+
+    py_image_dirty_mark(args[0], 0, 0, 0, 0);
+    return args[0];
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_draw_labels_obj, 2, py_image_draw_labels);
+
+// A keypoint is hidden when its optional third column is below the threshold.
+static bool py_image_keypoint_get(py_image_matrix_t *m, size_t i, int k, int n, float threshold,
+                                  float x_scale, float y_scale, point_t *p) {
+    if ((k < 0) || (k >= n) || (py_image_matrix_get(m, i, k, 2, true) < threshold)) {
+        return false;
+    }
+
+    p->x = fast_roundf(py_image_matrix_get(m, i, k, 0, true) * x_scale);
+    p->y = fast_roundf(py_image_matrix_get(m, i, k, 1, true) * y_scale);
+    return true;
+}
+
+STATIC mp_obj_t py_image_draw_keypoints_batch(size_t n_args, const mp_obj_t *args, mp_map_t *kw_args) {
+    image_t *arg_img = py_helper_arg_to_image_mutable(args[0]);
+
+    py_image_matrix_t kpts;
+    py_image_matrix_init(&kpts, args[1], 3, 2);
+
+    mp_obj_t arg_skeleton =
+        py_helper_keyword_object(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_skeleton), mp_const_none);
+    py_image_palette_t pal;
+    py_image_palette_init(&pal, arg_img, n_args, args, 3, kw_args, NULL);
+    int arg_size =
+        py_helper_keyword_int(n_args, args, 4, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_size), 3);
+    int arg_thickness =
+        py_helper_keyword_int(n_args, args, 5, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_thickness), 2);
+    float arg_threshold =
+        py_helper_keyword_float(n_args, args, 6, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_threshold), 0.0f);
+    bool arg_antialias =
+        py_helper_keyword_int(n_args, args, 7, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_antialias), false);
+    float arg_x_scale =
+        py_helper_keyword_float(n_args, args, 8, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_x_scale), 1.0f);
+    float arg_y_scale =
+        py_helper_keyword_float(n_args, args, 9, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_y_scale), 1.0f);
+
+    size_t limbs_len = 0;
+    mp_obj_t *limbs = NULL;
+    if (arg_skeleton != mp_const_none) {
+        mp_obj_get_array(arg_skeleton, &limbs_len, &limbs);
+    }
+
+    // The skeleton is parsed once, not once per instance.
+    int *pairs = m_new(int, (limbs_len * 2) + 1);
+    for (size_t l = 0; l < limbs_len; l++) {
+        mp_obj_t *pair;
+        mp_obj_get_array_fixed_n(limbs[l], 2, &pair);
+        pairs[(l * 2) + 0] = mp_obj_get_int(pair[0]);
+        pairs[(l * 2) + 1] = mp_obj_get_int(pair[1]);
+    }
+
+    for (size_t i = 0; i < kpts.rows; i++) {
+        int c = py_image_palette_get(&pal, i);
+        int n = py_image_matrix_len(&kpts, i);
+        int x_min = INT_MAX, y_min = INT_MAX, x_max = INT_MIN, y_max = INT_MIN;
+
+        for (size_t l = 0; l < limbs_len; l++) {
+            point_t p0, p1;
+            if (py_image_keypoint_get(&kpts, i, pairs[(l * 2) + 0], n, arg_threshold, arg_x_scale, arg_y_scale, &p0)
+                && py_image_keypoint_get(&kpts, i, pairs[(l * 2) + 1], n, arg_threshold, arg_x_scale, arg_y_scale, &p1)) {
+                if (arg_antialias) {
+                    imlib_draw_line_aa(arg_img, p0.x, p0.y, p1.x, p1.y, c, arg_thickness);
+                } else {
+                    imlib_draw_line(arg_img, p0.x, p0.y, p1.x, p1.y, c, arg_thickness);
+                }
+            }
+        }
+
+        for (int k = 0; k < n; k++) {
+            point_t p;
+            if (py_image_keypoint_get(&kpts, i, k, n, arg_threshold, arg_x_scale, arg_y_scale, &p)) {
+                if (arg_antialias) {
+                    imlib_draw_circle_aa(arg_img, p.x, p.y, arg_size, c, 1, true);
+                } else {
+                    imlib_draw_circle(arg_img, p.x, p.y, arg_size, c, 1, true);
+                }
+                x_min = IM_MIN(x_min, p.x);
+                y_min = IM_MIN(y_min, p.y);
+                x_max = IM_MAX(x_max, p.x);
+                y_max = IM_MAX(y_max, p.y);
+            }
+        }
+
+        // Limbs only join visible keypoints so the keypoint bounds cover them too.
+        if (x_min <= x_max) {
+            int margin = IM_MAX(arg_size, arg_thickness) + 1;
+            py_image_dirty_mark(args[0], x_min - margin, y_min - margin,
+                                x_max - x_min + (margin * 2) + 1, y_max - y_min + (margin * 2) + 1);
+        }
+    }
+
+    py_image_dirty_mark(args[0], 0, 0, 0, 0);
+    return args[0];
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_draw_keypoints_batch_obj, 2, py_image_draw_keypoints_batch);
+
 STATIC mp_obj_t py_image_mask_rectangle(size_t n_args, const mp_obj_t *args, mp_map_t *kw_args) {
     image_t *arg_img = py_helper_arg_to_image_mutable(args[0]);
     int arg_rx;
@@ -2008,6 +2807,19 @@ STATIC mp_obj_t py_image_gamma(size_t n_args, const mp_obj_t *args, mp_map_t *kw
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_gamma_obj, 1, py_image_gamma);
 
+#ifdef IMLIB_ENABLE_COLOR_CORR
+STATIC mp_obj_t py_image_color_corr(mp_obj_t img_obj, mp_obj_t cc_obj) {
+    image_t *arg_img =
+        py_helper_arg_to_image_mutable(img_obj);
+    color_corr_t *arg_cc =
+        py_color_corr_cobj(cc_obj);
+
+    imlib_color_corr(arg_cc, arg_img);
+    return img_obj;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(py_image_color_corr_obj, py_image_color_corr);
+#endif // IMLIB_ENABLE_COLOR_CORR
+
 #endif // IMLIB_ENABLE_ISP_OPS
 
 #ifdef IMLIB_ENABLE_BINARY_OPS
@@ -2078,6 +2890,88 @@ STATIC mp_obj_t py_image_binary(size_t n_args, const mp_obj_t *args, mp_map_t *k
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_binary_obj, 2, py_image_binary);
 
+#ifdef IMLIB_ENABLE_ADAPTIVE_THRESHOLD
+// Always outputs a bitmap, in place unless copy is set.
+STATIC mp_obj_t py_image_adaptive_threshold(size_t n_args, const mp_obj_t *args, mp_map_t *kw_args) {
+    image_t *arg_img =
+        py_helper_arg_to_image_mutable(args[0]);
+    int arg_ksize =
+        py_helper_arg_to_ksize(args[1]);
+    int arg_method =
+        py_helper_keyword_int(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_method), ADAPTIVE_THRESHOLD_MEAN);
+    int arg_offset =
+        py_helper_keyword_int(n_args, args, 3, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_offset), 0);
+    float arg_k =
+        py_helper_keyword_float(n_args, args, 4, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_k), 0.34f);
+    bool arg_invert =
+        py_helper_keyword_int(n_args, args, 5, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_invert), false);
+    image_t *arg_msk =
+        py_helper_keyword_to_image_mutable_mask(n_args, args, 6, kw_args);
+    bool arg_copy =
+        py_helper_keyword_int(n_args, args, 7, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_copy), false);
+
+    if ((arg_method < ADAPTIVE_THRESHOLD_MEAN) || (ADAPTIVE_THRESHOLD_OTSU < arg_method)) {
+        mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("Invalid adaptive threshold method!"));
+    }
+
+    #ifndef IMLIB_ENABLE_GAUSSIAN
+    if (arg_method == ADAPTIVE_THRESHOLD_GAUSSIAN) {
+        mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("Gaussian is not enabled!"));
+    }
+    #endif
+
+    if ((arg_img->pixfmt != PIXFORMAT_BINARY) && (arg_img->pixfmt != PIXFORMAT_GRAYSCALE) &&
+        (arg_img->pixfmt != PIXFORMAT_RGB565) && (arg_img->pixfmt != PIXFORMAT_RGB888)) {
+        mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("Expected a BINARY, GRAYSCALE, RGB565 or RGB888 image!"));
+    }
+
+    if (!arg_copy) {
+        switch (arg_img->pixfmt) {
+            case PIXFORMAT_GRAYSCALE: {
+                PY_ASSERT_TRUE_MSG((arg_img->w >= (sizeof(uint32_t) / sizeof(uint8_t))),
+                                   "Can't convert to bitmap in place!");
+                break;
+            }
+            case PIXFORMAT_RGB565: {
+                PY_ASSERT_TRUE_MSG((arg_img->w >= (sizeof(uint32_t) / sizeof(uint16_t))),
+                                   "Can't convert to bitmap in place!");
+                break;
+            }
+            case PIXFORMAT_RGB888: {
+                PY_ASSERT_TRUE_MSG(((arg_img->w * 3) >= sizeof(uint32_t)),
+                                   "Can't convert to bitmap in place!");
+                break;
+            }
+            default: {
+                break;
+            }
+        }
+    }
+
+    image_t out;
+    out.w = arg_img->w;
+    out.h = arg_img->h;
+    out.pixfmt = PIXFORMAT_BINARY;
+    if (arg_copy)
+        py_image_alloc(&out, kw_args);
+    else
+        out.pixels = arg_img->pixels;
+
+    fb_alloc_mark();
+    imlib_adaptive_threshold(&out, arg_img, arg_method, arg_ksize, arg_offset, arg_k, arg_invert, arg_msk);
+    fb_alloc_free_till_mark();
+
+    if (!arg_copy) {
+        arg_img->pixfmt = PIXFORMAT_BINARY;
+        py_helper_update_framebuffer(&out);
+        return args[0];
+    }
+
+    return py_image_from_struct(&out);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_adaptive_threshold_obj, 2, py_image_adaptive_threshold);
+#endif // IMLIB_ENABLE_ADAPTIVE_THRESHOLD
+
 STATIC mp_obj_t py_image_invert(mp_obj_t img_obj) {
     imlib_invert(py_helper_arg_to_image_mutable(img_obj));
     return img_obj;
@@ -2601,8 +3495,17 @@ static mp_obj_t py_image_histeq(size_t n_args, const mp_obj_t *args, mp_map_t *k
     image_t *arg_msk =
         py_helper_keyword_to_image_mutable_mask(n_args, args, 3, kw_args);
 
+    #if defined(IMLIB_ENABLE_CLAHE)
+    // A CLAHE object carries its own settings and the tile tables of the previous frames.
+    clahe_t *arg_clahe = py_helper_keyword_clahe(n_args, args, 4, kw_args);
+    #else
+    clahe_t *arg_clahe = NULL;
+    #endif
+
     fb_alloc_mark();
-    if (arg_adaptive) {
+    if (arg_clahe) {
+        imlib_clahe(arg_clahe, arg_img, arg_msk);
+    } else if (arg_adaptive) {
         imlib_clahe_histeq(arg_img, arg_clip_limit, arg_msk);
     } else{
         imlib_histeq(arg_img, arg_msk);
@@ -2762,38 +3665,24 @@ STATIC mp_obj_t py_image_gaussian(size_t n_args, const mp_obj_t *args, mp_map_t
         py_helper_arg_to_image_mutable(args[0]);
     int arg_ksize =
         py_helper_arg_to_ksize(args[1]);
+    bool arg_unsharp =
+        py_helper_keyword_int(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_unsharp), false);
 
-    int k_2 = arg_ksize * 2;
-    int n = k_2 + 1;
-
-    fb_alloc_mark();
-
-    int *pascal = fb_alloc(n * sizeof(int), FB_ALLOC_NO_HINT);
-    pascal[0] = 1;
-
-    for (int i = 0; i < k_2; i++) {
-        // Compute a row of pascal's triangle.
-        pascal[i + 1] = (pascal[i] * (k_2 - i)) / (i + 1);
-    }
+    mp_obj_t arg_mul_obj =
+        py_helper_keyword_object(n_args, args, 3, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_mul), NULL);
+    float arg_mul = arg_unsharp ? -1.0f : 1.0f;
 
-    int *arg_krn = fb_alloc(n * n * sizeof(int), FB_ALLOC_NO_HINT);
-    int arg_m = 0;
+    if (arg_mul_obj) {
+        // mul scales the sum of the pascal kernel, 2^(4 * ksize), the blur works on normalized values.
+        double arg_m = 1.0;
 
-    for (int i = 0; i < n; i++) {
-        for (int j = 0; j < n; j++) {
-            int temp = pascal[i] * pascal[j];
-            arg_krn[(i * n) + j] = temp;
-            arg_m += temp;
+        for (int i = 0; i < arg_ksize; i++) {
+            arg_m *= 16.0;
         }
-    }
 
-    if (py_helper_keyword_int(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_unsharp), false)) {
-        arg_krn[((n / 2) * n) + (n / 2)] -= arg_m * 2;
-        arg_m = -arg_m;
+        arg_mul = mp_obj_get_float(arg_mul_obj) * arg_m;
     }
 
-    float arg_mul =
-        py_helper_keyword_float(n_args, args, 3, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_mul), 1.0f / arg_m);
     float arg_add =
         py_helper_keyword_float(n_args, args, 4, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_add), 0.0f);
     bool arg_threshold =
@@ -2805,7 +3694,9 @@ STATIC mp_obj_t py_image_gaussian(size_t n_args, const mp_obj_t *args, mp_map_t
     image_t *arg_msk =
         py_helper_keyword_to_image_mutable_mask(n_args, args, 8, kw_args);
 
-    imlib_morph(arg_img, arg_ksize, arg_krn, arg_mul, arg_add, arg_threshold, arg_offset, arg_invert, arg_msk);
+    fb_alloc_mark();
+    imlib_gaussian_filter(arg_img, arg_ksize, arg_unsharp, arg_mul, arg_add,
+                          arg_threshold, arg_offset, arg_invert, arg_msk);
     fb_alloc_free_till_mark();
     return args[0];
 }
@@ -2888,10 +3779,12 @@ STATIC mp_obj_t py_image_bilateral(size_t n_args, const mp_obj_t *args, mp_map_t
         py_helper_keyword_int(n_args, args, 6, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_invert), false);
     image_t *arg_msk =
         py_helper_keyword_to_image_mutable_mask(n_args, args, 7, kw_args);
+    bool arg_fast =
+        py_helper_keyword_int(n_args, args, 8, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_fast), false);
 
     fb_alloc_mark();
-    imlib_bilateral_filter(arg_img, arg_ksize, arg_color_sigma, arg_space_sigma, arg_threshold, arg_offset, arg_invert,
-                           arg_msk);
+    imlib_bilateral_filter(arg_img, arg_ksize, arg_color_sigma, arg_space_sigma, arg_fast, arg_threshold, arg_offset,
+                           arg_invert, arg_msk);
     fb_alloc_free_till_mark();
     return args[0];
 }
@@ -3019,6 +3912,73 @@ STATIC mp_obj_t py_image_rotation_corr(size_t n_args, const mp_obj_t *args, mp_m
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_rotation_corr_obj, 1, py_image_rotation_corr);
 #endif // IMLIB_ENABLE_ROTATION_CORR
 
+#ifdef IMLIB_ENABLE_REMAP
+STATIC mp_obj_t py_image_remap(size_t n_args, const mp_obj_t *args, mp_map_t *kw_args) {
+    image_t *arg_img =
+        py_helper_arg_to_image_mutable(args[0]);
+    remap_t *arg_remap =
+        py_remap_cobj(args[1]);
+    image_t *arg_dst =
+        py_helper_keyword_to_image_mutable(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_dst), NULL);
+    bool arg_bilinear =
+        py_helper_keyword_int(n_args, args, 3, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_bilinear), false);
+
+    fb_alloc_mark();
+
+    if (arg_dst && (arg_dst->data != arg_img->data)) {
+        imlib_remap(arg_remap, arg_dst, arg_img, arg_bilinear);
+    } else {
+        // Create a tmp copy of the image to pull pixels from.
+        image_t src = *arg_img;
+        src.data = fb_alloc(image_size(arg_img), FB_ALLOC_NO_HINT);
+        memcpy(src.data, arg_img->data, image_size(arg_img));
+        imlib_remap(arg_remap, arg_img, &src, arg_bilinear);
+    }
+
+    fb_alloc_free_till_mark();
+    return arg_dst ? py_helper_keyword_object(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_dst), NULL) : args[0];
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_remap_obj, 2, py_image_remap);
+#endif // IMLIB_ENABLE_REMAP
+
+#ifdef IMLIB_ENABLE_PIPELINE
+STATIC mp_obj_t py_image_pipeline(size_t n_args, const mp_obj_t *args, mp_map_t *kw_args) {
+    image_t *arg_img =
+        py_helper_arg_to_image_mutable(args[0]);
+    pipeline_t *arg_pipeline =
+        py_pipeline_cobj(args[1]);
+    image_t *arg_dst =
+        py_helper_keyword_to_image_mutable(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_dst), NULL);
+
+    image_t out = *arg_img;
+    out.pixfmt = imlib_pipeline_pixfmt(arg_pipeline, arg_img->pixfmt);
+
+    if (arg_dst) {
+        PY_ASSERT_TRUE_MSG((arg_dst->w == out.w) && (arg_dst->h == out.h) && (arg_dst->pixfmt == out.pixfmt),
+                           "Destination image does not match the pipeline output!");
+        out.data = arg_dst->data;
+    } else {
+        PY_ASSERT_TRUE_MSG(image_size(&out) <= image_size(arg_img), "Can't convert to a larger format in place!");
+    }
+
+    fb_alloc_mark();
+    imlib_pipeline_run(arg_pipeline, &out, arg_img);
+    fb_alloc_free_till_mark();
+
+    if (arg_dst) {
+        return py_helper_keyword_object(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_dst), NULL);
+    }
+
+    if (out.pixfmt != arg_img->pixfmt) {
+        arg_img->pixfmt = out.pixfmt;
+        py_helper_update_framebuffer(arg_img);
+    }
+
+    return args[0];
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_pipeline_obj, 2, py_image_pipeline);
+#endif // IMLIB_ENABLE_PIPELINE
+
 //////////////
 // Get Methods
 //////////////
@@ -4835,10 +5795,14 @@ static mp_obj_t py_image_find_lines(size_t n_args, const mp_obj_t *args, mp_map_
     uint32_t threshold = py_helper_keyword_int(n_args, args, 4, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_threshold), 1000);
     unsigned int theta_margin = py_helper_keyword_int(n_args, args, 5, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_theta_margin), 25);
     unsigned int rho_margin = py_helper_keyword_int(n_args, args, 6, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_rho_margin), 25);
+    unsigned int theta_window = py_helper_keyword_int(n_args, args, 7, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_theta_window), 0);
+    PY_ASSERT_TRUE_MSG(theta_window < 90, "theta_window must be less than 90.");
+    bool probabilistic = py_helper_keyword_int(n_args, args, 8, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_probabilistic), false);
 
     list_t out;
     fb_alloc_mark();
-    imlib_find_lines(&out, arg_img, &roi, x_stride, y_stride, threshold, theta_margin, rho_margin);
+    imlib_find_lines(&out, arg_img, &roi, x_stride, y_stride, threshold, theta_margin, rho_margin,
+                     theta_window, probabilistic);
     fb_alloc_free_till_mark();
 
     mp_obj_list_t *objects_list = mp_obj_new_list(list_size(&out), NULL);
@@ -4876,10 +5840,13 @@ static mp_obj_t py_image_find_line_segments(size_t n_args, const mp_obj_t *args,
 
     unsigned int merge_distance = py_helper_keyword_int(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_merge_distance), 0);
     unsigned int max_theta_diff = py_helper_keyword_int(n_args, args, 3, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_max_theta_diff), 15);
+    // fast=True trades exactness for speed: segments are close to the default ones (endpoints
+    // typically within 2 pixels) but some are split or merged differently.
+    bool fast = py_helper_keyword_int(n_args, args, 4, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_fast), false);
 
     list_t out;
     fb_alloc_mark();
-    imlib_lsd_find_line_segments(&out, arg_img, &roi, merge_distance, max_theta_diff);
+    imlib_lsd_find_line_segments(&out, arg_img, &roi, merge_distance, max_theta_diff, fast);
     fb_alloc_free_till_mark();
 
     mp_obj_list_t *objects_list = mp_obj_new_list(list_size(&out), NULL);
@@ -6150,7 +7117,16 @@ STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_find_displacement_obj, 2, py_image_fi
 
 #ifdef IMLIB_FIND_TEMPLATE
 static mp_obj_t py_image_find_template(size_t n_args, const mp_obj_t *args, mp_map_t *kw_args) {
-    image_t *arg_img = py_helper_arg_to_image_grayscale(args[0]);
+    image_t *arg_img = py_helper_arg_to_image_not_compressed(args[0]);
+    #ifdef IMLIB_ENABLE_PYRAMID
+    pyramid_t *pyr = py_helper_keyword_pyramid(arg_img, n_args, args, 6, kw_args);
+    if (pyr) {
+        PY_ASSERT_TRUE_MSG(pyr->luma, "Expected a luma pyramid!");
+    } else
+    #endif
+    {
+        arg_img = py_helper_arg_to_image_grayscale(args[0]);
+    }
     image_t *arg_template = py_helper_arg_to_image_grayscale(args[1]);
     float arg_thresh = mp_obj_get_float(args[2]);
 
@@ -6172,7 +7148,12 @@ static mp_obj_t py_image_find_template(size_t n_args, const mp_obj_t *args, mp_m
     rectangle_t r;
     float corr;
     fb_alloc_mark();
-    if (search == SEARCH_DS) {
+    if (0) {
+    #ifdef IMLIB_ENABLE_PYRAMID
+    } else if (pyr) {
+        corr = imlib_template_match_pyramid(pyr, arg_template, &roi, step, &r);
+    #endif
+    } else if (search == SEARCH_DS) {
         corr = imlib_template_match_ds(arg_img, arg_template, &r);
     } else {
         corr = imlib_template_match_ex(arg_img, arg_template, &roi, step, &r);
@@ -6206,9 +7187,24 @@ static mp_obj_t py_image_find_features(size_t n_args, const mp_obj_t *args, mp_m
     PY_ASSERT_TRUE_MSG((roi.w > cascade->window.w && roi.h > cascade->window.h),
                        "Region of interest is smaller than detector window!");
 
+    #ifdef IMLIB_ENABLE_PYRAMID
+    pyramid_t *pyr = py_helper_keyword_pyramid(arg_img, n_args, args, 5, kw_args);
+    if (pyr) {
+        PY_ASSERT_TRUE_MSG(pyr->luma, "Expected a luma pyramid!");
+    }
+    #endif
+
     // Detect objects
+    array_t *objects_array;
     fb_alloc_mark();
-    array_t *objects_array = imlib_detect_objects(arg_img, cascade, &roi);
+    #ifdef IMLIB_ENABLE_PYRAMID
+    if (pyr) {
+        objects_array = imlib_detect_objects_pyramid(pyr, cascade, &roi);
+    } else
+    #endif
+    {
+        objects_array = imlib_detect_objects(arg_img, cascade, &roi);
+    }
     fb_alloc_free_till_mark();
 
     // Add detected objects to a new Python list...
@@ -6263,7 +7259,16 @@ STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_find_lbp_obj, 2, py_image_find_lbp);
 
 #ifdef IMLIB_ENABLE_FIND_KEYPOINTS
 static mp_obj_t py_image_find_keypoints(size_t n_args, const mp_obj_t *args, mp_map_t *kw_args) {
-    image_t *arg_img = py_helper_arg_to_image_grayscale(args[0]);
+    image_t *arg_img = py_helper_arg_to_image_not_compressed(args[0]);
+    #ifdef IMLIB_ENABLE_PYRAMID
+    pyramid_t *pyr = py_helper_keyword_pyramid(arg_img, n_args, args, 7, kw_args);
+    if (pyr) {
+        PY_ASSERT_TRUE_MSG(pyr->luma, "Expected a luma pyramid!");
+    } else
+    #endif
+    {
+        arg_img = py_helper_arg_to_image_grayscale(args[0]);
+    }
 
     rectangle_t roi;
     py_helper_keyword_rectangle_roi(arg_img, n_args, args, 1, kw_args, &roi);
@@ -6285,8 +7290,16 @@ static mp_obj_t py_image_find_keypoints(size_t n_args, const mp_obj_t *args, mp_
     #endif
 
     // Find keypoints
+    array_t *kpts;
     fb_alloc_mark();
-    array_t *kpts = orb_find_keypoints(arg_img, normalized, threshold, scale_factor, max_keypoints, corner_detector, &roi);
+    #ifdef IMLIB_ENABLE_PYRAMID
+    if (pyr) {
+        kpts = orb_find_keypoints_pyramid(pyr, normalized, threshold, max_keypoints, corner_detector, &roi);
+    } else
+    #endif
+    {
+        kpts = orb_find_keypoints(arg_img, normalized, threshold, scale_factor, max_keypoints, corner_detector, &roi);
+    }
     fb_alloc_free_till_mark();
 
     if (array_length(kpts)) {
@@ -6398,23 +7411,90 @@ static mp_obj_t py_image_stereo_disparity(size_t n_args, const mp_obj_t *args, m
 
     int reversed = py_helper_keyword_int(n_args, args, 1, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_reversed), false);
     int max_disparity = py_helper_keyword_int(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_max_disparity), 64);
-    int threshold = py_helper_keyword_int(n_args, args, 3, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_threshold), 64);
+    // The block matcher's threshold keyword has no SGM equivalent, it is accepted and ignored.
 
     if ((max_disparity < 1) || (255 < max_disparity)) {
         mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("1 <= max_disparity <= 255!"));
     }
 
-    if (threshold < 0) {
-        mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("0 <= threshold!"));
-    }
-
     fb_alloc_mark();
-    imlib_stereo_disparity(img, reversed, max_disparity, threshold);
+    imlib_stereo_disparity(img, reversed, max_disparity);
     fb_alloc_free_till_mark();
 
     return args[0];
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_stereo_disparity_obj, 1, py_image_stereo_disparity);
+
+// Returns a uint16 ndarray of disparities in 1/16th pixels, 0xFFFF where the left-right check failed.
+static mp_obj_t py_image_stereo_sgm(size_t n_args, const mp_obj_t *args, mp_map_t *kw_args) {
+    image_t *img = py_helper_arg_to_image_not_compressed(args[0]);
+    mp_obj_t right_obj = py_helper_keyword_object(n_args, args, 1, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_right), NULL);
+    int max_disparity = py_helper_keyword_int(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_max_disparity), 64);
+    int p1 = py_helper_keyword_int(n_args, args, 3, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_p1), STEREO_DEFAULT_P1);
+    int p2 = py_helper_keyword_int(n_args, args, 4, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_p2), STEREO_DEFAULT_P2);
+    // Largest left-right disparity difference kept, -1 turns the check off.
+    int lr_max_diff = py_helper_keyword_int(n_args, args, 5, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_lr_max_diff), 1);
+    bool subpixel = py_helper_keyword_int(n_args, args, 6, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_subpixel), true);
+    bool reversed = py_helper_keyword_int(n_args, args, 7, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_reversed), false);
+
+    image_t *right = img;
+    rectangle_t roi_l = { 0, 0, img->w, img->h };
+    rectangle_t roi_r = roi_l;
+
+    if (right_obj) {
+        right = py_helper_arg_to_image_not_compressed(right_obj);
+
+        if ((right->w != img->w) || (right->h != img->h) || (right->pixfmt != img->pixfmt)) {
+            mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("Images must have the same size and format!"));
+        }
+    } else {
+        if (img->w % 2) {
+            mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("Image width must be even!"));
+        }
+
+        roi_l.w = roi_r.w = img->w / 2;
+        roi_r.x = roi_l.w;
+    }
+
+    if (reversed) {
+        image_t *tmp = img;
+        img = right;
+        right = tmp;
+        int x = roi_l.x;
+        roi_l.x = roi_r.x;
+        roi_r.x = x;
+    }
+
+    if ((img->pixfmt != PIXFORMAT_BINARY) && (img->pixfmt != PIXFORMAT_GRAYSCALE) && (img->pixfmt != PIXFORMAT_RGB565)) {
+        mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("Expected a BINARY, GRAYSCALE or RGB565 image!"));
+    }
+
+    if ((max_disparity < 1) || (255 < max_disparity)) {
+        mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("1 <= max_disparity <= 255!"));
+    }
+
+    if ((p1 < 0) || (p2 < p1) || (1024 < p2)) {
+        mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("0 <= p1 <= p2 <= 1024!"));
+    }
+
+    stereo_settings_t settings = {
+        .max_disparity = max_disparity,
+        .p1 = p1,
+        .p2 = p2,
+        .lr_max_diff = lr_max_diff,
+        .subpixel = subpixel
+    };
+
+    size_t shape[4] = { 0, 0, roi_l.h, roi_l.w };
+    ndarray_obj_t *ndarray = ndarray_new_dense_ndarray(2, shape, NDARRAY_UINT16);
+
+    fb_alloc_mark();
+    imlib_stereo_sgm((uint16_t *) ndarray->array, img, &roi_l, right, &roi_r, &settings);
+    fb_alloc_free_till_mark();
+
+    return MP_OBJ_FROM_PTR(ndarray);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_image_stereo_sgm_obj, 1, py_image_stereo_sgm);
 #endif // IMLIB_ENABLE_STEREO_DISPARITY
 
 static const mp_rom_map_elem_t locals_dict_table[] = {
@@ -6451,6 +7531,8 @@ static const mp_rom_map_elem_t locals_dict_table[] = {
     {MP_ROM_QSTR(MP_QSTR_to_grayscale),        MP_ROM_PTR(&py_image_to_grayscale_obj)},
     {MP_ROM_QSTR(MP_QSTR_to_rgb565),           MP_ROM_PTR(&py_image_to_rgb565_obj)},
     {MP_ROM_QSTR(MP_QSTR_to_rgb888),           MP_ROM_PTR(&py_image_to_rgb888_obj)},
+    {MP_ROM_QSTR(MP_QSTR_to_rgbp888),          MP_ROM_PTR(&py_image_to_rgbp888_obj)},
+    {MP_ROM_QSTR(MP_QSTR_to_yuv420),           MP_ROM_PTR(&py_image_to_yuv420_obj)},
     {MP_ROM_QSTR(MP_QSTR_to_rainbow),          MP_ROM_PTR(&py_image_to_rainbow_obj)},
     {MP_ROM_QSTR(MP_QSTR_to_ironbow),          MP_ROM_PTR(&py_image_to_ironbow_obj)},
     {MP_ROM_QSTR(MP_QSTR_to_jpeg),             MP_ROM_PTR(&py_image_to_jpeg_obj)},
@@ -6472,6 +7554,9 @@ static const mp_rom_map_elem_t locals_dict_table[] = {
     {MP_ROM_QSTR(MP_QSTR_flush),               MP_ROM_PTR(&py_image_flush_obj)},
     /* Drawing Methods */
     {MP_ROM_QSTR(MP_QSTR_clear),               MP_ROM_PTR(&py_image_clear_obj)},
+    {MP_ROM_QSTR(MP_QSTR_track_dirty),         MP_ROM_PTR(&py_image_track_dirty_obj)},
+    {MP_ROM_QSTR(MP_QSTR_dirty_rects),         MP_ROM_PTR(&py_image_dirty_rects_obj)},
+    {MP_ROM_QSTR(MP_QSTR_flush_dirty),         MP_ROM_PTR(&py_image_flush_dirty_obj)},
     {MP_ROM_QSTR(MP_QSTR_draw_line),           MP_ROM_PTR(&py_image_draw_line_obj)},
     {MP_ROM_QSTR(MP_QSTR_draw_rectangle),      MP_ROM_PTR(&py_image_draw_rectangle_obj)},
     {MP_ROM_QSTR(MP_QSTR_draw_circle),         MP_ROM_PTR(&py_image_draw_circle_obj)},
@@ -6488,6 +7573,10 @@ static const mp_rom_map_elem_t locals_dict_table[] = {
     {MP_ROM_QSTR(MP_QSTR_flood_fill),          MP_ROM_PTR(&py_func_unavailable_obj)},
     #endif
     {MP_ROM_QSTR(MP_QSTR_draw_keypoints),      MP_ROM_PTR(&py_image_draw_keypoints_obj)},
+    {MP_ROM_QSTR(MP_QSTR_draw_polyline),       MP_ROM_PTR(&py_image_draw_polyline_obj)},
+    {MP_ROM_QSTR(MP_QSTR_draw_boxes),          MP_ROM_PTR(&py_image_draw_boxes_obj)},
+    {MP_ROM_QSTR(MP_QSTR_draw_labels),         MP_ROM_PTR(&py_image_draw_labels_obj)},
+    {MP_ROM_QSTR(MP_QSTR_draw_keypoints_batch), MP_ROM_PTR(&py_image_draw_keypoints_batch_obj)},
     {MP_ROM_QSTR(MP_QSTR_mask_rectangle),      MP_ROM_PTR(&py_image_mask_rectangle_obj)},
     {MP_ROM_QSTR(MP_QSTR_mask_circle),         MP_ROM_PTR(&py_image_mask_circle_obj)},
     {MP_ROM_QSTR(MP_QSTR_mask_ellipse),        MP_ROM_PTR(&py_image_mask_ellipse_obj)},
@@ -6497,15 +7586,26 @@ static const mp_rom_map_elem_t locals_dict_table[] = {
     {MP_ROM_QSTR(MP_QSTR_ccm),                 MP_ROM_PTR(&py_ccm_obj)},
     {MP_ROM_QSTR(MP_QSTR_gamma),               MP_ROM_PTR(&py_image_gamma_obj)},
     {MP_ROM_QSTR(MP_QSTR_gamma_corr),          MP_ROM_PTR(&py_image_gamma_obj)},
+    #ifdef IMLIB_ENABLE_COLOR_CORR
+    {MP_ROM_QSTR(MP_QSTR_color_corr),          MP_ROM_PTR(&py_image_color_corr_obj)},
+    #else
+    {MP_ROM_QSTR(MP_QSTR_color_corr),          MP_ROM_PTR(&py_func_unavailable_obj)},
+    #endif
     #else
     {MP_ROM_QSTR(MP_QSTR_awb),                 MP_ROM_PTR(&py_func_unavailable_obj)},
     {MP_ROM_QSTR(MP_QSTR_ccm),                 MP_ROM_PTR(&py_func_unavailable_obj)},
     {MP_ROM_QSTR(MP_QSTR_gamma),               MP_ROM_PTR(&py_func_unavailable_obj)},
     {MP_ROM_QSTR(MP_QSTR_gamma_corr),          MP_ROM_PTR(&py_func_unavailable_obj)},
+    {MP_ROM_QSTR(MP_QSTR_color_corr),          MP_ROM_PTR(&py_func_unavailable_obj)},
     #endif // IMLIB_ENABLE_ISP_OPS
     /* Binary Methods */
     #ifdef IMLIB_ENABLE_BINARY_OPS
     {MP_ROM_QSTR(MP_QSTR_binary),              MP_ROM_PTR(&py_image_binary_obj)},
+    #ifdef IMLIB_ENABLE_ADAPTIVE_THRESHOLD
+    {MP_ROM_QSTR(MP_QSTR_adaptive_threshold),  MP_ROM_PTR(&py_image_adaptive_threshold_obj)},
+    #else
+    {MP_ROM_QSTR(MP_QSTR_adaptive_threshold),  MP_ROM_PTR(&py_func_unavailable_obj)},
+    #endif
     {MP_ROM_QSTR(MP_QSTR_invert),              MP_ROM_PTR(&py_image_invert_obj)},
     {MP_ROM_QSTR(MP_QSTR_and),                 MP_ROM_PTR(&py_image_b_and_obj)},
     {MP_ROM_QSTR(MP_QSTR_b_and),               MP_ROM_PTR(&py_image_b_and_obj)},
@@ -6650,6 +7750,16 @@ static const mp_rom_map_elem_t locals_dict_table[] = {
     #else
     {MP_ROM_QSTR(MP_QSTR_rotation_corr),       MP_ROM_PTR(&py_func_unavailable_obj)},
     #endif
+    #ifdef IMLIB_ENABLE_REMAP
+    {MP_ROM_QSTR(MP_QSTR_remap),               MP_ROM_PTR(&py_image_remap_obj)},
+    #else
+    {MP_ROM_QSTR(MP_QSTR_remap),               MP_ROM_PTR(&py_func_unavailable_obj)},
+    #endif
+    #ifdef IMLIB_ENABLE_PIPELINE
+    {MP_ROM_QSTR(MP_QSTR_pipeline),            MP_ROM_PTR(&py_image_pipeline_obj)},
+    #else
+    {MP_ROM_QSTR(MP_QSTR_pipeline),            MP_ROM_PTR(&py_func_unavailable_obj)},
+    #endif
     /* Get Methods */
     #ifdef IMLIB_ENABLE_GET_SIMILARITY
     {MP_ROM_QSTR(MP_QSTR_get_similarity),      MP_ROM_PTR(&py_image_get_similarity_obj)},
@@ -6744,8 +7854,10 @@ static const mp_rom_map_elem_t locals_dict_table[] = {
     #endif
     #ifdef IMLIB_ENABLE_STEREO_DISPARITY
     {MP_ROM_QSTR(MP_QSTR_stereo_disparity),    MP_ROM_PTR(&py_image_stereo_disparity_obj)},
+    {MP_ROM_QSTR(MP_QSTR_stereo_sgm),          MP_ROM_PTR(&py_image_stereo_sgm_obj)},
     #else
     {MP_ROM_QSTR(MP_QSTR_stereo_disparity),    MP_ROM_PTR(&py_func_unavailable_obj)},
+    {MP_ROM_QSTR(MP_QSTR_stereo_sgm),          MP_ROM_PTR(&py_func_unavailable_obj)},
     #endif
 };
 
@@ -6993,6 +8105,7 @@ mp_obj_t py_image(int w, int h, pixformat_t pixfmt, uint32_t size, void *pixels)
     o->_cobj.size = size;
     o->_cobj.pixfmt = pixfmt;
     o->_cobj.pixels = pixels;
+    o->dirty = NULL;
     return o;
 }
 
@@ -7000,6 +8113,7 @@ mp_obj_t py_image_from_struct(image_t *img) {
     py_image_obj_t *o = m_new_obj_with_finaliser(py_image_obj_t);
     o->base.type = &py_image_type;
     o->_cobj = *img;
+    o->dirty = NULL;
     return o;
 }
 
@@ -7501,6 +8615,10 @@ static const mp_rom_map_elem_t globals_dict_table[] = {
     #endif
     {MP_ROM_QSTR(MP_QSTR_EDGE_CANNY),          MP_ROM_INT(EDGE_CANNY)},
     {MP_ROM_QSTR(MP_QSTR_EDGE_SIMPLE),         MP_ROM_INT(EDGE_SIMPLE)},
+    {MP_ROM_QSTR(MP_QSTR_ADAPTIVE_MEAN),       MP_ROM_INT(ADAPTIVE_THRESHOLD_MEAN)},
+    {MP_ROM_QSTR(MP_QSTR_ADAPTIVE_GAUSSIAN),   MP_ROM_INT(ADAPTIVE_THRESHOLD_GAUSSIAN)},
+    {MP_ROM_QSTR(MP_QSTR_ADAPTIVE_SAUVOLA),    MP_ROM_INT(ADAPTIVE_THRESHOLD_SAUVOLA)},
+    {MP_ROM_QSTR(MP_QSTR_ADAPTIVE_OTSU),       MP_ROM_INT(ADAPTIVE_THRESHOLD_OTSU)},
     {MP_ROM_QSTR(MP_QSTR_CORNER_FAST),         MP_ROM_INT(CORNER_FAST)},
     {MP_ROM_QSTR(MP_QSTR_CORNER_AGAST),        MP_ROM_INT(CORNER_AGAST)},
     #ifdef IMLIB_ENABLE_APRILTAGS
@@ -7534,6 +8652,41 @@ static const mp_rom_map_elem_t globals_dict_table[] = {
     #else
     {MP_ROM_QSTR(MP_QSTR_ImageIO),             MP_ROM_PTR(&py_func_unavailable_obj)},
     #endif
+    #if defined(IMLIB_ENABLE_IMAGE_FILE_IO)
+    {MP_ROM_QSTR(MP_QSTR_Gif),                 MP_ROM_PTR(&py_gif_type) },
+    #else
+    {MP_ROM_QSTR(MP_QSTR_Gif),                 MP_ROM_PTR(&py_func_unavailable_obj)},
+    #endif
+    #if defined(IMLIB_ENABLE_IMAGE_FILE_IO)
+    {MP_ROM_QSTR(MP_QSTR_Mjpeg),               MP_ROM_PTR(&py_mjpeg_type) },
+    #else
+    {MP_ROM_QSTR(MP_QSTR_Mjpeg),               MP_ROM_PTR(&py_func_unavailable_obj)},
+    #endif
+    #if defined(IMLIB_ENABLE_PYRAMID)
+    {MP_ROM_QSTR(MP_QSTR_Pyramid),             MP_ROM_PTR(&py_pyramid_type) },
+    #else
+    {MP_ROM_QSTR(MP_QSTR_Pyramid),             MP_ROM_PTR(&py_func_unavailable_obj)},
+    #endif
+    #if defined(IMLIB_ENABLE_REMAP)
+    {MP_ROM_QSTR(MP_QSTR_Remap),               MP_ROM_PTR(&py_remap_type) },
+    #else
+    {MP_ROM_QSTR(MP_QSTR_Remap),               MP_ROM_PTR(&py_func_unavailable_obj)},
+    #endif
+    #if defined(IMLIB_ENABLE_PIPELINE)
+    {MP_ROM_QSTR(MP_QSTR_Pipeline),            MP_ROM_PTR(&py_pipeline_type) },
+    #else
+    {MP_ROM_QSTR(MP_QSTR_Pipeline),            MP_ROM_PTR(&py_func_unavailable_obj)},
+    #endif
+    #if defined(IMLIB_ENABLE_COLOR_CORR)
+    {MP_ROM_QSTR(MP_QSTR_ColorCorrection),     MP_ROM_PTR(&py_color_corr_type) },
+    #else
+    {MP_ROM_QSTR(MP_QSTR_ColorCorrection),     MP_ROM_PTR(&py_func_unavailable_obj)},
+    #endif
+    #if defined(IMLIB_ENABLE_CLAHE)
+    {MP_ROM_QSTR(MP_QSTR_CLAHE),               MP_ROM_PTR(&py_clahe_type) },
+    #else
+    {MP_ROM_QSTR(MP_QSTR_CLAHE),               MP_ROM_PTR(&py_func_unavailable_obj)},
+    #endif
     {MP_ROM_QSTR(MP_QSTR_binary_to_grayscale), MP_ROM_PTR(&py_image_binary_to_grayscale_obj)},
     {MP_ROM_QSTR(MP_QSTR_binary_to_rgb),       MP_ROM_PTR(&py_image_binary_to_rgb_obj)},
     {MP_ROM_QSTR(MP_QSTR_binary_to_lab),       MP_ROM_PTR(&py_image_binary_to_lab_obj)},
@@ -22,6 +22,10 @@
 #include "py_imageio.h"
 
 #if defined(IMLIB_ENABLE_IMAGE_FILE_IO)
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include "ff_wrapper.h"
 #endif
 #include "framebuffer.h"
@@ -40,6 +44,16 @@
 #define ORIGINAL_VER            10
 #define RGB565_FIXED_VER        11
 #define NEW_PIXFORMAT_VER       20
+#define INDEXED_VER             21
+
+#define OLD_HEADER_SIZE         16
+#define NEW_HEADER_SIZE         32
+
+// V2.1 files end with the file offset of every frame followed by the frame count and this tag.
+#define INDEX_TAG               (*((uint32_t *) "IDX "))
+#define INDEX_FOOTER_SIZE       8
+
+#define WRITER_MAX_SLOTS        16
 
 #ifndef __DCACHE_PRESENT
 #define IMAGE_ALIGNMENT         32 // Use 32-byte alignment on MCUs with no cache for DMA buffer alignment.
@@ -60,10 +74,35 @@ typedef enum image_io_stream_type {
     IMAGE_IO_MEMORY_STREAM,
 } image_io_stream_type_t;
 
+#if defined(IMLIB_ENABLE_IMAGE_FILE_IO)
+// Frames queued for the writer thread, each slot holds a complete record (header, data and
+// padding) so the thread does a single write per frame and never touches Python objects.
+typedef struct imageio_slot {
+    uint8_t *data;
+    uint32_t size;
+    uint32_t capacity;
+} imageio_slot_t;
+
+typedef struct imageio_writer {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    FILE *fp;
+    imageio_slot_t *slots;
+    uint32_t slot_count;
+    uint32_t head;    // next slot to fill
+    uint32_t tail;    // next slot to write
+    uint32_t pending; // slots filled and not written yet
+    bool quit;
+    int error;
+} imageio_writer_t;
+#endif
+
 typedef struct py_imageio_obj {
     mp_obj_base_t base;
     image_io_stream_type_t type;
     bool closed;
+    bool views;                         // copy=False images point into the stream data
     uint32_t count;
     uint32_t offset;
     uint32_t ms;
@@ -72,6 +111,15 @@ typedef struct py_imageio_obj {
         struct {
             FIL fp;
             int version;
+            bool dirty;                 // frames were written, the index is rewritten on close
+            uint32_t data_end;          // end of the frame data, the index follows in V2.1 files
+            uint32_t *index;            // file offset of every frame seen so far
+            uint32_t index_len;
+            uint32_t index_cap;
+            uint32_t index_end;         // file offset after the last indexed frame
+            imageio_writer_t *writer;   // NULL for synchronous writes
+            uint8_t *map;               // read only mapping of the file for zero-copy reads
+            size_t map_size;
         };
         #endif
         struct {
@@ -91,8 +139,227 @@ STATIC py_imageio_obj_t *py_imageio_obj(mp_obj_t self) {
     return stream;
 }
 
+#if defined(IMLIB_ENABLE_IMAGE_FILE_IO)
+STATIC void *imageio_writer_task(void *arg) {
+    imageio_writer_t *writer = arg;
+
+    pthread_mutex_lock(&writer->lock);
+
+    for (;;) {
+        while ((!writer->pending) && (!writer->quit)) {
+            pthread_cond_wait(&writer->cond, &writer->lock);
+        }
+
+        if (!writer->pending) {
+            break;
+        }
+
+        imageio_slot_t *slot = &writer->slots[writer->tail];
+        bool failed = writer->error;
+        pthread_mutex_unlock(&writer->lock);
+
+        int error = 0;
+
+        if ((!failed) && (fwrite(slot->data, slot->size, 1, writer->fp) != 1)) {
+            error = errno ? errno : EIO;
+        }
+
+        pthread_mutex_lock(&writer->lock);
+
+        if (error) {
+            writer->error = error;
+        }
+
+        writer->tail = (writer->tail + 1) % writer->slot_count;
+        writer->pending -= 1;
+        pthread_cond_broadcast(&writer->cond);
+    }
+
+    pthread_mutex_unlock(&writer->lock);
+    return NULL;
+}
+
+STATIC imageio_writer_t *imageio_writer_start(FILE *fp, uint32_t slot_count) {
+    imageio_writer_t *writer = calloc(1, sizeof(imageio_writer_t));
+    imageio_slot_t *slots = calloc(slot_count, sizeof(imageio_slot_t));
+
+    if ((!writer) || (!slots)) {
+        free(writer);
+        free(slots);
+        mp_raise_msg(&mp_type_MemoryError, MP_ERROR_TEXT("Failed to allocate the write queue"));
+    }
+
+    writer->fp = fp;
+    writer->slots = slots;
+    writer->slot_count = slot_count;
+    pthread_mutex_init(&writer->lock, NULL);
+    pthread_cond_init(&writer->cond, NULL);
+
+    if (pthread_create(&writer->thread, NULL, imageio_writer_task, writer)) {
+        pthread_cond_destroy(&writer->cond);
+        pthread_mutex_destroy(&writer->lock);
+        free(slots);
+        free(writer);
+        mp_raise_msg(&mp_type_OSError, MP_ERROR_TEXT("Failed to start the writer thread"));
+    }
+
+    return writer;
+}
+
+// Waits for the writer thread to go idle and returns the first write error, if any.
+STATIC int imageio_writer_wait(imageio_writer_t *writer) {
+    MP_THREAD_GIL_EXIT();
+    pthread_mutex_lock(&writer->lock);
+
+    while (writer->pending) {
+        pthread_cond_wait(&writer->cond, &writer->lock);
+    }
+
+    int error = writer->error;
+    writer->error = 0;
+    pthread_mutex_unlock(&writer->lock);
+    MP_THREAD_GIL_ENTER();
+    return error;
+}
+
+STATIC int imageio_writer_stop(imageio_writer_t *writer) {
+    pthread_mutex_lock(&writer->lock);
+    writer->quit = true;
+    pthread_cond_broadcast(&writer->cond);
+    pthread_mutex_unlock(&writer->lock);
+
+    MP_THREAD_GIL_EXIT();
+    pthread_join(writer->thread, NULL);
+    MP_THREAD_GIL_ENTER();
+
+    int error = writer->error;
+
+    for (uint32_t i = 0; i < writer->slot_count; i++) {
+        free(writer->slots[i].data);
+    }
+
+    pthread_cond_destroy(&writer->cond);
+    pthread_mutex_destroy(&writer->lock);
+    free(writer->slots);
+    free(writer);
+    return error;
+}
+
+// Returns a buffer for a record of size bytes, blocks while all slots are queued.
+STATIC uint8_t *imageio_writer_acquire(imageio_writer_t *writer, uint32_t size) {
+    MP_THREAD_GIL_EXIT();
+    pthread_mutex_lock(&writer->lock);
+
+    while (writer->pending == writer->slot_count) {
+        pthread_cond_wait(&writer->cond, &writer->lock);
+    }
+
+    int error = writer->error;
+    writer->error = 0;
+    pthread_mutex_unlock(&writer->lock);
+    MP_THREAD_GIL_ENTER();
+
+    if (error) {
+        mp_raise_OSError(error);
+    }
+
+    // The head slot is not used by the writer thread until it is committed.
+    imageio_slot_t *slot = &writer->slots[writer->head];
+
+    if (slot->capacity < size) {
+        uint8_t *data = realloc(slot->data, size);
+
+        if (!data) {
+            mp_raise_msg(&mp_type_MemoryError, MP_ERROR_TEXT("Failed to allocate a write slot"));
+        }
+
+        slot->data = data;
+        slot->capacity = size;
+    }
+
+    slot->size = size;
+    return slot->data;
+}
+
+STATIC void imageio_writer_commit(imageio_writer_t *writer) {
+    pthread_mutex_lock(&writer->lock);
+    writer->head = (writer->head + 1) % writer->slot_count;
+    writer->pending += 1;
+    pthread_cond_broadcast(&writer->cond);
+    pthread_mutex_unlock(&writer->lock);
+}
+
+// The file is owned by the writer thread while frames are queued, wait for it before using it.
+STATIC void int_py_imageio_flush(py_imageio_obj_t *stream) {
+    if ((stream->type == IMAGE_IO_FILE_STREAM) && stream->writer) {
+        int error = imageio_writer_wait(stream->writer);
+
+        if (error) {
+            mp_raise_OSError(error);
+        }
+    }
+}
+
+STATIC void int_py_imageio_index_append(py_imageio_obj_t *stream, uint32_t offset, uint32_t record_size) {
+    if (stream->index_len == stream->index_cap) {
+        stream->index_cap = stream->index_cap ? (stream->index_cap * 2) : 64;
+        stream->index = xrealloc(stream->index, stream->index_cap * sizeof(uint32_t));
+    }
+
+    stream->index[stream->index_len++] = offset;
+    stream->index_end = offset + record_size;
+}
+
+STATIC void int_py_imageio_read_index(py_imageio_obj_t *stream) {
+    FIL *fp = &stream->fp;
+    uint32_t size = f_size(fp);
+
+    stream->data_end = size;
+    stream->index_end = MAGIC_SIZE;
+
+    if ((stream->version >= INDEXED_VER) && (size >= (MAGIC_SIZE + INDEX_FOOTER_SIZE))) {
+        uint32_t count, tag;
+        file_seek(fp, size - INDEX_FOOTER_SIZE);
+        read_long(fp, &count);
+        read_long(fp, &tag);
+
+        // A recording that was not closed has no index, fall back to walking the frames.
+        if ((tag == INDEX_TAG) && (count <= ((size - MAGIC_SIZE - INDEX_FOOTER_SIZE) / sizeof(uint32_t)))) {
+            uint32_t start = size - INDEX_FOOTER_SIZE - (count * sizeof(uint32_t));
+            stream->index_cap = count + 1;
+            stream->index = xrealloc(stream->index, stream->index_cap * sizeof(uint32_t));
+            file_seek(fp, start);
+            read_data(fp, stream->index, count * sizeof(uint32_t));
+            stream->index_len = count;
+            stream->index_end = start;
+            stream->data_end = start;
+            stream->count = count;
+        }
+    }
+
+    file_seek(fp, MAGIC_SIZE);
+}
+
+STATIC void int_py_imageio_write_index(py_imageio_obj_t *stream) {
+    FIL *fp = &stream->fp;
+    file_seek(fp, stream->data_end);
+    write_data(fp, stream->index, stream->index_len * sizeof(uint32_t));
+    write_long(fp, stream->index_len);
+    write_long(fp, INDEX_TAG);
+    file_sync(fp);
+    file_truncate(fp);
+}
+#endif
+
 STATIC void py_imageio_print(const mp_print_t *print, mp_obj_t self, mp_print_kind_t kind) {
     py_imageio_obj_t *stream = MP_OBJ_TO_PTR(self);
+    #if defined(IMLIB_ENABLE_IMAGE_FILE_IO)
+    if ((stream->type == IMAGE_IO_FILE_STREAM) && (!stream->closed) && stream->writer) {
+        // Errors are reported by the next write, sync or close.
+        int error = imageio_writer_wait(stream->writer);
+        stream->writer->error = error;
+    }
+    #endif
     mp_printf(print, "{\"type\":%s, \"closed\":%s, \"count\":%u, \"offset\":%u, "
               "\"version\":%u, \"buffer_size\":%u, \"size\":%u}",
               (stream->type == IMAGE_IO_FILE_STREAM) ? "\"file stream\"" : "\"memory stream\"",
@@ -162,6 +429,7 @@ STATIC mp_obj_t py_imageio_size(mp_obj_t self) {
 
     #if defined(IMLIB_ENABLE_IMAGE_FILE_IO)
     if (stream->type == IMAGE_IO_FILE_STREAM) {
+        int_py_imageio_flush(stream);
         return mp_obj_new_int(f_size(&stream->fp));
     }
     #endif
@@ -181,46 +449,69 @@ STATIC mp_obj_t py_imageio_write(mp_obj_t self, mp_obj_t img_obj) {
     #if defined(IMLIB_ENABLE_IMAGE_FILE_IO)
     } else if (stream->type == IMAGE_IO_FILE_STREAM) {
         FIL *fp = &stream->fp;
-
-        write_long(fp, elapsed_ms);
-        write_long(fp, image->w);
-        write_long(fp, image->h);
-
-        char padding[ALIGN_SIZE] = {};
+        uint32_t header[NEW_HEADER_SIZE / sizeof(uint32_t)] = { elapsed_ms, image->w, image->h };
+        uint32_t header_size = NEW_HEADER_SIZE;
 
         if (stream->version < NEW_PIXFORMAT_VER) {
+            header_size = OLD_HEADER_SIZE;
+
             if (image->pixfmt == PIXFORMAT_BINARY) {
-                write_long(fp, OLD_BINARY_BPP);
+                header[3] = OLD_BINARY_BPP;
             } else if (image->pixfmt == PIXFORMAT_GRAYSCALE) {
-                write_long(fp, OLD_GRAYSCALE_BPP);
+                header[3] = OLD_GRAYSCALE_BPP;
             } else if (image->pixfmt == PIXFORMAT_RGB565) {
-                write_long(fp, OLD_RGB565_BPP);
+                header[3] = OLD_RGB565_BPP;
             } else if (image->pixfmt == PIXFORMAT_BAYER) {
-                write_long(fp, OLD_BAYER_BPP);
+                header[3] = OLD_BAYER_BPP;
             } else if (image->pixfmt == PIXFORMAT_JPEG) {
-                write_long(fp, image->size);
+                header[3] = image->size;
             } else {
                 mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("Invalid image stream bpp"));
             }
         } else {
-            write_long(fp, image->pixfmt);
-            write_long(fp, image->size);
-            write_data(fp, padding, AFTER_SIZE_PADDING);
+            header[3] = image->pixfmt;
+            header[4] = image->size;
         }
 
         uint32_t size = image_size(image);
-        write_data(fp, image->data, size);
-
-        if (size % ALIGN_SIZE) {
-            write_data(fp, padding, ALIGN_SIZE - (size % ALIGN_SIZE));
-        }
+        uint32_t padding = (size % ALIGN_SIZE) ? (ALIGN_SIZE - (size % ALIGN_SIZE)) : 0;
+        uint32_t record_size = header_size + size + padding;
+        uint32_t offset = (stream->offset < stream->index_len) ? stream->index[stream->offset] : stream->index_end;
 
         // Seeking to the middle of a file and writing data corrupts the remainder of the file. So,
         // truncate the rest of the file when this happens to prevent crashing because of this.
-        if (!f_eof(fp)) {
+        if (offset < stream->data_end) {
+            if (stream->views && stream->map && (stream->map != MAP_FAILED)) {
+                mp_raise_msg(&mp_type_OSError, MP_ERROR_TEXT("Frames are referenced by copy=False images"));
+            }
+
+            int_py_imageio_flush(stream);
+            file_seek(fp, offset);
+            file_sync(fp);
             file_truncate(fp);
+            stream->data_end = offset;
+            stream->index_len = IM_MIN(stream->index_len, stream->offset);
         }
 
+        if (stream->writer) {
+            uint8_t *record = imageio_writer_acquire(stream->writer, record_size);
+            memcpy(record, header, header_size);
+            memcpy(record + header_size, image->data, size);
+            memset(record + header_size + size, 0, padding);
+            imageio_writer_commit(stream->writer);
+        } else {
+            char zeros[ALIGN_SIZE] = {};
+            write_data(fp, header, header_size);
+            write_data(fp, image->data, size);
+
+            if (padding) {
+                write_data(fp, zeros, padding);
+            }
+        }
+
+        int_py_imageio_index_append(stream, offset, record_size);
+        stream->data_end = stream->index_end;
+        stream->dirty = true;
         stream->count = stream->offset + 1;
     #endif
     } else if (stream->type == IMAGE_IO_MEMORY_STREAM) {
@@ -265,10 +556,16 @@ STATIC void int_py_imageio_pause(py_imageio_obj_t *stream, bool pause) {
 }
 
 #if defined(IMLIB_ENABLE_IMAGE_FILE_IO)
-STATIC void int_py_imageio_read_chunk(py_imageio_obj_t *stream, image_t *image, bool pause) {
+STATIC bool int_py_imageio_at_end(py_imageio_obj_t *stream) {
+    return f_tell(&stream->fp) >= stream->data_end;
+}
+
+// Reads the header of the frame at the current file position, which is frame number frame.
+STATIC void int_py_imageio_read_chunk(py_imageio_obj_t *stream, uint32_t frame, image_t *image, bool pause) {
     FIL *fp = &stream->fp;
+    uint32_t offset = f_tell(fp);
 
-    if (f_eof(fp)) {
+    if (offset >= stream->data_end) {
         mp_raise_msg(&mp_type_EOFError, MP_ERROR_TEXT("End of stream"));
     }
 
@@ -305,6 +602,44 @@ STATIC void int_py_imageio_read_chunk(py_imageio_obj_t *stream, image_t *image,
         char ignore[AFTER_SIZE_PADDING];
         read_data(fp, ignore, AFTER_SIZE_PADDING);
     }
+
+    if (frame == stream->index_len) {
+        uint32_t size = image_size(image);
+
+        if (size % ALIGN_SIZE) {
+            size += ALIGN_SIZE - (size % ALIGN_SIZE);
+        }
+
+        int_py_imageio_index_append(stream, offset, (f_tell(fp) - offset) + size);
+    }
+}
+
+// Returns the frame data in place if the file can be mapped, zero-copy reads fall back to
+// copying when it can't (or the data needs fixing up).
+STATIC uint8_t *int_py_imageio_map_data(py_imageio_obj_t *stream, image_t *image) {
+    FIL *fp = &stream->fp;
+    uint32_t offset = f_tell(fp);
+    uint32_t size = image_size(image);
+
+    if (stream->dirty || ((image->pixfmt == PIXFORMAT_RGB565) && (stream->version == ORIGINAL_VER))) {
+        return NULL;
+    }
+
+    if (!stream->map) {
+        stream->map = mmap(NULL, stream->data_end, PROT_READ, MAP_SHARED, fileno(*fp), 0);
+        stream->map_size = stream->data_end;
+    }
+
+    if ((stream->map == MAP_FAILED) || ((offset + size) > stream->map_size)) {
+        return NULL;
+    }
+
+    if (size % ALIGN_SIZE) {
+        size += ALIGN_SIZE - (size % ALIGN_SIZE);
+    }
+
+    file_seek(fp, offset + size);
+    return stream->map + offset;
 }
 #endif
 
@@ -326,15 +661,23 @@ STATIC mp_obj_t py_imageio_read(size_t n_args, const mp_obj_t *args, mp_map_t *k
     }
 
     image_t image = {};
+    uint8_t *view = NULL;
 
     bool pause = py_helper_keyword_int(n_args, args, 3, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_pause), true);
+    // Without a copy the image references the stream data and is only valid until close().
+    bool copy = py_helper_keyword_int(n_args, args, 4, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_copy), true);
 
     if (0) {
     #if defined(IMLIB_ENABLE_IMAGE_FILE_IO)
     } else if (stream->type == IMAGE_IO_FILE_STREAM) {
         FIL *fp = &stream->fp;
+        int_py_imageio_flush(stream);
+
+        if ((stream->offset < stream->index_len) && (f_tell(fp) != stream->index[stream->offset])) {
+            file_seek(fp, stream->index[stream->offset]);
+        }
 
-        if (f_eof(fp)) {
+        if (int_py_imageio_at_end(stream)) {
             if (!py_helper_keyword_int(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_loop), true)) {
                 return mp_const_none;
             }
@@ -343,13 +686,17 @@ STATIC mp_obj_t py_imageio_read(size_t n_args, const mp_obj_t *args, mp_map_t *k
 
             stream->offset = 0;
 
-            if (f_eof(fp)) {
+            if (int_py_imageio_at_end(stream)) {
                 // empty file
                 return mp_const_none;
             }
         }
 
-        int_py_imageio_read_chunk(stream, &image, pause);
+        int_py_imageio_read_chunk(stream, stream->offset, &image, pause);
+
+        if ((!copy) && (!copy_to_fb) && (!arg_other)) {
+            view = int_py_imageio_map_data(stream, &image);
+        }
     #endif
     } else if (stream->type == IMAGE_IO_MEMORY_STREAM) {
         if (stream->offset == stream->count) {
@@ -359,6 +706,10 @@ STATIC mp_obj_t py_imageio_read(size_t n_args, const mp_obj_t *args, mp_map_t *k
         int_py_imageio_pause(stream, pause);
 
         memcpy(&image, stream->buffer + (stream->offset * stream->size) + sizeof(uint32_t), sizeof(image_t));
+
+        if ((!copy) && (!copy_to_fb) && (!arg_other)) {
+            view = stream->buffer + (stream->offset * stream->size) + IMAGE_T_SIZE_ALIGNED;
+        }
     }
 
     uint32_t size = image_size(&image);
@@ -366,7 +717,15 @@ STATIC mp_obj_t py_imageio_read(size_t n_args, const mp_obj_t *args, mp_map_t *k
     if (copy_to_fb) {
         py_helper_set_to_framebuffer(&image);
     }
-    if (arg_other) {
+    if (view) {
+        image.data = view;
+        image.alloc_type = ALLOC_REF;
+        image.cache = true;
+        image.phy_addr = 0;
+        image.pool_id = 0;
+        image.ref_obj = args[0];
+        stream->views = true;
+    } else if (arg_other) {
         PY_ASSERT_TRUE_MSG((size <= image_size(arg_other)),
                            "The new image won't fit in the target frame buffer!");
         image.data = arg_other->data;
@@ -379,7 +738,10 @@ STATIC mp_obj_t py_imageio_read(size_t n_args, const mp_obj_t *args, mp_map_t *k
         py_image_alloc(&image, kw_args);
     }
 
-    if (0) {
+    if (view) {
+        if (stream->offset >= stream->count) {
+            stream->count = stream->offset + 1;
+        }
     #if defined(IMLIB_ENABLE_IMAGE_FILE_IO)
     } else if (stream->type == IMAGE_IO_FILE_STREAM) {
         FIL *fp = &stream->fp;
@@ -439,18 +801,19 @@ STATIC mp_obj_t py_imageio_seek(mp_obj_t self, mp_obj_t offs) {
     #if defined(IMLIB_ENABLE_IMAGE_FILE_IO)
     if (stream->type == IMAGE_IO_FILE_STREAM) {
         FIL *fp = &stream->fp;
-        file_seek(fp, MAGIC_SIZE); // skip past the file header
+        int_py_imageio_flush(stream);
 
-        for (int i = 0; i < offset; i++) {
-            image_t image = {};
-            int_py_imageio_read_chunk(stream, &image, false);
-            uint32_t size = image_size(&image);
+        if (offset < stream->index_len) {
+            file_seek(fp, stream->index[offset]);
+        } else {
+            // Walk the frames past the end of the index, indexing them on the way.
+            file_seek(fp, stream->index_end);
 
-            if (size % ALIGN_SIZE) {
-                size += ALIGN_SIZE - (size % ALIGN_SIZE);
+            while (stream->index_len < offset) {
+                image_t image = {};
+                int_py_imageio_read_chunk(stream, stream->index_len, &image, false);
+                file_seek(fp, stream->index_end);
             }
-
-            file_seek(fp, f_tell(fp) + size);
         }
 
         if (stream->offset >= stream->count) {
@@ -470,6 +833,7 @@ STATIC mp_obj_t py_imageio_sync(mp_obj_t self) {
     py_imageio_obj_t *stream = py_imageio_obj(self);
 
     if (stream->type == IMAGE_IO_FILE_STREAM) {
+        int_py_imageio_flush(stream);
         file_sync(&stream->fp);
     }
     #endif
@@ -478,29 +842,85 @@ STATIC mp_obj_t py_imageio_sync(mp_obj_t self) {
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_imageio_sync_obj, py_imageio_sync);
 
-STATIC mp_obj_t py_imageio_close(mp_obj_t self) {
-    py_imageio_obj_t *stream = py_imageio_obj(self);
-
+// Releases the memory copy=False images point into, which is only safe once they are gone.
+STATIC void int_py_imageio_release(py_imageio_obj_t *stream) {
     if (0) {
     #if defined(IMLIB_ENABLE_IMAGE_FILE_IO)
     } else if (stream->type == IMAGE_IO_FILE_STREAM) {
-        file_close(&stream->fp);
+        if (stream->map && (stream->map != MAP_FAILED)) {
+            munmap(stream->map, stream->map_size);
+        }
+
+        stream->map = NULL;
     #endif
-    } else if (stream->type == IMAGE_IO_MEMORY_STREAM) {
+    } else if ((stream->type == IMAGE_IO_MEMORY_STREAM) && stream->buffer) {
         fb_alloc_free_till_mark_past_mark_permanent();
+        stream->buffer = NULL;
     }
+}
 
+STATIC mp_obj_t py_imageio_close(mp_obj_t self) {
+    py_imageio_obj_t *stream = py_imageio_obj(self);
     stream->closed = true;
 
+    #if defined(IMLIB_ENABLE_IMAGE_FILE_IO)
+    if (stream->type == IMAGE_IO_FILE_STREAM) {
+        int error = 0;
+
+        if (stream->writer) {
+            error = imageio_writer_stop(stream->writer);
+            stream->writer = NULL;
+        }
+
+        if ((!error) && stream->dirty && (stream->version >= INDEXED_VER)) {
+            int_py_imageio_write_index(stream);
+        }
+
+        xfree(stream->index);
+        stream->index = NULL;
+        file_close(&stream->fp);
+
+        if (!stream->views) {
+            int_py_imageio_release(stream);
+        }
+
+        if (error) {
+            mp_raise_OSError(error);
+        }
+
+        return self;
+    }
+    #endif
+
+    // copy=False images keep the stream object alive, so their data is released by the finaliser.
+    if (!stream->views) {
+        int_py_imageio_release(stream);
+    }
+
     return self;
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_imageio_close_obj, py_imageio_close);
 
+STATIC mp_obj_t py_imageio_del(mp_obj_t self) {
+    py_imageio_obj_t *stream = MP_OBJ_TO_PTR(self);
+
+    if (!stream->closed) {
+        py_imageio_close(self);
+    }
+
+    int_py_imageio_release(stream);
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_imageio_del_obj, py_imageio_del);
+
 STATIC mp_obj_t py_imageio_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *args) {
-    mp_arg_check_num(n_args, n_kw, 2, 2, false);
+    mp_arg_check_num(n_args, n_kw, 2, 2, true);
+    mp_map_t kw_args;
+    mp_map_init_fixed_table(&kw_args, n_kw, args + n_args);
     py_imageio_obj_t *stream = m_new_obj_with_finaliser(py_imageio_obj_t);
     stream->base.type = &py_imageio_type;
     stream->closed = false;
+    stream->views = false;
 
     if (0) {
     #if defined(IMLIB_ENABLE_IMAGE_FILE_IO)
@@ -509,39 +929,34 @@ STATIC mp_obj_t py_imageio_make_new(const mp_obj_type_t *type, size_t n_args, si
         FIL *fp = &stream->fp;
         stream->type = IMAGE_IO_FILE_STREAM;
         stream->count = 0;
+        stream->dirty = false;
+        stream->data_end = MAGIC_SIZE;
+        stream->index = NULL;
+        stream->index_len = 0;
+        stream->index_cap = 0;
+        stream->index_end = MAGIC_SIZE;
+        stream->writer = NULL;
+        stream->map = NULL;
+        stream->map_size = 0;
+
+        // Number of frames that can be queued for the writer thread, 0 writes synchronously.
+        int queue = py_helper_keyword_int(n_args, args, 2, &kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_queue), 0);
+
+        if ((queue < 0) || (WRITER_MAX_SLOTS < queue)) {
+            mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("0 <= queue <= 16!"));
+        }
 
         char mode = mp_obj_str_get_str(args[1])[0];
 
         if ((mode == 'W') || (mode == 'w')) {
             file_read_write_open_always(fp, mp_obj_str_get_str(args[0]));
-            const char string[] = "OMV IMG STR V2.0";
-            stream->version = NEW_PIXFORMAT_VER;
+            const char string[] = "OMV IMG STR V2.1";
+            stream->version = INDEXED_VER;
 
-            // Overwrite if file is too small.
-            if (f_size(fp) < MAGIC_SIZE) {
-                write_data(fp, string, sizeof(string) - 1); // exclude null terminator
-            } else {
-                uint8_t version_hi, period, version_lo;
-                char temp[sizeof(string) - 3] = {};
-                read_data(fp, temp, sizeof(temp) - 1);
-                read_byte(fp, &version_hi);
-                read_byte(fp, &period);
-                read_byte(fp, &version_lo);
-                int version = ((version_hi - '0') * 10) + (version_lo - '0');
-
-                // Overwrite if file magic does not match.
-                if (strcmp(string, temp)
-                    || (period != ((uint8_t) '.'))
-                    || (version != ORIGINAL_VER)
-                    || (version != RGB565_FIXED_VER)
-                    || (version != NEW_PIXFORMAT_VER)) {
-                    file_seek(fp, 0);
-                    write_data(fp, string, sizeof(string) - 1); // exclude null terminator
-                } else {
-                    file_close(fp);
-                    mode = 'R';
-                }
-            }
+            // Always start a new stream, the frames and index footer of an old one must not survive.
+            file_seek(fp, 0);
+            write_data(fp, string, sizeof(string) - 1); // exclude null terminator
+            file_truncate(fp);
         }
 
         if ((mode == 'R') || (mode == 'r')) {
@@ -559,12 +974,19 @@ STATIC mp_obj_t py_imageio_make_new(const mp_obj_type_t *type, size_t n_args, si
 
             if ((stream->version != ORIGINAL_VER)
                 && (stream->version != RGB565_FIXED_VER)
-                && (stream->version != NEW_PIXFORMAT_VER)) {
-                mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("Expected version V1.0, V1.1, or V2.0"));
+                && (stream->version != NEW_PIXFORMAT_VER)
+                && (stream->version != INDEXED_VER)) {
+                mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("Expected version V1.0, V1.1, V2.0 or V2.1"));
             }
+
+            int_py_imageio_read_index(stream);
         } else if ((mode != 'W') && (mode != 'w')) {
             mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("Invalid stream mode, expected 'R/r' or 'W/w'"));
         }
+
+        if (queue) {
+            stream->writer = imageio_writer_start(*fp, queue);
+        }
     #endif
     } else if (mp_obj_is_type(args[0], &mp_type_tuple)) {
         // Memory Stream I/O
@@ -606,7 +1028,7 @@ STATIC mp_obj_t py_imageio_make_new(const mp_obj_type_t *type, size_t n_args, si
 
 STATIC const mp_rom_map_elem_t py_imageio_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR___name__),        MP_ROM_QSTR(MP_QSTR_imageio)            },
-    { MP_ROM_QSTR(MP_QSTR___del__),         MP_ROM_PTR(&py_imageio_close_obj)       },
+    { MP_ROM_QSTR(MP_QSTR___del__),         MP_ROM_PTR(&py_imageio_del_obj)         },
     { MP_ROM_QSTR(MP_QSTR_FILE_STREAM),     MP_ROM_INT(IMAGE_IO_FILE_STREAM)        },
     { MP_ROM_QSTR(MP_QSTR_MEMORY_STREAM),   MP_ROM_INT(IMAGE_IO_MEMORY_STREAM)      },
     { MP_ROM_QSTR(MP_QSTR_type),            MP_ROM_PTR(&py_imageio_get_type_obj)    },
@@ -0,0 +1,169 @@
+/*
+ * This file is part of the OpenMV project.
+ *
+ * Copyright (c) 2013-2021 Ibrahim Abdelkader <iabdalkader@openmv.io>
+ * Copyright (c) 2013-2021 Kwabena W. Agyeman <kwagyeman@openmv.io>
+ *
+ * This work is licensed under the MIT license, see the file LICENSE for details.
+ *
+ * MJPEG Python module.
+ */
+#include "imlib_config.h"
+#if defined(IMLIB_ENABLE_IMAGE_FILE_IO)
+
+#include "py/obj.h"
+#include "py/nlr.h"
+#include "py/runtime.h"
+
+#include "py_assert.h"
+#include "py_helper.h"
+#include "py_image.h"
+#include "py_mjpeg.h"
+#include "fb_alloc.h"
+#include "ff_wrapper.h"
+
+typedef struct py_mjpeg_obj {
+    mp_obj_base_t base;
+    bool closed;
+    FIL fp;
+    mjpeg_t _cobj;
+} py_mjpeg_obj_t;
+
+STATIC py_mjpeg_obj_t *py_mjpeg_obj(mp_obj_t self) {
+    py_mjpeg_obj_t *mjpeg = MP_OBJ_TO_PTR(self);
+
+    if (mjpeg->closed) {
+        mp_raise_msg(&mp_type_OSError, MP_ERROR_TEXT("MJPEG closed"));
+    }
+
+    return mjpeg;
+}
+
+STATIC void py_mjpeg_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind) {
+    py_mjpeg_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    mjpeg_t *mjpeg = &self->_cobj;
+    mp_printf(print, "{\"closed\":%s, \"width\":%d, \"height\":%d, \"count\":%u, \"queued\":%s}",
+              self->closed ? "\"true\"" : "\"false\"",
+              mjpeg->w, mjpeg->h, mjpeg->count,
+              mjpeg->writer ? "\"true\"" : "\"false\"");
+}
+
+STATIC mp_obj_t py_mjpeg_width(mp_obj_t self) {
+    return mp_obj_new_int(((py_mjpeg_obj_t *) MP_OBJ_TO_PTR(self))->_cobj.w);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_mjpeg_width_obj, py_mjpeg_width);
+
+STATIC mp_obj_t py_mjpeg_height(mp_obj_t self) {
+    return mp_obj_new_int(((py_mjpeg_obj_t *) MP_OBJ_TO_PTR(self))->_cobj.h);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_mjpeg_height_obj, py_mjpeg_height);
+
+STATIC mp_obj_t py_mjpeg_count(mp_obj_t self) {
+    return mp_obj_new_int(((py_mjpeg_obj_t *) MP_OBJ_TO_PTR(self))->_cobj.count);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_mjpeg_count_obj, py_mjpeg_count);
+
+STATIC mp_obj_t py_mjpeg_add_frame(uint n_args, const mp_obj_t *args, mp_map_t *kw_args) {
+    py_mjpeg_obj_t *self = py_mjpeg_obj(args[0]);
+    image_t *image = py_image_cobj(args[1]);
+
+    int arg_q = py_helper_keyword_int(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_quality), 90);
+    PY_ASSERT_TRUE_MSG((1 <= arg_q) && (arg_q <= 100), "1 <= quality <= 100!");
+
+    rectangle_t roi;
+    py_helper_keyword_rectangle_roi(image, n_args, args, 3, kw_args, &roi);
+
+    int arg_rgb_channel = py_helper_keyword_int(n_args, args, 4, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_rgb_channel), -1);
+    if ((arg_rgb_channel < -1) || (2 < arg_rgb_channel)) {
+        mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("-1 <= rgb_channel <= 2!"));
+    }
+
+    int arg_alpha = py_helper_keyword_int(n_args, args, 5, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_alpha), 256);
+    if ((arg_alpha < 0) || (256 < arg_alpha)) {
+        mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("0 <= alpha <= 256!"));
+    }
+
+    const uint16_t *color_palette = py_helper_keyword_color_palette(n_args, args, 6, kw_args, NULL);
+    const uint8_t *alpha_palette = py_helper_keyword_alpha_palette(n_args, args, 7, kw_args, NULL);
+
+    image_hint_t hint = py_helper_keyword_int(n_args, args, 8, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_hint), 0);
+
+    fb_alloc_mark();
+    mjpeg_write(&self->fp, &self->_cobj, image, arg_q, &roi, arg_rgb_channel, arg_alpha,
+                color_palette, alpha_palette, hint);
+    fb_alloc_free_till_mark();
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_mjpeg_add_frame_obj, 2, py_mjpeg_add_frame);
+
+STATIC mp_obj_t py_mjpeg_sync(uint n_args, const mp_obj_t *args) {
+    py_mjpeg_obj_t *self = py_mjpeg_obj(args[0]);
+    mjpeg_sync(&self->fp, &self->_cobj, (n_args > 1) ? mp_obj_get_float(args[1]) : 0.0f);
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(py_mjpeg_sync_obj, 1, 2, py_mjpeg_sync);
+
+STATIC mp_obj_t py_mjpeg_close(uint n_args, const mp_obj_t *args) {
+    py_mjpeg_obj_t *self = MP_OBJ_TO_PTR(args[0]);
+
+    if (!self->closed) {
+        self->closed = true;
+        mjpeg_close(&self->fp, &self->_cobj, (n_args > 1) ? mp_obj_get_float(args[1]) : 0.0f);
+    }
+
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(py_mjpeg_close_obj, 1, 2, py_mjpeg_close);
+
+STATIC mp_obj_t py_mjpeg_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *args) {
+    mp_arg_check_num(n_args, n_kw, 1, 5, true);
+
+    mp_map_t kw_args;
+    mp_map_init_fixed_table(&kw_args, n_kw, args + n_args);
+
+    int width =
+        py_helper_keyword_int(n_args, args, 1, &kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_width), 0);
+    int height =
+        py_helper_keyword_int(n_args, args, 2, &kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_height), 0);
+    PY_ASSERT_TRUE_MSG((width >= 0) && (width <= 65535) && (height >= 0) && (height <= 65535),
+                       "0 <= width/height <= 65535!");
+    // Frames buffered for the encoder thread, 0 encodes and writes on the caller.
+    int queue =
+        py_helper_keyword_int(n_args, args, 3, &kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_queue), 0);
+    PY_ASSERT_TRUE_MSG((queue >= 0) && (queue <= 64), "0 <= queue <= 64!");
+    // Frames between index checkpoints, 0 only writes the index on sync() and close().
+    int checkpoint =
+        py_helper_keyword_int(n_args, args, 4, &kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_checkpoint), 0);
+    PY_ASSERT_TRUE_MSG(checkpoint >= 0, "checkpoint >= 0!");
+
+    py_mjpeg_obj_t *self = m_new_obj_with_finaliser(py_mjpeg_obj_t);
+    self->base.type = &py_mjpeg_type;
+    self->closed = true;
+
+    file_write_open(&self->fp, mp_obj_str_get_str(args[0]));
+    mjpeg_open(&self->fp, &self->_cobj, width, height, queue, checkpoint);
+    self->closed = false;
+    return MP_OBJ_FROM_PTR(self);
+}
+
+STATIC const mp_rom_map_elem_t py_mjpeg_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR___del__),         MP_ROM_PTR(&py_mjpeg_close_obj)         },
+    { MP_ROM_QSTR(MP_QSTR_width),           MP_ROM_PTR(&py_mjpeg_width_obj)         },
+    { MP_ROM_QSTR(MP_QSTR_height),          MP_ROM_PTR(&py_mjpeg_height_obj)        },
+    { MP_ROM_QSTR(MP_QSTR_count),           MP_ROM_PTR(&py_mjpeg_count_obj)         },
+    { MP_ROM_QSTR(MP_QSTR_add_frame),       MP_ROM_PTR(&py_mjpeg_add_frame_obj)     },
+    { MP_ROM_QSTR(MP_QSTR_sync),            MP_ROM_PTR(&py_mjpeg_sync_obj)          },
+    { MP_ROM_QSTR(MP_QSTR_close),           MP_ROM_PTR(&py_mjpeg_close_obj)         }
+};
+
+STATIC MP_DEFINE_CONST_DICT(py_mjpeg_locals_dict, py_mjpeg_locals_dict_table);
+
+MP_DEFINE_CONST_OBJ_TYPE(
+    py_mjpeg_type,
+    MP_QSTR_Mjpeg,
+    MP_TYPE_FLAG_NONE,
+    print, py_mjpeg_print,
+    make_new, py_mjpeg_make_new,
+    locals_dict, &py_mjpeg_locals_dict
+    );
+#endif // IMLIB_ENABLE_IMAGE_FILE_IO
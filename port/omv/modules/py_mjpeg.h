@@ -0,0 +1,15 @@
+/*
+ * This file is part of the OpenMV project.
+ *
+ * Copyright (c) 2013-2021 Ibrahim Abdelkader <iabdalkader@openmv.io>
+ * Copyright (c) 2013-2021 Kwabena W. Agyeman <kwagyeman@openmv.io>
+ *
+ * This work is licensed under the MIT license, see the file LICENSE for details.
+ *
+ * MJPEG Python module.
+ */
+#ifndef __PY_MJPEG_H__
+#define __PY_MJPEG_H__
+#include "imlib.h"
+extern const mp_obj_type_t py_mjpeg_type;
+#endif // __PY_MJPEG_H__
@@ -0,0 +1,325 @@
+/*
+ * This file is part of the OpenMV project.
+ *
+ * Copyright (c) 2013-2021 Ibrahim Abdelkader <iabdalkader@openmv.io>
+ * Copyright (c) 2013-2021 Kwabena W. Agyeman <kwagyeman@openmv.io>
+ *
+ * This work is licensed under the MIT license, see the file LICENSE for details.
+ *
+ * Image pipeline Python module.
+ */
+#include "imlib_config.h"
+#if defined(IMLIB_ENABLE_PIPELINE)
+
+#include "py/obj.h"
+#include "py/nlr.h"
+#include "py/runtime.h"
+
+#include "py_assert.h"
+#include "py_helper.h"
+#include "py_image.h"
+#include "py_pipeline.h"
+
+typedef struct py_pipeline_obj {
+    mp_obj_base_t base;
+    pipeline_t _cobj;
+    mp_obj_t operands[PIPELINE_MAX_STAGES]; // Keeps image operands alive.
+} py_pipeline_obj_t;
+
+pipeline_t *py_pipeline_cobj(mp_obj_t obj) {
+    PY_ASSERT_TYPE(obj, &py_pipeline_type);
+    return &((py_pipeline_obj_t *) MP_OBJ_TO_PTR(obj))->_cobj;
+}
+
+STATIC pipeline_stage_t *py_pipeline_push(mp_obj_t self_in, pipeline_op_t op, int ksize) {
+    py_pipeline_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    pipeline_stage_t *stage = imlib_pipeline_push(&self->_cobj, op, ksize);
+    PY_ASSERT_TRUE_MSG(stage, "Too many pipeline stages!");
+    self->operands[self->_cobj.n_stages - 1] = MP_OBJ_NULL;
+    return stage;
+}
+
+// Records a math/logic op whose operand is either an image or a color.
+STATIC pipeline_stage_t *py_pipeline_push_operand(size_t n_args, const mp_obj_t *args, pipeline_op_t op) {
+    pipeline_stage_t *stage = py_pipeline_push(args[0], op, 0);
+
+    if (MP_OBJ_IS_TYPE(args[1], &py_image_type)) {
+        py_pipeline_obj_t *self = MP_OBJ_TO_PTR(args[0]);
+        stage->other = py_helper_arg_to_image_mutable(args[1]);
+        self->operands[self->_cobj.n_stages - 1] = args[1];
+    } else {
+        // Colors are kept as RGB888 and converted to the format the stage ends up running in.
+        image_t rgb = {.pixfmt = PIXFORMAT_RGB888};
+        stage->color = py_helper_keyword_color(&rgb, n_args, args, 1, NULL, 0);
+    }
+
+    return stage;
+}
+
+STATIC void py_pipeline_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind) {
+    py_pipeline_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    mp_printf(print, "{\"stages\":%d}", self->_cobj.n_stages);
+}
+
+STATIC mp_obj_t py_pipeline_add(size_t n_args, const mp_obj_t *args) {
+    py_pipeline_push_operand(n_args, args, PIPELINE_OP_ADD);
+    return args[0];
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(py_pipeline_add_obj, 2, 2, py_pipeline_add);
+
+STATIC mp_obj_t py_pipeline_sub(size_t n_args, const mp_obj_t *args, mp_map_t *kw_args) {
+    pipeline_stage_t *stage = py_pipeline_push_operand(n_args, args, PIPELINE_OP_SUB);
+    stage->invert =
+        py_helper_keyword_int(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_reverse), false);
+    return args[0];
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_pipeline_sub_obj, 2, py_pipeline_sub);
+
+STATIC mp_obj_t py_pipeline_mul(size_t n_args, const mp_obj_t *args, mp_map_t *kw_args) {
+    pipeline_stage_t *stage = py_pipeline_push_operand(n_args, args, PIPELINE_OP_MUL);
+    stage->invert =
+        py_helper_keyword_int(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_invert), false);
+    return args[0];
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_pipeline_mul_obj, 2, py_pipeline_mul);
+
+STATIC mp_obj_t py_pipeline_div(size_t n_args, const mp_obj_t *args, mp_map_t *kw_args) {
+    pipeline_stage_t *stage = py_pipeline_push_operand(n_args, args, PIPELINE_OP_DIV);
+    stage->invert =
+        py_helper_keyword_int(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_invert), false);
+    stage->mod =
+        py_helper_keyword_int(n_args, args, 3, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_mod), false);
+    return args[0];
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_pipeline_div_obj, 2, py_pipeline_div);
+
+#define PY_PIPELINE_OPERAND_OP(name, op)                                        \
+    STATIC mp_obj_t py_pipeline_##name(size_t n_args, const mp_obj_t *args) {   \
+        py_pipeline_push_operand(n_args, args, op);                             \
+        return args[0];                                                         \
+    }                                                                           \
+    STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(py_pipeline_##name##_obj, 2, 2, py_pipeline_##name);
+
+PY_PIPELINE_OPERAND_OP(min, PIPELINE_OP_MIN)
+PY_PIPELINE_OPERAND_OP(max, PIPELINE_OP_MAX)
+PY_PIPELINE_OPERAND_OP(difference, PIPELINE_OP_DIFFERENCE)
+PY_PIPELINE_OPERAND_OP(b_and, PIPELINE_OP_B_AND)
+PY_PIPELINE_OPERAND_OP(b_nand, PIPELINE_OP_B_NAND)
+PY_PIPELINE_OPERAND_OP(b_or, PIPELINE_OP_B_OR)
+PY_PIPELINE_OPERAND_OP(b_nor, PIPELINE_OP_B_NOR)
+PY_PIPELINE_OPERAND_OP(b_xor, PIPELINE_OP_B_XOR)
+PY_PIPELINE_OPERAND_OP(b_xnor, PIPELINE_OP_B_XNOR)
+
+#define PY_PIPELINE_UNARY_OP(name, op)                                          \
+    STATIC mp_obj_t py_pipeline_##name(mp_obj_t self_in) {                      \
+        py_pipeline_push(self_in, op, 0);                                       \
+        return self_in;                                                         \
+    }                                                                           \
+    STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_pipeline_##name##_obj, py_pipeline_##name);
+
+PY_PIPELINE_UNARY_OP(invert, PIPELINE_OP_INVERT)
+PY_PIPELINE_UNARY_OP(negate, PIPELINE_OP_NEGATE)
+PY_PIPELINE_UNARY_OP(to_bitmap, PIPELINE_OP_TO_BITMAP)
+PY_PIPELINE_UNARY_OP(to_grayscale, PIPELINE_OP_TO_GRAYSCALE)
+PY_PIPELINE_UNARY_OP(to_rgb565, PIPELINE_OP_TO_RGB565)
+
+STATIC mp_obj_t py_pipeline_binary(size_t n_args, const mp_obj_t *args, mp_map_t *kw_args) {
+    list_t *thresholds = m_new_obj(list_t);
+    list_init(thresholds, sizeof(color_thresholds_list_lnk_data_t));
+    py_helper_arg_to_thresholds(args[1], thresholds);
+
+    pipeline_stage_t *stage = py_pipeline_push(args[0], PIPELINE_OP_BINARY, 0);
+    stage->thresholds = thresholds;
+    stage->invert =
+        py_helper_keyword_int(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_invert), false);
+    stage->zero =
+        py_helper_keyword_int(n_args, args, 3, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_zero), false);
+    stage->to_bitmap =
+        py_helper_keyword_int(n_args, args, 4, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_to_bitmap), false);
+    return args[0];
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_pipeline_binary_obj, 2, py_pipeline_binary);
+
+STATIC mp_obj_t py_pipeline_erode(size_t n_args, const mp_obj_t *args, mp_map_t *kw_args) {
+    int arg_ksize =
+        py_helper_arg_to_ksize(args[1]);
+    pipeline_stage_t *stage = py_pipeline_push(args[0], PIPELINE_OP_ERODE, arg_ksize);
+    stage->threshold =
+        py_helper_keyword_int(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_threshold),
+                              py_helper_ksize_to_n(arg_ksize) - 1);
+    return args[0];
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_pipeline_erode_obj, 2, py_pipeline_erode);
+
+STATIC mp_obj_t py_pipeline_dilate(size_t n_args, const mp_obj_t *args, mp_map_t *kw_args) {
+    int arg_ksize =
+        py_helper_arg_to_ksize(args[1]);
+    pipeline_stage_t *stage = py_pipeline_push(args[0], PIPELINE_OP_DILATE, arg_ksize);
+    stage->threshold =
+        py_helper_keyword_int(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_threshold), 0);
+    return args[0];
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_pipeline_dilate_obj, 2, py_pipeline_dilate);
+
+// open() and close() record the same erode/dilate pair as imlib_open()/imlib_close().
+STATIC mp_obj_t py_pipeline_open_close(size_t n_args, const mp_obj_t *args, mp_map_t *kw_args, bool open) {
+    int arg_ksize =
+        py_helper_arg_to_ksize(args[1]);
+    int arg_threshold =
+        py_helper_keyword_int(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_threshold), 0);
+
+    for (int i = 0; i < 2; i++) {
+        bool erode = open ^ i;
+        pipeline_stage_t *stage = py_pipeline_push(args[0], erode ? PIPELINE_OP_ERODE : PIPELINE_OP_DILATE, arg_ksize);
+        stage->threshold = erode ? (py_helper_ksize_to_n(arg_ksize) - 1 - arg_threshold) : arg_threshold;
+    }
+
+    return args[0];
+}
+
+STATIC mp_obj_t py_pipeline_open(size_t n_args, const mp_obj_t *args, mp_map_t *kw_args) {
+    return py_pipeline_open_close(n_args, args, kw_args, true);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_pipeline_open_obj, 2, py_pipeline_open);
+
+STATIC mp_obj_t py_pipeline_close(size_t n_args, const mp_obj_t *args, mp_map_t *kw_args) {
+    return py_pipeline_open_close(n_args, args, kw_args, false);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_pipeline_close_obj, 2, py_pipeline_close);
+
+STATIC void py_pipeline_morph_args(pipeline_stage_t *stage, int m, size_t n_args, const mp_obj_t *args, mp_map_t *kw_args) {
+    stage->mul =
+        py_helper_keyword_float(n_args, args, 3, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_mul), 1.0f / m);
+    stage->add =
+        py_helper_keyword_float(n_args, args, 4, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_add), 0.0f);
+    stage->morph_threshold =
+        py_helper_keyword_int(n_args, args, 5, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_threshold), false);
+    stage->offset =
+        py_helper_keyword_int(n_args, args, 6, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_offset), 0);
+    stage->invert =
+        py_helper_keyword_int(n_args, args, 7, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_invert), false);
+}
+
+STATIC mp_obj_t py_pipeline_morph(size_t n_args, const mp_obj_t *args, mp_map_t *kw_args) {
+    int arg_ksize =
+        py_helper_arg_to_ksize(args[1]);
+
+    int n = py_helper_ksize_to_n(arg_ksize);
+
+    mp_obj_t *krn;
+    mp_obj_get_array_fixed_n(args[2], n, &krn);
+
+    int *arg_krn = m_new(int, n);
+    int arg_m = 0;
+
+    for (int i = 0; i < n; i++) {
+        arg_krn[i] = mp_obj_get_int(krn[i]);
+        arg_m += arg_krn[i];
+    }
+
+    if (arg_m == 0) {
+        arg_m = 1;
+    }
+
+    pipeline_stage_t *stage = py_pipeline_push(args[0], PIPELINE_OP_MORPH, arg_ksize);
+    stage->krn = arg_krn;
+    py_pipeline_morph_args(stage, arg_m, n_args, args, kw_args);
+    return args[0];
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_pipeline_morph_obj, 3, py_pipeline_morph);
+
+// Same kernel as Image.gaussian(), recorded as its pascal row so it runs as two O(n) passes.
+STATIC mp_obj_t py_pipeline_gaussian(size_t n_args, const mp_obj_t *args, mp_map_t *kw_args) {
+    int arg_ksize =
+        py_helper_arg_to_ksize(args[1]);
+    PY_ASSERT_TRUE_MSG(arg_ksize <= PIPELINE_GAUSSIAN_MAX_KSIZE, "KernelSize must be <= 8!");
+
+    int k_2 = arg_ksize * 2;
+    int n = k_2 + 1;
+
+    int *pascal = m_new(int, n);
+    pascal[0] = 1;
+
+    for (int i = 0; i < k_2; i++) {
+        // Compute a row of pascal's triangle.
+        pascal[i + 1] = (pascal[i] * (k_2 - i)) / (i + 1);
+    }
+
+    pipeline_stage_t *stage = py_pipeline_push(args[0], PIPELINE_OP_MORPH, arg_ksize);
+    stage->krn_sep = pascal;
+
+    // The mul/add/threshold/offset/invert keywords follow the unsharp keyword (index 2).
+    bool arg_unsharp =
+        py_helper_keyword_int(n_args, args, 2, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_unsharp), false);
+    stage->krn_center = arg_unsharp ? -2 : 0;
+    py_pipeline_morph_args(stage, arg_unsharp ? -1 : 1, n_args, args, kw_args);
+
+    mp_obj_t arg_mul_obj =
+        py_helper_keyword_object(n_args, args, 3, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_mul), NULL);
+
+    if (arg_mul_obj) {
+        // mul scales the sum of the pascal kernel, 2^(4 * ksize), the stage works on normalized values.
+        stage->mul = mp_obj_get_float(arg_mul_obj) * (float) (1LL << (k_2 * 2));
+    }
+
+    return args[0];
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_pipeline_gaussian_obj, 2, py_pipeline_gaussian);
+
+STATIC mp_obj_t py_pipeline_clear(mp_obj_t self_in) {
+    py_pipeline_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    imlib_pipeline_init(&self->_cobj);
+    memset(self->operands, 0, sizeof(self->operands));
+    return self_in;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_pipeline_clear_obj, py_pipeline_clear);
+
+STATIC mp_obj_t py_pipeline_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *args) {
+    mp_arg_check_num(n_args, n_kw, 0, 0, false);
+
+    py_pipeline_obj_t *self = m_new_obj(py_pipeline_obj_t);
+    self->base.type = &py_pipeline_type;
+    py_pipeline_clear(MP_OBJ_FROM_PTR(self));
+    return MP_OBJ_FROM_PTR(self);
+}
+
+STATIC const mp_rom_map_elem_t py_pipeline_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR_add),             MP_ROM_PTR(&py_pipeline_add_obj)           },
+    { MP_ROM_QSTR(MP_QSTR_sub),             MP_ROM_PTR(&py_pipeline_sub_obj)           },
+    { MP_ROM_QSTR(MP_QSTR_mul),             MP_ROM_PTR(&py_pipeline_mul_obj)           },
+    { MP_ROM_QSTR(MP_QSTR_div),             MP_ROM_PTR(&py_pipeline_div_obj)           },
+    { MP_ROM_QSTR(MP_QSTR_min),             MP_ROM_PTR(&py_pipeline_min_obj)           },
+    { MP_ROM_QSTR(MP_QSTR_max),             MP_ROM_PTR(&py_pipeline_max_obj)           },
+    { MP_ROM_QSTR(MP_QSTR_difference),      MP_ROM_PTR(&py_pipeline_difference_obj)    },
+    { MP_ROM_QSTR(MP_QSTR_b_and),           MP_ROM_PTR(&py_pipeline_b_and_obj)         },
+    { MP_ROM_QSTR(MP_QSTR_b_nand),          MP_ROM_PTR(&py_pipeline_b_nand_obj)        },
+    { MP_ROM_QSTR(MP_QSTR_b_or),            MP_ROM_PTR(&py_pipeline_b_or_obj)          },
+    { MP_ROM_QSTR(MP_QSTR_b_nor),           MP_ROM_PTR(&py_pipeline_b_nor_obj)         },
+    { MP_ROM_QSTR(MP_QSTR_b_xor),           MP_ROM_PTR(&py_pipeline_b_xor_obj)         },
+    { MP_ROM_QSTR(MP_QSTR_b_xnor),          MP_ROM_PTR(&py_pipeline_b_xnor_obj)        },
+    { MP_ROM_QSTR(MP_QSTR_invert),          MP_ROM_PTR(&py_pipeline_invert_obj)        },
+    { MP_ROM_QSTR(MP_QSTR_negate),          MP_ROM_PTR(&py_pipeline_negate_obj)        },
+    { MP_ROM_QSTR(MP_QSTR_binary),          MP_ROM_PTR(&py_pipeline_binary_obj)        },
+    { MP_ROM_QSTR(MP_QSTR_to_bitmap),       MP_ROM_PTR(&py_pipeline_to_bitmap_obj)     },
+    { MP_ROM_QSTR(MP_QSTR_to_grayscale),    MP_ROM_PTR(&py_pipeline_to_grayscale_obj)  },
+    { MP_ROM_QSTR(MP_QSTR_to_rgb565),       MP_ROM_PTR(&py_pipeline_to_rgb565_obj)     },
+    { MP_ROM_QSTR(MP_QSTR_erode),           MP_ROM_PTR(&py_pipeline_erode_obj)         },
+    { MP_ROM_QSTR(MP_QSTR_dilate),          MP_ROM_PTR(&py_pipeline_dilate_obj)        },
+    { MP_ROM_QSTR(MP_QSTR_open),            MP_ROM_PTR(&py_pipeline_open_obj)          },
+    { MP_ROM_QSTR(MP_QSTR_close),           MP_ROM_PTR(&py_pipeline_close_obj)         },
+    { MP_ROM_QSTR(MP_QSTR_morph),           MP_ROM_PTR(&py_pipeline_morph_obj)         },
+    { MP_ROM_QSTR(MP_QSTR_gaussian),        MP_ROM_PTR(&py_pipeline_gaussian_obj)      },
+    { MP_ROM_QSTR(MP_QSTR_clear),           MP_ROM_PTR(&py_pipeline_clear_obj)         }
+};
+
+STATIC MP_DEFINE_CONST_DICT(py_pipeline_locals_dict, py_pipeline_locals_dict_table);
+
+MP_DEFINE_CONST_OBJ_TYPE(
+    py_pipeline_type,
+    MP_QSTR_Pipeline,
+    MP_TYPE_FLAG_NONE,
+    print, py_pipeline_print,
+    make_new, py_pipeline_make_new,
+    locals_dict, &py_pipeline_locals_dict
+    );
+#endif // IMLIB_ENABLE_PIPELINE
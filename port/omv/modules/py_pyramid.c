@@ -0,0 +1,161 @@
+/*
+ * This file is part of the OpenMV project.
+ *
+ * Copyright (c) 2013-2021 Ibrahim Abdelkader <iabdalkader@openmv.io>
+ * Copyright (c) 2013-2021 Kwabena W. Agyeman <kwagyeman@openmv.io>
+ *
+ * This work is licensed under the MIT license, see the file LICENSE for details.
+ *
+ * Image pyramid Python module.
+ */
+#include "imlib_config.h"
+#if defined(IMLIB_ENABLE_PYRAMID)
+
+#include "py/obj.h"
+#include "py/nlr.h"
+#include "py/runtime.h"
+
+#include "py_assert.h"
+#include "py_helper.h"
+#include "py_image.h"
+#include "py_pyramid.h"
+
+typedef struct py_pyramid_obj {
+    mp_obj_base_t base;
+    mp_obj_t img;           // Keeps the current frame alive.
+    pyramid_t _cobj;
+} py_pyramid_obj_t;
+
+pyramid_t *py_pyramid_cobj(mp_obj_t obj) {
+    PY_ASSERT_TYPE(obj, &py_pyramid_type);
+    py_pyramid_obj_t *self = MP_OBJ_TO_PTR(obj);
+    PY_ASSERT_TRUE_MSG(self->_cobj.n_levels, "Pyramid has no image, call update() first");
+    return &self->_cobj;
+}
+
+// Returns the "pyramid" keyword argument if set, the pyramid must have been built from img.
+pyramid_t *py_helper_keyword_pyramid(image_t *img, uint n_args, const mp_obj_t *args, uint arg_index, mp_map_t *kw_args) {
+    mp_obj_t obj = py_helper_keyword_object(n_args, args, arg_index, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_pyramid), NULL);
+
+    if (obj == NULL || obj == mp_const_none) {
+        return NULL;
+    }
+
+    pyramid_t *pyr = py_pyramid_cobj(obj);
+    PY_ASSERT_TRUE_MSG((pyr->src.w == img->w) && (pyr->src.h == img->h) && (pyr->src.data == img->data),
+                       "Pyramid was not built from this image");
+    return pyr;
+}
+
+STATIC void py_pyramid_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind) {
+    py_pyramid_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    mp_printf(print, "{\"w\":%d, \"h\":%d, \"levels\":%d, \"scale_factor\":%f, \"luma\":%s}",
+              self->_cobj.src.w,
+              self->_cobj.src.h,
+              self->_cobj.n_levels,
+              (double) self->_cobj.scale_factor,
+              self->_cobj.luma ? "true" : "false");
+}
+
+STATIC mp_obj_t py_pyramid_update(mp_obj_t self_in, mp_obj_t img_obj) {
+    py_pyramid_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    image_t *img = py_helper_arg_to_image_not_compressed(img_obj);
+    imlib_pyramid_update(&self->_cobj, img);
+    self->img = img_obj;
+    return self_in;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(py_pyramid_update_obj, py_pyramid_update);
+
+STATIC mp_obj_t py_pyramid_levels(mp_obj_t self_in) {
+    py_pyramid_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    return mp_obj_new_int(self->_cobj.n_levels);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_pyramid_levels_obj, py_pyramid_levels);
+
+// Returns an image referencing the level buffer, it is valid until the next update().
+STATIC mp_obj_t py_pyramid_level(mp_obj_t self_in, mp_obj_t level_obj) {
+    pyramid_t *pyr = py_pyramid_cobj(self_in);
+    int level = mp_obj_get_int(level_obj);
+    PY_ASSERT_TRUE_MSG((level >= 0) && (level < pyr->n_levels), "Invalid pyramid level");
+
+    image_t img = *imlib_pyramid_level(pyr, level);
+    img.alloc_type = ALLOC_REF;
+    img.ref_obj = self_in;
+    img.phy_addr = 0;
+    img.pool_id = 0;
+    return py_image_from_struct(&img);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(py_pyramid_level_obj, py_pyramid_level);
+
+STATIC mp_obj_t py_pyramid_scale(mp_obj_t self_in, mp_obj_t level_obj) {
+    pyramid_t *pyr = py_pyramid_cobj(self_in);
+    int level = mp_obj_get_int(level_obj);
+    PY_ASSERT_TRUE_MSG((level >= 0) && (level < pyr->n_levels), "Invalid pyramid level");
+    return mp_obj_new_tuple(2, (mp_obj_t []) {mp_obj_new_float(pyr->levels[level].x_scale),
+                                               mp_obj_new_float(pyr->levels[level].y_scale)});
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(py_pyramid_scale_obj, py_pyramid_scale);
+
+STATIC mp_obj_t py_pyramid_find_level(mp_obj_t self_in, mp_obj_t scale_obj) {
+    pyramid_t *pyr = py_pyramid_cobj(self_in);
+    return mp_obj_new_int(imlib_pyramid_find_level(pyr, mp_obj_get_float(scale_obj)));
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(py_pyramid_find_level_obj, py_pyramid_find_level);
+
+STATIC mp_obj_t py_pyramid_free(mp_obj_t self_in) {
+    py_pyramid_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    imlib_pyramid_free(&self->_cobj);
+    self->img = mp_const_none;
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_pyramid_free_obj, py_pyramid_free);
+
+STATIC mp_obj_t py_pyramid_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *args) {
+    mp_arg_check_num(n_args, n_kw, 0, 5, true);
+
+    mp_map_t kw_args;
+    mp_map_init_fixed_table(&kw_args, n_kw, args + n_args);
+
+    float scale_factor =
+        py_helper_keyword_float(n_args, args, 1, &kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_scale_factor), 1.5f);
+    PY_ASSERT_TRUE_MSG((scale_factor > 1.0f) && (scale_factor <= 8.0f), "1 < scale_factor <= 8!");
+    int levels =
+        py_helper_keyword_int(n_args, args, 2, &kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_levels), PYRAMID_MAX_LEVELS);
+    PY_ASSERT_TRUE_MSG((levels > 0) && (levels <= PYRAMID_MAX_LEVELS), "Invalid number of levels!");
+    int min_size =
+        py_helper_keyword_int(n_args, args, 3, &kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_min_size), 16);
+    bool luma =
+        py_helper_keyword_int(n_args, args, 4, &kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_luma), true);
+
+    py_pyramid_obj_t *self = m_new_obj_with_finaliser(py_pyramid_obj_t);
+    self->base.type = &py_pyramid_type;
+    self->img = mp_const_none;
+    imlib_pyramid_init(&self->_cobj, scale_factor, levels, min_size, luma);
+
+    if (n_args > 0 && args[0] != mp_const_none) {
+        py_pyramid_update(MP_OBJ_FROM_PTR(self), args[0]);
+    }
+
+    return MP_OBJ_FROM_PTR(self);
+}
+
+STATIC const mp_rom_map_elem_t py_pyramid_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR___del__),         MP_ROM_PTR(&py_pyramid_free_obj)        },
+    { MP_ROM_QSTR(MP_QSTR_update),          MP_ROM_PTR(&py_pyramid_update_obj)      },
+    { MP_ROM_QSTR(MP_QSTR_levels),          MP_ROM_PTR(&py_pyramid_levels_obj)      },
+    { MP_ROM_QSTR(MP_QSTR_level),           MP_ROM_PTR(&py_pyramid_level_obj)       },
+    { MP_ROM_QSTR(MP_QSTR_scale),           MP_ROM_PTR(&py_pyramid_scale_obj)       },
+    { MP_ROM_QSTR(MP_QSTR_find_level),      MP_ROM_PTR(&py_pyramid_find_level_obj)  }
+};
+
+STATIC MP_DEFINE_CONST_DICT(py_pyramid_locals_dict, py_pyramid_locals_dict_table);
+
+MP_DEFINE_CONST_OBJ_TYPE(
+    py_pyramid_type,
+    MP_QSTR_Pyramid,
+    MP_TYPE_FLAG_NONE,
+    print, py_pyramid_print,
+    make_new, py_pyramid_make_new,
+    locals_dict, &py_pyramid_locals_dict
+    );
+#endif // IMLIB_ENABLE_PYRAMID
@@ -0,0 +1,17 @@
+/*
+ * This file is part of the OpenMV project.
+ *
+ * Copyright (c) 2013-2021 Ibrahim Abdelkader <iabdalkader@openmv.io>
+ * Copyright (c) 2013-2021 Kwabena W. Agyeman <kwagyeman@openmv.io>
+ *
+ * This work is licensed under the MIT license, see the file LICENSE for details.
+ *
+ * Image pyramid Python module.
+ */
+#ifndef __PY_PYRAMID_H__
+#define __PY_PYRAMID_H__
+#include "imlib.h"
+extern const mp_obj_type_t py_pyramid_type;
+pyramid_t *py_pyramid_cobj(mp_obj_t obj);
+pyramid_t *py_helper_keyword_pyramid(image_t *img, uint n_args, const mp_obj_t *args, uint arg_index, mp_map_t *kw_args);
+#endif // __PY_PYRAMID_H__
@@ -0,0 +1,187 @@
+/*
+ * This file is part of the OpenMV project.
+ *
+ * Copyright (c) 2013-2021 Ibrahim Abdelkader <iabdalkader@openmv.io>
+ * Copyright (c) 2013-2021 Kwabena W. Agyeman <kwagyeman@openmv.io>
+ *
+ * This work is licensed under the MIT license, see the file LICENSE for details.
+ *
+ * Image remap Python module.
+ */
+#include "imlib_config.h"
+#if defined(IMLIB_ENABLE_REMAP)
+
+#include "py/obj.h"
+#include "py/nlr.h"
+#include "py/runtime.h"
+
+#include "py_assert.h"
+#include "py_helper.h"
+#include "py_image.h"
+#include "py_remap.h"
+
+typedef struct py_remap_obj {
+    mp_obj_base_t base;
+    remap_t _cobj;
+} py_remap_obj_t;
+
+remap_t *py_remap_cobj(mp_obj_t obj) {
+    PY_ASSERT_TYPE(obj, &py_remap_type);
+    py_remap_obj_t *self = MP_OBJ_TO_PTR(obj);
+    PY_ASSERT_TRUE_MSG(self->_cobj.map, "Remap has not been compiled!");
+    return &self->_cobj;
+}
+
+STATIC void py_remap_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind) {
+    py_remap_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    mp_printf(print, "{\"w\":%d, \"h\":%d, \"type\":\"%s\"}",
+              self->_cobj.w,
+              self->_cobj.h,
+              (self->_cobj.type == REMAP_TYPE_LENS_CORR) ? "lens_corr" :
+              (self->_cobj.type == REMAP_TYPE_ROTATION_CORR) ? "rotation_corr" :
+              (self->_cobj.type == REMAP_TYPE_HOMOGRAPHY) ? "homography" : "none");
+}
+
+STATIC mp_obj_t py_remap_width(mp_obj_t self_in) {
+    return mp_obj_new_int(((py_remap_obj_t *) MP_OBJ_TO_PTR(self_in))->_cobj.w);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_remap_width_obj, py_remap_width);
+
+STATIC mp_obj_t py_remap_height(mp_obj_t self_in) {
+    return mp_obj_new_int(((py_remap_obj_t *) MP_OBJ_TO_PTR(self_in))->_cobj.h);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_remap_height_obj, py_remap_height);
+
+#ifdef IMLIB_ENABLE_LENS_CORR
+STATIC mp_obj_t py_remap_lens_corr(size_t n_args, const mp_obj_t *args, mp_map_t *kw_args) {
+    py_remap_obj_t *self = MP_OBJ_TO_PTR(args[0]);
+    int arg_w = mp_obj_get_int(args[1]);
+    int arg_h = mp_obj_get_int(args[2]);
+    PY_ASSERT_FALSE_MSG(arg_w % 2, "Width must be even!");
+    PY_ASSERT_FALSE_MSG(arg_h % 2, "Height must be even!");
+    float arg_strength =
+        py_helper_keyword_float(n_args, args, 3, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_strength), 1.8f);
+    PY_ASSERT_TRUE_MSG(arg_strength > 0.0f, "Strength must be > 0!");
+    float arg_zoom =
+        py_helper_keyword_float(n_args, args, 4, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_zoom), 1.0f);
+    PY_ASSERT_TRUE_MSG(arg_zoom > 0.0f, "Zoom must be > 0!");
+    float arg_x_corr =
+        py_helper_keyword_float(n_args, args, 5, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_x_corr), 0.0f);
+    float arg_y_corr =
+        py_helper_keyword_float(n_args, args, 6, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_y_corr), 0.0f);
+
+    fb_alloc_mark();
+    imlib_remap_lens_corr(&self->_cobj, arg_w, arg_h, arg_strength, arg_zoom, arg_x_corr, arg_y_corr);
+    fb_alloc_free_till_mark();
+    return args[0];
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_remap_lens_corr_obj, 3, py_remap_lens_corr);
+#endif // IMLIB_ENABLE_LENS_CORR
+
+#ifdef IMLIB_ENABLE_ROTATION_CORR
+STATIC mp_obj_t py_remap_rotation_corr(size_t n_args, const mp_obj_t *args, mp_map_t *kw_args) {
+    py_remap_obj_t *self = MP_OBJ_TO_PTR(args[0]);
+    int arg_w = mp_obj_get_int(args[1]);
+    int arg_h = mp_obj_get_int(args[2]);
+    float arg_x_rotation =
+        IM_DEG2RAD(py_helper_keyword_float(n_args, args, 3, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_x_rotation), 0.0f));
+    float arg_y_rotation =
+        IM_DEG2RAD(py_helper_keyword_float(n_args, args, 4, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_y_rotation), 0.0f));
+    float arg_z_rotation =
+        IM_DEG2RAD(py_helper_keyword_float(n_args, args, 5, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_z_rotation), 0.0f));
+    float arg_x_translation =
+        py_helper_keyword_float(n_args, args, 6, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_x_translation), 0.0f);
+    float arg_y_translation =
+        py_helper_keyword_float(n_args, args, 7, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_y_translation), 0.0f);
+    float arg_zoom =
+        py_helper_keyword_float(n_args, args, 8, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_zoom), 1.0f);
+    PY_ASSERT_TRUE_MSG(arg_zoom > 0.0f, "Zoom must be > 0!");
+    float arg_fov =
+        IM_DEG2RAD(py_helper_keyword_float(n_args, args, 9, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_fov), 60.0f));
+    PY_ASSERT_TRUE_MSG((0.0f < arg_fov) && (arg_fov < 180.0f), "FOV must be > 0 and < 180!");
+    float data[8];
+    float *arg_corners = py_helper_keyword_corner_array(n_args, args, 10, kw_args, MP_OBJ_NEW_QSTR(MP_QSTR_corners), data);
+
+    fb_alloc_mark();
+    imlib_remap_rotation_corr(&self->_cobj, arg_w, arg_h,
+                              arg_x_rotation, arg_y_rotation, arg_z_rotation,
+                              arg_x_translation, arg_y_translation,
+                              arg_zoom, arg_fov, arg_corners);
+    fb_alloc_free_till_mark();
+    return args[0];
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(py_remap_rotation_corr_obj, 3, py_remap_rotation_corr);
+#endif // IMLIB_ENABLE_ROTATION_CORR
+
+// The matrix maps destination pixels to source pixels, either a 3x3 nested list or 9 values.
+STATIC mp_obj_t py_remap_homography(size_t n_args, const mp_obj_t *args) {
+    py_remap_obj_t *self = MP_OBJ_TO_PTR(args[0]);
+    int arg_w = mp_obj_get_int(args[1]);
+    int arg_h = mp_obj_get_int(args[2]);
+    float H[9];
+
+    size_t len;
+    mp_obj_t *items;
+    mp_obj_get_array(args[3], &len, &items);
+
+    if (len == 9) {
+        for (size_t i = 0; i < 9; i++) {
+            H[i] = mp_obj_get_float(items[i]);
+        }
+    } else if (len == 3) {
+        for (size_t i = 0; i < 3; i++) {
+            mp_obj_t *row;
+            mp_obj_get_array_fixed_n(items[i], 3, &row);
+            for (size_t j = 0; j < 3; j++) {
+                H[(i * 3) + j] = mp_obj_get_float(row[j]);
+            }
+        }
+    } else {
+        mp_raise_msg(&mp_type_ValueError, MP_ERROR_TEXT("Expected a 3x3 matrix!"));
+    }
+
+    imlib_remap_homography(&self->_cobj, arg_w, arg_h, H);
+    return args[0];
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(py_remap_homography_obj, 4, 4, py_remap_homography);
+
+STATIC mp_obj_t py_remap_free(mp_obj_t self_in) {
+    py_remap_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    imlib_remap_free(&self->_cobj);
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(py_remap_free_obj, py_remap_free);
+
+STATIC mp_obj_t py_remap_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *args) {
+    mp_arg_check_num(n_args, n_kw, 0, 0, false);
+
+    py_remap_obj_t *self = m_new_obj_with_finaliser(py_remap_obj_t);
+    self->base.type = &py_remap_type;
+    imlib_remap_init(&self->_cobj);
+    return MP_OBJ_FROM_PTR(self);
+}
+
+STATIC const mp_rom_map_elem_t py_remap_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR___del__),         MP_ROM_PTR(&py_remap_free_obj)          },
+    { MP_ROM_QSTR(MP_QSTR_width),           MP_ROM_PTR(&py_remap_width_obj)         },
+    { MP_ROM_QSTR(MP_QSTR_height),          MP_ROM_PTR(&py_remap_height_obj)        },
+    #ifdef IMLIB_ENABLE_LENS_CORR
+    { MP_ROM_QSTR(MP_QSTR_lens_corr),       MP_ROM_PTR(&py_remap_lens_corr_obj)     },
+    #endif
+    #ifdef IMLIB_ENABLE_ROTATION_CORR
+    { MP_ROM_QSTR(MP_QSTR_rotation_corr),   MP_ROM_PTR(&py_remap_rotation_corr_obj) },
+    #endif
+    { MP_ROM_QSTR(MP_QSTR_homography),      MP_ROM_PTR(&py_remap_homography_obj)    }
+};
+
+STATIC MP_DEFINE_CONST_DICT(py_remap_locals_dict, py_remap_locals_dict_table);
+
+MP_DEFINE_CONST_OBJ_TYPE(
+    py_remap_type,
+    MP_QSTR_Remap,
+    MP_TYPE_FLAG_NONE,
+    print, py_remap_print,
+    make_new, py_remap_make_new,
+    locals_dict, &py_remap_locals_dict
+    );
+#endif // IMLIB_ENABLE_REMAP
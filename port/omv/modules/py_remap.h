@@ -0,0 +1,16 @@
+/*
+ * This file is part of the OpenMV project.
+ *
+ * Copyright (c) 2013-2021 Ibrahim Abdelkader <iabdalkader@openmv.io>
+ * Copyright (c) 2013-2021 Kwabena W. Agyeman <kwagyeman@openmv.io>
+ *
+ * This work is licensed under the MIT license, see the file LICENSE for details.
+ *
+ * Image remap Python module.
+ */
+#ifndef __PY_REMAP_H__
+#define __PY_REMAP_H__
+#include "imlib.h"
+extern const mp_obj_type_t py_remap_type;
+remap_t *py_remap_cobj(mp_obj_t obj);
+#endif // __PY_REMAP_H__